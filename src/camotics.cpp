@@ -30,6 +30,15 @@
 using namespace std;
 
 
+#ifdef HAVE_V8
+#include <cbang/v8/JSImpl.h>
+#endif
+
+
 int main(int argc, char *argv[]) {
+#ifdef HAVE_V8
+  gv8::JSImpl::init(0, 0); // For TPL run in process
+#endif
+
   return cb::doApplication<CAMotics::QtApp>(argc, argv);
 }
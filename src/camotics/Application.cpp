@@ -19,6 +19,7 @@
 \******************************************************************************/
 
 #include "Application.h"
+#include "Trace.h"
 
 #include <cbang/Info.h>
 #include <cbang/log/Logger.h>
@@ -67,6 +68,25 @@ Application::Application(const string &name, hasFeature_t hasFeature) :
   }
 
   cmdLine.setShowKeywordOpts(false);
+  cmdLine.addTarget("trace", trace, "Record a timeline of the simulation "
+                    "phases and write it to this file, on exit, as Chrome "
+                    "trace JSON for chrome://tracing or Perfetto.");
+}
+
+
+Application::~Application() {
+  if (trace.empty()) return;
+
+  try {
+    Trace::write(trace);
+  } CATCH_ERROR;
+}
+
+
+int Application::init(int argc, char *argv[]) {
+  int ret = cb::Application::init(argc, argv);
+  if (!trace.empty()) Trace::setEnabled(true);
+  return ret;
 }
 
 
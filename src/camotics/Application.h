@@ -27,12 +27,16 @@
 
 namespace CAMotics {
   class Application : public cb::Application, public cb::Reader {
+    std::string trace;
+
   public:
     Application(const std::string &name,
                 hasFeature_t hasFeature = Application::_hasFeature);
+    ~Application();
 
     // From cb::Application
     static bool _hasFeature(int feature);
+    int init(int argc, char *argv[]);
     void run();
 
     // From cb::Reader
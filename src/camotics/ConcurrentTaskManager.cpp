@@ -29,47 +29,57 @@ using namespace cb;
 using namespace CAMotics;
 
 
-ConcurrentTaskManager::ConcurrentTaskManager() {
+ConcurrentTaskManager::ConcurrentTaskManager(unsigned threads) {
   start();
+
+  for (unsigned i = 1; i < threads; i++) {
+    workers.push_back(new Worker(*this));
+    workers.back()->start();
+  }
 }
 
 
 ConcurrentTaskManager::~ConcurrentTaskManager() {
   stop();
-  signal();
   join();
+
+  for (unsigned i = 0; i < workers.size(); i++) workers[i]->join();
 }
 
 
 double ConcurrentTaskManager::getProgress() const {
-  SmartLock lock(this);
+  SmartPointer<Task> current = getCurrent();
   return current.isNull() ? 0 : current->getProgress();
 }
 
 
 double ConcurrentTaskManager::getETA() const {
-  SmartLock lock(this);
+  SmartPointer<Task> current = getCurrent();
   return current.isNull() ? 0 : current->getETA();
 }
 
 
 string ConcurrentTaskManager::getStatus() const {
-  SmartLock lock(this);
+  SmartPointer<Task> current = getCurrent();
   return current.isNull() ? "" : current->getStatus();
 }
 
 
-void ConcurrentTaskManager::addTask(const SmartPointer<Task>::Protected &task,
-                                    bool priority) {
+SmartPointer<Task>
+ConcurrentTaskManager::addTask(const SmartPointer<Task>::Protected &task,
+                               bool priority) {
   SmartLock lock(this);
 
-  if (shouldShutdown()) complete(task);
-
-  else {
-    if (priority) interrupt();
-    waiting.push_back(task);
-    signal();
+  if (shouldShutdown()) {
+    complete(task);
+    return task;
   }
+
+  if (priority) interrupt();
+  waiting.push_back(task);
+  broadcast();
+
+  return waiting.back();
 }
 
 
@@ -99,44 +109,91 @@ void ConcurrentTaskManager::addObserver(TaskObserver *observer) {
 void ConcurrentTaskManager::interrupt() {
   SmartLock lock(this);
 
-  if (!current.isNull()) current->interrupt();
+  for (queue_t::iterator it = running.begin(); it != running.end(); it++)
+    (*it)->interrupt();
 
   for (queue_t::iterator it = waiting.begin(); it != waiting.end(); it++)
     (*it)->interrupt();
 }
 
 
-void ConcurrentTaskManager::run() {
+void ConcurrentTaskManager::run() {work();}
+
+
+void ConcurrentTaskManager::stop() {
   SmartLock lock(this);
 
-  while (!shouldShutdown() || !waiting.empty()) {
-    if (waiting.empty()) Condition::wait();
-    if (waiting.empty()) break;
+  Thread::stop();
+  for (unsigned i = 0; i < workers.size(); i++) workers[i]->stop();
 
-    current = waiting.front();
-    waiting.pop_front();
+  broadcast();
+  interrupt();
+}
 
-    if (!shouldShutdown() && !current->shouldQuit()) {
-      SmartUnlock unlock(this);
-      try {
-        current->begin();
-        current->run();
-      } CATCH_ERROR;
 
-      try {current->end();} CATCH_ERROR;
+SmartPointer<Task> ConcurrentTaskManager::getCurrent() const {
+  SmartLock lock(this);
+
+  for (queue_t::const_reverse_iterator it = running.rbegin();
+       it != running.rend(); it++)
+    if (!(*it)->shouldQuit()) return *it;
+
+  return 0;
+}
+
+
+SmartPointer<Task> ConcurrentTaskManager::next() {
+  set<const void *> blocked;
+
+  for (queue_t::iterator it = running.begin(); it != running.end(); it++)
+    if ((*it)->getExclusionKey()) blocked.insert((*it)->getExclusionKey());
+
+  for (queue_t::iterator it = waiting.begin(); it != waiting.end(); it++) {
+    const void *key = (*it)->getExclusionKey();
+
+    if (!key || !blocked.count(key)) {
+      SmartPointer<Task> task = *it;
+      waiting.erase(it);
+      return task;
     }
 
-    complete(current);
-    current.release();
+    blocked.insert(key); // Keep the order of tasks with the same key
   }
+
+  return 0;
 }
 
 
-void ConcurrentTaskManager::stop() {
+void ConcurrentTaskManager::work() {
   SmartLock lock(this);
-  Thread::stop();
-  signal();
-  interrupt();
+
+  while (!shouldShutdown() || !waiting.empty()) {
+    SmartPointer<Task> task = next();
+
+    if (task.isNull()) {
+      if (shouldShutdown() && running.empty()) break;
+      Condition::wait();
+      continue;
+    }
+
+    running.push_back(task);
+
+    if (!shouldShutdown() && !task->shouldQuit()) {
+      SmartUnlock unlock(this);
+      try {
+        task->begin();
+        task->run();
+      } CATCH_ERROR;
+
+      try {task->end();} CATCH_ERROR;
+    }
+
+    running.remove(task);
+    complete(task);
+
+    // Tasks with the same key may start now
+    broadcast();
+  }
 }
 
 
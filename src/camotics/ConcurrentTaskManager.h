@@ -30,29 +30,50 @@
 
 #include <list>
 #include <set>
+#include <vector>
 
 
 namespace CAMotics {
+  /***
+   * Runs tasks on a small pool of threads, the manager's own plus extra
+   * workers.  Adding a priority task interrupts the others, and it starts
+   * right away instead of waiting for them to wind down.  Tasks with the
+   * same Task::getExclusionKey() run one at a time, in the order added.
+   */
   class ConcurrentTaskManager : public cb::Thread, public cb::Condition {
     typedef std::list<cb::SmartPointer<Task> > queue_t;
 
     queue_t waiting;
-    cb::SmartPointer<Task> current;
+    queue_t running; ///< In the order started
     queue_t done;
 
+    class Worker : public cb::Thread {
+      ConcurrentTaskManager &manager;
+
+    public:
+      Worker(ConcurrentTaskManager &manager) : manager(manager) {}
+
+      // From Thread
+      void run() {manager.work();}
+    };
+
+    std::vector<cb::SmartPointer<Worker> > workers;
+
     typedef std::set<TaskObserver *> observers_t;
     observers_t observers;
 
   public:
-    ConcurrentTaskManager();
+    ConcurrentTaskManager(unsigned threads = 4);
     ~ConcurrentTaskManager();
 
     double getProgress() const;
     double getETA() const;
     std::string getStatus() const;
 
-    void addTask(const cb::SmartPointer<Task>::Protected &task,
-                 bool priority = true);
+    /// @return @param task, to check on it later.
+    cb::SmartPointer<Task>
+    addTask(const cb::SmartPointer<Task>::Protected &task,
+            bool priority = true);
     bool hasMore() const;
     cb::SmartPointer<Task> remove();
     void addObserver(TaskObserver *observer);
@@ -63,6 +84,11 @@ namespace CAMotics {
     void stop();
 
   protected:
+    /// @return the most recently started task which was not interrupted.
+    cb::SmartPointer<Task> getCurrent() const;
+    /// @return the next waiting task which may start now or null.
+    cb::SmartPointer<Task> next();
+    void work();
     void interruptTasks();
     void complete(const cb::SmartPointer<Task> &task);
   };
@@ -20,6 +20,8 @@
 
 #include "Grid.h"
 
+#include <cmath>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
@@ -98,3 +100,18 @@ pair<Grid, Grid> Grid::split(unsigned axis) const {
 
   return result;
 }
+
+
+bool Grid::vertexRange(double min, double max, double offset,
+                       double resolution, unsigned count, unsigned &first,
+                       unsigned &last) {
+  double a = ceil((min - offset) / resolution);
+  double b = floor((max - offset) / resolution);
+
+  if (b < 0 || count <= a || b < a) return false;
+
+  first = a < 0 ? 0 : (unsigned)a;
+  last = count <= b ? count - 1 : (unsigned)b;
+
+  return true;
+}
@@ -60,5 +60,12 @@ namespace CAMotics {
     unsigned largestDim() const;
     void partition(std::vector<Grid> &grids, unsigned count) const;
     std::pair<Grid, Grid> split(unsigned axis) const;
+
+    /// Find the first and last of @param count vertices, spaced
+    /// @param resolution apart from @param offset, within [@param min,
+    /// @param max] along one axis.  @return false if there are none.
+    static bool vertexRange(double min, double max, double offset,
+                            double resolution, unsigned count,
+                            unsigned &first, unsigned &last);
   };
 }
@@ -0,0 +1,116 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "MemoryUsage.h"
+
+#include <cbang/String.h>
+#include <cbang/json/Sink.h>
+
+#include <mutex>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  mutex peaksLock;
+  MemoryUsage peaks;
+}
+
+
+void MemoryUsage::add(const string &name, uint64_t bytes) {
+  this->bytes[name] += bytes;
+}
+
+
+uint64_t MemoryUsage::get(const string &name) const {
+  iterator it = bytes.find(name);
+  return it == bytes.end() ? 0 : it->second;
+}
+
+
+uint64_t MemoryUsage::getTotal() const {
+  uint64_t total = 0;
+  for (iterator it = begin(); it != end(); it++) total += it->second;
+  return total;
+}
+
+
+void MemoryUsage::max(const MemoryUsage &o) {
+  for (iterator it = o.begin(); it != o.end(); it++) {
+    uint64_t &b = bytes[it->first];
+    if (b < it->second) b = it->second;
+  }
+}
+
+
+string MemoryUsage::toString() const {
+  string s;
+
+  for (iterator it = begin(); it != end(); it++) {
+    if (!s.empty()) s += ' ';
+    s += it->first + ": " + format(it->second);
+  }
+
+  return s;
+}
+
+
+void MemoryUsage::write(JSON::Sink &sink) const {
+  sink.beginDict();
+  for (iterator it = begin(); it != end(); it++)
+    sink.insert(it->first, it->second);
+  sink.insert("total", getTotal());
+  sink.endDict();
+}
+
+
+string MemoryUsage::format(uint64_t bytes) {
+  static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+
+  double size = bytes;
+  unsigned unit = 0;
+  while (1024 <= size && unit < 4) {
+    size /= 1024;
+    unit++;
+  }
+
+  if (!unit) return String::printf("%llu B", (unsigned long long)bytes);
+  return String::printf("%0.1f %s", size, units[unit]);
+}
+
+
+void MemoryUsage::record(const MemoryUsage &usage) {
+  lock_guard<mutex> guard(peaksLock);
+  peaks.max(usage);
+}
+
+
+MemoryUsage MemoryUsage::getPeaks() {
+  lock_guard<mutex> guard(peaksLock);
+  return peaks;
+}
+
+
+void MemoryUsage::clearPeaks() {
+  lock_guard<mutex> guard(peaksLock);
+  peaks = MemoryUsage();
+}
@@ -0,0 +1,64 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <cstdint>
+
+
+namespace cb {namespace JSON {class Sink;}}
+
+
+namespace CAMotics {
+  /***
+   * Bytes held by the larger data structures of a job, by name.  The peak
+   * of each, over every job recorded since clearPeaks(), is also kept for
+   * the process so benchmarks can report it.
+   */
+  class MemoryUsage {
+    typedef std::map<std::string, uint64_t> bytes_t;
+    bytes_t bytes;
+
+  public:
+    typedef bytes_t::const_iterator iterator;
+    iterator begin() const {return bytes.begin();}
+    iterator end() const {return bytes.end();}
+    bool empty() const {return bytes.empty();}
+
+    void add(const std::string &name, uint64_t bytes);
+    uint64_t get(const std::string &name) const;
+    uint64_t getTotal() const;
+    /// Keep the larger count of each name here and in @param o.
+    void max(const MemoryUsage &o);
+
+    std::string toString() const;
+    void write(cb::JSON::Sink &sink) const;
+
+    /// @return @param bytes with a binary unit, as in "1.5 MiB".
+    static std::string format(uint64_t bytes);
+
+    /// Raise the process peaks to @param usage.
+    static void record(const MemoryUsage &usage);
+    static MemoryUsage getPeaks();
+    static void clearPeaks();
+  };
+}
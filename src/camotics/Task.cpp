@@ -23,6 +23,8 @@
 #include <cbang/util/SmartLock.h>
 #include <cbang/time/Timer.h>
 
+#include <algorithm>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
@@ -35,8 +37,7 @@ string Task::getStatus() const {
 
 
 double Task::getProgress() const {
-  SmartLock lock(this);
-  return progress;
+  return progress.load(memory_order_relaxed);
 }
 
 
@@ -52,10 +53,17 @@ double Task::getTime() const {
 }
 
 
+double Task::getPredictedTime() const {
+  SmartLock lock(this);
+  return predicted;
+}
+
+
 void Task::begin() {
   SmartLock lock(this);
   status.clear();
-  progress = eta = 0;
+  setProgress(0);
+  eta = predicted = predictedEnd = 0;
   startTime = endTime = Timer::now();
 }
 
@@ -63,13 +71,27 @@ void Task::begin() {
 void Task::update(double progress, const string &status) {
   SmartLock lock(this);
 
-  this->progress = progress;
+  setProgress(progress);
   if (!status.empty()) this->status = status;
 
   endTime = Timer::now();
   double delta = endTime - startTime;
-  if (progress && 1 < delta) eta = delta / progress - delta;
-  else eta = 0;
+  bool measured = progress && 1 < delta;
+  double rest = measured ? delta / progress - delta : 0;
+
+  if (predicted) {
+    double expected = std::max(0.0, predictedEnd - endTime);
+    if (measured) eta = (1 - progress) * expected + progress * rest;
+    else eta = expected;
+
+  } else eta = rest;
+}
+
+
+void Task::setPrediction(double seconds) {
+  SmartLock lock(this);
+  predicted = seconds;
+  predictedEnd = Timer::now() + seconds;
 }
 
 
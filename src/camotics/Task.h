@@ -23,32 +23,57 @@
 #include <gcode/Interrupter.h>
 #include <cbang/os/Condition.h>
 
+#include <atomic>
+
 
 namespace CAMotics {
   class Task : public GCode::Interrupter, public cb::Condition {
-    bool interrupted;
+    std::atomic<bool> interrupted;
+    const Task *parent;
 
     double startTime;
     double endTime;
     std::string status;
-    double progress;
+    std::atomic<double> progress;
     double eta;
+    double predicted;
+    double predictedEnd;
 
   public:
     Task() :
-      interrupted(false), startTime(0), endTime(0), status("Idle"), progress(0),
-      eta(0) {}
+      interrupted(false), parent(0), startTime(0), endTime(0), status("Idle"),
+      progress(0), eta(0), predicted(0), predictedEnd(0) {}
     virtual ~Task() {}
 
+    /// Also quit when @param parent is interrupted.
+    void setParent(const Task *parent) {this->parent = parent;}
+
     virtual void interrupt() {interrupted = true;}
-    virtual bool shouldQuit() const {return interrupted;}
+    virtual bool shouldQuit() const {return isInterrupted();}
+    /// Lock-free and not virtual, for inner loops.
+    bool isInterrupted() const {
+      return interrupted.load(std::memory_order_relaxed) ||
+        (parent && parent->isInterrupted());
+    }
     virtual std::string getStatus() const;
     virtual double getProgress() const;
     virtual double getETA() const;
     virtual double getTime() const;
+    /// @return the seconds the work was predicted to take when it began or
+    /// zero if there was no prediction.
+    double getPredictedTime() const;
+    /// Tasks with the same non-null key do not run at the same time.
+    virtual const void *getExclusionKey() const {return 0;}
 
     void begin();
     void update(double progress, const std::string &status = std::string());
+    /// Lock-free, for inner loops.  The ETA and time follow on the next
+    /// update().
+    void setProgress(double progress)
+    {this->progress.store(progress, std::memory_order_relaxed);}
+    /// Expect the remaining work to take @param seconds.  The ETA follows
+    /// this prediction at first and the measured rate as progress is made.
+    void setPrediction(double seconds);
     double end();
 
     virtual void run() {};
@@ -0,0 +1,181 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "Trace.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/String.h>
+#include <cbang/json/Writer.h>
+#include <cbang/os/SystemUtilities.h>
+
+#include <vector>
+#include <mutex>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Per thread, about 1MiB
+  const unsigned ringSize = 1 << 15;
+
+
+  struct Event {
+    const char *name;
+    bool counter;
+    double start;
+    double value; // Duration or count
+  };
+
+
+  struct Buffer {
+    unsigned id;
+    vector<Event> events;
+    uint64_t next;
+
+    Buffer(unsigned id) : id(id), events(ringSize), next(0) {}
+
+    void add(const char *name, bool counter, double start, double value) {
+      Event &e = events[next++ % ringSize];
+      e.name = name;
+      e.counter = counter;
+      e.start = start;
+      e.value = value;
+    }
+  };
+
+
+  mutex buffersLock;
+  vector<SmartPointer<Buffer> > buffers;
+  vector<Buffer *> freeBuffers;
+  double epoch = 0;
+
+
+  // Buffers are reused by later threads, so short lived jobs share lanes
+  struct ThreadBuffer {
+    Buffer *buffer;
+
+    ThreadBuffer() : buffer(0) {}
+
+    ~ThreadBuffer() {
+      if (!buffer) return;
+      lock_guard<mutex> guard(buffersLock);
+      freeBuffers.push_back(buffer);
+    }
+
+
+    Buffer &get() {
+      if (!buffer) {
+        lock_guard<mutex> guard(buffersLock);
+
+        if (freeBuffers.empty()) {
+          buffers.push_back(new Buffer(buffers.size() + 1));
+          buffer = buffers.back().get();
+
+        } else {
+          buffer = freeBuffers.back();
+          freeBuffers.pop_back();
+        }
+      }
+
+      return *buffer;
+    }
+  };
+
+
+  thread_local ThreadBuffer threadBuffer;
+}
+
+
+atomic<bool> Trace::enabled(false);
+
+
+void Trace::setEnabled(bool enabled) {
+  if (enabled && !epoch) epoch = Timer::now();
+  Trace::enabled = enabled;
+}
+
+
+void Trace::add(const char *name, double start, double duration) {
+  threadBuffer.get().add(name, false, start, duration);
+}
+
+
+void Trace::count(const char *name, double value) {
+  threadBuffer.get().add(name, true, Timer::now(), value);
+}
+
+
+void Trace::write(JSON::Sink &sink) {
+  lock_guard<mutex> guard(buffersLock);
+
+  sink.beginDict();
+  sink.insert("displayTimeUnit", "ms");
+  sink.insertList("traceEvents");
+
+  for (unsigned i = 0; i < buffers.size(); i++) {
+    const Buffer &buffer = *buffers[i];
+
+    sink.appendDict();
+    sink.insert("name", "thread_name");
+    sink.insert("ph", "M");
+    sink.insert("pid", 1);
+    sink.insert("tid", buffer.id);
+    sink.insertDict("args");
+    sink.insert("name", String::printf("thread %u", buffer.id));
+    sink.endDict();
+    sink.endDict();
+
+    // Oldest first
+    uint64_t first = ringSize < buffer.next ? buffer.next - ringSize : 0;
+    for (uint64_t j = first; j < buffer.next; j++) {
+      const Event &e = buffer.events[j % ringSize];
+
+      sink.appendDict();
+      sink.insert("name", e.name);
+      sink.insert("ph", e.counter ? "C" : "X");
+      sink.insert("pid", 1);
+      sink.insert("tid", buffer.id);
+      sink.insert("ts", (e.start - epoch) * 1e6);
+
+      if (e.counter) {
+        sink.insertDict("args");
+        sink.insert("value", e.value);
+        sink.endDict();
+
+      } else sink.insert("dur", e.value * 1e6);
+
+      sink.endDict();
+    }
+  }
+
+  sink.endList();
+  sink.endDict();
+}
+
+
+void Trace::write(const string &filename) {
+  SmartPointer<ostream> stream = SystemUtilities::oopen(filename);
+  JSON::Writer writer(*stream, 0, true);
+  write(writer);
+  writer.close();
+}
@@ -0,0 +1,80 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+#include <cbang/time/Timer.h>
+
+#include <string>
+#include <atomic>
+
+
+namespace cb {namespace JSON {class Sink;}}
+
+
+namespace CAMotics {
+  /***
+   * Records a timeline of scoped phases and counters, written as Chrome
+   * trace JSON which chrome://tracing and Perfetto can show.  Each thread
+   * writes to its own ring buffer so only the newest events are kept and
+   * recording takes no locks.  When disabled a scope costs one load.
+   */
+  class Trace {
+    static std::atomic<bool> enabled;
+
+  public:
+    static bool isEnabled()
+    {return enabled.load(std::memory_order_relaxed);}
+    static void setEnabled(bool enabled);
+
+    static void add(const char *name, double start, double duration);
+    static void count(const char *name, double value);
+
+    /// Only call once traced threads are idle.
+    static void write(cb::JSON::Sink &sink);
+    static void write(const std::string &filename);
+  };
+
+
+  class TraceScope {
+    const char *name;
+    double start;
+
+  public:
+    TraceScope(const char *name) :
+      name(Trace::isEnabled() ? name : 0),
+      start(this->name ? cb::Timer::now() : 0) {}
+    ~TraceScope() {if (name) Trace::add(name, start, cb::Timer::now() - start);}
+  };
+}
+
+
+#define CAMOTICS_TRACE_CAT(a, b) a##b
+#define CAMOTICS_TRACE_VAR(line) CAMOTICS_TRACE_CAT(_traceScope, line)
+
+/// Trace the rest of the enclosing scope.  @param NAME must be a literal.
+#define CAMOTICS_TRACE(NAME)                                        \
+  CAMotics::TraceScope CAMOTICS_TRACE_VAR(__LINE__)(NAME)
+
+#define CAMOTICS_TRACE_COUNT(NAME, VALUE)                           \
+  do {                                                              \
+    if (CAMotics::Trace::isEnabled()) CAMotics::Trace::count(NAME, VALUE); \
+  } while (0)
@@ -0,0 +1,262 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "AdaptiveMarchingCubes.h"
+#include "MarchingCubes.h"
+#include "GridTreeLeaf.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+const double AdaptiveMarchingCubes::MIN_NORMAL_DOT = 0.98; // About 11 degrees
+
+
+namespace {
+  // Cube corners and edges as laid out in the marching cubes tables
+  const unsigned corners[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+    {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},
+  };
+
+  const unsigned cubeEdges[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0},
+    {4, 5}, {5, 6}, {6, 7}, {7, 4},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7},
+  };
+}
+
+
+void AdaptiveMarchingCubes::run(FieldFunction &func, GridTreeRef &tree) {
+  const cb::Vector3U &steps = tree.getSteps();
+  double resolution = tree.getResolution();
+
+  unsigned completedCells = 0;
+  unsigned totalCells = tree.getTotalCells();
+
+  for (unsigned z = 0; !shouldQuit() && z < steps.z(); z += BLOCK_SIZE) {
+    for (unsigned y = 0; !isInterrupted() && y < steps.y(); y += BLOCK_SIZE)
+      for (unsigned x = 0; x < steps.x(); x += BLOCK_SIZE) {
+        cb::Vector3U origin(x, y, z);
+        cb::Vector3U size(min(BLOCK_SIZE, steps.x() - x),
+                          min(BLOCK_SIZE, steps.y() - y),
+                          min(BLOCK_SIZE, steps.z() - z));
+
+        // Outside of the changed region
+        cb::Vector3D bMin = tree.getOffset() + (cb::Vector3D)origin * resolution;
+        cb::Vector3D bMax = bMin + (cb::Vector3D)size * resolution;
+        if (func.cull(cb::Rectangle3D(bMin, bMax).grow(resolution * 1.1)))
+          continue;
+
+        // Partial blocks at the edge of the grid are always refined
+        bool whole = size.x() == BLOCK_SIZE && size.y() == BLOCK_SIZE &&
+          size.z() == BLOCK_SIZE;
+
+        if (whole) {
+          sample(func, tree, origin, 3, BLOCK_SIZE / 2, coarse);
+
+          if (isUniform(coarse)) {
+            clear(tree, origin, size, cb::Vector3U(BLOCK_SIZE));
+            continue;
+          }
+
+          if (isFlat(func, coarse, resolution)) {
+            march(func, tree, coarse);
+            continue;
+          }
+        }
+
+        // Refine, one sample per grid vertex
+        unsigned n = max(size.x(), max(size.y(), size.z())) + 1;
+        sample(func, tree, origin, n, 1, fine, whole ? &coarse : 0);
+        march(func, tree, fine);
+      }
+
+    // Progress
+    completedCells += steps.x() * steps.y() * min(BLOCK_SIZE, steps.z() - z);
+    setProgress((double)completedCells / totalCells);
+  }
+}
+
+
+void AdaptiveMarchingCubes::sample(FieldFunction &func,
+                                   const GridTreeRef &tree,
+                                   const cb::Vector3U &origin, unsigned size,
+                                   unsigned step, Lattice &lattice,
+                                   const Lattice *known) {
+  lattice.origin = origin;
+  lattice.size = size;
+  lattice.step = step;
+  lattice.points.resize(size * size * size);
+  lattice.depths.resize(size * size * size);
+
+  // Samples past the edge of the grid are clamped to it
+  const cb::Vector3U &steps = tree.getSteps();
+  double resolution = tree.getResolution();
+  unsigned ratio = known ? known->step / step : 0;
+
+  points.clear();
+  missing.clear();
+
+  for (unsigned x = 0; x < size; x++)
+    for (unsigned y = 0; y < size; y++)
+      for (unsigned z = 0; z < size; z++) {
+        unsigned i = lattice.index(x, y, z);
+
+        // Reuse samples shared with a coarser lattice of the same block
+        if (ratio && x % ratio == 0 && y % ratio == 0 && z % ratio == 0) {
+          unsigned j = known->index(x / ratio, y / ratio, z / ratio);
+          lattice.points[i] = known->points[j];
+          lattice.depths[i] = known->depths[j];
+          continue;
+        }
+
+        cb::Vector3U v(min(origin.x() + x * step, steps.x()),
+                       min(origin.y() + y * step, steps.y()),
+                       min(origin.z() + z * step, steps.z()));
+
+        lattice.points[i] = tree.getOffset() + (cb::Vector3D)v * resolution;
+        points.push_back(lattice.points[i]);
+        missing.push_back(i);
+      }
+
+  func.depth(points, depths);
+
+  for (unsigned i = 0; i < missing.size(); i++)
+    lattice.depths[missing[i]] = depths[i];
+}
+
+
+bool AdaptiveMarchingCubes::isUniform(const Lattice &lattice) const {
+  bool inside = lattice.depths[0] < 0;
+
+  for (unsigned i = 1; i < lattice.depths.size(); i++)
+    if ((lattice.depths[i] < 0) != inside) return false;
+
+  return true;
+}
+
+
+bool AdaptiveMarchingCubes::isFlat(FieldFunction &func, const Lattice &lattice,
+                                   double resolution) const {
+  const unsigned n = lattice.size;
+  bool first = true;
+  cb::Vector3D normal;
+
+  // Compare the normals where the surface crosses each lattice edge
+  for (unsigned x = 0; x < n; x++)
+    for (unsigned y = 0; y < n; y++)
+      for (unsigned z = 0; z < n; z++)
+        for (unsigned axis = 0; axis < 3; axis++) {
+          unsigned v[3] = {x, y, z};
+          if (n <= ++v[axis]) continue;
+
+          unsigned a = lattice.index(x, y, z);
+          unsigned b = lattice.index(v[0], v[1], v[2]);
+          double aDepth = lattice.depths[a];
+          double bDepth = lattice.depths[b];
+          if ((aDepth < 0) == (bDepth < 0)) continue;
+
+          cb::Vector3D aPt = lattice.points[a];
+          cb::Vector3D bPt = lattice.points[b];
+          cb::Vector3D p = func.linearIntersect(aPt, aDepth, bPt, bDepth);
+          cb::Vector3D pNormal = func.findNormal(p, resolution / 16);
+
+          if (!pNormal.lengthSquared()) return false;
+
+          if (first) {
+            normal = pNormal;
+            first = false;
+
+          } else if (pNormal.dot(normal) < MIN_NORMAL_DOT) return false;
+        }
+
+  return true;
+}
+
+
+void AdaptiveMarchingCubes::march(FieldFunction &func, GridTreeRef &tree,
+                                  const Lattice &lattice) {
+  const unsigned n = lattice.size;
+  const unsigned step = lattice.step;
+  const cb::Vector3U &steps = tree.getSteps();
+  Edge edges[12];
+  const Edge *edgePtrs[12];
+  for (unsigned i = 0; i < 12; i++) edgePtrs[i] = &edges[i];
+
+  for (unsigned x = 0; x + 1 < n; x++)
+    for (unsigned y = 0; y + 1 < n; y++)
+      for (unsigned z = 0; z + 1 < n; z++) {
+        cb::Vector3U cell(lattice.origin.x() + x * step,
+                          lattice.origin.y() + y * step,
+                          lattice.origin.z() + z * step);
+
+        // Cubes of refined partial blocks past the edge of the grid
+        if (steps.x() <= cell.x() || steps.y() <= cell.y() ||
+            steps.z() <= cell.z()) continue;
+
+        unsigned v[8];
+        uint8_t index = 0;
+        for (unsigned i = 0; i < 8; i++) {
+          v[i] = lattice.index(x + corners[i][0], y + corners[i][1],
+                               z + corners[i][2]);
+          if (lattice.depths[v[i]] < 0) index |= 1 << i;
+        }
+
+        triangles.clear();
+
+        if (MarchingCubes::hasTriangles(index)) {
+          for (unsigned i = 0; i < 12; i++) {
+            unsigned a = v[cubeEdges[i][0]];
+            unsigned b = v[cubeEdges[i][1]];
+            double aDepth = lattice.depths[a];
+            double bDepth = lattice.depths[b];
+
+            if ((aDepth < 0) != (bDepth < 0)) {
+              cb::Vector3D aPt = lattice.points[a];
+              cb::Vector3D bPt = lattice.points[b];
+              edges[i].vertex = func.linearIntersect(aPt, aDepth, bPt, bDepth);
+            }
+          }
+
+          MarchingCubes::addTriangles(index, edgePtrs, triangles);
+        }
+
+        // Coarse cubes cover more than one cell, clear the others
+        if (1 < step) clear(tree, cell, cb::Vector3U(step), cell);
+
+        tree.insertLeaf(GridTreeLeaf::create(triangles), cell);
+      }
+}
+
+
+void AdaptiveMarchingCubes::clear(GridTreeRef &tree,
+                                  const cb::Vector3U &origin,
+                                  const cb::Vector3U &size,
+                                  const cb::Vector3U &keep) {
+  for (unsigned x = origin.x(); x < origin.x() + size.x(); x++)
+    for (unsigned y = origin.y(); y < origin.y() + size.y(); y++)
+      for (unsigned z = origin.z(); z < origin.z() + size.z(); z++)
+        if (cb::Vector3U(x, y, z) != keep)
+          tree.insertLeaf(0, cb::Vector3U(x, y, z));
+}
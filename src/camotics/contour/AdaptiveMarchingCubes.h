@@ -0,0 +1,88 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "ContourGenerator.h"
+#include "GridTreeRef.h"
+#include "Edge.h"
+#include "Triangle.h"
+
+#include <vector>
+
+
+namespace CAMotics {
+  /***
+   * Marching cubes which samples blocks of cells at twice the grid
+   * resolution first and only uses the grid resolution where the surface
+   * bends.  A block is refined if the normals of the surface crossing its
+   * coarse edges differ by more than a few degrees, so flat floors and walls
+   * stay coarse while scallops and corners get full detail.  Blocks with no
+   * crossing at the coarse samples are treated as empty.
+   *
+   * Coarse triangles are stored in the lowest cell of their coarse cube.
+   * Where a coarse block meets a refined one the surfaces are close to
+   * planar, but their vertices need not match exactly.
+   */
+  class AdaptiveMarchingCubes : public ContourGenerator {
+    /// Samples of a block of cells every @var step cells
+    struct Lattice {
+      cb::Vector3U origin;
+      unsigned size;
+      unsigned step;
+
+      std::vector<cb::Vector3D> points;
+      std::vector<double> depths;
+
+      unsigned index(unsigned x, unsigned y, unsigned z) const
+      {return (x * size + y) * size + z;}
+    };
+
+    Lattice coarse;
+    Lattice fine;
+
+    std::vector<cb::Vector3D> points;
+    std::vector<double> depths;
+    std::vector<unsigned> missing;
+    std::vector<Triangle> triangles;
+
+  public:
+    /// Cells per block along each axis
+    static const unsigned BLOCK_SIZE = 4;
+    /// Blocks whose normals are less alike than this are refined
+    static const double MIN_NORMAL_DOT;
+
+    // From ContourGenerator
+    void run(FieldFunction &func, GridTreeRef &tree);
+
+  protected:
+    void sample(FieldFunction &func, const GridTreeRef &tree,
+                const cb::Vector3U &origin, unsigned size, unsigned step,
+                Lattice &lattice, const Lattice *known = 0);
+    bool isUniform(const Lattice &lattice) const;
+    bool isFlat(FieldFunction &func, const Lattice &lattice,
+                double resolution) const;
+    void march(FieldFunction &func, GridTreeRef &tree,
+               const Lattice &lattice);
+    void clear(GridTreeRef &tree, const cb::Vector3U &origin,
+               const cb::Vector3U &size, const cb::Vector3U &keep);
+  };
+}
@@ -0,0 +1,72 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "BlockCuller.h"
+#include "FieldStats.h"
+
+#include <camotics/Task.h>
+
+#include <algorithm>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+BlockCuller::BlockCuller(const GridTreeRef &grid) :
+  grid(grid), width(grid.getSteps().y() / SIZE + 1),
+  culled((grid.getSteps().x() / SIZE + 1) * width),
+  signs(culled.size()) {}
+
+
+void BlockCuller::compute(FieldFunction &func, unsigned z,
+                          const Task *task) {
+  const cb::Vector3U &steps = grid.getSteps();
+  double resolution = grid.getResolution();
+
+  unsigned bz = z - z % SIZE;
+  unsigned zEnd = min(bz + SIZE, steps.z()); // Last vertex layer needed
+  FieldStats &stats = FieldStats::local();
+
+  for (unsigned bx = 0; bx <= steps.x(); bx += SIZE) {
+    if (task && task->isInterrupted()) return;
+
+    for (unsigned by = 0; by <= steps.y(); by += SIZE) {
+      // Vertices of the block's cells, including those shared with the next
+      cb::Vector3U end(min(bx + SIZE, steps.x()), min(by + SIZE, steps.y()),
+                       zEnd);
+      cb::Rectangle3D bounds(
+        grid.getOffset() + cb::Vector3D(bx, by, bz) * resolution,
+        grid.getOffset() + (cb::Vector3D)end * resolution);
+
+      // Grown by the largest offset vertices are culled with
+      unsigned i = (bx / SIZE) * width + by / SIZE;
+      bool cull = func.cull(bounds.grow(2.1 * resolution));
+      culled[i] = cull;
+
+      // Grown so no filled vertex has a neighbor of the other sign and so
+      // none is ever an end of an edge the surface crosses
+      signs[i] = cull ? 0 : func.classify(bounds.grow(1.1 * resolution));
+
+      stats.blockCullTests++;
+      if (cull) stats.blocksCulled++;
+    }
+  }
+}
@@ -0,0 +1,66 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "FieldFunction.h"
+#include "GridTreeRef.h"
+
+#include <cbang/StdTypes.h>
+
+#include <vector>
+
+
+namespace CAMotics {
+  class Task;
+
+  /// Culls cubes of cells at once so most cells of a sparse change are
+  /// skipped without testing them one by one.  Blocks the field function
+  /// finds wholly inside or outside are marked so their vertices are
+  /// filled rather than evaluated.
+  class BlockCuller {
+    const GridTreeRef &grid;
+    unsigned width;
+    std::vector<bool> culled;
+    std::vector<int8_t> signs;
+
+  public:
+    /// Cells per block along each axis
+    static const unsigned SIZE = 16;
+
+    BlockCuller(const GridTreeRef &grid);
+
+    /// Cull the layer of blocks containing cells at @param z.  Stops early
+    /// once @param task is interrupted.
+    void compute(FieldFunction &func, unsigned z, const Task *task = 0);
+
+    /// True if every test of the vertex or cell at @param x, @param y in z
+    /// layers of the last computed block, plus one above, would be culled.
+    bool isCulled(unsigned x, unsigned y) const
+    {return culled[(x / SIZE) * width + y / SIZE];}
+
+    /// @return the sign every vertex at @param x, @param y in the z layers
+    /// of the last computed block, and its neighbors, is known to have or
+    /// zero if it is not known.  @see FieldFunction::classify()
+    int getSign(unsigned x, unsigned y) const
+    {return signs[(x / SIZE) * width + y / SIZE];}
+  };
+}
@@ -57,6 +57,14 @@ uint64_t CompositeSurface::getCount() const {
 }
 
 
+uint64_t CompositeSurface::getMemoryUsage() const {
+  uint64_t bytes = 0;
+  for (unsigned i = 0; i < surfaces.size(); i++)
+    bytes += surfaces[i]->getMemoryUsage();
+  return bytes;
+}
+
+
 cb::Rectangle3D CompositeSurface::getBounds() const {
   cb::Rectangle3D bounds;
   for (unsigned i = 0; i < surfaces.size(); i++)
@@ -65,6 +73,19 @@ cb::Rectangle3D CompositeSurface::getBounds() const {
 }
 
 
+void CompositeSurface::finalize(bool withVBOs) {
+  for (unsigned i = 0; i < surfaces.size(); i++)
+    surfaces[i]->finalize(withVBOs);
+}
+
+
+bool CompositeSurface::sharesBuffers() const {
+  for (unsigned i = 0; i < surfaces.size(); i++)
+    if (surfaces[i]->sharesBuffers()) return true;
+  return false;
+}
+
+
 void CompositeSurface::draw(bool withVBOs) {
   for (unsigned i = 0; i < surfaces.size(); i++) surfaces[i]->draw(withVBOs);
 }
@@ -75,7 +96,11 @@ void CompositeSurface::write(STL::Sink &sink, Task *task) const {
 }
 
 
-void CompositeSurface::reduce(Task &task) {
-  consolidate();
-  for (unsigned i = 0; i < surfaces.size(); i++) surfaces[i]->reduce(task);
+SmartPointer<Surface>
+CompositeSurface::reduce(Task &task, unsigned threads,
+                         const ReduceTarget &target) const {
+  if (surfaces.size() == 1) return surfaces[0]->reduce(task, threads, target);
+
+  surfaces_t copies(surfaces);
+  return TriangleSurface(copies).reduce(task, threads, target);
 }
@@ -44,9 +44,13 @@ namespace CAMotics {
     // From Surface
     cb::SmartPointer<Surface> copy() const;
     uint64_t getCount() const;
+    uint64_t getMemoryUsage() const;
     cb::Rectangle3D getBounds() const;
+    void finalize(bool withVBOs);
+    bool sharesBuffers() const;
     void draw(bool withVBOs);
     void write(STL::Sink &sink, Task *task = 0) const;
-    void reduce(Task &task);
+    cb::SmartPointer<Surface> reduce(Task &task, unsigned threads,
+                                     const ReduceTarget &target) const;
   };
 }
@@ -20,17 +20,18 @@
 
 #include "ContourGenerator.h"
 
+#include <camotics/render/RenderPolicy.h>
+
 #include <cbang/time/Timer.h>
 
 using namespace cb;
 using namespace CAMotics;
 
 
-void ContourGenerator::updateProgress(double progress) {
-  double now = Timer::now();
+bool ContourGenerator::shouldQuit() const {
+  // Checked once per slab, so a paused job holds no locks
+  while (job && RenderPolicy::isThrottled() && !isInterrupted())
+    Timer::sleep(0.05);
 
-  if (0.25 < now - lastTime) {
-    lastTime = now;
-    Task::update(progress);
-  }
+  return isInterrupted();
 }
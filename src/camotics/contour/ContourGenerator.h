@@ -33,15 +33,21 @@
 
 
 namespace CAMotics {
+  /// Reports progress with Task::setProgress(), once per slab of cells.
   class ContourGenerator : public Task {
-    double lastTime;
+    unsigned job;
 
   public:
-    ContourGenerator() : lastTime(0) {}
+    ContourGenerator() : job(0) {}
 
-    void updateProgress(double progress);
+    /// Render jobs other than the first pause between slabs while
+    /// RenderPolicy::isThrottled().
+    void setJob(unsigned job) {this->job = job;}
 
     using Task::run;
     virtual void run(FieldFunction &func, GridTreeRef &tree) = 0;
+
+    // From Task
+    bool shouldQuit() const;
   };
 }
@@ -20,31 +20,40 @@
 
 #include "CubeSlice.h"
 
+#include <camotics/Task.h>
+
 #include <cbang/log/Logger.h>
 
+#include <algorithm>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
 CubeSlice::CubeSlice(const GridTreeRef &grid) :
-  grid(grid), z(0), shifted(false) {}
+  grid(grid), z(0), slices{VertexSlice(grid), VertexSlice(grid)},
+  left(&slices[0]), right(&slices[1]), stride(grid.getSteps().y() + 1),
+  culler(grid), shifted(false) {
+  const cb::Vector3U &steps = grid.getSteps();
+  for (unsigned i = 0; i < 5; i++) edges[i].resize((steps.x() + 1) * stride);
+}
+
 
+void CubeSlice::compute(FieldFunction &func, const Task *task) {
+  // Blocks
+  if (!shifted || z % BlockCuller::SIZE == 0) culler.compute(func, z, task);
 
-void CubeSlice::compute(FieldFunction &func) {
   // Vertices
   if (!shifted) {
-    left = new VertexSlice(grid, z);
-    left->compute(func);
+    left->setZ(z);
+    left->compute(func, &culler, task);
   }
 
-  right = new VertexSlice(grid, z + 1);
-  right->compute(func);
+  right->setZ(z + 1);
+  right->compute(func, &culler, task);
 
-  // Edges
   const cb::Vector3U &steps = grid.getSteps();
-  for (unsigned i = 0; i < 5; i++)
-    edges[i].resize(steps.x() + 1, vector<Edge>(steps.y() + 1));
 
   static cb::Vector3U vIndex[5] = {
     cb::Vector3U(1, 0, 0), // a
@@ -63,9 +72,16 @@ void CubeSlice::compute(FieldFunction &func) {
   cb::Vector3D p(0, 0, grid.getOffset().z() + resolution * z);
 
   for (unsigned x = 0; x <= steps.x(); x++) {
+    if (task && task->isInterrupted()) return;
     p.x() = grid.getOffset().x() + resolution * x;
 
     for (unsigned y = 0; y <= steps.y(); y++) {
+      // Nothing is computed for culled vertices
+      if (culler.isCulled(x, y)) {
+        y += BlockCuller::SIZE - 1 - y % BlockCuller::SIZE;
+        continue;
+      }
+
       p.y() = grid.getOffset().y() + resolution * y;
 
       cb::Vector3D a = p;
@@ -80,7 +96,7 @@ void CubeSlice::compute(FieldFunction &func) {
         double bDepth = depth(x, y, vIndex[i]);
 
         if ((aDepth < 0) != (bDepth < 0) && !cull)
-          edges[i][x][y] = func.getEdge(a, aDepth, b, bDepth);
+          edges[i][x * stride + y] = func.getEdge(a, aDepth, b, bDepth);
 
         if (i == 2) {
           a = b;
@@ -94,33 +110,47 @@ void CubeSlice::compute(FieldFunction &func) {
 
 
 void CubeSlice::shift() {
-  // Vertices
-  left = right;
-  right.release();
+  // Vertices, the old left is overwritten by the next compute()
+  swap(left, right);
 
-  // Edges
-  edges[0] = edges[3];
-  edges[1] = edges[4];
+  // Edges, the top of this slice is the bottom of the next
+  edges[0].swap(edges[3]);
+  edges[1].swap(edges[4]);
 
   z++;
   shifted = true;
 }
 
 
-uint8_t CubeSlice::getEdges(unsigned x, unsigned y, Edge edges[12]) const {
-  // This table maps vertices to the index needed for the marching cubes table.
-  static const cb::Vector3U vOffset[8] = {
-    cb::Vector3U(0, 0, 0), cb::Vector3U(1, 0, 0),
-    cb::Vector3U(1, 1, 0), cb::Vector3U(0, 1, 0),
-    cb::Vector3U(0, 0, 1), cb::Vector3U(1, 0, 1),
-    cb::Vector3U(1, 1, 1), cb::Vector3U(0, 1, 1),
-  };
+bool CubeSlice::isUniform(unsigned x, unsigned y, unsigned width,
+                          unsigned height) const {
+  // True if every vertex of the cells in the block is on the same side
+  bool inside = left->depth(x, y) < 0;
+
+  for (unsigned i = x; i <= x + width; i++)
+    for (unsigned j = y; j <= y + height; j++)
+      if ((left->depth(i, j) < 0) != inside ||
+          (right->depth(i, j) < 0) != inside) return false;
+
+  return true;
+}
+
 
-  uint8_t vertexFlags = 0;
-  for (unsigned i = 0; i < 8; i++)
-    if (depth(x, y, vOffset[i]) < 0)
-      vertexFlags |= 1 << i;
+uint8_t CubeSlice::getIndex(unsigned x, unsigned y) const {
+  // Vertices in the order of the marching cubes table, bottom then top:
+  //   (0, 0) (1, 0) (1, 1) (0, 1)
+  const unsigned i = x * stride + y;
+  const float *l = left->getDepths() + i;
+  const float *r = right->getDepths() + i;
 
+  return
+    (l[0] < 0) << 0 | (l[stride] < 0) << 1 | (l[stride + 1] < 0) << 2 |
+    (l[1] < 0) << 3 | (r[0] < 0) << 4 | (r[stride] < 0) << 5 |
+    (r[stride + 1] < 0) << 6 | (r[1] < 0) << 7;
+}
+
+
+const Edge &CubeSlice::getEdge(unsigned x, unsigned y, unsigned edge) const {
   // eOffset[] maps cube indices to the 12 edges and edge flags as laid out in
   // the marching cubes tables.
   //
@@ -138,17 +168,14 @@ uint8_t CubeSlice::getEdges(unsigned x, unsigned y, Edge edges[12]) const {
   //  4->5  5->6  6->7  7->4
   //  0->4  1->5  2->6  3->7
   //
-  static int eOffset[12][3] = {
+  static const unsigned eOffset[12][3] = {
     {0, 0, 0}, {1, 0, 1}, {0, 1, 0}, {0, 0, 1},
     {0, 0, 3}, {1, 0, 4}, {0, 1, 3}, {0, 0, 4},
     {0, 0, 2}, {1, 0, 2}, {1, 1, 2}, {0, 1, 2},
   };
 
-  for (unsigned i = 0; i < 12; i++)
-    edges[i] =
-      this->edges[eOffset[i][2]][x + eOffset[i][0]][y + eOffset[i][1]];
-
-  return vertexFlags;
+  const unsigned *o = eOffset[edge];
+  return edges[o[2]][(x + o[0]) * stride + y + o[1]];
 }
 
 
@@ -22,21 +22,29 @@
 
 
 #include "VertexSlice.h"
+#include "BlockCuller.h"
 #include "FieldFunction.h"
 #include "GridTreeRef.h"
 
-#include <cbang/SmartPointer.h>
 #include <cbang/StdTypes.h>
 
 
 namespace CAMotics {
+  class Task;
+
   class CubeSlice {
     const GridTreeRef &grid;
     unsigned z;
 
-    cb::SmartPointer<VertexSlice> left;
-    cb::SmartPointer<VertexSlice> right;
-    std::vector<std::vector<Edge> > edges[5];
+    // Two slices whose storage is swapped between left and right on shift()
+    VertexSlice slices[2];
+    VertexSlice *left;
+    VertexSlice *right;
+
+    unsigned stride;
+    std::vector<Edge> edges[5];
+
+    BlockCuller culler;
 
     bool shifted;
 
@@ -46,9 +54,18 @@ namespace CAMotics {
     const GridTreeRef &getGrid() const {return grid;}
     unsigned getZ() const {return z;}
 
-    void compute(FieldFunction &func);
+    /// Stops early, leaving the slice incomplete, once @param task is
+    /// interrupted.
+    void compute(FieldFunction &func, const Task *task = 0);
     void shift();
-    uint8_t getEdges(unsigned x, unsigned y, Edge edges[12]) const;
+    /// @return the marching cubes vertex flags of the cell at @param x, y.
+    uint8_t getIndex(unsigned x, unsigned y) const;
+    /// @return marching cubes @param edge of the cell at @param x, y.
+    const Edge &getEdge(unsigned x, unsigned y, unsigned edge) const;
+    bool isUniform(unsigned x, unsigned y, unsigned width,
+                   unsigned height) const;
+    bool isCulled(unsigned x, unsigned y) const
+    {return culler.isCulled(x, y);}
 
   protected:
     double depth(int x, int y, const cb::Vector3U &offset) const;
@@ -20,14 +20,266 @@
 
 #include "CubicalMarchingSquares.h"
 
+#include "CubeSlice.h"
+#include "GridTreeLeaf.h"
+#include "QEF.h"
+
+#include <cbang/geom/Rectangle.h>
+
+#include <cmath>
+
+using namespace std;
+using namespace cb;
 using namespace CAMotics;
 
 
-void CubicalMarchingSquares::doSlice(FieldFunction &func,
-                                     const CubeSlice &slice, unsigned z) {
+namespace {
+  // Edge normals closer than this cosine are on a smooth surface
+  const double sharpCos = 0.9;
+
+  // Cell corners in marching cubes order
+  const unsigned corners[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+    {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},
+  };
+
+  // The corners of each marching cubes edge
+  const unsigned edgeCorners[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0}, {4, 5}, {5, 6},
+    {6, 7}, {7, 4}, {0, 4}, {1, 5}, {2, 6}, {3, 7},
+  };
+
+  // Faces by their fixed axis and side, with their corners in order around
+  // the face and the edges between them
+  struct Face {
+    unsigned axis;
+    unsigned side;
+    unsigned corners[4];
+    unsigned edges[4];
+  };
+
+  const Face faces[6] = {
+    {2, 0, {0, 1, 2, 3}, {0, 1, 2, 3}},
+    {2, 1, {4, 5, 6, 7}, {4, 5, 6, 7}},
+    {1, 0, {0, 1, 5, 4}, {0, 9, 4, 8}},
+    {1, 1, {3, 2, 6, 7}, {2, 10, 6, 11}},
+    {0, 0, {0, 3, 7, 4}, {3, 11, 7, 8}},
+    {0, 1, {1, 2, 6, 5}, {1, 10, 5, 9}},
+  };
+
+
+  bool isSharp(const Vector3D &a, const Vector3D &b) {
+    double length = a.length() * b.length();
+    return length && a.dot(b) < sharpCos * length;
+  }
+
+
+  /// Orient a face segment from @param a to @param b, given by their edges,
+  /// so that marching cubes' winding puts @param corner, on its inside, to
+  /// the left when looking from outside the cell.  Edge midpoints are used so
+  /// the test never degenerates.
+  bool isOriented(const Face &face, unsigned a, unsigned b, unsigned corner) {
+    int ma[3], d1[3], d2[3];
+
+    for (unsigned i = 0; i < 3; i++) {
+      ma[i] = corners[edgeCorners[a][0]][i] + corners[edgeCorners[a][1]][i];
+      int mb = corners[edgeCorners[b][0]][i] + corners[edgeCorners[b][1]][i];
+      d1[i] = mb - ma[i];
+      d2[i] = 2 * corners[corner][i] - ma[i];
+    }
+
+    unsigned u = (face.axis + 1) % 3;
+    unsigned v = (face.axis + 2) % 3;
+    int cross = d1[u] * d2[v] - d1[v] * d2[u];
+
+    return 0 < (face.side ? cross : -cross);
+  }
 }
 
 
 void CubicalMarchingSquares::doCell(GridTreeRef &tree, const CubeSlice &slice,
                                     unsigned x, unsigned y) {
+  uint8_t index = slice.getIndex(x, y);
+  cb::Vector3U offset(x, y, slice.getZ());
+
+  // Don't allocate leaves for cells without triangles, just clear old ones
+  if (!index || index == 0xff) {
+    tree.insertLeaf(0, offset);
+    return;
+  }
+
+  double resolution = tree.getResolution();
+  cb::Vector3D origin =
+    tree.getOffset() + cb::Vector3D(offset.x(), offset.y(), offset.z()) *
+    resolution;
+
+  for (unsigned i = 0; i < 12; i++) next[i] = -1;
+  for (unsigned i = 0; i < 6; i++)
+    addFace(slice, x, y, index, i, origin, resolution);
+
+  // Join the segments in to loops, marking the edges used
+  triangles.clear();
+
+  for (unsigned i = 0; i < 12; i++)
+    if (0 <= next[i]) addLoop(slice, x, y, i, origin, resolution);
+
+  tree.insertLeaf(GridTreeLeaf::create(triangles), offset);
+}
+
+
+void CubicalMarchingSquares::addFace(const CubeSlice &slice, unsigned x,
+                                     unsigned y, uint8_t index, unsigned face,
+                                     const cb::Vector3D &origin,
+                                     double resolution) {
+  const Face &f = faces[face];
+
+  bool inside[4];
+  for (unsigned i = 0; i < 4; i++) inside[i] = index & (1 << f.corners[i]);
+
+  // Marching squares, separating inside corners when the face is ambiguous
+  unsigned segments[2][2];
+  unsigned count = 0;
+
+  if (inside[0] == inside[2] && inside[1] == inside[3]) {
+    if (inside[0] == inside[1]) return; // No crossings
+
+    for (unsigned i = 0; i < 4; i++)
+      if (inside[i]) {
+        segments[count][0] = f.edges[(i + 3) % 4];
+        segments[count++][1] = f.edges[i];
+      }
+
+  } else {
+    for (unsigned i = 0; i < 4; i++)
+      if (inside[i] != inside[(i + 1) % 4])
+        segments[0][count++] = f.edges[i];
+    count = 1;
+  }
+
+  for (unsigned i = 0; i < count; i++) {
+    unsigned a = segments[i][0];
+    unsigned b = segments[i][1];
+
+    // Any inside corner of the first edge is on the inside of the segment
+    unsigned corner = edgeCorners[a][0];
+    if (!(index & (1 << corner))) corner = edgeCorners[a][1];
+    if (!isOriented(f, a, b, corner)) swap(a, b);
+
+    next[a] = b;
+    hasFeature[a] = false;
+
+    // Place a vertex where the tangent lines of a sharp edge meet
+    const Edge &ea = slice.getEdge(x, y, a);
+    const Edge &eb = slice.getEdge(x, y, b);
+
+    unsigned u = (f.axis + 1) % 3;
+    unsigned v = (f.axis + 2) % 3;
+    cb::Vector2D na(ea.normal[u], ea.normal[v]);
+    cb::Vector2D nb(eb.normal[u], eb.normal[v]);
+
+    if (!isSharp(cb::Vector3D(na.x(), na.y(), 0),
+                 cb::Vector3D(nb.x(), nb.y(), 0))) continue;
+
+    double det = na.x() * nb.y() - na.y() * nb.x();
+    if (fabs(det) < 1e-6 * na.length() * nb.length()) continue;
+
+    double da = na.x() * ea.vertex[u] + na.y() * ea.vertex[v];
+    double db = nb.x() * eb.vertex[u] + nb.y() * eb.vertex[v];
+
+    cb::Vector3D p = origin + cb::Vector3D(corners[f.corners[0]][0],
+                                           corners[f.corners[0]][1],
+                                           corners[f.corners[0]][2]) *
+      resolution;
+    double pu = (da * nb.y() - db * na.y()) / det;
+    double pv = (na.x() * db - nb.x() * da) / det;
+
+    // Only within the face
+    if (pu < origin[u] || origin[u] + resolution < pu ||
+        pv < origin[v] || origin[v] + resolution < pv) continue;
+
+    p[u] = pu;
+    p[v] = pv;
+
+    features[a] = p;
+    hasFeature[a] = true;
+  }
+}
+
+
+void CubicalMarchingSquares::addLoop(const CubeSlice &slice, unsigned x,
+                                     unsigned y, unsigned start,
+                                     const cb::Vector3D &origin,
+                                     double resolution) {
+  vector<cb::Vector3F> points;
+  const Edge *edges[12];
+  unsigned count = 0;
+  bool sharp = false;
+
+  int e = start;
+  do {
+    if (count == 12) return; // Not closed
+
+    const Edge &edge = slice.getEdge(x, y, e);
+    for (unsigned i = 0; i < count && !sharp; i++)
+      sharp = isSharp(edges[i]->normal, edge.normal);
+    edges[count++] = &edge;
+
+    points.push_back(cb::Vector3F(edge.vertex));
+    if (hasFeature[e]) {
+      points.push_back(cb::Vector3F(features[e]));
+      sharp = true;
+    }
+
+    int n = next[e];
+    next[e] = -1;
+    e = n;
+  } while (0 <= e && e != (int)start);
+
+  if (e < 0 || points.size() < 3) return; // Not closed
+
+  if (sharp) {
+    // Fan around a vertex on the feature, found as in dual contouring
+    cb::Vector3D mass;
+    for (unsigned i = 0; i < count; i++) mass += edges[i]->vertex;
+    mass /= count;
+
+    double mat[12][3];
+    double vec[12];
+    unsigned rows = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+      const cb::Vector3D &n = edges[i]->normal;
+      if (!n.lengthSquared()) continue;
+
+      for (unsigned j = 0; j < 3; j++) mat[rows][j] = n[j];
+      vec[rows++] = n.dot(edges[i]->vertex - mass);
+    }
+
+    for (; rows < 3; rows++) {
+      mat[rows][0] = mat[rows][1] = mat[rows][2] = 0;
+      vec[rows] = 0;
+    }
+
+    cb::Vector3D p = mass + QEF::evaluate(mat, vec, rows);
+
+    // Keep the vertex in its cell
+    cb::Rectangle3D bounds(origin, origin + cb::Vector3D(resolution));
+    if (!bounds.contains(p)) p = mass;
+
+    cb::Vector3F center(p);
+
+    for (unsigned i = 0; i < points.size(); i++) {
+      const cb::Vector3F &b = points[(i + 1) % points.size()];
+      Triangle t(cb::Triangle3F(center, points[i], b));
+      t.updateNormal();
+      triangles.push_back(t);
+    }
+
+  } else
+    // A smooth patch is fanned from its first vertex, like marching cubes
+    for (unsigned i = 1; i + 1 < points.size(); i++) {
+      Triangle t(cb::Triangle3F(points[0], points[i], points[i + 1]));
+      t.updateNormal();
+      triangles.push_back(t);
+    }
 }
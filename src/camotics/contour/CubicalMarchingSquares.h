@@ -22,16 +22,39 @@
 
 
 #include "SliceContourGenerator.h"
+#include "Triangle.h"
+
+#include <vector>
 
 
 namespace CAMotics {
+  /***
+   * Cubical marching squares.  Each face of a cell is contoured with
+   * marching squares and the segments are joined into loops, which are then
+   * triangulated.  Where the edge normals show a sharp feature a vertex is
+   * placed on it, on the face for edges and inside the cell for corners.
+   * Faces are contoured from their own corners and edges only, so cells
+   * sharing a face always agree and the surface has no cracks.
+   */
   class CubicalMarchingSquares : public SliceContourGenerator {
-    Edge edges[12];
+    std::vector<Triangle> triangles;
+
+    // Oriented face segments by the cell edge they start at
+    int next[12];
+    bool hasFeature[12];
+    cb::Vector3D features[12];
 
   public:
     // From SliceContourGenerator
-    void doSlice(FieldFunction &func, const CubeSlice &slice, unsigned z);
     void doCell(GridTreeRef &tree, const CubeSlice &slice, unsigned x,
                 unsigned y);
+
+  protected:
+    void addFace(const CubeSlice &slice, unsigned x, unsigned y,
+                 uint8_t index, unsigned face, const cb::Vector3D &origin,
+                 double resolution);
+    void addLoop(const CubeSlice &slice, unsigned x, unsigned y,
+                 unsigned start, const cb::Vector3D &origin,
+                 double resolution);
   };
 }
@@ -0,0 +1,284 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "DualContouring.h"
+#include "GridTreeLeaf.h"
+#include "QEF.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+DualContouring::DualContouring() :
+  width(0), height(0), lower(&layers[0]), upper(&layers[1]), last(&cells[0]),
+  current(&cells[1]) {}
+
+
+void DualContouring::run(FieldFunction &func, GridTreeRef &tree) {
+  const cb::Vector3U &steps = tree.getSteps();
+  double resolution = tree.getResolution();
+
+  // Allocate space, with a border of one cell before the grid
+  width = steps.x() + 2;
+  height = steps.y() + 2;
+
+  for (unsigned i = 0; i < 2; i++) {
+    layers[i].depths.resize(width * height);
+    layers[i].xEdges.resize(width * height);
+    layers[i].yEdges.resize(width * height);
+    layers[i].valid = false;
+    cells[i].assign((width - 1) * (height - 1), Cell());
+  }
+  zEdges.resize(width * height);
+
+  // Cull whole layers of cells, with the same margin as single cells below
+  vector<bool> culled(steps.z() + 1);
+  for (int z = -1; z < (int)steps.z(); z++)
+    culled[z + 1] = func.cull(cb::Rectangle3D(getPoint(tree, 0, 0, z),
+                                              getPoint(tree, width - 1,
+                                                       height - 1, z + 1))
+                              .grow(resolution * 1.1));
+
+  unsigned completedCells = 0;
+  unsigned totalCells = tree.getTotalCells();
+
+  for (int z = -1; !shouldQuit() && z < (int)steps.z(); z++) {
+    // Cells are needed by their own layer and by the quads of the next
+    bool needed = !culled[z + 1] || (z + 1 < (int)steps.z() && !culled[z + 2]);
+
+    if (needed) {
+      if (!lower->valid) computeLayer(func, tree, z, *lower);
+      computeLayer(func, tree, z + 1, *upper);
+      computeZEdges(func, tree, z);
+      computeCells(tree, z);
+
+    } else {
+      lower->valid = false;
+      current->assign(current->size(), Cell());
+    }
+
+    if (0 <= z && !culled[z + 1])
+      for (unsigned x = 0; !isInterrupted() && x < steps.x(); x++)
+        for (unsigned y = 0; y < steps.y(); y++) {
+          if (func.cull(getPoint(tree, x + 1, y + 1, z), resolution * 1.1))
+            continue;
+
+          const unsigned v = (x + 1) * height + y + 1;
+          const unsigned c = x * (height - 1) + y;
+          const vector<Cell> &l = *last;
+          const vector<Cell> &r = *current;
+          const unsigned dx = height - 1;
+          bool inside = 0 <= lower->depths[v];
+          triangles.clear();
+
+          // X edge, the cells around it are before it in y and z
+          if (inside != (0 <= lower->depths[v + height]))
+            addQuad(l[c + dx], l[c + dx + 1], r[c + dx + 1], r[c + dx],
+                    cb::Vector3F(inside ? 1 : -1, 0, 0));
+
+          // Y edge, before it in x and z
+          if (inside != (0 <= lower->depths[v + 1]))
+            addQuad(l[c + 1], l[c + dx + 1], r[c + dx + 1], r[c + 1],
+                    cb::Vector3F(0, inside ? 1 : -1, 0));
+
+          // Z edge, before it in x and y
+          if (inside != (0 <= upper->depths[v]))
+            addQuad(r[c], r[c + dx], r[c + dx + 1], r[c + 1],
+                    cb::Vector3F(0, 0, inside ? 1 : -1));
+
+          // Or clear old leaf
+          tree.insertLeaf(GridTreeLeaf::create(triangles),
+                          cb::Vector3U(x, y, z));
+        }
+
+    if (0 <= z) {
+      completedCells += steps.x() * steps.y();
+      setProgress((double)completedCells / totalCells);
+    }
+
+    swap(lower, upper);
+    upper->valid = false;
+    swap(last, current);
+  }
+}
+
+
+cb::Vector3D DualContouring::getPoint(const GridTreeRef &tree, unsigned i,
+                                      unsigned j, int z) const {
+  return tree.getOffset() +
+    cb::Vector3D((int)i - 1, (int)j - 1, z) * tree.getResolution();
+}
+
+
+Edge DualContouring::getEdge(FieldFunction &func, const cb::Vector3D &a,
+                             double aDepth, const cb::Vector3D &b,
+                             double bDepth, double h) const {
+  cb::Vector3D _a = a;
+  cb::Vector3D _b = b;
+
+  Edge e;
+  e.vertex = func.linearIntersect(_a, aDepth, _b, bDepth);
+  e.normal = func.findNormal(e.vertex, h);
+
+  return e;
+}
+
+
+void DualContouring::computeLayer(FieldFunction &func, const GridTreeRef &tree,
+                                  int z, Layer &layer) {
+  double h = tree.getResolution() / 16;
+
+  // Depths, all at once so the field function can batch them
+  vector<cb::Vector3D> points;
+  for (unsigned i = 0; i < width; i++)
+    for (unsigned j = 0; j < height; j++)
+      points.push_back(getPoint(tree, i, j, z));
+
+  func.depth(points, layer.depths);
+
+  // Edges crossing the surface in x and y
+  for (unsigned i = 0; i < width; i++)
+    for (unsigned j = 0; j < height; j++) {
+      unsigned v = i * height + j;
+      double depth = layer.depths[v];
+
+      if (i + 1 < width && (depth < 0) != (layer.depths[v + height] < 0))
+        layer.xEdges[v] = getEdge(func, points[v], depth, points[v + height],
+                                  layer.depths[v + height], h);
+
+      if (j + 1 < height && (depth < 0) != (layer.depths[v + 1] < 0))
+        layer.yEdges[v] = getEdge(func, points[v], depth, points[v + 1],
+                                  layer.depths[v + 1], h);
+    }
+
+  layer.valid = true;
+}
+
+
+void DualContouring::computeZEdges(FieldFunction &func, const GridTreeRef &tree,
+                                   int z) {
+  double h = tree.getResolution() / 16;
+
+  for (unsigned i = 0; i < width; i++)
+    for (unsigned j = 0; j < height; j++) {
+      unsigned v = i * height + j;
+
+      if ((lower->depths[v] < 0) != (upper->depths[v] < 0))
+        zEdges[v] = getEdge(func, getPoint(tree, i, j, z), lower->depths[v],
+                            getPoint(tree, i, j, z + 1), upper->depths[v], h);
+    }
+}
+
+
+void DualContouring::computeCells(const GridTreeRef &tree, int z) {
+  for (unsigned i = 0; i < width - 1; i++)
+    for (unsigned j = 0; j < height - 1; j++) {
+      Cell &cell = (*current)[i * (height - 1) + j];
+      cell.active = false;
+
+      // Gather the edges of the cell which cross the surface
+      const Edge *edges[12];
+      unsigned count = 0;
+      unsigned v = i * height + j;
+
+      for (unsigned k = 0; k < 2; k++) {
+        const Layer &layer = k ? *upper : *lower;
+        const vector<double> &d = layer.depths;
+
+        for (unsigned o = 0; o < 2; o++) {
+          // X edges at y and y + 1
+          unsigned a = v + o;
+          if ((d[a] < 0) != (d[a + height] < 0)) edges[count++] = &layer.xEdges[a];
+
+          // Y edges at x and x + 1
+          a = v + o * height;
+          if ((d[a] < 0) != (d[a + 1] < 0)) edges[count++] = &layer.yEdges[a];
+        }
+      }
+
+      for (unsigned o = 0; o < 4; o++) {
+        unsigned a = v + (o & 1) * height + (o >> 1);
+        if ((lower->depths[a] < 0) != (upper->depths[a] < 0))
+          edges[count++] = &zEdges[a];
+      }
+
+      if (!count) continue;
+
+      // Solve relative to the mean of the intersections, so directions the
+      // QEF cannot determine fall back to it
+      cb::Vector3D mass;
+      for (unsigned k = 0; k < count; k++) mass += edges[k]->vertex;
+      mass /= count;
+
+      double mat[12][3];
+      double vec[12];
+      unsigned rows = 0;
+
+      for (unsigned k = 0; k < count; k++) {
+        const cb::Vector3D &n = edges[k]->normal;
+        if (!n.lengthSquared()) continue;
+
+        for (unsigned l = 0; l < 3; l++) mat[rows][l] = n[l];
+        vec[rows++] = n.dot(edges[k]->vertex - mass);
+      }
+
+      // Less than three rows leaves the system underdetermined
+      for (; rows < 3; rows++) {
+        mat[rows][0] = mat[rows][1] = mat[rows][2] = 0;
+        vec[rows] = 0;
+      }
+
+      cb::Vector3D p = mass + QEF::evaluate(mat, vec, rows);
+
+      // Keep the vertex in its cell
+      cb::Rectangle3D bounds(getPoint(tree, i, j, z),
+                             getPoint(tree, i + 1, j + 1, z + 1));
+      if (!bounds.contains(p)) p = mass;
+
+      cell.vertex = cb::Vector3F(p);
+      cell.active = true;
+    }
+}
+
+
+void DualContouring::addQuad(const Cell &a, const Cell &b, const Cell &c,
+                             const Cell &d, const cb::Vector3F &outside) {
+  if (!a.active || !b.active || !c.active || !d.active) return;
+
+  // Wind the quad so it faces out of the material
+  Triangle t1(cb::Triangle3F(a.vertex, b.vertex, c.vertex));
+  Triangle t2(cb::Triangle3F(a.vertex, c.vertex, d.vertex));
+
+  cb::Vector3F n = Triangle::computeNormal(a.vertex, b.vertex, c.vertex) +
+    Triangle::computeNormal(a.vertex, c.vertex, d.vertex);
+
+  if (n.dot(outside) < 0) {
+    t1 = Triangle(cb::Triangle3F(a.vertex, c.vertex, b.vertex));
+    t2 = Triangle(cb::Triangle3F(a.vertex, d.vertex, c.vertex));
+  }
+
+  t1.updateNormal();
+  t2.updateNormal();
+  triangles.push_back(t1);
+  triangles.push_back(t2);
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "ContourGenerator.h"
+#include "GridTreeRef.h"
+#include "Edge.h"
+#include "Triangle.h"
+
+#include <vector>
+
+
+namespace CAMotics {
+  /***
+   * Dual contouring places one vertex per cell crossing the surface, at the
+   * point which best fits the planes of its edge intersections as found by
+   * QEF::evaluate(), and joins the vertices of the four cells around each
+   * crossing edge with a quad.  This keeps sharp edges and corners which
+   * marching cubes rounds off, with fewer triangles.
+   *
+   * Each cell stores the quads of the three edges leaving its lowest corner.
+   * These also use the cells before it, so depths are sampled with a one
+   * cell border around the grid.
+   */
+  class DualContouring : public ContourGenerator {
+    struct Layer {
+      std::vector<double> depths;
+      std::vector<Edge> xEdges;
+      std::vector<Edge> yEdges;
+      bool valid;
+
+      Layer() : valid(false) {}
+    };
+
+    struct Cell {
+      cb::Vector3F vertex;
+      bool active;
+
+      Cell() : active(false) {}
+    };
+
+    // Vertices per row and column including the border
+    unsigned width;
+    unsigned height;
+
+    Layer layers[2];
+    Layer *lower;
+    Layer *upper;
+    std::vector<Edge> zEdges;
+
+    std::vector<Cell> cells[2];
+    std::vector<Cell> *last;
+    std::vector<Cell> *current;
+
+    std::vector<Triangle> triangles;
+
+  public:
+    DualContouring();
+
+    // From ContourGenerator
+    void run(FieldFunction &func, GridTreeRef &tree);
+
+  protected:
+    cb::Vector3D getPoint(const GridTreeRef &tree, unsigned i, unsigned j,
+                          int z) const;
+    Edge getEdge(FieldFunction &func, const cb::Vector3D &a, double aDepth,
+                 const cb::Vector3D &b, double bDepth, double h) const;
+
+    void computeLayer(FieldFunction &func, const GridTreeRef &tree, int z,
+                      Layer &layer);
+    void computeZEdges(FieldFunction &func, const GridTreeRef &tree, int z);
+    void computeCells(const GridTreeRef &tree, int z);
+    void addQuad(const Cell &a, const Cell &b, const Cell &c, const Cell &d,
+                 const cb::Vector3F &outside);
+  };
+}
@@ -19,6 +19,7 @@
 \******************************************************************************/
 
 #include "FieldFunction.h"
+#include "FieldStats.h"
 
 #include <cbang/Exception.h>
 
@@ -34,39 +35,83 @@ cb::Vector3D FieldFunction::linearIntersect(cb::Vector3D &a, double &aDepth,
   if ((aDepth < 0) == (bDepth < 0))
     THROWS("There is no intersection between points " << a << " & " << b);
 
+  beginSegment(a, b);
+
+  // Search by false position, which follows the depths rather than halving,
+  // until the bracket is as small as eight bisections would leave it.  When
+  // the same end is kept twice its depth is halved, the Illinois method, so
+  // neither end can get stuck.  A step which does not halve the bracket is
+  // followed by a bisection, so depths which are saturated or only give a
+  // bound still end within 16 steps.
+  double length = a.distance(b);
+  double tolerance = length / 256;
+  bool bisect = false;
+  int retained = 0;
   cb::Vector3D mid;
 
-  // Binary search for intersection point
-  for (unsigned i = 0; i < 8; i++) {
-    mid = a + (b - a) * 0.5;
-    double midDepth = depth(mid);
+  for (unsigned i = 0; i < 32; i++) {
+    double t = bisect ? 0.5 : aDepth / (aDepth - bDepth);
+    if (!(0 < t && t < 1)) t = 0.5; // Not finite or at an end
+
+    mid = a + (b - a) * t;
+    double midDepth = segmentDepth(mid);
 
     if ((midDepth < 0) == (aDepth < 0)) {
       a = mid;
       aDepth = midDepth;
+      if (retained == 1) bDepth /= 2;
+      retained = 1;
 
     } else {
       b = mid;
       bDepth = midDepth;
+      if (retained == -1) aDepth /= 2;
+      retained = -1;
     }
+
+    double newLength = a.distance(b);
+    if (!midDepth || newLength <= tolerance) break;
+
+    bisect = !bisect && length / 2 < newLength;
+    length = newLength;
   }
 
   return mid;
 }
 
 
-cb::Vector3D FieldFunction::findNormal(cb::Vector3D &a, double aDepth,
-                                   cb::Vector3D &b, double bDepth) {
-  cb::Vector3D normal;
+cb::Vector3D FieldFunction::findNormal(const cb::Vector3D &p,
+                                       double h) const {
+  cb::Vector3D normal = segmentNormal(p);
+  if (normal.lengthSquared()) return normal;
 
-  // TODO
+  // The depth increases in to the material
+  for (unsigned i = 0; i < 3; i++) {
+    cb::Vector3D offset;
+    offset[i] = h;
+    normal[i] = depth(p - offset) - depth(p + offset);
+  }
 
-  return normal;
+  double length = normal.length();
+  return length ? normal / length : normal;
 }
 
 
 bool FieldFunction::cull(const cb::Vector3D &p, double offset) const {
-  return cull(cb::Rectangle3D(p, p).grow(offset));
+  bool culled = cull(cb::Rectangle3D(p, p).grow(offset));
+
+  FieldStats &stats = FieldStats::local();
+  stats.cullTests++;
+  if (culled) stats.culled++;
+
+  return culled;
+}
+
+
+void FieldFunction::depth(const vector<cb::Vector3D> &points,
+                          vector<double> &depths) const {
+  depths.resize(points.size());
+  for (unsigned i = 0; i < points.size(); i++) depths[i] = depth(points[i]);
 }
 
 
@@ -77,7 +122,7 @@ Edge FieldFunction::getEdge(const cb::Vector3D &v1, double depth1,
 
   Edge e;
   e.vertex = linearIntersect(a, depth1, b, depth2);
-  e.normal = findNormal(a, depth1, b, depth2);
+  e.normal = segmentNormal(e.vertex); // Closed form only, no gradient
   return e;
 
 }
@@ -29,22 +29,53 @@
 
 
 namespace CAMotics {
+  /***
+   * A depth field, not negative inside, which the contour generators
+   * query from many threads at once.  Implementations keep their scratch
+   * space, such as ToolSweep's candidate moves, in thread_local storage
+   * rather than taking a query context.  Workpiece, CutWorkpiece and every
+   * contour generator then share this one const interface, and each
+   * thread's buffers grow once to its working set and are reused by every
+   * later query without allocating.  The segment given to beginSegment()
+   * is kept per thread for the same reason.
+   */
   class FieldFunction {
   public:
     virtual ~FieldFunction() {} // Compiler needs this
 
+    /// Find where the depth changes sign between @param a and @param b.
+    /// They are moved to the ends of the last bracket searched.
     cb::Vector3D linearIntersect(cb::Vector3D &a, double &aDepth,
                                  cb::Vector3D &b, double &bDepth);
-    cb::Vector3D findNormal(cb::Vector3D &a, double aDepth, cb::Vector3D &b,
-                            double bDepth);
+    /// Find the outward unit normal at @param p, on the segment last given
+    /// to beginSegment(), from the surface itself where it is known and
+    /// otherwise from the depth gradient measured over @param h.
+    cb::Vector3D findNormal(const cb::Vector3D &p, double h) const;
     bool contains(const cb::Vector3D &p) const {return 0 <= depth(p);}
     bool cull(const cb::Vector3D &p, double offset) const;
 
     virtual bool cull(const cb::Rectangle3D &r) const {return false;}
+    /// @return 1 if every point in @param r is known to be inside, -1 if
+    /// every point is known to be outside or 0 if the surface may cross it.
+    virtual int classify(const cb::Rectangle3D &r) const {return 0;}
     virtual double depth(const cb::Vector3D &p) const = 0;
+    virtual void depth(const std::vector<cb::Vector3D> &points,
+                       std::vector<double> &depths) const;
     virtual Edge getEdge(const cb::Vector3D &v1, double depth1,
                          const cb::Vector3D &v2, double depth2);
 
+    /// Called before the depths along a segment are searched, so what can
+    /// change along it is only gathered once.
+    virtual void beginSegment(const cb::Vector3D &a,
+                              const cb::Vector3D &b) const {}
+    /// The depth at @param p on the segment given to beginSegment().
+    virtual double segmentDepth(const cb::Vector3D &p) const
+    {return depth(p);}
+    /// @return the outward unit normal of the surface at @param p on the
+    /// segment given to beginSegment() or a zero vector if it is not known.
+    virtual cb::Vector3D segmentNormal(const cb::Vector3D &p) const
+    {return cb::Vector3D();}
+
     Edge getEdge(const cb::Vector3D &v1, bool inside1,
                  const cb::Vector3D &v2, bool inside2);
   };
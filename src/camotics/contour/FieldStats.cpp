@@ -0,0 +1,139 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "FieldStats.h"
+
+#include <cbang/String.h>
+#include <cbang/json/Sink.h>
+
+#include <mutex>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  mutex statsLock;
+  FieldStats totals;
+
+
+  double ratio(uint64_t a, uint64_t b) {return b ? (double)a / b : 0;}
+}
+
+
+void FieldStats::clear() {
+  depthCalls = lookups = candidates = earlyExits = rejected = removed = 0;
+  filled = 0;
+  cullTests = culled = blockCullTests = blocksCulled = 0;
+}
+
+
+FieldStats &FieldStats::operator+=(const FieldStats &o) {
+  depthCalls += o.depthCalls;
+  lookups += o.lookups;
+  candidates += o.candidates;
+  earlyExits += o.earlyExits;
+  rejected += o.rejected;
+  removed += o.removed;
+  filled += o.filled;
+  cullTests += o.cullTests;
+  culled += o.culled;
+  blockCullTests += o.blockCullTests;
+  blocksCulled += o.blocksCulled;
+  return *this;
+}
+
+
+FieldStats FieldStats::operator-(const FieldStats &o) const {
+  FieldStats s = *this;
+  s.depthCalls -= o.depthCalls;
+  s.lookups -= o.lookups;
+  s.candidates -= o.candidates;
+  s.earlyExits -= o.earlyExits;
+  s.rejected -= o.rejected;
+  s.removed -= o.removed;
+  s.filled -= o.filled;
+  s.cullTests -= o.cullTests;
+  s.culled -= o.culled;
+  s.blockCullTests -= o.blockCullTests;
+  s.blocksCulled -= o.blocksCulled;
+  return s;
+}
+
+
+string FieldStats::toString() const {
+  return String::printf("Depths: %llu Candidates/lookup: %0.2f "
+                        "Early exits: %0.2f%% Rejected: %0.2f%% "
+                        "Removed: %0.2f%% Filled: %llu Culled: %0.2f%% "
+                        "Blocks culled: %0.2f%%",
+                        (unsigned long long)depthCalls,
+                        ratio(candidates, lookups),
+                        ratio(earlyExits, candidates) * 100,
+                        ratio(rejected, candidates) * 100,
+                        ratio(removed, depthCalls) * 100,
+                        (unsigned long long)filled,
+                        ratio(culled, cullTests) * 100,
+                        ratio(blocksCulled, blockCullTests) * 100);
+}
+
+
+void FieldStats::write(JSON::Sink &sink) const {
+  sink.beginDict();
+  sink.insert("depth_calls", depthCalls);
+  sink.insert("lookups", lookups);
+  sink.insert("candidates", candidates);
+  sink.insert("candidates_per_lookup", ratio(candidates, lookups));
+  sink.insert("early_exits", earlyExits);
+  sink.insert("early_exit_rate", ratio(earlyExits, candidates));
+  sink.insert("rejected", rejected);
+  sink.insert("reject_rate", ratio(rejected, candidates));
+  sink.insert("removed", removed);
+  sink.insert("removed_rate", ratio(removed, depthCalls));
+  sink.insert("filled", filled);
+  sink.insert("cull_tests", cullTests);
+  sink.insert("culled", culled);
+  sink.insert("cull_rate", ratio(culled, cullTests));
+  sink.insert("block_cull_tests", blockCullTests);
+  sink.insert("blocks_culled", blocksCulled);
+  sink.insert("block_cull_rate", ratio(blocksCulled, blockCullTests));
+  sink.endDict();
+}
+
+
+FieldStats &FieldStats::local() {
+  static thread_local FieldStats stats;
+  return stats;
+}
+
+
+void FieldStats::flush() {
+  FieldStats &stats = local();
+  lock_guard<mutex> guard(statsLock);
+  totals += stats;
+  stats.clear();
+}
+
+
+FieldStats FieldStats::getTotals() {
+  lock_guard<mutex> guard(statsLock);
+  return totals;
+}
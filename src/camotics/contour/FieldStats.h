@@ -0,0 +1,63 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+
+namespace cb {namespace JSON {class Sink;}}
+
+
+namespace CAMotics {
+  /***
+   * Counts of field evaluation work.  Each thread counts in to its own
+   * copy, without locking, which is added to the process totals by flush()
+   * once the thread's work is done.
+   */
+  struct FieldStats {
+    uint64_t depthCalls;     ///< Points evaluated
+    uint64_t lookups;        ///< Move lookups
+    uint64_t candidates;     ///< Moves returned by the lookups
+    uint64_t earlyExits;     ///< Candidates skipped, the point was inside
+    uint64_t rejected;       ///< Candidates out of the tool's reach
+    uint64_t removed;        ///< Points answered by a wholly removed block
+    uint64_t filled;         ///< Vertices given the sign of a uniform region
+    uint64_t cullTests;      ///< Vertices and cells tested for culling
+    uint64_t culled;
+    uint64_t blockCullTests; ///< Blocks of cells tested for culling
+    uint64_t blocksCulled;
+
+    FieldStats() {clear();}
+
+    void clear();
+    FieldStats &operator+=(const FieldStats &o);
+    FieldStats operator-(const FieldStats &o) const;
+
+    std::string toString() const;
+    void write(cb::JSON::Sink &sink) const;
+
+    static FieldStats &local();
+    static void flush();
+    static FieldStats getTotals();
+  };
+}
@@ -0,0 +1,379 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "GLTFWriter.h"
+#include "TriangleMesh.h"
+#include "HalfEdgeMesh.h"
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/json/Writer.h>
+
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // glTF constants
+  const unsigned ARRAY_BUFFER = 34962;
+  const unsigned ELEMENT_ARRAY_BUFFER = 34963;
+  const unsigned BYTE = 5120;
+  const unsigned UNSIGNED_SHORT = 5123;
+  const unsigned UNSIGNED_INT = 5125;
+
+  const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+  const uint32_t GLB_JSON = 0x4E4F534A;  // "JSON"
+  const uint32_t GLB_BIN = 0x004E4942;   // "BIN\0"
+
+
+  // glTF is little-endian, as is every platform CAMotics builds for
+  template <typename T>
+  void append(string &s, T x) {s.append((const char *)&x, sizeof(T));}
+
+
+  void pad(string &s, char c) {while (s.size() % 4) s.push_back(c);}
+
+
+  int8_t quantizeNormal(float x) {
+    return (int8_t)round(max(-1.0f, min(1.0f, x)) * 127);
+  }
+}
+
+
+void GLTFWriter::write(const TriangleMesh &mesh, const string &name,
+                       unsigned lods) {
+  const vector<float> &vertices = mesh.getVertices();
+  if (mesh.getIndices().empty()) THROW("Cannot write an empty glTF mesh");
+
+  // Bounds
+  float min[3], max[3];
+  for (unsigned j = 0; j < 3; j++) min[j] = max[j] = vertices[j];
+
+  for (unsigned i = 0; i < vertices.size(); i += 3)
+    for (unsigned j = 0; j < 3; j++) {
+      min[j] = std::min(min[j], vertices[i + j]);
+      max[j] = std::max(max[j], vertices[i + j]);
+    }
+
+  float scale[3];
+  double diagonal = 0;
+  for (unsigned j = 0; j < 3; j++) {
+    float extent = max[j] - min[j];
+    scale[j] = extent ? extent / 65535 : 1;
+    diagonal += (double)extent * extent;
+  }
+  diagonal = sqrt(diagonal);
+
+  // Levels
+  data.clear();
+  views.clear();
+  accessors.clear();
+  vector<unsigned> levels;
+
+  for (unsigned k = 0; k <= lods; k++) {
+    Level level;
+
+    if (k) {
+      buildLevel(mesh, diagonal / 4096 * pow(4.0, k - 1), level);
+      if (level.indices.empty()) break;
+
+    } else {
+      level.indices = mesh.getIndices();
+      for (unsigned i = 0; i < vertices.size() / 3; i++)
+        level.vertices.push_back(i);
+    }
+
+    levels.push_back(addLevel(mesh, level, min, scale));
+  }
+
+  // JSON
+  ostringstream str;
+  JSON::Writer writer(str, 0, true);
+
+  writer.beginDict();
+
+  writer.insertDict("asset");
+  writer.insert("version", "2.0");
+  writer.insert("generator", "CAMotics");
+  writer.endDict();
+
+  writer.insertList("extensionsUsed");
+  writer.append("KHR_mesh_quantization");
+  if (1 < levels.size()) writer.append("MSFT_lod");
+  writer.endList();
+
+  writer.insertList("extensionsRequired");
+  writer.append("KHR_mesh_quantization");
+  writer.endList();
+
+  writer.insert("scene", 0);
+  writer.insertList("scenes");
+  writer.appendDict();
+  writer.insertList("nodes");
+  writer.append(0);
+  writer.endList();
+  writer.endDict();
+  writer.endList();
+
+  // Coarser levels are only reachable through the first node
+  writer.insertList("nodes");
+  for (unsigned k = 0; k < levels.size(); k++) {
+    writer.appendDict();
+    writer.insert("name", k ? name + " LOD " + String(k) : name);
+    writer.insert("mesh", k);
+
+    writer.insertList("translation");
+    for (unsigned j = 0; j < 3; j++) writer.append(min[j]);
+    writer.endList();
+
+    writer.insertList("scale");
+    for (unsigned j = 0; j < 3; j++) writer.append(scale[j]);
+    writer.endList();
+
+    if (!k && 1 < levels.size()) {
+      writer.insertDict("extensions");
+      writer.insertDict("MSFT_lod");
+      writer.insertList("ids");
+      for (unsigned i = 1; i < levels.size(); i++) writer.append(i);
+      writer.endList();
+      writer.endDict();
+      writer.endDict();
+
+      writer.insertDict("extras");
+      writer.insertList("MSFT_screencoverage");
+      for (unsigned i = 0; i < levels.size(); i++)
+        writer.append(pow(0.5, i + 1));
+      writer.endList();
+      writer.endDict();
+    }
+
+    writer.endDict();
+  }
+  writer.endList();
+
+  writer.insertList("meshes");
+  for (unsigned k = 0; k < levels.size(); k++) {
+    writer.appendDict();
+    writer.insertList("primitives");
+    writer.appendDict();
+    writer.insertDict("attributes");
+    writer.insert("POSITION", levels[k]);
+    writer.insert("NORMAL", levels[k] + 1);
+    writer.endDict();
+    writer.insert("indices", levels[k] + 2);
+    writer.insert("material", 0);
+    writer.endDict();
+    writer.endList();
+    writer.endDict();
+  }
+  writer.endList();
+
+  writer.insertList("materials");
+  writer.appendDict();
+  writer.insertDict("pbrMetallicRoughness");
+  writer.insertList("baseColorFactor");
+  for (unsigned j = 0; j < 3; j++) writer.append(0.7);
+  writer.append(1);
+  writer.endList();
+  writer.insert("metallicFactor", 0.5);
+  writer.insert("roughnessFactor", 0.5);
+  writer.endDict();
+  writer.endDict();
+  writer.endList();
+
+  writer.insertList("accessors");
+  for (unsigned i = 0; i < accessors.size(); i++) {
+    const Accessor &a = accessors[i];
+    unsigned components = string(a.type) == "VEC3" ? 3 : 1;
+
+    writer.appendDict();
+    writer.insert("bufferView", a.view);
+    writer.insert("componentType", a.componentType);
+    if (a.normalized) writer.insertBoolean("normalized", true);
+    writer.insert("count", a.count);
+    writer.insert("type", a.type);
+
+    // Required for positions
+    if (i % 3 == 0) {
+      writer.insertList("min");
+      for (unsigned j = 0; j < components; j++) writer.append(a.min[j]);
+      writer.endList();
+
+      writer.insertList("max");
+      for (unsigned j = 0; j < components; j++) writer.append(a.max[j]);
+      writer.endList();
+    }
+
+    writer.endDict();
+  }
+  writer.endList();
+
+  writer.insertList("bufferViews");
+  for (unsigned i = 0; i < views.size(); i++) {
+    const View &v = views[i];
+
+    writer.appendDict();
+    writer.insert("buffer", 0);
+    writer.insert("byteOffset", v.offset);
+    writer.insert("byteLength", v.length);
+    if (v.stride) writer.insert("byteStride", v.stride);
+    writer.insert("target", v.target);
+    writer.endDict();
+  }
+  writer.endList();
+
+  writer.insertList("buffers");
+  writer.appendDict();
+  writer.insert("byteLength", data.size());
+  writer.endDict();
+  writer.endList();
+
+  writer.endDict();
+  writer.close();
+
+  // GLB container
+  string json = str.str();
+  pad(json, ' ');
+
+  string header;
+  append(header, GLB_MAGIC);
+  append(header, (uint32_t)2);
+  append(header, (uint32_t)(12 + 8 + json.size() + 8 + data.size()));
+  append(header, (uint32_t)json.size());
+  append(header, GLB_JSON);
+
+  string binHeader;
+  append(binHeader, (uint32_t)data.size());
+  append(binHeader, GLB_BIN);
+
+  ostream &stream = sink.getStream();
+  stream.write(header.data(), header.size());
+  stream.write(json.data(), json.size());
+  stream.write(binHeader.data(), binHeader.size());
+  stream.write(data.data(), data.size());
+  stream.flush();
+
+  if (!stream) THROW("Failed to write glTF");
+
+  data.clear();
+}
+
+
+void GLTFWriter::buildLevel(const TriangleMesh &mesh, double maxDistance,
+                            Level &level) const {
+  HalfEdgeMesh reducer(mesh.getVertices(), mesh.getIndices());
+  reducer.queueCollapses(maxDistance);
+  while (reducer.collapseNext()) continue;
+
+  // Collapses keep vertex ids, so only the survivors need renumbering
+  vector<uint32_t> ids(mesh.getVertices().size() / 3, ~(uint32_t)0);
+
+  for (unsigned f = 0; f < reducer.getFaceCount(); f++) {
+    uint32_t v[3];
+    if (!reducer.getFace(f, v)) continue;
+
+    for (unsigned j = 0; j < 3; j++) {
+      if (ids[v[j]] == ~(uint32_t)0) {
+        ids[v[j]] = level.vertices.size();
+        level.vertices.push_back(v[j]);
+      }
+
+      level.indices.push_back(ids[v[j]]);
+    }
+  }
+}
+
+
+unsigned GLTFWriter::addLevel(const TriangleMesh &mesh, const Level &level,
+                              const float min[3], const float scale[3]) {
+  const vector<float> &vertices = mesh.getVertices();
+  const vector<float> &normals = mesh.getNormals();
+  unsigned count = level.vertices.size();
+  unsigned first = accessors.size();
+
+  // Positions, padded to four byte alignment
+  Accessor positions = {0, UNSIGNED_SHORT, false, count, "VEC3",
+                        {65535, 65535, 65535}, {0, 0, 0}};
+  string bytes;
+
+  for (unsigned i = 0; i < count; i++) {
+    const float *v = &vertices[3 * level.vertices[i]];
+
+    for (unsigned j = 0; j < 3; j++) {
+      unsigned q = (unsigned)round((v[j] - min[j]) / scale[j]);
+      if (65535 < q) q = 65535;
+      positions.min[j] = std::min(positions.min[j], q);
+      positions.max[j] = std::max(positions.max[j], q);
+      append(bytes, (uint16_t)q);
+    }
+
+    append(bytes, (uint16_t)0);
+  }
+
+  positions.view = addView(bytes, 8, ARRAY_BUFFER);
+  accessors.push_back(positions);
+
+  // Normals
+  Accessor norms = {0, BYTE, true, count, "VEC3", {0, 0, 0}, {0, 0, 0}};
+  bytes.clear();
+
+  for (unsigned i = 0; i < count; i++) {
+    const float *n = &normals[3 * level.vertices[i]];
+    for (unsigned j = 0; j < 3; j++) append(bytes, quantizeNormal(n[j]));
+    append(bytes, (int8_t)0);
+  }
+
+  norms.view = addView(bytes, 4, ARRAY_BUFFER);
+  accessors.push_back(norms);
+
+  // Indices
+  bool small = count <= 65536;
+  Accessor indices = {0, small ? UNSIGNED_SHORT : UNSIGNED_INT, false,
+                      (unsigned)level.indices.size(), "SCALAR", {0, 0, 0},
+                      {0, 0, 0}};
+  bytes.clear();
+
+  for (unsigned i = 0; i < level.indices.size(); i++)
+    if (small) append(bytes, (uint16_t)level.indices[i]);
+    else append(bytes, level.indices[i]);
+
+  indices.view = addView(bytes, 0, ELEMENT_ARRAY_BUFFER);
+  accessors.push_back(indices);
+
+  return first;
+}
+
+
+unsigned GLTFWriter::addView(const string &bytes, unsigned stride,
+                             unsigned target) {
+  View view = {(unsigned)data.size(), (unsigned)bytes.size(), stride, target};
+
+  data.append(bytes);
+  pad(data, 0);
+  views.push_back(view);
+
+  return views.size() - 1;
+}
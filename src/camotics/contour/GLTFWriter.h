@@ -0,0 +1,87 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include <cbang/io/OutputSink.h>
+
+#include <string>
+#include <vector>
+
+
+namespace CAMotics {
+  class TriangleMesh;
+
+  /***
+   * Writes an indexed triangle mesh as binary glTF, for web viewers.  The
+   * mesh is already welded, so its vertices are written as is.  Positions
+   * are quantized to 16 bits over the bounds, normals to 8 bits, as
+   * allowed by KHR_mesh_quantization, and indices use 16 bits where they
+   * fit.  Coarser levels of detail, made by edge collapse, are added with
+   * MSFT_lod so viewers can show something before the full mesh loads.
+   */
+  class GLTFWriter {
+    cb::OutputSink sink;
+
+    struct Level {
+      std::vector<uint32_t> vertices; ///< The mesh vertex of each
+      std::vector<uint32_t> indices;  ///< Into vertices
+    };
+
+    struct View {
+      unsigned offset;
+      unsigned length;
+      unsigned stride;
+      unsigned target;
+    };
+
+    struct Accessor {
+      unsigned view;
+      unsigned componentType;
+      bool normalized;
+      unsigned count;
+      const char *type;
+      unsigned min[3]; ///< Only kept for positions
+      unsigned max[3];
+    };
+
+    std::string data;
+    std::vector<View> views;
+    std::vector<Accessor> accessors;
+
+  public:
+    GLTFWriter(const cb::OutputSink &sink) : sink(sink) {}
+
+    /// Write @param mesh followed by @param lods levels, each allowed to
+    /// stray four times further from the surface than the last.
+    void write(const TriangleMesh &mesh, const std::string &name,
+               unsigned lods = 0);
+
+  protected:
+    void buildLevel(const TriangleMesh &mesh, double maxDistance,
+                    Level &level) const;
+    /// @return the first of the level's three accessors, positions,
+    /// normals and indices.
+    unsigned addLevel(const TriangleMesh &mesh, const Level &level,
+                      const float min[3], const float scale[3]);
+    unsigned addView(const std::string &bytes, unsigned stride,
+                     unsigned target);
+  };
+}
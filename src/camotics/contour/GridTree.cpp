@@ -21,15 +21,26 @@
 #include "GridTree.h"
 #include "GridTreeRef.h"
 
-#include <camotics/sim/AABBTree.h>
+#include <camotics/sim/ToolSweep.h>
 
 #include <cbang/log/Logger.h>
 
+#include <cmath>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  double cost(const ToolSweep &sweep, const cb::Rectangle3D &bbox,
+              const cb::Rectangle3D &bounds) {
+    if (!bbox.intersects(bounds)) return 0;
+    return 1 + sweep.intersections(bbox.intersection(bounds));
+  }
+}
+
+
 GridTree::GridTree(const Grid &grid) :
   GridTreeNode(grid.getSteps()), Grid(grid) {}
 
@@ -38,11 +49,22 @@ GridTree::~GridTree() {}
 
 
 void GridTree::partition(vector<GridTreeRef> &grids, const cb::Rectangle3D &bbox,
-                         unsigned count) {
+                         unsigned count, const ToolSweep *sweep) {
   cb::Rectangle3D bounds = getBounds();
   if (isEmpty() || !bbox.intersects(bounds)) return;
 
-  if (count < 2) {
+  // Nothing would be rendered, cells are culled with the same margin
+  if (sweep && sweep->cull(bbox.intersection(bounds)
+                           .grow(getResolution() * 1.1))) return;
+
+  // Once leaves have been inserted the tree below cannot be partitioned, and
+  // once partitioned it must be again so leaves always go to the same nodes
+  GridTree *leftTree = dynamic_cast<GridTree *>(left);
+  GridTree *rightTree = dynamic_cast<GridTree *>(right);
+  bool hasLeaves = (left && !leftTree) || (right && !rightTree);
+  bool isSplit = leftTree || rightTree;
+
+  if (hasLeaves || (count < 2 && !isSplit)) {
     cb::Vector3U offset;
     cb::Vector3U steps(getSteps());
 
@@ -67,14 +89,37 @@ void GridTree::partition(vector<GridTreeRef> &grids, const cb::Rectangle3D &bbox
 
   pair<Grid, Grid> parts = Grid::split(largestDim());
 
-  if (!left) left = new GridTree(parts.first);
-  if (!right) right = new GridTree(parts.second);
+  if (!left) left = leftTree = new GridTree(parts.first);
+  if (!right) right = rightTree = new GridTree(parts.second);
+
+  if (count < 2) count = 2;
+  unsigned leftCount = count / 2;
 
-  dynamic_cast<GridTree *>(left)->partition(grids, bbox, count / 2);
-  dynamic_cast<GridTree *>(right)->partition(grids, bbox, count - count / 2);
+  if (sweep) {
+    // Divide the count by the moves on each side
+    double leftCost = cost(*sweep, bbox, parts.first.getBounds());
+    double rightCost = cost(*sweep, bbox, parts.second.getBounds());
+
+    if (!leftCost) leftCount = 0;
+    else if (!rightCost) leftCount = count;
+    else {
+      leftCount = round(count * leftCost / (leftCost + rightCost));
+      if (!leftCount) leftCount = 1;
+      if (count <= leftCount) leftCount = count - 1;
+    }
+  }
+
+  leftTree->partition(grids, bbox, leftCount, sweep);
+  rightTree->partition(grids, bbox, count - leftCount, sweep);
 }
 
 
 void GridTree::insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &offset) {
   GridTreeNode::insertLeaf(leaf, getSteps(), offset);
 }
+
+
+void GridTree::getChunks(vector<Chunk> &chunks, unsigned maxCells) const {
+  GridTreeNode::getChunks(this, getOffset(), getSteps(), cb::Vector3U(),
+                          cb::Vector3U(), getSteps(), maxCells, chunks);
+}
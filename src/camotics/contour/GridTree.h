@@ -28,16 +28,25 @@
 
 namespace CAMotics {
   class GridTreeRef;
+  class ToolSweep;
 
   class GridTree : public GridTreeNode, public Grid {
   public:
     GridTree(const Grid &grid);
     ~GridTree();
 
+    /***
+     * Divide the part of the tree within @param bbox in to about
+     * @param count grids.  If @param sweep is given, grids it culls are
+     * dropped and the count is divided in proportion to the number of moves
+     * intersecting each side, so each grid gets about the same work.
+     */
     void partition(std::vector<GridTreeRef> &grids, const cb::Rectangle3D &bbox,
-                   unsigned count);
+                   unsigned count, const ToolSweep *sweep = 0);
 
     using GridTreeNode::insertLeaf;
     void insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &offset);
+
+    void getChunks(std::vector<Chunk> &chunks, unsigned maxCells) const;
   };
 }
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <cbang/StdTypes.h>
 #include <cbang/geom/Vector.h>
 
 #include <vector>
@@ -33,7 +34,11 @@ namespace CAMotics {
     virtual ~GridTreeBase() {}
 
     virtual bool isLeaf() const {return false;}
+    /// Give up this holder's reference, freeing the node if it was the last.
+    virtual void release() {delete this;}
     virtual unsigned getCount() const = 0;
+    /// @return the bytes held by this node and those below it.
+    virtual uint64_t getMemoryUsage() const = 0;
     virtual void insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &steps,
                             const cb::Vector3U &offset) {}
     virtual void gather(std::vector<float> &vertices,
@@ -20,23 +20,93 @@
 
 #include "GridTreeLeaf.h"
 
+#include <cbang/Exception.h>
+#include <cbang/StdTypes.h>
+
+#include <algorithm>
+#include <new>
+#include <cstring>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
-void GridTreeLeaf::add(const Triangle &t) {
-  if (!t.normal.isReal()) return; // Degenerate, skip
-  triangles.push_back(t);
+namespace {
+  bool isDegenerate(const Triangle &t) {return !t.normal.isReal();}
+}
+
+
+GridTreeLeaf::GridTreeLeaf(const vector<Triangle> &triangles,
+                           unsigned count) : refs(1), count(count) {
+  float *vertices = getVertices();
+  float *normals = vertices + count * 9;
+
+  for (unsigned i = 0; i < triangles.size(); i++) {
+    const Triangle &t = triangles[i];
+    if (isDegenerate(t)) continue;
+
+    for (unsigned j = 0; j < 3; j++)
+      for (unsigned k = 0; k < 3; k++)
+        *vertices++ = t[j][k];
+
+    for (unsigned k = 0; k < 3; k++)
+      *normals++ = t.normal[k];
+  }
+}
+
+
+GridTreeLeaf *GridTreeLeaf::create(const vector<Triangle> &triangles) {
+  unsigned count = triangles.size() -
+    count_if(triangles.begin(), triangles.end(), isDegenerate);
+  if (!count) return 0;
+
+  // Triangle data follows the leaf
+  void *ptr = ::operator new(sizeof(GridTreeLeaf) + count * 12 * sizeof(float));
+
+  return new (ptr) GridTreeLeaf(triangles, count);
 }
 
 
+void GridTreeLeaf::pack(vector<char> &data) const {
+  uint32_t count = this->count;
+  const char *c = (const char *)&count;
+  data.insert(data.end(), c, c + sizeof(count));
+
+  const char *v = (const char *)getVertices();
+  data.insert(data.end(), v, v + count * 12 * sizeof(float));
+}
+
+
+GridTreeLeaf *GridTreeLeaf::unpack(const char *&data, const char *end) {
+  uint32_t count;
+  if (end - data < (ptrdiff_t)sizeof(count)) THROW("Packed leaf is truncated");
+  memcpy(&count, data, sizeof(count));
+  data += sizeof(count);
+
+  uint64_t size = (uint64_t)count * 12 * sizeof(float);
+  if (!count || (uint64_t)(end - data) < size)
+    THROW("Packed leaf is corrupt");
+
+  void *ptr = ::operator new(sizeof(GridTreeLeaf) + size);
+  GridTreeLeaf *leaf = new (ptr) GridTreeLeaf(count);
+  memcpy(leaf->getVertices(), data, size);
+  data += size;
+
+  return leaf;
+}
+
+
+void GridTreeLeaf::operator delete(void *ptr) {::operator delete(ptr);}
+
+
 void GridTreeLeaf::gather(vector<float> &vertices,
                           vector<float> &normals) const {
-  for (unsigned i = 0; i < getCount(); i++)
+  const float *v = getVertices();
+  vertices.insert(vertices.end(), v, v + count * 9);
+
+  const float *n = getNormals();
+  for (unsigned i = 0; i < count; i++, n += 3)
     for (unsigned j = 0; j < 3; j++)
-      for (unsigned k = 0; k < 3; k++) {
-        vertices.push_back(triangles[i][j][k]);
-        normals.push_back(triangles[i].normal[k]);
-      }
+      normals.insert(normals.end(), n, n + 3);
 }
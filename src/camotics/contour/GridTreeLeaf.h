@@ -26,20 +26,48 @@
 
 
 #include <vector>
+#include <atomic>
 
 
 namespace CAMotics {
+  /***
+   * The triangles of one cell, stored in the same allocation as the leaf.
+   * Vertices are kept in the triangle soup layout gather() produces so they
+   * can be copied in one block, followed by one normal per triangle.
+   * Leaves never change once made, so snapshots of a tree share them with
+   * it and a leaf is freed when its last holder releases it.
+   */
   class GridTreeLeaf : public GridTreeBase {
-    std::vector<Triangle> triangles;
+    std::atomic<unsigned> refs;
+    unsigned count;
+
+    GridTreeLeaf(const std::vector<Triangle> &triangles, unsigned count);
+    GridTreeLeaf(unsigned count) : refs(1), count(count) {}
+
+    float *getVertices() {return reinterpret_cast<float *>(this + 1);}
+    const float *getVertices() const
+    {return reinterpret_cast<const float *>(this + 1);}
+    const float *getNormals() const {return getVertices() + count * 9;}
 
   public:
-    const std::vector<Triangle> &getTriangles() const {return triangles;}
+    /// @return a new leaf holding the non-degenerate @param triangles or
+    /// null if there are none.
+    static GridTreeLeaf *create(const std::vector<Triangle> &triangles);
+    /// Append the triangles, as stored, to @param data.
+    void pack(std::vector<char> &data) const;
+    /// @return a leaf read from @param data, which is advanced past it.
+    /// Throws if fewer than @param end - @param data bytes would be read.
+    static GridTreeLeaf *unpack(const char *&data, const char *end);
+    static void operator delete(void *ptr);
 
-    void add(const Triangle &t);
+    GridTreeLeaf *acquire() {refs++; return this;}
 
     // From GridTreeBase
     bool isLeaf() const {return true;}
-    unsigned getCount() const {return triangles.size();}
+    void release() {if (!--refs) delete this;}
+    unsigned getCount() const {return count;}
+    uint64_t getMemoryUsage() const
+    {return sizeof(GridTreeLeaf) + count * 12 * sizeof(float);}
     void gather(std::vector<float> &vertices,
                 std::vector<float> &normals) const;
   };
@@ -21,27 +21,40 @@
 #include "GridTreeNode.h"
 #include "GridTreeLeaf.h"
 
+#include <camotics/Grid.h>
+
 #include <cbang/Exception.h>
+#include <cbang/StdTypes.h>
+
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  unsigned largestAxis(const cb::Vector3U &steps) {
+    unsigned axis = 2;
+    if (steps.y() <= steps.x() && steps.z() <= steps.x()) axis = 0;
+    if (steps.x() <= steps.y() && steps.z() <= steps.y()) axis = 1;
+    return axis;
+  }
+}
+
+
 GridTreeNode::GridTreeNode(const cb::Vector3U &steps) :
-  left(0), right(0), count(0) {
-  // Choose largest axis
-  axis = 2;
-  if (steps.y() <= steps.x() && steps.z() <= steps.x()) axis = 0;
-  if (steps.x() <= steps.y() && steps.z() <= steps.y()) axis = 1;
+  left(0), right(0), axis(largestAxis(steps)), split(steps[axis] / 2) {}
 
-  split = steps[axis] / 2;
-}
+
+GridTreeNode::~GridTreeNode() {clear();}
 
 
-GridTreeNode::~GridTreeNode() {
-  if (left) delete left;
-  if (right) delete right;
+void GridTreeNode::clear() {
+  if (left) left->release();
+  if (right) right->release();
+  left = right = 0;
 }
 
 
@@ -63,10 +76,11 @@ void GridTreeNode::insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &_steps,
     steps[axis] /= 2;
 
     if (atLeaf(steps)) {
-      if (left) delete left;
+      if (left) left->release();
       left = leaf;
 
     } else {
+      if (!left && !leaf) return; // Nothing to clear
       if (!left) left = new GridTreeNode(steps);
       left->insertLeaf(leaf, steps, offset);
     }
@@ -78,16 +92,135 @@ void GridTreeNode::insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &_steps,
     rOffset[axis] -= split;
 
     if (atLeaf(steps)) {
-      if (right) delete right;
+      if (right) right->release();
       right = leaf;
 
     } else {
+      if (!right && !leaf) return; // Nothing to clear
       if (!right) right = new GridTreeNode(steps);
       right->insertLeaf(leaf, steps, rOffset);
     }
   }
+}
+
+
+void GridTreeNode::getLeaves(const cb::Vector3U &steps,
+                             const cb::Vector3U &offset,
+                             leaves_t &leaves) const {
+  // Same routing as insertLeaf()
+  cb::Vector3U lSteps(steps);
+  cb::Vector3U rSteps(steps);
+  cb::Vector3U rOffset(offset);
+  lSteps[axis] /= 2;
+  rSteps[axis] -= steps[axis] / 2;
+  rOffset[axis] += split;
+
+  const GridTreeBase *children[2] = {left, right};
+  const cb::Vector3U *childSteps[2] = {&lSteps, &rSteps};
+  const cb::Vector3U *childOffsets[2] = {&offset, &rOffset};
+
+  for (unsigned i = 0; i < 2; i++) {
+    const GridTreeBase *child = children[i];
+    if (!child) continue;
+
+    if (child->isLeaf())
+      leaves.push_back(make_pair(*childOffsets[i],
+                                 static_cast<const GridTreeLeaf *>(child)));
+
+    else {
+      const GridTreeNode *node = dynamic_cast<const GridTreeNode *>(child);
+      if (node) node->getLeaves(*childSteps[i], *childOffsets[i], leaves);
+    }
+  }
+}
+
+
+void GridTreeNode::getSlots(slots_t &slots) {
+  GridTreeBase **children[2] = {&left, &right};
+
+  for (unsigned i = 0; i < 2; i++) {
+    GridTreeBase *child = *children[i];
+    if (!child) continue;
+
+    if (child->isLeaf())
+      slots.push_back(make_pair(children[i],
+                                static_cast<GridTreeLeaf *>(child)));
+
+    else {
+      GridTreeNode *node = dynamic_cast<GridTreeNode *>(child);
+      if (node) node->getSlots(slots);
+    }
+  }
+}
+
+
+void GridTreeNode::getChunks(const GridTreeBase *node,
+                             const cb::Vector3D &origin,
+                             const cb::Vector3U &_steps,
+                             const cb::Vector3U &_offset,
+                             const cb::Vector3U &_min, const cb::Vector3U &_max,
+                             unsigned maxCells, vector<Chunk> &chunks) {
+  cb::Vector3U steps(_steps);
+  cb::Vector3U offset(_offset);
+  cb::Vector3U min(_min);
+  cb::Vector3U max(_max);
+
+  // Partitioned subtrees have their own grid and leaves are inserted
+  // relative to it
+  const Grid *grid = dynamic_cast<const Grid *>(node);
+  if (grid) {
+    steps = grid->getSteps();
+    cb::Vector3D o = (grid->getOffset() - origin) / grid->getResolution();
+    for (unsigned i = 0; i < 3; i++) offset[i] = (unsigned)round(o[i]);
+    min = offset;
+    max = offset + steps;
+  }
+
+  // Nothing can be stored in an empty range of cells
+  for (unsigned i = 0; i < 3; i++) if (max[i] <= min[i]) return;
+
+  cb::Vector3U dims = max - min;
+  if ((uint64_t)steps.x() * steps.y() * steps.z() <= maxCells ||
+      (uint64_t)dims.x() * dims.y() * dims.z() <= maxCells) {
+    Chunk chunk = {node, min, max};
+    chunks.push_back(chunk);
+    return;
+  }
+
+  // Route cells the same way insertLeaf() does, with missing subtrees split
+  // as insertLeaf() would create them, so chunks stay the same as they fill
+  const GridTreeNode *n = dynamic_cast<const GridTreeNode *>(node);
+  unsigned axis = n ? n->axis : largestAxis(steps);
+  unsigned split = n ? n->split : steps[axis] / 2;
+
+  cb::Vector3U lSteps(steps);
+  cb::Vector3U rSteps(steps);
+  lSteps[axis] /= 2;
+  rSteps[axis] -= steps[axis] / 2;
+
+  cb::Vector3U lMax(max);
+  cb::Vector3U rMin(min);
+  cb::Vector3U rOffset(offset);
+  lMax[axis] = std::min(max[axis], offset[axis] + split);
+  rMin[axis] = std::max(min[axis], offset[axis] + split);
+  rOffset[axis] += split;
+
+  getChunks(n ? n->left : 0, origin, lSteps, offset, min, lMax, maxCells,
+            chunks);
+  getChunks(n ? n->right : 0, origin, rSteps, rOffset, rMin, max, maxCells,
+            chunks);
+}
+
+
+unsigned GridTreeNode::getCount() const {
+  // Computed when needed so inserts only touch the path to their leaf
+  return (left ? left->getCount() : 0) + (right ? right->getCount() : 0);
+}
+
 
-  count = (left ? left->getCount() : 0) + (right ? right->getCount() : 0);
+uint64_t GridTreeNode::getMemoryUsage() const {
+  return sizeof(GridTreeNode) + (left ? left->getMemoryUsage() : 0) +
+    (right ? right->getMemoryUsage() : 0);
 }
 
 
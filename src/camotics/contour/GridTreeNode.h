@@ -23,6 +23,8 @@
 
 #include "GridTreeBase.h"
 
+#include <utility>
+
 
 namespace CAMotics {
   class GridTreeNode : public GridTreeBase {
@@ -33,14 +35,40 @@ namespace CAMotics {
     unsigned axis;
     unsigned split;
 
-    unsigned count;
-
   public:
+    /// A subtree, in gather order, and the cells which may be stored in it
+    struct Chunk {
+      const GridTreeBase *node;
+      cb::Vector3U min;
+      cb::Vector3U max;
+    };
+
+    typedef std::vector<std::pair<cb::Vector3U, const GridTreeLeaf *> >
+    leaves_t;
+    typedef std::vector<std::pair<GridTreeBase **, GridTreeLeaf *> > slots_t;
+
     GridTreeNode(const cb::Vector3U &steps);
     ~GridTreeNode();
 
+    static void getChunks(const GridTreeBase *node, const cb::Vector3D &origin,
+                          const cb::Vector3U &steps,
+                          const cb::Vector3U &offset, const cb::Vector3U &min,
+                          const cb::Vector3U &max, unsigned maxCells,
+                          std::vector<Chunk> &chunks);
+
+    /// Free all cells below this node.
+    void clear();
+    /// Append the leaves below this node of @param steps cells with their
+    /// cells, counted from @param offset, as insertLeaf() placed them.
+    void getLeaves(const cb::Vector3U &steps, const cb::Vector3U &offset,
+                   leaves_t &leaves) const;
+    /// Append the child pointers below this node which hold leaves, with
+    /// their leaves.  Nodes are only freed by clear() so they stay valid.
+    void getSlots(slots_t &slots);
+
     // From GridTreeBase
-    unsigned getCount() const {return count;}
+    unsigned getCount() const;
+    uint64_t getMemoryUsage() const;
     void insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &steps,
                     const cb::Vector3U &offset);
     void gather(std::vector<float> &vertices,
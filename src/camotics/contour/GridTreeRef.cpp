@@ -19,9 +19,12 @@
 \******************************************************************************/
 
 #include "GridTreeRef.h"
+#include "GridTreeLeaf.h"
 
 #include <cbang/Exception.h>
 
+#include <cstring>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
@@ -37,7 +40,12 @@ GridTreeRef::GridTreeRef(GridTree *ref, const cb::Vector3U &offset,
 
 
 unsigned GridTreeRef::getCount() const {
-  THROWS("Cannot call " << __func__ << " on GridTreeRef");
+  return ref->getCount();
+}
+
+
+uint64_t GridTreeRef::getMemoryUsage() const {
+  return ref->getMemoryUsage();
 }
 
 
@@ -46,7 +54,50 @@ void GridTreeRef::insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &offset) {
 }
 
 
+void GridTreeRef::clear() {
+  ref->clear();
+}
+
+
 void GridTreeRef::gather(vector<float> &vertices,
                          vector<float> &normals) const {
-  THROWS("Cannot call " << __func__ << " on GridTreeRef");
+  // Partitioned grids own their subtree, so this is safe while other grids
+  // are rendering.  It includes any cells of the subtree outside this grid.
+  ref->gather(vertices, normals);
+}
+
+
+void GridTreeRef::pack(vector<char> &data) const {
+  GridTreeNode::leaves_t leaves;
+  ref->getLeaves(ref->getSteps(), cb::Vector3U(), leaves);
+
+  // Each leaf's cell in the subtree followed by its triangles
+  for (unsigned i = 0; i < leaves.size(); i++) {
+    uint32_t cell[3];
+    for (unsigned j = 0; j < 3; j++) cell[j] = leaves[i].first[j];
+
+    const char *c = (const char *)cell;
+    data.insert(data.end(), c, c + sizeof(cell));
+    leaves[i].second->pack(data);
+  }
+}
+
+
+void GridTreeRef::unpack(const char *data, uint64_t length) {
+  const char *end = data + length;
+  const cb::Vector3U &steps = ref->getSteps();
+
+  while (data < end) {
+    uint32_t cell[3];
+    if ((uint64_t)(end - data) < sizeof(cell))
+      THROW("Packed grid is truncated");
+    memcpy(cell, data, sizeof(cell));
+    data += sizeof(cell);
+
+    for (unsigned i = 0; i < 3; i++)
+      if (steps[i] <= cell[i]) THROW("Packed grid is corrupt");
+
+    ref->insertLeaf(GridTreeLeaf::unpack(data, end),
+                    cb::Vector3U(cell[0], cell[1], cell[2]));
+  }
 }
@@ -23,6 +23,8 @@
 
 #include "GridTree.h"
 
+#include <cbang/StdTypes.h>
+
 
 namespace CAMotics {
   class GridTreeRef : public GridTreeBase, public Grid {
@@ -35,9 +37,18 @@ namespace CAMotics {
 
     using GridTreeBase::insertLeaf;
     void insertLeaf(GridTreeLeaf *leaf, const cb::Vector3U &offset);
+    /// Free the cells of the subtree, including any outside this grid.
+    void clear();
+
+    /// Append the leaves of the subtree to @param data.
+    void pack(std::vector<char> &data) const;
+    /// Insert leaves from pack() in to the subtree.  Throws if @param data
+    /// is corrupt, keeping any leaves read before the error.
+    void unpack(const char *data, uint64_t length);
 
     // From GridTreeBase
     unsigned getCount() const;
+    uint64_t getMemoryUsage() const;
     void gather(std::vector<float> &vertices,
                 std::vector<float> &normals) const;
   };
@@ -0,0 +1,75 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "GridTreeSnapshot.h"
+#include "GridTreeLeaf.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+GridTreeSnapshot::GridTreeSnapshot(GridTreeNode &tree, double time) :
+  time(time) {
+  tree.getSlots(slots);
+  sort(slots.begin(), slots.end());
+  for (unsigned i = 0; i < slots.size(); i++) slots[i].second->acquire();
+}
+
+
+GridTreeSnapshot::~GridTreeSnapshot() {
+  for (unsigned i = 0; i < slots.size(); i++) slots[i].second->release();
+}
+
+
+uint64_t GridTreeSnapshot::getMemoryUsage() const {
+  return sizeof(GridTreeSnapshot) +
+    slots.capacity() * sizeof(GridTreeNode::slots_t::value_type);
+}
+
+
+void GridTreeSnapshot::restore(GridTreeNode &tree) const {
+  GridTreeNode::slots_t current;
+  tree.getSlots(current);
+  sort(current.begin(), current.end());
+
+  // Empty the slots filled since, nodes are never freed so ours still exist
+  unsigned j = 0;
+  for (unsigned i = 0; i < current.size(); i++) {
+    GridTreeBase **slot = current[i].first;
+    while (j < slots.size() && slots[j].first < slot) j++;
+    if (j < slots.size() && slots[j].first == slot) continue;
+
+    current[i].second->release();
+    *slot = 0;
+  }
+
+  // Put back the leaves which were replaced
+  for (unsigned i = 0; i < slots.size(); i++) {
+    GridTreeBase *&slot = *slots[i].first;
+    if (slot == slots[i].second) continue;
+
+    if (slot) slot->release();
+    slot = slots[i].second->acquire();
+  }
+}
@@ -0,0 +1,51 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include "GridTreeNode.h"
+
+#include <cbang/StdTypes.h>
+
+
+namespace CAMotics {
+  /***
+   * The leaves of a tree at one time.  Leaves are shared with the tree, so
+   * a snapshot only keeps alive those the tree has since replaced.  It
+   * refers to the tree's nodes and must not outlive them or a clear().
+   */
+  class GridTreeSnapshot {
+    double time;
+    GridTreeNode::slots_t slots; ///< Sorted by slot
+
+  public:
+    GridTreeSnapshot(GridTreeNode &tree, double time);
+    ~GridTreeSnapshot();
+
+    double getTime() const {return time;}
+    /// @return the bytes of the index, not counting the shared leaves.
+    uint64_t getMemoryUsage() const;
+
+    /// Put the leaves back in @param tree, which this was taken from.
+    void restore(GridTreeNode &tree) const;
+  };
+}
@@ -0,0 +1,421 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "HalfEdgeMesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  const uint32_t none = ~(uint32_t)0;
+
+  // Guards ring walks against meshes broken in ways the build missed
+  const unsigned maxValence = 1024;
+
+  // Collapses which would leave a vertex with more neighbors than this are
+  // skipped.  Large fans cost more to check than the few faces they save.
+  const unsigned maxMergedValence = 24;
+
+  inline uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return (uint64_t)a << 32 | b;
+  }
+
+
+  struct option_sort {
+    typedef pair<Vector3D, uint32_t> option_t;
+
+    bool operator()(const option_t &a, const option_t &b) const {
+      for (unsigned i = 0; i < 3; i++)
+        if (a.first[i] != b.first[i]) return a.first[i] < b.first[i];
+      return a.second < b.second;
+    }
+  };
+}
+
+
+HalfEdgeMesh::Quadric::Quadric() {fill(q, q + 10, 0);}
+
+
+void HalfEdgeMesh::Quadric::addPlane(const Vector3D &n, double d) {
+  const double a = n.x(), b = n.y(), c = n.z();
+  q[0] += a * a; q[1] += a * b; q[2] += a * c; q[3] += a * d;
+  q[4] += b * b; q[5] += b * c; q[6] += b * d;
+  q[7] += c * c; q[8] += c * d;
+  q[9] += d * d;
+}
+
+
+HalfEdgeMesh::Quadric &HalfEdgeMesh::Quadric::operator+=(const Quadric &o) {
+  for (unsigned i = 0; i < 10; i++) q[i] += o.q[i];
+  return *this;
+}
+
+
+double HalfEdgeMesh::Quadric::evaluate(const Vector3D &p) const {
+  const double x = p.x(), y = p.y(), z = p.z();
+
+  return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+    q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+    q[7] * z * z + 2 * q[8] * z + q[9];
+}
+
+
+HalfEdgeMesh::HalfEdgeMesh(const vector<float> &vertices,
+                           const vector<uint32_t> &indices) :
+  maxCost(0), collapses(0), mark(0) {
+  unsigned count = vertices.size() / 3;
+
+  points.resize(count);
+  for (unsigned i = 0; i < count; i++)
+    points[i] = Vector3D(vertices[i * 3], vertices[i * 3 + 1],
+                         vertices[i * 3 + 2]);
+
+  locked.assign(count, false);
+  marks.assign(count, 0);
+  vertexEdges.assign(count, none);
+  dests.resize(indices.size());
+  twins.assign(indices.size(), none);
+  deleted.assign(indices.size() / 3, false);
+  liveFaces = deleted.size();
+
+  valences.assign(count, 0);
+  stamps.assign(count, 0);
+  targets.assign(count, none);
+
+  // Sort half-edges by their undirected edge so twins end up next to each
+  // other
+  vector<pair<uint64_t, uint32_t> > edges;
+  edges.reserve(indices.size());
+
+  for (uint32_t h = 0; h < indices.size(); h++) {
+    uint32_t f = h / 3;
+    dests[h] = indices[next(h)];
+
+    if (deleted[f]) continue;
+
+    const uint32_t *corners = &indices[f * 3];
+    if (corners[0] == corners[1] || corners[1] == corners[2] ||
+        corners[2] == corners[0]) {
+      deleted[f] = true; // Degenerate
+      liveFaces--;
+      continue;
+    }
+
+    uint32_t v = indices[h];
+    vertexEdges[v] = h;
+    valences[v]++;
+    edges.push_back(make_pair(edgeKey(min(v, dests[h]), max(v, dests[h])), h));
+  }
+
+  sort(edges.begin(), edges.end());
+
+  for (unsigned i = 0; i < edges.size();) {
+    unsigned j = i + 1;
+    while (j < edges.size() && edges[j].first == edges[i].first) j++;
+
+    uint32_t a = edges[i].second;
+    uint32_t b = edges[j - 1].second;
+
+    // Exactly two opposite half-edges make a manifold edge
+    if (j - i == 2 && origin(a) == dests[b]) {
+      twins[a] = b;
+      twins[b] = a;
+
+    } else // Boundary or non-manifold
+      for (; i < j; i++) {
+        uint32_t h = edges[i].second;
+        locked[origin(h)] = locked[dests[h]] = true;
+      }
+
+    i = j;
+  }
+
+  vector<pair<uint64_t, uint32_t> >().swap(edges);
+
+  // Vertices where separate fans of faces touch can not be collapsed
+  vector<uint32_t> outgoing;
+  for (uint32_t v = 0; v < count; v++) {
+    if (vertexEdges[v] == none) {locked[v] = true; continue;}
+    if (locked[v]) continue;
+
+    getOutgoing(v, outgoing);
+    if (outgoing.size() != valences[v]) locked[v] = true;
+  }
+}
+
+
+void HalfEdgeMesh::queueCollapses(double maxDistance) {
+  maxCost = maxDistance * maxDistance;
+
+  // Quadrics of the original face planes
+  quadrics.assign(points.size(), Quadric());
+
+  for (uint32_t f = 0; f < deleted.size(); f++) {
+    if (deleted[f]) continue;
+
+    Vector3D n = faceNormal(f);
+    double length = n.length();
+    if (!length) continue;
+    n /= length;
+
+    double d = -n.dot(points[dests[f * 3]]);
+    for (unsigned i = 0; i < 3; i++) quadrics[dests[f * 3 + i]].addPlane(n, d);
+  }
+
+  for (uint32_t v = 0; v < points.size(); v++) queueBest(v);
+}
+
+
+bool HalfEdgeMesh::collapseNext() {
+  static thread_local vector<uint32_t> outgoing;
+
+  while (!heap.empty()) {
+    Collapse c = heap.top();
+    heap.pop();
+
+    if (locked[c.from] || stamps[c.from] != c.stamp) continue;
+
+    // Costs only grow as quadrics are merged so a queued collapse may be
+    // optimistic.  If it no longer holds look for another.
+    getOutgoing(c.from, outgoing);
+
+    uint32_t best = none;
+    for (unsigned i = 0; i < outgoing.size() && best == none; i++)
+      if (dests[outgoing[i]] == c.to) best = outgoing[i];
+
+    if (best == none || getCost(best) != c.cost ||
+        !canCollapse(best, outgoing)) {
+      queueBest(c.from);
+      continue;
+    }
+
+    collapse(best);
+
+    // The vertices around the removed one gain new edges.  Those queued to
+    // collapse elsewhere are checked again when they come off the heap.
+    queueBest(c.to);
+    for (unsigned i = 0; i < outgoing.size(); i++) {
+      uint32_t w = dests[outgoing[i]];
+      if (targets[w] == c.from || targets[w] == none) queueBest(w);
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+
+bool HalfEdgeMesh::getFace(unsigned f, Vector3D v[3]) const {
+  if (deleted[f]) return false;
+
+  for (unsigned i = 0; i < 3; i++) v[i] = points[origin(f * 3 + i)];
+
+  return true;
+}
+
+
+bool HalfEdgeMesh::getFace(unsigned f, uint32_t v[3]) const {
+  if (deleted[f]) return false;
+
+  for (unsigned i = 0; i < 3; i++) v[i] = origin(f * 3 + i);
+
+  return true;
+}
+
+
+void HalfEdgeMesh::getOutgoing(uint32_t v, vector<uint32_t> &edges) const {
+  edges.clear();
+
+  uint32_t first = vertexEdges[v];
+  if (first == none) return;
+
+  // Around the vertex one way
+  uint32_t h = first;
+  do {
+    edges.push_back(h);
+    h = twins[prev(h)];
+  } while (h != none && h != first && edges.size() < maxValence);
+
+  if (h == first) return;
+
+  // Hit a boundary, go back the other way
+  for (h = twins[first]; h != none && edges.size() < maxValence;
+       h = twins[h]) {
+    h = next(h);
+    edges.push_back(h);
+  }
+}
+
+
+Vector3D HalfEdgeMesh::faceNormal(uint32_t f) const {
+  const Vector3D &a = points[dests[f * 3 + 2]];
+  const Vector3D &b = points[dests[f * 3]];
+  const Vector3D &c = points[dests[f * 3 + 1]];
+
+  return (b - a).cross(c - a);
+}
+
+
+bool HalfEdgeMesh::canCollapse(uint32_t h,
+                               const vector<uint32_t> &vEdges) const {
+  uint32_t v = origin(h);
+  uint32_t u = dests[h];
+  uint32_t t = twins[h];
+
+  if (locked[v] || t == none) return false;
+
+  // Vertices opposite the edge
+  uint32_t a = dests[next(h)];
+  uint32_t b = dests[next(t)];
+  if (a == b) return false;
+
+  // Link condition, only a and b may neighbor both ends or the collapse
+  // would pinch the surface
+  static thread_local vector<uint32_t> uEdges;
+  getOutgoing(u, uEdges);
+
+  if (++mark == 0) {
+    fill(marks.begin(), marks.end(), 0);
+    mark = 1;
+  }
+
+  for (unsigned i = 0; i < uEdges.size(); i++) marks[dests[uEdges[i]]] = mark;
+
+  for (unsigned i = 0; i < vEdges.size(); i++) {
+    uint32_t w = dests[vEdges[i]];
+    if (w != a && w != b && marks[w] == mark) return false;
+  }
+
+  // Faces which move must not flip or become degenerate
+  const Vector3D &p = points[u];
+
+  for (unsigned i = 0; i < vEdges.size(); i++) {
+    uint32_t g = vEdges[i];
+    if (g / 3 == h / 3 || g / 3 == t / 3) continue;
+
+    const Vector3D &q1 = points[dests[g]];
+    const Vector3D &q2 = points[dests[next(g)]];
+    Vector3D n = (q1 - p).cross(q2 - p);
+
+    if (n.dot(faceNormal(g / 3)) <= 0) return false;
+  }
+
+  return true;
+}
+
+
+double HalfEdgeMesh::getCost(uint32_t h) const {
+  uint32_t v = origin(h);
+  uint32_t u = dests[h];
+
+  return quadrics[v].evaluate(points[u]) + quadrics[u].evaluate(points[u]);
+}
+
+
+uint32_t HalfEdgeMesh::findBest(uint32_t v, double &cost) const {
+  static thread_local vector<uint32_t> outgoing;
+  static thread_local vector<pair<Vector3D, uint32_t> > options;
+  getOutgoing(v, outgoing);
+  options.clear();
+
+  // On flat areas most costs are zero.  Among equal costs prefer the least
+  // connected and then the closest neighbor, which keeps the triangles well
+  // shaped and the vertex rings short.
+  for (unsigned i = 0; i < outgoing.size(); i++) {
+    uint32_t h = outgoing[i];
+    uint32_t u = dests[h];
+    double cost = getCost(h);
+
+    if (cost <= maxCost && valences[u] + valences[v] <= maxMergedValence)
+      options.push_back
+        (make_pair(Vector3D(cost, valences[u],
+                            points[v].distanceSquared(points[u])), h));
+  }
+
+  // Test the cheapest first, the topology checks cost more than the quadrics
+  sort(options.begin(), options.end(), option_sort());
+
+  for (unsigned i = 0; i < options.size(); i++)
+    if (canCollapse(options[i].second, outgoing)) {
+      cost = options[i].first.x();
+      return options[i].second;
+    }
+
+  return none;
+}
+
+
+void HalfEdgeMesh::queueBest(uint32_t v) {
+  if (locked[v]) return;
+
+  double cost;
+  uint32_t best = findBest(v, cost);
+  targets[v] = best == none ? none : dests[best];
+  if (best != none) heap.push(Collapse(cost, v, dests[best], ++stamps[v]));
+}
+
+
+void HalfEdgeMesh::collapse(uint32_t h) {
+  uint32_t v = origin(h);
+  uint32_t u = dests[h];
+  uint32_t t = twins[h];
+
+  // h runs v->u->a and t runs u->v->b
+  uint32_t n1 = next(h), p1 = prev(h);
+  uint32_t nt = next(t), pt = prev(t);
+  uint32_t a = dests[n1];
+  uint32_t b = dests[nt];
+
+  // Everything pointing at v now points at u
+  vector<uint32_t> outgoing;
+  getOutgoing(v, outgoing);
+  for (unsigned i = 0; i < outgoing.size(); i++) dests[prev(outgoing[i])] = u;
+
+  // Stitch across the two removed faces
+  uint32_t tn1 = twins[n1], tp1 = twins[p1];
+  uint32_t tnt = twins[nt], tpt = twins[pt];
+
+  if (tn1 != none) twins[tn1] = tp1;
+  twins[tp1] = tn1;
+  twins[tnt] = tpt;
+  if (tpt != none) twins[tpt] = tnt;
+
+  deleted[h / 3] = deleted[t / 3] = true;
+  liveFaces -= 2;
+
+  // tp1 now runs u->a and tnt b->u
+  vertexEdges[u] = tp1;
+  vertexEdges[a] = next(tp1);
+  vertexEdges[b] = tnt;
+  vertexEdges[v] = none;
+
+  valences[u] += valences[v] - 4;
+  valences[a]--;
+  valences[b]--;
+
+  quadrics[u] += quadrics[v];
+  locked[v] = true;
+  collapses++;
+}
@@ -0,0 +1,120 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+#include <cbang/StdTypes.h>
+#include <cbang/geom/Vector.h>
+
+#include <vector>
+#include <queue>
+
+
+namespace CAMotics {
+  /***
+   * A compact half-edge mesh for simplifying an indexed triangle mesh by edge
+   * collapse.  Half-edge 3f + i runs from corner i to corner i + 1 of face f.
+   * Collapses are taken cheapest first from a heap and are bounded by the
+   * quadric error of the original face planes, so flat areas and straight
+   * creases are simplified while the shape is kept.
+   */
+  class HalfEdgeMesh {
+    /// Symmetric 4x4 matrix summing squared distances to planes
+    struct Quadric {
+      double q[10];
+
+      Quadric();
+      void addPlane(const cb::Vector3D &n, double d);
+      Quadric &operator+=(const Quadric &o);
+      double evaluate(const cb::Vector3D &p) const;
+    };
+
+
+    struct Collapse {
+      double cost;
+      uint32_t from;
+      uint32_t to;
+      uint32_t stamp;
+
+      Collapse(double cost, uint32_t from, uint32_t to, uint32_t stamp) :
+        cost(cost), from(from), to(to), stamp(stamp) {}
+
+      bool operator<(const Collapse &o) const {return o.cost < cost;}
+    };
+
+    std::vector<cb::Vector3D> points;
+    std::vector<Quadric> quadrics;
+    std::vector<bool> locked; // Boundary, non-manifold or removed vertices
+    std::vector<uint32_t> vertexEdges; // An outgoing half-edge per vertex
+    std::vector<uint32_t> valences;
+    std::vector<uint32_t> stamps; // Only the latest queued collapse is valid
+    std::vector<uint32_t> targets; // Where each vertex is queued to collapse
+
+    std::vector<uint32_t> dests; // Vertex each half-edge points to
+    std::vector<uint32_t> twins;
+    std::vector<bool> deleted; // Per face
+    unsigned liveFaces;
+
+    std::priority_queue<Collapse> heap;
+    double maxCost;
+    uint64_t collapses;
+
+    // Neighbor marks for the link condition test
+    mutable std::vector<uint32_t> marks;
+    mutable uint32_t mark;
+
+  public:
+    /// Build from unique @param vertices, three floats each, and @param
+    /// indices, three per triangle.
+    HalfEdgeMesh(const std::vector<float> &vertices,
+                 const std::vector<uint32_t> &indices);
+
+    unsigned getFaceCount() const {return deleted.size();}
+    /// @return the number of faces not removed.
+    unsigned getLiveFaceCount() const {return liveFaces;}
+    uint64_t getCollapses() const {return collapses;}
+    unsigned getQueued() const {return heap.size();}
+
+    /// Queue every collapse which moves the surface less than
+    /// @param maxDistance.
+    void queueCollapses(double maxDistance);
+    /// @return false when there are no more collapses to try.
+    bool collapseNext();
+
+    /// @return false if face @param f was removed.
+    bool getFace(unsigned f, cb::Vector3D v[3]) const;
+    /// @return false if face @param f was removed.
+    bool getFace(unsigned f, uint32_t v[3]) const;
+
+  protected:
+    static uint32_t next(uint32_t h) {return h % 3 == 2 ? h - 2 : h + 1;}
+    static uint32_t prev(uint32_t h) {return h % 3 ? h - 1 : h + 2;}
+    uint32_t origin(uint32_t h) const {return dests[prev(h)];}
+
+    void getOutgoing(uint32_t v, std::vector<uint32_t> &edges) const;
+    cb::Vector3D faceNormal(uint32_t f) const;
+
+    /// @param vEdges are the outgoing edges of the origin of @param h.
+    bool canCollapse(uint32_t h, const std::vector<uint32_t> &vEdges) const;
+    double getCost(uint32_t h) const;
+    uint32_t findBest(uint32_t v, double &cost) const;
+    void queueBest(uint32_t v);
+    void collapse(uint32_t h);
+  };
+}
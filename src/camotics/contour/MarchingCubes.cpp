@@ -23,6 +23,7 @@
 #include "CubeSlice.h"
 #include "GridTreeLeaf.h"
 
+using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
@@ -32,28 +33,48 @@ namespace {
 }
 
 
-void MarchingCubes::doCell(GridTreeRef &tree, const CubeSlice &slice,
-                           unsigned x, unsigned y) {
-  uint8_t index = slice.getEdges(x, y, edges);
-  cb::Vector3U offset(x, y, slice.getZ());
+bool MarchingCubes::hasTriangles(uint8_t index) {
+  return 0 <= triangleConnectionTable[index][0];
+}
 
-  SmartPointer<GridTreeLeaf> leaf = new GridTreeLeaf;
 
+void MarchingCubes::addTriangles(uint8_t index, const Edge *const edges[12],
+                                 vector<Triangle> &triangles) {
   // Draw the triangles that were found.  There can be up to five per cube.
   Triangle t;
   for (int j = 0; j < 5; j++) {
     if (triangleConnectionTable[index][3 * j] < 0) break;
 
     for (int i = 0; i < 3; i++)
-      t[i] = edges[triangleConnectionTable[index][3 * j + i]].vertex;
+      t[i] = edges[triangleConnectionTable[index][3 * j + i]]->vertex;
 
     t.updateNormal();
 
-    leaf->add(t);
+    triangles.push_back(t);
+  }
+}
+
+
+void MarchingCubes::doCell(GridTreeRef &tree, const CubeSlice &slice,
+                           unsigned x, unsigned y) {
+  uint8_t index = slice.getIndex(x, y);
+  cb::Vector3U offset(x, y, slice.getZ());
+
+  // Don't allocate leaves for cells without triangles, just clear old ones
+  if (!hasTriangles(index)) {
+    tree.insertLeaf(0, offset);
+    return;
   }
 
-  tree.insertLeaf(leaf.get(), offset);
-  leaf.adopt();
+  // Only look up the edges the triangles use
+  const Edge *edges[12];
+  for (const int *e = triangleConnectionTable[index]; 0 <= *e; e++)
+    edges[*e] = &slice.getEdge(x, y, *e);
+
+  triangles.clear();
+  addTriangles(index, edges, triangles);
+
+  tree.insertLeaf(GridTreeLeaf::create(triangles), offset);
 }
 
 
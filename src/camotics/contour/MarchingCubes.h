@@ -22,13 +22,23 @@
 
 
 #include "SliceContourGenerator.h"
+#include "Triangle.h"
+
+#include <vector>
 
 
 namespace CAMotics {
   class MarchingCubes : public SliceContourGenerator {
-    Edge edges[12];
+    std::vector<Triangle> triangles;
 
   public:
+    /// True if cubes with corner flags @param index contain any triangles.
+    static bool hasTriangles(uint8_t index);
+    /// Add the triangles of a cube with corner flags @param index.  Only
+    /// the @param edges the surface crosses are used.
+    static void addTriangles(uint8_t index, const Edge *const edges[12],
+                             std::vector<Triangle> &triangles);
+
     // From SliceContourGenerator
     void doCell(GridTreeRef &tree, const CubeSlice &slice, unsigned x,
                 unsigned y);
@@ -0,0 +1,40 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+#include <cbang/StdTypes.h>
+
+
+namespace CAMotics {
+  /***
+   * Where surface reduction stops.  By default every collapse which moves
+   * the surface less than a small fraction of the average edge length is
+   * made.  Collapses are always taken cheapest first.
+   */
+  struct ReduceTarget {
+    uint64_t triangles; ///< Stop once no more than this many remain
+    double error;       ///< Largest surface change, in model units
+
+    ReduceTarget(uint64_t triangles = 0, double error = 0) :
+      triangles(triangles), error(error) {}
+  };
+}
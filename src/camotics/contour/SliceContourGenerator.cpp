@@ -20,7 +20,11 @@
 
 #include "SliceContourGenerator.h"
 #include "TriangleSurface.h"
+#include "FieldStats.h"
 
+#include <algorithm>
+
+using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
@@ -40,21 +44,60 @@ void SliceContourGenerator::run(FieldFunction &func, GridTreeRef &grid) {
     p.z() = grid.getOffset().z() + resolution * z;
 
     if (z) slice.shift();
-    slice.compute(func);
+    slice.compute(func, this);
+    if (isInterrupted()) break;
     doSlice(func, slice, z);
 
-    for (unsigned y = 0; y < steps.y(); y++) {
-      p.y() = grid.getOffset().y() + resolution * y;
+    // Work in square bricks of cells so that empty or solid space, which
+    // is most of a large workpiece, is skipped without visiting each cell
+    const unsigned brick = VertexSlice::BRICK_SIZE;
+
+    for (unsigned by = 0; !isInterrupted() && by < steps.y(); by += brick) {
+      for (unsigned bx = 0; bx < steps.x(); bx += brick) {
+        unsigned width = min(brick, steps.x() - bx);
+        unsigned height = min(brick, steps.y() - by);
+
+        // Outside of the changed region
+        cb::Vector3D bMin = grid.getOffset() +
+          cb::Vector3D(bx, by, z) * resolution;
+        cb::Vector3D bMax = bMin +
+          cb::Vector3D(width - 1, height - 1, 0) * resolution;
+
+        bool culled = slice.isCulled(bx, by) ||
+          func.cull(cb::Rectangle3D(bMin, bMax).grow(resolution * 1.1));
+
+        FieldStats &stats = FieldStats::local();
+        stats.blockCullTests++;
+        if (culled) stats.blocksCulled++;
+
+        // No surface crosses the brick
+        bool uniform = !culled && slice.isUniform(bx, by, width, height);
 
-      for (unsigned x = 0; x < steps.x(); x++) {
-        p.x() = grid.getOffset().x() + resolution * x;
+        if (!culled)
+          for (unsigned y = by; y < by + height; y++) {
+            p.y() = grid.getOffset().y() + resolution * y;
 
-        if (!func.cull(p, resolution * 1.1)) doCell(grid, slice, x, y);
+            for (unsigned x = bx; x < bx + width; x++) {
+              p.x() = grid.getOffset().x() + resolution * x;
 
-        // Progress
-        if ((++completedCells & 7) == 0)
-          updateProgress((double)completedCells / totalCells);
+              if (func.cull(p, resolution * 1.1)) continue;
+
+              if (uniform) doEmptyCell(grid, slice, x, y);
+              else doCell(grid, slice, x, y);
+            }
+          }
       }
     }
+
+    // Progress
+    completedCells += steps.x() * steps.y();
+    setProgress((double)completedCells / totalCells);
   }
 }
+
+
+void SliceContourGenerator::doEmptyCell(GridTreeRef &tree,
+                                        const CubeSlice &slice, unsigned x,
+                                        unsigned y) {
+  tree.insertLeaf(0, cb::Vector3U(x, y, slice.getZ())); // Clear old leaf
+}
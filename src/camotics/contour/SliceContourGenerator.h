@@ -33,6 +33,9 @@ namespace CAMotics {
                          unsigned z) {}
     virtual void doCell(GridTreeRef &tree, const CubeSlice &slice, unsigned x,
                         unsigned y) = 0;
+    /// Called instead of doCell() for cells with no surface crossing
+    virtual void doEmptyCell(GridTreeRef &tree, const CubeSlice &slice,
+                             unsigned x, unsigned y);
 
     // From ContourGenerator
     void run(FieldFunction &func, GridTreeRef &tree);
@@ -19,6 +19,11 @@
 \******************************************************************************/
 
 #include "Surface.h"
+#include "TriangleSurface.h"
+#include "CompositeSurface.h"
+#include "GLTFWriter.h"
+
+#include <cbang/Exception.h>
 
 #include <stl/Writer.h>
 
@@ -28,10 +33,26 @@ using namespace CAMotics;
 
 
 void Surface::writeSTL(const OutputSink &sink, bool binary, const string &name,
-                       const string &hash) const {
+                       const string &hash, Task *task) const {
   STL::Writer writer(sink, binary);
 
   writer.writeHeader(name, getCount(), hash);
-  write(writer);
+  write(writer, task);
   writer.writeFooter(name, hash);
 }
+
+
+void Surface::writeGLTF(const OutputSink &sink, const string &name,
+                        unsigned lods) const {
+  const TriangleSurface *triangles =
+    dynamic_cast<const TriangleSurface *>(this);
+  if (triangles) return GLTFWriter(sink).write(*triangles, name, lods);
+
+  const CompositeSurface *composite =
+    dynamic_cast<const CompositeSurface *>(this);
+  if (!composite) THROW("Cannot write this surface as glTF");
+
+  // Join the parts so they share one set of buffers
+  vector<SmartPointer<Surface> > parts(composite->begin(), composite->end());
+  TriangleSurface(parts).writeGLTF(sink, name, lods);
+}
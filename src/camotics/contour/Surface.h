@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include "ReduceTarget.h"
+
 #include <cbang/geom/Rectangle.h>
 #include <cbang/io/OutputSink.h>
 
@@ -35,12 +37,29 @@ namespace CAMotics {
 
     virtual cb::SmartPointer<Surface> copy() const = 0;
     virtual uint64_t getCount() const = 0;
+    /// @return the bytes held in main memory, not counting GL buffers.
+    virtual uint64_t getMemoryUsage() const = 0;
     virtual cb::Rectangle3D getBounds() const = 0;
+    /// Prepare for drawing in the current GL context.  Called by draw() if
+    /// it was not done before.
+    virtual void finalize(bool withVBOs) = 0;
+    /// @return true if finalize() takes over the buffers of a surface which
+    /// may still be drawn, so it must run where that one is drawn.
+    virtual bool sharesBuffers() const = 0;
     virtual void draw(bool withVBOs) = 0;
     virtual void write(STL::Sink &sink, Task *task = 0) const = 0;
-    virtual void reduce(Task &task) = 0;
+    /// The surface is only read, so it can still be drawn meanwhile.
+    /// Reduction stops early once @param target is met.
+    /// @return a reduced copy or null if @param task was interrupted.
+    virtual cb::SmartPointer<Surface>
+    reduce(Task &task, unsigned threads = 1,
+           const ReduceTarget &target = ReduceTarget()) const = 0;
 
     void writeSTL(const cb::OutputSink &sink, bool binary,
-                  const std::string &name, const std::string &hash) const;
+                  const std::string &name, const std::string &hash,
+                  Task *task = 0) const;
+    /// Write binary glTF with @param lods coarser levels of detail.
+    void writeGLTF(const cb::OutputSink &sink, const std::string &name,
+                   unsigned lods = 0) const;
   };
 }
@@ -19,123 +19,140 @@
 \******************************************************************************/
 
 #include "TriangleMesh.h"
+#include "HalfEdgeMesh.h"
 
 #include <camotics/Task.h>
 
+#include <cbang/SmartPointer.h>
 #include <cbang/log/Logger.h>
 #include <cbang/time/Timer.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/os/Thread.h>
+#include <cbang/util/SmartLock.h>
+#include <cbang/util/DefaultCatch.h>
 
 #include <algorithm>
-#include <map>
+#include <cstring>
+#include <cmath>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
-TriangleMesh::TriangleMesh(const TriangleMesh &o) :
-  vertices(o.vertices), normals(o.normals) {}
-
-
-void TriangleMesh::Vertex::set(const cb::Vector3D &v) {
-  for (unsigned i = 0; i < 3; i++) (*this)[i] = v[i];
-}
+namespace {
+  // Faces meeting at a sharper angle than this do not share vertices
+  const float minCreaseDot = 0.7; // About 45 degrees
 
+  const uint32_t noVertex = ~(uint32_t)0;
 
-cb::Vector3D TriangleMesh::Triangle::computeNormal() const {
-  if (!(vertices[0] && vertices[1] && vertices[2]))
-    THROW("Triangle has null vertex");
+  // Largest surface change allowed by reduce(), relative to the edge length
+  const double maxReduceError = 0.001;
 
-  cb::Vector3D u = *vertices[0] - *vertices[1];
-  cb::Vector3D v = *vertices[1] - *vertices[2];
 
-  return u.cross(v).normalize();
+  /// @return true once @param mesh has no more than @param triangles faces.
+  bool reachedTarget(const HalfEdgeMesh &mesh, uint64_t triangles) {
+    return triangles && mesh.getLiveFaceCount() <= triangles;
+  }
 }
 
 
-void TriangleMesh::Triangle::updateNormal() {normal = computeNormal();}
-
+TriangleMesh::WeldKey::WeldKey(const Vector3F &v) {
+  for (unsigned i = 0; i < 3; i++) memcpy(&bits[i], &v[i], sizeof(float));
+}
 
-bool TriangleMesh::Triangle::has(Vertex &v) const {
-  for (unsigned i = 0; i < 3; i++)
-    if (vertices[i] == &v) return true;
 
-  return false;
+bool TriangleMesh::WeldKey::operator==(const WeldKey &o) const {
+  return !memcmp(bits, o.bits, sizeof(bits));
 }
 
 
-void TriangleMesh::Triangle::replace(Vertex &a, Vertex &b) {
-  for (unsigned i = 0; i < 3; i++)
-    if (vertices[i] == &a) {
-      vertices[i] = &b;
-      return;
-    }
-
-  THROWS("Vertex " << a << " not found in triangle");
+size_t TriangleMesh::WeldHash::operator()(const WeldKey &key) const {
+  size_t hash = 0;
+  for (unsigned i = 0; i < 3; i++) hash = (hash ^ key.bits[i]) * 0x9e3779b1;
+  return hash;
 }
 
 
-bool TriangleMesh::Triangle::isFlipped() const {
-  return computeNormal().dot(normal) < 0;
+TriangleMesh::TriangleMesh(const TriangleMesh &o) :
+  lastUpdate(0), weldStart(0), vertices(o.vertices), normals(o.normals),
+  indices(o.indices) {
+  // Normals of vertices still being welded in the original are sums
+  normalize(o.weldStart, o.weldStart + o.weldNext.size());
 }
 
 
-void TriangleMesh::Triangle::unflip() {
-  if (isFlipped()) swap(vertices[0], vertices[1]);
+uint64_t TriangleMesh::getMemoryUsage() const {
+  // Hash nodes hold a key, a value and a pointer, buckets one pointer
+  uint64_t weldBytes =
+    welds.size() * (sizeof(welds_t::value_type) + sizeof(void *)) +
+    welds.bucket_count() * sizeof(void *) +
+    weldNext.capacity() * sizeof(uint32_t) +
+    weldNormals.capacity() * sizeof(float);
+
+  return (vertices.capacity() + normals.capacity()) * sizeof(float) +
+    indices.capacity() * sizeof(uint32_t) + weldBytes;
 }
 
 
-bool TriangleMesh::Triangle::wouldFlip(Vertex &a, Vertex &b) const {
-  Triangle t;
-  Vertex mid((a + b) / 2.0);
+uint32_t TriangleMesh::addVertex(const Vector3F &v, const Vector3F &normal) {
+  uint32_t index = vertices.size() / 3;
+  if (weldNext.empty()) weldStart = index;
 
-  for (unsigned i = 0; i < 3; i++)
-    t.vertices[i] =
-      (*vertices[i] == a || *vertices[i] == b) ? &mid : vertices[i];
+  pair<welds_t::iterator, bool> result =
+    welds.insert(welds_t::value_type(WeldKey(v), index));
 
-  t.updateNormal();
+  if (!result.second) {
+    uint32_t first = result.first->second;
 
-  return normal.dot(t.normal) < 0;
-}
+    for (uint32_t i = first; i != noVertex; i = weldNext[i - weldStart]) {
+      const float *n = &weldNormals[(i - weldStart) * 3];
 
+      if (minCreaseDot <= Vector3F(n[0], n[1], n[2]).dot(normal)) {
+        for (unsigned j = 0; j < 3; j++) normals[i * 3 + j] += normal[j];
+        return i;
+      }
+    }
 
-void TriangleMesh::Vertex::findNeighbors(VertexSet &neighbors) const {
-  for (unsigned i = 0; i < triangles.size(); i++) {
-    Triangle &t = *triangles[i];
+    // Split at the crease
+    weldNext.push_back(weldNext[first - weldStart]);
+    weldNext[first - weldStart] = index;
 
-    if (t.deleted) continue;
+  } else weldNext.push_back(noVertex);
 
-    for (unsigned j = 0; j < 3; j++)
-      if (t.vertices[j] != this) neighbors.insert(t.vertices[j]);
+  for (unsigned i = 0; i < 3; i++) {
+    vertices.push_back(v[i]);
+    normals.push_back(normal[i]);
+    weldNormals.push_back(normal[i]);
   }
+
+  return index;
 }
 
 
-bool TriangleMesh::Vertex::coplaner(const cb::Vector3D &normal,
-                                    double tolerance) const {
-  for (unsigned i = 0; i < triangles.size() - 1; i++) {
-    if (triangles[i]->deleted) continue;
+void TriangleMesh::addTriangle(const Vector3F vertices[3],
+                               const Vector3F &normal) {
+  for (unsigned i = 0; i < 3; i++)
+    indices.push_back(addVertex(vertices[i], normal));
+}
 
-    const cb::Vector3D &na = triangles[i]->normal;
-    const cb::Vector3D &nb = triangles[i + 1]->normal;
 
-    double cosAngle = na.dot(nb);
-    if (cosAngle < 1 - tolerance) {
-      cosAngle = na.cross(nb).normalize().dot(normal);
-      if (-1 + tolerance < cosAngle && cosAngle < 1 - tolerance) return false;
-    }
-  }
+void TriangleMesh::clearWelds() {
+  normalize(weldStart, weldStart + weldNext.size());
 
-  return true;
+  welds_t().swap(welds);
+  vector<uint32_t>().swap(weldNext);
+  vector<float>().swap(weldNormals);
+  weldStart = vertices.size() / 3;
 }
 
 
-bool TriangleMesh::Vertex::wouldFlip(Vertex &o) {
-  for (unsigned i = 0; i < triangles.size(); i++)
-    if (!triangles[i]->deleted && triangles[i]->wouldFlip(*this, o))
-      return true;
-
-  return false;
+void TriangleMesh::normalize(unsigned first, unsigned last) {
+  for (unsigned i = first; i < last; i++) {
+    float *n = &normals[i * 3];
+    float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length) for (unsigned j = 0; j < 3; j++) n[j] /= length;
+  }
 }
 
 
@@ -154,7 +171,7 @@ namespace {
 }
 
 
-void TriangleMesh::weld(float threshold) {
+void TriangleMesh::weld(vector<float> &vertices, float threshold) {
   if (vertices.empty()) return;
 
   unsigned count = vertices.size() / 3;
@@ -175,188 +192,271 @@ void TriangleMesh::weld(float threshold) {
 }
 
 
-void TriangleMesh::reduce(Task &task) {
-  unsigned count = getCount();
-
-  // Build triangles and find unique vertices
-  vector<SmartPointer<Vertex> > vertices;
-  vector<Triangle> triangles(count);
+bool TriangleMesh::mergePositions(const vector<float> &in, vector<float> &out,
+                                  vector<uint32_t> &map, Task *task) {
+  unsigned count = in.size() / 3;
+  welds_t positions;
 
-  typedef map<cb::Vector3D, unsigned> unique_vertices_t;
-  unique_vertices_t uniqueVertices;
-  cb::Vector3D v;
-  unsigned index = 0;
+  out.clear();
+  map.resize(count);
 
   for (unsigned i = 0; i < count; i++) {
-    if (!update(task, 0, 4, i, count)) return;
+    if (task && !update(*task, 0, 3, i, count)) return false;
 
-    Triangle &t = triangles[i];
+    const float *p = &in[i * 3];
+    Vector3F v(p[0], p[1], p[2]);
 
-    for (unsigned j = 0; j < 3; j++) {
-      for (unsigned k = 0; k < 3; k++) v[k] = this->vertices[index++];
+    uint32_t pos = positions.insert
+      (welds_t::value_type(WeldKey(v), out.size() / 3)).first->second;
+
+    if (pos == out.size() / 3) out.insert(out.end(), p, p + 3);
+    map[i] = pos;
+  }
 
-      unsigned pos = uniqueVertices.insert
-        (unique_vertices_t::value_type(v, vertices.size())).first->second;
+  return true;
+}
 
-      if (pos == vertices.size()) vertices.push_back(new Vertex(v));
 
-      t.vertices[j] = vertices[pos].get();
-      vertices[pos]->triangles.push_back(&t);
+namespace {
+  double averageEdgeLength(const vector<float> &points,
+                           const vector<uint32_t> &faces) {
+    double length = 0;
+
+    for (unsigned i = 0; i < faces.size(); i++) {
+      const float *a = &points[faces[i] * 3];
+      const float *b = &points[faces[i % 3 == 2 ? i - 2 : i + 1] * 3];
+      length += Vector3D(a[0] - b[0], a[1] - b[1], a[2] - b[2]).length();
     }
 
-    t.updateNormal();
+    return faces.empty() ? 0 : length / faces.size();
   }
 
-  // Collapse edges
-  for (unsigned i = 0; i < vertices.size(); i++) {
-    if (!update(task, 1, 4, i, vertices.size())) return;
 
-    Vertex &v = *vertices[i];
+  class TileReducer : public Mutex {
+    const vector<float> &points;
+    const vector<uint32_t> &faces;
+    const vector<unsigned> &tiles;
+    const double maxDistance;
+    const uint64_t triangles;
 
-    // Find neighbors
-    VertexSet neighbors;
-    v.findNeighbors(neighbors);
+    vector<vector<uint32_t> > results;
+    unsigned nextTile;
+    uint64_t collapses;
 
-    // Choose vertex to merge with
-    unsigned minNeighbors = numeric_limits<unsigned>::max();
-    Vertex *merge = 0;
+  public:
+    TileReducer(const vector<float> &points, const vector<uint32_t> &faces,
+                const vector<unsigned> &tiles, double maxDistance,
+                uint64_t triangles) :
+      points(points), faces(faces), tiles(tiles), maxDistance(maxDistance),
+      triangles(triangles), results(tiles.size() - 1), nextTile(0),
+      collapses(0) {}
 
-    VertexSet::iterator it;
-    for (it = neighbors.begin(); it != neighbors.end(); it++) {
-      Vertex &neighbor = **it;
+    unsigned getTileCount() const {return results.size();}
+    uint64_t getCollapses() const {return collapses;}
 
-      // Check if adjacent triangles are coplaner
-      cb::Vector3D n = (v - neighbor).normalize();
-      if (!v.coplaner(n)) continue;
-      if (!neighbor.coplaner(n)) continue;
 
-      // Make sure the neighbor does not have more then two neighbors in common
-      VertexSet neighborNeighbors;
-      neighbor.findNeighbors(neighborNeighbors);
-      if (moreThan2InCommon(neighbors, neighborNeighbors)) continue;
+    bool claim(unsigned &tile) {
+      SmartLock lock(this);
+      if (results.size() <= nextTile) return false;
+      tile = nextTile++;
+      return true;
+    }
 
-      // Check for flips
-      if (v.wouldFlip(neighbor) || neighbor.wouldFlip(v)) continue;
 
-      // Choose neighbor with the least number of neighbors
-      unsigned numNeighbors = neighborNeighbors.size();
-      if (numNeighbors < minNeighbors) {
-        merge = &neighbor;
-        minNeighbors = numNeighbors;
+    /// Append the reduced faces of every tile to @param out.
+    void getFaces(vector<uint32_t> &out) {
+      for (unsigned i = 0; i < results.size(); i++) {
+        out.insert(out.end(), results[i].begin(), results[i].end());
+        vector<uint32_t>().swap(results[i]); // Free memory as we go
       }
     }
 
-    if (!merge) continue;
 
-    // Delete this vertex
-    v.deleted = true;
+    /// @param localIndex maps points to the tile's vertices and must be
+    /// all noVertex or empty.
+    void reduce(unsigned tile, vector<uint32_t> &localIndex,
+                const Task &task) {
+      localIndex.resize(points.size() / 3, noVertex);
 
-    // Update triangles
-    merge->set((v + *merge) / 2.0);
+      vector<float> tilePoints;
+      vector<uint32_t> tileFaces;
+      vector<uint32_t> globalIndex;
 
-    for (unsigned j = 0; j < v.triangles.size(); j++) {
-      Triangle &t = *v.triangles[j];
-      if (t.deleted) continue;
+      for (unsigned i = tiles[tile] * 3; i < tiles[tile + 1] * 3; i++) {
+        uint32_t v = faces[i];
 
-      // Delete triangle
-      for (unsigned k = 0; k < 3; k++)
-        if (t.vertices[k] == merge) t.deleted = true;
+        if (localIndex[v] == noVertex) {
+          localIndex[v] = globalIndex.size();
+          globalIndex.push_back(v);
+          tilePoints.insert(tilePoints.end(), &points[v * 3],
+                            &points[v * 3] + 3);
+        }
 
-      if (t.deleted) continue;
+        tileFaces.push_back(localIndex[v]);
+      }
 
-      // Merge triangle
-      for (unsigned k = 0; k < 3; k++)
-        if (t.vertices[k] == &v) t.vertices[k] = merge;
+      for (unsigned i = 0; i < globalIndex.size(); i++)
+        localIndex[globalIndex[i]] = noVertex;
 
-      // Add triangle
-      bool added = false;
-      for (unsigned k = 0; k < merge->triangles.size(); k++)
-        if (merge->triangles[k]->deleted) {
-          merge->triangles[k] = &t;
-          added = true;
-          break;
-        }
+      // Edges shared with other tiles are open here, so their vertices are
+      // locked and the tiles still fit together afterwards
+      HalfEdgeMesh mesh(tilePoints, tileFaces);
+      mesh.queueCollapses(maxDistance);
 
-      if (!added) merge->triangles.push_back(&t);
-    }
-  }
+      // The tile's share of the target, at least one so it still stops
+      uint64_t keep = 0;
+      if (triangles)
+        keep = std::max<uint64_t>
+          (1, triangles * (tiles[tile + 1] - tiles[tile]) / (faces.size() / 3));
 
-  // Flip edges
-  for (unsigned i = 0; i < vertices.size(); i++) {
-    if (!update(task, 2, 4, i, vertices.size())) return;
+      while (!reachedTarget(mesh, keep) && mesh.collapseNext())
+        if (task.shouldQuit()) return;
 
-    Vertex &v = *vertices[i];
-
-    // Find neighbors
-    VertexSet neighbors;
-    v.findNeighbors(neighbors);
+      vector<uint32_t> &result = results[tile];
+      for (unsigned f = 0; f < mesh.getFaceCount(); f++) {
+        uint32_t v[3];
+        if (mesh.getFace(f, v))
+          for (unsigned i = 0; i < 3; i++) result.push_back(globalIndex[v[i]]);
+      }
 
-    VertexSet::iterator it;
-    for (it = neighbors.begin(); it != neighbors.end(); it++) {
-      Vertex &neighbor = **it;
+      SmartLock lock(this);
+      collapses += mesh.getCollapses();
+    }
+  };
 
-      // Find neighbor's neighbors
-      VertexSet neighborNeighbors;
-      neighbor.findNeighbors(neighborNeighbors);
 
-      // Find common vertices
-      VertexSet common;
-      VertexSet::iterator it2;
-      for (it2 = neighborNeighbors.begin(); it2 != neighborNeighbors.end();
-           it2++)
-        if (*it != &v) common.insert(*it);
+  class TileReduceJob : public Thread {
+    TileReducer &reducer;
+    const Task &task;
 
-      // Ignore if more then two common vertices
-      if (common.size() != 2) continue;
+  public:
+    TileReduceJob(TileReducer &reducer, const Task &task) :
+      reducer(reducer), task(task) {}
 
-      // Evaluate flip
-      it2 = common.begin();
-      Vertex &a = **it2++;
-      Vertex &b = **it2;
+    // From Thread
+    void run() {
+      try {
+        vector<uint32_t> localIndex;
+        unsigned tile;
 
-      if (v.distanceSquared(neighbor) && a.distanceSquared(b)) continue;
+        while (!task.shouldQuit() && reducer.claim(tile))
+          reducer.reduce(tile, localIndex, task);
+      } CATCH_ERROR;
+    }
+  };
+}
 
-      // Find triangles
-      vector<Triangle *> triangles;
-      for (unsigned j = 0; j < v.triangles.size(); j++)
-        if (v.triangles[j]->has(neighbor)) triangles.push_back(v.triangles[j]);
 
-      if (triangles.size() != 2)
-        THROWS("Wrong number of matching triangles " << triangles.size());
+bool TriangleMesh::reduce(const TriangleMesh &source, Task &task,
+                          const vector<unsigned> &tiles, unsigned threads,
+                          const ReduceTarget &target) {
+  // Vertices are only unique per crease, merge those at the same position
+  vector<float> points;
+  vector<uint32_t> vertexMap;
+  if (!mergePositions(source.vertices, points, vertexMap, &task)) return false;
+
+  // Then those which are almost at the same position
+  vector<float> welded;
+  vector<uint32_t> weldMap;
+  weld(points);
+  mergePositions(points, welded, weldMap);
+  points.swap(welded);
+  vector<float>().swap(welded);
+
+  vector<uint32_t> faces(source.indices.size());
+  for (unsigned i = 0; i < faces.size(); i++)
+    faces[i] = weldMap[vertexMap[source.indices[i]]];
+
+  vector<uint32_t>().swap(vertexMap);
+  vector<uint32_t>().swap(weldMap);
+
+  // An error target bounds collapses absolutely.  A triangle target alone
+  // takes any collapse, cheapest first, until it is met.
+  double maxDistance;
+  if (target.error) maxDistance = target.error;
+  else if (target.triangles) maxDistance = numeric_limits<double>::infinity();
+  else maxDistance = maxReduceError * averageEdgeLength(points, faces);
+  uint64_t collapses = 0;
+
+  // Reduce the tiles in parallel.  The pass over the whole mesh which
+  // follows then mostly has the seams between them left to do.
+  if (1 < threads && 2 < tiles.size()) {
+    TileReducer reducer(points, faces, tiles, maxDistance, target.triangles);
+    vector<SmartPointer<TileReduceJob> > jobs;
+    unsigned count = std::min(threads, reducer.getTileCount()) - 1;
+
+    try {
+      for (unsigned i = 0; i < count; i++) {
+        jobs.push_back(new TileReduceJob(reducer, task));
+        jobs.back()->start();
+      }
 
-      // Flip edge
-      for (unsigned j = 0; j < triangles.size(); j++) {
-        if (triangles[j]->has(a)) triangles[j]->replace(v, b);
-        else if (triangles[j]->has(b)) triangles[j]->replace(neighbor, a);
+      // This thread takes tiles too and reports the progress
+      vector<uint32_t> localIndex;
+      unsigned tile;
 
-        triangles[j]->unflip();
+      while (reducer.claim(tile)) {
+        reducer.reduce(tile, localIndex, task);
+        if (!update(task, 1, 3, tile, reducer.getTileCount())) break;
       }
+
+    } catch (...) {
+      for (unsigned i = 0; i < jobs.size(); i++) jobs[i]->join();
+      throw;
     }
+
+    for (unsigned i = 0; i < jobs.size(); i++) jobs[i]->join();
+    if (task.shouldQuit()) return false;
+
+    collapses = reducer.getCollapses();
+    faces.clear();
+    reducer.getFaces(faces);
+  }
+
+  // Collapse edges
+  HalfEdgeMesh mesh(points, faces);
+  vector<uint32_t>().swap(faces);
+  mesh.queueCollapses(maxDistance);
+
+  // Progress is toward the triangle target when there is one
+  unsigned start = mesh.getLiveFaceCount();
+  unsigned total = mesh.getQueued();
+  if (target.triangles && target.triangles < start)
+    total = start - target.triangles;
+
+  while (!reachedTarget(mesh, target.triangles) && mesh.collapseNext()) {
+    unsigned current = target.triangles ?
+      start - mesh.getLiveFaceCount() : mesh.getCollapses();
+    if (!update(task, 2, 3, current, total)) return false;
   }
 
+  collapses += mesh.getCollapses();
+  LOG_INFO(1, "Reduce collapsed " << collapses << " edges"
+           << (reachedTarget(mesh, target.triangles) ? ", target met" : ""));
+
   // Reconstruct
-  this->vertices.clear();
-  this->normals.clear();
+  vertices.clear();
+  normals.clear();
+  indices.clear();
+  clearWelds();
 
-  for (unsigned i = 0; i < triangles.size(); i++) {
-    if (!update(task, 3, 4, i, triangles.size())) return;
+  for (unsigned i = 0; i < mesh.getFaceCount(); i++) {
+    Vector3D v[3];
+    if (!mesh.getFace(i, v)) continue;
 
-    Triangle &t = triangles[i];
-    if (t.deleted) continue;
-    t.updateNormal();
-    if (!t.normal.isReal()) continue; // Degenerate, discard
+    Vector3D normal = (v[1] - v[0]).cross(v[2] - v[0]).normalize();
+    if (!normal.isReal()) continue; // Degenerate, discard
 
-    for (unsigned j = 0; j < 3; j++) {
-      Vertex &v = *t.vertices[j];
+    Vector3F vf[3];
+    for (unsigned j = 0; j < 3; j++) vf[j] = Vector3F(v[j]);
 
-      for (unsigned k = 0; k < 3; k++) {
-        this->vertices.push_back(v[k]);
-        this->normals.push_back(t.normal[k]);
-      }
-    }
+    addTriangle(vf, Vector3F(normal));
   }
 
+  clearWelds();
   task.update(1);
+
+  return true;
 }
 
 
@@ -374,22 +474,3 @@ bool TriangleMesh::update(Task &task, unsigned step, unsigned steps,
 
   return true;
 }
-
-
-bool TriangleMesh::moreThan2InCommon(VertexSet &vs1, VertexSet &vs2) {
-  unsigned count = 0;
-  VertexSet::iterator it1 = vs1.begin();
-  VertexSet::iterator it2 = vs2.end();
-
-  while (it1 != vs1.end() && it2 != vs2.end()) {
-    if (**it1 == **it2) {
-      if (++count == 3) return true;
-      it1++;
-      it2++;
-
-    } else if (**it1 < **it2) it1++;
-    else it2++;
-  }
-
-  return false;
-}
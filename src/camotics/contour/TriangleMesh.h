@@ -20,10 +20,13 @@
 
 #pragma once
 
+#include "ReduceTarget.h"
+
+#include <cbang/StdTypes.h>
 #include <cbang/geom/Vector.h>
 
 #include <vector>
-#include <set>
+#include <unordered_map>
 #include <limits>
 
 
@@ -31,69 +34,82 @@ namespace CAMotics {
   class Task;
 
   class TriangleMesh {
-    struct Triangle;
-    struct Vertex;
-    struct VertexSort;
-    typedef std::set<Vertex *, VertexSort> VertexSet;
-
-
-    struct Vertex : cb::Vector3D {
-      std::vector<Triangle *> triangles;
-      bool deleted;
-
-      Vertex(const cb::Vector3D &v) : cb::Vector3D(v), deleted(false) {}
+    /// The exact bits of a vertex position
+    struct WeldKey {
+      uint32_t bits[3];
 
-      void set(const cb::Vector3D &v);
-      void findNeighbors(VertexSet &neighbors) const;
-      bool coplaner(const cb::Vector3D &normal,
-                    double tolerance = 0.0001) const;
-      bool wouldFlip(Vertex &o);
+      WeldKey(const cb::Vector3F &v);
+      bool operator==(const WeldKey &o) const;
     };
 
 
-    struct VertexSort {
-      bool operator() (const Vertex *a, const Vertex *b) {return *a < *b;}
+    struct WeldHash {
+      size_t operator()(const WeldKey &key) const;
     };
 
 
-    struct Triangle {
-      Vertex *vertices[3];
-      cb::Vector3D normal;
-      bool deleted;
-
-      Triangle() : deleted(false) {vertices[0] = vertices[1] = vertices[2] = 0;}
-
-
-      cb::Vector3D computeNormal() const;
-      void updateNormal();
-
-      bool has(Vertex &v) const;
-      void replace(Vertex &a, Vertex &b);
-
-      bool isFlipped() const;
-      void unflip();
-      bool wouldFlip(Vertex &a, Vertex &b) const;
-    };
+    typedef std::unordered_map<WeldKey, uint32_t, WeldHash> welds_t;
 
     double lastUpdate;
 
+    // Vertices added since the last clearWelds(), starting at weldStart.  The
+    // map holds the first vertex at each position, weldNext the rest and
+    // weldNormals the first face normal of each.
+    welds_t welds;
+    uint32_t weldStart;
+    std::vector<uint32_t> weldNext;
+    std::vector<float> weldNormals;
+
   protected:
+    // Unique vertices, each with the average normal of the faces which share
+    // it, and three vertex indices per triangle
     std::vector<float> vertices;
     std::vector<float> normals;
+    std::vector<uint32_t> indices;
 
   public:
-    TriangleMesh() : lastUpdate(0) {}
+    TriangleMesh() : lastUpdate(0), weldStart(0) {}
     TriangleMesh(const TriangleMesh &o);
 
-    unsigned getCount() const {return vertices.size() / 9;}
-
-    void weld(float threshold = std::numeric_limits<float>::epsilon() * 10);
-    void reduce(Task &task);
+    unsigned getCount() const {return indices.size() / 3;}
+    /// @return three floats per unique vertex.
+    const std::vector<float> &getVertices() const {return vertices;}
+    /// @return three floats per unique vertex.
+    const std::vector<float> &getNormals() const {return normals;}
+    /// @return three vertex indices per triangle.
+    const std::vector<uint32_t> &getIndices() const {return indices;}
+    /// @return the bytes held by the mesh arrays and any pending welds.
+    uint64_t getMemoryUsage() const;
 
   protected:
+    /// Replace this mesh with a reduced copy of @param source, which is only
+    /// read.  @param tiles, given by their first triangle plus the end, are
+    /// reduced on up to @param threads threads and then the seams between
+    /// them.  Each tile stops at its share of a triangle @param target.
+    /// @return false if the task was interrupted.
+    bool reduce(const TriangleMesh &source, Task &task,
+                const std::vector<unsigned> &tiles, unsigned threads = 1,
+                const ReduceTarget &target = ReduceTarget());
+
+    /// Snap together coordinates closer than @param threshold.
+    static void
+    weld(std::vector<float> &vertices,
+         float threshold = std::numeric_limits<float>::epsilon() * 10);
+    /// Copy the unique positions of @param in to @param out and where each
+    /// went to @param map.  @return false if @param task was interrupted.
+    bool mergePositions(const std::vector<float> &in, std::vector<float> &out,
+                        std::vector<uint32_t> &map, Task *task = 0);
+
+    /// Add the corner of a face, reusing a vertex added since the last call
+    /// to clearWelds() at the same position unless the faces meet at a crease.
+    uint32_t addVertex(const cb::Vector3F &v, const cb::Vector3F &normal);
+    void addTriangle(const cb::Vector3F vertices[3],
+                     const cb::Vector3F &normal);
+    /// Finish the normals of the welded vertices and forget them.
+    void clearWelds();
+    void normalize(unsigned first, unsigned last);
+
     bool update(Task &task, unsigned step, unsigned steps, unsigned current,
                 unsigned total);
-
-    static bool moreThan2InCommon(VertexSet &vs1, VertexSet &vs2);
   };
 }
@@ -27,87 +27,330 @@
 #include <cbang/log/Logger.h>
 
 #include <camotics/Task.h>
+#include <camotics/Trace.h>
 #include <camotics/view/GL.h>
+#include <camotics/view/Frustum.h>
 #include <stl/Source.h>
+#include <stl/MappedReader.h>
 #include <stl/Sink.h>
+#include <stl/BinaryTriangle.h>
+
+#include <cbang/os/Thread.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
-TriangleSurface::TriangleSurface(const GridTree &tree) :
-  finalized(false), useVBOs(true) {
+TriangleSurface::TriangleSurface(const GridTree &tree, unsigned threads) :
+  finalized(false), useVBOs(true), capacity(0), indexCapacity(0),
+  dirtyVertex(0), dirtyIndex(0) {
+  vbufs[0] = 0;
+  add(tree, threads);
+}
+
+
+TriangleSurface::TriangleSurface(const GridTree &tree,
+                                 const SmartPointer<TriangleSurface> &last,
+                                 const cb::Rectangle3D &changed,
+                                 unsigned threads) :
+  finalized(false), useVBOs(true), capacity(0), indexCapacity(0),
+  base(last), dirtyVertex(0), dirtyIndex(0) {
   vbufs[0] = 0;
-  add(tree);
+  add(tree, last.get(), changed, threads);
+
+  // Only the buffers of the last surface can be reused, not its predecessors
+  if (!base.isNull()) base->base.release();
 }
 
 
 TriangleSurface::TriangleSurface(STL::Source &source, Task *task) :
-  finalized(false), useVBOs(true) {
+  finalized(false), useVBOs(true), capacity(0), indexCapacity(0),
+  dirtyVertex(0), dirtyIndex(0) {
   vbufs[0] = 0;
   read(source, task);
 }
 
 
-TriangleSurface::TriangleSurface(vector<SmartPointer<Surface> > &surfaces) :
-  finalized(false), useVBOs(true) {
+TriangleSurface::TriangleSurface(const STL::MappedReader &reader, Task *task,
+                                 unsigned threads) :
+  finalized(false), useVBOs(true), capacity(0), indexCapacity(0),
+  dirtyVertex(0), dirtyIndex(0) {
   vbufs[0] = 0;
+  read(reader, task, threads);
+}
 
-  for (unsigned i = 0; i < surfaces.size(); i++) {
-    TriangleSurface *s = dynamic_cast<TriangleSurface *>(surfaces[i].get());
-    if (!s) THROW("Expected an TriangleSurface");
-
-    // Copy surface data
-    vertices.insert(vertices.end(), s->vertices.begin(), s->vertices.end());
-    normals.insert(normals.end(), s->normals.begin(), s->normals.end());
-    bounds.add(s->bounds);
 
-    surfaces[i] = 0; // Free memory as we go
-  }
+TriangleSurface::TriangleSurface(vector<SmartPointer<Surface> > &surfaces) :
+  finalized(false), useVBOs(true), capacity(0), indexCapacity(0),
+  dirtyVertex(0), dirtyIndex(0) {
+  vbufs[0] = 0;
+  append(surfaces);
 }
 
 
 TriangleSurface::TriangleSurface(const TriangleSurface &o) :
-  TriangleMesh(o), finalized(false), useVBOs(o.useVBOs), bounds(o.bounds) {
+  TriangleMesh(o), finalized(false), useVBOs(o.useVBOs), capacity(0),
+  indexCapacity(0), bounds(o.bounds), chunkVertices(o.chunkVertices),
+  chunkIndices(o.chunkIndices), chunkBounds(o.chunkBounds), dirtyVertex(0),
+  dirtyIndex(0) {
   vbufs[0] = 0;
 }
 
 
-TriangleSurface::TriangleSurface() : finalized(false), useVBOs(true) {
+TriangleSurface::TriangleSurface() :
+  finalized(false), useVBOs(true), capacity(0), indexCapacity(0),
+  dirtyVertex(0), dirtyIndex(0) {
   vbufs[0] = 0;
 }
 
 
 TriangleSurface::~TriangleSurface() {
-  if (vbufs[0]) getGLFuncs().glDeleteBuffers(2, vbufs);
+  if (vbufs[0]) getGLFuncs().glDeleteBuffers(3, vbufs);
+}
+
+
+namespace {
+  // Quantized draw groups are limited by their 16-bit indices.  They span
+  // at most this many times the size of their first chunk so positions
+  // keep a small fraction of a cell of precision.
+  const unsigned maxGroupVertices = 1 << 16;
+  const double maxGroupSpan = 8;
+
+  const unsigned quantizedVertexBytes = 4 * sizeof(int16_t); // Aligned
+  const unsigned quantizedNormalBytes = 4 * sizeof(int8_t);
+
+
+  double largestDimension(const cb::Rectangle3D &r) {
+    cb::Vector3D d = r.getDimensions();
+    return std::max(d.x(), std::max(d.y(), d.z()));
+  }
 }
 
 
 void TriangleSurface::finalize(bool withVBOs) {
   if (finalized) return;
 
+  clearWelds(); // No longer needed once the surface is complete
+
   GLFuncs &glFuncs = getGLFuncs();
   useVBOs = haveVBOs() && withVBOs;
 
   if (useVBOs) {
-    if (!vbufs[0]) glFuncs.glGenBuffers(2, vbufs);
+    CAMOTICS_TRACE("Upload VBOs");
+    unsigned start = 0;
+    unsigned indexStart = 0;
+
+    // Upload quantized data when the surface is made of small enough chunks
+    bool quantized = groupChunks();
+    unsigned vertexBytes = quantized ? quantizedVertexBytes : sizeof(float) * 3;
+    unsigned normalBytes = quantized ? quantizedNormalBytes : sizeof(float) * 3;
+    unsigned indexBytes = quantized ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    // Take over the buffers of the surface this one was updated from and
+    // only upload what changed, if it fits
+    if (!base.isNull() && base->finalized && base->useVBOs && base->vbufs[0] &&
+        base->groups.empty() == groups.empty() &&
+        vertices.size() <= base->capacity &&
+        indices.size() <= base->indexCapacity && !vbufs[0]) {
+      for (unsigned i = 0; i < 3; i++) vbufs[i] = base->vbufs[i];
+      capacity = base->capacity;
+      indexCapacity = base->indexCapacity;
+      start = dirtyVertex;
+      indexStart = dirtyIndex;
+
+      base->vbufs[0] = 0;
+      base->finalized = false;
+
+    } else {
+      if (!vbufs[0]) glFuncs.glGenBuffers(3, vbufs);
+
+      // Leave room to grow so later updates can be uploaded in place
+      capacity = vertices.size() + vertices.size() / 12 * 3;
+      indexCapacity = indices.size() + indices.size() / 4;
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[0]);
+      glFuncs.glBufferData(GL_ARRAY_BUFFER, capacity / 3 * vertexBytes, 0,
+                           GL_STATIC_DRAW);
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[1]);
+      glFuncs.glBufferData(GL_ARRAY_BUFFER, capacity / 3 * normalBytes, 0,
+                           GL_STATIC_DRAW);
+
+      glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbufs[2]);
+      glFuncs.glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * indexBytes,
+                           0, GL_STATIC_DRAW);
+    }
 
-    // Vertices
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[0]);
-    glFuncs.glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
-                          &vertices[0], GL_STATIC_DRAW);
+    if (quantized) {
+      // Groups before the first change are the same as in the base surface
+      unsigned first = 0;
+      while (first < groups.size() &&
+             (groups[first].firstVertex + groups[first].vertexCount) * 3 <=
+             start &&
+             groups[first].firstIndex + groups[first].indexCount <= indexStart)
+        first++;
+
+      uploadQuantized(first);
+
+    } else {
+      if (start < vertices.size()) {
+        const unsigned size = (vertices.size() - start) * sizeof(float);
+
+        // Vertices
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[0]);
+        glFuncs.glBufferSubData(GL_ARRAY_BUFFER, start * sizeof(float), size,
+                                &vertices[start]);
+
+        // Normals
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[1]);
+        glFuncs.glBufferSubData(GL_ARRAY_BUFFER, start * sizeof(float), size,
+                                &normals[start]);
+      }
+
+      if (indexStart < indices.size()) {
+        glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbufs[2]);
+        glFuncs.glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+                                indexStart * sizeof(uint32_t),
+                                (indices.size() - indexStart) *
+                                sizeof(uint32_t), &indices[indexStart]);
+      }
+    }
 
-    // Normals
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[1]);
-    glFuncs.glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float),
-                         &normals[0], GL_STATIC_DRAW);
-  }
+    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+  } else groups.clear();
+
+  base.release();
   finalized = true;
 }
 
 
+bool TriangleSurface::haveChunks() const {
+  unsigned chunks = chunkBounds.size();
+
+  return chunks && chunkVertices.size() == chunks + 1 &&
+    chunkIndices.size() == chunks + 1 &&
+    chunkVertices.back() == vertices.size() &&
+    chunkIndices.back() == indices.size();
+}
+
+
+bool TriangleSurface::groupChunks() {
+  groups.clear();
+
+  if (!haveChunks()) return false;
+  unsigned chunks = chunkBounds.size();
+
+  for (unsigned i = 0; i < chunks;) {
+    unsigned firstVertex = chunkVertices[i] / 3;
+    double maxSpan = maxGroupSpan * largestDimension(chunkBounds[i]);
+    cb::Rectangle3D span = chunkBounds[i];
+
+    // Add neighboring chunks while they fit
+    unsigned end = i + 1;
+    for (; end < chunks; end++) {
+      cb::Rectangle3D next = span;
+      next.add(chunkBounds[end]);
+
+      if (maxGroupVertices < chunkVertices[end + 1] / 3 - firstVertex ||
+          maxSpan < largestDimension(next)) break;
+
+      span = next;
+    }
+
+    DrawGroup group;
+    group.firstVertex = firstVertex;
+    group.vertexCount = chunkVertices[end] / 3 - firstVertex;
+    group.firstIndex = chunkIndices[i];
+    group.indexCount = chunkIndices[end] - group.firstIndex;
+    i = end;
+
+    if (maxGroupVertices < group.vertexCount) {
+      groups.clear();
+      return false;
+    }
+
+    if (!group.indexCount) continue;
+
+    // Fit positions to the signed 16-bit range
+    cb::Rectangle3F bounds;
+    for (unsigned j = 0; j < group.vertexCount; j++) {
+      const float *v = &vertices[(group.firstVertex + j) * 3];
+      bounds.add(Vector3F(v[0], v[1], v[2]));
+    }
+
+    group.bounds = cb::Rectangle3D(bounds.getMin(), bounds.getMax());
+
+    float extent = largestDimension(bounds);
+    group.scale = extent ? extent / 65534 : 1;
+    for (unsigned j = 0; j < 3; j++)
+      group.origin[j] = bounds.getMin()[j] + 32767 * group.scale;
+
+    groups.push_back(group);
+  }
+
+  return !groups.empty();
+}
+
+
+void TriangleSurface::uploadQuantized(unsigned firstGroup) {
+  if (groups.size() <= firstGroup) return;
+
+  const unsigned firstVertex = groups[firstGroup].firstVertex;
+  const unsigned firstIndex = groups[firstGroup].firstIndex;
+
+  vector<int16_t> qVertices((vertices.size() / 3 - firstVertex) * 4, 0);
+  vector<int8_t> qNormals((vertices.size() / 3 - firstVertex) * 4, 0);
+  vector<uint16_t> qIndices(indices.size() - firstIndex, 0);
+
+  for (unsigned g = firstGroup; g < groups.size(); g++) {
+    const DrawGroup &group = groups[g];
+
+    for (unsigned i = 0; i < group.vertexCount; i++) {
+      unsigned v = group.firstVertex + i;
+      int16_t *qv = &qVertices[(v - firstVertex) * 4];
+      int8_t *qn = &qNormals[(v - firstVertex) * 4];
+
+      for (unsigned j = 0; j < 3; j++) {
+        long q = lround((vertices[v * 3 + j] - group.origin[j]) / group.scale);
+        qv[j] = std::max(-32767L, std::min(32767L, q));
+        qn[j] = lround(std::max(-1.0f, std::min(1.0f, normals[v * 3 + j])) *
+                       127);
+      }
+    }
+
+    for (unsigned i = 0; i < group.indexCount; i++) {
+      unsigned j = group.firstIndex + i;
+      qIndices[j - firstIndex] = indices[j] - group.firstVertex;
+    }
+  }
+
+  GLFuncs &glFuncs = getGLFuncs();
+
+  glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[0]);
+  glFuncs.glBufferSubData(GL_ARRAY_BUFFER, firstVertex * quantizedVertexBytes,
+                          qVertices.size() * sizeof(int16_t), &qVertices[0]);
+
+  glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[1]);
+  glFuncs.glBufferSubData(GL_ARRAY_BUFFER, firstVertex * quantizedNormalBytes,
+                          qNormals.size() * sizeof(int8_t), &qNormals[0]);
+
+  if (!qIndices.empty()) {
+    glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbufs[2]);
+    glFuncs.glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+                            firstIndex * sizeof(uint16_t),
+                            qIndices.size() * sizeof(uint16_t), &qIndices[0]);
+  }
+}
+
+
 void TriangleSurface::add(const Vector3F vertices[3]) {
   // Compute face normal
   Vector3F normal =
@@ -123,22 +366,243 @@ void TriangleSurface::add(const Vector3F vertices[3]) {
 }
 
 
+void TriangleSurface::append(vector<SmartPointer<Surface> > &surfaces) {
+  unsigned vertexCount = vertices.size();
+  unsigned indexCount = indices.size();
+
+  for (unsigned i = 0; i < surfaces.size(); i++) {
+    TriangleSurface *s = dynamic_cast<TriangleSurface *>(surfaces[i].get());
+    if (!s) THROW("Expected an TriangleSurface");
+
+    s->clearWelds();
+    vertexCount += s->vertices.size();
+    indexCount += s->indices.size();
+  }
+
+  vertices.reserve(vertexCount);
+  normals.reserve(vertexCount);
+  indices.reserve(indexCount);
+
+  for (unsigned i = 0; i < surfaces.size(); i++) {
+    TriangleSurface *s = static_cast<TriangleSurface *>(surfaces[i].get());
+
+    // Copy surface data
+    uint32_t offset = vertices.size() / 3;
+    vertices.insert(vertices.end(), s->vertices.begin(), s->vertices.end());
+    normals.insert(normals.end(), s->normals.begin(), s->normals.end());
+
+    for (unsigned j = 0; j < s->indices.size(); j++)
+      indices.push_back(s->indices[j] + offset);
+    bounds.add(s->bounds);
+
+    surfaces[i] = 0; // Free memory as we go
+  }
+}
+
+
 void TriangleSurface::add(const Vector3F vertices[3], const Vector3F &normal) {
-  for (unsigned i = 0; i < 3; i++) {
-    bounds.add(vertices[i]);
+  for (unsigned i = 0; i < 3; i++) bounds.add(vertices[i]);
+  addTriangle(vertices, normal);
+}
 
-    for (unsigned j = 0; j < 3; j++) {
-      this->vertices.push_back(vertices[i][j]);
-      normals.push_back(normal[j]);
-    }
+
+void TriangleSurface::add(const GridTree &tree, unsigned threads) {
+  add(tree, 0, cb::Rectangle3D(), threads);
+}
+
+
+void TriangleSurface::add(const GridTreeBase &node) {
+  // Presized, the node's triangles come as a soup of corners
+  vector<float> soup;
+  vector<float> soupNormals;
+  soup.reserve(node.getCount() * 9);
+  soupNormals.reserve(node.getCount() * 9);
+  node.gather(soup, soupNormals);
+
+  // Weld the vertices so they are shared by the triangles
+  clearWelds();
+  for (unsigned i = 0; i < soup.size(); i += 3) {
+    const float *v = &soup[i], *n = &soupNormals[i];
+    indices.push_back(addVertex(Vector3F(v[0], v[1], v[2]),
+                                Vector3F(n[0], n[1], n[2])));
   }
+  clearWelds();
+}
+
+
+namespace {
+  // Cells per chunk, small enough that a cut only dirties a few
+  const unsigned maxChunkCells = 1 << 15;
+
+  // Chunks are grouped in to about this many reduce tiles per thread, each
+  // with at least minTileTriangles
+  const unsigned tilesPerThread = 4;
+  const unsigned minTileTriangles = 1 << 14;
+
+
+  class GatherJob : public Thread {
+    const vector<const GridTreeBase *> &nodes;
+    vector<SmartPointer<TriangleSurface> > &parts;
+    unsigned first;
+    unsigned step;
+
+  public:
+    GatherJob(const vector<const GridTreeBase *> &nodes,
+              vector<SmartPointer<TriangleSurface> > &parts, unsigned first,
+              unsigned step) :
+      nodes(nodes), parts(parts), first(first), step(step) {}
+
+
+    /// Gather and weld every step'th node in to its own part
+    void gather() {
+      for (unsigned i = first; i < nodes.size(); i += step) {
+        SmartPointer<TriangleSurface> part = new TriangleSurface;
+        part->add(*nodes[i]);
+        parts[i] = part;
+      }
+    }
+
+
+    // From Thread
+    void run() {
+      try {
+        gather();
+      } CATCH_ERROR;
+    }
+  };
 }
 
 
-void TriangleSurface::add(const GridTree &tree) {
-  unsigned start = getCount();
+void TriangleSurface::add(const GridTree &tree, const TriangleSurface *last,
+                          const cb::Rectangle3D &_changed, unsigned threads) {
+  unsigned start = vertices.size();
+  bool tracked = vertices.empty(); // Chunk offsets only make sense from zero
+
+  vector<GridTreeNode::Chunk> chunks;
+  tree.getChunks(chunks, maxChunkCells);
+
+  // The last surface can only be reused if it was built from the same chunks
+  if (!tracked || !last || last->chunkBounds.size() != chunks.size())
+    last = 0;
+
+  // Cells on the edge of the changed region may also have been rewritten
+  cb::Rectangle3D changed = _changed.grow(tree.getResolution());
+
+  // Find the chunks which can be copied and gather the rest
+  vector<cb::Rectangle3D> cBounds(chunks.size());
+  vector<bool> reuse(chunks.size(), false);
+  vector<const GridTreeBase *> nodes;
+  uint64_t newVertices = 0;
+  uint64_t newIndices = 0;
+
+  for (unsigned i = 0; i < chunks.size(); i++) {
+    const GridTreeNode::Chunk &chunk = chunks[i];
+    double res = tree.getResolution();
+    cBounds[i] = cb::Rectangle3D(
+      tree.getOffset() + (cb::Vector3D)chunk.min * res,
+      tree.getOffset() + (cb::Vector3D)chunk.max * res);
+
+    if (last && cBounds[i] == last->chunkBounds[i] &&
+        !cBounds[i].intersects(changed)) {
+      reuse[i] = true;
+      newVertices += last->chunkVertices[i + 1] - last->chunkVertices[i];
+      newIndices += last->chunkIndices[i + 1] - last->chunkIndices[i];
+
+    } else if (chunk.node) nodes.push_back(chunk.node);
+  }
+
+  // Gather, in parallel if there is more than one chunk
+  vector<SmartPointer<TriangleSurface> > parts(nodes.size());
+  if (nodes.size() < threads) threads = nodes.size();
+  if (!threads) threads = 1;
+
+  vector<SmartPointer<GatherJob> > jobs;
+  for (unsigned i = 0; i < threads; i++)
+    jobs.push_back(new GatherJob(nodes, parts, i, threads));
+
+  try {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->start();
+    jobs[0]->gather();
+
+  } catch (...) {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+    throw;
+  }
+
+  for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+
+  for (unsigned i = 0; i < parts.size(); i++) {
+    if (parts[i].isNull()) THROW("Failed to gather surface chunk");
+    newVertices += parts[i]->vertices.size();
+    newIndices += parts[i]->indices.size();
+  }
+
+  // Copy the chunks in order in to the presized arrays
+  vertices.reserve(vertices.size() + newVertices);
+  normals.reserve(normals.size() + newVertices);
+  indices.reserve(indices.size() + newIndices);
+
+  chunkVertices.clear();
+  chunkIndices.clear();
+  chunkBounds.clear();
+  dirtyVertex = dirtyIndex = 0;
+  bool dirty = !last;
+  unsigned nextPart = 0;
+
+  clearWelds();
+
+  for (unsigned i = 0; i < chunks.size(); i++) {
+    if (tracked) {
+      chunkVertices.push_back(vertices.size());
+      chunkIndices.push_back(indices.size());
+      chunkBounds.push_back(cBounds[i]);
+    }
+
+    const TriangleSurface *source = 0;
+    unsigned beginVertex = 0, endVertex = 0, beginIndex = 0, endIndex = 0;
+
+    if (reuse[i]) {
+      // Unchanged, copy from the last surface
+      source = last;
+      beginVertex = last->chunkVertices[i];
+      endVertex = last->chunkVertices[i + 1];
+      beginIndex = last->chunkIndices[i];
+      endIndex = last->chunkIndices[i + 1];
+
+    } else {
+      if (!dirty) {
+        dirtyVertex = vertices.size();
+        dirtyIndex = indices.size();
+        dirty = true;
+      }
+
+      if (!chunks[i].node) continue;
+
+      source = parts[nextPart++].get();
+      endVertex = source->vertices.size();
+      endIndex = source->indices.size();
+    }
+
+    uint32_t offset = vertices.size() / 3 - beginVertex / 3; // May wrap
 
-  tree.gather(vertices, normals);
+    vertices.insert(vertices.end(), source->vertices.begin() + beginVertex,
+                    source->vertices.begin() + endVertex);
+    normals.insert(normals.end(), source->normals.begin() + beginVertex,
+                   source->normals.begin() + endVertex);
+
+    for (unsigned j = beginIndex; j < endIndex; j++)
+      indices.push_back(source->indices[j] + offset);
+  }
+
+  if (tracked) {
+    chunkVertices.push_back(vertices.size());
+    chunkIndices.push_back(indices.size());
+  }
+
+  if (!dirty) { // Nothing changed
+    dirtyVertex = vertices.size();
+    dirtyIndex = indices.size();
+  }
 
   for (unsigned i = start; i < vertices.size(); i += 3)
     bounds.add(Vector3F(vertices[i], vertices[i + 1], vertices[i + 2]));
@@ -150,6 +614,14 @@ SmartPointer<Surface> TriangleSurface::copy() const {
 }
 
 
+uint64_t TriangleSurface::getMemoryUsage() const {
+  return sizeof(TriangleSurface) + TriangleMesh::getMemoryUsage() +
+    groups.capacity() * sizeof(DrawGroup) + colors.capacity() +
+    (chunkVertices.capacity() + chunkIndices.capacity()) * sizeof(unsigned) +
+    chunkBounds.capacity() * sizeof(cb::Rectangle3D);
+}
+
+
 void TriangleSurface::draw(bool withVBOs) {
   if (!getCount()) return; // Nothing to draw
 
@@ -157,6 +629,69 @@ void TriangleSurface::draw(bool withVBOs) {
 
   GLFuncs &glFuncs = getGLFuncs();
 
+  bool colored = !colors.empty();
+  if (colored) {
+    glFuncs.glEnableClientState(GL_COLOR_ARRAY);
+    glFuncs.glEnable(GL_COLOR_MATERIAL);
+  }
+
+  if (useVBOs && !groups.empty()) {
+    // Only draw the groups which may be in view
+    Frustum frustum;
+
+    // Scaled positions also scale the normals
+    GLboolean normalize;
+    glFuncs.glGetBooleanv(GL_NORMALIZE, &normalize);
+    glFuncs.glEnable(GL_NORMALIZE);
+
+    glFuncs.glEnableClientState(GL_VERTEX_ARRAY);
+    glFuncs.glEnableClientState(GL_NORMAL_ARRAY);
+    glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbufs[2]);
+
+    for (unsigned i = 0; i < groups.size(); i++) {
+      const DrawGroup &group = groups[i];
+      if (!frustum.intersects(group.bounds)) continue;
+
+      glFuncs.glPushMatrix();
+      glFuncs.glTranslatef(group.origin[0], group.origin[1], group.origin[2]);
+      glFuncs.glScalef(group.scale, group.scale, group.scale);
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[0]);
+      glFuncs.glVertexPointer
+        (3, GL_SHORT, quantizedVertexBytes,
+         (void *)((uintptr_t)group.firstVertex * quantizedVertexBytes));
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[1]);
+      glFuncs.glNormalPointer
+        (GL_BYTE, quantizedNormalBytes,
+         (void *)((uintptr_t)group.firstVertex * quantizedNormalBytes));
+
+      if (colored) {
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0,
+                               &colors[group.firstVertex * 4]);
+      }
+
+      glFuncs.glDrawElements
+        (GL_TRIANGLES, group.indexCount, GL_UNSIGNED_SHORT,
+         (void *)((uintptr_t)group.firstIndex * sizeof(uint16_t)));
+
+      glFuncs.glPopMatrix();
+    }
+
+    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glFuncs.glDisableClientState(GL_NORMAL_ARRAY);
+    glFuncs.glDisableClientState(GL_VERTEX_ARRAY);
+    if (colored) {
+      glFuncs.glDisableClientState(GL_COLOR_ARRAY);
+      glFuncs.glDisable(GL_COLOR_MATERIAL);
+    }
+
+    if (!normalize) glFuncs.glDisable(GL_NORMALIZE);
+    return;
+  }
+
   if (useVBOs) {
     glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbufs[0]);
     glFuncs.glVertexPointer(3, GL_FLOAT, 0, 0);
@@ -171,13 +706,50 @@ void TriangleSurface::draw(bool withVBOs) {
     glFuncs.glNormalPointer(GL_FLOAT, 0, &normals[0]);
   }
 
+  if (colored) glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0, &colors[0]);
+
   glFuncs.glEnableClientState(GL_VERTEX_ARRAY);
   glFuncs.glEnableClientState(GL_NORMAL_ARRAY);
 
-  glFuncs.glDrawArrays(GL_TRIANGLES, 0, getCount() * 3);
+  if (useVBOs) glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbufs[2]);
+
+  // Runs of visible chunks, or everything if the surface has none
+  unsigned chunks = haveChunks() ? chunkBounds.size() : 0;
+  SmartPointer<Frustum> frustum = chunks ? new Frustum : 0;
+  unsigned first = 0;
+
+  for (unsigned i = 0; i <= chunks; i++) {
+    unsigned end = i < chunks ? chunkIndices[i] : indices.size();
+    bool visible = i < chunks && frustum->intersects(chunkBounds[i]);
+
+    if (!visible && first < end) {
+      if (useVBOs)
+        glFuncs.glDrawElements(GL_TRIANGLES, end - first, GL_UNSIGNED_INT,
+                               (void *)((uintptr_t)first * sizeof(uint32_t)));
+      else glFuncs.glDrawElements(GL_TRIANGLES, end - first, GL_UNSIGNED_INT,
+                                  &indices[first]);
+    }
+
+    if (!visible) first = i < chunks ? chunkIndices[i + 1] : end;
+  }
+
+  if (useVBOs) glFuncs.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
   glFuncs.glDisableClientState(GL_NORMAL_ARRAY);
   glFuncs.glDisableClientState(GL_VERTEX_ARRAY);
+  if (colored) {
+    glFuncs.glDisableClientState(GL_COLOR_ARRAY);
+    glFuncs.glDisable(GL_COLOR_MATERIAL);
+  }
+}
+
+
+void TriangleSurface::setColors(const vector<uint8_t> &colors) {
+  if (!colors.empty() && colors.size() != vertices.size() / 3 * 4)
+    THROWS("Expected " << vertices.size() / 3 * 4 << " color bytes, got "
+           << colors.size());
+
+  this->colors = colors;
 }
 
 
@@ -186,11 +758,119 @@ void TriangleSurface::clear() {
 
   vertices.clear();
   normals.clear();
+  indices.clear();
+  clearWelds();
+  chunkVertices.clear();
+  chunkIndices.clear();
+  chunkBounds.clear();
+  groups.clear();
+  colors.clear();
+  base.release();
+  dirtyVertex = dirtyIndex = 0;
 
   bounds = cb::Rectangle3D();
 }
 
 
+namespace {
+  // Facets per part when reading in parallel
+  const unsigned minReadFacets = 1 << 16;
+
+
+  bool isValidFacet(const Vector3F v[3], const Vector3F &n) {
+    bool valid = n.isReal();
+    for (unsigned j = 0; j < 3; j++)
+      if (!v[j].isReal()) valid = false;
+
+    if (!valid)
+      LOG_ERROR("Invalid facet in STL: normal=" << n << " triangle=("
+                << v[0] << ", " << v[1] << ", " << v[2] << ")");
+
+    return valid;
+  }
+
+
+  class ReadJob : public Thread {
+    const STL::MappedReader &reader;
+    vector<SmartPointer<Surface> > &parts;
+    unsigned first;
+    unsigned step;
+    Task *task;
+
+  public:
+    ReadJob(const STL::MappedReader &reader,
+            vector<SmartPointer<Surface> > &parts, unsigned first,
+            unsigned step, Task *task) :
+      reader(reader), parts(parts), first(first), step(step), task(task) {}
+
+
+    /// Read every step'th part, reporting progress if this is the first job
+    void readParts() {
+      uint64_t facets = reader.getFacetCount();
+      Vector3F v[3];
+      Vector3F n;
+
+      for (unsigned i = first; i < parts.size(); i += step) {
+        TriangleSurface &part = *parts[i].cast<TriangleSurface>();
+        uint32_t end = facets * (i + 1) / parts.size();
+
+        for (uint32_t j = facets * i / parts.size(); j < end; j++) {
+          reader.getFacet(j, v[0], v[1], v[2], n);
+          if (isValidFacet(v, n)) part.add(v, n);
+        }
+
+        if (task) {
+          if (task->shouldQuit()) break;
+          if (!first) task->update((double)i / parts.size(),
+                                   "Reading STL surface");
+        }
+      }
+    }
+
+
+    // From Thread
+    void run() {
+      try {
+        readParts();
+      } CATCH_ERROR;
+    }
+  };
+}
+
+
+void TriangleSurface::read(const STL::MappedReader &reader, Task *task,
+                           unsigned threads) {
+  clear();
+
+  // Each part welds its own vertices
+  unsigned count = reader.getFacetCount() / minReadFacets;
+  if (threads * 4 < count) count = threads * 4;
+  if (!count) count = 1;
+
+  vector<SmartPointer<Surface> > parts;
+  for (unsigned i = 0; i < count; i++) parts.push_back(new TriangleSurface);
+
+  if (count < threads || !threads) threads = count;
+  vector<SmartPointer<ReadJob> > jobs;
+  for (unsigned i = 0; i < threads; i++)
+    jobs.push_back(new ReadJob(reader, parts, i, threads, task));
+
+  try {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->start();
+    jobs[0]->readParts();
+
+  } catch (...) {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+    throw;
+  }
+
+  for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+
+  append(parts);
+  if (task) task->update(1, "Idle");
+}
+
+
 void TriangleSurface::read(STL::Source &source, Task *task) {
   clear();
 
@@ -203,17 +883,7 @@ void TriangleSurface::read(STL::Source &source, Task *task) {
        i++) {
     // Read facet
     source.readFacet(v[0], v[1], v[2], n);
-
-    // Validate
-    bool valid = n.isReal();
-    for (unsigned j = 0; j < 3; j++)
-      if (!v[j].isReal()) valid = false;
-
-    if (!valid) {
-      LOG_ERROR("Invalid facet in STL: normal=" << n << " triangle=("
-                << v[0] << ", " << v[1] << ", " << v[2] << ")");
-      continue;
-    }
+    if (!isValidFacet(v, n)) continue;
 
     add(v, n);
 
@@ -224,32 +894,269 @@ void TriangleSurface::read(STL::Source &source, Task *task) {
     }
   }
 
-  task->update(1, "Idle");
+  if (task) task->update(1, "Idle");
 }
 
 
 void TriangleSurface::write(STL::Sink &sink, Task *task) const {
+  // Facets are packed in blocks and handed to the sink together
+  const unsigned blockSize = 16384;
+  vector<STL::BinaryTriangle> block(std::min(blockSize, getCount()));
   Vector3F p[3];
 
-  for (unsigned i = 0; i < getCount() && (!task || !task->shouldQuit()); i++) {
-    unsigned offset = i * 9;
+  for (unsigned start = 0; start < getCount(); start += blockSize) {
+    if (task && task->shouldQuit()) break;
+
+    unsigned count = std::min(blockSize, getCount() - start);
+
+    for (unsigned i = 0; i < count; i++) {
+      const uint32_t *tri = &indices[(start + i) * 3];
+
+      for (unsigned j = 0; j < 3; j++)
+        for (unsigned k = 0; k < 3; k++)
+          p[j][k] = vertices[tri[j] * 3 + k];
+
+      // Vertex normals are averaged so use the face normal
+      Vector3F normal = (p[1] - p[0]).cross(p[2] - p[0]);
+      double length = normal.length();
+      if (length) normal /= length;
+
+      STL::BinaryTriangle &t = block[i];
+      t.attrib = 0;
+
+      for (unsigned k = 0; k < 3; k++) {
+        t.normal[k] = normal[k];
+        t.v1[k] = p[0][k];
+        t.v2[k] = p[1][k];
+        t.v3[k] = p[2][k];
+      }
+    }
+
+    sink.writeFacets(&block[0], count);
+
+    if (task)
+      task->update((double)(start + count) / getCount(),
+                   "Writing STL surface");
+  }
+}
+
+
+namespace {
+  // Packed integers use seven bits per byte, signed ones are zig-zag coded
+  void packU64(vector<char> &data, uint64_t x) {
+    for (; 0x80 <= x; x >>= 7) data.push_back((char)(x | 0x80));
+    data.push_back((char)x);
+  }
+
+
+  void packS64(vector<char> &data, int64_t x) {
+    packU64(data, ((uint64_t)x << 1) ^ (uint64_t)(x >> 63));
+  }
+
+
+  void packFloat(vector<char> &data, float x) {
+    char bytes[sizeof(float)];
+    memcpy(bytes, &x, sizeof(float));
+    data.insert(data.end(), bytes, bytes + sizeof(float));
+  }
+
+
+  class Unpacker {
+    const char *ptr;
+    const char *end;
+
+  public:
+    Unpacker(const char *data, uint64_t length) :
+      ptr(data), end(data + length) {}
+
+    bool atEnd() const {return ptr == end;}
+
+
+    uint64_t u64() {
+      uint64_t x = 0;
+
+      for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (ptr == end) THROW("Packed surface is truncated");
+        uint8_t byte = *ptr++;
+        x |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return x;
+      }
+
+      THROW("Packed surface is corrupt");
+    }
+
+
+    int64_t s64() {
+      uint64_t x = u64();
+      return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+    }
+
+
+    float f32() {
+      if (end - ptr < (int)sizeof(float)) THROW("Packed surface is truncated");
+      float x;
+      memcpy(&x, ptr, sizeof(float));
+      ptr += sizeof(float);
+      return x;
+    }
+
+
+    unsigned count(uint64_t max) {
+      uint64_t x = u64();
+      if (max < x) THROW("Packed surface is corrupt");
+      return x;
+    }
+  };
+}
+
+
+void TriangleSurface::pack(vector<char> &data, float precision) const {
+  unsigned vertexCount = vertices.size() / 3;
+  Vector3D origin = bounds.isReal() ? bounds.getMin() : Vector3D();
+
+  packU64(data, vertexCount);
+  packU64(data, indices.size());
+  packFloat(data, precision);
+  for (unsigned i = 0; i < 3; i++) packFloat(data, origin[i]);
+
+  // Neighboring vertices are close so their differences pack small
+  int64_t last[3] = {0, 0, 0};
+  for (unsigned i = 0; i < vertexCount; i++)
+    for (unsigned j = 0; j < 3; j++) {
+      int64_t q = llround((vertices[i * 3 + j] - origin[j]) / precision);
+      packS64(data, q - last[j]);
+      last[j] = q;
+    }
+
+  int64_t lastIndex = 0;
+  for (unsigned i = 0; i < indices.size(); i++) {
+    packS64(data, (int64_t)indices[i] - lastIndex);
+    lastIndex = indices[i];
+  }
 
-    // The vertex normals are all the same
-    Vector3F normal =
-      Vector3F(normals[offset + 0], normals[offset + 1], normals[offset + 2]);
+  // Chunks, so later reductions can still be tiled
+  packU64(data, chunkVertices.size());
+  for (unsigned i = 0; i < chunkVertices.size(); i++)
+    packU64(data, chunkVertices[i] - (i ? chunkVertices[i - 1] : 0));
 
+  packU64(data, chunkIndices.size());
+  for (unsigned i = 0; i < chunkIndices.size(); i++)
+    packU64(data, chunkIndices[i] - (i ? chunkIndices[i - 1] : 0));
+
+  packU64(data, chunkBounds.size());
+  for (unsigned i = 0; i < chunkBounds.size(); i++)
+    for (unsigned j = 0; j < 3; j++) {
+      packFloat(data, chunkBounds[i].getMin()[j]);
+      packFloat(data, chunkBounds[i].getMax()[j]);
+    }
+}
+
+
+void TriangleSurface::unpack(const char *data, uint64_t length) {
+  clear();
+
+  // Every packed value takes at least a byte
+  Unpacker in(data, length);
+  unsigned vertexCount = in.count(length / 3);
+  unsigned indexCount = in.count(length);
+  if (indexCount % 3) THROW("Packed surface is corrupt");
+
+  double precision = in.f32();
+  Vector3D origin;
+  for (unsigned i = 0; i < 3; i++) origin[i] = in.f32();
+
+  vertices.resize(vertexCount * 3);
+  int64_t last[3] = {0, 0, 0};
+
+  for (unsigned i = 0; i < vertexCount; i++) {
+    Vector3F v;
+
+    for (unsigned j = 0; j < 3; j++) {
+      last[j] += in.s64();
+      v[j] = vertices[i * 3 + j] = origin[j] + last[j] * precision;
+    }
+
+    bounds.add(v);
+  }
+
+  indices.resize(indexCount);
+  int64_t lastIndex = 0;
+
+  for (unsigned i = 0; i < indexCount; i++) {
+    lastIndex += in.s64();
+    if (lastIndex < 0 || vertexCount <= lastIndex)
+      THROW("Packed surface is corrupt");
+    indices[i] = lastIndex;
+  }
+
+  chunkVertices.resize(in.count(length));
+  for (unsigned i = 0; i < chunkVertices.size(); i++)
+    chunkVertices[i] = in.u64() + (i ? chunkVertices[i - 1] : 0);
+
+  chunkIndices.resize(in.count(length));
+  for (unsigned i = 0; i < chunkIndices.size(); i++)
+    chunkIndices[i] = in.u64() + (i ? chunkIndices[i - 1] : 0);
+
+  chunkBounds.resize(in.count(length));
+  for (unsigned i = 0; i < chunkBounds.size(); i++)
+    for (unsigned j = 0; j < 3; j++) {
+      chunkBounds[i].getMin()[j] = in.f32();
+      chunkBounds[i].getMax()[j] = in.f32();
+    }
+
+  if (!in.atEnd()) THROW("Packed surface is corrupt");
+
+  // Vertex normals are the average of their face normals
+  normals.assign(vertices.size(), 0);
+
+  for (unsigned i = 0; i < indexCount; i += 3) {
+    Vector3F p[3];
     for (unsigned j = 0; j < 3; j++)
       for (unsigned k = 0; k < 3; k++)
-        p[j][k] = vertices[offset + j * 3 + k];
+        p[j][k] = vertices[indices[i + j] * 3 + k];
 
-    sink.writeFacet(p[0], p[1], p[2], normal);
+    Vector3F normal = (p[1] - p[0]).cross(p[2] - p[0]);
+    double length = normal.length();
+    if (!length) continue;
+    normal /= length;
 
-    if (task) task->update((double)i / getCount(), "Writing STL surface");
+    for (unsigned j = 0; j < 3; j++)
+      for (unsigned k = 0; k < 3; k++)
+        normals[indices[i + j] * 3 + k] += normal[k];
   }
+
+  normalize(0, vertexCount);
 }
 
 
-void TriangleSurface::reduce(Task &task) {
-  weld();
-  TriangleMesh::reduce(task);
+SmartPointer<Surface>
+TriangleSurface::reduce(Task &task, unsigned threads,
+                        const ReduceTarget &target) const {
+  // Consecutive GridTree chunks are neighbors, group them in to tiles
+  unsigned count = TriangleMesh::getCount();
+  vector<unsigned> tiles;
+  tiles.push_back(0);
+
+  if (!chunkIndices.empty() && chunkIndices.back() == indices.size()) {
+    unsigned tileSize =
+      std::max(minTileTriangles, count / (threads * tilesPerThread + 1));
+
+    for (unsigned i = 1; i + 1 < chunkIndices.size(); i++) {
+      unsigned first = chunkIndices[i] / 3;
+      if (tiles.back() + tileSize <= first && first < count)
+        tiles.push_back(first);
+    }
+  }
+
+  tiles.push_back(count);
+
+  SmartPointer<TriangleSurface> reduced = new TriangleSurface;
+  if (!reduced->TriangleMesh::reduce(*this, task, tiles, threads, target))
+    return 0;
+
+  const vector<float> &v = reduced->vertices;
+  for (unsigned i = 0; i < v.size(); i += 3)
+    reduced->bounds.add(Vector3F(v[i], v[i + 1], v[i + 2]));
+
+  return reduced;
 }
@@ -30,40 +30,116 @@
 #include <vector>
 
 
-namespace STL {class Source;}
+namespace STL {
+  class Source;
+  class MappedReader;
+}
 
 namespace CAMotics {
   class GridTree;
+  class GridTreeBase;
 
   class TriangleSurface : public Surface, public TriangleMesh {
     bool finalized;
 
-    unsigned vbufs[2];
+    unsigned vbufs[3];
     bool useVBOs;
+    unsigned capacity;
+    unsigned indexCapacity;
+
+    /// Consecutive chunks uploaded with 16-bit positions relative to
+    /// origin, in units of scale, byte normals and 16-bit indices
+    struct DrawGroup {
+      unsigned firstVertex;
+      unsigned vertexCount;
+      unsigned firstIndex;
+      unsigned indexCount;
+      cb::Vector3F origin;
+      float scale;
+      cb::Rectangle3D bounds; ///< For culling
+    };
+
+    // Empty if the VBOs hold floats
+    std::vector<DrawGroup> groups;
 
     cb::Rectangle3D bounds;
 
+    // Optional RGBA bytes per vertex, drawn instead of the material color
+    std::vector<uint8_t> colors;
+
+    // Where each GridTree chunk's vertex floats and indices start, with one
+    // extra end offset.  Vertices are only welded within a chunk.
+    std::vector<unsigned> chunkVertices;
+    std::vector<unsigned> chunkIndices;
+    std::vector<cb::Rectangle3D> chunkBounds;
+
+    // Surface this one was updated from and the first vertex float and index
+    // which differ
+    cb::SmartPointer<TriangleSurface> base;
+    unsigned dirtyVertex;
+    unsigned dirtyIndex;
+
+    /// Move the data of @param surfaces, all TriangleSurfaces, to the end.
+    void append(std::vector<cb::SmartPointer<Surface> > &surfaces);
+
+    /// @return true if the chunk offsets cover the whole surface.
+    bool haveChunks() const;
+
+    /// Group the chunks for quantized upload.  @return false if they either
+    /// do not cover the whole surface or one is too large.
+    bool groupChunks();
+    void uploadQuantized(unsigned firstGroup);
+
   public:
-    TriangleSurface(const GridTree &tree);
+    /// Gather the chunks of @param tree on up to @param threads threads.
+    TriangleSurface(const GridTree &tree, unsigned threads = 1);
+    /// Reuse @param last for all chunks of the tree outside @param changed.
+    TriangleSurface(const GridTree &tree,
+                    const cb::SmartPointer<TriangleSurface> &last,
+                    const cb::Rectangle3D &changed, unsigned threads = 1);
     TriangleSurface(STL::Source &source, Task *task = 0);
+    TriangleSurface(const STL::MappedReader &reader, Task *task = 0,
+                    unsigned threads = 1);
     TriangleSurface(std::vector<cb::SmartPointer<Surface> > &surfaces);
     TriangleSurface(const TriangleSurface &o);
     TriangleSurface();
     virtual ~TriangleSurface();
 
-    void finalize(bool withVBOs);
     void add(const cb::Vector3F vertices[3]);
     void add(const cb::Vector3F vertices[3], const cb::Vector3F &normal);
-    void add(const GridTree &tree);
+    void add(const GridTree &tree, unsigned threads = 1);
+    void add(const GridTree &tree, const TriangleSurface *last,
+             const cb::Rectangle3D &changed, unsigned threads = 1);
+    /// Weld the triangles of @param node and add them.
+    void add(const GridTreeBase &node);
+
+    /// Append a compact copy of the mesh to @param data with positions
+    /// rounded to multiples of @param precision.  Normals are not kept,
+    /// unpack() computes them from the faces.
+    void pack(std::vector<char> &data, float precision) const;
+    /// Replace this surface with one from pack().  Throws if it is corrupt.
+    void unpack(const char *data, uint64_t length);
+
+    /// Draw with four bytes, RGBA, per vertex or clear the colors if
+    /// @param colors is empty.
+    void setColors(const std::vector<uint8_t> &colors);
 
     // From Surface
     cb::SmartPointer<Surface> copy() const;
     uint64_t getCount() const {return TriangleMesh::getCount();}
+    uint64_t getMemoryUsage() const;
     cb::Rectangle3D getBounds() const {return bounds;}
+    void finalize(bool withVBOs);
+    bool sharesBuffers() const {return !base.isNull();}
     void draw(bool withVBOs);
     void clear();
     void read(STL::Source &source, Task *task = 0);
+    /// Convert the facets of @param reader in parts on up to
+    /// @param threads threads.
+    void read(const STL::MappedReader &reader, Task *task = 0,
+              unsigned threads = 1);
     void write(STL::Sink &sink, Task *task = 0) const;
-    void reduce(Task &task);
+    cb::SmartPointer<Surface> reduce(Task &task, unsigned threads,
+                                     const ReduceTarget &target) const;
   };
 }
@@ -19,7 +19,12 @@
 \******************************************************************************/
 
 #include "VertexSlice.h"
+#include "BlockCuller.h"
+#include "FieldStats.h"
 
+#include <camotics/Task.h>
+
+#include <algorithm>
 #include <limits>
 
 using namespace std;
@@ -27,26 +32,91 @@ using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  // Depths outside the float range would interpolate to NaN
+  float clampDepth(double depth) {
+    const double max = numeric_limits<float>::max();
+    return (float)(depth < -max ? -max : (max < depth ? max : depth));
+  }
+}
+
+
 VertexSlice::VertexSlice(const GridTreeRef &grid, unsigned z) :
-  grid(grid), z(z) {}
+  grid(grid), z(z), stride(grid.getSteps().y() + 1) {}
 
 
-void VertexSlice::compute(FieldFunction &func) {
-  // Allocate space
+void VertexSlice::compute(FieldFunction &func, const BlockCuller *culler,
+                          const Task *task) {
+  // Allocate space once, one row of y per x
   const cb::Vector3U &steps = grid.getSteps();
-  resize(steps.x() + 1,
-         vector<double>(steps.y() + 1, -numeric_limits<double>::max()));
+  depths.assign((steps.x() + 1) * stride, -numeric_limits<float>::max());
 
   double resolution = grid.getResolution();
   cb::Vector3D p = cb::Vector3D(0, 0, grid.getOffset().z() + resolution * z);
 
-  for (unsigned x = 0; x <= steps.x(); x++) {
-    p.x() = grid.getOffset().x() + resolution * x;
+  // Evaluate one square brick of vertices at a time so the field function
+  // can batch points which share most of their nearby moves
+  vector<cb::Vector3D> points;
+  vector<unsigned> index;
+  vector<double> depths;
+
+  for (unsigned x0 = 0; x0 <= steps.x(); x0 += BRICK_SIZE)
+    for (unsigned y0 = 0; y0 <= steps.y(); y0 += BRICK_SIZE) {
+      if (task && task->isInterrupted()) return;
+
+      // Bricks never straddle culled blocks
+      if (culler && culler->isCulled(x0, y0)) continue;
+
+      unsigned x1 = min(x0 + BRICK_SIZE - 1, steps.x());
+      unsigned y1 = min(y0 + BRICK_SIZE - 1, steps.y());
+
+      // Skip the whole brick if it is outside the changed region
+      const cb::Vector3D &offset = grid.getOffset();
+      cb::Vector3D bMin(offset.x() + resolution * x0,
+                        offset.y() + resolution * y0, p.z());
+      cb::Vector3D bMax(offset.x() + resolution * x1,
+                        offset.y() + resolution * y1, p.z());
+      cb::Rectangle3D bounds(bMin, bMax);
+      if (func.cull(bounds.grow(2.1 * resolution))) continue;
+
+      // Fill bricks wholly inside or outside with their sign, first by the
+      // block then by the brick itself.  The region tested is grown so the
+      // surface never crosses an edge ending at a filled vertex.
+      int sign = culler ? culler->getSign(x0, y0) : 0;
+      if (!sign) sign = func.classify(bounds.grow(1.1 * resolution));
 
-    for (unsigned y = 0; y <= steps.y(); y++) {
-      p.y() = grid.getOffset().y() + resolution * y;
+      if (sign) {
+        float fill = sign * numeric_limits<float>::max();
 
-      if (!func.cull(p, 2.1 * resolution)) at(x).at(y) = func.depth(p);
+        for (unsigned x = x0; x <= x1; x++)
+          for (unsigned y = y0; y <= y1; y++)
+            this->depths[x * stride + y] = fill;
+
+        FieldStats::local().filled += (x1 - x0 + 1) * (y1 - y0 + 1);
+        continue;
+      }
+
+      points.clear();
+      index.clear();
+
+      for (unsigned x = x0; x <= x1; x++) {
+        p.x() = offset.x() + resolution * x;
+
+        for (unsigned y = y0; y <= y1; y++) {
+          p.y() = offset.y() + resolution * y;
+
+          if (!func.cull(p, 2.1 * resolution)) {
+            points.push_back(p);
+            index.push_back(x * stride + y);
+          }
+        }
+      }
+
+      if (points.empty()) continue;
+
+      func.depth(points, depths);
+
+      for (unsigned i = 0; i < index.size(); i++)
+        this->depths[index[i]] = clampDepth(depths[i]);
     }
-  }
 }
@@ -28,18 +28,38 @@
 
 
 namespace CAMotics {
-  class VertexSlice : public std::vector<std::vector<double> > {
+  class BlockCuller;
+  class Task;
+
+  class VertexSlice {
     const GridTreeRef &grid;
     unsigned z;
 
+    unsigned stride;
+    std::vector<float> depths;
+
   public:
-    VertexSlice(const GridTreeRef &grid, unsigned z);
+    /// Vertices or cells, along x and y, culled and evaluated together
+    /// before testing them one by one
+    static const unsigned BRICK_SIZE = 8;
+
+    VertexSlice(const GridTreeRef &grid, unsigned z = 0);
 
-    double depth(unsigned x, unsigned y) const {return at(x).at(y);}
+    double depth(unsigned x, unsigned y) const
+    {return depths[x * stride + y];}
+    /// Depths by x then y, @see getStride()
+    const float *getDepths() const {return &depths[0];}
+    unsigned getStride() const {return stride;}
 
-    void compute(FieldFunction &func);
+    /// Reuses the storage of the last slice computed.  Vertices in regions
+    /// @param func classifies as wholly inside or outside are not evaluated
+    /// but given the largest depth of that sign.  Stops early, between
+    /// bricks, once @param task is interrupted.
+    void compute(FieldFunction &func, const BlockCuller *culler = 0,
+                 const Task *task = 0);
 
     const GridTreeRef &getGrid() const {return grid;}
     unsigned getZ() const {return z;}
+    void setZ(unsigned z) {this->z = z;}
   };
 }
@@ -30,6 +30,12 @@ using namespace cb;
 using namespace std;
 
 
+MachineModel::~MachineModel() {
+  if (linesVBuf && QOpenGLContext::currentContext())
+    getGLFuncs().glDeleteBuffers(1, &linesVBuf);
+}
+
+
 void MachineModel::setPosition(const Vector3D &p) {
   for (parts_t::const_iterator it = parts.begin(); it != parts.end(); it++)
     it->second->setPosition(p);
@@ -81,9 +87,13 @@ void MachineModel::readModel(const InputSource &source) {
         partConfig->insert("color", getDefaultColor(name).getJSON());
 
       SmartPointer<MachinePart> part = new MachinePart(name, partConfig);
-      part->read(source, transform, reverseWinding);
+      unsigned size = lines.size();
+      part->read(source, transform, reverseWinding, lines);
 
-      if (!part->getCount()) continue;
+      if (!part->getCount()) {
+        lines.resize(size);
+        continue;
+      }
 
       parts[name] = part;
       bounds.add(part->getBounds());
@@ -112,8 +122,38 @@ void MachineModel::draw(bool withVBOs, bool wire) {
   glFuncs.glPushMatrix();
   glFuncs.glTranslatef(offset[0], offset[1], offset[2]);
 
-  for (parts_t::const_iterator it = parts.begin(); it != parts.end(); it++)
-    it->second->draw(withVBOs, wire);
+  // All the lines first, from one buffer, so lighting and the vertex array
+  // are only set once
+  if (!lines.empty()) {
+    GLboolean light;
+    glFuncs.glGetBooleanv(GL_LIGHTING, &light);
+    glFuncs.glDisable(GL_LIGHTING);
+    glFuncs.glEnableClientState(GL_VERTEX_ARRAY);
+
+    if (withVBOs && haveVBOs()) {
+      if (!linesVBuf) {
+        glFuncs.glGenBuffers(1, &linesVBuf);
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, linesVBuf);
+        glFuncs.glBufferData(GL_ARRAY_BUFFER, lines.size() * sizeof(float),
+                             &lines[0], GL_STATIC_DRAW);
+      }
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, linesVBuf);
+      glFuncs.glVertexPointer(3, GL_FLOAT, 0, 0);
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    } else glFuncs.glVertexPointer(3, GL_FLOAT, 0, &lines[0]);
+
+    for (parts_t::const_iterator it = parts.begin(); it != parts.end(); it++)
+      it->second->drawLines(wire);
+
+    glFuncs.glDisableClientState(GL_VERTEX_ARRAY);
+    if (light) glFuncs.glEnable(GL_LIGHTING);
+  }
+
+  if (!wire)
+    for (parts_t::const_iterator it = parts.begin(); it != parts.end(); it++)
+      it->second->drawSurface(withVBOs);
 
   glFuncs.glPopMatrix();
 }
@@ -44,8 +44,13 @@ namespace CAMotics {
     typedef std::map<std::string, cb::SmartPointer<MachinePart> > parts_t;
     parts_t parts;
 
+    // The line vertices of all parts, drawn from one buffer
+    std::vector<float> lines;
+    unsigned linesVBuf;
+
   public:
-    MachineModel(const cb::InputSource &source) {read(source);}
+    MachineModel(const cb::InputSource &source) : linesVBuf(0) {read(source);}
+    ~MachineModel();
 
     const std::string &getName() const {return name;}
     void setPosition(const cb::Vector3D &p);
@@ -29,7 +29,7 @@ using namespace std;
 
 MachinePart::MachinePart(const string &name,
                          SmartPointer<JSON::Value> &config) :
-  name(name), vbuf(0) {
+  name(name), firstLineVertex(0), lineVertexCount(0) {
   if (config->hasList("color")) color.read(config->getList("color"));
   if (config->hasList("init")) init.read(config->getList("init"));
   if (config->hasList("home")) home.read(config->getList("home"));
@@ -48,8 +48,9 @@ void MachinePart::setPosition(const Vector3D &position) {
 
 
 void MachinePart::read(const InputSource &source,
-                       const Matrix4x4D &transform, bool reverseWinding) {
-  vector<Vector2U> lines;
+                       const Matrix4x4D &transform, bool reverseWinding,
+                       vector<float> &lines) {
+  vector<Vector2U> lineIndices;
   vector<Vector3U> triangles;
   vector<Vector3F> vertices;
 
@@ -75,8 +76,8 @@ void MachinePart::read(const InputSource &source,
                     String::parseU32(nums[reverseWinding ? 1 : 2])));
 
       else if (line[0] == 'l' && nums.size() == 2)
-        lines.push_back(Vector2U(String::parseU32(nums[0]),
-                                 String::parseU32(nums[1])));
+        lineIndices.push_back(Vector2U(String::parseU32(nums[0]),
+                                       String::parseU32(nums[1])));
 
       else if (line[0] == 'v' && nums.size() == 3) {
         if (vertices.size() < n + 1) vertices.resize((n + 1) * 1.5);
@@ -92,10 +93,13 @@ void MachinePart::read(const InputSource &source,
   }
 
   // Assemble lines
-  for (unsigned i = 0; i < lines.size(); i++)
+  firstLineVertex = lines.size() / 3;
+  lineVertexCount = lineIndices.size() * 2;
+
+  for (unsigned i = 0; i < lineIndices.size(); i++)
     for (int j = 0; j < 2; j++)
       for (int k = 0; k < 3; k++)
-        this->lines.push_back(vertices[lines[i][j]][k]);
+        lines.push_back(vertices[lineIndices[i][j]][k]);
 
   // Assemble triangles
   for (unsigned i = 0; i < triangles.size(); i++) {
@@ -106,53 +110,32 @@ void MachinePart::read(const InputSource &source,
 }
 
 
-void MachinePart::drawLines(bool withVBOs) {
-  GLFuncs &glFuncs = getGLFuncs();
-
-  if (withVBOs && haveVBOs()) {
-    if (!vbuf) {
-      glFuncs.glGenBuffers(1, &vbuf);
-
-      // Vertices
-      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-      glFuncs.glBufferData(GL_ARRAY_BUFFER, lines.size() * sizeof(float),
-                            &lines[0], GL_STATIC_DRAW);
-    }
+void MachinePart::drawLines(bool wire) {
+  if (!lineVertexCount) return;
 
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vbuf);
-    glFuncs.glVertexPointer(3, GL_FLOAT, 0, 0);
-
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  } else glFuncs.glVertexPointer(3, GL_FLOAT, 0, &lines[0]);
+  GLFuncs &glFuncs = getGLFuncs();
 
-  glFuncs.glEnableClientState(GL_VERTEX_ARRAY);
-  GLboolean light;
-  glFuncs.glGetBooleanv(GL_LIGHTING, &light);
-  glFuncs.glDisable(GL_LIGHTING);
+  glFuncs.glPushMatrix();
+  glFuncs.glTranslatef(offset[0], offset[1], offset[2]);
+  glFuncs.glTranslatef(position[0], position[1], position[2]);
 
-  glFuncs.glDrawArrays(GL_LINES, 0, lines.size() / 3);
+  if (wire) glFuncs.glColor3ub(color[0], color[1], color[2]);
+  else glFuncs.glColor3ub(color[0] * 0.8, color[1] * 0.8, color[2] * 0.8);
 
-  if (light) glFuncs.glEnable(GL_LIGHTING);
-  glFuncs.glDisableClientState(GL_VERTEX_ARRAY);
+  glFuncs.glDrawArrays(GL_LINES, firstLineVertex, lineVertexCount);
+  glFuncs.glPopMatrix();
 }
 
 
-void MachinePart::draw(bool withVBOs, bool wire) {
+void MachinePart::drawSurface(bool withVBOs) {
   GLFuncs &glFuncs = getGLFuncs();
 
   glFuncs.glPushMatrix();
   glFuncs.glTranslatef(offset[0], offset[1], offset[2]);
   glFuncs.glTranslatef(position[0], position[1], position[2]);
 
-  if (wire) glFuncs.glColor3ub(color[0], color[1], color[2]);
-  else glFuncs.glColor3ub(color[0] * 0.8, color[1] * 0.8, color[2] * 0.8);
-  drawLines(withVBOs);
-
-  if (!wire) {
-    glFuncs.glColor3ub(color[0], color[1], color[2]);
-    TriangleSurface::draw(withVBOs);
-  }
+  glFuncs.glColor3ub(color[0], color[1], color[2]);
+  TriangleSurface::draw(withVBOs);
 
   glFuncs.glPopMatrix();
 }
@@ -44,8 +44,9 @@ namespace CAMotics {
     cb::Vector3D position;
     cb::Vector3D offset;
 
-    std::vector<float> lines;
-    unsigned vbuf;
+    // Range of this part's vertices in the model's shared line buffer
+    unsigned firstLineVertex;
+    unsigned lineVertexCount;
 
   public:
     MachinePart(const std::string &name,
@@ -58,11 +59,13 @@ namespace CAMotics {
 
     void setPosition(const cb::Vector3D &position);
 
+    /// Appends the part's line vertices to @param lines.
     void read(const cb::InputSource &source, const cb::Matrix4x4D &transform,
-              bool reverseWinding);
+              bool reverseWinding, std::vector<float> &lines);
 
-    void drawLines(bool withVBOs);
-    void draw(bool withVBOs, bool wire);
-    using TriangleSurface::draw;
+    /// The vertex array must point at the model's line buffer and lighting
+    /// must be off.
+    void drawLines(bool wire);
+    void drawSurface(bool withVBOs);
   };
 }
@@ -23,12 +23,25 @@
 
 #include <cbang/geom/Vector.h>
 
+#include <algorithm>
+#include <cmath>
+
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  template <typename T>
+  void moveItem(vector<T> &v, unsigned from, unsigned to) {
+    T x = v[from];
+    v.erase(v.begin() + from);
+    v.insert(v.begin() + to, x);
+  }
+}
+
+
 AnnealState::AnnealState(const paths_t &paths) : paths(paths) {
   index.clear();
   flip.clear();
@@ -38,6 +51,7 @@ AnnealState::AnnealState(const paths_t &paths) : paths(paths) {
     flip.push_back(false);
   }
 
+  update();
   cost = computeCost();
 }
 
@@ -46,26 +60,47 @@ AnnealState &AnnealState::operator=(const AnnealState &o) {
   index = o.index;
   flip = o.flip;
   cost = o.cost;
+  entry = o.entry;
+  exit = o.exit;
 
   return *this;
 }
 
 
+void AnnealState::update() {
+  unsigned n = index.size();
+  Ends *ends[2] = {&entry, &exit};
+
+  for (int i = 0; i < 2; i++) {
+    ends[i]->x.resize(n);
+    ends[i]->y.resize(n);
+    ends[i]->z.resize(n);
+  }
+
+  for (unsigned i = 0; i < n; i++) {
+    const Path &path = paths.at(index[i]);
+    bool flipped = flip[index[i]];
+    const Vector3D &start = flipped ? path.endPoint() : path.startPoint();
+    const Vector3D &end = flipped ? path.startPoint() : path.endPoint();
+
+    entry.x[i] = start.x();
+    entry.y[i] = start.y();
+    entry.z[i] = start.z();
+    exit.x[i] = end.x();
+    exit.y[i] = end.y();
+    exit.z[i] = end.z();
+  }
+}
+
+
 void AnnealState::flipIndex(unsigned i) {
   flip[index[i]] = !flip[index[i]];
+  swapEnds(i);
 }
 
 
 double AnnealState::computeCost(unsigned first, unsigned second) const {
-  const Path &path1 = paths.at(index[first]);
-  const Path &path2 = paths.at(index[second]);
-
-  const cb::Vector3D &p1 =
-    flip[index[first]] ? path1.startPoint() : path1.endPoint();
-  const cb::Vector3D &p2 =
-    flip[index[second]] ? path2.endPoint() : path2.startPoint();
-
-  return p1.distance(p2);
+  return distance(exit, first, entry, second);
 }
 
 
@@ -79,7 +114,7 @@ double AnnealState::computeCost() const {
 }
 
 
-double AnnealState::swapDelta(unsigned first, unsigned second) {
+double AnnealState::swapDelta(unsigned first, unsigned second) const {
   double delta = 0;
 
   if (first) {
@@ -112,37 +147,68 @@ double AnnealState::swapDelta(unsigned first, unsigned second) {
 }
 
 
-double AnnealState::reverseDelta(unsigned first, unsigned second) {
-  double delta = 0;
+double AnnealState::reverseDelta(unsigned first, unsigned second) const {
+  double delta;
+  reverseDeltas(1, &first, &second, &delta);
+  return delta;
+}
 
-  if (first) {
-    delta -= computeCost(first - 1, first);
-    flipIndex(second);
-    delta += computeCost(first - 1, second);
-    flipIndex(second);
-  }
 
-  if (second < index.size() - 1) {
-    delta -= computeCost(second, second + 1);
-    flipIndex(first);
-    delta += computeCost(first, second + 1);
-    flipIndex(first);
+void AnnealState::reverseDeltas(unsigned count, const unsigned *first,
+                                const unsigned *second, double *deltas) const {
+  unsigned last = index.size() - 1;
+
+  // The ends of the tour are masked rather than branched around.  Reversed,
+  // the path at second is entered at its exit and the one at first left
+  // from its entry.
+  for (unsigned i = 0; i < count; i++) {
+    unsigned f = first[i];
+    unsigned s = second[i];
+    unsigned before = f ? f - 1 : 0;
+    unsigned after = s < last ? s + 1 : last;
+
+    double head =
+      distance(exit, before, exit, s) - distance(exit, before, entry, f);
+    double tail =
+      distance(entry, f, entry, after) - distance(exit, s, entry, after);
+
+    deltas[i] = (f ? head : 0) + (s < last ? tail : 0);
   }
+}
+
+
+double AnnealState::flipDelta(unsigned i) const {
+  double delta = 0;
+
+  if (i)
+    delta += distance(exit, i - 1, exit, i) - distance(exit, i - 1, entry, i);
+
+  if (i < index.size() - 1)
+    delta += distance(entry, i, entry, i + 1) - distance(exit, i, entry, i + 1);
 
   return delta;
 }
 
 
-double AnnealState::flipDelta(unsigned i) {
+double AnnealState::moveDelta(unsigned from, unsigned after,
+                              bool flipped) const {
+  unsigned last = index.size() - 1;
+  const Ends &in = flipped ? exit : entry;
+  const Ends &out = flipped ? entry : exit;
   double delta = 0;
 
-  if (i) delta -= computeCost(i - 1, i);
-  if (i < index.size() - 1) delta -= computeCost(i, i + 1);
+  // Close the gap
+  if (from) delta -= computeCost(from - 1, from);
+  if (from < last) delta -= computeCost(from, from + 1);
+  if (from && from < last) delta += computeCost(from - 1, from + 1);
 
-  flipIndex(i);
-  if (i) delta += computeCost(i - 1, i);
-  if (i < index.size() - 1) delta += computeCost(i, i + 1);
-  flipIndex(i);
+  // Insert
+  delta += distance(exit, after, in, from);
+
+  if (after < last) {
+    delta -= computeCost(after, after + 1);
+    delta += distance(out, from, entry, after + 1);
+  }
 
   return delta;
 }
@@ -150,6 +216,7 @@ double AnnealState::flipDelta(unsigned i) {
 
 void AnnealState::acceptSwap(unsigned first, unsigned second) {
   std::swap(index[first], index[second]);
+  swapPositions(first, second);
 }
 
 
@@ -159,11 +226,57 @@ void AnnealState::acceptReverse(unsigned first, unsigned second) {
   unsigned length = second - first + 1;
   unsigned half = length / 2;
 
-  for (unsigned i = 0; i < half; i++)
+  for (unsigned i = 0; i < half; i++) {
     std::swap(index[first + i], index[second - i]);
+    swapPositions(first + i, second - i);
+  }
 }
 
 
 void AnnealState::acceptFlip(unsigned i) {
   flipIndex(i);
 }
+
+
+void AnnealState::acceptMove(unsigned from, unsigned after, bool flipped) {
+  if (flipped) flipIndex(from);
+
+  unsigned to = after < from ? after + 1 : after;
+  Ends *ends[2] = {&entry, &exit};
+
+  moveItem(index, from, to);
+
+  for (int i = 0; i < 2; i++) {
+    moveItem(ends[i]->x, from, to);
+    moveItem(ends[i]->y, from, to);
+    moveItem(ends[i]->z, from, to);
+  }
+}
+
+
+double AnnealState::distance(const Ends &a, unsigned i, const Ends &b,
+                             unsigned j) {
+  double dx = b.x[j] - a.x[i];
+  double dy = b.y[j] - a.y[i];
+  double dz = b.z[j] - a.z[i];
+
+  return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+
+void AnnealState::swapEnds(unsigned i) {
+  std::swap(entry.x[i], exit.x[i]);
+  std::swap(entry.y[i], exit.y[i]);
+  std::swap(entry.z[i], exit.z[i]);
+}
+
+
+void AnnealState::swapPositions(unsigned i, unsigned j) {
+  Ends *ends[2] = {&entry, &exit};
+
+  for (int k = 0; k < 2; k++) {
+    std::swap(ends[k]->x[i], ends[k]->x[j]);
+    std::swap(ends[k]->y[i], ends[k]->y[j]);
+    std::swap(ends[k]->z[i], ends[k]->z[j]);
+  }
+}
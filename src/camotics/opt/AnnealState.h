@@ -36,20 +36,48 @@ namespace CAMotics {
     std::vector<bool> flip;
     double cost;
 
+  protected:
+    // Path end points by tour position, in the direction they are cut, so
+    // costs are read from contiguous arrays without looking up paths
+    struct Ends {
+      std::vector<double> x;
+      std::vector<double> y;
+      std::vector<double> z;
+    };
+
+    Ends entry;
+    Ends exit;
+
+  public:
     AnnealState(const paths_t &paths);
 
     AnnealState &operator=(const AnnealState &o);
 
+    /// Rebuild the end points after changing index or flip directly.
+    void update();
     void flipIndex(unsigned i);
 
     double computeCost(unsigned first, unsigned second) const;
     double computeCost() const;
 
-    double swapDelta(unsigned first, unsigned second);
-    double reverseDelta(unsigned first, unsigned second);
-    double flipDelta(unsigned i);
+    double swapDelta(unsigned first, unsigned second) const;
+    double reverseDelta(unsigned first, unsigned second) const;
+    /// Evaluate @param count reversals at once.
+    void reverseDeltas(unsigned count, const unsigned *first,
+                       const unsigned *second, double *deltas) const;
+    double flipDelta(unsigned i) const;
+    /// Moving the path at @param from to just after the one at @param after,
+    /// which must be neither it nor its predecessor.
+    double moveDelta(unsigned from, unsigned after, bool flipped) const;
     void acceptSwap(unsigned first, unsigned second);
     void acceptReverse(unsigned first, unsigned second);
     void acceptFlip(unsigned i);
+    void acceptMove(unsigned from, unsigned after, bool flipped);
+
+  protected:
+    static double distance(const Ends &a, unsigned i, const Ends &b,
+                           unsigned j);
+    void swapEnds(unsigned i);
+    void swapPositions(unsigned i, unsigned j);
   };
 }
@@ -0,0 +1,149 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "FeedOpt.h"
+
+#include <gcode/ToolPath.h>
+#include <gcode/ast/Word.h>
+#include <gcode/ast/Number.h>
+#include <gcode/plan/PlannerConfig.h>
+
+#include <cbang/Exception.h>
+#include <cbang/log/Logger.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+FeedOpt::FeedOpt(GCode::Processor &next, double minScale, double maxScale,
+                 double percentile) :
+  next(next), minScale(minScale), maxScale(maxScale),
+  percentile(percentile), feed(0), current(0) {
+  if (minScale <= 0 || maxScale < minScale)
+    THROWS("Invalid feed scale range " << minScale << " to " << maxScale);
+  if (percentile <= 0 || 1 < percentile)
+    THROWS("Invalid removal rate percentile " << percentile);
+}
+
+
+double FeedOpt::compute(const GCode::ToolPath &path,
+                        const vector<HeightMap::Removal> &removal,
+                        const GCode::PlannerConfig &config) {
+  unsigned count = min(removal.size(), path.size());
+
+  // Each tool's target rate, most of its cuts already run at or below it
+  typedef map<int, vector<double> > rates_t;
+  rates_t rates;
+  for (unsigned i = 0; i < count; i++)
+    if (path[i].getType() == GCode::MoveType::MOVE_CUTTING &&
+        removal[i].volume)
+      rates[path[i].getTool()].push_back(removal[i].getRate());
+
+  map<int, double> targets;
+  for (rates_t::iterator it = rates.begin(); it != rates.end(); it++) {
+    vector<double> &r = it->second;
+    unsigned n = min(r.size() - 1, (size_t)(percentile * r.size()));
+    nth_element(r.begin(), r.begin() + n, r.end());
+    targets[it->first] = r[n];
+  }
+
+  scales.clear();
+  double oldTime = 0;
+  double newTime = 0;
+
+  for (unsigned i = 0; i < count; i++) {
+    const GCode::Move &move = path[i];
+    if (move.getType() != GCode::MoveType::MOVE_CUTTING || !move.getFeed())
+      continue;
+
+    double scale = maxScale; // Air cut
+    if (removal[i].volume)
+      scale = targets[move.getTool()] / removal[i].getRate();
+    scale = max(minScale, min(maxScale, scale));
+
+    // Stay within the velocity of each axis along the move's chord
+    cb::Vector3D delta = move.getEndPt() - move.getStartPt();
+    double length = delta.length();
+    for (unsigned axis = 0; length && axis < 3; axis++)
+      if (delta[axis]) {
+        double limit = config.maxVel[axis] * length / fabs(delta[axis]);
+        scale = min(scale, limit / move.getFeed());
+      }
+
+    // A line is as slow as its slowest move
+    unsigned line = move.getLine();
+    if (scales.size() <= line) scales.resize(line + 1, 0);
+    scales[line] = scales[line] ? min(scales[line], scale) : scale;
+
+    oldTime += move.getTime();
+    newTime += move.getTime() / scale;
+  }
+
+  LOG_INFO(1, "Estimated cutting time " << oldTime << "s reduced to "
+           << newTime << "s");
+
+  feed = current = 0;
+
+  return newTime;
+}
+
+
+void FeedOpt::operator()(const SmartPointer<GCode::Block> &block) {
+  // Remember the programmed feed and drop its words, unless it is computed
+  vector<unsigned> words;
+
+  for (unsigned i = 0; i < block->size(); i++) {
+    GCode::Word *word = dynamic_cast<GCode::Word *>(block->at(i).get());
+    if (!word || word->getType() != 'F') continue;
+
+    GCode::Number *number =
+      dynamic_cast<GCode::Number *>(word->getExpression().get());
+
+    if (!number) {
+      feed = current = 0;
+      return next(block);
+    }
+
+    feed = number->getValue();
+    words.push_back(i);
+  }
+
+  for (unsigned i = words.size(); i; i--)
+    block->erase(block->begin() + words[i - 1]);
+
+  // Scaled feeds are rounded to a tenth of a unit per minute
+  unsigned line = block->getLine();
+  double scale = line < scales.size() ? scales[line] : 0;
+  double target = scale ? round(feed * scale * 10) / 10 : feed;
+
+  if (target && (target != current || !words.empty())) {
+    block->push_back(new GCode::Word('F', new GCode::Number(target)));
+    current = target;
+  }
+
+  next(block);
+}
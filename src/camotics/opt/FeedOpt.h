@@ -0,0 +1,72 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <camotics/sim/HeightMap.h>
+
+#include <gcode/Processor.h>
+
+#include <vector>
+
+
+namespace GCode {
+  class ToolPath;
+  class PlannerConfig;
+}
+
+namespace CAMotics {
+  /***
+   * Rewrites the F words of a program from the material each of its lines
+   * removed.  Each tool's cuts are scaled toward the removal rate that most
+   * of them already run at or below, so heavy cuts slow down and light cuts
+   * speed up.  Air cuts run as fast as allowed.  Feeds stay within the
+   * planner's axis velocity limits.  Blocks are passed on to another
+   * processor, such as a GCode::Printer.
+   */
+  class FeedOpt : public GCode::Processor {
+    GCode::Processor &next;
+
+    double minScale;
+    double maxScale;
+    double percentile; ///< Of each tool's removal rates, taken as its target
+
+    std::vector<double> scales; ///< By program line, zero where unchanged
+
+    double feed;    ///< Programmed feed, zero if unknown
+    double current; ///< Feed in effect in the output
+
+  public:
+    FeedOpt(GCode::Processor &next, double minScale = 0.5,
+            double maxScale = 2, double percentile = 0.9);
+
+    /// Scale the feeds of @param path's lines from @param removal, which
+    /// holds the removal of each move.
+    /// @return the estimated cutting time after scaling.
+    double compute(const GCode::ToolPath &path,
+                   const std::vector<HeightMap::Removal> &removal,
+                   const GCode::PlannerConfig &config);
+
+    // From GCode::Processor
+    void operator()(const cb::SmartPointer<GCode::Block> &block);
+  };
+}
@@ -0,0 +1,136 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "KDTree.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+KDTree::KDTree(const vector<Vector3D> &points) :
+  points(points), positions(points.size()), alive(points.size()),
+  removed(points.size(), false) {
+  for (unsigned i = 0; i < points.size(); i++) ids.push_back(i);
+  build(0, points.size(), 0);
+  for (unsigned i = 0; i < ids.size(); i++) positions[ids[i]] = i;
+}
+
+
+void KDTree::remove(unsigned id) {
+  unsigned pos = positions[id];
+  if (removed[pos]) return;
+  removed[pos] = true;
+
+  unsigned begin = 0;
+  unsigned end = points.size();
+
+  while (begin < end) {
+    unsigned mid = (begin + end) / 2;
+    alive[mid]--;
+
+    if (pos == mid) break;
+    if (pos < mid) end = mid;
+    else begin = mid + 1;
+  }
+}
+
+
+int KDTree::nearest(const Vector3D &p) const {
+  heap_t heap;
+  search(p, 1, 0, points.size(), 0, heap);
+  return heap.empty() ? -1 : (int)heap.front().second;
+}
+
+
+void KDTree::nearest(const Vector3D &p, unsigned k,
+                     vector<unsigned> &results) const {
+  heap_t heap;
+  search(p, k, 0, points.size(), 0, heap);
+
+  sort_heap(heap.begin(), heap.end());
+  for (unsigned i = 0; i < heap.size(); i++) results.push_back(heap[i].second);
+}
+
+
+void KDTree::build(unsigned begin, unsigned end, unsigned axis) {
+  if (end <= begin) return;
+
+  unsigned mid = (begin + end) / 2;
+  alive[mid] = end - begin;
+
+  // Order the range around its median point, keeping ids alongside
+  vector<unsigned> order;
+  for (unsigned i = begin; i < end; i++) order.push_back(i);
+
+  nth_element(order.begin(), order.begin() + (mid - begin), order.end(),
+              [this, axis] (unsigned a, unsigned b) {
+                return points[a][axis] < points[b][axis];
+              });
+
+  vector<Vector3D> rangePoints;
+  vector<unsigned> rangeIDs;
+  for (unsigned i = 0; i < order.size(); i++) {
+    rangePoints.push_back(points[order[i]]);
+    rangeIDs.push_back(ids[order[i]]);
+  }
+
+  copy(rangePoints.begin(), rangePoints.end(), points.begin() + begin);
+  copy(rangeIDs.begin(), rangeIDs.end(), ids.begin() + begin);
+
+  build(begin, mid, (axis + 1) % 3);
+  build(mid + 1, end, (axis + 1) % 3);
+}
+
+
+void KDTree::search(const Vector3D &p, unsigned k, unsigned begin,
+                    unsigned end, unsigned axis, heap_t &heap) const {
+  if (end <= begin) return;
+
+  unsigned mid = (begin + end) / 2;
+  if (!alive[mid]) return;
+
+  if (!removed[mid]) {
+    double d = p.distanceSquared(points[mid]);
+
+    if (heap.size() < k || d < heap.front().first) {
+      if (heap.size() == k) {
+        pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+      }
+
+      heap.push_back(make_pair(d, ids[mid]));
+      push_heap(heap.begin(), heap.end());
+    }
+  }
+
+  double diff = p[axis] - points[mid][axis];
+  unsigned next = (axis + 1) % 3;
+
+  if (diff < 0) search(p, k, begin, mid, next, heap);
+  else search(p, k, mid + 1, end, next, heap);
+
+  if (heap.size() < k || diff * diff < heap.front().first) {
+    if (diff < 0) search(p, k, mid + 1, end, next, heap);
+    else search(p, k, begin, mid, next, heap);
+  }
+}
@@ -0,0 +1,65 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/geom/Vector.h>
+
+#include <vector>
+#include <utility>
+
+
+namespace CAMotics {
+  /***
+   * A k-d tree over a fixed set of points, stored implicitly by splitting
+   * ranges of one array at their medians.  Points can be removed so
+   * repeated nearest neighbor searches skip those already used.
+   */
+  class KDTree {
+    std::vector<cb::Vector3D> points;
+    std::vector<unsigned> ids;
+    std::vector<unsigned> positions; ///< By id
+    std::vector<unsigned> alive;     ///< Live points in each node's range
+    std::vector<bool> removed;       ///< By position
+
+  public:
+    KDTree(const std::vector<cb::Vector3D> &points);
+
+    unsigned size() const {return alive.empty() ? 0 : alive[root()];}
+
+    void remove(unsigned id);
+
+    /// @return the id of the closest live point or -1 if there are none.
+    int nearest(const cb::Vector3D &p) const;
+
+    /// Find the ids of up to @param k closest live points, closest first.
+    void nearest(const cb::Vector3D &p, unsigned k,
+                 std::vector<unsigned> &results) const;
+
+  protected:
+    typedef std::vector<std::pair<double, unsigned> > heap_t;
+
+    unsigned root() const {return points.size() / 2;}
+    void build(unsigned begin, unsigned end, unsigned axis);
+    void search(const cb::Vector3D &p, unsigned k, unsigned begin,
+                unsigned end, unsigned axis, heap_t &heap) const;
+  };
+}
@@ -21,11 +21,13 @@
 #include "Opt.h"
 
 #include "AnnealState.h"
+#include "KDTree.h"
 
 #include <gcode/machine/MachineState.h>
 #include <gcode/machine/MoveSink.h>
 
 #include <cbang/Math.h>
+#include <cbang/os/Thread.h>
 #include <cbang/log/Logger.h>
 #include <cbang/time/Time.h>
 
@@ -34,10 +36,26 @@ using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  class AnnealJob : public Thread {
+    const Opt &opt;
+    AnnealState &best;
+    unsigned seed;
+
+  public:
+    AnnealJob(const Opt &opt, AnnealState &best, unsigned seed) :
+      opt(opt), best(best), seed(seed) {}
+
+    // From Thread
+    void run() {opt.anneal(best, seed);}
+  };
+}
+
+
 Opt::Opt(const GCode::ToolPath &path) :
   cutCount(0), iterations(10000), runs(1), heatTarget(1.5),
   minTemp(0.01), heatRate(1.5), coolRate(0.95), reheatRate(2), timeout(10),
-  zSafe(5), tools(path.getTools()) {
+  neighbors(8), maxPasses(100), zSafe(5), tools(path.getTools()) {
 
   srand(Time::now()); // Randomize
 
@@ -90,55 +108,40 @@ void Opt::add(const GCode::Move &move) {
 
 
 double Opt::optimize() {
+  // Moves ending in rapids leave an empty path at the end
+  if (!paths.empty() && paths.back().empty()) paths.pop_back();
+  if (paths.size() < 2) return 0;
+
   AnnealState start(paths);
   AnnealState best(paths);
-  AnnealState veryBest(paths);
-  AnnealState current(paths);
-
-  for (unsigned run = 0; run < runs && !shouldQuit(); run++) {
-    best = start;
-
-    // Greedy run
-    round(0, iterations, current, best);
 
-    double T = 1;
-    double average;
-    double target = best.cost * heatTarget;
+  // Anneal from a good solution rather than the input order
+  greedy(start);
+  LOG_INFO(1, "Nearest neighbor cost " << start.cost);
+  improve(start);
+  LOG_INFO(1, "Local search cost " << start.cost);
 
-    // Increase temperature up to target
-    LOG_INFO(1, "Heating up");
-    do {
-      T *= heatRate;
-      average = round(T, iterations, current, best);
-    } while (average < target && !shouldQuit());
+  // Independent runs on their own threads, each with its own state and seed
+  vector<SmartPointer<AnnealState> > results;
+  vector<SmartPointer<AnnealJob> > jobs;
 
-    // Run until cold
-    LOG_INFO(1, "Anealing");
-    uint64_t lastImprovement = Time::now();
-
-    while (!shouldQuit()) {
-      double tempBest = best.cost;
-      round(T, iterations, current, best);
-
-      if (best.cost < tempBest) {
-        LOG_INFO(1, "Temperature " << T << " Cost " << best.cost);
-
-        lastImprovement = Time::now();
-        T *= reheatRate;
-
-      } else T *= coolRate;
-
-      if (T < minTemp) break; // Frozen
-      if (timeout < Time::now() - lastImprovement) break;
-    }
-
-    if (best.cost < veryBest.cost) veryBest = best;
+  for (unsigned run = 0; run < runs; run++) {
+    results.push_back(new AnnealState(paths));
+    *results.back() = start;
+    jobs.push_back(new AnnealJob(*this, *results.back(), rand()));
   }
 
-  best = veryBest;
+  for (unsigned i = 1; i < jobs.size(); i++) jobs[i]->start();
+  if (!jobs.empty()) jobs[0]->run();
+  for (unsigned i = 1; i < jobs.size(); i++) jobs[i]->join();
+
+  // Keep the best run
+  best = start;
+  for (unsigned i = 0; i < results.size(); i++)
+    if (results[i]->cost < best.cost) best = *results[i];
 
   // Rearrange vector
-  if (best.cost < current.cost) {
+  if (best.cost < computeCost()) {
     vector<Path> tmp(paths.begin(), paths.end());
     paths.clear();
 
@@ -152,6 +155,47 @@ double Opt::optimize() {
 }
 
 
+void Opt::anneal(AnnealState &best, unsigned seed) const {
+  rng_t rng(seed);
+  AnnealState current(paths);
+  current = best;
+
+  // Greedy run
+  round(0, iterations, current, best, rng);
+
+  double T = 1;
+  double average;
+  double target = best.cost * heatTarget;
+
+  // Increase temperature up to target
+  LOG_INFO(1, "Heating up");
+  do {
+    T *= heatRate;
+    average = round(T, iterations, current, best, rng);
+  } while (average < target && !shouldQuit());
+
+  // Run until cold
+  LOG_INFO(1, "Anealing");
+  uint64_t lastImprovement = Time::now();
+
+  while (!shouldQuit()) {
+    double tempBest = best.cost;
+    round(T, iterations, current, best, rng);
+
+    if (best.cost < tempBest) {
+      LOG_INFO(1, "Temperature " << T << " Cost " << best.cost);
+
+      lastImprovement = Time::now();
+      T *= reheatRate;
+
+    } else T *= coolRate;
+
+    if (T < minTemp) break; // Frozen
+    if (timeout < Time::now() - lastImprovement) break;
+  }
+}
+
+
 void Opt::extract(GCode::ToolPath &path) const {
   GCode::MoveSink sink(path);
   sink.setParent(new GCode::MachineState);
@@ -198,19 +242,159 @@ void Opt::extract(GCode::ToolPath &path) const {
 }
 
 
-static bool accept(double delta, double T) {
-  return delta < 0 ? true : (rand() < exp(-delta / (T * 0.00001)) * RAND_MAX);
+void Opt::greedy(AnnealState &state) const {
+  vector<Vector3D> ends;
+  for (unsigned i = 0; i < paths.size(); i++) {
+    ends.push_back(paths[i].startPoint());
+    ends.push_back(paths[i].endPoint());
+  }
+
+  // Start with the first path, then always go to the closest free end
+  KDTree tree(ends);
+  tree.remove(0);
+  tree.remove(1);
+
+  state.index.assign(1, 0);
+  state.flip.assign(paths.size(), false);
+  Vector3D p = paths[0].endPoint();
+
+  while (tree.size()) {
+    unsigned end = tree.nearest(p);
+    unsigned path = end / 2;
+    bool reversed = end & 1;
+
+    tree.remove(path * 2);
+    tree.remove(path * 2 + 1);
+
+    state.index.push_back(path);
+    state.flip[path] = reversed;
+    p = reversed ? paths[path].startPoint() : paths[path].endPoint();
+  }
+
+  state.update();
+  state.cost = state.computeCost();
+}
+
+
+void Opt::improve(AnnealState &state) const {
+  unsigned n = paths.size();
+
+  // Candidates are the paths with an end close to either end of a path
+  vector<Vector3D> ends;
+  for (unsigned i = 0; i < n; i++) {
+    ends.push_back(paths[i].startPoint());
+    ends.push_back(paths[i].endPoint());
+  }
+
+  KDTree tree(ends);
+  vector<vector<unsigned> > candidates(n);
+
+  for (unsigned i = 0; i < n; i++) {
+    vector<unsigned> results;
+    tree.nearest(ends[i * 2], neighbors + 2, results);
+    tree.nearest(ends[i * 2 + 1], neighbors + 2, results);
+
+    for (unsigned j = 0; j < results.size(); j++) {
+      unsigned path = results[j] / 2;
+      vector<unsigned> &c = candidates[i];
+
+      if (path != i && find(c.begin(), c.end(), path) == c.end())
+        c.push_back(path);
+    }
+  }
+
+  vector<unsigned> position(n);
+  for (unsigned i = 0; i < n; i++) position[state.index[i]] = i;
+
+  const double epsilon = -1e-9;
+  vector<unsigned> firsts;
+  vector<unsigned> seconds;
+  vector<double> deltas;
+  bool improved = true;
+
+  for (unsigned pass = 0; pass < maxPasses && improved && !shouldQuit();
+       pass++) {
+    improved = false;
+
+    for (unsigned i = 0; i < n; i++) {
+      // Flip
+      double delta = state.flipDelta(i);
+      if (delta < epsilon) {
+        state.acceptFlip(i);
+        state.cost += delta;
+        improved = true;
+      }
+
+      const vector<unsigned> &c = candidates[state.index[i]];
+      if (c.empty()) continue;
+
+      // 2-opt, reverse the paths between i and a candidate, best first
+      firsts.clear();
+      seconds.clear();
+
+      for (unsigned k = 0; k < c.size(); k++) {
+        unsigned j = position[c[k]];
+        firsts.push_back(i < j ? i + 1 : j);
+        seconds.push_back(i < j ? j : i - 1);
+      }
+
+      deltas.resize(c.size());
+      state.reverseDeltas(c.size(), &firsts[0], &seconds[0], &deltas[0]);
+
+      unsigned k = min_element(deltas.begin(), deltas.end()) - deltas.begin();
+      if (deltas[k] < epsilon) {
+        state.acceptReverse(firsts[k], seconds[k]);
+        state.cost += deltas[k];
+        for (unsigned l = firsts[k]; l <= seconds[k]; l++)
+          position[state.index[l]] = l;
+
+        improved = true;
+        continue;
+      }
+
+      // Or-opt, move a candidate to follow i, either way round
+      for (unsigned k = 0; k < c.size(); k++) {
+        unsigned j = position[c[k]];
+        if (j == i + 1 || !j) continue;
+
+        bool moved = false;
+        for (int flipped = 0; flipped < 2 && !moved; flipped++) {
+          delta = state.moveDelta(j, i, flipped);
+
+          if (delta < epsilon) {
+            state.acceptMove(j, i, flipped);
+            state.cost += delta;
+            for (unsigned l = min(i, j); l <= max(i, j); l++)
+              position[state.index[l]] = l;
+
+            moved = improved = true;
+          }
+        }
+
+        if (moved) break;
+      }
+    }
+  }
+
+  // Remove accumulated rounding errors
+  state.cost = state.computeCost();
+}
+
+
+static bool accept(double delta, double T, Opt::rng_t &rng) {
+  return delta < 0 ? true :
+    (rng() < exp(-delta / (T * 0.00001)) * Opt::rng_t::max());
 }
 
 
 double Opt::round(double T, unsigned iterations, AnnealState &current,
-                  AnnealState &best) {
+                  AnnealState &best, rng_t &rng) const {
   double average = 0;
 
   for (unsigned round = 0; round < iterations && !shouldQuit(); round++) {
-    unsigned first = rand() % best.index.size();
-    unsigned second = rand() % best.index.size();
-    unsigned mode = rand() % 3;
+    unsigned first = rng() % best.index.size();
+    unsigned second = rng() % best.index.size();
+    unsigned mode = rng() % 3;
 
     if (first == second) continue;
     if (second < first) std::swap(first, second);
@@ -223,7 +407,7 @@ double Opt::round(double T, unsigned iterations, AnnealState &current,
     case 2: delta = current.flipDelta(first); break;
     }
 
-    if (accept(delta / current.cost, T)) {
+    if (accept(delta / current.cost, T, rng)) {
       switch (mode) {
       case 0: current.acceptSwap(first, second); break;
       case 1: current.acceptReverse(first, second); break;
@@ -29,6 +29,8 @@
 
 #include <cbang/SmartPointer.h>
 
+#include <random>
+
 
 namespace CAMotics {
   class AnnealState;
@@ -40,7 +42,7 @@ namespace CAMotics {
     paths_t paths;
 
     unsigned iterations; ///< Iterations per annealing round
-    unsigned runs;       ///< GCode::Number of optimization runs
+    unsigned runs;       ///< Number of optimization runs, run in parallel
     double heatTarget;   ///< Stop heating the system when the average cost
                          ///< reaches this ratio of the starting cost, after a
                          ///< brief greedy optimization
@@ -51,12 +53,16 @@ namespace CAMotics {
     double reheatRate;   ///< Rate to reheat system as ratio of current temp
                          ///< Reheating occurs when best cost improved
     unsigned timeout;    ///< Stop opt if no improvement in this many seconds
+    unsigned neighbors;  ///< Candidates per path for local search
+    unsigned maxPasses;  ///< Limit on local search passes
     double zSafe;        ///< Safe Z height
 
     GCode::ToolTable tools;
     cb::SmartPointer<GCode::ToolPath> path;
 
   public:
+    typedef std::mt19937 rng_t;
+
     Opt(const GCode::ToolPath &path);
 
     const cb::SmartPointer<GCode::ToolPath> &getPath() const {return path;}
@@ -68,10 +74,14 @@ namespace CAMotics {
 
     void add(const GCode::Move &move);
     double optimize();
+    /// One annealing run starting from and improving on @param best.
+    void anneal(AnnealState &best, unsigned seed) const;
     void extract(GCode::ToolPath &path) const;
 
   protected:
+    void greedy(AnnealState &state) const;
+    void improve(AnnealState &state) const;
     double round(double T, unsigned iterations, AnnealState &current,
-                 AnnealState &best);
+                 AnnealState &best, rng_t &rng) const;
   };
 }
@@ -21,6 +21,7 @@
 #include "Probe.h"
 
 #include <cbang/Math.h>
+#include <cbang/String.h>
 #include <cbang/log/Logger.h>
 #include <cbang/config/Options.h>
 
@@ -65,11 +66,37 @@ Probe::Probe(Options &options, std::ostream &stream) :
                     "GCode to emit before the probe");
   options.addTarget("probe-suffix", probeSuffix,
                     "GCode to emit after the probe");
+  options.addTarget("bounds", bounds, "Probe the XMIN,YMIN,XMAX,YMAX area "
+                    "and level the program as it is read, in one pass without "
+                    "holding it in memory.  Every grid point is probed and "
+                    "cutting moves outside the area are an error.");
   options.popCategory();
 }
 
 
 void Probe::read(const InputSource &source) {
+  // Stream the program through when the area is known up front
+  if (!bounds.empty()) {
+    vector<string> values;
+    String::tokenize(bounds, values, ",");
+    if (values.size() != 4) THROWS("Invalid probe bounds '" << bounds << "'");
+
+    bbox = Rectangle2D(Vector2D(String::parseDouble(values[0]),
+                                String::parseDouble(values[1])),
+                       Vector2D(String::parseDouble(values[2]),
+                                String::parseDouble(values[3])));
+    createGrid();
+
+    for (ProbeGrid::row_iterator row = grid->begin(); row != grid->end();
+         row++)
+      for (ProbeGrid::col_iterator it = row->begin(); it != row->end(); it++)
+        it->probe = true;
+
+    didOutputProbe = false;
+    GCode::Parser().parse(source, *this);
+    return;
+  }
+
   // Parse program
   GCode::Program program;
   GCode::Parser().parse(source, program);
@@ -83,9 +110,7 @@ void Probe::read(const InputSource &source) {
 
   // Create probe grid
   pass = 2;
-  cb::Vector2D divisions(ceil(bbox.getWidth() / gridSize),
-                     ceil(bbox.getLength() / gridSize));
-  grid = new ProbeGrid(bbox, divisions);
+  createGrid();
   try {
     program.process(interp);
   } catch (const GCode::EndProgram &) {}
@@ -96,6 +121,13 @@ void Probe::read(const InputSource &source) {
 }
 
 
+void Probe::createGrid() {
+  cb::Vector2D divisions(ceil(bbox.getWidth() / gridSize),
+                         ceil(bbox.getLength() / gridSize));
+  grid = new ProbeGrid(bbox, divisions);
+}
+
+
 void Probe::outputProbe(ProbePoint &pt, unsigned address, unsigned count) {
   if (maxMem <= address)
     THROW("Too many probes, ran out of address space in controller");
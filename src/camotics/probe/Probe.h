@@ -56,6 +56,7 @@ namespace CAMotics {
     bool useLastZExpression;
     std::string probePrefix;
     std::string probeSuffix;
+    std::string bounds;
 
   protected:
     unsigned pass;
@@ -70,6 +71,7 @@ namespace CAMotics {
     // From cb::Reader
     void read(const cb::InputSource &source);
 
+    void createGrid();
     void outputProbe(ProbePoint &pt, unsigned address, unsigned count);
     void outputProbe();
 
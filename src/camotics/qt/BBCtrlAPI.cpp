@@ -25,12 +25,14 @@
 #include <camotics/view/View.h>
 #include <camotics/view/ToolPathView.h>
 
+#include <cbang/Exception.h>
 #include <cbang/os/SystemUtilities.h>
 #include <cbang/log/Logger.h>
 #include <cbang/time/Time.h>
 #include <cbang/io/StringInputSource.h>
 #include <cbang/util/DefaultCatch.h>
 
+#include <QFile>
 #include <QHttpMultiPart>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
@@ -40,9 +42,13 @@ using namespace cb;
 using namespace std;
 
 
+// Position updates arrive much faster than the view can show them, in ms
+#define POSITION_UPDATE_PERIOD 50
+
+
 BBCtrlAPI::BBCtrlAPI(QtWin *parent) :
   parent(parent), netManager(new QNetworkAccessManager(this)), active(false),
-  _connected(false) {
+  _connected(false), uploadReply(0) {
   connect(&webSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
           SLOT(onError(QAbstractSocket::SocketError)));
   connect(&webSocket, SIGNAL(connected()), this, SLOT(onConnected()));
@@ -52,8 +58,11 @@ BBCtrlAPI::BBCtrlAPI(QtWin *parent) :
 
   updateTimer.setSingleShot(false);
   reconnectTimer.setSingleShot(true);
+  positionTimer.setSingleShot(true);
+  positionTimer.setInterval(POSITION_UPDATE_PERIOD);
 
   connect(&updateTimer, SIGNAL(timeout()), this, SLOT(onUpdate()));
+  connect(&positionTimer, SIGNAL(timeout()), this, SLOT(onPosition()));
   connect(&reconnectTimer, SIGNAL(timeout()), this, SLOT(onReconnect()));
 }
 
@@ -73,6 +82,7 @@ void BBCtrlAPI::disconnectCNC() {
   webSocket.close();
   updateTimer.stop();
   reconnectTimer.stop();
+  positionTimer.stop();
 }
 
 
@@ -83,21 +93,47 @@ void BBCtrlAPI::reconnect() {
 }
 
 
-void BBCtrlAPI::uploadGCode(const char *data, unsigned length) {
+void BBCtrlAPI::uploadFile(const string &path) {
+  QFile *file = new QFile(QString::fromUtf8(path.c_str()));
+
+  if (!file->open(QFile::ReadOnly)) {
+    delete file;
+    THROWS("Failed to open '" << path << "' for upload");
+  }
+
+  // Qt reads the file as the socket drains
+  QHttpPart part;
+  part.setBodyDevice(file);
+  upload(part, file);
+}
+
+
+void BBCtrlAPI::uploadGCode(const SmartPointer<vector<char> > &gcode) {
+  QHttpPart part;
+  if (!gcode->empty())
+    part.setBody(QByteArray::fromRawData(&gcode->front(), gcode->size()));
+
+  upload(part);
+  uploadData = gcode; // Not copied by QByteArray::fromRawData()
+}
+
+
+void BBCtrlAPI::upload(QHttpPart &part, QObject *body) {
   LOG_INFO(1, "Uploading GCode '" << filename << "'");
 
+  // Only the latest program matters
+  if (uploadReply) uploadReply->abort();
+
   // Create multi-part MIME encoded message
   QHttpMultiPart *multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
 
-  QHttpPart part;
   part.setHeader(QNetworkRequest::ContentTypeHeader, QVariant("text/plain"));
-
   part.setHeader(QNetworkRequest::ContentDispositionHeader,
                  QString("form-data; name=\"gcode\"; filename=\"%1\"")
                  .arg(QString::fromUtf8(filename.c_str())));
-  part.setBody(QByteArray::fromRawData(data, length));
 
   multiPart->append(part);
+  if (body) body->setParent(multiPart);
 
   // Upload
   QUrl url = QString("http://") + this->url.host() + QString("/api/file");
@@ -105,9 +141,9 @@ void BBCtrlAPI::uploadGCode(const char *data, unsigned length) {
 
   if (!netManager) netManager = new QNetworkAccessManager(this);
 
-  QNetworkReply *reply = netManager->put(request, multiPart);
-  multiPart->setParent(reply); // delete the multiPart with the reply
-  // here connect signals etc.
+  uploadReply = netManager->put(request, multiPart);
+  multiPart->setParent(uploadReply); // delete the multiPart with the reply
+  connect(uploadReply, SIGNAL(finished()), this, SLOT(onUploadFinished()));
 }
 
 
@@ -159,15 +195,21 @@ void BBCtrlAPI::onTextMessageReceived(const QString &message) {
       if (key == "xp" || key == "yp" || key == "zp") updatePosition = true;
     }
 
-    if (updatePosition) {
-      uint32_t line = vars.getS32("ln", 0);
-      cb::Vector3D position(vars.getNumber("xp", 0),
-                        vars.getNumber("yp", 0),
-                        vars.getNumber("zp", 0));
+    // Only the latest position is shown
+    if (updatePosition && !positionTimer.isActive()) positionTimer.start();
+  } CATCH_ERROR;
+}
+
 
-      parent->getView()->path->setByRemote(position, line);
-      parent->redraw();
-    }
+void BBCtrlAPI::onPosition() {
+  try {
+    uint32_t line = vars.getS32("ln", 0);
+    cb::Vector3D position(vars.getNumber("xp", 0),
+                          vars.getNumber("yp", 0),
+                          vars.getNumber("zp", 0));
+
+    parent->getView()->path->setByRemote(position, line);
+    parent->redraw();
   } CATCH_ERROR;
 }
 
@@ -180,6 +222,25 @@ void BBCtrlAPI::onUpdate() {
 }
 
 
+void BBCtrlAPI::onUploadFinished() {
+  QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+  if (!reply) return;
+
+  if (reply->error() == QNetworkReply::NoError)
+    LOG_INFO(1, "Uploaded GCode '" << filename << "'");
+  else if (reply->error() != QNetworkReply::OperationCanceledError)
+    LOG_WARNING("CNC upload failed: "
+                << reply->errorString().toUtf8().data());
+
+  if (reply == uploadReply) {
+    uploadReply = 0;
+    uploadData.release();
+  }
+
+  reply->deleteLater();
+}
+
+
 void BBCtrlAPI::onReconnect() {
   if (!active) return;
 
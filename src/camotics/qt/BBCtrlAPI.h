@@ -21,11 +21,16 @@
 #pragma once
 
 #include <cbang/json/JSON.h>
+#include <cbang/SmartPointer.h>
 
 #include <QObject>
 #include <QtWebSockets/QtWebSockets>
 
+#include <vector>
+
 class QNetworkAccessManager;
+class QNetworkReply;
+class QHttpPart;
 
 
 namespace CAMotics {
@@ -42,11 +47,15 @@ namespace CAMotics {
     uint64_t lastMessage;
     QTimer updateTimer;
     QTimer reconnectTimer;
+    QTimer positionTimer; ///< Applies the latest position at display rate
 
     QWebSocket webSocket;
     QUrl url;
     std::string filename;
 
+    QNetworkReply *uploadReply;
+    cb::SmartPointer<std::vector<char> > uploadData; ///< Until uploaded
+
     cb::JSON::Dict vars;
 
   public:
@@ -58,7 +67,13 @@ namespace CAMotics {
     void disconnectCNC();
     void reconnect();
     void setFilename(const std::string &filename) {this->filename = filename;}
-    void uploadGCode(const char *data, unsigned length);
+    /// Streams the GCode file @param path, it is never loaded whole.
+    void uploadFile(const std::string &path);
+    /// Uploads @param gcode which is kept until the upload ends.
+    void uploadGCode(const cb::SmartPointer<std::vector<char> > &gcode);
+
+  protected:
+    void upload(QHttpPart &part, QObject *body = 0);
 
   signals:
     void connected();
@@ -70,6 +85,8 @@ namespace CAMotics {
     void onDisconnected();
     void onTextMessageReceived(const QString &message);
     void onUpdate();
+    void onPosition();
     void onReconnect();
+    void onUploadFinished();
   };
 }
@@ -23,20 +23,24 @@
 
 #include <cbang/String.h>
 #include <cbang/log/Logger.h>
-#include <cbang/util/SmartLock.h>
 
 #include <QColor>
 #include <QByteArray>
 #include <QTextBlock>
+#include <QTextCursor>
+#include <QTextCharFormat>
+#include <QScrollBar>
 
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
-ConsoleWriter::ConsoleWriter(QWidget *parent) : QTextEdit(parent) {
+ConsoleWriter::ConsoleWriter(QWidget *parent) :
+  QTextEdit(parent), pending(0), maxLines(0), repeats(0) {
   menu.addAction(QIcon(":/icons/copy.png"), "&Copy", this, SLOT(copy()))
     ->setShortcut(QKeySequence::Copy);
   menu.addAction(QIcon(":/icons/select-all.png"), "Select &All", this,
@@ -46,57 +50,140 @@ ConsoleWriter::ConsoleWriter(QWidget *parent) : QTextEdit(parent) {
     ->setShortcut(QKeySequence::Find);
   menu.addAction("Find &Next", this, SIGNAL(findNext())
                  )->setShortcut(QKeySequence::FindNext);
+
+  setMaxLines(10000);
+}
+
+
+ConsoleWriter::~ConsoleWriter() {
+  Line *line = pending.exchange(0);
+
+  while (line) {
+    Line *next = line->next;
+    delete line;
+    line = next;
+  }
+}
+
+
+void ConsoleWriter::setMaxLines(unsigned maxLines) {
+  this->maxLines = maxLines;
+  document()->setMaximumBlockCount(maxLines);
+}
+
+
+void ConsoleWriter::append(const string &text) {
+  Line *line = new Line;
+  line->text = text;
+  line->next = pending.load(memory_order_relaxed);
+
+  while (!pending.compare_exchange_weak(line->next, line,
+                                        memory_order_release,
+                                        memory_order_relaxed))
+    continue;
 }
 
 
 void ConsoleWriter::writeToConsole() {
-  // Only access lines while holding cb::Logger lock
-  SmartLock lock(&Logger::instance());
-
-  for (unsigned i = 0; i < lines.size(); i++) {
-    string &line = lines[i];
-
-    cout << line << endl;
-
-    QColor saveColor = QTextEdit::textColor();
-
-    if (4 < line.size() && line[0] == 27 && line[1] == '[' && line[4] == 'm') {
-
-      int code = String::parseU8(line.substr(2, 2));
-      QColor color;
-
-      switch (code) {
-      case 30: color = QColor("#000000"); break;
-      case 31: color = QColor("#ff0000"); break;
-      case 32: color = QColor("#00ff00"); break;
-      case 33: color = QColor("#ffff00"); break;
-      case 34: color = QColor("#0000ff"); break;
-      case 35: color = QColor("#ff00ff"); break;
-      case 36: color = QColor("#00ffff"); break;
-      case 37: color = QColor("#ffffff"); break;
-
-      case 90: color = QColor("#555555"); break;
-      case 91: color = QColor("#ff5555"); break;
-      case 92: color = QColor("#55ff55"); break;
-      case 93: color = QColor("#ffff55"); break;
-      case 94: color = QColor("#5555ff"); break;
-      case 95: color = QColor("#ff55ff"); break;
-      case 96: color = QColor("#55ffff"); break;
-      case 97: color = QColor("#ffffff"); break;
-      }
-
-      line = line.substr(5);
-      QTextEdit::setTextColor(color);
+  Line *head = pending.exchange(0, memory_order_acquire);
+  if (!head) return;
+
+  // Take the queued lines in the order they were logged
+  vector<string> lines;
+  while (head) {
+    Line *next = head->next;
+    lines.push_back(head->text);
+    delete head;
+    head = next;
+  }
+  reverse(lines.begin(), lines.end());
+
+  // Echo to the terminal in one write
+  string echo;
+  for (unsigned i = 0; i < lines.size(); i++) echo += lines[i] + '\n';
+  cout << echo << flush;
+
+  // Older lines would be dropped by the document anyway
+  unsigned first = lines.size() < maxLines ? 0 : lines.size() - maxLines;
+
+  QScrollBar *scroll = verticalScrollBar();
+  bool atEnd = scroll->value() == scroll->maximum();
+  if (document()->isEmpty()) lastLine.clear(); // Cleared
+
+  QTextCursor cursor(document());
+  cursor.movePosition(QTextCursor::End);
+  cursor.beginEditBlock();
+
+  if (first) {
+    insertLine(cursor, String::printf("... %u lines not shown", first));
+    lastLine.clear();
+  }
+
+  for (unsigned i = first; i < lines.size(); i++) {
+    if (lines[i] == lastLine) {
+      repeats++;
+      continue;
     }
 
-    if (String::endsWith(line, "\033[0m"))
-      line = line.substr(0, line.size() - 4);
+    insertRepeats(cursor);
+    insertLine(cursor, lines[i]);
+    lastLine = lines[i];
+  }
+
+  insertRepeats(cursor);
+  cursor.endEditBlock();
+
+  if (atEnd) scroll->setValue(scroll->maximum());
+}
+
+
+void ConsoleWriter::insertRepeats(QTextCursor &cursor) {
+  if (!repeats) return;
+  insertLine(cursor, String::printf("(repeated %u more time%s)", repeats,
+                                    repeats == 1 ? "" : "s"));
+  repeats = 0;
+}
 
-    QTextEdit::append(QString::fromUtf8(line.c_str()));
-    QTextEdit::setTextColor(saveColor);
+
+void ConsoleWriter::insertLine(QTextCursor &cursor, const string &text) {
+  string line = text;
+  QTextCharFormat format;
+  format.setForeground(QTextEdit::textColor());
+
+  if (4 < line.size() && line[0] == 27 && line[1] == '[' && line[4] == 'm') {
+
+    int code = String::parseU8(line.substr(2, 2));
+    QColor color;
+
+    switch (code) {
+    case 30: color = QColor("#000000"); break;
+    case 31: color = QColor("#ff0000"); break;
+    case 32: color = QColor("#00ff00"); break;
+    case 33: color = QColor("#ffff00"); break;
+    case 34: color = QColor("#0000ff"); break;
+    case 35: color = QColor("#ff00ff"); break;
+    case 36: color = QColor("#00ffff"); break;
+    case 37: color = QColor("#ffffff"); break;
+
+    case 90: color = QColor("#555555"); break;
+    case 91: color = QColor("#ff5555"); break;
+    case 92: color = QColor("#55ff55"); break;
+    case 93: color = QColor("#ffff55"); break;
+    case 94: color = QColor("#5555ff"); break;
+    case 95: color = QColor("#ff55ff"); break;
+    case 96: color = QColor("#55ffff"); break;
+    case 97: color = QColor("#ffffff"); break;
+    }
+
+    line = line.substr(5);
+    format.setForeground(color);
   }
 
-  lines.clear();
+  if (String::endsWith(line, "\033[0m"))
+    line = line.substr(0, line.size() - 4);
+
+  if (!document()->isEmpty()) cursor.insertBlock();
+  cursor.insertText(QString::fromUtf8(line.c_str()), format);
 }
 
 
@@ -23,8 +23,10 @@
 
 #include <QTextEdit>
 #include <QMenu>
+#include <QTextCursor>
 
-#include <vector>
+#include <string>
+#include <atomic>
 
 
 namespace CAMotics {
@@ -33,12 +35,31 @@ namespace CAMotics {
 
     QMenu menu;
 
-    std::vector<std::string> lines;
+    // Lines logged since the last writeToConsole(), newest first
+    struct Line {
+      std::string text;
+      Line *next;
+    };
+    std::atomic<Line *> pending;
+
+    unsigned maxLines;
+    std::string lastLine;
+    unsigned repeats;
+
+    void insertRepeats(QTextCursor &cursor);
+    void insertLine(QTextCursor &cursor, const std::string &text);
 
   public:
     ConsoleWriter(QWidget *parent = 0);
+    ~ConsoleWriter();
+
+    /// Keep at most @param maxLines in the console, dropping the oldest.
+    void setMaxLines(unsigned maxLines);
 
-    void append(const std::string &line) {lines.push_back(line);}
+    /// Queue @param line, from any thread, without locking.
+    void append(const std::string &line);
+    /// Show the queued lines, in one edit of the document.  Repeats of a
+    /// line are counted instead of shown.  Called once per frame.
     void writeToConsole();
 
     // From QTextEdit
@@ -94,11 +94,26 @@ bool ExportDialog::binarySTLSelected() const {
 }
 
 
+bool ExportDialog::gltfSelected() const {
+  return ui->gltfRadioButton->isChecked();
+}
+
+
 bool ExportDialog::compactJSONSelected() const {
   return ui->compactJSONRadioButton->isChecked();
 }
 
 
+bool ExportDialog::csvSelected() const {
+  return ui->csvRadioButton->isChecked();
+}
+
+
+bool ExportDialog::binaryPathSelected() const {
+  return ui->binaryPathRadioButton->isChecked();
+}
+
+
 void ExportDialog::on_surfaceRadioButton_clicked() {
   ui->surfaceFrame->setEnabled(true);
   ui->simDataFrame->setEnabled(false);
@@ -50,7 +50,10 @@ namespace CAMotics {
     bool simDataSelected() const;
 
     bool binarySTLSelected() const;
+    bool gltfSelected() const;
     bool compactJSONSelected() const;
+    bool csvSelected() const;
+    bool binaryPathSelected() const;
 
   protected slots:
     void on_surfaceRadioButton_clicked();
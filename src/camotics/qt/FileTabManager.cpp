@@ -39,6 +39,12 @@ using namespace cb;
 using namespace std;
 
 
+// Files larger than this are only highlighted where they are viewed
+#define LAZY_HIGHLIGHT_SIZE (1 << 20)
+// and files larger than this are opened read-only, without undo
+#define LARGE_FILE_SIZE (32 << 20)
+
+
 FileTabManager::FileTabManager(QWidget *parent) :
   QTabWidget(parent), win(0), offset(1) {
 
@@ -75,13 +81,29 @@ void FileTabManager::open(const cb::SmartPointer<NCFile> &file,
 
     QFile qFile(QString::fromUtf8(absPath.c_str()));
     qFile.open(QFile::ReadOnly);
-    QString contents = qFile.readAll();
+    qint64 size = qFile.size();
+
+    // Decode straight from the mapped file instead of copying it first
+    QString contents;
+    const char *data = (const char *)qFile.map(0, size);
+    if (data) contents = QString::fromUtf8(data, size);
+    else contents = qFile.readAll();
     qFile.close();
     contents.replace('\t', "  ");
 
+    // GCode lines are highlighted independently, TPL needs the whole file
+    if (!isTPL) highlighter->setLazy(LAZY_HIGHLIGHT_SIZE < size);
+
+    bool large = LARGE_FILE_SIZE < size;
+    if (large) {
+      editor->setReadOnly(true);
+      editor->document()->setUndoRedoEnabled(false);
+    }
+
     editor->loadDarkScheme();
     editor->setWordWrapMode(QTextOption::NoWrap);
     editor->setPlainText(contents);
+    contents.clear();
 
     connect(editor, SIGNAL(find()), SIGNAL(find()));
     connect(editor, SIGNAL(findNext()), SIGNAL(findNext()));
@@ -90,6 +112,7 @@ void FileTabManager::open(const cb::SmartPointer<NCFile> &file,
     QString title = QString::fromUtf8
       (SystemUtilities::basename(file->getAbsolutePath()).c_str());
     tab = (unsigned)QTabWidget::addTab(editor, title);
+    if (large) QTabWidget::setTabToolTip(tab, tr("Large file, read-only"));
     QApplication::restoreOverrideCursor();
   }
 
@@ -103,8 +126,11 @@ void FileTabManager::open(const cb::SmartPointer<NCFile> &file,
   if (0 < line) {
     QTextCursor c = editor->textCursor();
 
-    c.setPosition(0, QTextCursor::MoveAnchor);
-    c.movePosition(QTextCursor::Down, QTextCursor::MoveAnchor, line - 1);
+    // Looked up in the document's block tree rather than moving down line
+    // by line, which is slow in large files
+    QTextBlock block = editor->document()->findBlockByNumber(line - 1);
+    if (block.isValid()) c.setPosition(block.position());
+    else c.movePosition(QTextCursor::End);
 
     if (0 < col)
       c.movePosition(QTextCursor::NextCharacter, QTextCursor::MoveAnchor, col);
@@ -348,6 +374,15 @@ void FileTabManager::on_modificationChanged(NCEdit *editor, bool changed) {
 }
 
 
+void FileTabManager::on_contentsChanged(NCEdit *editor) {
+  // Ignore loading and reverting
+  if (getEditorIndex(editor) == -1 || !editor->document()->isModified())
+    return;
+
+  win->editorChanged();
+}
+
+
 void FileTabManager::on_tabCloseRequested(int index) {
   close(index, true, false);
 }
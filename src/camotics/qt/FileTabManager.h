@@ -71,6 +71,7 @@ namespace CAMotics {
 
   public slots:
     void on_modificationChanged(NCEdit *editor, bool changed);
+    void on_contentsChanged(NCEdit *editor);
 
   protected slots:
     void on_tabCloseRequested(int index);
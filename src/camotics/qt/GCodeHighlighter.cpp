@@ -120,10 +120,13 @@ void GCodeHighlighter::setFormat(const Token &token, ColorComponent cc) {
 
 
 void GCodeHighlighter::highlightBlock(const QString &text) {
+  // Skipped until scrolled into view
+  if (!isInView()) return setCurrentBlockState(PENDING_STATE);
+  setCurrentBlockState(-1);
+
   try {
     QByteArray array = text.toUtf8();
-    Scanner scanner(InputSource(array.data(), array.length()));
-    GCode::Tokenizer tokenizer(scanner);
+    GCode::Tokenizer tokenizer(array.data(), array.length());
 
     // Deleted
     if (tokenizer.consume(DIV_TOKEN))
@@ -53,6 +53,11 @@ void GLView::mouseMoveEvent(QMouseEvent *event) {
 }
 
 
+void GLView::mouseDoubleClickEvent(QMouseEvent *event) {
+  getQtWin().glViewMouseDoubleClickEvent(event);
+}
+
+
 void GLView::wheelEvent(QWheelEvent *event) {
   getQtWin().glViewWheelEvent(event);
 }
@@ -54,7 +54,22 @@ using namespace CAMotics;
 
 
 Highlighter::Highlighter(QTextDocument *parent)
-  : QSyntaxHighlighter(parent), markCaseSensitivity(Qt::CaseInsensitive) {
+  : QSyntaxHighlighter(parent), markCaseSensitivity(Qt::CaseInsensitive),
+    lazy(false), viewFirst(0), viewLast(0) {
+}
+
+
+void Highlighter::setView(int first, int last) {
+  viewFirst = first;
+  viewLast = last;
+
+  if (!lazy || !document()) return;
+
+  QTextBlock block = document()->findBlockByNumber(first);
+  for (int i = first; i <= last && block.isValid(); i++) {
+    if (block.userState() == PENDING_STATE) rehighlightBlock(block);
+    block = block.next();
+  }
 }
 
 
@@ -83,6 +98,13 @@ void Highlighter::setKeywords(const QStringList &keywords) {
 }
 
 
+bool Highlighter::isInView() const {
+  if (!lazy) return true;
+  int number = currentBlock().blockNumber();
+  return viewFirst <= number && number <= viewLast;
+}
+
+
 void Highlighter::highlightBlock(const QString &text) {
   // Mark
   if (!markString.isEmpty()) {
@@ -41,9 +41,21 @@ namespace CAMotics {
     QString markString;
     Qt::CaseSensitivity markCaseSensitivity;
 
+    bool lazy;
+    int viewFirst;
+    int viewLast;
+
   public:
+    /// State of blocks skipped while out of view
+    enum {PENDING_STATE = -2};
+
     Highlighter(QTextDocument *parent = 0);
 
+    /// Only highlight the blocks in view, only used by stateless languages.
+    void setLazy(bool lazy) {this->lazy = lazy;}
+    /// Highlight skipped blocks now in view, block numbers are inclusive.
+    void setView(int first, int last);
+
     void setColor(ColorComponent component, const QColor &color);
     void mark(const QString &str, Qt::CaseSensitivity caseSensitivity);
 
@@ -51,6 +63,9 @@ namespace CAMotics {
     void setKeywords(const QStringList &keywords);
 
   protected:
+    /// @return true if the current block should be highlighted now.
+    bool isInView() const;
+
     // From QSyntaxHighlighter
     void highlightBlock(const QString &text);
   };
@@ -155,8 +155,11 @@ NCEdit::NCEdit(const SmartPointer<NCFile> &file,
   connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateSidebar()));
   connect(this, SIGNAL(updateRequest(QRect, int)), this,
           SLOT(updateSidebar(QRect, int)));
+  connect(this, SIGNAL(updateRequest(QRect, int)), this,
+          SLOT(updateHighlighting()));
   connect(this, SIGNAL(modificationChanged(bool)),
           SLOT(modificationChanged(bool)));
+  connect(this, SIGNAL(textChanged()), SLOT(contentsChanged()));
 
 #if defined(Q_OS_MAC)
   QFont textFont = font();
@@ -649,6 +652,19 @@ void NCEdit::updateSidebar(const QRect &rect, int d) {
 }
 
 
+void NCEdit::updateHighlighting() {
+  // Highlight a screen ahead so scrolling does not show plain text
+  int first = firstVisibleBlock().blockNumber();
+  int lines = viewport()->height() / fontMetrics().lineSpacing() + 1;
+  highlighter->setView(qMax(0, first - lines), first + 2 * lines);
+}
+
+
 void NCEdit::modificationChanged(bool changed) {
   parent->on_modificationChanged(this, changed);
 }
+
+
+void NCEdit::contentsChanged() {
+  parent->on_contentsChanged(this);
+}
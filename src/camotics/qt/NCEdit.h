@@ -155,6 +155,8 @@ namespace CAMotics {
   protected slots:
     void updateCursor();
     void updateSidebar(const QRect &rect, int d);
+    void updateHighlighting();
     void modificationChanged(bool changed);
+    void contentsChanged();
   };
 }
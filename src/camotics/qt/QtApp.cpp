@@ -23,6 +23,8 @@
 #include "QtWin.h"
 #include "QApplication.h"
 
+#include <camotics/render/RenderPolicy.h>
+
 #include <cbang/Info.h>
 #include <cbang/log/Logger.h>
 #include <cbang/os/SystemInfo.h>
@@ -47,6 +49,19 @@ QtApp::QtApp(QWidget *parent) :
               "complete.  Only valid with 'auto-play'")
     ->setDefault(false);
   options.addTarget("threads", threads, "GCode::Number of simulation threads.");
+  options.add("tpl-in-process", "Run TPL programs in this process instead of "
+              "generating GCode with tplang.")->setDefault(false);
+  options.add("cut-times", "Find when each grid vertex is first cut with "
+              "the first surface so moving through time only contours the "
+              "grid.  Needs four bytes of memory per grid vertex.")
+    ->setDefault(false);
+  options.add("render-low-priority", "Run the simulation's rendering threads "
+              "at a lower priority than the user interface.")
+    ->setDefault(true);
+  options.add("render-reserve-cpus", "Keep this many CPUs free of rendering "
+              "threads for the user interface.")->setDefault(0);
+  options.add("render-throttle", "Pause all but one rendering thread while "
+              "the view is being moved.")->setDefault(true);
 
   // Configure Logger
   Logger &logger = Logger::instance();
@@ -69,7 +84,7 @@ int QtApp::init(int argc, char *argv[]) {
   this->argc = argc;
   this->argv = argv;
 
-  int ret = cb::Application::init(argc, argv);
+  int ret = Application::init(argc, argv);
   if (ret < 0) return ret;
 
   QGuiApplication guiApp(argc, argv);
@@ -104,6 +119,11 @@ void QtApp::run() {
   QCoreApplication::setOrganizationName(QString::fromUtf8(org.c_str()));
   QCoreApplication::setApplicationName(QString::fromUtf8(getName().c_str()));
 
+  // Render job scheduling
+  RenderPolicy::setLowPriority(options["render-low-priority"].toBoolean());
+  RenderPolicy::setReservedCPUs(options["render-reserve-cpus"].toInteger());
+  RenderPolicy::setThrottle(options["render-throttle"].toBoolean());
+
   QtWin qtWin(*this);
   qtWin.init();
 
@@ -111,8 +131,8 @@ void QtApp::run() {
   if (options["fullscreen"].toBoolean())
     qtWin.setWindowState(qtWin.windowState() | Qt::WindowFullScreen);
 
-  if (projectFile.empty()) qtWin.loadDefaultExample();
-  else qtWin.openProject(projectFile);
+  // Otherwise the default example is opened once the window is shown
+  if (!projectFile.empty()) qtWin.openProject(projectFile);
 
   qtWin.getView()->setSpeed(options["play-speed"].toInteger());
 
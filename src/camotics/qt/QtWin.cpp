@@ -21,17 +21,27 @@
 #include "QtWin.h"
 #include "Settings.h"
 #include "GLView.h"
+#include "NCEdit.h"
 
 #include "ui_camotics.h"
 
 #include <camotics/view/Viewer.h>
 #include <camotics/view/GL.h>
 #include <camotics/sim/Project.h>
+#include <camotics/MemoryUsage.h>
 #include <camotics/sim/SimulationRun.h>
+#include <camotics/sim/HeightMap.h>
 #include <camotics/sim/CutWorkpiece.h>
 #include <camotics/sim/ToolPathTask.h>
+#include <camotics/sim/ToolPathCache.h>
 #include <camotics/sim/SurfaceTask.h>
+#include <camotics/sim/SurfaceCache.h>
+#include <camotics/sim/KeyframeTask.h>
 #include <camotics/sim/ReduceTask.h>
+#include <camotics/sim/ExportTask.h>
+#include <camotics/sim/Deviation.h>
+#include <camotics/render/RenderPolicy.h>
+#include <camotics/contour/TriangleSurface.h>
 #include <camotics/machine/MachineModel.h>
 #include <camotics/opt/Opt.h>
 
@@ -42,6 +52,7 @@
 #include <cbang/os/DirectoryWalker.h>
 #include <cbang/log/Logger.h>
 #include <cbang/util/SmartInc.h>
+#include <cbang/util/SmartLock.h>
 #include <cbang/util/DefaultCatch.h>
 #include <cbang/time/TimeInterval.h>
 
@@ -56,6 +67,9 @@
 #include <QStringListModel>
 
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 
 using namespace std;
 using namespace cb;
@@ -64,17 +78,26 @@ using namespace CAMotics;
 #define LOCK_UI_UPDATES SmartInc<unsigned> inc(inUIUpdate)
 #define PROTECT_UI_UPDATE if (inUIUpdate) return; LOCK_UI_UPDATES
 
+// Animation timer periods in ms, while something is changing and while idle
+#define ANIMATION_ACTIVE_PERIOD 50
+#define ANIMATION_IDLE_PERIOD 500
+#define EDIT_PREVIEW_DELAY 300
+#define FILE_WATCH_DELAY 250
+
 
 QtWin::QtWin(Application &app) :
   QMainWindow(0), ui(new Ui::CAMoticsWindow), newDialog(this),
   newProjectDialog(this), exportDialog(this), aboutDialog(this),
   settingsDialog(this), donateDialog(this), findDialog(this, false),
   findAndReplaceDialog(this, true), toolDialog(this), camDialog(this),
-  connectDialog(this), fileDialog(*this), taskCompleteEvent(0), app(app),
-  options(app.getOptions()), view(new View(valueSet)), viewer(new Viewer),
-  lastRedraw(0), dirty(false), simDirty(false), inUIUpdate(false),
-  lastProgress(0), lastStatusActive(false), autoPlay(false), autoClose(false),
-  sliderMoving(false), positionChanged(false) {
+  connectDialog(this), fileDialog(*this), exportMan(1), taskCompleteEvent(0),
+  uploader(this),
+  app(app), options(app.getOptions()), view(new View(valueSet)),
+  viewer(new Viewer), toolPathCache(new ToolPathCache), lastRedraw(0),
+  dirty(false), simDirty(false), inUIUpdate(false), lastProgress(0),
+  lastStatusActive(false), autoPlay(false), autoClose(false),
+  sliderMoving(false), positionChanged(false), liveSim(false), liveTime(-1),
+  nextKeyframe(0) {
 
   ui->setupUi(this);
 
@@ -122,6 +145,7 @@ QtWin::QtWin(Application &app) :
 
   // ConcurrentTaskManager
   taskMan.addObserver(this);
+  exportMan.addObserver(this);
   taskCompleteEvent = QEvent::registerEventType();
 
   // Hide unimplemented console buttons
@@ -141,9 +165,7 @@ QtWin::QtWin(Application &app) :
   backwardIcon.addFile(QString::fromUtf8(":/icons/backward.png"), QSize(),
                        QIcon::Normal, QIcon::Off);
 
-  // Load data
-  loadMachines();
-  loadExamples();
+  // Load data, the examples and machines once the window is up
   loadRecentProjects();
 
   // Add docks to View menu
@@ -168,6 +190,11 @@ QtWin::QtWin(Application &app) :
   statusLabel = new QLabel;
   statusBar()->addPermanentWidget(statusLabel);
 
+  // Memory held by the simulation, shown from the View menu
+  memoryLabel = new QLabel;
+  memoryLabel->setVisible(false);
+  statusBar()->addPermanentWidget(memoryLabel);
+
   // Setup console stream
   consoleStream = new LineBufferStream<ConsoleWriter>(*ui->console);
   Logger::instance().setScreenStream(*consoleStream);
@@ -185,7 +212,19 @@ void QtWin::init() {
   // Start animation timer
   animationTimer.setSingleShot(false);
   connect(&animationTimer, SIGNAL(timeout()), this, SLOT(animate()));
-  animationTimer.start(50);
+  animationTimer.start(ANIMATION_ACTIVE_PERIOD);
+
+  // Preview edits once typing pauses
+  editTimer.setSingleShot(true);
+  editTimer.setInterval(EDIT_PREVIEW_DELAY);
+  connect(&editTimer, SIGNAL(timeout()), this, SLOT(previewEdits()));
+
+  // Editors often save in several writes, check once they are done
+  watchTimer.setSingleShot(true);
+  watchTimer.setInterval(FILE_WATCH_DELAY);
+  connect(&watchTimer, SIGNAL(timeout()), this, SLOT(checkFiles()));
+  connect(&fileWatcher, SIGNAL(fileChanged(const QString &)), this,
+          SLOT(fileChanged(const QString &)));
 
   // Simulation and Tool View tabs are not closeable
   ui->fileTabManager->setTabsClosable(true);
@@ -238,6 +277,9 @@ void QtWin::init() {
   valueSet["program_line"]->add(this, &QtWin::updateProgramLine);
 
   valueSet.updated();
+
+  // Scan for examples and machines after the window is first shown
+  QTimer::singleShot(0, this, SLOT(loadData()));
 }
 
 
@@ -256,13 +298,24 @@ void QtWin::setUnitLabel(QLabel *label, double value, int precision,
 
 
 void QtWin::loadMachine(const string &machine) {
-  if (view->machine.isNull() || machine != view->machine->getName()) {
-    string machineFile = settingsDialog.getMachinePath(machine);
-    LOG_DEBUG(1, "Loading machine " << machine << " from " << machineFile);
+  machineName = machine;
+  if (view->isFlagSet(View::SHOW_MACHINE_FLAG)) updateMachine();
+}
+
+
+void QtWin::updateMachine() {
+  if (machineName.empty() ||
+      (!view->machine.isNull() && machineName == view->machine->getName()))
+    return;
+
+  try {
+    string machineFile = settingsDialog.getMachinePath(machineName);
+    LOG_DEBUG(1, "Loading machine " << machineName << " from "
+              << machineFile);
     view->machine.release();
     view->machine = new MachineModel(machineFile);
     redraw();
-  }
+  } CATCH_ERROR;
 }
 
 
@@ -311,6 +364,15 @@ void QtWin::loadMachines() {
 }
 
 
+void QtWin::loadData() {
+  loadExamples();
+  loadMachines();
+
+  // Unless a project was given on the command line
+  if (project.isNull()) loadDefaultExample();
+}
+
+
 void QtWin::loadDefaultExample() {
   if (defaultExample.empty()) newProject();
   else {
@@ -507,6 +569,8 @@ void QtWin::snapView(char v) {
 
 
 void QtWin::glViewMousePressEvent(QMouseEvent *event) {
+  RenderPolicy::interact();
+
   if (event->buttons() & Qt::LeftButton)
     view->startRotation(event->x(), event->y());
 
@@ -516,6 +580,8 @@ void QtWin::glViewMousePressEvent(QMouseEvent *event) {
 
 
 void QtWin::glViewMouseMoveEvent(QMouseEvent *event) {
+  if (event->buttons()) RenderPolicy::interact();
+
   if (event->buttons() & Qt::LeftButton) {
     view->updateRotation(event->x(), event->y());
     redraw(true);
@@ -527,7 +593,28 @@ void QtWin::glViewMouseMoveEvent(QMouseEvent *event) {
 }
 
 
+void QtWin::glViewMouseDoubleClickEvent(QMouseEvent *event) {
+  if (!(event->button() & Qt::LeftButton)) return;
+
+  Picker::Pick pick;
+  if (!view->pick(event->x(), event->y(), pick) || !pick.hasMove) return;
+
+  const GCode::Move &move = pick.move;
+  showMessage(String::printf("%s line %u at (%.3f, %.3f, %.3f)",
+                             pick.onSurface ? "Cut by" : "Path",
+                             move.getLine(), pick.point.x(), pick.point.y(),
+                             pick.point.z()));
+
+  // Lines are only known to belong to a lone G-Code file
+  if (project.isNull() || project->getFileCount() != 1) return;
+  string path = project->getFile(0)->getAbsolutePath();
+  if (!String::endsWith(path, ".tpl")) activateFile(path, move.getLine());
+}
+
+
 void QtWin::glViewWheelEvent(QWheelEvent *event) {
+  RenderPolicy::interact();
+
   if (event->delta() < 0) view->zoomIn();
   else view->zoomOut();
 
@@ -535,7 +622,10 @@ void QtWin::glViewWheelEvent(QWheelEvent *event) {
 }
 
 
-void QtWin::initializeGL() {view->glInit();}
+void QtWin::initializeGL() {
+  view->glInit();
+  uploader.init(QOpenGLContext::currentContext());
+}
 
 
 void QtWin::resizeGL(int w, int h) {
@@ -572,8 +662,11 @@ void QtWin::warning(const string &msg) {
 void QtWin::loadToolPath(const SmartPointer<GCode::ToolPath> &toolPath,
                          bool simulate) {
   this->toolPath = toolPath;
+  liveTime = -1;
 
   // Update changed Project settings
+  project->path = toolPath;
+  project->threads = options["threads"].toInteger();
   project->updateAutomaticWorkpiece(*toolPath);
   project->updateResolution();
 
@@ -591,10 +684,14 @@ void QtWin::loadToolPath(const SmartPointer<GCode::ToolPath> &toolPath,
 
   // Clear old surface
   surface.release();
+  clearPreview();
   view->setSurface(0);
   view->setMoveLookup(0);
 
+  updateKeyframes();
+
   if (!simulate) {
+    keyframes.clear();
     setStatusActive(false);
     return;
   }
@@ -608,17 +705,36 @@ void QtWin::loadToolPath(const SmartPointer<GCode::ToolPath> &toolPath,
   }
 
   // Simulation
-  project->path = toolPath;
   project->time = view->getTime();
-  project->threads = options["threads"].toInteger();
   project->workpiece = project->getWorkpieceBounds();
 
-  // Load new surface
-  taskMan.addTask(new SurfaceTask(*project));
+  if (project->getResolutionMode() == ResolutionMode::RESOLUTION_BUDGET) {
+    CostModel::Cost cost = project->getPredictedCost();
+    string msg = String::printf("Resolution %.4f predicted to take ",
+                                project->getResolution()) +
+      TimeInterval(cost.time).toString() + " and " +
+      MemoryUsage::format(cost.memory);
+
+    LOG_INFO(1, msg);
+    showMessage(msg);
+  }
+
+  // Load new surface, showing a preview while it is computed unless it was
+  // cached by an earlier run
+  SurfaceTask *task = new SurfaceTask(*project, this, new SurfaceCache);
+  task->getSimRun()->setCutTimes(options["cut-times"].toBoolean());
+  taskMan.addTask(task);
 }
 
 
 void QtWin::toolPathComplete(ToolPathTask &task) {
+  // Edits are only simulated once saved and never uploaded
+  if (&task == editPreview.get()) {
+    editPreview.release();
+    loadToolPath(task.getPath(), false);
+    return;
+  }
+
   if (task.getErrorCount()) {
     const char *msg = "Errors were encountered during tool path generation.  "
       "See the console output for more details";
@@ -628,39 +744,195 @@ void QtWin::toolPathComplete(ToolPathTask &task) {
     showConsole();
   }
 
-  gcode = task.getGCode();
-  if (!bbCtrlAPI.isNull() && bbCtrlAPI->isConnected())
-    bbCtrlAPI->uploadGCode(&gcode->front(), gcode->size());
+  gcode = task.getGCode(); // Shared with the task, not copied
+  if (!bbCtrlAPI.isNull() && bbCtrlAPI->isConnected()) uploadGCode();
 
   loadToolPath(task.getPath(), !task.getErrorCount());
 }
 
 
+string QtWin::getUploadFile() const {
+  if (project.isNull() || project->getFileCount() != 1) return "";
+
+  string path = project->getFile(0)->getAbsolutePath();
+  if (String::endsWith(path, ".tpl") || !SystemUtilities::exists(path))
+    return "";
+
+  return path;
+}
+
+
+void QtWin::uploadGCode() {
+  try {
+    string path = getUploadFile();
+    if (!path.empty()) bbCtrlAPI->uploadFile(path);
+    else if (!gcode.isNull()) bbCtrlAPI->uploadGCode(gcode);
+  } CATCH_ERROR;
+}
+
+
 void QtWin::surfaceComplete(SurfaceTask &task) {
+  clearPreview();
+
   simRun = task.getSimRun();
   surface = task.getSurface();
   if (surface.isNull()) simRun.release();
 
-  view->setSurface(surface);
+  bool withVBOs = Settings().get("Settings/VBO/Surface", true).toBool();
   view->setMoveLookup(simRun->getMoveLookup());
-  view->setFlag(View::SURFACE_VBOS_FLAG,
-                Settings().get("Settings/VBO/Surface", true).toBool());
+  view->setFlag(View::SURFACE_VBOS_FLAG, withVBOs);
+
+  // Height maps record what each move removed, color the path by its rate
+  if (!simRun.isNull() && !simRun->getHeightMap().isNull()) {
+    const vector<HeightMap::Removal> &removal =
+      simRun->getHeightMap()->getRemoval();
+
+    vector<double> rates;
+    for (unsigned i = 0; i < removal.size(); i++)
+      rates.push_back(removal[i].getRate());
+
+    view->path->setRemovalRates(rates);
+  }
+
+  // The preview stays on screen until the surface is uploaded
+  if (surface.isNull()) view->setSurface(0);
+  else uploader.upload(surface, withVBOs);
 
   redraw();
+  updateMemoryUsage();
 
   setStatusActive(false);
 }
 
 
-void QtWin::reduceComplete(ReduceTask &task) {
+void QtWin::updateKeyframes() {
+  keyframes.clear();
+  nextKeyframe = 0;
+  speculation.release(); // Interrupted by the new tool path
+
+  double total = toolPath.isNull() ? 0 : toolPath->getTime();
+  if (!total) return;
+
+  // The first tool changes
+  set<int> positions;
+  for (unsigned i = 1; i < toolPath->size() && positions.size() < 16; i++)
+    if (toolPath->at(i).getTool() != toolPath->at(i - 1).getTool())
+      positions.insert((int)(toolPath->at(i).getStartTime() / total * 10000 +
+                             0.5));
+
+  // And every 1/16th of the way
+  for (int i = 1; i <= 16; i++) positions.insert(i * 625);
+
+  keyframes.assign(positions.begin(), positions.end());
+}
+
+
+bool QtWin::isKeyframe(int position) const {
+  return binary_search(keyframes.begin(), keyframes.end(), position);
+}
+
+
+SmartPointer<Simulation> QtWin::getKeyframeSimulation(int position) const {
+  SmartPointer<Simulation> sim = new Simulation(*project);
+  sim->time = position / 10000.0 * toolPath->getTime();
+  return sim;
+}
+
+
+void QtWin::speculate() {
+  if (!speculation.isNull() && !speculation->shouldQuit()) return; // Running
+  if (nextKeyframe == keyframes.size()) return;
+
+  // Interrupted by anything the user asks for, then tried again when idle
+  int position = keyframes[nextKeyframe];
+  speculation = taskMan.addTask
+    (new KeyframeTask(*getKeyframeSimulation(position), new SurfaceCache),
+     false);
+}
+
+
+void QtWin::keyframeComplete(KeyframeTask &task) {
+  if (!task.isLoadOnly()) {
+    if (speculation.get() == &task) {
+      speculation.release();
+      nextKeyframe++;
+    }
+
+    return;
+  }
+
+  // Show the cached surface if the slider is still there
+  if (task.getSurface().isNull() || toolPath.isNull()) return;
+  int position = ui->positionSlider->value();
+  if (task.getSimulation().time != position / 10000.0 * toolPath->getTime())
+    return;
+
   surface = task.getSurface();
-  view->setSurface(surface);
-  redraw();
+  uploader.upload(surface, view->isFlagSet(View::SURFACE_VBOS_FLAG));
+}
+
+
+SmartPointer<Surface> QtWin::takePreview() {
+  SmartLock lock(&previewLock);
+  SmartPointer<Surface> surface = preview;
+  preview.release();
+  return surface;
+}
+
+
+void QtWin::clearPreview() {
+  SmartLock lock(&previewLock);
+  preview.release();
+}
+
+
+void QtWin::reduceComplete(ReduceTask &task) {
+  // Interrupted reductions leave the surface as it was
+  if (!task.getSurface().isNull()) {
+    surface = task.getSurface();
+    uploader.upload(surface, view->isFlagSet(View::SURFACE_VBOS_FLAG));
+  }
 
+  updateMemoryUsage();
   setStatusActive(false);
 }
 
 
+void QtWin::updateMemoryUsage() {
+  if (!memoryLabel->isVisible()) return;
+
+  MemoryUsage usage;
+  if (!simRun.isNull()) simRun->getMemoryUsage(usage);
+  else if (!toolPath.isNull())
+    usage.add("toolpath", toolPath->getMemoryUsage());
+  if (!surface.isNull()) usage.add("surface", surface->getMemoryUsage());
+
+  string tip;
+  for (MemoryUsage::iterator it = usage.begin(); it != usage.end(); it++)
+    tip += (tip.empty() ? "" : "\n") + it->first + ": " +
+      MemoryUsage::format(it->second);
+
+  string text = "Memory: " + MemoryUsage::format(usage.getTotal());
+  memoryLabel->setText(QString::fromUtf8(text.c_str()));
+  memoryLabel->setToolTip(QString::fromUtf8(tip.c_str()));
+}
+
+
+void QtWin::uploadComplete() {
+  while (true) {
+    SmartPointer<Surface> uploaded = uploader.remove();
+    if (uploaded.isNull()) break;
+
+    // Drop surfaces replaced while they were uploading
+    if (uploaded.get() != surface.get()) continue;
+
+    view->setSurface(surface);
+    colorDeviation();
+    redraw();
+  }
+}
+
+
 void QtWin::optimizeComplete(Opt &opt) {
   loadToolPath(opt.getPath(), true);
 }
@@ -668,6 +940,7 @@ void QtWin::optimizeComplete(Opt &opt) {
 
 void QtWin::quit() {
   stop();
+  exportMan.interrupt();
   app.requestExit();
   taskMan.join();
   QCoreApplication::exit();
@@ -683,6 +956,7 @@ void QtWin::stop() {
 void QtWin::reload(bool now) {
   if (!now) {
     simDirty = true;
+    wakeAnimation();
     return;
   }
 
@@ -693,19 +967,42 @@ void QtWin::reload(bool now) {
   ui->console->setTextColor(QColor("#d9d9d9"));
 
   try {
-    // Queue tool path task
-    taskMan.addTask(new ToolPathTask(*project));
+    // Queue tool path task, it is reused if its inputs have not changed
+    ToolPathTask *task = new ToolPathTask(*project, toolPathCache);
+    task->setInProcessTPL(options["tpl-in-process"].toBoolean());
+    taskMan.addTask(task);
     setStatusActive(true);
   } CATCH_ERROR;
 }
 
 
+void QtWin::editorChanged() {
+  editTimer.start(); // Restarted by each keystroke
+}
+
+
+void QtWin::fileChanged(const QString &path) {
+  watchTimer.start(); // Restarted by each write
+}
+
+
+void QtWin::checkFiles() {
+  if (project.isNull()) return;
+
+  // Saving by replacing a file ends its watch
+  watchFiles();
+
+  if (project->checkFiles()) reload();
+}
+
+
 void QtWin::reduce() {
   if (surface.isNull()) return;
 
   try {
     // Queue reduce task
-    taskMan.addTask(new ReduceTask(*surface));
+    unsigned threads = options["threads"].toInteger();
+    taskMan.addTask(new ReduceTask(surface, threads));
     setStatusActive(true);
   } CATCH_ERROR;
 }
@@ -734,6 +1031,13 @@ void QtWin::redraw(bool now) {
   }
 
   dirty = true;
+  wakeAnimation();
+}
+
+
+void QtWin::wakeAnimation() {
+  if (animationTimer.interval() != ANIMATION_ACTIVE_PERIOD)
+    animationTimer.start(ANIMATION_ACTIVE_PERIOD);
 }
 
 
@@ -803,6 +1107,23 @@ void QtWin::disconnectCNC() {
 
 
 void QtWin::exportData() {
+  // Offer to cancel a running export instead of starting another
+  if (!exporting.isNull()) {
+    int response =
+      QMessageBox::question(this, "Cancel export?", "An export is still "
+                            "running.  Would you like to cancel it?",
+                            QMessageBox::Yes | QMessageBox::No,
+                            QMessageBox::No);
+
+    if (response == QMessageBox::Yes) {
+      exportMan.interrupt();
+      exporting.release();
+      showMessage("Export canceled");
+    }
+
+    return;
+  }
+
   // Check what we have to export
   if (surface.isNull() && gcode.isNull() && project.isNull()) {
     warning("Nothing to export.\nRun a simulation first.");
@@ -820,21 +1141,47 @@ void QtWin::exportData() {
   string title = "Export ";
   string fileTypes;
   string ext;
+  ExportTask::format_t format;
 
   if (exportDialog.surfaceSelected()) {
     title += "Surface";
-    fileTypes = "STL Files (*.stl)";
-    ext = "stl";
+
+    if (exportDialog.gltfSelected()) {
+      fileTypes = "glTF Files (*.glb)";
+      ext = "glb";
+      format = ExportTask::GLTF;
+
+    } else {
+      fileTypes = "STL Files (*.stl)";
+      ext = "stl";
+      format = exportDialog.binarySTLSelected() ?
+        ExportTask::STL_BINARY : ExportTask::STL_ASCII;
+    }
 
   } else if (exportDialog.gcodeSelected()) {
     title += "GCode";
     fileTypes = "GCode Files (*.gcode *.nc *.ngc *.tap)";
     ext = "gcode";
+    format = ExportTask::GCODE;
+
+  } else if (exportDialog.csvSelected()) {
+    title += "Tool Path";
+    fileTypes = "CSV Files (*.csv)";
+    ext = "csv";
+    format = ExportTask::PATH_CSV;
+
+  } else if (exportDialog.binaryPathSelected()) {
+    title += "Tool Path";
+    fileTypes = "CAMotics Tool Paths (*.tpc)";
+    ext = "tpc";
+    format = ExportTask::PATH_BINARY;
 
   } else {
     title += "Simulation Data";
     fileTypes = "JSON Files (*.json)";
     ext = "json";
+    format = exportDialog.compactJSONSelected() ?
+      ExportTask::JSON_COMPACT : ExportTask::JSON_PRETTY;
   }
 
   fileTypes += ";;All Files (*.*)";
@@ -842,24 +1189,28 @@ void QtWin::exportData() {
   // Open output file
   string filename = SystemUtilities::swapExtension(project->getFilename(), ext);
   filename = openFile(title, fileTypes, filename, true);
-
   if (filename.empty()) return;
-  SmartPointer<iostream> stream = SystemUtilities::open(filename, ios::out);
 
-  // Export
-  if (exportDialog.surfaceSelected()) {
-    string hash = project.isNull() ? "" : project->computeHash();
-    bool binary = exportDialog.binarySTLSelected();
-    surface->writeSTL(*stream, binary, "CAMotics Surface", hash);
+  // Export in the background, sharing the current results
+  ExportTask *task = new ExportTask(filename, format);
 
-  } else if (exportDialog.gcodeSelected()) {
-    stream->write(&gcode->front(), gcode->size());
+  if (exportDialog.surfaceSelected())
+    task->setSurface(surface, project.isNull() ? "" : project->computeHash());
+  else if (exportDialog.gcodeSelected()) task->setGCode(gcode);
+  else task->setSimulation(*project);
 
-  } else {
-    JSON::Writer writer(*stream, 0, exportDialog.compactJSONSelected());
-    project->write(writer, true);
-    writer.close();
-  }
+  exporting = exportMan.addTask(task, false);
+  showMessage("Exporting " + filename);
+  wakeAnimation();
+}
+
+
+void QtWin::exportComplete(ExportTask &task) {
+  exporting.release();
+
+  if (task.getError().empty()) showMessage("Exported " + task.getFilename());
+  else warning("Export to '" + task.getFilename() + "' failed.\n" +
+               task.getError());
 }
 
 
@@ -1141,6 +1492,25 @@ void QtWin::updateFiles() {
                 (project->getFile(i)->getRelativePath().c_str()));
 
   ui->filesListView->setModel(new QStringListModel(list));
+
+  watchFiles();
+}
+
+
+void QtWin::watchFiles() {
+  QStringList watched = fileWatcher.files();
+  if (!watched.isEmpty()) fileWatcher.removePaths(watched);
+
+  if (project.isNull() || !project->getWatch()) return;
+
+  QStringList paths;
+  for (unsigned i = 0; i < project->getFileCount(); i++) {
+    const string &path = project->getFile(i)->getAbsolutePath();
+    if (SystemUtilities::exists(path))
+      paths.append(QString::fromUtf8(path.c_str()));
+  }
+
+  if (!paths.isEmpty()) fileWatcher.addPaths(paths);
 }
 
 
@@ -1259,6 +1629,7 @@ void QtWin::updateActions() {
 void QtWin::updateUnits() {
   loadWorkpiece();
   updateBounds();
+  valueSet.invalidate(); // Labels include units
   valueSet.updated();
 }
 
@@ -1349,6 +1720,52 @@ void QtWin::exportToolTable() {
 }
 
 
+void QtWin::compareToDesign() {
+  string filename =
+    openFile("Compare to design", "STL files (*.stl)", "", false);
+
+  // Cancelling clears the comparison
+  if (filename.empty()) design.release();
+  else
+    try {
+      design = Deviation::read(filename);
+    } CATCH_ERROR;
+
+  colorDeviation();
+  redraw();
+}
+
+
+void QtWin::colorDeviation() {
+  TriangleSurface *mesh = dynamic_cast<TriangleSurface *>(surface.get());
+  if (!mesh) return;
+
+  if (design.isNull()) {
+    mesh->setColors(vector<uint8_t>());
+    return;
+  }
+
+  try {
+    unsigned threads = options["threads"].toInteger();
+    vector<float> distances;
+    design->compute(mesh->getVertices(), distances, threads);
+    if (distances.empty()) return;
+
+    // Deviations within the simulation resolution are expected
+    double tolerance = project.isNull() ? 0 : project->getResolution();
+    vector<uint8_t> colors;
+    Deviation::colorMap(distances, tolerance, colors);
+    mesh->setColors(colors);
+
+    float gouge = *min_element(distances.begin(), distances.end());
+    float excess = *max_element(distances.begin(), distances.end());
+    showMessage(String::printf("Deviation from design: gouge %.3f, "
+                               "excess %.3f", -std::min(0.0f, gouge),
+                               std::max(0.0f, excess)));
+  } CATCH_ERROR;
+}
+
+
 void QtWin::importToolTable() {
   if (project.isNull()) return;
 
@@ -1517,6 +1934,8 @@ void QtWin::setStatusActive(bool active) {
   lastStatusActive = active;
 
   if (active) {
+    wakeAnimation();
+
     statusLabel->clear();
     QMovie *movie = new QMovie(":/icons/running.gif");
     statusLabel->setMovie(movie);
@@ -1557,6 +1976,8 @@ void QtWin::updatePlaySpeed(const string &name, unsigned value) {
 void QtWin::updateViewFlags(const std::string &name, unsigned flags) {
   ui->actionPlay->setIcon(flags & View::PLAY_FLAG ? pauseIcon : playIcon);
   ui->actionPlay->setText(flags & View::PLAY_FLAG ? "Pause" : "Play");
+  if (flags & View::PLAY_FLAG) wakeAnimation();
+  if (flags & View::SHOW_MACHINE_FLAG) updateMachine();
 }
 
 
@@ -1664,16 +2085,38 @@ void QtWin::taskCompleted() {
 }
 
 
+void QtWin::surfacePreview(const SmartPointer<Surface> &surface) {
+  SmartLock lock(&previewLock);
+  preview = surface;
+}
+
+
 bool QtWin::event(QEvent *event) {
+  if (event->type() == uploader.getEventType()) {
+    uploadComplete();
+    return true;
+  }
+
   if (event->type() != taskCompleteEvent) return QMainWindow::event(event);
 
+  while (exportMan.hasMore()) {
+    SmartPointer<Task> task = exportMan.remove();
+    exportComplete(*task.cast<ExportTask>());
+  }
+
   while (taskMan.hasMore()) {
     SmartPointer<Task> task = taskMan.remove();
 
+    // Tasks run concurrently so an interrupted task can finish after the
+    // one which replaced it and must not overwrite its result
+    if (task->shouldQuit()) continue;
+
     if (task.isInstance<ToolPathTask>())
       toolPathComplete(*task.cast<ToolPathTask>());
     else if (task.isInstance<SurfaceTask>())
       surfaceComplete(*task.cast<SurfaceTask>());
+    else if (task.isInstance<KeyframeTask>())
+      keyframeComplete(*task.cast<KeyframeTask>());
     else if (task.isInstance<ReduceTask>())
       reduceComplete(*task.cast<ReduceTask>());
     else if (task.isInstance<Opt>())
@@ -1701,25 +2144,58 @@ void QtWin::resizeEvent(QResizeEvent *event) {
 void QtWin::animate() {
   try {
     dirty = view->update() || dirty;
+    valueSet.flush();
 
     // Auto close after auto play
     if (!autoPlay && autoClose && !view->isFlagSet(View::PLAY_FLAG))
       app.requestExit();
 
+    // Show the latest preview of the surface being computed
+    SmartPointer<Surface> latest = takePreview();
+    if (!latest.isNull()) {
+      view->setSurface(latest);
+      dirty = true;
+    }
+
     if (dirty) redraw(true);
     if (simDirty) reload(true);
 
+    // Follow the machine, only ever cutting further.  The run only renders
+    // the moves made since its last surface and the latest position is
+    // taken once the previous update completes.
+    if (liveSim && !simRun.isNull() && view->path->isByRemote() &&
+        !bbCtrlAPI.isNull() && bbCtrlAPI->isConnected()) {
+      double time = view->path->getTime();
+
+      if (liveTime < time) {
+        liveTime = time;
+        simRun->setEndTime(time);
+        positionChanged = true;
+      }
+    }
+
     if (positionChanged && !lastStatusActive &&
         view->isFlagSet(View::SHOW_SURFACE_FLAG)) {
       positionChanged = false;
       setStatusActive(true);
       taskMan.addTask(new SurfaceTask(simRun));
-    }
+
+      // Show a keyframe simulated ahead of time while that catches up
+      int position = ui->positionSlider->value();
+      if (isKeyframe(position))
+        taskMan.addTask(new KeyframeTask(*getKeyframeSimulation(position),
+                                         new SurfaceCache, true), false);
+
+    } else if (!lastStatusActive && !positionChanged && !simRun.isNull() &&
+               !view->isFlagSet(View::PLAY_FLAG) &&
+               view->isFlagSet(View::SHOW_SURFACE_FLAG))
+      speculate(); // Use idle cores
 
     // Update progress
     if (!view->isFlagSet(View::PLAY_FLAG)) {
-      double progress = taskMan.getProgress();
-      string status = taskMan.getStatus();
+      // Keyframes simulated in the background are not shown
+      double progress = lastStatusActive ? taskMan.getProgress() : 0;
+      string status = lastStatusActive ? taskMan.getStatus() : "";
       if (lastProgress != progress || lastStatus != status) {
         lastProgress = progress;
         lastStatus = status;
@@ -1740,6 +2216,14 @@ void QtWin::animate() {
       }
     }
 
+    // Export progress
+    if (!exporting.isNull()) {
+      string status = exporting->getStatus();
+      double progress = exporting->getProgress();
+      if (progress) status += String::printf(" %.0f%%", progress * 100);
+      showMessage(status);
+    }
+
     // Copy log
     ui->console->writeToConsole();
 
@@ -1752,6 +2236,47 @@ void QtWin::animate() {
     checkSave(false);
     quit();
   }
+
+  // Only poll for the log and quit requests while nothing is changing.
+  // redraw(), reload() and play wake the timer up again.
+  bool active = dirty || simDirty || positionChanged || lastStatusActive ||
+    valueSet.isDirty() || view->isFlagSet(View::PLAY_FLAG) || autoClose ||
+    !exporting.isNull();
+  int period = active ? ANIMATION_ACTIVE_PERIOD : ANIMATION_IDLE_PERIOD;
+  if (animationTimer.interval() != period) animationTimer.start(period);
+}
+
+
+void QtWin::previewEdits() {
+  if (project.isNull()) return;
+
+  FileTabManager &tabs = *ui->fileTabManager;
+  map<string, SmartPointer<vector<char> > > edits;
+
+  for (int tab = 0; tab < tabs.count(); tab++) {
+    if (!tabs.isFileTab(tab) || !tabs.isModified(tab)) continue;
+
+    // TPL programs are run by tplang, which reads the saved file
+    string path = tabs.getFile(tab)->getAbsolutePath();
+    if (String::endsWith(path, ".tpl")) continue;
+
+    QByteArray data = tabs.getEditor(tab)->toPlainText().toUtf8();
+    edits[path] = new vector<char>(data.begin(), data.end());
+  }
+
+  if (edits.empty()) return;
+
+  try {
+    ToolPathTask *task = new ToolPathTask(*project, toolPathCache);
+
+    map<string, SmartPointer<vector<char> > >::iterator it;
+    for (it = edits.begin(); it != edits.end(); it++)
+      task->setContents(it->first, it->second);
+
+    // Interrupts the last preview, which is then never loaded
+    editPreview = taskMan.addTask(task);
+    setStatusActive(true);
+  } CATCH_ERROR;
 }
 
 
@@ -1760,9 +2285,7 @@ void QtWin::openRecentProjectsSlot(const QString path) {
 }
 
 
-void QtWin::on_bbctrlConnected() {
-  if (!gcode.isNull()) bbCtrlAPI->uploadGCode(&gcode->front(), gcode->size());
-}
+void QtWin::on_bbctrlConnected() {uploadGCode();}
 
 
 void QtWin::on_machineChanged(QString machine, QString path) {
@@ -1800,7 +2323,14 @@ void QtWin::on_positionSlider_sliderPressed() {
 void QtWin::on_positionSlider_sliderReleased() {
   sliderMoving = false;
   view->clearFlag(View::TRANSLUCENT_SURFACE_FLAG);
-  on_positionSlider_valueChanged(ui->positionSlider->value());
+
+  // Snap to a keyframe within 1% so its surface shows right away
+  int position = ui->positionSlider->value();
+  vector<int>::const_iterator it =
+    lower_bound(keyframes.begin(), keyframes.end(), position - 100);
+  if (it != keyframes.end() && *it <= position + 100 && *it != position)
+    ui->positionSlider->setValue(*it); // Signals valueChanged()
+  else on_positionSlider_valueChanged(position);
 }
 
 
@@ -2117,6 +2647,12 @@ void QtWin::on_actionToolPath_triggered(bool checked) {
 }
 
 
+void QtWin::on_actionHideRapids_triggered(bool checked) {
+  view->path->setShowMoveType(GCode::MoveType::MOVE_RAPID, !checked);
+  redraw();
+}
+
+
 void QtWin::on_actionAddFile_triggered() {
   if (newDialog.exec() != QDialog::Accepted) return;
   newFile(newDialog.tplSelected());
@@ -2170,6 +2706,19 @@ void QtWin::on_actionShowConsole_triggered() {
 }
 
 
+void QtWin::on_actionMemoryUsage_triggered(bool checked) {
+  memoryLabel->setVisible(checked);
+  updateMemoryUsage();
+}
+
+
+void QtWin::on_actionLiveSimulation_triggered(bool checked) {
+  liveSim = checked;
+  liveTime = -1;
+  redraw();
+}
+
+
 void QtWin::on_hideConsolePushButton_clicked() {
   on_actionHideConsole_triggered();
 }
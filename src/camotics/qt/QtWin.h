@@ -33,14 +33,17 @@
 #include "CAMDialog.h"
 #include "ConnectDialog.h"
 #include "BBCtrlAPI.h"
+#include "SurfaceUploader.h"
 
 #include <camotics/ConcurrentTaskManager.h>
+#include <camotics/sim/SurfaceObserver.h>
 #include <camotics/view/View.h>
 #include <camotics/view/Tool2DView.h>
 #include <camotics/value/ValueSet.h>
 
 #include <cbang/SmartPointer.h>
 #include <cbang/Application.h>
+#include <cbang/os/Mutex.h>
 #ifndef Q_MOC_RUN
 #include <cbang/iostream/LineBufferDevice.h>
 #endif
@@ -62,12 +65,17 @@ namespace CAMotics {
   class CutWorkpiece;
   class ConsoleWriter;
   class ToolPathTask;
+  class ToolPathCache;
   class SurfaceTask;
+  class KeyframeTask;
   class ReduceTask;
   class Opt;
+  class ExportTask;
+  class Deviation;
 
 
-  class QtWin : public QMainWindow, public TaskObserver {
+  class QtWin :
+    public QMainWindow, public TaskObserver, public SurfaceObserver {
     Q_OBJECT;
 
     cb::SmartPointer<Ui::CAMoticsWindow> ui;
@@ -84,9 +92,14 @@ namespace CAMotics {
     ConnectDialog connectDialog;
     FileDialog fileDialog;
     QTimer animationTimer;
+    QTimer editTimer;
+    QFileSystemWatcher fileWatcher;
+    QTimer watchTimer;
     QByteArray fullLayoutState;
     ConcurrentTaskManager taskMan;
+    ConcurrentTaskManager exportMan; ///< Not interrupted by simulations
     int taskCompleteEvent;
+    SurfaceUploader uploader;
 
     QIcon playIcon;
     QIcon pauseIcon;
@@ -94,6 +107,7 @@ namespace CAMotics {
     QIcon backwardIcon;
 
     QLabel *statusLabel;
+    QLabel *memoryLabel;
 
     cb::Application &app;
     cb::Options &options;
@@ -104,8 +118,12 @@ namespace CAMotics {
     cb::SmartPointer<View> view;
     cb::SmartPointer<Viewer> viewer;
     cb::SmartPointer<GCode::ToolPath> toolPath;
+    cb::SmartPointer<ToolPathCache> toolPathCache;
     cb::SmartPointer<std::vector<char> > gcode;
     cb::SmartPointer<Surface> surface;
+    cb::SmartPointer<Deviation> design;
+    cb::SmartPointer<Surface> preview;
+    cb::Mutex previewLock;
 
     QSignalMapper recentProjectsMapper;
     cb::SmartPointer<BBCtrlAPI> bbCtrlAPI;
@@ -120,9 +138,25 @@ namespace CAMotics {
     bool autoPlay;
     bool autoClose;
     std::string defaultExample;
+    std::string machineName; ///< Parsed once the machine is first shown
     bool sliderMoving;
     bool positionChanged;
 
+    // Cut the surface as a connected machine runs the program
+    bool liveSim;
+    double liveTime; ///< Last simulated machine time, negative if none
+
+    // Slider positions simulated ahead of time while idle
+    std::vector<int> keyframes;
+    unsigned nextKeyframe;
+    cb::SmartPointer<Task> speculation;
+
+    // Tool path of the unsaved edits, replaced by the next keystroke
+    cb::SmartPointer<Task> editPreview;
+
+    // Only one export runs at a time
+    cb::SmartPointer<Task> exporting;
+
     cb::SmartPointer<cb::LineBufferStream<ConsoleWriter> > consoleStream;
 
   public:
@@ -140,6 +174,7 @@ namespace CAMotics {
                       bool withUnit = false);
 
     void loadMachine(const std::string &machine);
+    void updateMachine();
     void loadMachines();
     void loadDefaultExample();
     void loadExamples();
@@ -157,6 +192,7 @@ namespace CAMotics {
 
     void glViewMousePressEvent(QMouseEvent *event);
     void glViewMouseMoveEvent(QMouseEvent *event);
+    void glViewMouseDoubleClickEvent(QMouseEvent *event);
     void glViewWheelEvent(QWheelEvent *event);
 
     void initializeGL();
@@ -171,20 +207,35 @@ namespace CAMotics {
                       bool simulate);
 
     void toolPathComplete(ToolPathTask &task);
+    /// @return the single GCode file to stream to the CNC, if any.
+    std::string getUploadFile() const;
+    void uploadGCode();
     void surfaceComplete(SurfaceTask &task);
+    void updateKeyframes();
+    bool isKeyframe(int position) const;
+    cb::SmartPointer<Simulation> getKeyframeSimulation(int position) const;
+    void speculate();
+    void keyframeComplete(KeyframeTask &task);
+    cb::SmartPointer<Surface> takePreview();
+    void clearPreview();
     void reduceComplete(ReduceTask &task);
+    void updateMemoryUsage();
+    void uploadComplete();
     void optimizeComplete(Opt &task);
 
     void quit();
     void stop();
     void reload(bool now = false);
+    void editorChanged();
     void reduce();
     void optimize();
     void redraw(bool now = false);
+    void wakeAnimation();
     void snapshot();
     void connectCNC();
     void disconnectCNC();
     void exportData();
+    void exportComplete(ExportTask &task);
 
     bool runNewProjectDialog();
     GCode::ToolTable getNewToolTable();
@@ -207,6 +258,7 @@ namespace CAMotics {
     GCode::ToolUnits getDefaultUnits() const;
 
     void updateFiles();
+    void watchFiles();
     void newFile(bool tpl);
     void addFile();
     void editFile(unsigned index);
@@ -224,6 +276,8 @@ namespace CAMotics {
     void removeTool(unsigned number);
     void exportToolTable();
     void importToolTable();
+    void compareToDesign();
+    void colorDeviation();
     void saveDefaultToolTable(const GCode::ToolTable &tools);
     GCode::ToolTable loadDefaultToolTable();
 
@@ -271,13 +325,20 @@ namespace CAMotics {
     // From TaskObserver
     void taskCompleted();
 
+    // From SurfaceObserver
+    void surfacePreview(const cb::SmartPointer<Surface> &surface);
+
     // From QMainWindow
     bool event(QEvent *event);
     void closeEvent(QCloseEvent *event);
     void resizeEvent(QResizeEvent *event);
 
   protected slots:
+    void loadData();
     void animate();
+    void previewEdits();
+    void fileChanged(const QString &path);
+    void checkFiles();
     void openRecentProjectsSlot(const QString path);
 
     void on_bbctrlConnected();
@@ -325,6 +386,7 @@ namespace CAMotics {
 
     void on_actionExportToolTable_triggered() {exportToolTable();}
     void on_actionImportToolTable_triggered() {importToolTable();}
+    void on_actionCompareDesign_triggered() {compareToDesign();}
     void on_actionSaveDefaultToolTable_triggered();
     void on_actionLoadDefaultToolTable_triggered();
 
@@ -359,6 +421,7 @@ namespace CAMotics {
     void on_actionWorkpieceBounds_triggered(bool checked);
     void on_actionAxes_triggered(bool checked);
     void on_actionToolPath_triggered(bool checked);
+    void on_actionHideRapids_triggered(bool checked);
 
     void on_actionAddFile_triggered();
     void on_actionReloadFile_triggered();
@@ -370,6 +433,8 @@ namespace CAMotics {
 
     void on_actionHideConsole_triggered();
     void on_actionShowConsole_triggered();
+    void on_actionMemoryUsage_triggered(bool checked);
+    void on_actionLiveSimulation_triggered(bool checked);
 
     void on_hideConsolePushButton_clicked();
     void on_clearConsolePushButton_clicked();
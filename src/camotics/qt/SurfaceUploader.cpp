@@ -0,0 +1,153 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "SurfaceUploader.h"
+
+#include <camotics/contour/Surface.h>
+#include <camotics/view/GL.h>
+
+#include <cbang/util/SmartLock.h>
+#include <cbang/util/SmartUnlock.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/log/Logger.h>
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+SurfaceUploader::SurfaceUploader(QObject *receiver) :
+  receiver(receiver), eventType(QEvent::registerEventType()), context(0),
+  offscreen(0), quit(false) {}
+
+
+SurfaceUploader::~SurfaceUploader() {
+  if (context) {
+    {
+      SmartLock lock(&condition);
+      quit = true;
+      condition.signal();
+    }
+
+    QThread::wait();
+
+    delete context;
+    delete offscreen;
+  }
+}
+
+
+void SurfaceUploader::init(QOpenGLContext *share) {
+  if (context || !share) return;
+
+  offscreen = new QOffscreenSurface;
+  offscreen->setFormat(share->format());
+  offscreen->create();
+
+  context = new QOpenGLContext;
+  context->setFormat(share->format());
+  context->setShareContext(share);
+
+  if (!offscreen->isValid() || !context->create() ||
+      !context->shareContext()) {
+    LOG_WARNING("Could not create a shared OpenGL context, uploading "
+                "surfaces while drawing");
+
+    delete context;
+    delete offscreen;
+    context = 0;
+    offscreen = 0;
+    return;
+  }
+
+  context->moveToThread(this);
+  start();
+}
+
+
+void SurfaceUploader::upload(const SmartPointer<Surface> &surface,
+                             bool withVBOs) {
+  SmartLock lock(&condition);
+
+  if (!context) complete(surface);
+
+  else {
+    Job job = {surface, withVBOs};
+    waiting.push_back(job);
+    condition.signal();
+  }
+}
+
+
+SmartPointer<Surface> SurfaceUploader::remove() {
+  SmartLock lock(&condition);
+
+  if (done.empty()) return 0;
+  SmartPointer<Surface> surface = done.front();
+  done.pop_front();
+
+  return surface;
+}
+
+
+void SurfaceUploader::complete(const SmartPointer<Surface> &surface) {
+  done.push_back(surface);
+  QCoreApplication::postEvent(receiver, new QEvent((QEvent::Type)eventType));
+}
+
+
+void SurfaceUploader::run() {
+  SmartLock lock(&condition);
+
+  bool current = context->makeCurrent(offscreen);
+  if (!current) LOG_WARNING("Could not use the shared OpenGL context");
+
+  while (!quit) {
+    if (waiting.empty()) {
+      condition.wait();
+      continue;
+    }
+
+    Job job = waiting.front();
+    waiting.pop_front();
+
+    if (current && !job.surface->sharesBuffers()) {
+      SmartUnlock unlock(&condition);
+
+      try {
+        job.surface->finalize(job.withVBOs);
+        getGLFuncs().glFinish(); // Complete before it is drawn elsewhere
+      } CATCH_ERROR;
+    }
+
+    complete(job.surface);
+  }
+
+  // Free buffers while the context is current
+  waiting.clear();
+  done.clear();
+
+  if (current) context->doneCurrent();
+  context->moveToThread(QCoreApplication::instance()->thread());
+}
@@ -0,0 +1,79 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+#include <cbang/SmartPointer.h>
+#include <cbang/os/Condition.h>
+
+#include <QThread>
+
+#include <list>
+
+class QOpenGLContext;
+class QOffscreenSurface;
+
+
+namespace CAMotics {
+  class Surface;
+
+  /// Uploads surfaces to VBOs in a GL context shared with the view, so the
+  /// one being drawn can stay on screen until its replacement is ready.
+  /// Surfaces which take over the buffers of another are passed through
+  /// untouched, in order, and finalized when they are first drawn.
+  class SurfaceUploader : public QThread {
+    QObject *receiver;
+    int eventType;
+
+    QOpenGLContext *context;
+    QOffscreenSurface *offscreen;
+
+    struct Job {
+      cb::SmartPointer<Surface> surface;
+      bool withVBOs;
+    };
+
+    cb::Condition condition;
+    bool quit;
+    std::list<Job> waiting;
+    std::list<cb::SmartPointer<Surface> > done;
+
+  public:
+    /// Posts an event of getEventType() to @param receiver as surfaces
+    /// complete.
+    SurfaceUploader(QObject *receiver);
+    ~SurfaceUploader();
+
+    int getEventType() const {return eventType;}
+
+    /// Start uploading in a context shared with @param share.  Must be
+    /// called from the GUI thread.  Until then surfaces are passed through.
+    void init(QOpenGLContext *share);
+
+    void upload(const cb::SmartPointer<Surface> &surface, bool withVBOs);
+    /// @return the next completed surface or null if there are none.
+    cb::SmartPointer<Surface> remove();
+
+  protected:
+    void complete(const cb::SmartPointer<Surface> &surface);
+
+    // From QThread
+    void run();
+  };
+}
@@ -70,6 +70,11 @@ void ToolDialog::update() {
   ui->snubDiameterDoubleSpinBox->setVisible(shape == GCode::ToolShape::TS_SNUBNOSE);
   ui->snubDiameterLabel->setVisible(shape == GCode::ToolShape::TS_SNUBNOSE);
 
+  // A profile sets its own size
+  bool profile = shape == GCode::ToolShape::TS_PROFILE;
+  ui->lengthDoubleSpinBox->setEnabled(!profile);
+  ui->diameterDoubleSpinBox->setEnabled(!profile);
+
 #define UPDATE(UI, GET, SET, VALUE)                 \
   if (ui->UI->GET() != (VALUE)) ui->UI->SET(VALUE);
 
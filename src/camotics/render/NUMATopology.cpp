@@ -0,0 +1,129 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "NUMATopology.h"
+
+#include <cbang/String.h>
+#include <cbang/log/Logger.h>
+
+#include <fstream>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  bool readLine(const string &path, string &line) {
+    ifstream in(path.c_str());
+    return in && getline(in, line);
+  }
+}
+
+
+NUMATopology::NUMATopology() {
+#ifdef __linux__
+  string line;
+  if (!readLine("/sys/devices/system/node/online", line)) return;
+
+  vector<unsigned> ids;
+  parseList(line, ids);
+
+  // Only the CPUs this process is allowed, such as by taskset or a cgroup
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed)) return;
+
+  for (unsigned i = 0; i < ids.size(); i++) {
+    string path = String::printf("/sys/devices/system/node/node%u/cpulist",
+                                 ids[i]);
+    if (!readLine(path, line)) continue;
+
+    vector<unsigned> cpus;
+    vector<unsigned> all;
+    parseList(line, all);
+
+    for (unsigned j = 0; j < all.size(); j++)
+      if (all[j] < CPU_SETSIZE && CPU_ISSET(all[j], &allowed))
+        cpus.push_back(all[j]);
+
+    // Nodes with only memory have no CPUs
+    if (!cpus.empty()) nodes.push_back(cpus);
+  }
+
+  LOG_DEBUG(1, "NUMA nodes with usable CPUs: " << nodes.size());
+#endif
+}
+
+
+bool NUMATopology::pin(unsigned node) const {
+#ifdef __linux__
+  if (nodes.size() <= node) return false;
+
+  // Keep to the CPUs the thread already may use, if any are on the node
+  cpu_set_t current;
+  CPU_ZERO(&current);
+  pthread_getaffinity_np(pthread_self(), sizeof(current), &current);
+
+  const vector<unsigned> &cpus = nodes[node];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned i = 0; i < cpus.size(); i++)
+    if (CPU_ISSET(cpus[i], &current)) CPU_SET(cpus[i], &set);
+
+  if (!CPU_COUNT(&set))
+    for (unsigned i = 0; i < cpus.size(); i++) CPU_SET(cpus[i], &set);
+
+  return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+#else
+  return false;
+#endif
+}
+
+
+void NUMATopology::parseList(const string &s, vector<unsigned> &list) {
+  const char *p = s.c_str();
+
+  while (*p) {
+    char *end;
+    unsigned long first = strtoul(p, &end, 10);
+    if (end == p) break;
+    p = end;
+
+    unsigned long last = first;
+    if (*p == '-') {
+      last = strtoul(p + 1, &end, 10);
+      if (end == p + 1) break;
+      p = end;
+    }
+
+    for (unsigned long i = first; i <= last; i++) list.push_back(i);
+
+    if (*p != ',') break;
+    p++;
+  }
+}
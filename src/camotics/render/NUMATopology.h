@@ -0,0 +1,53 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <string>
+#include <vector>
+
+
+namespace CAMotics {
+  /***
+   * The CPUs of each NUMA node this process may run on.  Read from sysfs
+   * on Linux.  Elsewhere, or when it cannot be read, there is one node
+   * and threads cannot be pinned.
+   */
+  class NUMATopology {
+    std::vector<std::vector<unsigned> > nodes;
+
+  public:
+    NUMATopology();
+
+    unsigned getNodeCount() const {return nodes.size();}
+    const std::vector<unsigned> &getCPUs(unsigned node) const
+    {return nodes.at(node);}
+
+    /// Restrict the calling thread to the CPUs of @param node, of those it
+    /// may already use if any.  Memory it then touches first is allocated
+    /// on that node.
+    /// @return false if threads cannot be pinned.
+    bool pin(unsigned node) const;
+
+    /// Parse a sysfs CPU or node list such as "0-3,8-11".
+    static void parseList(const std::string &s, std::vector<unsigned> &list);
+  };
+}
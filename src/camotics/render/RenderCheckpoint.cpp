@@ -0,0 +1,222 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "RenderCheckpoint.h"
+
+#include <camotics/Grid.h>
+#include <camotics/contour/GridTreeRef.h>
+
+#include <cbang/Exception.h>
+#include <cbang/log/Logger.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  const char magic[4] = {'C', 'C', 'K', 'P'};
+  const uint32_t version = 1;
+
+  // Larger records are assumed to be corrupt
+  const uint64_t maxRecordSize = (uint64_t)1 << 36;
+
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+  };
+
+
+  struct Record {
+    uint32_t cell[3];
+    uint32_t steps[3];
+    uint64_t size; // Packed grid which follows
+  };
+
+
+  void writeHeader(ostream &stream) {
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    stream.write((const char *)&header, sizeof(header));
+  }
+
+
+  void writeRecord(ostream &stream, const uint32_t cell[3],
+                   const uint32_t steps[3], const vector<char> &data) {
+    Record record;
+    memcpy(record.cell, cell, sizeof(record.cell));
+    memcpy(record.steps, steps, sizeof(record.steps));
+    record.size = data.size();
+
+    stream.write((const char *)&record, sizeof(record));
+    stream.write(data.data(), data.size());
+  }
+}
+
+
+RenderCheckpoint::Key::Key(const Grid &root, const Grid &grid) {
+  Vector3D offset =
+    (grid.getOffset() - root.getOffset()) / root.getResolution();
+
+  for (unsigned i = 0; i < 3; i++) {
+    cell[i] = (uint32_t)round(offset[i]);
+    steps[i] = grid.getSteps()[i];
+  }
+}
+
+
+bool RenderCheckpoint::Key::operator<(const Key &o) const {
+  for (unsigned i = 0; i < 3; i++) {
+    if (cell[i] != o.cell[i]) return cell[i] < o.cell[i];
+    if (steps[i] != o.steps[i]) return steps[i] < o.steps[i];
+  }
+
+  return false;
+}
+
+
+RenderCheckpoint::RenderCheckpoint(const string &filename) :
+  filename(filename) {
+  try {
+    // Later records must not be appended to a partly written one
+    if (!load()) write();
+  } catch (const Exception &e) {
+    LOG_WARNING("Ignoring render checkpoint '" << filename << "': "
+                << e.getMessage());
+    records.clear();
+
+    try {remove();} CATCH_ERROR; // Start over
+  }
+
+  if (!records.empty())
+    LOG_INFO(1, "Resuming " << records.size() << " grids from " << filename);
+}
+
+
+bool RenderCheckpoint::restore(const Grid &root, GridTreeRef &grid) {
+  records_t::iterator it = records.find(Key(root, grid));
+  if (it == records.end()) return false;
+
+  try {
+    const vector<char> &data = it->second;
+    grid.unpack(data.data(), data.size());
+    records.erase(it);
+    return true;
+
+  } catch (const Exception &e) {
+    LOG_WARNING("Rendering damaged checkpoint grid again: " << e.getMessage());
+    grid.clear();
+  }
+
+  records.erase(it);
+  return false;
+}
+
+
+void RenderCheckpoint::save(const Grid &root, const GridTreeRef &grid) {
+  try {
+    if (stream.isNull()) {
+      SystemUtilities::ensureDirectory(SystemUtilities::dirname(filename));
+      bool exists = SystemUtilities::exists(filename);
+
+      stream = SystemUtilities::open(filename, ios::out | ios::app |
+                                     ios::binary);
+
+      if (!exists) writeHeader(*stream);
+    }
+
+    vector<char> data;
+    grid.pack(data);
+
+    Key key(root, grid);
+    writeRecord(*stream, key.cell, key.steps, data);
+    stream->flush();
+    if (stream->fail()) THROWS("Failed to write '" << filename << "'");
+
+  } catch (const Exception &e) {
+    LOG_WARNING("Failed to checkpoint grid: " << e.getMessage());
+  }
+}
+
+
+void RenderCheckpoint::remove() {
+  stream.release();
+  records.clear();
+
+  if (SystemUtilities::exists(filename)) SystemUtilities::unlink(filename);
+}
+
+
+bool RenderCheckpoint::load() {
+  if (!SystemUtilities::exists(filename)) return true;
+
+  SmartPointer<istream> in = SystemUtilities::iopen(filename);
+
+  Header header;
+  in->read((char *)&header, sizeof(header));
+  if (in->gcount() != sizeof(header) ||
+      memcmp(header.magic, magic, sizeof(magic)) || header.version != version)
+    THROW("Not a render checkpoint file");
+
+  while (true) {
+    Record record;
+    in->read((char *)&record, sizeof(record));
+    if (!in->gcount()) return true;
+    if (in->gcount() != sizeof(record)) return false;
+    if (maxRecordSize < record.size) return false;
+
+    vector<char> data(record.size);
+    in->read(data.data(), data.size());
+    if ((uint64_t)in->gcount() != record.size) return false;
+
+    Key key;
+    memcpy(key.cell, record.cell, sizeof(key.cell));
+    memcpy(key.steps, record.steps, sizeof(key.steps));
+    records[key].swap(data);
+  }
+}
+
+
+void RenderCheckpoint::write() {
+  string tmp = filename + ".tmp";
+
+  {
+    SmartPointer<iostream> out =
+      SystemUtilities::open(tmp, ios::out | ios::trunc | ios::binary);
+
+    writeHeader(*out);
+
+    for (records_t::const_iterator it = records.begin(); it != records.end();
+         it++)
+      writeRecord(*out, it->first.cell, it->first.steps, it->second);
+
+    out->flush();
+    if (out->fail()) THROWS("Failed to write '" << tmp << "'");
+  }
+
+  SystemUtilities::rename(tmp, filename);
+}
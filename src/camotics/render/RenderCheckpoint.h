@@ -0,0 +1,79 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+
+namespace CAMotics {
+  class Grid;
+  class GridTreeRef;
+
+  /***
+   * Keeps the cells of completed grids in a file as they finish, so an
+   * interrupted render can be resumed by the same simulation.  Grids are
+   * found by their place in the tree so they are only reused when the tree
+   * is partitioned the same way, as it is with the same thread count.
+   * Records partly written when interrupted are ignored.
+   */
+  class RenderCheckpoint {
+    std::string filename;
+    cb::SmartPointer<std::iostream> stream;
+
+    struct Key {
+      uint32_t cell[3];
+      uint32_t steps[3];
+
+      Key() {}
+      Key(const Grid &root, const Grid &grid);
+      bool operator<(const Key &o) const;
+    };
+
+    typedef std::map<Key, std::vector<char> > records_t;
+    records_t records;
+
+  public:
+    RenderCheckpoint(const std::string &filename);
+
+    const std::string &getFilename() const {return filename;}
+    unsigned getCount() const {return records.size();}
+
+    /// Fill @param grid of @param root from the file.
+    /// @return false if it was not saved.
+    bool restore(const Grid &root, GridTreeRef &grid);
+    /// Append the cells of completed @param grid of @param root.
+    void save(const Grid &root, const GridTreeRef &grid);
+    /// Delete the file, once the render is complete.
+    void remove();
+
+  protected:
+    /// @return false if the file ends in a partly written record.
+    bool load();
+    void write();
+  };
+}
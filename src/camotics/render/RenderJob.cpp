@@ -19,11 +19,19 @@
 \******************************************************************************/
 
 #include "RenderJob.h"
+#include "Renderer.h"
+#include "NUMATopology.h"
+#include "RenderPolicy.h"
 
 #include <camotics/contour/MarchingCubes.h>
 #include <camotics/contour/CubicalMarchingSquares.h>
+#include <camotics/contour/DualContouring.h>
+#include <camotics/contour/AdaptiveMarchingCubes.h>
+#include <camotics/contour/FieldStats.h>
+#include <camotics/Trace.h>
 
 #include <cbang/Exception.h>
+#include <cbang/log/Logger.h>
 #include <cbang/time/Timer.h>
 #include <cbang/util/DefaultCatch.h>
 
@@ -31,26 +39,51 @@ using namespace cb;
 using namespace CAMotics;
 
 
-RenderJob::RenderJob(Condition &condition, FieldFunction &func, RenderMode mode,
-                     GridTreeRef &tree) :
-  condition(condition), func(func), tree(tree) {
+RenderJob::RenderJob(Renderer &renderer, FieldFunction &func,
+                     RenderMode mode, unsigned index, unsigned node,
+                     const NUMATopology *numa) :
+  renderer(renderer), func(func), node(node), numa(numa), cost(0),
+  stopped(false) {
   switch (mode) {
   case RenderMode::MCUBES_MODE: generator = new MarchingCubes; break;
   case RenderMode::CMS_MODE: generator = new CubicalMarchingSquares; break;
+  case RenderMode::DC_MODE: generator = new DualContouring; break;
+  case RenderMode::ADAPTIVE_MODE:
+    generator = new AdaptiveMarchingCubes;
+    break;
   default: THROWS("Invalid or unsupported render mode " << mode);
   }
+
+  generator->setJob(index);
+  generator->setParent(renderer.getTask().get());
 }
 
 
 void RenderJob::run() {
   try {
-    generator->run(func, tree);
+    RenderPolicy::enter();
+
+    if (numa && !numa->pin(node))
+      LOG_WARNING("Failed to pin render job to NUMA node " << node);
+
+    // Keep rendering grids until there are none left
+    GridTreeRef *tree = 0;
+    while (!stopped) {
+      tree = renderer.next(tree, cost, node);
+      if (!tree) break;
+
+      CAMOTICS_TRACE("Contour grid");
+      generator->begin();
+      generator->run(func, *tree);
+    }
   } CATCH_WARNING;
 
-  condition.signal();
+  FieldStats::flush();
+  renderer.finished();
 }
 
 
 void RenderJob::stop() {
+  stopped = true;
   if (!generator.isNull()) generator->interrupt();
 }
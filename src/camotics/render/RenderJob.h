@@ -27,22 +27,33 @@
 #include <camotics/contour/GridTreeRef.h>
 
 #include <cbang/os/Thread.h>
-#include <cbang/os/Condition.h>
+
+#include <atomic>
 
 
 namespace CAMotics {
+  class Renderer;
+  class NUMATopology;
+
   class RenderJob : public cb::Thread {
-    cb::Condition &condition;
+    Renderer &renderer;
     cb::SmartPointer<ContourGenerator> generator;
 
     FieldFunction &func;
-    GridTreeRef &tree;
+    unsigned node;
+    const NUMATopology *numa;
+    double cost;
+    std::atomic<bool> stopped; ///< Set by stop() from another thread
 
   public:
-    RenderJob(cb::Condition &condition, FieldFunction &func, RenderMode mode,
-              GridTreeRef &tree);
-
-    double getProgress() {return generator->getProgress();}
+    /// Job @param index takes grids queued for @param node first.  It runs
+    /// on that node's CPUs if @param numa is given.
+    RenderJob(Renderer &renderer, FieldFunction &func, RenderMode mode,
+              unsigned index = 0, unsigned node = 0,
+              const NUMATopology *numa = 0);
+
+    /// Cost of the grid being rendered scaled by its progress
+    double getProgress() {return cost * generator->getProgress();}
 
     // From Thread
     void run();
@@ -33,5 +33,9 @@
 // EDX Register
 CBANG_ENUM(MCUBES_MODE)
 CBANG_ENUM(CMS_MODE)
+CBANG_ENUM(HEIGHT_MAP_MODE)
+CBANG_ENUM(DC_MODE)
+CBANG_ENUM(ADAPTIVE_MODE)
+CBANG_ENUM(TRI_DEXEL_MODE)
 
 #endif // CBANG_ENUM_EXPAND
@@ -18,12 +18,19 @@
 
 \******************************************************************************/
 
-#include "SpeedCommand.h"
+#pragma once
 
-#include <cbang/json/Sink.h>
 
-using namespace GCode;
-using namespace cb;
+namespace CAMotics {
+  class GridTreeRef;
 
+  class RenderObserver {
+  public:
+    virtual ~RenderObserver() {}
 
-void SpeedCommand::insert(JSON::Sink &sink) {sink.insert("speed", speed);}
+    /// Called from the rendering thread after all cells of @param grid are
+    /// computed, while other grids may still be rendering.  The observer
+    /// may free the cells once it is done with them.
+    virtual void gridCompleted(GridTreeRef &grid) = 0;
+  };
+}
@@ -0,0 +1,124 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "RenderPolicy.h"
+
+#include <cbang/log/Logger.h>
+#include <cbang/os/SystemInfo.h>
+#include <cbang/time/Timer.h>
+
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  atomic<bool> lowPriority(false);
+  atomic<unsigned> reservedCPUs(0);
+  atomic<bool> throttleEnabled(false);
+  atomic<double> throttleUntil(0);
+}
+
+
+void RenderPolicy::setLowPriority(bool low) {lowPriority = low;}
+bool RenderPolicy::getLowPriority() {return lowPriority;}
+void RenderPolicy::setReservedCPUs(unsigned count) {reservedCPUs = count;}
+unsigned RenderPolicy::getReservedCPUs() {return reservedCPUs;}
+
+
+void RenderPolicy::setThrottle(bool throttle) {
+  throttleEnabled = throttle;
+  if (!throttle) throttleUntil = 0;
+}
+
+
+bool RenderPolicy::getThrottle() {return throttleEnabled;}
+
+
+void RenderPolicy::interact(double hold) {
+  if (throttleEnabled) throttleUntil = Timer::now() + hold;
+}
+
+
+bool RenderPolicy::isThrottled() {
+  double until = throttleUntil;
+  return until && Timer::now() < until;
+}
+
+
+unsigned RenderPolicy::getJobCount(unsigned threads) {
+  unsigned reserved = reservedCPUs;
+  if (!reserved) return threads;
+
+  unsigned cpus = SystemInfo::instance().getCPUCount();
+  if (cpus <= reserved) return 1;
+  return std::max(1U, std::min(threads, cpus - reserved));
+}
+
+
+void RenderPolicy::enter() {
+#ifdef _WIN32
+  if (lowPriority)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+#elif defined(__linux__)
+  // Linux threads have their own nice value
+  if (lowPriority) {
+    id_t tid = syscall(SYS_gettid);
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, tid);
+    if (!errno) setpriority(PRIO_PROCESS, tid, std::min(nice + 10, 19));
+  }
+
+  // Leave the highest numbered CPUs the thread may use to the GUI
+  unsigned reserved = reservedCPUs;
+  if (reserved) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) return;
+
+    if ((unsigned)CPU_COUNT(&set) <= reserved) return;
+
+    for (int cpu = CPU_SETSIZE - 1; 0 <= cpu && reserved; cpu--)
+      if (CPU_ISSET(cpu, &set)) {
+        CPU_CLR(cpu, &set);
+        reserved--;
+      }
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+      LOG_WARNING("Failed to keep render job off reserved CPUs");
+  }
+#endif
+}
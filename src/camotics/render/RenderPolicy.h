@@ -0,0 +1,57 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+namespace CAMotics {
+  /***
+   * Process wide scheduling of render jobs, so a GUI stays responsive
+   * while a simulation uses every CPU.  Jobs may run at a lower OS
+   * priority and leave some CPUs to the GUI.  While the user interacts
+   * with the view all but the first job pause between slabs of cells.
+   */
+  class RenderPolicy {
+  public:
+    static void setLowPriority(bool low);
+    static bool getLowPriority();
+
+    /// Keep @param count CPUs free of render jobs.
+    static void setReservedCPUs(unsigned count);
+    static unsigned getReservedCPUs();
+
+    /// Pause jobs while the user interacts, see interact().
+    static void setThrottle(bool throttle);
+    static bool getThrottle();
+
+    /// Called for each user interaction.  Jobs are throttled until none
+    /// has come for @param hold seconds.
+    static void interact(double hold = 0.25);
+    static bool isThrottled();
+
+    /// @return how many jobs to run for @param threads threads, leaving the
+    /// reserved CPUs free.
+    static unsigned getJobCount(unsigned threads);
+
+    /// Lower the priority of the calling job thread and keep it off the
+    /// reserved CPUs, as set.
+    static void enter();
+  };
+}
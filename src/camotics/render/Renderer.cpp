@@ -21,76 +21,268 @@
 #include "Renderer.h"
 
 #include "RenderJob.h"
+#include "RenderObserver.h"
+#include "RenderCheckpoint.h"
+#include "NUMATopology.h"
+#include "RenderPolicy.h"
 
 #include <camotics/Grid.h>
+#include <camotics/Trace.h>
 #include <camotics/sim/CutWorkpiece.h>
+#include <camotics/contour/FieldStats.h>
 
 #include <cbang/String.h>
 #include <cbang/log/Logger.h>
+#include <cbang/os/Thread.h>
 #include <cbang/time/TimeInterval.h>
 #include <cbang/time/Timer.h>
 #include <cbang/util/SmartLock.h>
 #include <cbang/util/DefaultCatch.h>
 
-#include <cmath>
-#include <list>
+#include <algorithm>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  const unsigned SAMPLE_STEPS = 3; // Per axis, in each grid
+
+
+  // @return the mean field evaluation work, the point plus the candidate
+  // moves searched, at a lattice of points spread through @param bounds.
+  double sampleWork(const FieldFunction &func, const Rectangle3D &bounds) {
+    const Vector3D &min = bounds.getMin();
+    Vector3D dims = bounds.getDimensions() / SAMPLE_STEPS;
+
+    vector<Vector3D> points;
+    for (unsigned x = 0; x < SAMPLE_STEPS; x++)
+      for (unsigned y = 0; y < SAMPLE_STEPS; y++)
+        for (unsigned z = 0; z < SAMPLE_STEPS; z++)
+          points.push_back(Vector3D(min.x() + dims.x() * (x + 0.5),
+                                    min.y() + dims.y() * (y + 0.5),
+                                    min.z() + dims.z() * (z + 0.5)));
+
+    FieldStats &stats = FieldStats::local();
+    uint64_t candidates = stats.candidates;
+    vector<double> depths;
+    func.depth(points, depths);
+
+    return 1 + (double)(stats.candidates - candidates) / points.size();
+  }
+
+
+  struct CostGreater {
+    const vector<double> &costs;
+    CostGreater(const vector<double> &costs) : costs(costs) {}
+    bool operator()(unsigned a, unsigned b) const {return costs[b] < costs[a];}
+  };
+
+
+  struct CenterLess {
+    const vector<GridTreeRef> &grids;
+    unsigned axis;
+    CenterLess(const vector<GridTreeRef> &grids, unsigned axis) :
+      grids(grids), axis(axis) {}
+    bool operator()(unsigned a, unsigned b) const {
+      return grids[a].getBounds().getCenter()[axis] <
+        grids[b].getBounds().getCenter()[axis];
+    }
+  };
+
+
+  // Copies the sweep on a thread pinned to the node, so it is local there
+  class ReplicaJob : public Thread {
+    const NUMATopology &topology;
+    unsigned node;
+    const CutWorkpiece &source;
+    unsigned threads;
+    SmartPointer<CutWorkpiece> replica;
+
+  public:
+    ReplicaJob(const NUMATopology &topology, unsigned node,
+               const CutWorkpiece &source, unsigned threads) :
+      topology(topology), node(node), source(source), threads(threads) {}
+
+    const SmartPointer<CutWorkpiece> &getReplica() const {return replica;}
+
+    // From Thread
+    void run() {
+      try {
+        if (!topology.pin(node)) return;
+        replica = new CutWorkpiece(source.getToolSweep()->replicate(threads),
+                                   source.getWorkpiece());
+      } CATCH_ERROR;
+    }
+  };
+}
+
+
 void Renderer::render(CutWorkpiece &cutWorkpiece, GridTree &tree,
                       const cb::Rectangle3D &bbox, unsigned threads,
                       RenderMode mode) {
-  typedef list<SmartPointer<RenderJob> > jobs_t;
+  typedef vector<SmartPointer<RenderJob> > jobs_t;
+  SmartPointer<NUMATopology> topology;
+  vector<SmartPointer<CutWorkpiece> > replicas;
   jobs_t jobs;
-  vector<GridTreeRef> jobGrids;
 
   try {
     SmartLock lock(this);
+    CAMOTICS_TRACE("Render surface");
+
+    // Divide work in to many more grids than threads so the jobs balance
+    vector<GridTreeRef> grids;
+    unsigned targetJobCount = threads * 16;
+    const ToolSweep &sweep = *cutWorkpiece.getToolSweep();
+    tree.partition(grids, bbox, targetJobCount, &sweep);
+
+    // Estimate the cost of each grid from the field evaluation work at a
+    // few of its points.  Timing the samples turns work in to seconds.
+    vector<double> costs;
+    vector<unsigned> order;
+    vector<unsigned> restored;
+    double totalCost = 0;
+    double restoredCost = 0;
+    double sampledWork = 0;
+    double sampleStart = Timer::now();
+
+    for (unsigned i = 0; i < grids.size(); i++) {
+      double cost = 1;
+      cb::Rectangle3D bounds = grids[i].getBounds();
+
+      if (!sweep.cull(bounds)) {
+        double work = sampleWork(cutWorkpiece, bounds);
+        cost += work * grids[i].getTotalCells();
+        sampledWork += work * SAMPLE_STEPS * SAMPLE_STEPS * SAMPLE_STEPS;
+      }
+
+      costs.push_back(cost);
+      totalCost += cost;
+
+      // Grids finished by an earlier run are not rendered again
+      if (checkpoint && checkpoint->restore(tree, grids[i])) {
+        restored.push_back(i);
+        restoredCost += cost;
+
+      } else order.push_back(i);
+    }
+
+    // Spread the jobs over the NUMA nodes
+    unsigned count = RenderPolicy::getJobCount(threads);
+    count = std::min(count, (unsigned)order.size());
+
+    // Predict the time left from the cost of the grids to render
+    if (sampledWork && count) {
+      double secPerWork = (Timer::now() - sampleStart) / sampledWork;
+      double predicted = (totalCost - restoredCost) * secPerWork / count;
+      task->setPrediction(predicted);
+      LOG_INFO(1, "Predicted render time " << TimeInterval(predicted));
+    }
+    unsigned nodes = 1;
+    if (numa && 1 < count) {
+      topology = new NUMATopology;
+      nodes = std::min(topology->getNodeCount(), count);
+      if (nodes < 2) nodes = 1;
+    }
+
+    // Each node gets a slab of the surface, along its longest axis, with
+    // about an equal share of the cost
+    vector<unsigned> queues(1, 0);
+    if (1 < nodes) {
+      cb::Vector3D dims = bbox.getDimensions();
+      unsigned axis = dims.x() < dims.y() ? 1 : 0;
+      if (dims[axis] < dims.z()) axis = 2;
+      sort(order.begin(), order.end(), CenterLess(grids, axis));
 
-    // Divide work
-    unsigned targetJobCount = pow(2, ceil(log(threads) / log(2)) + 2);
+      double total = 0;
+      for (unsigned i = 0; i < order.size(); i++) total += costs[order[i]];
 
-    tree.partition(jobGrids, bbox, targetJobCount);
-    unsigned totalJobCount = jobGrids.size();
+      double sum = 0;
+      for (unsigned i = 0; i < order.size(); i++) {
+        double mid = sum + costs[order[i]] / 2;
+        sum += costs[order[i]];
+        while (queues.size() < nodes && total * queues.size() / nodes < mid)
+          queues.push_back(i);
+      }
+
+      while (queues.size() < nodes) queues.push_back(order.size());
+    }
+    queues.push_back(order.size());
+
+    jobGrids.clear();
+    jobCosts.clear();
+    queueNext.clear();
+    queueEnd.clear();
+
+    for (unsigned i = 0; i < nodes; i++) {
+      // Most expensive first
+      sort(order.begin() + queues[i], order.begin() + queues[i + 1],
+           CostGreater(costs));
+
+      queueNext.push_back(jobGrids.size());
+      for (unsigned j = queues[i]; j < queues[i + 1]; j++) {
+        jobGrids.push_back(grids[order[j]]);
+        jobCosts.push_back(costs[order[j]]);
+      }
+      queueEnd.push_back(jobGrids.size());
+    }
+
+    runningJobs = 0;
+    completedCost = restoredCost;
+    completedGrids.clear();
 
-    LOG_DEBUG(1, "Partitioned in to " << totalJobCount << " jobs");
+    if (observer)
+      for (unsigned i = 0; i < restored.size(); i++)
+        observer->gridCompleted(grids[restored[i]]);
+
+    LOG_DEBUG(1, "Partitioned in to " << jobGrids.size() << " jobs");
+    if (!restored.empty())
+      LOG_INFO(1, "Restored " << restored.size() << " grids from checkpoint");
     LOG_INFO(1, "Computing surface bounded by " << tree.getBounds() << " at "
              << tree.getResolution() << " grid resolution");
 
-    // Run jobs
-    double lastUpdate = 0;
-    while (!task->shouldQuit() && !(jobGrids.empty() && jobs.empty())) {
-      // Start new jobs
-      while (!jobGrids.empty() && jobs.size() < threads) {
-        SmartPointer<RenderJob> job =
-          new RenderJob(*this, cutWorkpiece, mode, jobGrids.back());
-        job->start();
-        jobs.push_back(job);
-        jobGrids.pop_back();
+    // Copy the sweep to each node, on as many threads as it has jobs
+    if (1 < nodes) {
+      CAMOTICS_TRACE("Replicate sweep");
+      task->update(0, "Replicating tool sweep");
+      LOG_INFO(1, "Replicating tool sweep to " << nodes << " NUMA nodes");
+
+      vector<SmartPointer<ReplicaJob> > replicaJobs;
+      for (unsigned i = 0; i < nodes; i++) {
+        unsigned nodeJobs = (count * (i + 1) + nodes - 1) / nodes -
+          (count * i + nodes - 1) / nodes;
+        replicaJobs.push_back
+          (new ReplicaJob(*topology, i, cutWorkpiece, nodeJobs));
       }
 
-      // Reap completed jobs
-      jobs_t::iterator it;
-      for (it = jobs.begin(); it != jobs.end() && !task->shouldQuit();)
-        if ((*it)->getState() == Thread::THREAD_DONE) {
-          (*it)->join();
-          it = jobs.erase(it);
-        } else it++;
+      for (unsigned i = 0; i < nodes; i++) replicaJobs[i]->start();
+      for (unsigned i = 0; i < nodes; i++) replicaJobs[i]->join();
 
+      for (unsigned i = 0; i < nodes; i++)
+        replicas.push_back(replicaJobs[i]->getReplica());
+    }
 
-      // Update Progress
-      double progress = 0;
+    // Start one job per thread, each takes grids until there are none left
+    for (unsigned i = 0; !task->shouldQuit() && i < count; i++) {
+      unsigned node = i * nodes / count;
+      CutWorkpiece &func = replicas.empty() || replicas[node].isNull() ?
+        cutWorkpiece : *replicas[node];
 
-      // Add running jobs
-      for (it = jobs.begin(); it != jobs.end() && !task->shouldQuit(); it++)
-        progress += (*it)->getProgress();
+      jobs.push_back(new RenderJob(*this, func, mode, i, node,
+                                   1 < nodes ? topology.get() : 0));
+      jobs.back()->start();
+      runningJobs++;
+    }
 
-      // Add completed jobs
-      progress += totalJobCount - jobGrids.size() - jobs.size();
-      progress /= totalJobCount;
+    // Grids completed by the last jobs are still reported after they exit
+    double lastUpdate = 0;
+    while (!task->shouldQuit() && (runningJobs || !completedGrids.empty())) {
+      // Update Progress
+      double progress = completedCost;
+      for (unsigned i = 0; i < jobs.size(); i++)
+        progress += jobs[i]->getProgress();
+      progress /= totalCost;
 
       task->update(progress, "Rendering surface");
 
@@ -103,12 +295,71 @@ void Renderer::render(CutWorkpiece &cutWorkpiece, GridTree &tree,
                  << " ETA: " << TimeInterval(task->getETA()));
       }
 
-      // Wait
-      timedWait(0.1);
+      // Woken as each grid completes, otherwise update progress periodically
+      if (completedGrids.empty()) timedWait(0.25);
+
+      // Report completed grids without blocking the jobs
+      if (!completedGrids.empty()) {
+        vector<GridTreeRef *> completed;
+        completed.swap(completedGrids);
+
+        this->unlock();
+        try {
+          CAMOTICS_TRACE("Report grids");
+          for (unsigned i = 0; i < completed.size(); i++) {
+            // Saved first, observers may free the cells
+            if (checkpoint) checkpoint->save(tree, *completed[i]);
+            if (observer) observer->gridCompleted(*completed[i]);
+          }
+        } CATCH_ERROR;
+        this->lock();
+      }
     }
   } CATCH_ERROR;
 
-  // Clean up remaining jobs in case of an early exit
-  for (jobs_t::iterator it = jobs.begin(); it != jobs.end(); it++)
-    (*it)->join();
+  // Stop remaining jobs in case of an early exit
+  for (unsigned i = 0; i < jobs.size(); i++) jobs[i]->stop();
+  for (unsigned i = 0; i < jobs.size(); i++) jobs[i]->join();
+}
+
+
+GridTreeRef *Renderer::next(GridTreeRef *done, double &cost,
+                            unsigned node) {
+  SmartLock lock(this);
+
+  completedCost += cost;
+  cost = 0;
+  if (done && (observer || checkpoint) && !task->shouldQuit())
+    completedGrids.push_back(done);
+  signal();
+
+  if (task->shouldQuit()) return 0;
+
+  if (node < queueNext.size() && queueNext[node] < queueEnd[node]) {
+    unsigned i = queueNext[node]++;
+    cost = jobCosts[i];
+    return &jobGrids[i];
+  }
+
+  // Take the cheapest grid from the queue with the most left
+  unsigned most = 0;
+  unsigned queue = 0;
+  for (unsigned i = 0; i < queueNext.size(); i++)
+    if (most < queueEnd[i] - queueNext[i]) {
+      most = queueEnd[i] - queueNext[i];
+      queue = i;
+    }
+
+  if (!most) return 0;
+
+  unsigned i = --queueEnd[queue];
+  cost = jobCosts[i];
+  return &jobGrids[i];
+}
+
+
+void Renderer::finished() {
+  SmartLock lock(this);
+  runningJobs--;
+  signal();
 }
@@ -23,24 +23,61 @@
 #include "RenderMode.h"
 
 #include <camotics/Task.h>
+#include <camotics/contour/GridTreeRef.h>
 
 #include <cbang/SmartPointer.h>
 #include <cbang/os/Condition.h>
 #include <cbang/geom/Rectangle.h>
 
+#include <vector>
+
 
 namespace CAMotics {
   class CutWorkpiece;
   class GridTree;
+  class RenderObserver;
+  class RenderCheckpoint;
 
   class Renderer : public Task {
     cb::SmartPointer<Task> task;
+    RenderObserver *observer;
+    RenderCheckpoint *checkpoint;
+    bool numa;
+
+    // One queue of grids per NUMA node, each a range of the job grids
+    std::vector<GridTreeRef> jobGrids;
+    std::vector<double> jobCosts;
+    std::vector<unsigned> queueNext;
+    std::vector<unsigned> queueEnd;
+    unsigned runningJobs;
+    double completedCost;
+    std::vector<GridTreeRef *> completedGrids;
 
   public:
-    Renderer(const cb::SmartPointer<Task> &task = new Task) : task(task) {}
+    Renderer(const cb::SmartPointer<Task> &task = new Task) :
+      task(task), observer(0), checkpoint(0), numa(false), runningJobs(0),
+      completedCost(0) {}
+
+    const cb::SmartPointer<Task> &getTask() const {return task;}
+
+    /// Report grids to @param observer as they complete.
+    void setObserver(RenderObserver *observer) {this->observer = observer;}
+    /// Skip grids saved in @param checkpoint and save those completed.
+    void setCheckpoint(RenderCheckpoint *checkpoint)
+    {this->checkpoint = checkpoint;}
+    /// If @param numa, on machines with more than one NUMA node, pin the
+    /// jobs to nodes, give each node its own copy of the tool sweep and
+    /// give its jobs grids from one region of the surface.
+    void setNUMA(bool numa) {this->numa = numa;}
 
     void render(CutWorkpiece &cutWorkpiece, GridTree &tree,
                 const cb::Rectangle3D &bbox, unsigned threads,
                 RenderMode mode = RenderMode::MCUBES_MODE);
+
+    /// Called by jobs to report @param done grid and @param cost of finished
+    /// work and get more, from the queue of @param node while it lasts.
+    GridTreeRef *next(GridTreeRef *done, double &cost, unsigned node = 0);
+    /// Called by jobs when they exit.
+    void finished();
   };
 }
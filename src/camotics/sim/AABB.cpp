@@ -24,16 +24,49 @@
 #include <camotics/view/BoundsView.h>
 
 #include <cbang/Zap.h>
+#include <cbang/os/Thread.h>
 
 #include <algorithm>
+#include <exception>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  // Below this many nodes a subtree is not worth a thread
+  const unsigned minParallelNodes = 4096;
+
+
+  class SplitJob : public Thread {
+    AABB *nodes;
+    unsigned threads;
+    AABB *result;
+    exception_ptr error;
+
+  public:
+    SplitJob(AABB *nodes, unsigned threads) :
+      nodes(nodes), threads(threads), result(0) {}
+
+    /// Rethrows what run() caught, so a failed subtree is not lost
+    AABB *getResult() const {
+      if (error) rethrow_exception(error);
+      return result;
+    }
+
+    // From Thread
+    void run() {
+      try {
+        result = new AABB(nodes, threads);
+      } catch (...) {error = current_exception();}
+    }
+  };
+}
+
+
 /// NOTE: Expects @param nodes to be a link list along the left child
-AABB::AABB(AABB *nodes) : left(0), right(0), move(0) {
+AABB::AABB(AABB *nodes, unsigned threads) : left(0), right(0), move(0) {
   if (!nodes) return;
 
   // Compute bounds
@@ -77,9 +110,26 @@ AABB::AABB(AABB *nodes) : left(0), right(0), move(0) {
   if (!lessThan) lessThan = greaterThan->split(greaterCount / 2);
   if (!greaterThan) greaterThan = lessThan->split(lessCount / 2);
 
-  // Recur
-  left = new AABB(lessThan);
-  right = new AABB(greaterThan);
+  // Recur, building the left subtree in parallel if there is enough work
+  if (1 < threads && minParallelNodes < count) {
+    SplitJob job(lessThan, threads / 2);
+    job.start();
+
+    try {
+      right = new AABB(greaterThan, threads - threads / 2);
+    } catch (...) {
+      job.join();
+      try {delete job.getResult();} catch (...) {}
+      throw;
+    }
+
+    job.join();
+    left = job.getResult();
+
+  } else {
+    left = new AABB(lessThan);
+    right = new AABB(greaterThan);
+  }
 }
 
 
@@ -110,6 +160,19 @@ unsigned AABB::getTreeHeight() const {
 }
 
 
+uint64_t AABB::getMemoryUsage() const {
+  // Unpartitioned nodes are a list through left, too long to recur along
+  uint64_t bytes = 0;
+
+  for (const AABB *it = this; it; it = it->left) {
+    bytes += sizeof(AABB);
+    if (it->right) bytes += it->right->getMemoryUsage();
+  }
+
+  return bytes;
+}
+
+
 bool AABB::intersects(const cb::Rectangle3D &r) {
   if (!cb::Rectangle3D::intersects(r)) return false;
 
@@ -118,6 +181,15 @@ bool AABB::intersects(const cb::Rectangle3D &r) {
 }
 
 
+unsigned AABB::intersections(const cb::Rectangle3D &r) {
+  if (!cb::Rectangle3D::intersects(r)) return 0;
+  if (isLeaf()) return 1;
+
+  return (left ? left->intersections(r) : 0) +
+    (right ? right->intersections(r) : 0);
+}
+
+
 void AABB::collisions(const cb::Vector3D &p, vector<const GCode::Move *> &moves) {
   if (!cb::Rectangle3D::contains(p)) return;
   if (isLeaf()) moves.push_back(move);
@@ -126,6 +198,16 @@ void AABB::collisions(const cb::Vector3D &p, vector<const GCode::Move *> &moves)
 }
 
 
+void AABB::collisions(const cb::Rectangle3D &r,
+                      vector<pair<const GCode::Move *,
+                      cb::Rectangle3D> > &boxes) {
+  if (!cb::Rectangle3D::intersects(r)) return;
+  if (isLeaf()) boxes.push_back(make_pair(move, getBounds()));
+  if (left) left->collisions(r, boxes);
+  if (right) right->collisions(r, boxes);
+}
+
+
 void AABB::draw(bool leavesOnly, unsigned height, unsigned depth) {
   if (!(left || right) || !leavesOnly) {
     glColor4f(0.5, 0, (height - depth) / (double)height, 1);
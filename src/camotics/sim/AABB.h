@@ -25,6 +25,7 @@
 #include <cbang/geom/Rectangle.h>
 
 #include <vector>
+#include <utility>
 
 
 namespace CAMotics {
@@ -34,7 +35,7 @@ namespace CAMotics {
     const GCode::Move *move;
 
   public:
-    AABB(AABB *nodes);
+    AABB(AABB *nodes, unsigned threads = 1);
     AABB(const GCode::Move *move, const cb::Rectangle3D &bbox) :
       cb::Rectangle3D(bbox), left(0), right(0), move(move) {}
     ~AABB();
@@ -46,9 +47,16 @@ namespace CAMotics {
     const GCode::Move *getMove() const {return move;}
     bool isLeaf() const {return move;}
     unsigned getTreeHeight() const;
+    /// @return the bytes of this node, the nodes below it and, before the
+    /// tree is built, the rest of the list.
+    uint64_t getMemoryUsage() const;
 
     bool intersects(const cb::Rectangle3D &r);
+    unsigned intersections(const cb::Rectangle3D &r);
     void collisions(const cb::Vector3D &p, std::vector<const GCode::Move *> &moves);
+    void collisions(const cb::Rectangle3D &r,
+                    std::vector<std::pair<const GCode::Move *,
+                    cb::Rectangle3D> > &boxes);
     void draw(bool leavesOnly = true, unsigned height = 1, unsigned depth = 0);
   };
 }
@@ -50,6 +50,12 @@ bool AABBTree::intersects(const cb::Rectangle3D &r) const {
 }
 
 
+unsigned AABBTree::intersections(const cb::Rectangle3D &r) const {
+  if (!finalized) THROWS("AABBTree not yet finalized");
+  return root ? root->intersections(r) : 0;
+}
+
+
 void AABBTree::collisions(const cb::Vector3D &p,
                           vector<const GCode::Move *> &moves) const {
   if (!finalized) THROWS("AABBTree not yet finalized");
@@ -57,13 +63,24 @@ void AABBTree::collisions(const cb::Vector3D &p,
 }
 
 
+void AABBTree::collisions(const cb::Rectangle3D &r, boxes_t &boxes) const {
+  if (!finalized) THROWS("AABBTree not yet finalized");
+  if (root) root->collisions(r, boxes);
+}
+
+
 void AABBTree::draw(bool leavesOnly) {
   if (root) root->draw(leavesOnly, root->getTreeHeight());
 }
 
 
+uint64_t AABBTree::getMemoryUsage() const {
+  return sizeof(AABBTree) + (root ? root->getMemoryUsage() : 0);
+}
+
+
 void AABBTree::finalize() {
   if (finalized) return;
   finalized = true;
-  root = new AABB(root);
+  root = new AABB(root, threads);
 }
@@ -36,9 +36,11 @@ namespace CAMotics {
   protected:
     AABB *root;
     bool finalized;
+    unsigned threads;
 
   public:
-    AABBTree() : root(0), finalized(false) {}
+    AABBTree(unsigned threads = 1) :
+      root(0), finalized(false), threads(threads) {}
     virtual ~AABBTree();
 
     unsigned getHeight() const {return root ? root->getTreeHeight() : 0;}
@@ -47,9 +49,12 @@ namespace CAMotics {
     cb::Rectangle3D getBounds() const;
     void insert(const GCode::Move *move, const cb::Rectangle3D &bbox);
     bool intersects(const cb::Rectangle3D &r) const;
+    unsigned intersections(const cb::Rectangle3D &r) const;
     void collisions(const cb::Vector3D &p,
                     std::vector<const GCode::Move *> &moves) const;
+    void collisions(const cb::Rectangle3D &r, boxes_t &boxes) const;
     void finalize();
     void draw(bool leavesOnly = false);
+    uint64_t getMemoryUsage() const;
   };
 }
@@ -21,15 +21,31 @@
 #include "CompositeSweep.h"
 
 #include <limits>
+#include <algorithm>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+CompositeSweep::CompositeSweep() :
+  radius(0), bottom(numeric_limits<double>::max()),
+  top(-numeric_limits<double>::max()) {}
+
+
 void CompositeSweep::add(const SmartPointer<Sweep> &sweep, double zOffset) {
   children.push_back(sweep);
   zOffsets.push_back(zOffset);
+
+  // The child's boxes for a move which stays at the origin give its extent
+  vector<cb::Rectangle3D> bboxes;
+  sweep->getBBoxes(cb::Vector3D(), cb::Vector3D(), bboxes, 0);
+
+  for (unsigned i = 0; i < bboxes.size(); i++) {
+    radius = max(radius, bboxes[i].getMax().x());
+    bottom = min(bottom, bboxes[i].getMin().z() + zOffset);
+    top = max(top, bboxes[i].getMax().z() + zOffset);
+  }
 }
 
 
@@ -37,8 +53,10 @@ void CompositeSweep::getBBoxes(const cb::Vector3D &start,
                                const cb::Vector3D &end,
                                vector<cb::Rectangle3D> &bboxes,
                                double tolerance) const {
-  for (unsigned i = 0; i < children.size(); i++)
-    children[i]->getBBoxes(start, end, bboxes, tolerance);
+  // One set of boxes around every child, so the lookup holds each piece of
+  // a move once and a point finds it once
+  if (children.empty()) return;
+  Sweep::getBBoxes(start, end, bboxes, radius, top, bottom, tolerance);
 }
 
 
@@ -54,3 +72,89 @@ double CompositeSweep::depth(const cb::Vector3D &start, const cb::Vector3D &end,
 
   return d2;
 }
+
+
+cb::Vector3D CompositeSweep::normal(const cb::Vector3D &start,
+                                    const cb::Vector3D &end,
+                                    const cb::Vector3D &p) const {
+  // The surface is that of the child with the greatest depth
+  double d2 = -numeric_limits<double>::max();
+  int best = -1;
+
+  for (unsigned i = 0; i < children.size(); i++) {
+    double cd2 =
+      children[i]->depth(start, end, p - cb::Vector3D(0, 0, zOffsets[i]));
+    if (d2 < cd2) {d2 = cd2; best = i;}
+  }
+
+  if (best < 0) return cb::Vector3D();
+  return children[best]->normal
+    (start, end, p - cb::Vector3D(0, 0, zOffsets[best]));
+}
+
+
+void CompositeSweep::depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                           const double *x, const double *y, const double *z,
+                           unsigned n, double *out) const {
+  if (!n) return;
+
+  // Evaluate each child on the whole batch rather than point by point
+  static thread_local vector<double> zs;
+  static thread_local vector<double> childOut;
+  childOut.resize(n);
+
+  for (unsigned i = 0; i < n; i++) out[i] = -numeric_limits<double>::max();
+
+  for (unsigned i = 0; i < children.size(); i++) {
+    const double *cz = z;
+
+    if (zOffsets[i]) {
+      zs.resize(n);
+      for (unsigned j = 0; j < n; j++) zs[j] = z[j] - zOffsets[i];
+      cz = &zs[0];
+    }
+
+    children[i]->depth(start, end, x, y, cz, n, &childOut[0]);
+
+    for (unsigned j = 0; j < n; j++)
+      if (out[j] < childOut[j]) out[j] = childOut[j];
+  }
+}
+
+
+void CompositeSweep::depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                           const float *x, const float *y, const float *z,
+                           unsigned n, float *out) const {
+  if (!n) return;
+
+  static thread_local vector<float> zs;
+  static thread_local vector<float> childOut;
+  childOut.resize(n);
+
+  for (unsigned i = 0; i < n; i++) out[i] = -numeric_limits<float>::max();
+
+  for (unsigned i = 0; i < children.size(); i++) {
+    const float *cz = z;
+
+    if (zOffsets[i]) {
+      zs.resize(n);
+      for (unsigned j = 0; j < n; j++) zs[j] = z[j] - zOffsets[i];
+      cz = &zs[0];
+    }
+
+    children[i]->depth(start, end, x, y, cz, n, &childOut[0]);
+
+    for (unsigned j = 0; j < n; j++)
+      if (out[j] < childOut[j]) out[j] = childOut[j];
+  }
+}
+
+
+double CompositeSweep::getRadius() const {
+  double radius = 0;
+
+  for (unsigned i = 0; i < children.size(); i++)
+    radius = max(radius, children[i]->getRadius());
+
+  return radius;
+}
@@ -33,7 +33,14 @@ namespace CAMotics {
     std::vector<cb::SmartPointer<Sweep> > children;
     std::vector<double> zOffsets;
 
+    // The extent of all the children about the tool tip
+    double radius;
+    double bottom;
+    double top;
+
   public:
+    CompositeSweep();
+
     void add(const cb::SmartPointer<Sweep> &sweep, double zOffset = 0);
 
     // From Sweep
@@ -42,5 +49,15 @@ namespace CAMotics {
                    double tolerance = 0.01) const;
     double depth(const cb::Vector3D &start, const cb::Vector3D &end,
                const cb::Vector3D &p) const;
+    void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+               const double *x, const double *y, const double *z,
+               unsigned n, double *out) const;
+    void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+               const float *x, const float *y, const float *z,
+               unsigned n, float *out) const;
+    cb::Vector3D normal(const cb::Vector3D &start, const cb::Vector3D &end,
+                        const cb::Vector3D &p) const;
+    double getRadius() const;
+    bool isConvex() const {return false;}
   };
 }
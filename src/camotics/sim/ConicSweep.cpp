@@ -46,22 +46,148 @@ namespace {
 }
 
 
+inline double ConicSweep::plungeDepth(const cb::Vector3D &A,
+                                      const cb::Vector3D &B,
+                                      double Px, double Py, double Pz) const {
+  // Tool moves straight up or down.  At height Pz the cut radius is the
+  // widest tool cross-section that passes through Pz.  Returns the signed
+  // distance to the swept solid, exact for cylinders and close for cones.
+  const double zMin = min(A.z(), B.z());
+  const double zMax = max(A.z(), B.z()) + l;
+  const double hMin = max(0.0, min(l, Pz - max(A.z(), B.z())));
+  const double hMax = max(0.0, min(l, Pz - zMin));
+
+  const double r = rb + Tm * (Tm < 0 ? hMin : hMax);
+  const double d = sqrt(sqr(Px - A.x()) + sqr(Py - A.y()));
+
+  if (Pz < zMin || zMax < Pz || r < d) {
+    const double dz = Pz < zMin ? zMin - Pz : (zMax < Pz ? Pz - zMax : 0);
+    const double dr = r < d ? d - r : 0;
+    return -sqrt(sqr(dz) + sqr(dr));
+  }
+
+  return min(r - d, min(Pz - zMin, zMax - Pz));
+}
+
+
+inline double ConicSweep::planarDepth(const cb::Vector3D &A,
+                                      const cb::Vector3D &B,
+                                      double Px, double Py, double Pz) const {
+  // Tool moves in the XY plane.  The cut at height Pz is the 2D capsule
+  // around AB with the tool radius at that height.  Returns the signed
+  // distance to the swept solid, exact for cylinders and close for cones.
+  const double h = Pz - A.z();
+  const double r = rb + Tm * (h < 0 ? 0 : (l < h ? l : h));
+  const double ABx = B.x() - A.x(), ABy = B.y() - A.y();
+  const double APx = Px - A.x(), APy = Py - A.y();
+
+  double t = (APx * ABx + APy * ABy) / (sqr(ABx) + sqr(ABy));
+  t = t < 0 ? 0 : (1 < t ? 1 : t);
+
+  const double d = sqrt(sqr(APx - t * ABx) + sqr(APy - t * ABy));
+
+  if (h < 0 || l < h || r < d) {
+    const double dz = h < 0 ? -h : (l < h ? h - l : 0);
+    const double dr = r < d ? d - r : 0;
+    return -sqrt(sqr(dz) + sqr(dr));
+  }
+
+  return min(r - d, min(h, l - h));
+}
+
+
+namespace {
+  // The normal of the nearest of the side, the bottom or the top.  The
+  // side is slanted by @param slope, the change in radius with height.
+  cb::Vector3D capNormal(double side, double bottom, double top, double Rx,
+                         double Ry, double d, double slope) {
+    if (bottom <= side && bottom <= top) return cb::Vector3D(0, 0, -1);
+    if (top <= side) return cb::Vector3D(0, 0, 1);
+    if (!d) return cb::Vector3D();
+    return cb::Vector3D(Rx / d, Ry / d, -slope).normalize();
+  }
+
+
+  // Outside the normal points away from the nearest point on the solid
+  cb::Vector3D gapNormal(double dr, double dz, double Rx, double Ry,
+                         double d) {
+    cb::Vector3D n(d ? Rx / d * dr : 0, d ? Ry / d * dr : 0, dz);
+    double length = n.length();
+    return length ? n / length : n;
+  }
+}
+
+
+cb::Vector3D ConicSweep::plungeNormal(const cb::Vector3D &A,
+                                      const cb::Vector3D &B,
+                                      const cb::Vector3D &P) const {
+  // Same cases as plungeDepth()
+  const double Pz = P.z();
+  const double zMin = min(A.z(), B.z());
+  const double zMax = max(A.z(), B.z()) + l;
+  const double hMin = max(0.0, min(l, Pz - max(A.z(), B.z())));
+  const double hMax = max(0.0, min(l, Pz - zMin));
+  const double h = Tm < 0 ? hMin : hMax;
+
+  const double r = rb + Tm * h;
+  const double Rx = P.x() - A.x(), Ry = P.y() - A.y();
+  const double d = sqrt(sqr(Rx) + sqr(Ry));
+
+  if (Pz < zMin || zMax < Pz || r < d) {
+    const double dz = Pz < zMin ? Pz - zMin : (zMax < Pz ? Pz - zMax : 0);
+    return gapNormal(r < d ? d - r : 0, dz, Rx, Ry, d);
+  }
+
+  // Where the widest section is not at an end the side is the cone itself
+  const double slope = 0 < h && h < l ? Tm : 0;
+
+  return capNormal(r - d, Pz - zMin, zMax - Pz, Rx, Ry, d, slope);
+}
+
+
+cb::Vector3D ConicSweep::planarNormal(const cb::Vector3D &A,
+                                      const cb::Vector3D &B,
+                                      const cb::Vector3D &P) const {
+  // Same cases as planarDepth()
+  const double h = P.z() - A.z();
+  const double r = rb + Tm * (h < 0 ? 0 : (l < h ? l : h));
+  const double ABx = B.x() - A.x(), ABy = B.y() - A.y();
+  const double APx = P.x() - A.x(), APy = P.y() - A.y();
+
+  double t = (APx * ABx + APy * ABy) / (sqr(ABx) + sqr(ABy));
+  t = t < 0 ? 0 : (1 < t ? 1 : t);
+
+  const double Rx = APx - t * ABx, Ry = APy - t * ABy;
+  const double d = sqrt(sqr(Rx) + sqr(Ry));
+
+  if (h < 0 || l < h || r < d) {
+    const double dz = h < 0 ? h : (l < h ? h - l : 0);
+    return gapNormal(r < d ? d - r : 0, dz, Rx, Ry, d);
+  }
+
+  return capNormal(r - d, h, l - h, Rx, Ry, d, Tm);
+}
+
+
 double ConicSweep::depth(const cb::Vector3D &A, const cb::Vector3D &B,
                          const cb::Vector3D &P) const {
   const double Ax = A.x(), Ay = A.y(), Az = A.z();
   const double Bx = B.x(), By = B.y(), Bz = B.z();
   const double Px = P.x(), Py = P.y(), Pz = P.z();
 
-  // Check z-height
+  // Closed form distances for plunges and 2.5D moves
+  if (Ax == Bx && Ay == By) {
+    if (Az == Bz) return -1;
+    return plungeDepth(A, B, Px, Py, Pz);
+  }
+
+  if (Az == Bz) return planarDepth(A, B, Px, Py, Pz);
+
+  // Other moves only report inside or outside.  Check z-height.
   if (Pz < min(Az, Bz) || max(Az, Bz) + l < Pz) return -1;
 
   // epsilon * beta^2 + gamma * beta + rho = 0
-  double epsilon = sqr(Bx - Ax) + sqr(By - Ay) - sqr(Tm * (Bz - Az));
-
-  // If this is a straight up and down move of a cylindrical tool choose
-  // a fake arbitrarily small epsilon.
-  // TODO improve cylindrical computation speed by computing special case
-  if (epsilon == 0 && Bz != Az && Tm == 0) epsilon = 0.000000001;
+  const double epsilon = sqr(Bx - Ax) + sqr(By - Ay) - sqr(Tm * (Bz - Az));
 
   const double gamma = (Ax - Px) * (Bx - Ax) + (Ay - Py) * (By - Ay) +
     (sqr(Tm) * (Az - Pz) - Tm * rb) * (Az - Bz);
@@ -114,3 +240,85 @@ double ConicSweep::depth(const cb::Vector3D &A, const cb::Vector3D &B,
 
   return 1;
 }
+
+
+cb::Vector3D ConicSweep::normal(const cb::Vector3D &A, const cb::Vector3D &B,
+                                const cb::Vector3D &P) const {
+  if (A.x() == B.x() && A.y() == B.y()) {
+    if (A.z() == B.z()) return cb::Vector3D();
+    return plungeNormal(A, B, P);
+  }
+
+  if (A.z() == B.z()) return planarNormal(A, B, P);
+
+  return cb::Vector3D(); // No closed form for other moves
+}
+
+
+void ConicSweep::depth(const cb::Vector3D &A, const cb::Vector3D &B,
+                       const double *x, const double *y, const double *z,
+                       unsigned n, double *out) const {
+  // Same math as the single point version above, but with the per point
+  // branches turned in to masks so the loop body can be vectorized.
+  const double Ax = A.x(), Ay = A.y(), Az = A.z();
+  const double Bx = B.x(), By = B.y(), Bz = B.z();
+  const double minZ = min(Az, Bz), maxZ = max(Az, Bz) + l;
+
+  if (Ax == Bx && Ay == By) {
+    for (unsigned i = 0; i < n; i++)
+      out[i] = Az == Bz ? -1 : plungeDepth(A, B, x[i], y[i], z[i]);
+    return;
+  }
+
+  if (Az == Bz) {
+    for (unsigned i = 0; i < n; i++)
+      out[i] = planarDepth(A, B, x[i], y[i], z[i]);
+    return;
+  }
+
+  const double epsilon =
+    sqr(Bx - Ax) + sqr(By - Ay) - sqr(Tm * (Bz - Az));
+
+  if (epsilon == 0) {
+    for (unsigned i = 0; i < n; i++) out[i] = -1;
+    return;
+  }
+
+  const double rb2 = rb * rb, rt2 = rt * rt;
+
+  for (unsigned i = 0; i < n; i++) {
+    const double Px = x[i], Py = y[i], Pz = z[i];
+
+    const bool inZ = !(Pz < minZ || maxZ < Pz);
+
+    const double gamma = (Ax - Px) * (Bx - Ax) + (Ay - Py) * (By - Ay) +
+      (sqr(Tm) * (Az - Pz) - Tm * rb) * (Az - Bz);
+    const double rho =
+      sqr(Ax - Px) + sqr(Ay - Py) - sqr(Tm * (Az - Pz) - rb);
+    const double sigma = sqr(gamma) - epsilon * rho;
+    const bool valid = 0 <= sigma;
+
+    const double beta = (-gamma - sqrt(valid ? sigma : 0)) / epsilon;
+    const double Qz = (Bz - Az) * beta + Az;
+    const bool side = !(Pz < Qz || Qz + l < Pz);
+    const bool onSegment = 0 <= beta && beta <= 1;
+
+    // Bottom disc
+    const double betaB = (Pz - Az) / (Bz - Az);
+    const double d2B = sqr(betaB * (Bx - Ax) + Ax - Px) +
+      sqr(betaB * (By - Ay) + Ay - Py);
+    const bool bottom =
+      rb && 0 <= betaB && betaB <= 1 && d2B <= rb2;
+
+    // Top disc
+    const double betaT = (Pz - Az - l) / (Bz - Az);
+    const double d2T = sqr(betaT * (Bx - Ax) + Ax - Px) +
+      sqr(betaT * (By - Ay) + Ay - Py);
+    const bool top = rt && 0 <= betaT && betaT <= 1 && d2T <= rt2;
+
+    const bool hit =
+      inZ && valid && (side ? onSegment : (bottom || top));
+
+    out[i] = hit ? 1 : -1;
+  }
+}
@@ -30,6 +30,15 @@ namespace CAMotics {
     const double rb; // Radius 1
     const double Tm; // GCode::Tool slope
 
+    double plungeDepth(const cb::Vector3D &A, const cb::Vector3D &B,
+                       double Px, double Py, double Pz) const;
+    double planarDepth(const cb::Vector3D &A, const cb::Vector3D &B,
+                       double Px, double Py, double Pz) const;
+    cb::Vector3D plungeNormal(const cb::Vector3D &A, const cb::Vector3D &B,
+                              const cb::Vector3D &P) const;
+    cb::Vector3D planarNormal(const cb::Vector3D &A, const cb::Vector3D &B,
+                              const cb::Vector3D &P) const;
+
   public:
     ConicSweep(double length, double radius1, double radius2 = -1);
 
@@ -38,5 +47,11 @@ namespace CAMotics {
                    std::vector<cb::Rectangle3D> &bboxes, double tolerance) const;
     double depth(const cb::Vector3D &start, const cb::Vector3D &end,
                const cb::Vector3D &p) const;
+    void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+               const double *x, const double *y, const double *z,
+               unsigned n, double *out) const;
+    cb::Vector3D normal(const cb::Vector3D &start, const cb::Vector3D &end,
+                        const cb::Vector3D &p) const;
+    double getRadius() const {return rt < rb ? rb : rt;}
   };
 }
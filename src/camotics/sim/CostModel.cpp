@@ -0,0 +1,239 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "CostModel.h"
+#include "ToolSweep.h"
+
+#include <cbang/json/JSON.h>
+#include <cbang/io/InputSource.h>
+#include <cbang/os/SystemUtilities.h>
+
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Blocks sampled across the workpiece
+  const double blockCount = 32 * 32 * 32;
+
+
+  // Fit t = a * x + b * y by least squares.  Rates the samples cannot
+  // separate, or would make negative, are left as they were.
+  void fitRates(const vector<double> &x, const vector<double> &y,
+                const vector<double> &t, double &a, double &b) {
+    double sxx = 0, sxy = 0, syy = 0, sxt = 0, syt = 0;
+
+    for (unsigned i = 0; i < t.size(); i++) {
+      sxx += x[i] * x[i];
+      sxy += x[i] * y[i];
+      syy += y[i] * y[i];
+      sxt += x[i] * t[i];
+      syt += y[i] * t[i];
+    }
+
+    double det = sxx * syy - sxy * sxy;
+    if (1e-9 * sxx * syy < det) {
+      double fa = (sxt * syy - syt * sxy) / det;
+      double fb = (syt * sxx - sxt * sxy) / det;
+
+      if (0 < fa && 0 < fb) {
+        a = fa;
+        b = fb;
+        return;
+      }
+    }
+
+    // Keep a and fit b alone
+    if (syy) {
+      double fb = (syt - a * sxy) / syy;
+      if (0 < fb) b = fb;
+    }
+  }
+
+
+  bool fits(const CostModel &model, const CostModel::Features &features,
+            double timeBudget, double memoryBudget, double resolution) {
+    CostModel::Cost cost = model.estimate(features, resolution);
+
+    return (!timeBudget || cost.time <= timeBudget) &&
+      (!memoryBudget || cost.memory <= memoryBudget);
+  }
+}
+
+
+CostModel::CostModel() :
+  secPerMove(2e-6), secPerCell(2e-7), bytesPerMove(400), bytesPerSurface(200) {}
+
+
+CostModel::Features
+CostModel::measure(const SmartPointer<GCode::ToolPath> &path,
+                   const Rectangle3D &bounds, unsigned threads) {
+  Features features;
+  features.moves = path->size();
+  features.threads = threads ? threads : 1;
+
+  if (path->empty() || bounds.getVolume() <= 0) return features;
+
+  ToolSweep sweep(path, 0, numeric_limits<double>::max(),
+                  LookupMode::LOOKUP_AABB_TREE, threads);
+
+  // Cubic blocks, the last in each row may extend past the bounds
+  double size = pow(bounds.getVolume() / blockCount, 1.0 / 3.0);
+  Vector3D dims = bounds.getDimensions();
+  unsigned steps[3];
+  for (unsigned i = 0; i < 3; i++)
+    steps[i] = max(1.0, ceil(dims[i] / size));
+
+  vector<bool> reached(steps[0] * steps[1] * steps[2]);
+  uint64_t hits = 0;
+  unsigned count = 0;
+
+  for (unsigned z = 0; z < steps[2]; z++)
+    for (unsigned y = 0; y < steps[1]; y++)
+      for (unsigned x = 0; x < steps[0]; x++) {
+        Vector3D min = bounds.getMin() + Vector3D(x, y, z) * size;
+        Rectangle3D block(min, min + Vector3D(size));
+        unsigned n = sweep.intersections(block);
+        if (!n) continue;
+
+        reached[(z * steps[1] + y) * steps[0] + x] = true;
+        hits += n;
+        count++;
+      }
+
+  // Count faces between reached blocks and the rest
+  unsigned faces = 0;
+  for (unsigned z = 0; z < steps[2]; z++)
+    for (unsigned y = 0; y < steps[1]; y++)
+      for (unsigned x = 0; x < steps[0]; x++) {
+        if (!reached[(z * steps[1] + y) * steps[0] + x]) continue;
+
+        unsigned p[3] = {x, y, z};
+        for (unsigned axis = 0; axis < 3; axis++)
+          for (int d = -1; d <= 1; d += 2) {
+            // Stepping below zero wraps past the last block
+            unsigned q[3] = {p[0], p[1], p[2]};
+            q[axis] += d;
+
+            if (steps[axis] <= q[axis] ||
+                !reached[(q[2] * steps[1] + q[1]) * steps[0] + q[0]])
+              faces++;
+          }
+      }
+
+  features.volume = count * size * size * size;
+  features.area = faces * size * size;
+  features.density = count ? (double)hits / count : 0;
+
+  return features;
+}
+
+
+CostModel::Cost CostModel::estimate(const Features &features,
+                                    double resolution) const {
+  double cells = features.volume / (resolution * resolution * resolution);
+  double surface = features.area / (resolution * resolution);
+  Cost cost;
+
+  cost.time = features.moves * secPerMove +
+    cells * features.density * secPerCell / features.threads;
+  cost.memory = features.moves * bytesPerMove + surface * bytesPerSurface;
+
+  return cost;
+}
+
+
+double CostModel::fit(const Features &features, double timeBudget,
+                      double memoryBudget, double minRes,
+                      double maxRes) const {
+  if (fits(*this, features, timeBudget, memoryBudget, minRes)) return minRes;
+  if (!fits(*this, features, timeBudget, memoryBudget, maxRes)) return maxRes;
+
+  // Costs fall as the resolution coarsens, so bisect between a resolution
+  // which does not fit and one which does
+  double lo = log(minRes);
+  double hi = log(maxRes);
+
+  for (unsigned i = 0; i < 32; i++) {
+    double mid = (lo + hi) / 2;
+    if (fits(*this, features, timeBudget, memoryBudget, exp(mid))) hi = mid;
+    else lo = mid;
+  }
+
+  return exp(hi);
+}
+
+
+void CostModel::calibrate(const vector<Sample> &samples) {
+  vector<double> moves, cells, surface, time, memory;
+
+  for (unsigned i = 0; i < samples.size(); i++) {
+    const Features &f = samples[i].features;
+    double res = samples[i].resolution;
+
+    moves.push_back(f.moves);
+    cells.push_back(f.volume / (res * res * res) * f.density / f.threads);
+    surface.push_back(f.area / (res * res));
+    time.push_back(samples[i].cost.time);
+    memory.push_back(samples[i].cost.memory);
+  }
+
+  fitRates(moves, cells, time, secPerMove, secPerCell);
+  fitRates(moves, surface, memory, bytesPerMove, bytesPerSurface);
+}
+
+
+void CostModel::load(const string &filename) {
+  read(*JSON::Reader::parse(InputSource(filename)));
+}
+
+
+void CostModel::save(const string &filename) const {
+  SmartPointer<ostream> stream = SystemUtilities::oopen(filename);
+  JSON::Writer writer(*stream, 0, false);
+  write(writer);
+  writer.close();
+}
+
+
+void CostModel::read(const JSON::Value &value) {
+  CostModel defaults;
+
+  secPerMove = value.getNumber("sec_per_move", defaults.secPerMove);
+  secPerCell = value.getNumber("sec_per_cell", defaults.secPerCell);
+  bytesPerMove = value.getNumber("bytes_per_move", defaults.bytesPerMove);
+  bytesPerSurface =
+    value.getNumber("bytes_per_surface", defaults.bytesPerSurface);
+}
+
+
+void CostModel::write(JSON::Sink &sink) const {
+  sink.beginDict();
+  sink.insert("sec_per_move", secPerMove);
+  sink.insert("sec_per_cell", secPerCell);
+  sink.insert("bytes_per_move", bytesPerMove);
+  sink.insert("bytes_per_surface", bytesPerSurface);
+  sink.endDict();
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+#include <cbang/json/Serializable.h>
+
+#include <vector>
+
+
+namespace CAMotics {
+  /***
+   * Predicts the time and memory a simulation needs at a given resolution
+   * from features of the job which do not depend on it.  The rates start
+   * at rough defaults and are fitted to runs measured by simbench.
+   */
+  class CostModel : public cb::JSON::Serializable {
+  public:
+    struct Features {
+      double volume;     ///< Of the blocks reached by the sweeps of moves
+      double area;       ///< Of the boundary of the reached blocks
+      double density;    ///< Mean number of moves reaching a reached block
+      unsigned moves;
+      unsigned threads;
+
+      Features() : volume(0), area(0), density(0), moves(0), threads(1) {}
+    };
+
+    struct Cost {
+      double time;   ///< Seconds
+      double memory; ///< Bytes
+
+      Cost() : time(0), memory(0) {}
+    };
+
+    struct Sample {
+      Features features;
+      double resolution;
+      Cost cost; ///< Measured
+    };
+
+    double secPerMove;
+    double secPerCell;      ///< On one thread, per move reaching the cell
+    double bytesPerMove;
+    double bytesPerSurface; ///< For each cell crossed by the surface
+
+    CostModel();
+
+    /// Measure @param path over the workpiece @param bounds by sampling
+    /// a coarse grid of blocks with the lookup of the path's sweep.
+    static Features measure(const cb::SmartPointer<GCode::ToolPath> &path,
+                            const cb::Rectangle3D &bounds,
+                            unsigned threads = 1);
+
+    Cost estimate(const Features &features, double resolution) const;
+
+    /// @return the finest resolution between @param minRes and
+    /// @param maxRes predicted to fit within both budgets, or
+    /// @param maxRes if none does.  A budget of zero is no limit.
+    double fit(const Features &features, double timeBudget,
+               double memoryBudget, double minRes, double maxRes) const;
+
+    /// Fit the rates to @param samples by least squares.
+    void calibrate(const std::vector<Sample> &samples);
+
+    void load(const std::string &filename);
+    void save(const std::string &filename) const;
+
+    // From JSON::Serializable
+    void read(const cb::JSON::Value &value);
+    void write(cb::JSON::Sink &sink) const;
+  };
+}
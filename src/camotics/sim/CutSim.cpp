@@ -24,34 +24,135 @@
 #include "SurfaceTask.h"
 #include "ReduceTask.h"
 #include "AABBTree.h"
+#include "SimulationRun.h"
+#include "STLStreamer.h"
+#include "SurfaceCache.h"
+#include "ToolPathCache.h"
+
+#include <camotics/contour/Surface.h>
+
+#include <cbang/String.h>
+#include <cbang/log/Logger.h>
+#include <cbang/time/TimeInterval.h>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
-CutSim::CutSim() {}
+CutSim::CutSim() : numa(false) {}
 CutSim::~CutSim() {}
 
 
-SmartPointer<GCode::ToolPath> CutSim::computeToolPath(const Project &project) {
-  task = new ToolPathTask(project);
+SmartPointer<GCode::ToolPath>
+CutSim::computeToolPath(const Project &project,
+                        const SmartPointer<ToolPathCache> &cache) {
+  task = new ToolPathTask(project, cache);
   task->run();
   return task.cast<ToolPathTask>()->getPath();
 }
 
 
-SmartPointer<Surface> CutSim::computeSurface(const Simulation &sim) {
-  task = new SurfaceTask(sim);
+SmartPointer<Surface>
+CutSim::computeSurface(const Simulation &sim,
+                       const SmartPointer<SurfaceCache> &cache, bool resume) {
+  task = new SurfaceTask(sim, 0, cache);
+  task.cast<SurfaceTask>()->getSimRun()->setNUMA(numa);
+
+  if (resume && !cache.isNull() && !cache->getPath().empty())
+    task.cast<SurfaceTask>()->getSimRun()->setCheckpoint
+      (cache->getCheckpointFilename(sim));
+
+  task->run();
+  return task.cast<SurfaceTask>()->getSurface();
+}
+
+
+SmartPointer<Surface>
+CutSim::computeSurface(const SmartPointer<SimulationRun> &run) {
+  run->setNUMA(numa);
+  task = new SurfaceTask(run);
   task->run();
   return task.cast<SurfaceTask>()->getSurface();
 }
 
 
 
-void CutSim::reduceSurface(Surface &surface) {
-  task = new ReduceTask(surface);
+SmartPointer<Surface>
+CutSim::reduceSurface(const SmartPointer<Surface> &surface, unsigned threads,
+                      const ReduceTarget &target) {
+  task = new ReduceTask(surface, threads, target);
   task->run();
+  return task.cast<ReduceTask>()->getSurface();
+}
+
+
+uint64_t CutSim::streamSurface(const Simulation &sim, STL::Sink &sink,
+                               const string &checkpoint) {
+  task = new Task;
+  task->begin();
+
+  SimulationRun run(sim);
+  run.setCheckpoint(checkpoint);
+  run.setNUMA(numa);
+  STLStreamer streamer(sink);
+  streamer.start();
+
+  SmartPointer<Surface> surface;
+  try {
+    surface = run.stream(task, streamer);
+  } catch (...) {
+    streamer.finish();
+    throw;
+  }
+
+  streamer.finish();
+  uint64_t count = streamer.getCount();
+
+  // Height maps and tri-dexel models are computed whole
+  if (!surface.isNull()) {
+    surface->write(sink, task.get());
+    count += surface->getCount();
+  }
+
+  double delta = task->end();
+  LOG_INFO(1, "Time: " << TimeInterval(delta) << " Triangles: " << count);
+
+  return count;
+}
+
+
+uint64_t CutSim::computeBands(const Simulation &sim, unsigned bands,
+                              STL::Sink &sink, unsigned reduceThreads) {
+  task = new Task;
+  task->begin();
+
+  uint64_t count = 0;
+
+  for (unsigned i = 0; i < bands && !task->shouldQuit(); i++) {
+    task->update((double)i / bands, String::printf("Band %u of %u", i + 1,
+                                                   bands));
+
+    // Each band is freed before the next is computed.  Band edges are open
+    // so reducing locks them and the bands still meet.
+    SimulationRun run(sim);
+    run.setPartition(i, bands);
+    run.setNUMA(numa);
+
+    SmartPointer<Surface> surface = run.compute(task);
+    if (!surface.isNull() && reduceThreads)
+      surface = surface->reduce(*task, reduceThreads);
+    if (surface.isNull()) break;
+
+    surface->write(sink, task.get());
+    count += surface->getCount();
+  }
+
+  double delta = task->end();
+  LOG_INFO(1, "Time: " << TimeInterval(delta) << " Triangles: " << count
+           << " Bands: " << bands);
+
+  return count;
 }
 
 
@@ -20,28 +20,67 @@
 
 #pragma once
 
+#include <camotics/contour/ReduceTarget.h>
+
 #include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
 
 
 namespace GCode {class ToolPath;}
+namespace STL {class Sink;}
 
 namespace CAMotics {
   class Surface;
   class Project;
   class Simulation;
+  class SimulationRun;
   class Task;
+  class SurfaceCache;
+  class ToolPathCache;
 
 
   class CutSim {
     cb::SmartPointer<Task> task;
+    bool numa;
 
   public:
     CutSim();
     ~CutSim();
 
-    cb::SmartPointer<GCode::ToolPath> computeToolPath(const Project &project);
-    cb::SmartPointer<Surface> computeSurface(const Simulation &sim);
-    void reduceSurface(Surface &surface);
+    /// Place the render jobs of surfaces on NUMA nodes, see
+    /// Renderer::setNUMA().
+    void setNUMA(bool numa) {this->numa = numa;}
+
+    cb::SmartPointer<GCode::ToolPath>
+    computeToolPath(const Project &project,
+                    const cb::SmartPointer<ToolPathCache> &cache = 0);
+    /// If @param resume, grids are checkpointed in @param cache so an
+    /// interrupted computation can continue where it stopped.
+    cb::SmartPointer<Surface>
+    computeSurface(const Simulation &sim,
+                   const cb::SmartPointer<SurfaceCache> &cache = 0,
+                   bool resume = false);
+    /// Compute the surface at the run's end time, only recomputing what
+    /// changed since its last surface.
+    cb::SmartPointer<Surface>
+    computeSurface(const cb::SmartPointer<SimulationRun> &run);
+    cb::SmartPointer<Surface>
+    reduceSurface(const cb::SmartPointer<Surface> &surface,
+                  unsigned threads = 1,
+                  const ReduceTarget &target = ReduceTarget());
+    /// Write the facets of the surface to @param sink as it is computed.
+    /// Grids are checkpointed in the file @param checkpoint, if given.
+    /// @return the number of facets written.
+    uint64_t streamSurface(const Simulation &sim, STL::Sink &sink,
+                           const std::string &checkpoint = std::string());
+    /// Compute the surface one slab at a time, reducing each with
+    /// @param reduceThreads unless zero, and write it to @param sink before
+    /// the next, so only one band is ever held.
+    /// @return the number of facets written.
+    uint64_t computeBands(const Simulation &sim, unsigned bands,
+                          STL::Sink &sink, unsigned reduceThreads = 0);
 
     void interrupt();
   };
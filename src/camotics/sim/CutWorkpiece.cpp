@@ -58,7 +58,58 @@ bool CutWorkpiece::cull(const cb::Rectangle3D &r) const {
 }
 
 
+int CutWorkpiece::classify(const cb::Rectangle3D &r) const {
+  int sweep = toolSweep->classify(r);
+  if (!workpiece.isValid()) return sweep;
+
+  // Cut away or untouched
+  if (sweep == 1) return -1;
+  if (sweep == -1) return workpiece.classify(r);
+  return 0;
+}
+
+
 double CutWorkpiece::depth(const cb::Vector3D &p) const {
   if (!workpiece.isValid()) return toolSweep->depth(p);
   return min(workpiece.depth(p), -toolSweep->depth(p));
 }
+
+
+double CutWorkpiece::depthBefore(const cb::Vector3D &p, double time) const {
+  double d = workpiece.depth(p);
+  if (d < 0) return d; // Skip the lookup outside the stock
+  return min(d, -toolSweep->depthBefore(p, time));
+}
+
+
+void CutWorkpiece::beginSegment(const cb::Vector3D &a,
+                                const cb::Vector3D &b) const {
+  toolSweep->beginSegment(a, b);
+}
+
+
+double CutWorkpiece::segmentDepth(const cb::Vector3D &p) const {
+  if (!workpiece.isValid()) return toolSweep->segmentDepth(p);
+  return min(workpiece.depth(p), -toolSweep->segmentDepth(p));
+}
+
+
+cb::Vector3D CutWorkpiece::segmentNormal(const cb::Vector3D &p) const {
+  if (!workpiece.isValid()) return toolSweep->segmentNormal(p);
+
+  // A cut surface faces in to the cut, out of the material
+  if (-toolSweep->segmentDepth(p) < workpiece.depth(p))
+    return toolSweep->segmentNormal(p) * -1;
+
+  return workpiece.segmentNormal(p);
+}
+
+
+void CutWorkpiece::depth(const vector<cb::Vector3D> &points,
+                         vector<double> &depths) const {
+  toolSweep->depth(points, depths);
+
+  if (workpiece.isValid())
+    for (unsigned i = 0; i < points.size(); i++)
+      depths[i] = min(workpiece.depth(points[i]), -depths[i]);
+}
@@ -44,8 +44,18 @@ namespace CAMotics {
     bool isValid() const;
     cb::Rectangle3D getBounds() const;
 
+    /// @return the depth of @param p in the workpiece as it was at
+    /// @param time.  The workpiece must be valid.
+    double depthBefore(const cb::Vector3D &p, double time) const;
+
     // From FieldFunction
     bool cull(const cb::Rectangle3D &r) const;
+    int classify(const cb::Rectangle3D &r) const;
     double depth(const cb::Vector3D &p) const;
+    void depth(const std::vector<cb::Vector3D> &points,
+               std::vector<double> &depths) const;
+    void beginSegment(const cb::Vector3D &a, const cb::Vector3D &b) const;
+    double segmentDepth(const cb::Vector3D &p) const;
+    cb::Vector3D segmentNormal(const cb::Vector3D &p) const;
   };
 }
@@ -0,0 +1,333 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "Deviation.h"
+
+#include <stl/Reader.h>
+
+#include <cbang/Exception.h>
+#include <cbang/io/InputSource.h>
+#include <cbang/log/Logger.h>
+#include <cbang/geom/Rectangle.h>
+#include <cbang/os/Thread.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  const unsigned leafSize = 4;
+  const unsigned maxDepth = 128;
+
+  // Ties in distance within this fraction go to the better aligned face
+  const double tieEpsilon = 1e-6;
+
+
+  // Closest point to p on triangle abc, as in StockField
+  Vector3D closestOnTriangle(const Vector3D &p, const Vector3D &a,
+                             const Vector3D &b, const Vector3D &c) {
+    Vector3D ab = b - a, ac = c - a, ap = p - a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+
+    Vector3D bp = p - b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (0 <= d3 && d4 <= d3) return b;
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && 0 <= d1 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+    Vector3D cp = p - c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (0 <= d6 && d5 <= d6) return c;
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && 0 <= d2 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && 0 <= d4 - d3 && 0 <= d5 - d6)
+      return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    double denom = 1 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+  }
+
+
+  Vector3D toDouble(const Vector3F &v) {return Vector3D(v.x(), v.y(), v.z());}
+
+
+  class DistanceJob : public Thread {
+    const Deviation &deviation;
+    const vector<float> &points;
+    vector<float> &distances;
+    unsigned begin;
+    unsigned end;
+
+  public:
+    DistanceJob(const Deviation &deviation, const vector<float> &points,
+                vector<float> &distances, unsigned begin, unsigned end) :
+      deviation(deviation), points(points), distances(distances),
+      begin(begin), end(end) {}
+
+
+    void compute() {
+      for (unsigned i = begin; i < end; i++) {
+        const float *p = &points[i * 3];
+        distances[i] = deviation.distance(Vector3D(p[0], p[1], p[2]));
+      }
+    }
+
+
+    // From Thread
+    void run() {
+      try {
+        compute();
+      } CATCH_ERROR;
+    }
+  };
+}
+
+
+Deviation::Deviation(STL::Source &source) {
+  Vector3F v[3];
+  Vector3F normal;
+
+  while (source.hasMore()) {
+    source.readFacet(v[0], v[1], v[2], normal);
+
+    // The winding gives the normal, degenerate faces have none
+    Vector3F n = (v[1] - v[0]).cross(v[2] - v[0]);
+    double length = n.length();
+    if (!length) continue;
+
+    for (unsigned i = 0; i < 3; i++) vertices.push_back(v[i]);
+    normals.push_back(n / length);
+  }
+
+  if (normals.empty()) THROW("Design has no faces");
+
+  // Build the tree over the face centers
+  vector<uint32_t> faces(normals.size());
+  vector<Vector3F> centers(normals.size());
+  for (unsigned i = 0; i < faces.size(); i++) {
+    faces[i] = i;
+    centers[i] = (vertices[i * 3] + vertices[i * 3 + 1] +
+                  vertices[i * 3 + 2]) / 3;
+  }
+
+  build(faces, centers, 0, faces.size());
+
+  // Store the faces in tree order so each leaf's faces are together
+  vector<Vector3F> sortedVertices(vertices.size());
+  vector<Vector3F> sortedNormals(normals.size());
+  for (unsigned i = 0; i < faces.size(); i++) {
+    for (unsigned j = 0; j < 3; j++)
+      sortedVertices[i * 3 + j] = vertices[faces[i] * 3 + j];
+    sortedNormals[i] = normals[faces[i]];
+  }
+
+  vertices.swap(sortedVertices);
+  normals.swap(sortedNormals);
+
+  LOG_INFO(1, "Design " << normals.size() << " faces in " << nodes.size()
+           << " nodes");
+}
+
+
+SmartPointer<Deviation> Deviation::read(const string &filename) {
+  InputSource source(filename);
+  STL::Reader reader(source);
+  string name, hash;
+  reader.readHeader(name, hash);
+
+  return new Deviation(reader);
+}
+
+
+double Deviation::distance(const Vector3D &p) const {
+  double best = numeric_limits<double>::infinity();
+  double bestAlignment = -1;
+  double sign = 1;
+
+  uint32_t stack[maxDepth];
+  unsigned top = 0;
+  stack[top++] = 0;
+
+  while (top) {
+    const Node &node = nodes[stack[--top]];
+
+    // Distance squared to the node's bounds
+    double box = 0;
+    for (unsigned i = 0; i < 3; i++) {
+      double d = 0;
+      if (p[i] < node.min[i]) d = node.min[i] - p[i];
+      else if (node.max[i] < p[i]) d = p[i] - node.max[i];
+      box += d * d;
+    }
+
+    if (best * (1 + tieEpsilon) < box) continue;
+
+    if (!node.count) {
+      // Visit the nearer child first, it is pushed last
+      uint32_t index = &node - &nodes[0];
+      uint32_t children[2] = {index + 1, node.right};
+      double center[2];
+
+      for (unsigned i = 0; i < 2; i++) {
+        const Node &child = nodes[children[i]];
+        center[i] = 0;
+        for (unsigned j = 0; j < 3; j++) {
+          double d = (child.min[j] + child.max[j]) / 2 - p[j];
+          center[i] += d * d;
+        }
+      }
+
+      bool leftFirst = center[0] <= center[1];
+      if (maxDepth < top + 2) THROW("Design tree too deep");
+      stack[top++] = children[leftFirst ? 1 : 0];
+      stack[top++] = children[leftFirst ? 0 : 1];
+      continue;
+    }
+
+    for (unsigned i = node.first; i < node.first + node.count; i++) {
+      Vector3D q = closestOnTriangle(p, toDouble(vertices[i * 3]),
+                                     toDouble(vertices[i * 3 + 1]),
+                                     toDouble(vertices[i * 3 + 2]));
+      Vector3D d = p - q;
+      double d2 = d.lengthSquared();
+      if (best * (1 + tieEpsilon) < d2) continue;
+
+      // Near an edge or corner several faces are equally close, the one
+      // facing the point gives the right side
+      double dot = d.dot(toDouble(normals[i]));
+      double alignment = d2 ? fabs(dot) / sqrt(d2) : 1;
+
+      if (d2 < best * (1 - tieEpsilon) || bestAlignment < alignment) {
+        best = std::min(best, d2);
+        bestAlignment = alignment;
+        sign = dot < 0 ? -1 : 1;
+      }
+    }
+  }
+
+  return sign * sqrt(best);
+}
+
+
+void Deviation::compute(const vector<float> &points, vector<float> &distances,
+                        unsigned threads) const {
+  unsigned count = points.size() / 3;
+  distances.resize(count);
+
+  if (count < threads) threads = count;
+  if (!threads) threads = 1;
+
+  vector<SmartPointer<DistanceJob> > jobs;
+  for (unsigned i = 0; i < threads; i++)
+    jobs.push_back(new DistanceJob(*this, points, distances,
+                                   (uint64_t)count * i / threads,
+                                   (uint64_t)count * (i + 1) / threads));
+
+  try {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->start();
+    jobs[0]->compute();
+
+  } catch (...) {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+    throw;
+  }
+
+  for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+}
+
+
+void Deviation::colorMap(const vector<float> &distances, double tolerance,
+                         vector<uint8_t> &colors) {
+  const float within[3] = {40, 200, 40};
+  const float gouged[3] = {230, 30, 30};
+  const float left[3] = {40, 80, 230};
+
+  colors.reserve(colors.size() + distances.size() * 4);
+
+  for (unsigned i = 0; i < distances.size(); i++) {
+    double d = distances[i];
+    double t = 0 < tolerance ? fabs(d) / tolerance : (d ? 4 : 0);
+
+    // Fully shaded at four times the tolerance
+    double s = std::min(1.0, std::max(0.0, (t - 1) / 3));
+    const float *to = d < 0 ? gouged : left;
+
+    for (unsigned j = 0; j < 3; j++)
+      colors.push_back(within[j] + (to[j] - within[j]) * s);
+    colors.push_back(255);
+  }
+}
+
+
+unsigned Deviation::build(vector<uint32_t> &faces,
+                          const vector<Vector3F> &centers, unsigned begin,
+                          unsigned end) {
+  unsigned index = nodes.size();
+  nodes.push_back(Node());
+
+  cb::Rectangle3F bounds;
+  cb::Rectangle3F centerBounds;
+  for (unsigned i = begin; i < end; i++) {
+    for (unsigned j = 0; j < 3; j++) bounds.add(vertices[faces[i] * 3 + j]);
+    centerBounds.add(centers[faces[i]]);
+  }
+
+  Node &node = nodes[index];
+  for (unsigned i = 0; i < 3; i++) {
+    node.min[i] = bounds.getMin()[i];
+    node.max[i] = bounds.getMax()[i];
+  }
+
+  node.first = begin;
+  node.count = end - begin;
+  node.right = 0;
+  if (end - begin <= leafSize) return index;
+
+  // Split at the median center along the widest axis
+  Vector3F dims = centerBounds.getDimensions();
+  unsigned axis = 0;
+  for (unsigned i = 1; i < 3; i++)
+    if (dims[axis] < dims[i]) axis = i;
+
+  unsigned mid = (begin + end) / 2;
+  nth_element(faces.begin() + begin, faces.begin() + mid,
+              faces.begin() + end, [&centers, axis] (uint32_t a, uint32_t b) {
+                return centers[a][axis] < centers[b][axis];
+              });
+
+  nodes[index].count = 0;
+  build(faces, centers, begin, mid);
+  unsigned right = build(faces, centers, mid, end);
+  nodes[index].right = right;
+
+  return index;
+}
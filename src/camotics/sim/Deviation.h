@@ -0,0 +1,82 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+#include <cbang/geom/Vector.h>
+
+#include <string>
+#include <vector>
+
+
+namespace STL {class Source;}
+
+namespace CAMotics {
+  /***
+   * A design model, held in a bounding volume hierarchy, which simulated
+   * surfaces are compared against.  Distances are signed, positive where
+   * material was left outside the design and negative where it was gouged.
+   * The sign comes from the normal of the closest face, so the design must
+   * be a closed mesh with outward facing normals.
+   */
+  class Deviation {
+    struct Node {
+      float min[3];
+      float max[3];
+      uint32_t first; ///< First face of a leaf
+      uint32_t count; ///< Faces in a leaf, zero for inner nodes
+      uint32_t right; ///< Second child, the first follows its parent
+    };
+
+    std::vector<Node> nodes;
+    std::vector<cb::Vector3F> vertices; ///< Three per face, in tree order
+    std::vector<cb::Vector3F> normals;  ///< One per face
+
+  public:
+    Deviation(STL::Source &source);
+
+    static cb::SmartPointer<Deviation> read(const std::string &filename);
+
+    unsigned getFaceCount() const {return normals.size();}
+
+    /// @return the signed distance from @param p to the design.
+    double distance(const cb::Vector3D &p) const;
+
+    /// Compute the distance of each point in @param points, given as three
+    /// floats each, on up to @param threads threads.
+    void compute(const std::vector<float> &points,
+                 std::vector<float> &distances, unsigned threads = 1) const;
+
+    /// Color distances within @param tolerance green, shading to red where
+    /// the design was gouged and to blue where material was left.  Four
+    /// bytes, RGBA, are appended to @param colors for each distance.
+    static void colorMap(const std::vector<float> &distances, double tolerance,
+                         std::vector<uint8_t> &colors);
+
+  protected:
+    unsigned build(std::vector<uint32_t> &faces,
+                   const std::vector<cb::Vector3F> &centers, unsigned begin,
+                   unsigned end);
+  };
+}
@@ -0,0 +1,179 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "ExportTask.h"
+#include "ToolPathFile.h"
+
+#include <camotics/contour/Surface.h>
+
+#include <cbang/Exception.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/json/Writer.h>
+#include <cbang/log/Logger.h>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Counts the moves ToolPath::write() appends, one dict each, to report
+  // progress and stop early
+  class ProgressWriter : public JSON::Writer {
+    Task &task;
+    double total;
+    uint64_t count;
+
+  public:
+    ProgressWriter(ostream &stream, bool compact, Task &task, uint64_t total) :
+      JSON::Writer(stream, 0, compact), task(task), total(total), count(0) {}
+
+    // From JSON::Writer
+    void appendDict(bool simple = false) {
+      if (!(++count & 0xfff)) {
+        if (task.shouldQuit()) THROW("Interrupted");
+        task.update(count / total, "Writing tool path");
+      }
+
+      JSON::Writer::appendDict(simple);
+    }
+  };
+}
+
+
+void ExportTask::setSurface(const SmartPointer<Surface> &surface,
+                            const string &hash) {
+  this->surface = surface;
+  this->hash = hash;
+}
+
+
+void ExportTask::setGCode(const SmartPointer<vector<char> > &gcode) {
+  this->gcode = gcode;
+}
+
+
+void ExportTask::setSimulation(const Simulation &sim) {
+  this->sim = new Simulation(sim);
+}
+
+
+void ExportTask::run() {
+  LOG_INFO(1, "Exporting " << filename);
+  update(0, "Exporting");
+
+  string tmp = filename + ".tmp";
+
+  try {
+    if (format == PATH_BINARY) {
+      if (sim.isNull() || sim->path.isNull()) THROW("No tool path");
+      // Already written through a temporary file
+      ToolPathFile::write(filename, *sim->path);
+
+    } else {
+      {
+        SmartPointer<ostream> stream = SystemUtilities::oopen(tmp);
+        write(*stream);
+        stream->flush();
+        if (stream->fail()) THROWS("Failed to write '" << tmp << "'");
+      }
+
+      if (shouldQuit()) THROW("Interrupted");
+      SystemUtilities::rename(tmp, filename);
+    }
+
+    LOG_INFO(1, "Exported " << filename);
+
+  } catch (const Exception &e) {
+    if (!shouldQuit()) {
+      error = e.getMessage();
+      LOG_ERROR("Export to '" << filename << "' failed: " << error);
+    }
+
+    if (SystemUtilities::exists(tmp)) SystemUtilities::unlink(tmp);
+  }
+}
+
+
+void ExportTask::write(ostream &stream) {
+  switch (format) {
+  case STL_BINARY: case STL_ASCII:
+    if (surface.isNull()) THROW("No surface");
+    surface->writeSTL(stream, format == STL_BINARY, "CAMotics Surface", hash,
+                      this);
+    break;
+
+  case GLTF:
+    if (surface.isNull()) THROW("No surface");
+    update(0, "Writing glTF surface");
+    surface->writeGLTF(stream, "CAMotics Surface", 2);
+    break;
+
+  case GCODE:
+    if (gcode.isNull()) THROW("No GCode");
+    if (!gcode->empty()) stream.write(&gcode->front(), gcode->size());
+    break;
+
+  case JSON_COMPACT: case JSON_PRETTY:
+    writeJSON(stream, format == JSON_COMPACT);
+    break;
+
+  case PATH_CSV: writeCSV(stream); break;
+  case PATH_BINARY: THROW("Binary paths are not streamed");
+  }
+}
+
+
+void ExportTask::writeJSON(ostream &stream, bool compact) {
+  if (sim.isNull()) THROW("No simulation");
+
+  uint64_t moves = sim->path.isNull() ? 0 : sim->path->size();
+  ProgressWriter writer(stream, compact, *this, moves ? moves : 1);
+  sim->write(writer, true);
+  writer.close();
+}
+
+
+void ExportTask::writeCSV(ostream &stream) {
+  if (sim.isNull() || sim->path.isNull()) THROW("No tool path");
+  const GCode::ToolPath &path = *sim->path;
+
+  stream.precision(10);
+  stream << "line,tool,type,start,time,feed,speed";
+  for (unsigned j = 0; j < 9; j++) stream << ',' << GCode::Axes::toAxis(j);
+  stream << '\n';
+
+  for (unsigned i = 0; i < path.size(); i++) {
+    if (!(i & 0xfff)) {
+      if (shouldQuit()) THROW("Interrupted");
+      update((double)i / path.size(), "Writing tool path CSV");
+    }
+
+    const GCode::Move &move = path.at(i);
+    GCode::Axes end = move.getEnd();
+
+    stream << move.getLine() << ',' << move.getTool() << ','
+           << move.getType().toString() << ',' << move.getStartTime() << ','
+           << move.getTime() << ',' << move.getFeed() << ','
+           << move.getSpeed();
+    for (unsigned j = 0; j < 9; j++) stream << ',' << end[j];
+    stream << '\n';
+  }
+}
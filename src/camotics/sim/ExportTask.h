@@ -0,0 +1,90 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Simulation.h"
+
+#include <camotics/Task.h>
+
+#include <cbang/SmartPointer.h>
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+
+namespace CAMotics {
+  class Surface;
+
+  /***
+   * Writes a surface, GCode or simulation data to a file off the GUI
+   * thread.  Output goes to a temporary file which replaces the target
+   * only once complete, so an interrupted or failed export leaves any
+   * earlier file in place.
+   */
+  class ExportTask : public Task {
+  public:
+    typedef enum {
+      STL_BINARY,
+      STL_ASCII,
+      GLTF,
+      GCODE,
+      JSON_COMPACT,
+      JSON_PRETTY,
+      PATH_CSV,    ///< One row per move, for spreadsheets
+      PATH_BINARY, ///< ToolPathFile format
+    } format_t;
+
+  protected:
+    std::string filename;
+    format_t format;
+
+    cb::SmartPointer<Surface> surface;
+    cb::SmartPointer<std::vector<char> > gcode;
+    cb::SmartPointer<Simulation> sim;
+    std::string hash;
+
+    std::string error;
+
+  public:
+    ExportTask(const std::string &filename, format_t format) :
+      filename(filename), format(format) {}
+
+    /// The sources are shared, not copied, and must not change meanwhile.
+    void setSurface(const cb::SmartPointer<Surface> &surface,
+                    const std::string &hash = std::string());
+    void setGCode(const cb::SmartPointer<std::vector<char> > &gcode);
+    void setSimulation(const Simulation &sim);
+
+    const std::string &getFilename() const {return filename;}
+    /// @return why the export failed or an empty string.
+    const std::string &getError() const {return error;}
+
+    // From Task
+    void run();
+
+  protected:
+    void write(std::ostream &stream);
+    void writeJSON(std::ostream &stream, bool compact);
+    void writeCSV(std::ostream &stream);
+  };
+}
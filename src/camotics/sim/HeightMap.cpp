@@ -0,0 +1,360 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "HeightMap.h"
+
+#include <camotics/Grid.h>
+#include <camotics/Task.h>
+#include <camotics/contour/TriangleSurface.h>
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  inline double sqr(double x) {return x * x;}
+
+
+  // Height of the tool surface above the tool tip at radial distance @param d
+  // or -1 if the tool does not reach that far.
+  double profile(const GCode::Tool &tool, double d) {
+    const double r = tool.getRadius();
+    if (r < d) return -1;
+
+    switch (tool.getShape()) {
+    case GCode::ToolShape::TS_CYLINDRICAL: return 0;
+    case GCode::ToolShape::TS_CONICAL: return d / r * tool.getLength();
+    case GCode::ToolShape::TS_BALLNOSE: return r - sqrt(r * r - d * d);
+
+    case GCode::ToolShape::TS_SNUBNOSE: {
+      const double rb = tool.getSnubDiameter() / 2;
+      if (d <= rb) return 0;
+      return (d - rb) / (r - rb) * tool.getLength();
+    }
+
+    default: THROWS("Height map does not support tool shape "
+                    << tool.getShape());
+    }
+  }
+
+
+  void addQuad(TriangleSurface &surface, const Vector3F &a, const Vector3F &b,
+               const Vector3F &c, const Vector3F &d, const Vector3F &normal) {
+    const Vector3F t1[3] = {a, b, c};
+    const Vector3F t2[3] = {a, c, d};
+    surface.add(t1, normal);
+    surface.add(t2, normal);
+  }
+}
+
+
+HeightMap::HeightMap(const cb::Rectangle3D &bounds, double resolution) :
+  bounds(bounds), resolution(resolution), time(0), removed(0) {
+  if (resolution <= 0) THROWS("Invalid height map resolution " << resolution);
+
+  width = ceil(bounds.getDimensions().x() / resolution) + 1;
+  height = ceil(bounds.getDimensions().y() / resolution) + 1;
+  heights.resize(width * height, bounds.getMax().z());
+}
+
+
+bool HeightMap::isSupported(const GCode::Tool &tool) {
+  switch (tool.getShape()) {
+  case GCode::ToolShape::TS_CYLINDRICAL:
+  case GCode::ToolShape::TS_CONICAL:
+  case GCode::ToolShape::TS_BALLNOSE:
+    return true;
+
+  case GCode::ToolShape::TS_SNUBNOSE:
+    // Wider at the tip than at the top would undercut
+    return tool.getSnubDiameter() <= 2 * tool.getRadius();
+
+  default: return false; // Spheroids are narrower above their middle
+  }
+}
+
+
+bool HeightMap::isSupported(const GCode::ToolPath &path) {
+  for (unsigned i = 0; i < path.size(); i++) {
+    const GCode::Tool *tool = path.getTool(path[i]);
+    if (tool && !isSupported(*tool)) return false;
+  }
+
+  return true;
+}
+
+
+void HeightMap::cut(const GCode::ToolPath &path, double time, Task *task) {
+  if (time < this->time) THROWS("Cannot uncut height map from time "
+                                << this->time << " to " << time);
+
+  int first = path.find(this->time);
+  if (first == -1) {
+    this->time = time;
+    return;
+  }
+
+  for (unsigned i = first; i < path.size(); i++) {
+    const GCode::Move &move = path[i];
+    if (time <= move.getStartTime()) break;
+
+    // Cutting is idempotent so after an interrupt we can resume here
+    if (task && (i & 1023) == 0) {
+      if (task->shouldQuit()) {
+        this->time = max(this->time, move.getStartTime());
+        return;
+      }
+
+      double total = time - this->time;
+      if (total) task->update((move.getStartTime() - this->time) / total,
+                              "Cutting height map");
+    }
+
+    const GCode::Tool *tool = path.getTool(move);
+    if (!tool) continue;
+
+    removed = 0;
+
+    if (!move.isArc())
+      cut(*tool, move.getPtAtTime(this->time), move.getPtAtTime(time));
+
+    else {
+      // Cut arcs as chords within half the grid resolution of the arc
+      double u0 = move.getFractionAtTime(this->time);
+      double u1 = move.getFractionAtTime(time);
+      double radius = move.getRadius();
+      double error = min(resolution / 2, radius);
+      double step = min(2 * M_PI / 3, 2 * acos(1 - error / radius));
+      unsigned segments = ceil(fabs(move.getAngle()) * (u1 - u0) / step);
+
+      for (unsigned j = 0; j < segments; j++)
+        cut(*tool, move.getPtAt(u0 + (u1 - u0) * j / segments),
+            move.getPtAt(u0 + (u1 - u0) * (j + 1) / segments));
+    }
+
+    // Removal is recorded as the moves are cut so it costs no extra pass
+    if (removal.size() < path.size()) removal.resize(path.size());
+    Removal &r = removal[i];
+    r.volume += removed * resolution * resolution;
+    r.time += min(time, move.getEndTime()) -
+      max(this->time, move.getStartTime());
+    r.engagement = getEngagement(*tool, move.getPtAtTime(time));
+  }
+
+  this->time = time;
+}
+
+
+void HeightMap::cut(const GCode::Tool &tool, const cb::Vector3D &start,
+                    const cb::Vector3D &end) {
+  const double r = tool.getRadius();
+  if (r <= 0) return;
+
+  const double dx = end.x() - start.x();
+  const double dy = end.y() - start.y();
+  const double lenXY = sqrt(dx * dx + dy * dy);
+
+  if (!lenXY) {
+    // Plunge or retract, only the lowest point matters
+    stamp(tool, start.z() < end.z() ? start : end);
+    return;
+  }
+
+  if (start.z() != end.z()) {
+    // Ramp, stamp the tool at sub-steps of half the grid resolution
+    unsigned steps = ceil(lenXY / (resolution / 2));
+
+    for (unsigned i = 0; i <= steps; i++)
+      stamp(tool, start + (end - start) * ((double)i / steps));
+
+    return;
+  }
+
+  // Planar move, exact distance from each vertex to the tool path
+  const cb::Vector3D &offset = bounds.getMin();
+  unsigned x0, x1, y0, y1;
+
+  if (!Grid::vertexRange(min(start.x(), end.x()) - r,
+                         max(start.x(), end.x()) + r, offset.x(), resolution,
+                         width, x0, x1) ||
+      !Grid::vertexRange(min(start.y(), end.y()) - r,
+                         max(start.y(), end.y()) + r, offset.y(), resolution,
+                         height, y0, y1)) return;
+
+  const double len2 = lenXY * lenXY;
+
+  for (unsigned y = y0; y <= y1; y++) {
+    const double py = offset.y() + y * resolution - start.y();
+
+    for (unsigned x = x0; x <= x1; x++) {
+      const double px = offset.x() + x * resolution - start.x();
+
+      double t = (px * dx + py * dy) / len2;
+      t = t < 0 ? 0 : (1 < t ? 1 : t);
+
+      double d = sqrt(sqr(px - t * dx) + sqr(py - t * dy));
+      double h = profile(tool, d);
+
+      if (0 <= h) lower(x, y, start.z() + h);
+    }
+  }
+}
+
+
+SmartPointer<Surface> HeightMap::getSurface() const {
+  SmartPointer<TriangleSurface> surface = new TriangleSurface;
+
+  const cb::Vector3D &offset = bounds.getMin();
+  const float zMin = bounds.getMin().z();
+  const float x0 = offset.x(), y0 = offset.y();
+  const float r = resolution;
+
+  // Top
+  for (unsigned y = 0; y + 1 < height; y++)
+    for (unsigned x = 0; x + 1 < width; x++) {
+      Vector3F a(x0 + x * r, y0 + y * r, max(zMin, at(x, y)));
+      Vector3F b(x0 + (x + 1) * r, y0 + y * r, max(zMin, at(x + 1, y)));
+      Vector3F c(x0 + (x + 1) * r, y0 + (y + 1) * r,
+                 max(zMin, at(x + 1, y + 1)));
+      Vector3F d(x0 + x * r, y0 + (y + 1) * r, max(zMin, at(x, y + 1)));
+
+      const Vector3F t1[3] = {a, b, c};
+      const Vector3F t2[3] = {a, c, d};
+      surface->add(t1);
+      surface->add(t2);
+    }
+
+  // Sides
+  const float x1 = x0 + (width - 1) * r, y1 = y0 + (height - 1) * r;
+
+  for (unsigned x = 0; x + 1 < width; x++) {
+    const float xa = x0 + x * r, xb = x0 + (x + 1) * r;
+    float za, zb;
+
+    za = max(zMin, at(x, 0)); zb = max(zMin, at(x + 1, 0));
+    if (zMin < za || zMin < zb)
+      addQuad(*surface, Vector3F(xa, y0, zMin), Vector3F(xb, y0, zMin),
+              Vector3F(xb, y0, zb), Vector3F(xa, y0, za), Vector3F(0, -1, 0));
+
+    za = max(zMin, at(x, height - 1)); zb = max(zMin, at(x + 1, height - 1));
+    if (zMin < za || zMin < zb)
+      addQuad(*surface, Vector3F(xb, y1, zMin), Vector3F(xa, y1, zMin),
+              Vector3F(xa, y1, za), Vector3F(xb, y1, zb), Vector3F(0, 1, 0));
+  }
+
+  for (unsigned y = 0; y + 1 < height; y++) {
+    const float ya = y0 + y * r, yb = y0 + (y + 1) * r;
+    float za, zb;
+
+    za = max(zMin, at(0, y)); zb = max(zMin, at(0, y + 1));
+    if (zMin < za || zMin < zb)
+      addQuad(*surface, Vector3F(x0, yb, zMin), Vector3F(x0, ya, zMin),
+              Vector3F(x0, ya, za), Vector3F(x0, yb, zb), Vector3F(-1, 0, 0));
+
+    za = max(zMin, at(width - 1, y)); zb = max(zMin, at(width - 1, y + 1));
+    if (zMin < za || zMin < zb)
+      addQuad(*surface, Vector3F(x1, ya, zMin), Vector3F(x1, yb, zMin),
+              Vector3F(x1, yb, zb), Vector3F(x1, ya, za), Vector3F(1, 0, 0));
+  }
+
+  // Bottom
+  addQuad(*surface, Vector3F(x0, y0, zMin), Vector3F(x0, y1, zMin),
+          Vector3F(x1, y1, zMin), Vector3F(x1, y0, zMin), Vector3F(0, 0, -1));
+
+  return surface;
+}
+
+
+void HeightMap::writeRemoval(ostream &stream,
+                             const GCode::ToolPath &path) const {
+  stream << "line,volume,time,rate,engagement\n";
+
+  // Moves of one line are consecutive, engagement is the line's largest
+  unsigned count = min(removal.size(), path.size());
+  unsigned i = 0;
+
+  while (i < count) {
+    unsigned line = path[i].getLine();
+    Removal total;
+
+    for (; i < count && path[i].getLine() == line; i++) {
+      total.volume += removal[i].volume;
+      total.time += removal[i].time;
+      total.engagement = max(total.engagement, removal[i].engagement);
+    }
+
+    stream << line + 1 << ',' << total.volume << ',' << total.time << ','
+           << total.getRate() << ',' << total.engagement << '\n';
+  }
+}
+
+
+double HeightMap::getEngagement(const GCode::Tool &tool,
+                                const cb::Vector3D &p) const {
+  // Sample a ring one grid step outside the tool, ignoring the floor below
+  const unsigned samples = 72;
+  const double r = tool.getRadius() + resolution;
+  const double minZ = max(p.z() + resolution / 2, bounds.getMin().z());
+  const cb::Vector3D &offset = bounds.getMin();
+  unsigned engaged = 0;
+
+  for (unsigned i = 0; i < samples; i++) {
+    double a = 2 * M_PI * i / samples;
+    double x = round((p.x() + r * cos(a) - offset.x()) / resolution);
+    double y = round((p.y() + r * sin(a) - offset.y()) / resolution);
+
+    if (x < 0 || y < 0 || width <= x || height <= y) continue;
+    if (minZ < at((unsigned)x, (unsigned)y)) engaged++;
+  }
+
+  return 360.0 * engaged / samples;
+}
+
+
+void HeightMap::stamp(const GCode::Tool &tool, const cb::Vector3D &p) {
+  const double r = tool.getRadius();
+  const cb::Vector3D &offset = bounds.getMin();
+  unsigned x0, x1, y0, y1;
+
+  if (!Grid::vertexRange(p.x() - r, p.x() + r, offset.x(), resolution, width,
+                         x0, x1) ||
+      !Grid::vertexRange(p.y() - r, p.y() + r, offset.y(), resolution, height,
+                         y0, y1))
+    return;
+
+  for (unsigned y = y0; y <= y1; y++) {
+    const double py = offset.y() + y * resolution - p.y();
+
+    for (unsigned x = x0; x <= x1; x++) {
+      const double px = offset.x() + x * resolution - p.x();
+      double h = profile(tool, sqrt(px * px + py * py));
+
+      if (0 <= h) lower(x, y, p.z() + h);
+    }
+  }
+}
@@ -0,0 +1,111 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+#include <iostream>
+
+
+namespace GCode {
+  class Tool;
+  class ToolPath;
+}
+
+namespace CAMotics {
+  class Surface;
+  class Task;
+
+  /// A 2.5D model of the workpiece which stores the top of the material at
+  /// each XY grid vertex.  Much cheaper than contouring the full volume but
+  /// it cannot represent undercuts so only tools which cut straight down,
+  /// without a wider part above a narrower one, can be simulated with it.
+  class HeightMap {
+  public:
+    /// The material removed by one move, as far as it has been cut.
+    struct Removal {
+      double volume;
+      double time;       ///< Time spent cutting
+      double engagement; ///< Degrees of the tool's edge in material at end
+
+      Removal() : volume(0), time(0), engagement(0) {}
+
+      double getRate() const {return time ? volume / time : 0;}
+    };
+
+  protected:
+    cb::Rectangle3D bounds;
+    double resolution;
+    unsigned width;
+    unsigned height;
+    std::vector<float> heights;
+    double time;
+
+    std::vector<Removal> removal; ///< By move
+    double removed; ///< Volume over grid cell area since last cleared
+
+  public:
+    HeightMap(const cb::Rectangle3D &bounds, double resolution);
+
+    const cb::Rectangle3D &getBounds() const {return bounds;}
+    double getResolution() const {return resolution;}
+    double getTime() const {return time;}
+    const std::vector<Removal> &getRemoval() const {return removal;}
+    uint64_t getMemoryUsage() const
+    {return heights.capacity() * sizeof(float) +
+        removal.capacity() * sizeof(Removal);}
+
+    static bool isSupported(const GCode::Tool &tool);
+    static bool isSupported(const GCode::ToolPath &path);
+
+    /// Cut all moves between the current time and @param time.
+    void cut(const GCode::ToolPath &path, double time, Task *task = 0);
+    void cut(const GCode::Tool &tool, const cb::Vector3D &start,
+             const cb::Vector3D &end);
+
+    cb::SmartPointer<Surface> getSurface() const;
+
+    /// Write the removal of each program line, as CSV, to @param stream.
+    void writeRemoval(std::ostream &stream,
+                      const GCode::ToolPath &path) const;
+
+    /// @return the degrees of the edge of @param tool, at @param p, which
+    /// touch material.
+    double getEngagement(const GCode::Tool &tool, const cb::Vector3D &p) const;
+
+  protected:
+    float &at(unsigned x, unsigned y) {return heights[y * width + x];}
+    float at(unsigned x, unsigned y) const {return heights[y * width + x];}
+
+    void lower(unsigned x, unsigned y, float z) {
+      float &h = at(x, y);
+      if (h <= z) return;
+      float floor = bounds.getMin().z();
+      if (floor < h) removed += h - (z < floor ? floor : z);
+      h = z;
+    }
+
+    void stamp(const GCode::Tool &tool, const cb::Vector3D &p);
+  };
+}
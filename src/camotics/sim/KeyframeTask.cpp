@@ -0,0 +1,66 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "KeyframeTask.h"
+#include "SurfaceCache.h"
+#include "SimulationRun.h"
+
+#include <camotics/contour/Surface.h>
+
+#include <cbang/time/TimeInterval.h>
+#include <cbang/log/Logger.h>
+
+using namespace cb;
+using namespace CAMotics;
+
+
+KeyframeTask::KeyframeTask(const Simulation &sim,
+                           const SmartPointer<SurfaceCache> &cache,
+                           bool loadOnly) :
+  sim(sim), cache(cache), loadOnly(loadOnly) {}
+
+
+KeyframeTask::~KeyframeTask() {}
+
+
+void KeyframeTask::run() {
+  Task::begin();
+
+  surface = cache->load(sim);
+  if (!surface.isNull() || loadOnly) {
+    Task::end();
+    return;
+  }
+
+  SimulationRun simRun(sim);
+  surface = simRun.compute(SmartPointer<Task>::Phony(this));
+
+  if (shouldQuit()) {
+    surface.release();
+    Task::end();
+    return;
+  }
+
+  if (!surface.isNull()) cache->store(sim, *surface);
+
+  double delta = Task::end();
+  LOG_INFO(2, "Keyframe at " << TimeInterval(sim.time) << " simulated in "
+           << TimeInterval(delta));
+}
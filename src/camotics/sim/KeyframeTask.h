@@ -0,0 +1,61 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Simulation.h"
+
+#include <camotics/Task.h>
+
+#include <cbang/SmartPointer.h>
+
+
+namespace CAMotics {
+  class Surface;
+  class SurfaceCache;
+
+
+  /***
+   * Simulates a surface ahead of time so it is in the cache by the time the
+   * user moves there.  With @param loadOnly it only loads a surface already
+   * in the cache, so it can be shown while the incremental SurfaceTask for
+   * the same time catches up.
+   */
+  class KeyframeTask : public Task {
+    Simulation sim;
+    cb::SmartPointer<SurfaceCache> cache;
+    bool loadOnly;
+    cb::SmartPointer<Surface> surface;
+
+  public:
+    KeyframeTask(const Simulation &sim,
+                 const cb::SmartPointer<SurfaceCache> &cache,
+                 bool loadOnly = false);
+    ~KeyframeTask();
+
+    const Simulation &getSimulation() const {return sim;}
+    bool isLoadOnly() const {return loadOnly;}
+    const cb::SmartPointer<Surface> &getSurface() const {return surface;}
+
+    // From Task
+    void run();
+  };
+}
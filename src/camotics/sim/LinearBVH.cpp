@@ -0,0 +1,434 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "LinearBVH.h"
+
+#include <camotics/view/GL.h>
+#include <camotics/view/BoundsView.h>
+
+#include <cbang/Exception.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Every path through the tree makes at most 30 Morton bit splits plus at
+  // most 32 median splits, and each level pushes at most WIDTH - 1 siblings.
+  const unsigned STACK_SIZE = 64 * LinearBVH::WIDTH;
+
+
+  // Round outward so the float box always contains the double box
+  inline float roundDown(double x) {
+    float f = (float)x;
+    return x < f ? nextafterf(f, -numeric_limits<float>::max()) : f;
+  }
+
+
+  inline float roundUp(double x) {
+    float f = (float)x;
+    return f < x ? nextafterf(f, numeric_limits<float>::max()) : f;
+  }
+
+
+  // Spread the lower 10 bits of v so there are two zero bits between each
+  inline uint32_t expandBits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xff0000ffu;
+    v = (v * 0x00000101u) & 0x0f00f00fu;
+    v = (v * 0x00000011u) & 0xc30c30c3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+  }
+
+
+  inline uint32_t quantize(double x) {
+    return x <= 0 ? 0 : (1023 <= x ? 1023 : (uint32_t)x);
+  }
+
+
+  // Returns the index of the first code in the upper half of the range
+  unsigned findSplit(const vector<uint32_t> &codes, unsigned first,
+                     unsigned last) {
+    uint32_t a = codes[first];
+    uint32_t b = codes[last - 1];
+
+    // Identical codes, split in the middle
+    if (a == b) return (first + last) / 2;
+
+    // Find the highest differing bit
+    uint32_t mask = 1u << 31;
+    while (!((a ^ b) & mask)) mask >>= 1;
+
+    // Binary search for the first code with that bit set
+    unsigned lo = first;
+    unsigned hi = last - 1;
+
+    while (lo + 1 < hi) {
+      unsigned mid = (lo + hi) / 2;
+      if (codes[mid] & mask) hi = mid;
+      else lo = mid;
+    }
+
+    return hi;
+  }
+
+
+  template <typename T>
+  void permute(vector<T> &v, const vector<pair<uint32_t, uint32_t> > &order) {
+    vector<T> tmp(v.size());
+    for (unsigned i = 0; i < order.size(); i++) tmp[i] = v[order[i].second];
+    v.swap(tmp);
+  }
+}
+
+
+LinearBVH::Node::Node() {
+  // Empty slots get inverted bounds so they never pass a test
+  for (unsigned i = 0; i < WIDTH; i++) {
+    minX[i] = minY[i] = minZ[i] = numeric_limits<float>::max();
+    maxX[i] = maxY[i] = maxZ[i] = -numeric_limits<float>::max();
+    child[i] = count[i] = 0;
+  }
+}
+
+
+unsigned LinearBVH::getTreeHeight() const {
+  return nodes.empty() ? 0 : getTreeHeight(0);
+}
+
+
+uint64_t LinearBVH::getMemoryUsage() const {
+  return sizeof(LinearBVH) + nodes.capacity() * sizeof(Node) +
+    moves.capacity() * sizeof(const GCode::Move *) +
+    (minX.capacity() + minY.capacity() + minZ.capacity() + maxX.capacity() +
+     maxY.capacity() + maxZ.capacity()) * sizeof(float);
+}
+
+
+cb::Rectangle3D LinearBVH::getBounds() const {
+  if (!finalized) THROWS("LinearBVH not yet finalized");
+  return bounds;
+}
+
+
+void LinearBVH::insert(const GCode::Move *move, const cb::Rectangle3D &bbox) {
+  if (finalized) THROWS("Cannot insert into LinearBVH after finalizing");
+
+  moves.push_back(move);
+  minX.push_back(roundDown(bbox.getMin().x()));
+  minY.push_back(roundDown(bbox.getMin().y()));
+  minZ.push_back(roundDown(bbox.getMin().z()));
+  maxX.push_back(roundUp(bbox.getMax().x()));
+  maxY.push_back(roundUp(bbox.getMax().y()));
+  maxZ.push_back(roundUp(bbox.getMax().z()));
+
+  bounds.add(bbox);
+}
+
+
+bool LinearBVH::intersects(const cb::Rectangle3D &r) const {
+  return intersections(r, 1);
+}
+
+
+unsigned LinearBVH::intersections(const cb::Rectangle3D &r) const {
+  return intersections(r, ~0U);
+}
+
+
+unsigned LinearBVH::intersections(const cb::Rectangle3D &r,
+                                  unsigned limit) const {
+  if (!finalized) THROWS("LinearBVH not yet finalized");
+  if (nodes.empty()) return 0;
+
+  const float rMinX = roundDown(r.getMin().x());
+  const float rMinY = roundDown(r.getMin().y());
+  const float rMinZ = roundDown(r.getMin().z());
+  const float rMaxX = roundUp(r.getMax().x());
+  const float rMaxY = roundUp(r.getMax().y());
+  const float rMaxZ = roundUp(r.getMax().z());
+
+  uint32_t stack[STACK_SIZE];
+  unsigned top = 0;
+  unsigned count = 0;
+  stack[top++] = 0;
+
+  while (top) {
+    const Node &node = nodes[stack[--top]];
+
+    for (unsigned i = 0; i < WIDTH; i++) {
+      if (rMaxX < node.minX[i] || node.maxX[i] < rMinX ||
+          rMaxY < node.minY[i] || node.maxY[i] < rMinY ||
+          rMaxZ < node.minZ[i] || node.maxZ[i] < rMinZ) continue;
+
+      if (!node.count[i]) {
+        stack[top++] = node.child[i];
+        continue;
+      }
+
+      unsigned end = node.child[i] + node.count[i];
+      for (unsigned j = node.child[i]; j < end; j++)
+        if (minX[j] <= rMaxX && rMinX <= maxX[j] &&
+            minY[j] <= rMaxY && rMinY <= maxY[j] &&
+            minZ[j] <= rMaxZ && rMinZ <= maxZ[j] && ++count == limit)
+          return count;
+    }
+  }
+
+  return count;
+}
+
+
+void LinearBVH::collisions(const cb::Vector3D &p,
+                           vector<const GCode::Move *> &results) const {
+  if (!finalized) THROWS("LinearBVH not yet finalized");
+  if (nodes.empty()) return;
+
+  // Rounding is monotonic so comparing the rounded point against the
+  // outward rounded bounds never misses a hit.
+  const float x = p.x();
+  const float y = p.y();
+  const float z = p.z();
+
+  uint32_t stack[STACK_SIZE];
+  unsigned top = 0;
+  stack[top++] = 0;
+
+  while (top) {
+    const Node &node = nodes[stack[--top]];
+
+    // Test all slots together, the loop has no branches
+    unsigned hits = 0;
+    for (unsigned i = 0; i < WIDTH; i++)
+      hits |= (unsigned)((node.minX[i] <= x) & (x <= node.maxX[i]) &
+                         (node.minY[i] <= y) & (y <= node.maxY[i]) &
+                         (node.minZ[i] <= z) & (z <= node.maxZ[i])) << i;
+
+    for (unsigned i = 0; hits; i++, hits >>= 1) {
+      if (!(hits & 1)) continue;
+
+      if (!node.count[i]) {
+        stack[top++] = node.child[i];
+        continue;
+      }
+
+      unsigned end = node.child[i] + node.count[i];
+      for (unsigned j = node.child[i]; j < end; j++)
+        if (minX[j] <= x && x <= maxX[j] && minY[j] <= y && y <= maxY[j] &&
+            minZ[j] <= z && z <= maxZ[j]) results.push_back(moves[j]);
+    }
+  }
+}
+
+
+void LinearBVH::collisions(const cb::Rectangle3D &r, boxes_t &boxes) const {
+  if (!finalized) THROWS("LinearBVH not yet finalized");
+  if (nodes.empty()) return;
+
+  const float rMinX = roundDown(r.getMin().x());
+  const float rMinY = roundDown(r.getMin().y());
+  const float rMinZ = roundDown(r.getMin().z());
+  const float rMaxX = roundUp(r.getMax().x());
+  const float rMaxY = roundUp(r.getMax().y());
+  const float rMaxZ = roundUp(r.getMax().z());
+
+  uint32_t stack[STACK_SIZE];
+  unsigned top = 0;
+  stack[top++] = 0;
+
+  while (top) {
+    const Node &node = nodes[stack[--top]];
+
+    for (unsigned i = 0; i < WIDTH; i++) {
+      if (rMaxX < node.minX[i] || node.maxX[i] < rMinX ||
+          rMaxY < node.minY[i] || node.maxY[i] < rMinY ||
+          rMaxZ < node.minZ[i] || node.maxZ[i] < rMinZ) continue;
+
+      if (!node.count[i]) {
+        stack[top++] = node.child[i];
+        continue;
+      }
+
+      // The stored bounds, rounded outward from the move's own box
+      unsigned end = node.child[i] + node.count[i];
+      for (unsigned j = node.child[i]; j < end; j++)
+        if (minX[j] <= rMaxX && rMinX <= maxX[j] &&
+            minY[j] <= rMaxY && rMinY <= maxY[j] &&
+            minZ[j] <= rMaxZ && rMinZ <= maxZ[j])
+          boxes.push_back
+            (make_pair(moves[j], cb::Rectangle3D
+                       (cb::Vector3D(minX[j], minY[j], minZ[j]),
+                        cb::Vector3D(maxX[j], maxY[j], maxZ[j]))));
+    }
+  }
+}
+
+
+void LinearBVH::finalize() {
+  if (finalized) return;
+  finalized = true;
+
+  unsigned count = moves.size();
+  if (!count) return;
+
+  // Bounds of the box centers
+  cb::Rectangle3D centers;
+  for (unsigned i = 0; i < count; i++)
+    centers.add(cb::Vector3D(((double)minX[i] + maxX[i]) / 2,
+                             ((double)minY[i] + maxY[i]) / 2,
+                             ((double)minZ[i] + maxZ[i]) / 2));
+
+  cb::Vector3D scale = centers.getDimensions();
+  for (unsigned i = 0; i < 3; i++) scale[i] = scale[i] ? 1023 / scale[i] : 0;
+
+  // Compute Morton codes and sort along the curve
+  vector<pair<uint32_t, uint32_t> > order(count);
+
+  for (unsigned i = 0; i < count; i++) {
+    const cb::Vector3D &cMin = centers.getMin();
+    uint32_t x = quantize((((double)minX[i] + maxX[i]) / 2 - cMin.x()) *
+                          scale.x());
+    uint32_t y = quantize((((double)minY[i] + maxY[i]) / 2 - cMin.y()) *
+                          scale.y());
+    uint32_t z = quantize((((double)minZ[i] + maxZ[i]) / 2 - cMin.z()) *
+                          scale.z());
+
+    order[i].first = expandBits(x) << 2 | expandBits(y) << 1 | expandBits(z);
+    order[i].second = i;
+  }
+
+  sort(order.begin(), order.end());
+
+  permute(moves, order);
+  permute(minX, order);
+  permute(minY, order);
+  permute(minZ, order);
+  permute(maxX, order);
+  permute(maxY, order);
+  permute(maxZ, order);
+
+  vector<uint32_t> codes(count);
+  for (unsigned i = 0; i < count; i++) codes[i] = order[i].first;
+
+  nodes.reserve(count / (LEAF_SIZE * (WIDTH - 1)) + 1);
+  build(codes, 0, count);
+}
+
+
+void LinearBVH::draw(bool leavesOnly) {
+  if (!leavesOnly)
+    for (unsigned i = 0; i < nodes.size(); i++)
+      for (unsigned j = 0; j < WIDTH; j++) {
+        const Node &node = nodes[i];
+        if (node.maxX[j] < node.minX[j]) continue; // Empty
+
+        glColor4f(0.5, 0, node.count[j] ? 1 : 0.5, 1);
+        BoundsView(cb::Vector3D(node.minX[j], node.minY[j], node.minZ[j]),
+                   cb::Vector3D(node.maxX[j], node.maxY[j], node.maxZ[j]))
+          .draw();
+      }
+
+  glColor4f(0.5, 0, 1, 1);
+  for (unsigned i = 0; i < moves.size(); i++)
+    BoundsView(cb::Vector3D(minX[i], minY[i], minZ[i]),
+               cb::Vector3D(maxX[i], maxY[i], maxZ[i])).draw();
+}
+
+
+uint32_t LinearBVH::build(const vector<uint32_t> &codes, unsigned first,
+                          unsigned last) {
+  uint32_t index = nodes.size();
+  nodes.push_back(Node());
+
+  // Split the range until it fills the node or all parts fit in leaves
+  unsigned ranges[WIDTH + 1] = {first, last};
+  unsigned parts = 1;
+
+  while (parts < WIDTH) {
+    // Find the largest part
+    unsigned largest = 0;
+    for (unsigned i = 1; i < parts; i++)
+      if (ranges[largest + 1] - ranges[largest] < ranges[i + 1] - ranges[i])
+        largest = i;
+
+    if (ranges[largest + 1] - ranges[largest] <= LEAF_SIZE) break;
+
+    unsigned split = findSplit(codes, ranges[largest], ranges[largest + 1]);
+
+    for (unsigned i = parts; largest < i; i--) ranges[i + 1] = ranges[i];
+    ranges[largest + 1] = split;
+    parts++;
+  }
+
+  for (unsigned i = 0; i < parts; i++) {
+    unsigned start = ranges[i];
+    unsigned end = ranges[i + 1];
+
+    // Bounds
+    float bMinX = minX[start], bMinY = minY[start], bMinZ = minZ[start];
+    float bMaxX = maxX[start], bMaxY = maxY[start], bMaxZ = maxZ[start];
+
+    for (unsigned j = start + 1; j < end; j++) {
+      bMinX = std::min(bMinX, minX[j]);
+      bMinY = std::min(bMinY, minY[j]);
+      bMinZ = std::min(bMinZ, minZ[j]);
+      bMaxX = std::max(bMaxX, maxX[j]);
+      bMaxY = std::max(bMaxY, maxY[j]);
+      bMaxZ = std::max(bMaxZ, maxZ[j]);
+    }
+
+    // Children are built first, nodes may be reallocated
+    uint32_t child = start;
+    uint32_t count = end - start;
+    if (LEAF_SIZE < count) {
+      child = build(codes, start, end);
+      count = 0;
+    }
+
+    Node &node = nodes[index];
+    node.minX[i] = bMinX;
+    node.minY[i] = bMinY;
+    node.minZ[i] = bMinZ;
+    node.maxX[i] = bMaxX;
+    node.maxY[i] = bMaxY;
+    node.maxZ[i] = bMaxZ;
+    node.child[i] = child;
+    node.count[i] = count;
+  }
+
+  return index;
+}
+
+
+unsigned LinearBVH::getTreeHeight(uint32_t index) const {
+  const Node &node = nodes[index];
+  unsigned height = 0;
+
+  for (unsigned i = 0; i < WIDTH; i++)
+    if (!node.count[i] && node.minX[i] <= node.maxX[i])
+      height = std::max(height, getTreeHeight(node.child[i]));
+
+  return height + 1;
+}
@@ -0,0 +1,92 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include "MoveLookup.h"
+
+#include <cbang/StdTypes.h>
+
+#include <vector>
+
+
+namespace CAMotics {
+  /// A four wide bounding volume hierarchy stored in one contiguous array.
+  /// Bounds are kept in single precision, rounded outward, and laid out so
+  /// that all four children of a node are tested together.  The hierarchy is
+  /// built by sorting the boxes along a Morton curve.
+  class LinearBVH : public MoveLookup {
+  public:
+    static const unsigned WIDTH = 4;
+    static const unsigned LEAF_SIZE = 4;
+
+  protected:
+    struct Node {
+      float minX[WIDTH];
+      float minY[WIDTH];
+      float minZ[WIDTH];
+      float maxX[WIDTH];
+      float maxY[WIDTH];
+      float maxZ[WIDTH];
+      uint32_t child[WIDTH]; ///< Node index or first primitive of a leaf
+      uint32_t count[WIDTH]; ///< Leaf primitive count, zero for inner nodes
+
+      Node();
+    };
+
+    std::vector<Node> nodes;
+
+    // Primitives
+    std::vector<const GCode::Move *> moves;
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> minZ;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> maxZ;
+
+    cb::Rectangle3D bounds;
+    bool finalized;
+
+  public:
+    LinearBVH() : finalized(false) {}
+
+    unsigned getNodeCount() const {return nodes.size();}
+    unsigned getTreeHeight() const;
+
+    // From MoveLookup
+    cb::Rectangle3D getBounds() const;
+    void insert(const GCode::Move *move, const cb::Rectangle3D &bbox);
+    bool intersects(const cb::Rectangle3D &r) const;
+    unsigned intersections(const cb::Rectangle3D &r) const;
+    void collisions(const cb::Vector3D &p,
+                    std::vector<const GCode::Move *> &moves) const;
+    void collisions(const cb::Rectangle3D &r, boxes_t &boxes) const;
+    void finalize();
+    void draw(bool leavesOnly = false);
+    uint64_t getMemoryUsage() const;
+
+  protected:
+    unsigned intersections(const cb::Rectangle3D &r, unsigned limit) const;
+    uint32_t build(const std::vector<uint32_t> &codes, unsigned first,
+                   unsigned last);
+    unsigned getTreeHeight(uint32_t node) const;
+  };
+}
@@ -18,12 +18,6 @@
 
 \******************************************************************************/
 
-#include "ToolCommand.h"
-
-#include <cbang/json/Sink.h>
-
-using namespace GCode;
-using namespace cb;
-
-
-void ToolCommand::insert(JSON::Sink &sink) {sink.insert("tool", tool);}
+#define CBANG_ENUM_IMPL
+#include "LookupMode.h"
+#include <cbang/enum/MakeEnumerationImpl.def>
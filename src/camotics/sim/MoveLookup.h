@@ -24,19 +24,34 @@
 
 #include <cbang/geom/Rectangle.h>
 
+#include <vector>
+#include <utility>
+
 
 namespace CAMotics {
   class MoveLookup {
   public:
+    typedef std::vector<std::pair<const GCode::Move *, cb::Rectangle3D> >
+    boxes_t;
+
     virtual ~MoveLookup() {}
 
     virtual cb::Rectangle3D getBounds() const = 0;
     virtual void insert(const GCode::Move *move,
                         const cb::Rectangle3D &bbox) = 0;
     virtual bool intersects(const cb::Rectangle3D &r) const = 0;
+    /// Number of moves whose bounds intersect @param r.
+    virtual unsigned intersections(const cb::Rectangle3D &r) const
+    {return intersects(r) ? 1 : 0;}
     virtual void collisions(const cb::Vector3D &p,
                             std::vector<const GCode::Move *> &moves) const = 0;
+    /// Append the moves found in @param r, each with a box which holds
+    /// exactly the points whose collisions() would include the move, so one
+    /// search can serve every point in @param r.
+    virtual void collisions(const cb::Rectangle3D &r, boxes_t &boxes) const = 0;
     virtual void finalize() {}
     virtual void draw(bool leavesOnly = false) {}
+    /// @return the bytes held by the lookup, not counting the moves.
+    virtual uint64_t getMemoryUsage() const = 0;
   };
 }
@@ -20,107 +20,201 @@
 
 #include "OctTree.h"
 
-#include <cbang/Zap.h>
+#include <cbang/Exception.h>
+
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
+using namespace cb;
 using namespace CAMotics;
 
 
-OctTree::OctNode::OctNode(const cb::Rectangle3D &bounds, unsigned depth) :
-  bounds(bounds), depth(depth) {
-  for (int i = 0; i < 8; i++) children[i] = 0;
+OctTree::OctTree(const Rectangle3D &bounds, unsigned depth) :
+  depth(depth), finalized(false) {
+  double m = bounds.getDimensions().max();
+  cube = Rectangle3D(bounds.getMin(), bounds.getMin() + Vector3D(m, m, m));
+  nodes.push_back(Node());
 }
 
 
-OctTree::OctNode::~OctNode() {
-  for (int i = 0; i < 8; i++)
-    if (children[i]) delete children[i];
+Rectangle3D OctTree::getBounds() const {
+  if (!finalized) THROWS("OctTree not yet finalized");
+  return nodes[0].bounds;
 }
 
 
-void OctTree::OctNode::insert(const GCode::Move *move, const cb::Rectangle3D &bbox) {
-  if (!bounds.intersects(bbox)) return;
+void OctTree::insert(const GCode::Move *move, const Rectangle3D &bbox) {
+  if (finalized) THROWS("Cannot insert into OctTree after finalizing");
+  moves.push_back(move);
+  boxes.push_back(bbox);
+}
 
-  if (!depth || bbox.contains(bounds)) {
-    moves.insert(move);
-    return;
-  }
 
-  cb::Vector3D dims = bounds.getDimensions();
-
-  static cb::Vector3D cubes[16] = {
-    cb::Vector3D(0.0, 0.0, 0.0), cb::Vector3D(0.5, 0.5, 0.5),
-    cb::Vector3D(0.5, 0.0, 0.0), cb::Vector3D(1.0, 0.5, 0.5),
-    cb::Vector3D(0.0, 0.5, 0.0), cb::Vector3D(0.5, 1.0, 0.5),
-    cb::Vector3D(0.5, 0.5, 0.0), cb::Vector3D(1.0, 1.0, 0.5),
-
-    cb::Vector3D(0.0, 0.0, 0.5), cb::Vector3D(0.5, 0.5, 1.0),
-    cb::Vector3D(0.5, 0.0, 0.5), cb::Vector3D(1.0, 0.5, 1.0),
-    cb::Vector3D(0.0, 0.5, 0.5), cb::Vector3D(0.5, 1.0, 1.0),
-    cb::Vector3D(0.5, 0.5, 0.5), cb::Vector3D(1.0, 1.0, 1.0),
-  };
-
-  for (int i = 0; i < 8; i++) {
-    if (!children[i]) {
-      cb::Rectangle3D cBounds(bounds.getMin() + dims * cubes[i * 2],
-                          bounds.getMin() + dims * cubes[i * 2 + 1]);
-      children[i] = new OctNode(cBounds, depth - 1);
-    }
+bool OctTree::intersects(const Rectangle3D &r) const {
+  if (!finalized) THROWS("OctTree not yet finalized");
+  return intersects(0, r);
+}
 
-    children[i]->insert(move, bbox);
-  }
+
+unsigned OctTree::intersections(const Rectangle3D &r) const {
+  if (!finalized) THROWS("OctTree not yet finalized");
+  return intersections(0, r);
 }
 
 
-bool OctTree::OctNode::intersects(const cb::Rectangle3D &r) const {
-  if (!bounds.intersects(r)) return false;
-  if (!moves.empty()) return true;
+void OctTree::collisions(const Vector3D &p,
+                         vector<const GCode::Move *> &moves) const {
+  if (!finalized) THROWS("OctTree not yet finalized");
+  collisions(0, p, moves);
+}
 
-  if (depth)
-    for (int i = 0; i < 8; i++)
-      if (children[i] && children[i]->intersects(r))
-        return true;
 
-  return false;
+void OctTree::collisions(const Rectangle3D &r, boxes_t &boxes) const {
+  if (!finalized) THROWS("OctTree not yet finalized");
+  collisions(0, r, boxes);
+}
+
+
+uint64_t OctTree::getMemoryUsage() const {
+  return sizeof(OctTree) + nodes.capacity() * sizeof(Node) +
+    moves.capacity() * sizeof(const GCode::Move *) +
+    boxes.capacity() * sizeof(Rectangle3D);
 }
 
 
-void OctTree::OctNode::collisions(const cb::Vector3D &p,
-                                  vector<const GCode::Move *> &moves) const {
-  if (!bounds.contains(p)) return;
+void OctTree::finalize() {
+  if (finalized) return;
+  finalized = true;
+
+  // Place each box, then counting sort the boxes by node
+  vector<unsigned> placement(boxes.size());
+  for (unsigned i = 0; i < boxes.size(); i++)
+    nodes[placement[i] = place(boxes[i])].count++;
 
-  moves.insert(moves.end(), this->moves.begin(), this->moves.end());
+  for (unsigned i = 1; i < nodes.size(); i++)
+    nodes[i].first = nodes[i - 1].first + nodes[i - 1].count;
 
-  if (depth)
-    for (int i = 0; i < 8; i++)
-      if (children[i]) children[i]->collisions(p, moves);
+  vector<unsigned> next(nodes.size());
+  for (unsigned i = 0; i < nodes.size(); i++) next[i] = nodes[i].first;
+
+  vector<const GCode::Move *> sortedMoves(moves.size());
+  vector<Rectangle3D> sortedBoxes(boxes.size());
+
+  for (unsigned i = 0; i < boxes.size(); i++) {
+    unsigned j = next[placement[i]]++;
+    sortedMoves[j] = moves[i];
+    sortedBoxes[j] = boxes[i];
+    nodes[placement[i]].bounds.add(boxes[i]);
+  }
+
+  moves.swap(sortedMoves);
+  boxes.swap(sortedBoxes);
+
+  // Children always follow their parents
+  for (int i = nodes.size() - 1; 0 <= i; i--)
+    for (unsigned j = 0; j < 8; j++) {
+      int child = nodes[i].children[j];
+      if (0 <= child && nodes[child].bounds.isReal())
+        nodes[i].bounds.add(nodes[child].bounds);
+    }
 }
 
 
-OctTree::OctTree(const cb::Rectangle3D &bounds, unsigned depth) {
-  double m = bounds.getDimensions().max();
+unsigned OctTree::place(const Rectangle3D &bbox) {
+  // The deepest level whose cells are at least as large as the box
+  double size = cube.getDimensions().max();
+  double extent = bbox.getDimensions().max();
+  unsigned level = 0;
+
+  while (level < depth && extent <= size / 2) {
+    size /= 2;
+    level++;
+  }
+
+  if (!level) return 0;
+
+  // The cell holding the box center
+  Vector3D center = bbox.getCenter();
+  unsigned cells = 1 << level;
+  unsigned cell[3];
+
+  for (unsigned axis = 0; axis < 3; axis++) {
+    double x = floor((center[axis] - cube.getMin()[axis]) / size);
+    cell[axis] = x < 0 ? 0 : (cells <= x ? cells - 1 : (unsigned)x);
+  }
+
+  // Walk down to it, adding nodes as needed
+  unsigned node = 0;
+
+  for (unsigned shift = level; shift; shift--) {
+    unsigned child = ((cell[0] >> (shift - 1)) & 1) |
+      (((cell[1] >> (shift - 1)) & 1) << 1) |
+      (((cell[2] >> (shift - 1)) & 1) << 2);
+
+    if (nodes[node].children[child] < 0) {
+      nodes[node].children[child] = nodes.size();
+      nodes.push_back(Node());
+    }
+
+    node = nodes[node].children[child];
+  }
 
-  root = new OctNode(cb::Rectangle3D(bounds.getMin(), bounds.getMin() +
-                                 cb::Vector3D(m, m, m)), depth);
+  return node;
 }
 
 
-OctTree::~OctTree() {
-  zap(root);
+bool OctTree::intersects(unsigned node, const Rectangle3D &r) const {
+  const Node &n = nodes[node];
+  if (!n.bounds.isReal() || !n.bounds.intersects(r)) return false;
+
+  for (unsigned i = n.first; i < n.first + n.count; i++)
+    if (boxes[i].intersects(r)) return true;
+
+  for (unsigned i = 0; i < 8; i++)
+    if (0 <= n.children[i] && intersects(n.children[i], r)) return true;
+
+  return false;
 }
 
 
-void OctTree::insert(const GCode::Move *move, const cb::Rectangle3D &bbox) {
-  this->bbox.add(bbox);
-  root->insert(move, bbox);
+unsigned OctTree::intersections(unsigned node, const Rectangle3D &r) const {
+  const Node &n = nodes[node];
+  if (!n.bounds.isReal() || !n.bounds.intersects(r)) return 0;
+
+  unsigned count = 0;
+  for (unsigned i = n.first; i < n.first + n.count; i++)
+    if (boxes[i].intersects(r)) count++;
+
+  for (unsigned i = 0; i < 8; i++)
+    if (0 <= n.children[i]) count += intersections(n.children[i], r);
+
+  return count;
 }
 
 
-bool OctTree::intersects(const cb::Rectangle3D &r) const {
-  return root->intersects(r);
+void OctTree::collisions(unsigned node, const Vector3D &p,
+                         vector<const GCode::Move *> &moves) const {
+  const Node &n = nodes[node];
+  if (!n.bounds.isReal() || !n.bounds.contains(p)) return;
+
+  for (unsigned i = n.first; i < n.first + n.count; i++)
+    if (boxes[i].contains(p)) moves.push_back(this->moves[i]);
+
+  for (unsigned i = 0; i < 8; i++)
+    if (0 <= n.children[i]) collisions(n.children[i], p, moves);
 }
 
 
-void OctTree::collisions(const cb::Vector3D &p, vector<const GCode::Move *> &moves) const {
-  root->collisions(p, moves);
+void OctTree::collisions(unsigned node, const Rectangle3D &r,
+                         boxes_t &boxes) const {
+  const Node &n = nodes[node];
+  if (!n.bounds.isReal() || !n.bounds.intersects(r)) return;
+
+  for (unsigned i = n.first; i < n.first + n.count; i++)
+    if (this->boxes[i].intersects(r))
+      boxes.push_back(make_pair(moves[i], this->boxes[i]));
+
+  for (unsigned i = 0; i < 8; i++)
+    if (0 <= n.children[i]) collisions(n.children[i], r, boxes);
 }
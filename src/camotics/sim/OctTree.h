@@ -23,40 +23,58 @@
 
 #include "MoveLookup.h"
 
-#include <set>
+#include <vector>
 
 
 namespace CAMotics {
+  /***
+   * A loose octree.  Each move is stored once, in the deepest node whose
+   * bounds, doubled around its center, still hold the move's box.  Moves
+   * are sorted by node when finalized so every node owns one contiguous
+   * range of the move and box arrays.
+   */
   class OctTree : public MoveLookup {
-    cb::Rectangle3D bbox;
-
-    class OctNode {
-      cb::Rectangle3D bounds;
-      unsigned depth;
-
-      OctNode *children[8];
-      std::set<const GCode::Move *> moves;
-
-    public:
-      OctNode(const cb::Rectangle3D &bounds, unsigned depth);
-      ~OctNode();
-
-      void insert(const GCode::Move *move, const cb::Rectangle3D &bbox);
-      bool intersects(const cb::Rectangle3D &r) const;
-      void collisions(const cb::Vector3D &p,
-                      std::vector<const GCode::Move *> &moves) const;
+    struct Node {
+      cb::Rectangle3D bounds; ///< Of all the boxes under this node
+      unsigned first;
+      unsigned count;
+      int children[8];
+
+      Node() : first(0), count(0)
+      {for (int i = 0; i < 8; i++) children[i] = -1;}
     };
 
-    OctNode *root;
+    cb::Rectangle3D cube;
+    unsigned depth;
+    bool finalized;
+
+    std::vector<Node> nodes;
+    std::vector<const GCode::Move *> moves;
+    std::vector<cb::Rectangle3D> boxes;
 
   public:
     OctTree(const cb::Rectangle3D &bounds, unsigned depth);
-    ~OctTree();
+
+    unsigned getNodeCount() const {return nodes.size();}
 
     // From MoveLookup
-    cb::Rectangle3D getBounds() const {return bbox;}
+    cb::Rectangle3D getBounds() const;
     void insert(const GCode::Move *move, const cb::Rectangle3D &bbox);
     bool intersects(const cb::Rectangle3D &r) const;
-    void collisions(const cb::Vector3D &p, std::vector<const GCode::Move *> &moves) const;
+    unsigned intersections(const cb::Rectangle3D &r) const;
+    void collisions(const cb::Vector3D &p,
+                    std::vector<const GCode::Move *> &moves) const;
+    void collisions(const cb::Rectangle3D &r, boxes_t &boxes) const;
+    void finalize();
+    uint64_t getMemoryUsage() const;
+
+  protected:
+    unsigned place(const cb::Rectangle3D &bbox);
+    bool intersects(unsigned node, const cb::Rectangle3D &r) const;
+    unsigned intersections(unsigned node, const cb::Rectangle3D &r) const;
+    void collisions(unsigned node, const cb::Vector3D &p,
+                    std::vector<const GCode::Move *> &moves) const;
+    void collisions(unsigned node, const cb::Rectangle3D &r,
+                    boxes_t &boxes) const;
   };
 }
@@ -0,0 +1,475 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "OpenCLSweep.h"
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+
+#ifdef HAVE_OPENCL
+#include <gcode/ToolTable.h>
+
+#include <cbang/log/Logger.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/util/SmartLock.h>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#endif
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+#ifdef HAVE_OPENCL
+namespace {
+  // Tool description layout, TOOL_STRIDE doubles per tool:
+  //   type, length, top radius, bottom radius, sphere radius, sphere length
+  enum {
+    TOOL_NONE,
+    TOOL_CONIC,
+    TOOL_SPHEROID,
+    TOOL_BALLNOSE,
+  };
+
+  const unsigned TOOL_STRIDE = 6;
+
+
+  // Same math as ConicSweep and SpheroidSweep.  Only the sign of the depth
+  // is used so each hit sets a flag rather than reducing a max.
+  const char *kernelSource = R"(
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+double sqr(double x) {return x * x;}
+
+
+bool conicHit(double l, double rt, double rb, double Ax, double Ay,
+              double Az, double Bx, double By, double Bz, double Px,
+              double Py, double Pz) {
+  const double Tm = (rt - rb) / l;
+
+  if (Pz < min(Az, Bz) || max(Az, Bz) + l < Pz) return false;
+
+  // Plunge
+  if (Ax == Bx && Ay == By) {
+    if (Az == Bz) return false;
+
+    const double hMin = max(0.0, Pz - max(Az, Bz));
+    const double hMax = min(l, Pz - min(Az, Bz));
+    if (hMax < hMin) return false;
+
+    const double r = rb + Tm * (Tm < 0 ? hMin : hMax);
+    return sqr(Px - Ax) + sqr(Py - Ay) <= r * r;
+  }
+
+  // Planar
+  if (Az == Bz) {
+    const double h = Pz - Az;
+    if (h < 0 || l < h) return false;
+
+    const double r = rb + Tm * h;
+    const double ABx = Bx - Ax, ABy = By - Ay;
+    const double APx = Px - Ax, APy = Py - Ay;
+
+    double t = (APx * ABx + APy * ABy) / (sqr(ABx) + sqr(ABy));
+    t = t < 0 ? 0 : (1 < t ? 1 : t);
+
+    return sqr(APx - t * ABx) + sqr(APy - t * ABy) <= r * r;
+  }
+
+  const double epsilon = sqr(Bx - Ax) + sqr(By - Ay) - sqr(Tm * (Bz - Az));
+  const double gamma = (Ax - Px) * (Bx - Ax) + (Ay - Py) * (By - Ay) +
+    (sqr(Tm) * (Az - Pz) - Tm * rb) * (Az - Bz);
+  const double rho = sqr(Ax - Px) + sqr(Ay - Py) - sqr(Tm * (Az - Pz) - rb);
+  const double sigma = sqr(gamma) - epsilon * rho;
+
+  if (epsilon == 0 || sigma < 0) return false;
+
+  const double beta = (-gamma - sqrt(sigma)) / epsilon;
+  const double Qz = (Bz - Az) * beta + Az;
+
+  if (Pz < Qz || Qz + l < Pz) {
+    // Bottom disc
+    if (rb) {
+      const double beta = (Pz - Az) / (Bz - Az);
+
+      if (0 <= beta && beta <= 1 &&
+          sqr(beta * (Bx - Ax) + Ax - Px) +
+          sqr(beta * (By - Ay) + Ay - Py) <= rb * rb) return true;
+    }
+
+    // Top disc
+    if (rt) {
+      const double beta = (Pz - Az - l) / (Bz - Az);
+
+      if (0 <= beta && beta <= 1 &&
+          sqr(beta * (Bx - Ax) + Ax - Px) +
+          sqr(beta * (By - Ay) + Ay - Py) <= rt * rt) return true;
+    }
+
+    return false;
+  }
+
+  return 0 <= beta && beta <= 1;
+}
+
+
+bool spheroidHit(double r, double length, double Ax, double Ay, double Az,
+                 double Bx, double By, double Bz, double Px, double Py,
+                 double Pz) {
+  // Handle oblong spheroids by scaling the z-axis
+  if (2 * r != length) {
+    const double scale = 2 * r / length;
+    Az *= scale;
+    Bz *= scale;
+    Pz *= scale;
+  }
+
+  if (Pz < min(Az, Bz) || max(Az, Bz) + 2 * r < Pz) return false;
+
+  const double ABx = Bx - Ax, ABy = By - Ay, ABz = Bz - Az;
+  const double CPx = Px - Ax, CPy = Py - Ay, CPz = Pz - Az - r;
+
+  const double epsilon = ABx * ABx + ABy * ABy + ABz * ABz;
+  double beta = epsilon ? (CPx * ABx + CPy * ABy + CPz * ABz) / epsilon : 0;
+  beta = beta < 0 ? 0 : (1 < beta ? 1 : beta);
+
+  return sqr(CPx - ABx * beta) + sqr(CPy - ABy * beta) +
+    sqr(CPz - ABz * beta) <= r * r;
+}
+
+
+__kernel void cut(__global const double *moves, __global const int *moveTools,
+                  __global const double *tools, __global const uint *hits,
+                  __global const double *points, __global uchar *cut,
+                  uint count) {
+  const uint i = get_global_id(0);
+  if (count <= i) return;
+
+  const uint point = hits[2 * i + 1];
+  if (cut[point]) return;
+
+  const uint move = hits[2 * i];
+  __global const double *m = moves + 6 * move;
+  __global const double *t = tools + 6 * moveTools[move];
+  __global const double *p = points + 3 * point;
+
+  bool hit = false;
+
+  switch ((int)t[0]) { // See the TOOL_* enum on the host
+  case 1:
+    hit = conicHit(t[1], t[2], t[3], m[0], m[1], m[2], m[3], m[4], m[5],
+                   p[0], p[1], p[2]);
+    break;
+
+  case 2:
+    hit = spheroidHit(t[4], t[5], m[0], m[1], m[2], m[3], m[4], m[5],
+                      p[0], p[1], p[2]);
+    break;
+
+  case 3:
+    hit = spheroidHit(t[4], t[5], m[0], m[1], m[2], m[3], m[4], m[5],
+                      p[0], p[1], p[2]) ||
+      conicHit(t[1], t[2], t[3], m[0], m[1], m[2], m[3], m[4], m[5],
+               p[0], p[1], p[2] - t[4]);
+    break;
+  }
+
+  if (hit) cut[point] = 1;
+}
+)";
+
+
+  void check(cl_int err, const char *call) {
+    if (err != CL_SUCCESS) THROWS("OpenCL " << call << "() failed: " << err);
+  }
+
+
+  class Buffer {
+    cl_mem mem;
+
+  public:
+    Buffer(cl_context context, cl_mem_flags flags, size_t size,
+           const void *data = 0) : mem(0) {
+      cl_int err;
+      if (data) flags |= CL_MEM_COPY_HOST_PTR;
+      mem = clCreateBuffer(context, flags, size ? size : 1,
+                           const_cast<void *>(data), &err);
+      check(err, "clCreateBuffer");
+    }
+
+    ~Buffer() {clReleaseMemObject(mem);}
+
+    const cl_mem &get() const {return mem;}
+  };
+}
+
+
+class OpenCLSweep::Context : public Mutex {
+  SmartPointer<GCode::ToolPath> path;
+
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+
+  SmartPointer<Buffer> tools;
+  SmartPointer<Buffer> moveTools;
+  SmartPointer<Buffer> moves;
+  double startTime;
+  double endTime;
+
+public:
+  Context(const SmartPointer<GCode::ToolPath> &path) :
+    path(path), device(0), context(0), queue(0), program(0), kernel(0),
+    startTime(-1), endTime(-1) {
+
+    findDevice();
+
+    cl_int err;
+    context = clCreateContext(0, 1, &device, 0, 0, &err);
+    check(err, "clCreateContext");
+
+    queue = clCreateCommandQueue(context, device, 0, &err);
+    check(err, "clCreateCommandQueue");
+
+    program = clCreateProgramWithSource(context, 1, &kernelSource, 0, &err);
+    check(err, "clCreateProgramWithSource");
+
+    if (clBuildProgram(program, 1, &device, 0, 0, 0) != CL_SUCCESS) {
+      size_t size = 0;
+      clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, 0,
+                            &size);
+      string log(size, 0);
+      clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size,
+                            &log[0], 0);
+      THROWS("Failed to build OpenCL sweep kernel: " << log);
+    }
+
+    kernel = clCreateKernel(program, "cut", &err);
+    check(err, "clCreateKernel");
+
+    uploadTools();
+  }
+
+
+  ~Context() {
+    moves.release();
+    moveTools.release();
+    tools.release();
+
+    if (kernel) clReleaseKernel(kernel);
+    if (program) clReleaseProgram(program);
+    if (queue) clReleaseCommandQueue(queue);
+    if (context) clReleaseContext(context);
+  }
+
+
+  void cut(double startTime, double endTime, const vector<Vector3D> &points,
+           const vector<hit_t> &hits, vector<char> &cut) {
+    cut.assign(points.size(), 0);
+    if (hits.empty()) return;
+
+    vector<double> coords(3 * points.size());
+    for (unsigned i = 0; i < points.size(); i++)
+      for (unsigned j = 0; j < 3; j++)
+        coords[3 * i + j] = points[i][j];
+
+    SmartLock lock(this);
+
+    if (this->startTime != startTime || this->endTime != endTime)
+      uploadMoves(startTime, endTime);
+
+    Buffer pointBuf(context, CL_MEM_READ_ONLY, coords.size() * sizeof(double),
+                    &coords[0]);
+    Buffer hitBuf(context, CL_MEM_READ_ONLY, hits.size() * sizeof(hit_t),
+                  &hits[0]);
+    Buffer cutBuf(context, CL_MEM_READ_WRITE, cut.size(), &cut[0]);
+    cl_uint count = hits.size();
+
+    check(clSetKernelArg(kernel, 0, sizeof(cl_mem), &moves->get()),
+          "clSetKernelArg");
+    check(clSetKernelArg(kernel, 1, sizeof(cl_mem), &moveTools->get()),
+          "clSetKernelArg");
+    check(clSetKernelArg(kernel, 2, sizeof(cl_mem), &tools->get()),
+          "clSetKernelArg");
+    check(clSetKernelArg(kernel, 3, sizeof(cl_mem), &hitBuf.get()),
+          "clSetKernelArg");
+    check(clSetKernelArg(kernel, 4, sizeof(cl_mem), &pointBuf.get()),
+          "clSetKernelArg");
+    check(clSetKernelArg(kernel, 5, sizeof(cl_mem), &cutBuf.get()),
+          "clSetKernelArg");
+    check(clSetKernelArg(kernel, 6, sizeof(cl_uint), &count),
+          "clSetKernelArg");
+
+    size_t size = count;
+    check(clEnqueueNDRangeKernel(queue, kernel, 1, 0, &size, 0, 0, 0, 0),
+          "clEnqueueNDRangeKernel");
+    check(clEnqueueReadBuffer(queue, cutBuf.get(), CL_TRUE, 0, cut.size(),
+                              &cut[0], 0, 0, 0), "clEnqueueReadBuffer");
+  }
+
+
+protected:
+  void findDevice() {
+    cl_uint count = 0;
+    if (clGetPlatformIDs(0, 0, &count) != CL_SUCCESS || !count)
+      THROWS("No OpenCL platforms");
+
+    vector<cl_platform_id> platforms(count);
+    check(clGetPlatformIDs(count, &platforms[0], 0), "clGetPlatformIDs");
+
+    for (unsigned i = 0; i < platforms.size(); i++) {
+      cl_uint n = 0;
+      if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 0, 0, &n) !=
+          CL_SUCCESS || !n) continue;
+
+      vector<cl_device_id> devices(n);
+      clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, n, &devices[0], 0);
+
+      for (unsigned j = 0; j < devices.size(); j++) {
+        // The sweep math needs double precision to match the CPU
+        cl_device_fp_config fp = 0;
+        clGetDeviceInfo(devices[j], CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp),
+                        &fp, 0);
+        if (!fp) continue;
+
+        char name[256] = {0};
+        clGetDeviceInfo(devices[j], CL_DEVICE_NAME, sizeof(name) - 1, name, 0);
+        LOG_INFO(1, "Using OpenCL device " << name);
+
+        device = devices[j];
+        return;
+      }
+    }
+
+    THROWS("No OpenCL GPU with double precision support");
+  }
+
+
+  void uploadTools() {
+    vector<cl_int> toolIndex(path->size(), 0);
+    vector<double> data;
+
+    for (unsigned i = 0; i < path->size(); i++) {
+      const GCode::Move &move = path->at(i);
+      int tool = move.getTool();
+      if (tool < 0) continue;
+      toolIndex[i] = tool;
+
+      if (data.size() < (tool + 1) * TOOL_STRIDE)
+        data.resize((tool + 1) * TOOL_STRIDE, TOOL_NONE);
+
+      double *d = &data[tool * TOOL_STRIDE];
+      if (d[0] != TOOL_NONE) continue; // Already described
+
+      const GCode::Tool &t = *path->getTool(move);
+      double radius = t.getRadius();
+
+      // Mirrors ToolSweep::getSweep()
+      switch (t.getShape()) {
+      case GCode::ToolShape::TS_CYLINDRICAL:
+        d[0] = TOOL_CONIC;
+        d[1] = t.getLength(); d[2] = radius; d[3] = radius;
+        break;
+
+      case GCode::ToolShape::TS_CONICAL:
+        d[0] = TOOL_CONIC;
+        d[1] = t.getLength(); d[2] = radius; d[3] = 0;
+        break;
+
+      case GCode::ToolShape::TS_BALLNOSE:
+        d[0] = TOOL_BALLNOSE;
+        d[1] = t.getLength(); d[2] = radius; d[3] = radius;
+        d[4] = radius; d[5] = 2 * radius;
+        break;
+
+      case GCode::ToolShape::TS_SPHEROID:
+        d[0] = TOOL_SPHEROID;
+        d[4] = radius; d[5] = t.getLength();
+        break;
+
+      case GCode::ToolShape::TS_SNUBNOSE:
+        d[0] = TOOL_CONIC;
+        d[1] = t.getLength(); d[2] = radius; d[3] = t.getSnubDiameter() / 2;
+        break;
+
+      case GCode::ToolShape::TS_PROFILE:
+        THROWS("OpenCL sweep does not support profile tools");
+      }
+    }
+
+    tools = new Buffer(context, CL_MEM_READ_ONLY, data.size() * sizeof(double),
+                       data.empty() ? 0 : &data[0]);
+    moveTools = new Buffer(context, CL_MEM_READ_ONLY,
+                           toolIndex.size() * sizeof(cl_int),
+                           toolIndex.empty() ? 0 : &toolIndex[0]);
+  }
+
+
+  void uploadMoves(double startTime, double endTime) {
+    vector<double> data(6 * path->size());
+
+    for (unsigned i = 0; i < path->size(); i++) {
+      const GCode::Move &move = path->at(i);
+      Vector3D start = move.getPtAtTime(startTime);
+      Vector3D end = move.getPtAtTime(endTime);
+
+      for (unsigned j = 0; j < 3; j++) {
+        data[6 * i + j] = start[j];
+        data[6 * i + 3 + j] = end[j];
+      }
+    }
+
+    moves = new Buffer(context, CL_MEM_READ_ONLY, data.size() * sizeof(double),
+                       data.empty() ? 0 : &data[0]);
+    this->startTime = startTime;
+    this->endTime = endTime;
+  }
+};
+
+
+#else // HAVE_OPENCL
+class OpenCLSweep::Context {
+public:
+  Context(const SmartPointer<GCode::ToolPath> &path) {
+    THROWS("Not built with OpenCL support");
+  }
+
+  void cut(double startTime, double endTime, const vector<Vector3D> &points,
+           const vector<hit_t> &hits, vector<char> &cut) {}
+};
+#endif // HAVE_OPENCL
+
+
+OpenCLSweep::OpenCLSweep(const SmartPointer<GCode::ToolPath> &path) :
+  ctx(new Context(path)) {}
+
+
+OpenCLSweep::~OpenCLSweep() {}
+
+
+void OpenCLSweep::cut(double startTime, double endTime,
+                      const vector<Vector3D> &points,
+                      const vector<hit_t> &hits, vector<char> &cut) {
+  ctx->cut(startTime, endTime, points, hits, cut);
+}
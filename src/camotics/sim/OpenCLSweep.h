@@ -17,43 +17,34 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 \******************************************************************************/
-
 #pragma once
 
-#include "PlannerCommand.h"
 
+#include <cbang/SmartPointer.h>
 #include <cbang/geom/Vector.h>
 
+#include <vector>
+#include <utility>
 
-namespace GCode {
-  class LineCommand : public PlannerCommand {
-  public:
-    cb::Vector4D position;
-    double length;
-
-    double entryVel;
-    double exitVel;
-    double deltaV;
 
-    double maxVel;
-    double maxAccel;
-    double maxJerk;
+namespace GCode {class ToolPath;}
 
-    double times[7];
+namespace CAMotics {
+  /// Evaluates tool sweep hits on an OpenCL device.  The tool table and the
+  /// move end points are uploaded once and reused for every batch of points.
+  class OpenCLSweep {
+    class Context;
+    cb::SmartPointer<Context> ctx;
 
-    LineCommand(uint64_t line);
-
-    // From PlannerCommand
-    const char *getType() {return "line";}
+  public:
+    typedef std::pair<unsigned, unsigned> hit_t; // Move index, point index
 
-    double getEntryVelocity() const {return entryVel;}
-    void setEntryVelocity(double entryVel) {this->entryVel = entryVel;}
-    double getExitVelocity() const {return exitVel;}
-    void setExitVelocity(double exitVel) {this->exitVel = exitVel;}
-    double getDeltaVelocity() const {return deltaV;}
-    double getLength() const {return length;}
-    void restart(double length);
+    OpenCLSweep(const cb::SmartPointer<GCode::ToolPath> &path);
+    ~OpenCLSweep();
 
-    void insert(cb::JSON::Sink &sink);
+    /// Sets @param cut[i] to true for every point cut by one of its hits.
+    void cut(double startTime, double endTime,
+             const std::vector<cb::Vector3D> &points,
+             const std::vector<hit_t> &hits, std::vector<char> &cut);
   };
 }
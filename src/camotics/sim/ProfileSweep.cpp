@@ -0,0 +1,255 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "ProfileSweep.h"
+
+#include <cbang/Exception.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  inline double sqr(double x) {return x * x;}
+}
+
+
+ProfileSweep::ProfileSweep(const vector<Vector2D> &profile,
+                           unsigned samples) : radius(0), convex(true) {
+  if (profile.size() < 2) THROW("Tool profile needs at least two points");
+  if (profile[0].y()) THROW("Tool profile must start at the tip");
+
+  for (unsigned i = 0; i < profile.size(); i++) {
+    if (profile[i].x() < 0) THROW("Tool profile radius cannot be negative");
+    if (i && profile[i].y() < profile[i - 1].y())
+      THROW("Tool profile heights must increase from the tip");
+    if (radius < profile[i].x()) radius = profile[i].x();
+  }
+
+  length = profile.back().y();
+  if (length <= 0) THROW("Tool profile has no height");
+
+  if (samples < 2) samples = 2;
+  step = length / (samples - 1);
+  invStep = 1 / step;
+
+  // Resample, taking the wider side where the profile steps out
+  radii.resize(samples);
+
+  for (unsigned i = 0; i < samples; i++) {
+    double h = i == samples - 1 ? length : i * step;
+    double r = 0;
+
+    for (unsigned j = 1; j < profile.size(); j++) {
+      const Vector2D &a = profile[j - 1];
+      const Vector2D &b = profile[j];
+      if (h < a.y() || b.y() < h) continue;
+
+      double t = a.y() == b.y() ? 1 : (h - a.y()) / (b.y() - a.y());
+      r = max(r, a.y() == b.y() ? max(a.x(), b.x()) :
+              a.x() + (b.x() - a.x()) * t);
+    }
+
+    radii[i] = r;
+  }
+
+  // A revolved profile is convex where its radius is concave in height
+  for (unsigned i = 1; i + 1 < samples; i++)
+    if (2 * radii[i] + 1e-9 * radius < radii[i - 1] + radii[i + 1])
+      convex = false;
+
+  // Sparse table of range maxima
+  logs.resize(samples + 1, 0);
+  for (unsigned n = 2; n <= samples; n++) logs[n] = logs[n / 2] + 1;
+
+  maxima.push_back(radii);
+
+  for (unsigned k = 1; (1U << k) <= samples; k++) {
+    const vector<double> &prev = maxima.back();
+    unsigned half = 1 << (k - 1);
+    vector<double> level(samples - (1 << k) + 1);
+
+    for (unsigned i = 0; i < level.size(); i++)
+      level[i] = max(prev[i], prev[i + half]);
+
+    maxima.push_back(level);
+  }
+}
+
+
+double ProfileSweep::getRadiusAt(double h) const {
+  if (h <= 0) return radii.front();
+
+  double f = h * invStep;
+  unsigned i = (unsigned)f;
+  if (radii.size() - 1 <= i) return radii.back();
+
+  return radii[i] + (radii[i + 1] - radii[i]) * (f - i);
+}
+
+
+double ProfileSweep::getMaxRadius(double h0, double h1) const {
+  double r = max(getRadiusAt(h0), getRadiusAt(h1));
+
+  // Between the ends the widest point is one of the samples
+  int i0 = floor(h0 * invStep) + 1;
+  int i1 = ceil(h1 * invStep) - 1;
+  if (i0 < 0) i0 = 0;
+  if ((int)radii.size() <= i1) i1 = radii.size() - 1;
+
+  if (i0 <= i1) {
+    unsigned k = logs[i1 - i0 + 1];
+    r = max(r, max(maxima[k][i0], maxima[k][i1 - (1 << k) + 1]));
+  }
+
+  return r;
+}
+
+
+void ProfileSweep::getBBoxes(const Vector3D &start, const Vector3D &end,
+                             vector<Rectangle3D> &bboxes,
+                             double tolerance) const {
+  Sweep::getBBoxes(start, end, bboxes, radius, length, 0, tolerance);
+}
+
+
+double ProfileSweep::depth(const Vector3D &A, const Vector3D &B,
+                           const Vector3D &P) const {
+  // Closed form distances for plunges and 2.5D moves
+  if (A.x() == B.x() && A.y() == B.y()) {
+    if (A.z() == B.z()) return -1;
+    return plungeDepth(A, B, P);
+  }
+
+  if (A.z() == B.z()) return planarDepth(A, B, P);
+
+  // Other moves only report inside or outside
+  return cuts(A, B, P) ? 1 : -1;
+}
+
+
+double ProfileSweep::plungeDepth(const Vector3D &A, const Vector3D &B,
+                                 const Vector3D &P) const {
+  // At height Pz the cut radius is the widest tool section that passes
+  // through Pz, as in ConicSweep::plungeDepth()
+  const double Pz = P.z();
+  const double zMin = min(A.z(), B.z());
+  const double zMax = max(A.z(), B.z()) + length;
+  const double hMin = max(0.0, min(length, Pz - max(A.z(), B.z())));
+  const double hMax = max(0.0, min(length, Pz - zMin));
+
+  const double r = getMaxRadius(hMin, hMax);
+  const double d = sqrt(sqr(P.x() - A.x()) + sqr(P.y() - A.y()));
+
+  if (Pz < zMin || zMax < Pz || r < d) {
+    const double dz = Pz < zMin ? zMin - Pz : (zMax < Pz ? Pz - zMax : 0);
+    const double dr = r < d ? d - r : 0;
+    return -sqrt(sqr(dz) + sqr(dr));
+  }
+
+  return min(r - d, min(Pz - zMin, zMax - Pz));
+}
+
+
+double ProfileSweep::planarDepth(const Vector3D &A, const Vector3D &B,
+                                 const Vector3D &P) const {
+  // The cut at height Pz is the 2D capsule around AB with the tool radius
+  // at that height
+  const double h = P.z() - A.z();
+  const double r = getRadiusAt(h < 0 ? 0 : (length < h ? length : h));
+  const double ABx = B.x() - A.x(), ABy = B.y() - A.y();
+  const double APx = P.x() - A.x(), APy = P.y() - A.y();
+
+  double t = (APx * ABx + APy * ABy) / (sqr(ABx) + sqr(ABy));
+  t = t < 0 ? 0 : (1 < t ? 1 : t);
+
+  const double d = sqrt(sqr(APx - t * ABx) + sqr(APy - t * ABy));
+
+  if (h < 0 || length < h || r < d) {
+    const double dz = h < 0 ? -h : (length < h ? h - length : 0);
+    const double dr = r < d ? d - r : 0;
+    return -sqrt(sqr(dz) + sqr(dr));
+  }
+
+  return min(r - d, min(h, length - h));
+}
+
+
+bool ProfileSweep::cuts(const Vector3D &A, const Vector3D &B,
+                        const Vector3D &P) const {
+  // With the tip at A + beta * AB, P is at height h(beta) = Hz - beta * ABz
+  // above it and cut if its XY distance d(beta) is at most r(h(beta)).
+  const double ABx = B.x() - A.x(), ABy = B.y() - A.y(), ABz = B.z() - A.z();
+  const double APx = P.x() - A.x(), APy = P.y() - A.y();
+  const double Hz = P.z() - A.z();
+
+  // d(beta)^2 = c2 + s2 * (beta - beta0)^2
+  const double s2 = sqr(ABx) + sqr(ABy);
+  const double s = sqrt(s2);
+  const double beta0 = (APx * ABx + APy * ABy) / s2;
+  const double c2 = max(0.0, sqr(APx) + sqr(APy) - sqr(beta0) * s2);
+  if (sqr(radius) < c2) return false;
+
+  // Where the tool spans P's height and is near enough at its widest
+  const double reach = sqrt(sqr(radius) - c2) / s;
+  double b0 = (Hz - length) / ABz;
+  double b1 = Hz / ABz;
+  if (b1 < b0) swap(b0, b1);
+
+  const double lo = max(max(0.0, beta0 - reach), b0);
+  const double hi = min(min(1.0, beta0 + reach), b1);
+  if (hi < lo) return false;
+
+  // Within each table cell r is linear in beta and d is convex, so
+  // r - d is concave and its maximum has a closed form
+  const double c = sqrt(c2);
+  const double hLo = max(0.0, min(Hz - lo * ABz, Hz - hi * ABz));
+  const double hHi = min(length, max(Hz - lo * ABz, Hz - hi * ABz));
+  unsigned first = (unsigned)(hLo * invStep);
+  unsigned last = min((unsigned)(hHi * invStep), (unsigned)radii.size() - 2);
+
+  for (unsigned i = first; i <= last; i++) {
+    // The cell's range of beta
+    double t0 = (Hz - (i + 1) * step) / ABz;
+    double t1 = (Hz - i * step) / ABz;
+    if (t1 < t0) swap(t0, t1);
+    t0 = max(t0, lo);
+    t1 = min(t1, hi);
+    if (t1 < t0) continue;
+
+    // r(beta) = a + k * beta
+    const double slope = (radii[i + 1] - radii[i]) * invStep;
+    const double k = -slope * ABz;
+    const double a = radii[i] + slope * (Hz - i * step);
+
+    double beta;
+    if (sqr(k) < s2) beta = beta0 + k * c / (s * sqrt(s2 - sqr(k)));
+    else beta = 0 < k ? t1 : t0;
+    beta = beta < t0 ? t0 : (t1 < beta ? t1 : beta);
+
+    if (sqrt(c2 + s2 * sqr(beta - beta0)) <= a + k * beta) return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,76 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Sweep.h"
+
+#include <cbang/geom/Vector.h>
+
+
+namespace CAMotics {
+  /***
+   * A tool of any revolved profile, given as (radius, height) points from
+   * the tip up.  The profile is resampled into a table of radii at even
+   * heights so the radius at any height is one interpolation and the widest
+   * radius over any range of heights, which a plunge sweeps, is one lookup
+   * in a sparse table of maxima.
+   */
+  class ProfileSweep : public Sweep {
+    double length;
+    double radius;
+    double step;
+    double invStep;
+    bool convex;
+
+    std::vector<double> radii; ///< At even heights above the tip
+    /// maxima[k][i] is the widest of radii[i] to radii[i + 2^k]
+    std::vector<std::vector<double> > maxima;
+    std::vector<unsigned> logs; ///< floor(log2(n)) by n
+
+  public:
+    ProfileSweep(const std::vector<cb::Vector2D> &profile,
+                 unsigned samples = 256);
+
+    /// @return the tool radius at height @param h above the tip.
+    double getRadiusAt(double h) const;
+    /// @return the widest tool radius between heights @param h0 and
+    /// @param h1 above the tip.
+    double getMaxRadius(double h0, double h1) const;
+
+    // From Sweep
+    void getBBoxes(const cb::Vector3D &start, const cb::Vector3D &end,
+                   std::vector<cb::Rectangle3D> &bboxes,
+                   double tolerance) const;
+    double depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                 const cb::Vector3D &p) const;
+    double getRadius() const {return radius;}
+    bool isConvex() const {return convex;}
+
+  protected:
+    double plungeDepth(const cb::Vector3D &A, const cb::Vector3D &B,
+                       const cb::Vector3D &P) const;
+    double planarDepth(const cb::Vector3D &A, const cb::Vector3D &B,
+                       const cb::Vector3D &P) const;
+    bool cuts(const cb::Vector3D &A, const cb::Vector3D &B,
+              const cb::Vector3D &P) const;
+  };
+}
@@ -29,7 +29,6 @@
 #include <gcode/ToolTable.h>
 
 #include <cbang/os/SystemUtilities.h>
-#include <cbang/time/Time.h>
 #include <cbang/log/Logger.h>
 #include <cbang/xml/XMLWriter.h>
 #include <cbang/xml/XMLReader.h>
@@ -42,22 +41,38 @@ using namespace CAMotics;
 
 
 Project::Project(Options &_options, const std::string &filename) :
-  options(_options), filename(filename), workpieceMargin(5), watch(true),
-  lastWatch(0), dirty(false) {
+  options(_options), filename(filename), planTimes(false), timeBudget(60),
+  memoryBudget(0), costThreads(0), workpieceMargin(5), watch(true),
+  dirty(false) {
 
   options.setAllowReset(true);
 
   options.pushCategory("Project");
   options.add("units", "GCode::Units used in project measurement",
               new EnumConstraint<GCode::ToolUnits>)->setDefault("mm");
+  options.addTarget("plan-times", planTimes, "Estimate move times with "
+                    "acceleration and jerk limits rather than as distance "
+                    "over feed");
   options.popCategory();
 
   options.pushCategory("Renderer");
   options.add("resolution-mode", "Automatically compute a reasonable renderer "
               "grid resolution.  Valid values are 'low', 'medium', 'high', "
-              "'manual'.  If 'manual' then 'resolution' will be used.",
+              "'very_high', 'budget' or 'manual'.  If 'manual' then "
+              "'resolution' will be used.  If 'budget' the finest "
+              "resolution predicted to fit 'time-budget' and "
+              "'memory-budget' is used.",
               new EnumConstraint<ResolutionMode>)->setDefault("medium");
   options.addTarget("resolution", resolution, "Renderer grid resolution");
+  options.addTarget("time-budget", timeBudget, "Seconds a simulation may "
+                    "take in the 'budget' resolution mode.  Zero is no "
+                    "limit.");
+  options.addTarget("memory-budget", memoryBudget, "MiB a simulation may "
+                    "use in the 'budget' resolution mode.  Zero is no "
+                    "limit.");
+  options.addTarget("cost-model", costModelFile, "Rates written by "
+                    "'simbench --calibrate' which predict the cost of "
+                    "simulations in the 'budget' resolution mode.");
   options.addTarget("render-mode", mode, "Render surface generation mode.");
   options.popCategory();
 
@@ -156,9 +171,41 @@ double Project::computeResolution(ResolutionMode mode, cb::Rectangle3D bounds) {
 
 void Project::updateResolution() {
   ResolutionMode mode = getResolutionMode();
+  cb::Rectangle3D bounds = getWorkpieceBounds();
+
+  if (mode == ResolutionMode::RESOLUTION_BUDGET && !path.isNull() &&
+      bounds != cb::Rectangle3D()) {
+    if (costPath != path || costBounds != bounds || costThreads != threads) {
+      costFeatures = CostModel::measure(path, bounds, threads);
+      costPath = path;
+      costBounds = bounds;
+      costThreads = threads;
+    }
+
+    // Search from a quarter of very high to four times low
+    double minRes =
+      computeResolution(ResolutionMode::RESOLUTION_VERY_HIGH, bounds) / 4;
+    double maxRes =
+      computeResolution(ResolutionMode::RESOLUTION_LOW, bounds) * 4;
+
+    setResolution(getCostModel().fit(costFeatures, timeBudget,
+                                     memoryBudget * 1024 * 1024, minRes,
+                                     maxRes));
+
+  } else if (mode != ResolutionMode::RESOLUTION_MANUAL)
+    setResolution(computeResolution(mode, bounds));
+}
+
 
-  if (mode != ResolutionMode::RESOLUTION_MANUAL)
-    setResolution(computeResolution(mode, getWorkpieceBounds()));
+CostModel Project::getCostModel() const {
+  CostModel model;
+  if (!costModelFile.empty()) model.load(costModelFile);
+  return model;
+}
+
+
+CostModel::Cost Project::getPredictedCost() const {
+  return getCostModel().estimate(costFeatures, resolution);
 }
 
 
@@ -252,16 +299,14 @@ void Project::removeFile(unsigned index) {
 bool Project::checkFiles() {
   bool changed = false;
 
-  if (watch && lastWatch < Time::now()) {
+  if (watch)
     for (iterator it = begin(); it != end(); it++)
       if ((*it)->changed()) {
         LOG_INFO(1, "File changed: " << (*it)->getRelativePath());
+        (*it)->update();
         changed = true;
       }
 
-    lastWatch = Time::now();
-  }
-
   return changed;
 }
 
@@ -271,23 +316,17 @@ void Project::updateAutomaticWorkpiece(GCode::ToolPath &path) {
   setAutomaticWorkpiece(true);
   cb::Rectangle3D wpBounds;
 
-  // Guess workpiece bounds from cutting moves
-  vector<SmartPointer<Sweep> > sweeps;
+  // Guess workpiece bounds from cutting moves.  Sweeping each tool across
+  // the bounds of all of its cuts, kept by the path as it was made, covers
+  // the same space as sweeping it across each cut's bounds.
   vector<cb::Rectangle3D> bboxes;
+  const map<int, cb::Rectangle3D> &cutBounds = path.getCutBounds();
 
-  for (unsigned i = 0; i < path.size(); i++) {
-    const GCode::Move &move = path.at(i);
-
-    if (move.getType() == GCode::MoveType::MOVE_RAPID) continue;
-
-    int tool = move.getTool();
-    if (tool < 0) continue;
-
-    if (sweeps.size() <= (unsigned)tool) sweeps.resize(tool + 1);
-    if (sweeps[tool].isNull())
-      sweeps[tool] = ToolSweep::getSweep(tools.get(tool));
-
-    sweeps[tool]->getBBoxes(move.getStartPt(), move.getEndPt(), bboxes, 0);
+  for (map<int, cb::Rectangle3D>::const_iterator it = cutBounds.begin();
+       it != cutBounds.end(); it++) {
+    SmartPointer<Sweep> sweep = ToolSweep::getSweep(tools.get(it->first));
+    const cb::Rectangle3D &bounds = it->second;
+    sweep->getBBoxes(bounds.getMin(), bounds.getMax(), bboxes, 0);
   }
 
   for (unsigned i = 0; i < bboxes.size(); i++) wpBounds.add(bboxes[i]);
@@ -24,6 +24,7 @@
 #include "ResolutionMode.h"
 #include "NCFile.h"
 #include "Simulation.h"
+#include "CostModel.h"
 
 #include <gcode/ToolUnits.h>
 #include <gcode/ToolTable.h>
@@ -44,6 +45,17 @@ namespace CAMotics {
   class Project : public Simulation {
     cb::OptionProxy options;
     std::string filename;
+    bool planTimes;
+
+    double timeBudget;
+    double memoryBudget; ///< MiB
+    std::string costModelFile;
+
+    // The features last measured for the budget resolution mode
+    CostModel::Features costFeatures;
+    cb::SmartPointer<GCode::ToolPath> costPath;
+    cb::Rectangle3D costBounds;
+    unsigned costThreads;
 
     double workpieceMargin;
     std::string workpieceMin;
@@ -52,7 +64,6 @@ namespace CAMotics {
     typedef std::list<cb::SmartPointer<NCFile> > files_t;
     files_t files;
     bool watch;
-    uint64_t lastWatch;
 
     bool dirty;
 
@@ -75,13 +86,24 @@ namespace CAMotics {
     GCode::ToolUnits getUnits() const;
     bool isMetric() const {return getUnits() == GCode::ToolUnits::UNITS_MM;}
 
+    bool getPlanTimes() const {return planTimes;}
+
     ResolutionMode getResolutionMode() const;
     void setResolutionMode(ResolutionMode mode);
     double getResolution() const {return resolution;}
     void setResolution(double resolution);
     static double computeResolution(ResolutionMode mode, cb::Rectangle3D bounds);
+    /// In the budget mode the resolution is fitted to the path, so this
+    /// should be called again once it is set.
     void updateResolution();
 
+    double getTimeBudget() const {return timeBudget;}
+    double getMemoryBudget() const {return memoryBudget;}
+    CostModel getCostModel() const;
+    /// @return the cost predicted for the current resolution by the last
+    /// budget mode update.
+    CostModel::Cost getPredictedCost() const;
+
     RenderMode getRenderMode() const {return mode;}
     void setRenderMode(RenderMode mode) {this->mode = mode;}
 
@@ -96,6 +118,8 @@ namespace CAMotics {
     cb::SmartPointer<NCFile> findFile(const std::string &filename) const;
     void addFile(const std::string &filename);
     void removeFile(unsigned i);
+    bool getWatch() const {return watch;}
+    /// @return true if any file changed since it was last checked.
     bool checkFiles();
 
     void updateAutomaticWorkpiece(GCode::ToolPath &path);
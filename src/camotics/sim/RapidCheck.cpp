@@ -0,0 +1,187 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "RapidCheck.h"
+#include "Simulation.h"
+#include "ToolSweep.h"
+#include "CutWorkpiece.h"
+#include "Sweep.h"
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+#include <cbang/geom/Rectangle.h>
+#include <cbang/os/Thread.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  class CheckJob : public Thread {
+    const RapidCheck &check;
+    const vector<unsigned> &rapids;
+    unsigned first;
+    unsigned step;
+
+  public:
+    vector<RapidCheck::Crash> crashes;
+
+    CheckJob(const RapidCheck &check, const vector<unsigned> &rapids,
+             unsigned first, unsigned step) :
+      check(check), rapids(rapids), first(first), step(step) {}
+
+
+    void compute() {
+      // Interleaved, since rapids far from the stock return at once
+      RapidCheck::Crash crash;
+      for (unsigned i = first; i < rapids.size(); i += step)
+        if (check.check(rapids[i], crash)) crashes.push_back(crash);
+    }
+
+
+    // From Thread
+    void run() {
+      try {
+        compute();
+      } CATCH_ERROR;
+    }
+  };
+
+
+  bool crash_less(const RapidCheck::Crash &a, const RapidCheck::Crash &b) {
+    return a.move < b.move;
+  }
+}
+
+
+RapidCheck::RapidCheck(const Simulation &sim) :
+  resolution(sim.resolution),
+  endTime(sim.time ? sim.time : numeric_limits<double>::max()) {
+  if (!sim.workpiece.isValid()) THROW("Rapid check needs a workpiece");
+  if (resolution <= 0) THROW("Rapid check needs a positive resolution");
+
+  sweep = new ToolSweep(sim.path, 0, endTime, sim.lookup, sim.threads);
+  cutWP = new CutWorkpiece(sweep, sim.workpiece);
+}
+
+
+RapidCheck::~RapidCheck() {}
+
+
+unsigned RapidCheck::run(unsigned threads) {
+  const GCode::ToolPath &path = *sweep->getPath();
+
+  vector<unsigned> rapids;
+  for (unsigned i = 0; i < path.size(); i++) {
+    const GCode::Move &move = path.at(i);
+    if (endTime < move.getStartTime()) break;
+    if (move.getType() == GCode::MoveType::MOVE_RAPID) rapids.push_back(i);
+  }
+
+  if (rapids.size() < threads) threads = rapids.size();
+  if (!threads) threads = 1;
+
+  vector<SmartPointer<CheckJob> > jobs;
+  for (unsigned i = 0; i < threads; i++)
+    jobs.push_back(new CheckJob(*this, rapids, i, threads));
+
+  try {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->start();
+    jobs[0]->compute();
+
+  } catch (...) {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+    throw;
+  }
+
+  for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+
+  crashes.clear();
+  for (unsigned i = 0; i < threads; i++)
+    crashes.insert(crashes.end(), jobs[i]->crashes.begin(),
+                   jobs[i]->crashes.end());
+  sort(crashes.begin(), crashes.end(), crash_less);
+
+  return crashes.size();
+}
+
+
+bool RapidCheck::check(unsigned index, Crash &crash) const {
+  const GCode::ToolPath &path = *sweep->getPath();
+  const GCode::Move &move = path.at(index);
+  const GCode::Tool *tool = path.getTool(move);
+  if (!tool) return false;
+
+  // The tool reaches up its length from the tip
+  const Sweep &toolSweep = sweep->getSweep(move);
+  double radius = toolSweep.getRadius();
+  Rectangle3D bounds = move.getBounds();
+  bounds = Rectangle3D(bounds.getMin() - Vector3D(radius, radius, 0),
+                       bounds.getMax() +
+                       Vector3D(radius, radius, tool->getLength()));
+
+  // Most rapids stay clear of the stock and of every cut
+  const Workpiece &workpiece = cutWP->getWorkpiece();
+  if (!bounds.intersects(workpiece.getBounds())) return false;
+  bounds = bounds.intersection(workpiece.getBounds());
+
+  Vector3D start = move.getStartPt();
+  Vector3D end = move.getEndPt();
+  double time = move.getStartTime();
+
+  Vector3U steps;
+  Vector3D dims = bounds.getDimensions();
+  for (unsigned i = 0; i < 3; i++)
+    steps[i] = (unsigned)max(1.0, ceil(dims[i] / resolution));
+
+  Vector3D p;
+  for (unsigned z = 0; z < steps.z(); z++) {
+    p.z() = bounds.getMin().z() + (z + 0.5) * resolution;
+
+    for (unsigned y = 0; y < steps.y(); y++) {
+      p.y() = bounds.getMin().y() + (y + 0.5) * resolution;
+
+      for (unsigned x = 0; x < steps.x(); x++) {
+        p.x() = bounds.getMin().x() + (x + 0.5) * resolution;
+
+        // Cheapest tests first, the cut workpiece needs a lookup
+        if (toolSweep.depth(start, end, p) <= 0) continue;
+        if (cutWP->depthBefore(p, time) <= 0) continue;
+
+        crash.move = index;
+        crash.line = move.getLine();
+        crash.time = time;
+        crash.point = p;
+
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,75 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Vector.h>
+
+#include <vector>
+
+
+namespace GCode {class Move;}
+
+namespace CAMotics {
+  class Simulation;
+  class ToolSweep;
+  class CutWorkpiece;
+
+  /***
+   * Finds rapid moves which pass through stock still left when they are
+   * made.  The volume swept by each rapid is sampled on a grid and tested
+   * against the workpiece as cut by the moves before it, so no surface is
+   * computed.
+   */
+  class RapidCheck {
+  public:
+    struct Crash {
+      unsigned move;
+      unsigned line;
+      double time;
+      cb::Vector3D point; ///< Stock inside the rapid's sweep
+    };
+
+  protected:
+    cb::SmartPointer<ToolSweep> sweep;
+    cb::SmartPointer<CutWorkpiece> cutWP;
+    double resolution;
+    double endTime;
+
+    std::vector<Crash> crashes;
+
+  public:
+    RapidCheck(const Simulation &sim);
+    ~RapidCheck();
+
+    const std::vector<Crash> &getCrashes() const {return crashes;}
+
+    /// Check every rapid on up to @param threads threads.
+    /// @return the number of rapids which crash.
+    unsigned run(unsigned threads = 1);
+
+    /// @return true and fill @param crash if the rapid @param index
+    /// crashes.
+    bool check(unsigned index, Crash &crash) const;
+  };
+}
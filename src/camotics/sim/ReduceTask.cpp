@@ -20,6 +20,8 @@
 
 #include "ReduceTask.h"
 
+#include <camotics/Trace.h>
+#include <camotics/MemoryUsage.h>
 #include <camotics/contour/Surface.h>
 
 #include <cbang/util/DefaultCatch.h>
@@ -30,24 +32,36 @@ using namespace cb;
 using namespace CAMotics;
 
 
-ReduceTask::ReduceTask(const Surface &surface) : surface(surface.copy()) {}
+ReduceTask::ReduceTask(const SmartPointer<Surface> &source,
+                       unsigned threads, const ReduceTarget &target) :
+  source(source), threads(threads ? threads : 1), target(target) {}
 
 
 void ReduceTask::run() {
   LOG_INFO(1, "Reducing mesh");
 
-  double startCount = surface->getCount();
+  double startCount = source->getCount();
 
   Task::begin();
   Task::update(0, "Reducing mesh...");
 
-  surface->reduce(*this);
+  {
+    CAMOTICS_TRACE("Reduce");
+    surface = source->reduce(*this, threads, target);
+  }
+  source.release(); // Let the caller free it once replaced
+
+  double delta = Task::end();
+  if (surface.isNull()) return; // Interrupted
 
   unsigned count = surface->getCount();
   double r = (double)(startCount - count) / startCount * 100;
 
-  double delta = Task::end();
-
   LOG_INFO(1, "Time: " << TimeInterval(delta)
            << String::printf(" Triangles: %u Reduction: %0.2f%%", count, r));
+
+  MemoryUsage memory;
+  memory.add("reduced", surface->getMemoryUsage());
+  MemoryUsage::record(memory);
+  LOG_INFO(1, "Memory: " << memory.toString());
 }
@@ -22,6 +22,7 @@
 
 
 #include <camotics/Task.h>
+#include <camotics/contour/ReduceTarget.h>
 
 #include <cbang/SmartPointer.h>
 
@@ -30,11 +31,17 @@ namespace CAMotics {
   class Surface;
 
   class ReduceTask : public Task {
+    cb::SmartPointer<Surface> source;
     cb::SmartPointer<Surface> surface;
+    unsigned threads;
+    ReduceTarget target;
 
   public:
-    ReduceTask(const Surface &surface);
+    /// @param source is shared, not copied, and left unchanged.
+    ReduceTask(const cb::SmartPointer<Surface> &source, unsigned threads = 1,
+               const ReduceTarget &target = ReduceTarget());
 
+    /// @return the reduced surface or null if the task was interrupted.
     const cb::SmartPointer<Surface> &getSurface() const {return surface;}
 
     // From Task
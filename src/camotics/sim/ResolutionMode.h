@@ -36,5 +36,6 @@ CBANG_ENUM_EXPAND(RESOLUTION_LOW,       1)
 CBANG_ENUM_EXPAND(RESOLUTION_MEDIUM,    2)
 CBANG_ENUM_EXPAND(RESOLUTION_HIGH,      3)
 CBANG_ENUM_EXPAND(RESOLUTION_VERY_HIGH, 4)
+CBANG_ENUM_EXPAND(RESOLUTION_BUDGET,    5)
 
 #endif // CBANG_ENUM_EXPAND
@@ -0,0 +1,123 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "STLStreamer.h"
+
+#include <camotics/contour/GridTreeRef.h>
+#include <stl/Sink.h>
+
+#include <cbang/util/SmartLock.h>
+#include <cbang/util/DefaultCatch.h>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Rendering waits while more than this many vertex floats, 64MB, are
+  // queued
+  const uint64_t maxQueuedFloats = 1 << 24;
+}
+
+
+STLStreamer::STLStreamer(STL::Sink &sink) :
+  sink(sink), queuedFloats(0), finished(false), stopped(false), count(0) {}
+
+
+void STLStreamer::finish() {
+  {
+    SmartLock lock(&condition);
+    finished = true;
+    condition.broadcast();
+  }
+
+  join();
+}
+
+
+void STLStreamer::gridCompleted(GridTreeRef &grid) {
+  // Facet normals are computed from the vertices when written
+  SmartPointer<batch_t> batch = new batch_t;
+  vector<float> normals;
+  grid.gather(*batch, normals);
+  vector<float>().swap(normals);
+  grid.clear(); // Written from here on
+
+  if (batch->empty()) return;
+
+  SmartLock lock(&condition);
+
+  // A batch larger than the limit is still queued on its own
+  while (!stopped && !queue.empty() &&
+         maxQueuedFloats < queuedFloats + batch->size())
+    condition.wait();
+
+  if (stopped) return; // Writing failed
+
+  queuedFloats += batch->size();
+  queue.push_back(batch);
+  condition.broadcast();
+}
+
+
+void STLStreamer::write(const batch_t &v) {
+  Vector3F p[3];
+
+  for (unsigned i = 0; i + 8 < v.size(); i += 9) {
+    for (unsigned j = 0; j < 3; j++)
+      p[j] = Vector3F(v[i + j * 3], v[i + j * 3 + 1], v[i + j * 3 + 2]);
+
+    // Vertex normals are averaged so use the face normal
+    Vector3F normal = (p[1] - p[0]).cross(p[2] - p[0]);
+    double length = normal.length();
+    if (length) normal /= length;
+
+    sink.writeFacet(p[0], p[1], p[2], normal);
+    count++;
+  }
+}
+
+
+void STLStreamer::run() {
+  try {
+    while (true) {
+      SmartPointer<batch_t> batch;
+
+      {
+        SmartLock lock(&condition);
+        while (queue.empty() && !finished) condition.wait();
+        if (queue.empty()) break;
+
+        batch = queue.front();
+        queue.pop_front();
+        queuedFloats -= batch->size();
+        condition.broadcast();
+      }
+
+      write(*batch);
+    }
+  } CATCH_ERROR;
+
+  SmartLock lock(&condition);
+  stopped = true;
+  queue.clear();
+  condition.broadcast();
+}
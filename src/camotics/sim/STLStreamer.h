@@ -0,0 +1,74 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <camotics/render/RenderObserver.h>
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+#include <cbang/os/Thread.h>
+#include <cbang/os/Condition.h>
+
+#include <vector>
+#include <list>
+
+
+namespace STL {class Sink;}
+
+namespace CAMotics {
+  /***
+   * Writes the triangles of each completed grid to an STL sink from a
+   * background thread and frees the grid's cells, so a surface can be
+   * exported without ever holding all of it.  The renderer waits to report
+   * more grids while too many triangles are queued.
+   */
+  class STLStreamer : public RenderObserver, public cb::Thread {
+    STL::Sink &sink;
+
+    typedef std::vector<float> batch_t;
+
+    cb::Condition condition;
+    std::list<cb::SmartPointer<batch_t> > queue; // Triangle vertices
+    uint64_t queuedFloats;
+    bool finished;
+    bool stopped;
+    uint64_t count;
+
+  public:
+    STLStreamer(STL::Sink &sink);
+
+    /// @return the number of facets written, final after finish().
+    uint64_t getCount() const {return count;}
+
+    /// Write the grids still queued and wait for the thread to exit.
+    void finish();
+
+    // From RenderObserver
+    void gridCompleted(GridTreeRef &grid);
+
+  protected:
+    void write(const batch_t &v);
+
+    // From Thread
+    void run();
+  };
+}
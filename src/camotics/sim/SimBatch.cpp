@@ -0,0 +1,334 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "SimBatch.h"
+#include "CutSim.h"
+#include "Project.h"
+#include "SurfaceCache.h"
+#include "ToolPathCache.h"
+
+#include <camotics/contour/Surface.h>
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/config/Options.h>
+#include <cbang/json/JSON.h>
+#include <cbang/log/Logger.h>
+#include <cbang/os/DirectoryWalker.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/os/Thread.h>
+#include <cbang/time/TimeInterval.h>
+#include <cbang/time/Timer.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/util/SmartLock.h>
+
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Surface memory grows with the area, not the volume, of the workpiece.
+  // Measured on the examples, with room for the grids being contoured.
+  const double bytesPerSurfaceCell = 1024;
+
+
+  void setResolution(Project &project, const string &resolution) {
+    if (resolution.empty()) return;
+
+    ResolutionMode resMode = ResolutionMode::RESOLUTION_MANUAL;
+    double res = 0;
+
+    try {
+      res = String::parseDouble(resolution);
+    } catch (const Exception &e) {}
+
+    if (res) project.setResolution(res);
+    else resMode = ResolutionMode::parse(resolution, resMode);
+
+    project.setResolutionMode(resMode);
+  }
+}
+
+
+class SimBatch::Worker : public Thread {
+  SimBatch &batch;
+
+public:
+  Worker(SimBatch &batch) : batch(batch) {}
+
+  // From Thread
+  void run() {batch.work();}
+};
+
+
+SimBatch::SimBatch(unsigned workers, unsigned threads, uint64_t budget,
+                   const string &cache) :
+  workers(workers ? workers : 1), threads(threads ? threads : 1),
+  budget(budget), cache(cache), nextJob(0), failed(0), used(0),
+  quit(false) {}
+
+
+SimBatch::~SimBatch() {}
+
+
+void SimBatch::read(const string &path) {
+  if (SystemUtilities::isDirectory(path)) readDirectory(path);
+  else readJSON(path);
+}
+
+
+void SimBatch::add(const SmartPointer<Job> &job) {
+  if (job->input.empty()) THROW("Batch job has no input");
+
+  if (job->output.empty()) {
+    string ext = SystemUtilities::extension(job->input);
+    job->output = job->input.substr(0, job->input.length() - ext.length());
+    if (ext.empty()) job->output += ".";
+    job->output += "stl";
+  }
+
+  jobs.push_back(job);
+  paths[job->input].users++;
+}
+
+
+unsigned SimBatch::run() {
+  vector<SmartPointer<Worker> > pool;
+
+  unsigned count = std::min(workers, (unsigned)jobs.size());
+  for (unsigned i = 1; i < count; i++) {
+    pool.push_back(new Worker(*this));
+    pool.back()->start();
+  }
+
+  if (count) work();
+
+  for (unsigned i = 0; i < pool.size(); i++) pool[i]->join();
+
+  return failed;
+}
+
+
+void SimBatch::interrupt() {
+  SmartLock lock(this);
+
+  quit = true;
+  for (set<CutSim *>::iterator it = running.begin(); it != running.end();
+       it++)
+    (*it)->interrupt();
+
+  broadcast();
+}
+
+
+uint64_t SimBatch::estimateMemory(const Project &project) {
+  double res = project.getResolution();
+  double cells = project.getWorkpieceBounds().getVolume() / (res * res * res);
+  return 6 * pow(cells, 2.0 / 3.0) * bytesPerSurfaceCell;
+}
+
+
+void SimBatch::readJSON(const string &filename) {
+  SmartPointer<JSON::Value> list = JSON::Reader::parse(InputSource(filename));
+
+  for (unsigned i = 0; i < list->size(); i++) {
+    const JSON::Value &dict = *list->get(i);
+    SmartPointer<Job> job = new Job;
+
+    // Relative to the job list
+    job->input = SystemUtilities::absolute(filename, dict.getString("input"));
+    if (dict.hasString("output"))
+      job->output =
+        SystemUtilities::absolute(filename, dict.getString("output"));
+
+    if (dict.has("resolution"))
+      job->resolution = dict.get("resolution")->isNumber() ?
+        String(dict.getNumber("resolution")) : dict.getString("resolution");
+
+    job->time = dict.getNumber("time", 0);
+    job->reduce = dict.getBoolean("reduce", true);
+    job->binary = dict.getBoolean("binary", true);
+
+    add(job);
+  }
+}
+
+
+void SimBatch::readDirectory(const string &path) {
+  DirectoryWalker walker(path, ".*\\.(xml|nc|ngc|gcode|tpl)", 1);
+
+  while (walker.hasNext()) {
+    SmartPointer<Job> job = new Job;
+    job->input = walker.next();
+    add(job);
+  }
+}
+
+
+SmartPointer<SimBatch::Job> SimBatch::next() {
+  SmartLock lock(this);
+  if (quit || jobs.size() <= nextJob) return 0;
+  return jobs[nextJob++];
+}
+
+
+void SimBatch::work() {
+  CutSim cutSim;
+
+  {
+    SmartLock lock(this);
+    running.insert(&cutSim);
+  }
+
+  while (true) {
+    SmartPointer<Job> job = next();
+    if (job.isNull()) break;
+
+    try {
+      simulate(*job, cutSim);
+    } catch (const Exception &e) {
+      LOG_ERROR(job->input << ": " << e);
+
+      SmartLock lock(this);
+      failed++;
+    }
+  }
+
+  SmartLock lock(this);
+  running.erase(&cutSim);
+}
+
+
+void SimBatch::simulate(const Job &job, CutSim &cutSim) {
+  double start = Timer::now();
+  unsigned jobThreads = std::max(1U, threads / workers);
+
+  Options options;
+  Project project(options);
+
+  if (SystemUtilities::extension(job.input) == "xml") project.load(job.input);
+  else project.addFile(job.input); // Assume TPL or GCode
+
+  setResolution(project, job.resolution);
+  project.time = job.time ? job.time : numeric_limits<double>::max();
+  project.threads = jobThreads;
+  project.workpiece = project.getWorkpieceBounds();
+
+  uint64_t bytes = 0;
+
+  try {
+    project.path = getPath(job, project, cutSim);
+    project.updateAutomaticWorkpiece(*project.path);
+
+    uint64_t estimate = estimateMemory(project);
+    reserve(estimate);
+    bytes = estimate;
+
+    SmartPointer<Surface> surface =
+      cutSim.computeSurface(project, new SurfaceCache(cache));
+
+    if (job.reduce && !surface.isNull())
+      surface = cutSim.reduceSurface(surface, jobThreads);
+
+    if (surface.isNull()) THROW("Interrupted");
+
+    SmartPointer<ostream> stream = SystemUtilities::oopen(job.output);
+    surface->writeSTL(*stream, job.binary, "CAMotics Surface",
+                      project.computeHash());
+
+  } catch (...) {
+    release(bytes);
+    releasePath(job.input);
+    throw;
+  }
+
+  release(bytes);
+  releasePath(job.input);
+
+  LOG_INFO(1, job.input << " -> " << job.output << " in "
+           << TimeInterval(Timer::now() - start));
+}
+
+
+SmartPointer<GCode::ToolPath> SimBatch::getPath(const Job &job,
+                                                 Project &project,
+                                                 CutSim &cutSim) {
+  SmartLock lock(this);
+  SharedPath &shared = paths[job.input];
+
+  // Another worker is computing the same tool path
+  while (shared.computing && !quit) wait();
+  if (quit) THROW("Interrupted");
+  if (!shared.path.isNull()) return shared.path;
+
+  shared.computing = true;
+  SmartPointer<GCode::ToolPath> path;
+
+  this->unlock();
+  try {
+    path = cutSim.computeToolPath(project, new ToolPathCache(cache));
+  } catch (...) {
+    this->lock();
+    shared.computing = false;
+    broadcast();
+    throw;
+  }
+  this->lock();
+
+  // ToolPath::move() already created any missing tools, so simulations
+  // only read the shared path
+
+  shared.path = path;
+  shared.computing = false;
+  broadcast();
+
+  return path;
+}
+
+
+void SimBatch::releasePath(const string &input) {
+  SmartLock lock(this);
+
+  SharedPath &shared = paths[input];
+  if (shared.users && !--shared.users) shared.path.release();
+}
+
+
+void SimBatch::reserve(uint64_t bytes) {
+  SmartLock lock(this);
+
+  // A job larger than the budget runs by itself
+  while (budget && used && budget < used + bytes && !quit) wait();
+  if (quit) THROW("Interrupted");
+
+  used += bytes;
+}
+
+
+void SimBatch::release(uint64_t bytes) {
+  SmartLock lock(this);
+  used -= bytes;
+  broadcast();
+}
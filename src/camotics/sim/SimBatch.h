@@ -0,0 +1,119 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/SmartPointer.h>
+#include <cbang/os/Condition.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+
+namespace CAMotics {
+  class CutSim;
+  class Project;
+
+  /***
+   * Runs many simulations, from a JSON list of jobs or a directory of
+   * projects, on one pool of workers in a single process.  A job starts
+   * once its estimated memory fits in the budget, and jobs of the same
+   * input, at other times or resolutions, share one tool path.
+   */
+  class SimBatch : public cb::Condition {
+  public:
+    struct Job {
+      std::string input;
+      std::string output;
+      std::string resolution;
+      double time;
+      bool reduce;
+      bool binary;
+
+      Job() : time(0), reduce(true), binary(true) {}
+    };
+
+  protected:
+    class Worker;
+
+    unsigned workers;
+    unsigned threads;
+    uint64_t budget;
+    std::string cache;
+
+    std::vector<cb::SmartPointer<Job> > jobs;
+    unsigned nextJob;
+    unsigned failed;
+    uint64_t used;
+    bool quit;
+
+    struct SharedPath {
+      cb::SmartPointer<GCode::ToolPath> path;
+      unsigned users;
+      bool computing;
+
+      SharedPath() : users(0), computing(false) {}
+    };
+
+    typedef std::map<std::string, SharedPath> paths_t;
+    paths_t paths;
+
+    std::set<CutSim *> running;
+
+  public:
+    /// @param threads are divided between @param workers.  A @param budget
+    /// of zero runs jobs regardless of memory.
+    SimBatch(unsigned workers, unsigned threads, uint64_t budget,
+             const std::string &cache = std::string());
+    ~SimBatch();
+
+    unsigned getJobCount() const {return jobs.size();}
+
+    /// Add the jobs listed in a JSON file or the projects in a directory.
+    void read(const std::string &path);
+    void add(const cb::SmartPointer<Job> &job);
+
+    /// @return the number of jobs which failed.
+    unsigned run();
+    void interrupt();
+
+    /// A rough estimate of the memory needed to simulate @param project.
+    static uint64_t estimateMemory(const Project &project);
+
+  protected:
+    void readJSON(const std::string &filename);
+    void readDirectory(const std::string &path);
+
+    cb::SmartPointer<Job> next();
+    void work();
+    void simulate(const Job &job, CutSim &cutSim);
+    cb::SmartPointer<GCode::ToolPath> getPath(const Job &job, Project &project,
+                                              CutSim &cutSim);
+    void releasePath(const std::string &input);
+    void reserve(uint64_t bytes);
+    void release(uint64_t bytes);
+  };
+}
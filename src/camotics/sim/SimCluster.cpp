@@ -0,0 +1,206 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "SimCluster.h"
+#include "ToolPathFile.h"
+
+#include <camotics/contour/TriangleSurface.h>
+#include <camotics/contour/CompositeSurface.h>
+
+#include <stl/Reader.h>
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/json/JSON.h>
+#include <cbang/log/Logger.h>
+#include <cbang/log/AsyncCopyStreamToLog.h>
+#include <cbang/os/Subprocess.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/util/SmartLock.h>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  string getPathFilename(const string &job) {
+    string ext = SystemUtilities::extension(job);
+    if (ext.empty()) return job + ".tpc";
+    return job.substr(0, job.length() - ext.length()) + "tpc";
+  }
+}
+
+
+SimCluster::SimCluster(const string &nodesFile, const string &workDir) :
+  workDir(SystemUtilities::absolute(workDir)), quit(false) {
+  SmartPointer<istream> stream = SystemUtilities::iopen(nodesFile);
+
+  while (stream->good()) {
+    string line;
+    getline(*stream, line);
+    line = String::trim(line);
+    if (!line.empty() && line[0] != '#') nodes.push_back(line);
+  }
+
+  if (nodes.empty()) THROWS("No nodes listed in '" << nodesFile << "'");
+
+  // Nodes are expected to have camsim installed at the same path
+  command = SystemUtilities::getExecutablePath();
+}
+
+
+SimCluster::~SimCluster() {}
+
+
+SmartPointer<Surface> SimCluster::compute(const Simulation &sim,
+                                          const string &name, unsigned parts) {
+  if (!parts) parts = nodes.size();
+
+  string base = SystemUtilities::joinPath(workDir, name);
+  string job = base + "-job.json";
+  writeJob(job, sim);
+
+  vector<string> outputs;
+  vector<SmartPointer<Thread> > logCopiers;
+
+  // Launch a worker for each part
+  for (unsigned i = 0; i < parts; i++) {
+    SmartLock lock(this);
+    if (quit) break;
+
+    const string &node = nodes[i % nodes.size()];
+    vector<string> args;
+    if (node != "local") String::tokenize(node, args);
+
+    outputs.push_back(String::printf("%s-part-%04u.stl", base.c_str(), i));
+
+    args.push_back(command);
+    args.push_back(String::printf("--partition=%u/%u", i, parts));
+    args.push_back("--binary=true");
+    args.push_back(job);
+    args.push_back(outputs.back());
+
+    LOG_INFO(1, "Simulating part " << i << " of " << parts << " on " << node);
+
+    SmartPointer<Subprocess> proc = new Subprocess;
+    proc->exec(args, Subprocess::REDIR_STDOUT |
+               Subprocess::MERGE_STDOUT_AND_STDERR |
+               Subprocess::W32_HIDE_WINDOW, ProcessPriority::PRIORITY_LOW);
+    procs.push_back(proc);
+
+    logCopiers.push_back(new AsyncCopyStreamToLog(proc->getStream(1)));
+    logCopiers.back()->start();
+  }
+
+  // Wait for all of them, even after a failure, so none are left behind
+  unsigned failed = 0;
+  for (unsigned i = 0; i < procs.size(); i++) {
+    try {
+      procs[i]->wait();
+      if (procs[i]->getReturnCode()) {
+        LOG_ERROR("Part " << i << " failed with exit code "
+                  << procs[i]->getReturnCode());
+        failed++;
+      }
+    } catch (const Exception &e) {
+      LOG_ERROR("Part " << i << ": " << e.getMessage());
+      failed++;
+    }
+
+    logCopiers[i]->join();
+  }
+
+  {
+    SmartLock lock(this);
+    procs.clear();
+  }
+
+  // Keep the parts separate, they are only merged and their seams welded
+  // if the surface is reduced
+  SmartPointer<CompositeSurface> surface = new CompositeSurface;
+  if (!quit && !failed)
+    for (unsigned i = 0; i < outputs.size(); i++) {
+      STL::Reader reader(InputSource(outputs[i]));
+      string name, hash;
+      reader.readHeader(name, hash);
+      surface->add(new TriangleSurface(reader));
+    }
+
+  for (unsigned i = 0; i < outputs.size(); i++)
+    if (SystemUtilities::exists(outputs[i]))
+      SystemUtilities::unlink(outputs[i]);
+  SystemUtilities::unlink(job);
+  if (SystemUtilities::exists(getPathFilename(job)))
+    SystemUtilities::unlink(getPathFilename(job));
+
+  if (failed) THROWS(failed << " of " << parts << " parts failed");
+  if (quit) return 0;
+
+  return surface;
+}
+
+
+void SimCluster::interrupt() {
+  SmartLock lock(this);
+  quit = true;
+
+  for (unsigned i = 0; i < procs.size(); i++)
+    try {procs[i]->kill(true);} CATCH_ERROR;
+}
+
+
+void SimCluster::writeJob(const string &filename, const Simulation &sim) {
+  // The tool path is passed in binary, next to the job
+  string pathFilename = getPathFilename(filename);
+  if (!sim.path.isNull()) ToolPathFile::write(pathFilename, *sim.path);
+
+  SmartPointer<ostream> stream = SystemUtilities::oopen(filename);
+  JSON::Writer writer(*stream, 0, true);
+
+  // The mode and lookup are not part of the simulation's own JSON
+  writer.beginDict();
+  writer.insert("mode", sim.mode.toString());
+  writer.insert("lookup", sim.lookup.toString());
+  if (!sim.path.isNull())
+    writer.insert("path", SystemUtilities::basename(pathFilename));
+  writer.beginInsert("simulation");
+  sim.write(writer, false);
+  writer.endDict();
+  writer.close();
+}
+
+
+Simulation SimCluster::readJob(const string &filename) {
+  SmartPointer<JSON::Value> job = JSON::Reader::parse(InputSource(filename));
+
+  Simulation sim;
+  sim.read(*job->get("simulation"));
+  sim.mode = RenderMode::parse(job->getString("mode"));
+  sim.lookup = LookupMode::parse(job->getString("lookup"));
+
+  if (job->has("path"))
+    sim.path = ToolPathFile::read
+      (SystemUtilities::absolute(filename, job->getString("path")), sim.tools);
+
+  return sim;
+}
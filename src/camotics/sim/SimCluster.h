@@ -0,0 +1,74 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include "Simulation.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <vector>
+
+
+namespace cb {class Subprocess;}
+
+namespace CAMotics {
+  class Surface;
+
+  /***
+   * Simulates across several nodes by splitting the workpiece into slabs.
+   * A job file holding the simulation and its tool path is written to a
+   * directory shared by all nodes and each node runs camsim on one slab,
+   * through its launch command such as 'ssh node1'.  Each slab is cut from
+   * the same grid, so the partial surfaces meet exactly and are stitched
+   * into one.
+   */
+  class SimCluster : public cb::Mutex {
+    std::vector<std::string> nodes;
+    std::string workDir;
+    std::string command;
+
+    std::vector<cb::SmartPointer<cb::Subprocess> > procs;
+    bool quit;
+
+  public:
+    /// @param nodesFile lists one launch command per line, 'local' runs on
+    /// this machine.  @param workDir must be seen by every node at the
+    /// same path.
+    SimCluster(const std::string &nodesFile, const std::string &workDir);
+    ~SimCluster();
+
+    unsigned getNodeCount() const {return nodes.size();}
+
+    /// Simulate in @param parts slabs, by default one per node.  The work
+    /// files are named after @param name.
+    cb::SmartPointer<Surface> compute(const Simulation &sim,
+                                      const std::string &name,
+                                      unsigned parts = 0);
+    void interrupt();
+
+    static void writeJob(const std::string &filename, const Simulation &sim);
+    static Simulation readJob(const std::string &filename);
+  };
+}
@@ -0,0 +1,409 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "SimServer.h"
+#include "CutSim.h"
+#include "Project.h"
+#include "SimulationRun.h"
+#include "ToolPathCache.h"
+
+#include <camotics/contour/Surface.h>
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/config/Options.h>
+#include <cbang/json/JSON.h>
+#include <cbang/io/StringInputSource.h>
+#include <cbang/log/Logger.h>
+#include <cbang/net/IPAddress.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SysError.h>
+#include <cbang/socket/Socket.h>
+#include <cbang/time/TimeInterval.h>
+#include <cbang/time/Timer.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <sstream>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <exception>
+
+#include <stdlib.h>
+#include <limits.h>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  const unsigned maxRequestSize = 1 << 20;
+
+
+  /// @return @param path absolute, with links, '.' and '..' followed.
+  string canonical(const string &path) {
+#ifdef _WIN32
+    char buffer[_MAX_PATH];
+    if (!_fullpath(buffer, path.c_str(), sizeof(buffer)))
+#else
+    char buffer[PATH_MAX];
+    if (!realpath(path.c_str(), buffer))
+#endif
+      THROWS("Failed to resolve '" << path << "': " << SysError());
+
+    return buffer;
+  }
+
+
+  void setResolution(Project &project, const JSON::Value &request) {
+    if (!request.has("resolution")) return;
+
+    ResolutionMode resMode = ResolutionMode::RESOLUTION_MANUAL;
+    double res = 0;
+
+    if (request.get("resolution")->isNumber())
+      res = request.getNumber("resolution");
+    else {
+      string name = request.getString("resolution");
+      resMode = ResolutionMode::parse(name, resMode);
+    }
+
+    if (res) project.setResolution(res);
+    project.setResolutionMode(resMode);
+  }
+
+
+  string errorReply(const string &error) {
+    LOG_ERROR(error);
+
+    ostringstream str;
+    JSON::Writer writer(str, 0, false);
+    writer.beginDict();
+    writer.insert("ok", false);
+    writer.insert("error", error);
+    writer.endDict();
+    writer.close();
+
+    return str.str() + "\n";
+  }
+}
+
+
+SimServer::SimServer(unsigned threads, const string &cache, unsigned maxRuns,
+                     unsigned maxSurfaces) :
+  threads(threads ? threads : 1), cache(cache), maxRuns(maxRuns),
+  maxSurfaces(maxSurfaces),
+  paths(new ToolPathCache(cache, std::max(4U, 4 * maxRuns))),
+  cutSim(new CutSim), requests(0), runHits(0), surfaceHits(0),
+  quit(false) {}
+
+
+SimServer::~SimServer() {}
+
+
+void SimServer::serve(const string &_address) {
+  // Clients read and write files, so only local ones unless a host is given
+  string address = _address;
+  string::size_type colon = address.rfind(':');
+  if (colon == string::npos) address = "127.0.0.1:" + address;
+  else if (!colon) address = "127.0.0.1" + address;
+
+  Socket listener;
+  listener.setReuseAddr(true);
+  listener.bind(IPAddress(address));
+  listener.listen();
+  listener.setBlocking(false);
+
+  LOG_INFO(1, "Serving simulations on " << address);
+
+  while (!quit) {
+    SmartPointer<Socket> client = listener.accept();
+    if (client.isNull()) {
+      Timer::sleep(0.1);
+      continue;
+    }
+
+    try {
+      serve(*client);
+    } CATCH_ERROR;
+  }
+}
+
+
+void SimServer::interrupt() {
+  quit = true;
+  cutSim->interrupt();
+}
+
+
+void SimServer::handle(const JSON::Value &request, JSON::Sink &sink) {
+  requests++;
+
+  string command = request.getString("command", "simulate");
+  if (command == "stats") writeStats(sink);
+  else if (command == "simulate") simulate(request, sink);
+  else THROWS("Unknown command '" << command << "'");
+}
+
+
+string SimServer::resolve(const string &path) const {
+  if (path.empty()) THROW("Empty path");
+
+  if (path[0] == '/' || path[0] == '\\' || path.find(':') != string::npos)
+    THROWS("Absolute path '" << path << "' not allowed");
+
+  vector<string> parts;
+  String::tokenize(path, parts, "/\\");
+  for (unsigned i = 0; i < parts.size(); i++)
+    if (parts[i] == "..") THROWS("Path '" << path << "' contains '..'");
+
+  string resolved =
+    root.empty() ? path : SystemUtilities::joinPath(root, path);
+  confine(resolved);
+
+  return resolved;
+}
+
+
+void SimServer::confine(const string &path) const {
+  // Files to be written may not exist yet, but their directory must
+  string real;
+  if (SystemUtilities::exists(path)) real = canonical(path);
+  else {
+    string dir = SystemUtilities::dirname(path);
+    real = canonical(dir.empty() ? string(".") : dir) + "/" +
+      SystemUtilities::basename(path);
+  }
+
+  string base = canonical(root.empty() ? string(".") : root) + "/";
+  if (!String::startsWith(real, base))
+    THROWS("File '" << path << "' is outside the server directory");
+}
+
+
+string SimServer::reply(const string &line) {
+  // Replies are written whole, so a failed request only sends an error
+  ostringstream str;
+
+  try {
+    JSON::ValuePtr request = JSON::Reader::parse(StringInputSource(line));
+    JSON::Writer writer(str, 0, false);
+    handle(*request, writer);
+    writer.close();
+
+  } catch (const Exception &e) {
+    return errorReply(e.getMessage());
+  } catch (const std::exception &e) {
+    return errorReply(e.what());
+  }
+
+  str << '\n';
+  return str.str();
+}
+
+
+void SimServer::serve(Socket &client) {
+  client.setBlocking(true);
+
+  string line;
+  bool oversized = false;
+  char buffer[4096];
+
+  while (!quit) {
+    streamsize count = client.read(buffer, sizeof(buffer));
+    if (count <= 0) break; // Closed
+
+    for (streamsize i = 0; i < count; i++) {
+      if (buffer[i] != '\n') {
+        // The rest of an oversized request is dropped
+        if (line.size() < maxRequestSize) line += buffer[i];
+        else oversized = true;
+        continue;
+      }
+
+      if (!oversized && String::trim(line).empty()) {
+        line.clear();
+        continue;
+      }
+
+      string reply = oversized ? errorReply
+        (SSTR("Request longer than " << maxRequestSize << " bytes")) :
+        this->reply(line);
+
+      line.clear();
+      oversized = false;
+
+      for (streamsize sent = 0; sent < (streamsize)reply.size();)
+        sent += client.write(reply.data() + sent, reply.size() - sent);
+    }
+  }
+}
+
+
+void SimServer::simulate(const JSON::Value &request, JSON::Sink &sink) {
+  double start = Timer::now();
+  string input = resolve(request.getString("input"));
+
+  Options options;
+  Project project(options);
+
+  if (SystemUtilities::extension(input) == "xml") project.load(input);
+  else project.addFile(input); // Assume TPL or GCode
+
+  // Projects name their own files, which must be below the root too
+  for (unsigned i = 0; i < project.getFileCount(); i++)
+    confine(project.getFile(i)->getAbsolutePath());
+
+  setResolution(project, request);
+  double time = request.getNumber("time", 0);
+  project.time = time ? time : numeric_limits<double>::max();
+  project.threads = threads;
+  project.workpiece = project.getWorkpieceBounds();
+
+  project.path = cutSim->computeToolPath(project, paths);
+  if (project.path.isNull()) THROW("Interrupted");
+  project.updateAutomaticWorkpiece(*project.path);
+
+  bool reduce = request.getBoolean("reduce", true);
+  string key = project.computeHash(true) + "-" +
+    String::toLower(project.mode.toString()) + (reduce ? "-reduced" : "");
+
+  SmartPointer<Surface> surface = findSurface(key);
+  string source = "cached";
+
+  if (surface.isNull()) {
+    uint64_t hits = runHits;
+    SmartPointer<SimulationRun> run = getRun(project);
+    source = hits == runHits ? "computed" : "incremental";
+
+    run->setEndTime(project.time);
+    surface = cutSim->computeSurface(run);
+
+    // The run goes on to change its surface, so keep a copy
+    if (!surface.isNull())
+      surface = reduce ? cutSim->reduceSurface(surface, threads) :
+        surface->copy();
+    if (surface.isNull()) THROW("Interrupted");
+
+    addSurface(key, surface);
+  }
+
+  string output = request.getString("output", "");
+  if (!output.empty())
+    surface->writeSTL(*SystemUtilities::oopen(resolve(output)),
+                      request.getBoolean("binary", true), "CAMotics Surface",
+                      project.computeHash());
+
+  string snapshot = request.getString("snapshot", "");
+  if (!snapshot.empty())
+    writeSnapshot(project, surface, resolve(snapshot),
+                  request.getNumber("width", 1024),
+                  request.getNumber("height", 768));
+
+  double seconds = Timer::now() - start;
+  LOG_INFO(1, input << " at " << TimeInterval(project.time) << ", "
+           << source << " in " << TimeInterval(seconds));
+
+  sink.beginDict();
+  sink.insert("ok", true);
+  sink.insert("surface", source);
+  sink.insert("triangles", surface->getCount());
+  sink.insert("time", project.path->getTime() < project.time ?
+              project.path->getTime() : project.time);
+  sink.insert("seconds", seconds);
+  if (!output.empty()) sink.insert("output", output);
+  if (!snapshot.empty()) sink.insert("snapshot", snapshot);
+  sink.endDict();
+}
+
+
+void SimServer::writeStats(JSON::Sink &sink) const {
+  sink.beginDict();
+  sink.insert("ok", true);
+  sink.insert("requests", requests);
+  sink.insert("run_hits", runHits);
+  sink.insert("surface_hits", surfaceHits);
+  sink.insert("runs", runs.size());
+  sink.insert("surfaces", surfaces.size());
+  sink.endDict();
+}
+
+
+SmartPointer<SimulationRun> SimServer::getRun(const Project &project) {
+  // Runs render any end time, so the key leaves it out
+  Simulation sim = project;
+  sim.time = 0;
+  string key =
+    sim.computeHash(true) + "-" + String::toLower(sim.mode.toString());
+
+  for (list<RunEntry>::iterator it = runs.begin(); it != runs.end(); it++)
+    if (it->key == key) {
+      runs.splice(runs.begin(), runs, it);
+      runHits++;
+      return runs.front().run;
+    }
+
+  RunEntry entry;
+  entry.key = key;
+  entry.run = new SimulationRun(project);
+
+  // Later surfaces of the run then only contour its grid
+  entry.run->setCutTimes(true);
+
+  runs.push_front(entry);
+  if (maxRuns < runs.size()) runs.pop_back();
+
+  return entry.run;
+}
+
+
+SmartPointer<Surface> SimServer::findSurface(const string &key) {
+  for (list<SurfaceEntry>::iterator it = surfaces.begin();
+       it != surfaces.end(); it++)
+    if (it->key == key) {
+      surfaces.splice(surfaces.begin(), surfaces, it);
+      surfaceHits++;
+      return surfaces.front().surface;
+    }
+
+  return 0;
+}
+
+
+void SimServer::addSurface(const string &key,
+                           const SmartPointer<Surface> &surface) {
+  if (!maxSurfaces) return;
+
+  SurfaceEntry entry;
+  entry.key = key;
+  entry.surface = surface;
+
+  surfaces.push_front(entry);
+  if (maxSurfaces < surfaces.size()) surfaces.pop_back();
+}
+
+
+void SimServer::writeSnapshot(const Project &project,
+                              const SmartPointer<Surface> &surface,
+                              const string &filename, unsigned width,
+                              unsigned height) {
+  THROW("Snapshots are not supported");
+}
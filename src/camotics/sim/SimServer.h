@@ -0,0 +1,135 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <list>
+#include <atomic>
+
+
+namespace cb {
+  class Socket;
+  namespace JSON {class Value; class Sink;}
+}
+
+namespace CAMotics {
+  class CutSim;
+  class Project;
+  class Surface;
+  class SimulationRun;
+  class ToolPathCache;
+
+  /***
+   * Simulates requests from clients, one JSON object per line over TCP,
+   * keeping what it computed in memory for the next.  Tool paths are kept
+   * by ToolPathCache, simulation runs, with their move lookups and grid
+   * trees, and finished surfaces here.  Each is found by a hash of what
+   * went in to it and the least recently used are dropped first.
+   *
+   * A request is a dict with an 'input' project, GCode or TPL file and
+   * optional 'output' STL file, 'time', 'resolution', 'reduce', 'binary',
+   * 'snapshot' image file and 'width' and 'height'.  The reply is a dict
+   * with 'ok' and either 'error' or what was done.  {"command": "stats"}
+   * reports the cache counters.
+   *
+   * Files are named relative to the server's root directory.  Absolute
+   * paths and paths containing '..' are refused, as are files which
+   * symbolic links put outside of it.  Requests longer than 1 MiB are
+   * refused.
+   */
+  class SimServer {
+    unsigned threads;
+    std::string cache;
+    std::string root;
+    unsigned maxRuns;
+    unsigned maxSurfaces;
+
+    cb::SmartPointer<ToolPathCache> paths;
+    cb::SmartPointer<CutSim> cutSim;
+
+    struct RunEntry {
+      std::string key;
+      cb::SmartPointer<SimulationRun> run;
+    };
+
+    struct SurfaceEntry {
+      std::string key;
+      cb::SmartPointer<Surface> surface;
+    };
+
+    // Most recently used first
+    std::list<RunEntry> runs;
+    std::list<SurfaceEntry> surfaces;
+
+    uint64_t requests;
+    uint64_t runHits;
+    uint64_t surfaceHits;
+    std::atomic<bool> quit; ///< Set by interrupt() from another thread
+
+  public:
+    /// Keeps up to @param maxRuns runs and @param maxSurfaces surfaces.
+    /// Tool paths and surfaces are also kept on disk under @param cache,
+    /// unless it is empty.
+    SimServer(unsigned threads, const std::string &cache,
+              unsigned maxRuns = 4, unsigned maxSurfaces = 16);
+    virtual ~SimServer();
+
+    /// Only files below @param root are read or written.  Empty is the
+    /// current directory.
+    void setRoot(const std::string &root) {this->root = root;}
+
+    /// Answer clients on @param address, 'host:port' or a port on
+    /// localhost, until interrupted.  Clients are served one at a time.
+    void serve(const std::string &address);
+    void interrupt();
+
+    /// Answer one request, writing the reply to @param sink.
+    void handle(const cb::JSON::Value &request, cb::JSON::Sink &sink);
+
+  protected:
+    /// @return @param path below the root.  Throws if it could leave it.
+    std::string resolve(const std::string &path) const;
+    /// Throws unless @param path, with links and '..' followed, is below
+    /// the root.
+    void confine(const std::string &path) const;
+    /// @return the reply line to the request @param line.
+    std::string reply(const std::string &line);
+    void serve(cb::Socket &client);
+    void simulate(const cb::JSON::Value &request, cb::JSON::Sink &sink);
+    void writeStats(cb::JSON::Sink &sink) const;
+
+    /// @return the run of @param project, whatever its end time.
+    cb::SmartPointer<SimulationRun> getRun(const Project &project);
+    cb::SmartPointer<Surface> findSurface(const std::string &key);
+    void addSurface(const std::string &key,
+                    const cb::SmartPointer<Surface> &surface);
+
+    /// Draw @param surface of @param project to the image @param filename.
+    virtual void writeSnapshot(const Project &project,
+                               const cb::SmartPointer<Surface> &surface,
+                               const std::string &filename, unsigned width,
+                               unsigned height);
+  };
+}
@@ -29,6 +29,10 @@
 #include <cbang/json/JSON.h>
 #include <cbang/iostream/UpdateStreamFilter.h>
 #include <cbang/net/Base64.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/util/SmartLock.h>
+
+#include <map>
 
 #include <boost/ref.hpp>
 #include <boost/iostreams/device/null.hpp>
@@ -40,7 +44,44 @@ using namespace cb;
 using namespace CAMotics;
 
 
-string Simulation::computeHash() const {
+namespace {
+  // Digests of recently hashed paths by revision, shared by the copies of
+  // a simulation each task makes
+  Mutex digestLock;
+  map<uint64_t, string> pathDigests;
+  const unsigned maxPathDigests = 16;
+
+
+  string getPathDigest(const GCode::ToolPath &path) {
+    uint64_t revision = path.getRevision();
+
+    {
+      SmartLock lock(&digestLock);
+      map<uint64_t, string>::const_iterator it = pathDigests.find(revision);
+      if (it != pathDigests.end()) return it->second;
+    }
+
+    // The packed moves are much smaller and quicker to make than JSON
+    vector<char> data;
+    path.pack(data);
+
+    SHA256 sha256;
+    sha256.update(&data[0], data.size());
+    string digest = sha256.finalize();
+
+    SmartLock lock(&digestLock);
+    if (maxPathDigests <= pathDigests.size())
+      pathDigests.erase(pathDigests.begin()); // The oldest revision
+    pathDigests[revision] = digest;
+
+    return digest;
+  }
+}
+
+
+string Simulation::computeHash(bool withPath) const {
+  // The settings, tools and workpiece are small and hashed as JSON.  The
+  // path is hashed once per revision and only its digest is added here.
   SHA256 sha256;
   UpdateStreamFilter<SHA256> digest(sha256);
 
@@ -49,10 +90,15 @@ string Simulation::computeHash() const {
   stream.push(io::null_sink());
 
   JSON::Writer writer(stream);
-  write(writer);
+  write(writer, false);
 
   stream.reset();
 
+  // Stock is written by file name, which stays the same when it is edited
+  if (!workpiece.getStock().isNull())
+    sha256.update(workpiece.getStock()->getDigest());
+  if (withPath && !path.isNull()) sha256.update(getPathDigest(*path));
+
   return Base64().encode(sha256.finalize());
 }
 
@@ -67,6 +113,9 @@ void Simulation::read(const JSON::Value &value) {
   if (value.has("workpiece")) workpiece.read(*value.get("workpiece"));
   else workpiece = cb::Rectangle3D();
 
+  if (value.has("stock"))
+    workpiece.setStock(StockField::read(value.getString("stock"), resolution));
+
   path = new GCode::ToolPath(tools);
   if (value.has("path")) path->read(*value.get("path"));
 }
@@ -88,6 +137,9 @@ void Simulation::write(JSON::Sink &sink, bool withPath) const {
     workpiece.write(sink);
   }
 
+  if (!workpiece.getStock().isNull())
+    sink.insert("stock", workpiece.getStock()->getFilename());
+
   if (withPath && !path.isNull()) {
     sink.beginInsert("path");
     path->write(sink);
@@ -22,6 +22,7 @@
 
 
 #include "Workpiece.h"
+#include "LookupMode.h"
 
 #include <gcode/ToolTable.h>
 #include <gcode/ToolPath.h>
@@ -47,17 +48,21 @@ namespace CAMotics {
     double time;
     RenderMode mode;
     unsigned threads;
+    LookupMode lookup;
 
     Simulation() :
-      resolution(1), time(0), mode(RenderMode::MCUBES_MODE), threads(0) {}
+      resolution(1), time(0), mode(RenderMode::HEIGHT_MAP_MODE), threads(0),
+      lookup(LookupMode::LOOKUP_AABB_TREE) {}
     Simulation(const GCode::ToolTable &tools,
                const cb::SmartPointer<GCode::ToolPath> &path,
                const Workpiece &workpiece, double resolution, double time,
-               RenderMode mode, unsigned threads) :
+               RenderMode mode, unsigned threads,
+               LookupMode lookup = LookupMode::LOOKUP_AABB_TREE) :
       tools(tools), path(path), workpiece(workpiece), resolution(resolution),
-      time(time), mode(mode), threads(threads) {}
+      time(time), mode(mode), threads(threads), lookup(lookup) {}
 
-    std::string computeHash() const;
+    /// The tool path is only hashed if @param withPath is true.
+    std::string computeHash(bool withPath = false) const;
 
     virtual void write(cb::JSON::Sink &sink, bool withPath) const;
 
@@ -20,21 +20,52 @@
 
 #include "SimulationRun.h"
 #include "Simulation.h"
+#include "SurfaceObserver.h"
+#include "HeightMap.h"
+#include "TriDexel.h"
+#include "OpenCLSweep.h"
+
+#include <camotics/Trace.h>
+#include <camotics/MemoryUsage.h>
 
 #include <camotics/contour/TriangleSurface.h>
 #include <camotics/contour/GridTree.h>
+#include <camotics/contour/GridTreeSnapshot.h>
 #include <camotics/render/Renderer.h>
+#include <camotics/render/RenderCheckpoint.h>
 #include <camotics/sim/CutWorkpiece.h>
 
+#include <cbang/Exception.h>
 #include <cbang/log/Logger.h>
 #include <cbang/time/TimeInterval.h>
+#include <cbang/time/Timer.h>
+
+#include <limits>
+#include <cmath>
 
+using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  // The coarse surface is rendered at a multiple of the resolution with at
+  // most this many cells so it is quick to compute
+  const double previewScale = 4;
+  const double maxPreviewCells = 1 << 18;
+
+  // Seconds between updates of the progressive surface
+  const double previewInterval = 0.5;
+
+  // Grid tree snapshots are taken this many times along the tool path and
+  // the oldest dropped past this many
+  const unsigned maxSnapshots = 16;
+}
+
+
 SimulationRun::SimulationRun(const Simulation &sim) :
-  sim(sim), minTime(-1), maxTime(-1) {}
+  sim(sim), minTime(-1), maxTime(-1), restored(false), part(0), parts(1),
+  cutTimes(false), numa(false), streamer(0), observer(0), lastPreview(0) {}
 
 
 SimulationRun::~SimulationRun() {}
@@ -52,47 +83,380 @@ void SimulationRun::setEndTime(double endTime) {
 }
 
 
-SmartPointer<Surface> SimulationRun::compute(const SmartPointer<Task> &task) {
+void SimulationRun::getMemoryUsage(MemoryUsage &usage) const {
+  if (!sim.path.isNull()) usage.add("toolpath", sim.path->getMemoryUsage());
+  if (!sweep.isNull()) usage.add("lookup", sweep->getMemoryUsage());
+  if (!tree.isNull()) usage.add("grid_tree", tree->getMemoryUsage());
+  for (unsigned i = 0; i < snapshots.size(); i++)
+    usage.add("grid_snapshots", snapshots[i]->getMemoryUsage());
+  if (!heightMap.isNull())
+    usage.add("height_map", heightMap->getMemoryUsage());
+  if (!triDexel.isNull()) usage.add("tri_dexel", triDexel->getMemoryUsage());
+}
+
+
+void SimulationRun::setPartition(unsigned part, unsigned parts) {
+  if (!parts || parts <= part)
+    THROWS("Invalid partition " << part << " of " << parts);
+  if (!sweep.isNull() || !heightMap.isNull() || !triDexel.isNull())
+    THROW("Partition must be set before the first surface");
+
+  this->part = part;
+  this->parts = parts;
+}
+
+
+SmartPointer<Surface> SimulationRun::compute(const SmartPointer<Task> &task,
+                                             SurfaceObserver *observer) {
+  if (sim.mode == RenderMode::HEIGHT_MAP_MODE) {
+    if (1 < parts) {
+      LOG_DEBUG(1, "Partitions are rendered with marching cubes");
+
+    } else if (canUseHeightMap()) return computeHeightMap(task);
+    else {
+      LOG_WARNING("Height map cannot simulate undercutting tools, STL stock "
+                  "or a job without a workpiece, using marching cubes");
+    }
+
+    sim.mode = RenderMode::MCUBES_MODE;
+  }
+
+  if (sim.mode == RenderMode::TRI_DEXEL_MODE) {
+    if (1 < parts) LOG_DEBUG(1, "Partitions are rendered with marching cubes");
+    else if (sim.workpiece.isValid() && sim.workpiece.getStock().isNull())
+      return computeTriDexel(task);
+    else LOG_WARNING("Tri-dexel models cannot simulate STL stock or a job "
+                     "without a workpiece, using marching cubes");
+
+    sim.mode = RenderMode::MCUBES_MODE;
+  }
+
   cb::Rectangle3D bbox;
 
   double start = task->getTime();
 
+  // Only the first surface takes long enough to be worth previewing
+  bool first = sweep.isNull();
+  bool progressive = observer && first;
+
   if (sweep.isNull()) {
     // GCode::Tool sweep
-    sweep = new ToolSweep(sim.path); // Build sweep for entire time period
+    // Build sweep for entire time period
+    sweep = new ToolSweep(sim.path, 0, numeric_limits<double>::max(),
+                          sim.lookup, sim.threads);
+
+    // Skip lookups in cleared pockets, blocks of eight cells on a side
+    sweep->setBlockSize(sim.resolution * 8);
+    sweep->setPrecision(sim.resolution / 16);
+
+    // Offload field evaluation to a GPU when one is available
+    try {
+      sweep->setDevice(new OpenCLSweep(sim.path));
+    } catch (const Exception &e) {
+      LOG_DEBUG(1, "Evaluating tool sweep on the CPU: " << e.getMessage());
+    }
 
     // Bounds, increased a little
     bbox = sim.workpiece.getBounds().grow(sim.resolution * 0.9);
 
     // Grid
     tree = new GridTree(Grid(bbox, sim.resolution));
+    if (1 < parts) partBounds = getPartitionBounds();
+
+    // Surfaces at other times then only contour the grid
+    if (cutTimes) sweep->computeCutTimes(*tree, sim.threads, task.get());
 
   } else {
     if (sim.time < minTime) minTime = sim.time;
     if (maxTime < sim.time) maxTime = sim.time;
 
-    SmartPointer<MoveLookup> change = new ToolSweep(sim.path, minTime, maxTime);
+    // Going back, start from the last snapshot before the new time if that
+    // renders less than undoing the moves since
+    const GridTreeSnapshot *snapshot = findSnapshot(sim.time);
+    if (snapshot && sim.time - snapshot->getTime() < maxTime - minTime) {
+      // Cells which differ between the snapshot and the tree are regathered
+      double from = std::min(snapshot->getTime(), minTime);
+      ToolSweep changed(sim.path, from, maxTime, sim.lookup, sim.threads);
+      cb::Rectangle3D bounds = changed.getBounds().grow(sim.resolution * 1.1);
+      if (restored) restoredBounds.add(bounds);
+      else restoredBounds = bounds;
+      restored = true;
+
+      snapshot->restore(*tree);
+      minTime = snapshot->getTime();
+      maxTime = sim.time;
+
+      LOG_DEBUG(1, "Restored grid snapshot at "
+                << TimeInterval(snapshot->getTime()));
+    }
+
+    SmartPointer<MoveLookup> change =
+      new ToolSweep(sim.path, minTime, maxTime, sim.lookup, sim.threads);
     sweep->setChange(change);
     bbox = change->getBounds().grow(sim.resolution * 1.1);
   }
 
+  // Only this part's slab is rendered
+  bool empty = false;
+  if (1 < parts) {
+    empty = !partBounds.getVolume() || !bbox.intersects(partBounds);
+    if (!empty) bbox = bbox.intersection(partBounds);
+  }
+
+  cb::Rectangle3D gatherBox(bbox);
+  if (restored) gatherBox.add(restoredBounds);
+
   // Set target time
   sweep->setEndTime(sim.time);
 
   // Setup cut simulation
   CutWorkpiece cutWP(sweep, sim.workpiece);
 
+  if (progressive && !empty) {
+    this->observer = observer;
+    computePreview(task, cutWP, bbox);
+  }
+
   // Render
   Renderer renderer(task);
-  renderer.render(cutWP, *tree, bbox, sim.threads, sim.mode);
+  if (progressive || streamer) renderer.setObserver(this);
+  renderer.setNUMA(numa);
+
+  // Only the first surface is rendered in to an empty tree
+  SmartPointer<RenderCheckpoint> resume;
+  if (first && !checkpoint.empty()) {
+    resume = new RenderCheckpoint(checkpoint);
+    renderer.setCheckpoint(resume.get());
+  }
+
+  if (!task->shouldQuit() && !empty)
+    renderer.render(cutWP, *tree, bbox, sim.threads, sim.mode);
+
+  if (!resume.isNull() && !task->shouldQuit()) resume->remove();
 
   LOG_DEBUG(1, "Render time " << TimeInterval(task->getTime() - start));
 
+  // Free progressive rendering data
+  this->observer = 0;
+  previewVertices.clear();
+  previewNormals.clear();
+  completedVertices.clear();
+  completedNormals.clear();
+  completedBounds.clear();
+
+  // Streamed grids were handed off as they completed
+  if (streamer) return 0;
+
   // Extract surface
   if (!task->shouldQuit()) {
     minTime = maxTime = sim.time;
-    return new TriangleSurface(*tree);
+    restored = false;
+    saveSnapshot();
+
+    // Only regather the parts of the tree which were rendered or restored
+    CAMOTICS_TRACE("Gather surface");
+    if (surface.isNull()) surface = new TriangleSurface(*tree, sim.threads);
+    else surface = new TriangleSurface(*tree, surface, gatherBox, sim.threads);
+
+    return surface;
   }
 
   return 0;
 }
+
+
+SmartPointer<Surface> SimulationRun::stream(const SmartPointer<Task> &task,
+                                            RenderObserver &streamer) {
+  if (!sweep.isNull() || !heightMap.isNull() || !triDexel.isNull())
+    THROW("Only the first surface can be streamed");
+
+  this->streamer = &streamer;
+  SmartPointer<Surface> surface;
+
+  try {
+    surface = compute(task);
+  } catch (...) {
+    this->streamer = 0;
+    throw;
+  }
+
+  this->streamer = 0;
+
+  // The tree was freed as it was written, start over if computed again
+  sweep.release();
+  snapshots.clear();
+  tree.release();
+
+  return surface;
+}
+
+
+cb::Rectangle3D SimulationRun::getPartitionBounds() const {
+  unsigned axis = tree->largestDim();
+  unsigned steps = tree->getSteps()[axis];
+  unsigned start = (uint64_t)steps * part / parts;
+  unsigned end = (uint64_t)steps * (part + 1) / parts;
+  if (start == end) return cb::Rectangle3D(); // More parts than cells
+
+  // Keep a quarter cell inside the slab so rounding the bounds to cells
+  // never takes a cell from a neighboring part
+  double res = tree->getResolution();
+  double offset = tree->getOffset()[axis];
+  cb::Rectangle3D bounds = tree->getBounds();
+  bounds.rmin[axis] = offset + (start + 0.25) * res;
+  bounds.rmax[axis] = offset + (end - 0.25) * res;
+
+  return bounds;
+}
+
+
+void SimulationRun::saveSnapshot() {
+  if (sim.path->empty()) return;
+
+  // Only taken going forward, at regular times along the tool path
+  double interval = sim.path->getTime() / maxSnapshots;
+  if (!snapshots.empty() && sim.time < snapshots.back()->getTime() + interval)
+    return;
+
+  if (maxSnapshots <= snapshots.size()) snapshots.erase(snapshots.begin());
+  snapshots.push_back(new GridTreeSnapshot(*tree, sim.time));
+}
+
+
+const GridTreeSnapshot *SimulationRun::findSnapshot(double time) const {
+  for (unsigned i = snapshots.size(); i; i--)
+    if (snapshots[i - 1]->getTime() <= time) return snapshots[i - 1].get();
+
+  return 0;
+}
+
+
+bool SimulationRun::canUseHeightMap() const {
+  return sim.workpiece.isValid() && sim.workpiece.getStock().isNull() &&
+    HeightMap::isSupported(*sim.path);
+}
+
+
+SmartPointer<Surface>
+SimulationRun::computeHeightMap(const SmartPointer<Task> &task) {
+  double start = task->getTime();
+
+  // Only moves after the last computed time need to be cut
+  if (heightMap.isNull() || sim.time < heightMap->getTime())
+    heightMap = new HeightMap(sim.workpiece.getBounds(), sim.resolution);
+
+  {
+    CAMOTICS_TRACE("Cut height map");
+    heightMap->cut(*sim.path, sim.time, task.get());
+  }
+
+  LOG_DEBUG(1, "Height map time " << TimeInterval(task->getTime() - start));
+
+  if (task->shouldQuit()) return 0;
+  return heightMap->getSurface();
+}
+
+
+SmartPointer<Surface>
+SimulationRun::computeTriDexel(const SmartPointer<Task> &task) {
+  double start = task->getTime();
+
+  // Only moves after the last computed time need to be cut
+  if (triDexel.isNull() || sim.time < triDexel->getTime())
+    triDexel = new TriDexel(sim.workpiece.getBounds(), sim.resolution,
+                            sim.threads);
+
+  {
+    CAMOTICS_TRACE("Cut tri-dexel model");
+    triDexel->cut(*sim.path, sim.time, task.get());
+  }
+
+  if (task->shouldQuit()) return 0;
+
+  SmartPointer<Surface> surface;
+  {
+    CAMOTICS_TRACE("Contour tri-dexel model");
+    task->update(0, "Contouring tri-dexel model");
+    surface = triDexel->getSurface(task.get());
+  }
+
+  LOG_DEBUG(1, "Tri-dexel time " << TimeInterval(task->getTime() - start));
+
+  return surface;
+}
+
+
+void SimulationRun::gridCompleted(GridTreeRef &grid) {
+  if (streamer) return streamer->gridCompleted(grid);
+  if (!observer) return;
+
+  grid.gather(completedVertices, completedNormals);
+  completedBounds.push_back(grid.getBounds());
+
+  if (lastPreview + previewInterval < Timer::now()) sendPreview();
+}
+
+
+void SimulationRun::computePreview(const SmartPointer<Task> &task,
+                                   CutWorkpiece &cutWP,
+                                   const cb::Rectangle3D &bbox) {
+  CAMOTICS_TRACE("Preview");
+  double start = task->getTime();
+
+  // Coarse grid
+  double resolution = sim.resolution * previewScale;
+  double minResolution = cbrt(bbox.getVolume() / maxPreviewCells);
+  if (resolution < minResolution) resolution = minResolution;
+
+  GridTree previewTree(Grid(bbox, resolution));
+
+  Renderer renderer(task);
+  renderer.render(cutWP, previewTree, bbox, sim.threads,
+                  RenderMode::MCUBES_MODE);
+  if (task->shouldQuit()) return;
+
+  previewTree.gather(previewVertices, previewNormals);
+
+  LOG_DEBUG(1, "Preview time " << TimeInterval(task->getTime() - start));
+
+  sendPreview();
+}
+
+
+void SimulationRun::sendPreview() {
+  SmartPointer<TriangleSurface> preview = new TriangleSurface;
+
+  // Coarse triangles not yet replaced by completed grids
+  for (unsigned i = 0; i < previewVertices.size(); i += 9) {
+    cb::Vector3F v[3];
+    for (unsigned j = 0; j < 3; j++)
+      v[j] = cb::Vector3F(previewVertices[i + j * 3],
+                          previewVertices[i + j * 3 + 1],
+                          previewVertices[i + j * 3 + 2]);
+
+    cb::Vector3D center = (cb::Vector3D)(v[0] + v[1] + v[2]) / 3;
+
+    bool replaced = false;
+    for (unsigned j = 0; j < completedBounds.size() && !replaced; j++)
+      replaced = completedBounds[j].contains(center);
+
+    if (!replaced)
+      preview->add(v, cb::Vector3F(previewNormals[i], previewNormals[i + 1],
+                                   previewNormals[i + 2]));
+  }
+
+  // Full resolution triangles
+  for (unsigned i = 0; i < completedVertices.size(); i += 9) {
+    cb::Vector3F v[3];
+    for (unsigned j = 0; j < 3; j++)
+      v[j] = cb::Vector3F(completedVertices[i + j * 3],
+                          completedVertices[i + j * 3 + 1],
+                          completedVertices[i + j * 3 + 2]);
+
+    preview->add(v, cb::Vector3F(completedNormals[i], completedNormals[i + 1],
+                                 completedNormals[i + 2]));
+  }
+
+  observer->surfacePreview(preview);
+  lastPreview = Timer::now();
+}
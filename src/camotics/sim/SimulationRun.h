@@ -23,33 +23,133 @@
 
 #include "Simulation.h"
 
+#include <camotics/render/RenderObserver.h>
+
 #include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+#include <string>
 
 
 namespace CAMotics {
   class ToolSweep;
   class GridTree;
+  class GridTreeSnapshot;
+  class HeightMap;
+  class TriDexel;
   class Surface;
+  class TriangleSurface;
   class MoveLookup;
   class Task;
+  class CutWorkpiece;
+  class SurfaceObserver;
+  class MemoryUsage;
 
 
-  class SimulationRun {
+  class SimulationRun : public RenderObserver {
     Simulation sim;
     cb::SmartPointer<ToolSweep> sweep;
     cb::SmartPointer<GridTree> tree;
+    cb::SmartPointer<HeightMap> heightMap;
+    cb::SmartPointer<TriDexel> triDexel;
+    cb::SmartPointer<TriangleSurface> surface;
 
     double minTime;
     double maxTime;
 
+    // Taken going forward so going back can start from the last before
+    std::vector<cb::SmartPointer<GridTreeSnapshot> > snapshots;
+    bool restored;
+    cb::Rectangle3D restoredBounds; ///< Not yet regathered
+
+    unsigned part;
+    unsigned parts;
+    cb::Rectangle3D partBounds;
+
+    bool cutTimes;
+    std::string checkpoint;
+    bool numa;
+
+    RenderObserver *streamer;
+
+    // Progressive rendering
+    SurfaceObserver *observer;
+    std::vector<float> previewVertices;
+    std::vector<float> previewNormals;
+    std::vector<float> completedVertices;
+    std::vector<float> completedNormals;
+    std::vector<cb::Rectangle3D> completedBounds;
+    double lastPreview;
+
   public:
     SimulationRun(const Simulation &sim);
     ~SimulationRun();
 
+    const Simulation &getSimulation() const {return sim;}
     cb::SmartPointer<MoveLookup> getMoveLookup() const;
+    /// The height map, and so the removal of each move, if one is used.
+    const cb::SmartPointer<HeightMap> &getHeightMap() const
+    {return heightMap;}
 
     void setEndTime(double endTime);
 
-    cb::SmartPointer<Surface> compute(const cb::SmartPointer<Task> &task);
+    /// Add the bytes held by the tool path, the move lookup, the grid and
+    /// any height map or tri-dexel model to @param usage.  Surfaces are
+    /// counted by whoever holds them.
+    void getMemoryUsage(MemoryUsage &usage) const;
+
+    /// Find when each grid vertex is first cut with the first surface, so
+    /// surfaces at other times need no further field evaluation.  Costs
+    /// four bytes per grid vertex.
+    void setCutTimes(bool cutTimes) {this->cutTimes = cutTimes;}
+
+    /// Save the grids of the first surface to the file @param checkpoint
+    /// as they complete and skip those already there.  The file is deleted
+    /// once the surface is complete.
+    void setCheckpoint(const std::string &checkpoint)
+    {this->checkpoint = checkpoint;}
+
+    /// Place render jobs on NUMA nodes, see Renderer::setNUMA().
+    void setNUMA(bool numa) {this->numa = numa;}
+
+    /***
+     * Only render slab @param part of @param parts, cut from the longest
+     * axis of the workpiece grid along whole cells.  The slabs of all parts
+     * together make the same surface as one unpartitioned run.
+     */
+    void setPartition(unsigned part, unsigned parts);
+
+    /***
+     * If @param observer is given, the first surface is rendered
+     * progressively.  A coarse surface is sent to @param observer first
+     * and then updated with full resolution grids as they complete.
+     */
+    cb::SmartPointer<Surface> compute(const cb::SmartPointer<Task> &task,
+                                      SurfaceObserver *observer = 0);
+
+    /***
+     * Compute the first surface without keeping it.  Each grid is passed to
+     * @param streamer as it completes, which should free its cells.  Height
+     * maps and tri-dexel models are not rendered in grids and are returned
+     * instead.
+     */
+    cb::SmartPointer<Surface> stream(const cb::SmartPointer<Task> &task,
+                                     RenderObserver &streamer);
+
+    // From RenderObserver
+    void gridCompleted(GridTreeRef &grid);
+
+  protected:
+    cb::Rectangle3D getPartitionBounds() const;
+    void saveSnapshot();
+    const GridTreeSnapshot *findSnapshot(double time) const;
+    bool canUseHeightMap() const;
+    cb::SmartPointer<Surface> computeHeightMap(const cb::SmartPointer<Task> &task);
+    cb::SmartPointer<Surface>
+    computeTriDexel(const cb::SmartPointer<Task> &task);
+    void computePreview(const cb::SmartPointer<Task> &task,
+                        CutWorkpiece &cutWP, const cb::Rectangle3D &bbox);
+    void sendPreview();
   };
 }
@@ -23,6 +23,7 @@
 #include <gcode/Move.h>
 
 #include <algorithm>
+#include <cmath>
 
 using namespace std;
 using namespace CAMotics;
@@ -32,7 +33,6 @@ SpheroidSweep::SpheroidSweep(double radius, double length) :
   radius(radius), length(length == -1 ? radius : length) {
 
   if (2 * radius != length) scale = cb::Vector3D(1, 1, 2 * radius / length);
-  radius2 = radius * radius;
 }
 
 
@@ -46,6 +46,7 @@ void SpheroidSweep::getBBoxes(const cb::Vector3D &start,
 
 namespace {
   inline double sqr(double x) {return x * x;}
+  inline float sqr(float x) {return x * x;}
 }
 
 
@@ -64,26 +65,128 @@ double SpheroidSweep::depth(const cb::Vector3D &_A, const cb::Vector3D &_B,
     P *= scale;
   }
 
-  // Check z-height
-  if (P.z() < min(A.z(), B.z()) || max(A.z(), B.z()) + 2 * r < P.z())
-    return -1;
+  // The swept sphere is a capsule about the path of its center.  Unlike
+  // finding where the sphere first reaches P this also holds for points
+  // already inside it at A, which arcs swept in short pieces depend on.
+  // The signed distance to the capsule is exact for spheres and measured
+  // in the scaled space for oblong spheroids.
+  const cb::Vector3D AB = B - A;
+  const cb::Vector3D CP = P - A - cb::Vector3D(0, 0, r);
+  const double epsilon = AB.dot(AB);
+
+  double beta = epsilon ? CP.dot(AB) / epsilon : 0;
+  beta = beta < 0 ? 0 : (1 < beta ? 1 : beta);
+
+  const cb::Vector3D D = CP - AB * beta;
+
+  return r - sqrt(D.dot(D));
+}
+
+
+cb::Vector3D SpheroidSweep::normal(const cb::Vector3D &_A,
+                                   const cb::Vector3D &_B,
+                                   const cb::Vector3D &_P) const {
+  const bool scaled = 2 * radius != length;
+
+  cb::Vector3D A = _A;
+  cb::Vector3D B = _B;
+  cb::Vector3D P = _P;
+
+  if (scaled) {
+    A *= scale;
+    B *= scale;
+    P *= scale;
+  }
+
+  // Away from the nearest point on the capsule's axis
+  const cb::Vector3D AB = B - A;
+  const cb::Vector3D CP = P - A - cb::Vector3D(0, 0, radius);
+  const double epsilon = AB.dot(AB);
+
+  double beta = epsilon ? CP.dot(AB) / epsilon : 0;
+  beta = beta < 0 ? 0 : (1 < beta ? 1 : beta);
+
+  // Scaling z scales the gradient's z the same way
+  cb::Vector3D n = CP - AB * beta;
+  if (scaled) n *= scale;
+
+  double norm = n.length();
+  return norm ? n / norm : n;
+}
+
+
+void SpheroidSweep::depth(const cb::Vector3D &_A, const cb::Vector3D &_B,
+                          const double *x, const double *y, const double *z,
+                          unsigned n, double *out) const {
+  // Same math as the single point version above, written without per point
+  // branches so the loop body can be vectorized.
+  const double r = radius;
+  const bool scaled = 2 * radius != length;
+  const double zScale = scaled ? scale.z() : 1;
+
+  cb::Vector3D A = _A;
+  cb::Vector3D B = _B;
+
+  if (scaled) {
+    A *= scale;
+    B *= scale;
+  }
 
   const cb::Vector3D AB = B - A;
-  const cb::Vector3D PA = A - P;
+  const double epsilon = AB.dot(AB);
+  const double inverse = epsilon ? 1 / epsilon : 0;
+
+  const double Cx = A.x(), Cy = A.y(), Cz = A.z() + r;
+  const double ABx = AB.x(), ABy = AB.y(), ABz = AB.z();
+
+  for (unsigned i = 0; i < n; i++) {
+    const double Px = x[i], Py = y[i], Pz = scaled ? z[i] * zScale : z[i];
+
+    const double CPx = Px - Cx, CPy = Py - Cy, CPz = Pz - Cz;
+    double beta = (CPx * ABx + CPy * ABy + CPz * ABz) * inverse;
+    beta = beta < 0 ? 0 : (1 < beta ? 1 : beta);
 
-  // epsilon * beta^2 + gamma * beta + rho = 0
+    const double d2 = sqr(CPx - ABx * beta) + sqr(CPy - ABy * beta) +
+      sqr(CPz - ABz * beta);
+
+    out[i] = r - sqrt(d2);
+  }
+}
+
+
+void SpheroidSweep::depth(const cb::Vector3D &_A, const cb::Vector3D &_B,
+                          const float *x, const float *y, const float *z,
+                          unsigned n, float *out) const {
+  // The double precision batch above in floats, twice as many per vector
+  const float r = radius;
+  const bool scaled = 2 * radius != length;
+  const float zScale = scaled ? scale.z() : 1;
+
+  cb::Vector3D A = _A;
+  cb::Vector3D B = _B;
+
+  if (scaled) {
+    A *= scale;
+    B *= scale;
+  }
+
+  const cb::Vector3D AB = B - A;
   const double epsilon = AB.dot(AB);
-  const double gamma = AB.dot(PA + cb::Vector3D(0, 0, r));
-  const double rho = PA.dot(PA) + 2 * r * (A.z() - P.z());
-  const double sigma = sqr(gamma) - epsilon * rho;
+  const float inverse = epsilon ? 1 / epsilon : 0;
+
+  const float Cx = A.x(), Cy = A.y(), Cz = A.z() + r;
+  const float ABx = AB.x(), ABy = AB.y(), ABz = AB.z();
 
-  // Check if solution is valid
-  if (epsilon == 0 || sigma < 0) return -1;
+  for (unsigned i = 0; i < n; i++) {
+    const float Px = x[i], Py = y[i], Pz = scaled ? z[i] * zScale : z[i];
 
-  const double beta = (-gamma - sqrt(sigma)) / epsilon; // Quadradic equation
+    const float CPx = Px - Cx, CPy = Py - Cy, CPz = Pz - Cz;
+    float beta = (CPx * ABx + CPy * ABy + CPz * ABz) * inverse;
+    beta = beta < 0 ? 0 : (1 < beta ? 1 : beta);
 
-  // Check that it's on the line segment
-  if (beta < 0 || 1 < beta) return -1;
+    const float d2 = sqr(CPx - ABx * beta) + sqr(CPy - ABy * beta) +
+      sqr(CPz - ABz * beta);
 
-  return 1;
+    out[i] = r - sqrt(d2);
+  }
 }
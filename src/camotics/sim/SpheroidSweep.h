@@ -29,7 +29,6 @@ namespace CAMotics {
     double length;
 
     cb::Vector3D scale;
-    double radius2;
 
   public:
     SpheroidSweep(double radius, double length = -1);
@@ -39,5 +38,14 @@ namespace CAMotics {
                    std::vector<cb::Rectangle3D> &bboxes, double tolerance) const;
     double depth(const cb::Vector3D &start, const cb::Vector3D &end,
                const cb::Vector3D &p) const;
+    void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+               const double *x, const double *y, const double *z,
+               unsigned n, double *out) const;
+    void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+               const float *x, const float *y, const float *z,
+               unsigned n, float *out) const;
+    cb::Vector3D normal(const cb::Vector3D &start, const cb::Vector3D &end,
+                        const cb::Vector3D &p) const;
+    double getRadius() const {return radius;}
   };
 }
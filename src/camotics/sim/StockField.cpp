@@ -0,0 +1,282 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "StockField.h"
+
+#include <camotics/SHA256.h>
+
+#include <stl/Reader.h>
+
+#include <cbang/Exception.h>
+#include <cbang/io/InputSource.h>
+#include <cbang/log/Logger.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Closest point to p on triangle abc, by the regions of its Voronoi
+  // diagram, from Ericson's Real-Time Collision Detection
+  cb::Vector3D closestOnTriangle(const cb::Vector3D &p, const cb::Vector3D &a,
+                                 const cb::Vector3D &b,
+                                 const cb::Vector3D &c) {
+    cb::Vector3D ab = b - a, ac = c - a, ap = p - a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+
+    cb::Vector3D bp = p - b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (0 <= d3 && d4 <= d3) return b;
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && 0 <= d1 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+    cb::Vector3D cp = p - c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (0 <= d6 && d5 <= d6) return c;
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && 0 <= d2 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && 0 <= d4 - d3 && 0 <= d5 - d6)
+      return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    double denom = 1 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+  }
+}
+
+
+StockField::StockField(STL::Source &source, double resolution,
+                       const string &filename) :
+  filename(filename), resolution(resolution) {
+  if (resolution <= 0) THROW("Stock resolution must be positive");
+
+  vector<cb::Vector3D> triangles;
+  cb::Vector3F v[3];
+  cb::Vector3F normal;
+
+  while (source.hasMore()) {
+    source.readFacet(v[0], v[1], v[2], normal);
+
+    // Faces without area bound nothing their neighbours do not
+    if (!(v[1] - v[0]).cross(v[2] - v[0]).lengthSquared()) continue;
+
+    for (unsigned i = 0; i < 3; i++) {
+      triangles.push_back(cb::Vector3D(v[i].x(), v[i].y(), v[i].z()));
+      bounds.add(triangles.back());
+    }
+  }
+
+  if (triangles.empty()) THROW("Stock has no faces");
+
+  SHA256 sha256;
+  sha256.update((const char *)&triangles[0],
+                triangles.size() * sizeof(cb::Vector3D));
+  digest = sha256.finalize();
+
+  // Coarsen the grid until it fits
+  while (true) {
+    band = 2 * this->resolution;
+    cb::Vector3D dims =
+      bounds.getDimensions() + cb::Vector3D(band, band, band) * 2;
+
+    uint64_t count = 1;
+    for (unsigned i = 0; i < 3; i++) {
+      steps[i] = ceil(dims[i] / this->resolution) + 1;
+      count *= steps[i];
+    }
+
+    if (count <= MAX_VERTICES) break;
+    this->resolution *= 1.25;
+  }
+
+  if (this->resolution != resolution)
+    LOG_WARNING("Stock sampled at " << this->resolution << " to fit memory");
+
+  origin = bounds.getMin() - cb::Vector3D(band, band, band);
+  depths.assign((uint64_t)steps[0] * steps[1] * steps[2], band);
+
+  computeDistances(triangles);
+  computeSigns(triangles);
+
+  LOG_INFO(1, "Stock " << triangles.size() / 3 << " faces sampled at "
+           << this->resolution << " in " << steps[0] << "x" << steps[1]
+           << "x" << steps[2] << " vertices");
+}
+
+
+SmartPointer<StockField> StockField::read(const string &filename,
+                                          double resolution) {
+  InputSource source(filename);
+  STL::Reader reader(source);
+  string name, hash;
+  reader.readHeader(name, hash);
+
+  return new StockField(reader, resolution, filename);
+}
+
+
+double StockField::depth(const cb::Vector3D &p) const {
+  cb::Vector3D f = (p - origin) / resolution;
+
+  // Beyond the grid is beyond the band around the stock
+  double gap2 = 0;
+  for (unsigned i = 0; i < 3; i++) {
+    double last = steps[i] - 1;
+    if (f[i] < 0) gap2 += f[i] * f[i];
+    else if (last < f[i]) gap2 += (f[i] - last) * (f[i] - last);
+  }
+  if (gap2) return -band - sqrt(gap2) * resolution;
+
+  // Trilinear interpolation
+  unsigned c[3];
+  double t[3];
+  for (unsigned i = 0; i < 3; i++) {
+    c[i] = min((unsigned)f[i], steps[i] - 2);
+    t[i] = f[i] - c[i];
+  }
+
+  double d[2][2];
+  for (unsigned x = 0; x < 2; x++)
+    for (unsigned y = 0; y < 2; y++) {
+      double z0 = at(c[0] + x, c[1] + y, c[2]);
+      double z1 = at(c[0] + x, c[1] + y, c[2] + 1);
+      d[x][y] = z0 + (z1 - z0) * t[2];
+    }
+
+  double y0 = d[0][0] + (d[0][1] - d[0][0]) * t[1];
+  double y1 = d[1][0] + (d[1][1] - d[1][0]) * t[1];
+
+  return y0 + (y1 - y0) * t[0];
+}
+
+
+void StockField::computeDistances(const vector<cb::Vector3D> &triangles) {
+  // Only vertices within the band of a face get a distance
+  for (unsigned i = 0; i < triangles.size(); i += 3) {
+    const cb::Vector3D &a = triangles[i];
+    const cb::Vector3D &b = triangles[i + 1];
+    const cb::Vector3D &c = triangles[i + 2];
+
+    cb::Rectangle3D box(a, a);
+    box.add(b);
+    box.add(c);
+    box = box.grow(band);
+
+    unsigned lo[3], hi[3];
+    for (unsigned j = 0; j < 3; j++) {
+      lo[j] = max(0.0, ceil((box.getMin()[j] - origin[j]) / resolution));
+      hi[j] = min((double)steps[j] - 1,
+                  floor((box.getMax()[j] - origin[j]) / resolution));
+    }
+
+    for (unsigned x = lo[0]; x <= hi[0]; x++)
+      for (unsigned y = lo[1]; y <= hi[1]; y++)
+        for (unsigned z = lo[2]; z <= hi[2]; z++) {
+          cb::Vector3D p = origin + cb::Vector3D(x, y, z) * resolution;
+          float &d = at(x, y, z);
+          d = min(d, (float)p.distance(closestOnTriangle(p, a, b, c)));
+        }
+  }
+}
+
+
+void StockField::computeSigns(const vector<cb::Vector3D> &triangles) {
+  // Cast a ray up each column of vertices and count the faces it crosses
+  // below each vertex.  The rays are nudged off the grid so they do not
+  // pass exactly through the edges of faces written on the same grid.
+  const double nudgeX = resolution * 0.000137;
+  const double nudgeY = resolution * 0.000291;
+
+  typedef pair<uint64_t, float> crossing_t;
+  vector<crossing_t> crossings;
+
+  for (unsigned i = 0; i < triangles.size(); i += 3) {
+    const cb::Vector3D &a = triangles[i];
+    const cb::Vector3D &b = triangles[i + 1];
+    const cb::Vector3D &c = triangles[i + 2];
+
+    double area = (b.x() - a.x()) * (c.y() - a.y()) -
+      (c.x() - a.x()) * (b.y() - a.y());
+    if (!area) continue; // Vertical faces are crossed by no column
+
+    double minX = min(a.x(), min(b.x(), c.x()));
+    double maxX = max(a.x(), max(b.x(), c.x()));
+    double minY = min(a.y(), min(b.y(), c.y()));
+    double maxY = max(a.y(), max(b.y(), c.y()));
+
+    unsigned x0 = max(0.0, ceil((minX - nudgeX - origin.x()) / resolution));
+    unsigned x1 = min((double)steps[0] - 1,
+                      floor((maxX - nudgeX - origin.x()) / resolution));
+    unsigned y0 = max(0.0, ceil((minY - nudgeY - origin.y()) / resolution));
+    unsigned y1 = min((double)steps[1] - 1,
+                      floor((maxY - nudgeY - origin.y()) / resolution));
+
+    for (unsigned x = x0; x <= x1; x++)
+      for (unsigned y = y0; y <= y1; y++) {
+        double px = origin.x() + x * resolution + nudgeX;
+        double py = origin.y() + y * resolution + nudgeY;
+
+        // Barycentric coordinates in XY
+        double u = ((b.x() - px) * (c.y() - py) -
+                    (c.x() - px) * (b.y() - py)) / area;
+        double v = ((c.x() - px) * (a.y() - py) -
+                    (a.x() - px) * (c.y() - py)) / area;
+        double w = 1 - u - v;
+        if (u < 0 || v < 0 || w < 0) continue;
+
+        double z = u * a.z() + v * b.z() + w * c.z();
+        crossings.push_back
+          (crossing_t((uint64_t)x * steps[1] + y, (float)z));
+      }
+  }
+
+  sort(crossings.begin(), crossings.end());
+
+  // Vertices with an odd number of crossings below them are inside
+  unsigned next = 0;
+  for (uint64_t column = 0; column < (uint64_t)steps[0] * steps[1];
+       column++) {
+    while (next < crossings.size() && crossings[next].first < column) next++;
+
+    unsigned x = column / steps[1];
+    unsigned y = column % steps[1];
+    bool inside = false;
+
+    for (unsigned z = 0; z < steps[2]; z++) {
+      double pz = origin.z() + z * resolution;
+
+      while (next < crossings.size() && crossings[next].first == column &&
+             crossings[next].second <= pz) {
+        inside = !inside;
+        next++;
+      }
+
+      if (!inside) at(x, y, z) = -at(x, y, z);
+    }
+  }
+}
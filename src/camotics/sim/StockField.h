@@ -0,0 +1,78 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <string>
+#include <vector>
+
+
+namespace STL {class Source;}
+
+namespace CAMotics {
+  /***
+   * Stock given as a closed triangle mesh, such as the surface written by
+   * an earlier setup, sampled once in to a grid of signed distances.  The
+   * distances are exact near the surface and clamped to a couple of cells
+   * elsewhere, which is all the renderer looks at.
+   */
+  class StockField {
+    std::string filename;
+    std::string digest;       ///< Of the mesh
+    cb::Rectangle3D bounds;   ///< Of the mesh
+    cb::Vector3D origin;
+    double resolution;
+    double band;              ///< Distances are clamped to this
+    unsigned steps[3];        ///< Vertices along each axis
+    std::vector<float> depths; ///< By x then y then z
+
+  public:
+    /// Vertices in the grid at most, the resolution is coarsened to fit.
+    static const uint64_t MAX_VERTICES = (uint64_t)1 << 25;
+
+    StockField(STL::Source &source, double resolution,
+               const std::string &filename = std::string());
+
+    static cb::SmartPointer<StockField> read(const std::string &filename,
+                                             double resolution);
+
+    const std::string &getFilename() const {return filename;}
+    /// @return a SHA256 digest of the triangles, which change the field.
+    const std::string &getDigest() const {return digest;}
+    const cb::Rectangle3D &getBounds() const {return bounds;}
+    double getResolution() const {return resolution;}
+
+    /// @return the signed distance to the stock's surface, positive inside.
+    double depth(const cb::Vector3D &p) const;
+
+  protected:
+    float &at(unsigned x, unsigned y, unsigned z)
+    {return depths[((uint64_t)x * steps[1] + y) * steps[2] + z];}
+    float at(unsigned x, unsigned y, unsigned z) const
+    {return depths[((uint64_t)x * steps[1] + y) * steps[2] + z];}
+
+    void computeDistances(const std::vector<cb::Vector3D> &triangles);
+    void computeSigns(const std::vector<cb::Vector3D> &triangles);
+  };
+}
@@ -0,0 +1,247 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "SurfaceCache.h"
+#include "Simulation.h"
+
+#include <camotics/contour/TriangleSurface.h>
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/log/Logger.h>
+#include <cbang/net/Base64.h>
+#include <cbang/os/SystemUtilities.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include <vector>
+#include <cstring>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  const char magic[4] = {'C', 'S', 'R', 'F'};
+  const uint32_t version = 1;
+
+  enum {
+    UNCOMPRESSED,
+    LZ4_COMPRESSED,
+  };
+
+  // Positions are kept to this fraction of the simulation resolution
+  const double precisionScale = 1.0 / (1 << 14);
+
+  // Larger files are assumed to be corrupt
+  const uint64_t maxFileSize = (uint64_t)1 << 36;
+
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t compression;
+    uint32_t reserved;
+    uint64_t size;   // Packed surface
+    uint64_t stored; // Bytes which follow the header
+  };
+}
+
+
+SurfaceCache::SurfaceCache(const string &path) : path(path) {}
+
+
+string SurfaceCache::getFilename(const Simulation &sim) const {
+  return getFilename(sim, ".srf");
+}
+
+
+string SurfaceCache::getCheckpointFilename(const Simulation &sim) const {
+  return getFilename(sim, ".ckpt");
+}
+
+
+string SurfaceCache::getFilename(const Simulation &sim,
+                                 const string &ext) const {
+  // Hex, since Base64 is neither file name safe nor case insensitive
+  string hash = Base64().decode(sim.computeHash(true));
+  string name;
+
+  for (unsigned i = 0; i < hash.size(); i++)
+    name += String::printf("%02x", (uint8_t)hash[i]);
+
+  name += "-" + String::toLower(sim.mode.toString()) + ext;
+
+  return SystemUtilities::joinPath(path, name);
+}
+
+
+SmartPointer<Surface> SurfaceCache::load(const Simulation &sim) const {
+  if (path.empty()) return 0;
+
+  string filename = getFilename(sim);
+  if (!SystemUtilities::exists(filename)) return 0;
+
+  try {
+    SmartPointer<istream> stream = SystemUtilities::iopen(filename);
+
+    Header header;
+    stream->read((char *)&header, sizeof(header));
+    if (stream->gcount() != sizeof(header) ||
+        memcmp(header.magic, magic, sizeof(magic)) ||
+        header.version != version)
+      THROW("Not a surface cache file");
+
+    if (maxFileSize < header.size || maxFileSize < header.stored)
+      THROW("Surface cache file is corrupt");
+
+    vector<char> stored(header.stored);
+    stream->read(stored.data(), stored.size());
+    if ((uint64_t)stream->gcount() != header.stored)
+      THROW("Surface cache file is truncated");
+
+    vector<char> data;
+
+    switch (header.compression) {
+    case UNCOMPRESSED:
+      if (header.size != header.stored)
+        THROW("Surface cache file is corrupt");
+      data.swap(stored);
+      break;
+
+#ifdef HAVE_LZ4
+    case LZ4_COMPRESSED:
+      if (LZ4_MAX_INPUT_SIZE < header.size ||
+          LZ4_MAX_INPUT_SIZE < header.stored)
+        THROW("Surface cache file is corrupt");
+
+      data.resize(header.size);
+      if (LZ4_decompress_safe(stored.data(), data.data(), stored.size(),
+                              data.size()) != (int)data.size())
+        THROW("Failed to decompress surface cache file");
+      break;
+#endif
+
+    default: THROWS("Unsupported surface cache compression "
+                    << header.compression);
+    }
+
+    SmartPointer<TriangleSurface> surface = new TriangleSurface;
+    surface->unpack(data.data(), data.size());
+
+    LOG_INFO(1, "Loaded cached surface " << filename);
+
+    return surface;
+
+  } catch (const Exception &e) {
+    LOG_WARNING("Ignoring surface cache file '" << filename << "': "
+                << e.getMessage());
+  }
+
+  return 0;
+}
+
+
+void SurfaceCache::store(const Simulation &sim, const Surface &surface) const {
+  if (path.empty() || !(0 < sim.resolution)) return;
+
+  // Simulations only produce triangle surfaces
+  const TriangleSurface *mesh = dynamic_cast<const TriangleSurface *>(&surface);
+  if (!mesh) return;
+
+  string filename = getFilename(sim);
+  string tmp = filename + ".tmp";
+
+  try {
+    vector<char> data;
+    mesh->pack(data, sim.resolution * precisionScale);
+
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.compression = UNCOMPRESSED;
+    header.reserved = 0;
+    header.size = data.size();
+
+    const vector<char> *stored = &data;
+
+#ifdef HAVE_LZ4
+    vector<char> compressed;
+
+    if (data.size() <= LZ4_MAX_INPUT_SIZE) {
+      compressed.resize(LZ4_compressBound(data.size()));
+      int size = LZ4_compress_default(data.data(), compressed.data(),
+                                      data.size(), compressed.size());
+
+      if (0 < size) {
+        compressed.resize(size);
+        stored = &compressed;
+        header.compression = LZ4_COMPRESSED;
+      }
+    }
+#endif
+
+    header.stored = stored->size();
+
+    SystemUtilities::ensureDirectory(path);
+
+    {
+      SmartPointer<ostream> stream = SystemUtilities::oopen(tmp);
+      stream->write((const char *)&header, sizeof(header));
+      stream->write(stored->data(), stored->size());
+      stream->flush();
+      if (stream->fail()) THROWS("Failed to write '" << tmp << "'");
+    }
+
+    // Readers never see a partly written file
+    SystemUtilities::rename(tmp, filename);
+
+    LOG_INFO(1, "Cached surface " << filename << " "
+             << header.stored << " bytes");
+
+  } catch (const Exception &e) {
+    LOG_WARNING("Failed to cache surface: " << e.getMessage());
+    if (SystemUtilities::exists(tmp)) SystemUtilities::unlink(tmp);
+  }
+}
+
+
+string SurfaceCache::getDefaultPath() {
+#ifdef _WIN32
+  const char *base = SystemUtilities::getenv("LOCALAPPDATA");
+  if (base && *base)
+    return SystemUtilities::joinPath
+      (SystemUtilities::joinPath(base, "CAMotics"), "cache");
+
+#else
+  const char *base = SystemUtilities::getenv("XDG_CACHE_HOME");
+  if (base && *base) return SystemUtilities::joinPath(base, "camotics");
+
+  base = SystemUtilities::getenv("HOME");
+  if (base && *base)
+    return SystemUtilities::joinPath
+      (SystemUtilities::joinPath(base, ".cache"), "camotics");
+#endif
+
+  return ""; // Nowhere to keep it
+}
@@ -0,0 +1,61 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+
+#include <string>
+
+
+namespace CAMotics {
+  class Simulation;
+  class Surface;
+
+  /***
+   * Keeps simulated surfaces on disk, named by a hash of everything which
+   * went in to them, so an unchanged simulation can be loaded instead of
+   * computed again.  Surfaces are stored packed and, when built with LZ4,
+   * compressed.  Failures are logged and otherwise treated as a cache miss.
+   */
+  class SurfaceCache {
+    std::string path;
+
+  public:
+    /// An empty @param path disables the cache.
+    SurfaceCache(const std::string &path = getDefaultPath());
+
+    const std::string &getPath() const {return path;}
+    std::string getFilename(const Simulation &sim) const;
+    /// Where grids are saved as they complete, to resume @param sim.
+    std::string getCheckpointFilename(const Simulation &sim) const;
+
+    /// @return the cached surface for @param sim or null if there is none.
+    cb::SmartPointer<Surface> load(const Simulation &sim) const;
+    void store(const Simulation &sim, const Surface &surface) const;
+
+    static std::string getDefaultPath();
+
+  protected:
+    std::string getFilename(const Simulation &sim,
+                            const std::string &ext) const;
+  };
+}
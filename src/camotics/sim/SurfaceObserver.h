@@ -20,19 +20,18 @@
 
 #pragma once
 
-#include "PlannerCommand.h"
+#include <cbang/SmartPointer.h>
 
 
-namespace GCode {
-  class ToolCommand : public PlannerCommand {
-    unsigned tool;
+namespace CAMotics {
+  class Surface;
 
+  class SurfaceObserver {
   public:
-    ToolCommand(uint64_t line, unsigned tool) :
-      PlannerCommand(line), tool(tool) {}
+    virtual ~SurfaceObserver() {}
 
-    // From PlannerCommand
-    const char *getType() {return "tool";}
-    void insert(cb::JSON::Sink &sink);
+    /// Called from the simulation thread with a partial surface to show
+    /// until the final one is done.
+    virtual void surfacePreview(const cb::SmartPointer<Surface> &surface) = 0;
   };
 }
@@ -20,9 +20,11 @@
 
 
 #include "SurfaceTask.h"
+#include "SurfaceCache.h"
 
 #include <camotics/sim/SimulationRun.h>
 #include <camotics/contour/Surface.h>
+#include <camotics/contour/FieldStats.h>
 
 #include <cbang/String.h>
 #include <cbang/time/TimeInterval.h>
@@ -32,12 +34,13 @@ using namespace cb;
 using namespace CAMotics;
 
 
-SurfaceTask::SurfaceTask(const Simulation &sim) :
-  simRun(new SimulationRun(sim)) {}
+SurfaceTask::SurfaceTask(const Simulation &sim, SurfaceObserver *observer,
+                         const SmartPointer<SurfaceCache> &cache) :
+  simRun(new SimulationRun(sim)), observer(observer), cache(cache) {}
 
 
 SurfaceTask::SurfaceTask(const SmartPointer<SimulationRun> &simRun) :
-  simRun(simRun) {}
+  simRun(simRun), observer(0) {}
 
 
 SurfaceTask::~SurfaceTask() {}
@@ -46,7 +49,28 @@ SurfaceTask::~SurfaceTask() {}
 void SurfaceTask::run() {
   Task::begin();
 
-  surface = simRun->compute(SmartPointer<Task>::Phony(this));
+  // Keyed by the simulation as given, compute() may change its mode
+  const Simulation sim = simRun->getSimulation();
+
+  if (!cache.isNull()) {
+    surface = cache->load(sim);
+
+    if (!surface.isNull()) {
+      double delta = Task::end();
+      LOG_INFO(1, "Time: " << TimeInterval(delta)
+               << " Triangles: " << surface->getCount() << " (cached)");
+      return;
+    }
+  }
+
+  FieldStats::flush();
+  FieldStats before = FieldStats::getTotals();
+
+  surface = simRun->compute(SmartPointer<Task>::Phony(this), observer);
+
+  // Includes any other simulations running at the same time
+  FieldStats::flush();
+  FieldStats stats = FieldStats::getTotals() - before;
 
   // Time
   if (shouldQuit()) {
@@ -55,10 +79,23 @@ void SurfaceTask::run() {
     return;
   }
 
+  if (!cache.isNull() && !surface.isNull()) cache->store(sim, *surface);
+
+  // Memory, while the simulation still holds it
+  memory = MemoryUsage();
+  simRun->getMemoryUsage(memory);
+  if (!surface.isNull()) memory.add("surface", surface->getMemoryUsage());
+  MemoryUsage::record(memory);
+
   // Done
   double delta = Task::end();
+  if (getPredictedTime())
+    LOG_INFO(1, "Predicted render time was "
+             << TimeInterval(getPredictedTime()));
   LOG_INFO(1, "Time: " << TimeInterval(delta)
            << " Triangles: " << surface->getCount()
            << " Triangles/sec: "
-           << String::printf("%0.2f", surface->getCount() / delta));
+           << String::printf("%0.2f", surface->getCount() / delta)
+           << ' ' << stats.toString());
+  LOG_INFO(1, "Memory: " << memory.toString());
 }
@@ -22,6 +22,7 @@
 
 
 #include <camotics/Task.h>
+#include <camotics/MemoryUsage.h>
 
 #include <cbang/SmartPointer.h>
 
@@ -30,21 +31,33 @@ namespace CAMotics {
   class Simulation;
   class SimulationRun;
   class Surface;
+  class SurfaceObserver;
+  class SurfaceCache;
 
 
   class SurfaceTask : public Task {
     cb::SmartPointer<SimulationRun> simRun;
     cb::SmartPointer<Surface> surface;
+    SurfaceObserver *observer;
+    cb::SmartPointer<SurfaceCache> cache;
+    MemoryUsage memory;
 
   public:
-    SurfaceTask(const Simulation &sim);
+    /// Send previews of the surface to @param observer, if given.  The
+    /// surface is loaded from or saved to @param cache, if given.
+    SurfaceTask(const Simulation &sim, SurfaceObserver *observer = 0,
+                const cb::SmartPointer<SurfaceCache> &cache = 0);
     SurfaceTask(const cb::SmartPointer<SimulationRun> &simRun);
     ~SurfaceTask();
 
     const cb::SmartPointer<SimulationRun> &getSimRun() const {return simRun;}
     const cb::SmartPointer<Surface> &getSurface() const {return surface;}
+    /// The bytes held by the simulation once the surface was computed.
+    const MemoryUsage &getMemoryUsage() const {return memory;}
 
     // From Task
     void run();
+    /// Tasks continuing the same simulation run in order.
+    const void *getExclusionKey() const {return simRun.get();}
   };
 }
@@ -22,17 +22,65 @@
 
 #include <gcode/Move.h>
 
+#include <cbang/Math.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  // A short segment tangent to the planar arc through its point closest to
+  // the direction of p, at angle @param s travelled from the start.  A
+  // round tool swept along it is the same distance from p as along the arc.
+  void arcTangent(const GCode::Move &move, double s0, double s1, double s,
+                  const cb::Vector3D &p, cb::Vector3D &a, cb::Vector3D &b) {
+    double sweep = fabs(move.getAngle());
+    double direction = 0 < move.getAngle() ? 1 : -1;
+
+    // The closest point is either radial to p or one of the ends
+    double closest = s + 2 * M_PI * ceil((s0 - s) / (2 * M_PI));
+
+    if (s1 < closest) {
+      cb::Vector3D e0 = move.getPtAt(s0 / sweep);
+      cb::Vector3D e1 = move.getPtAt(s1 / sweep);
+      double d0 = (e0.x() - p.x()) * (e0.x() - p.x()) +
+        (e0.y() - p.y()) * (e0.y() - p.y());
+      double d1 = (e1.x() - p.x()) * (e1.x() - p.x()) +
+        (e1.y() - p.y()) * (e1.y() - p.y());
+      closest = d0 <= d1 ? s0 : s1;
+    }
+
+    double angle = move.getStartAngle() - direction * closest;
+    cb::Vector3D q = move.getPtAt(closest / sweep);
+    cb::Vector3D tangent(-sin(angle) * 1e-6, cos(angle) * 1e-6, 0);
+
+    a = q - tangent;
+    b = q + tangent;
+  }
+}
+
+
 void Sweep::getBBoxes(const cb::Vector3D &start, const cb::Vector3D &end,
                       vector<cb::Rectangle3D> &bboxes, double radius,
                       double length, double zOffset, double tolerance) const {
-  const unsigned maxLen = radius * 16;
   double len = start.distance(end);
-  unsigned steps = (len <= maxLen) ? 1 : (len / maxLen);
+
+  // An axis aligned box around a diagonal piece covers more than the tool
+  // sweeps by about the piece's length times its XY offsets, so diagonal
+  // moves are cut shorter, enough to keep that within a few tool widths.
+  double maxLen = radius * 16;
+  if (len) {
+    double ux = fabs(end.x() - start.x()) / len;
+    double uy = fabs(end.y() - start.y()) / len;
+    if (ux * uy) maxLen = std::min(maxLen, radius * 4 / (ux * uy));
+  }
+
+  unsigned steps = (len <= maxLen || !maxLen) ? 1 : ceil(len / maxLen);
   double stride = 1.0 / steps;
   cb::Vector3D p1 = start;
   cb::Vector3D p2;
@@ -55,3 +103,129 @@ void Sweep::getBBoxes(const cb::Vector3D &start, const cb::Vector3D &end,
     p1 = p2;
   }
 }
+
+
+void Sweep::depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                  const double *x, const double *y, const double *z,
+                  unsigned n, double *out) const {
+  for (unsigned i = 0; i < n; i++)
+    out[i] = depth(start, end, cb::Vector3D(x[i], y[i], z[i]));
+}
+
+
+void Sweep::depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                  const float *x, const float *y, const float *z,
+                  unsigned n, float *out) const {
+  if (!n) return;
+
+  static thread_local vector<double> xs, ys, zs, depths;
+  xs.assign(x, x + n);
+  ys.assign(y, y + n);
+  zs.assign(z, z + n);
+  depths.resize(n);
+
+  depth(start, end, &xs[0], &ys[0], &zs[0], n, &depths[0]);
+
+  // Depths beyond the float range only need to keep their sign
+  const double max = numeric_limits<float>::max();
+  for (unsigned i = 0; i < n; i++)
+    out[i] = depths[i] < -max ? -max : (max < depths[i] ? max : depths[i]);
+}
+
+
+double Sweep::arcDepth(const GCode::Move &move, double startTime,
+                       double endTime, const cb::Vector3D &p,
+                       double tolerance) const {
+  // The part of the arc swept between the times, as angles from the start
+  double sweep = fabs(move.getAngle());
+  double s0 = move.getFractionAtTime(startTime) * sweep;
+  double s1 = move.getFractionAtTime(endTime) * sweep;
+  if (s1 <= s0) return -1;
+
+  // Is p within reach of the circle?
+  const cb::Vector2D &center = move.getCenter();
+  cb::Vector2D d(p.x() - center.x(), p.y() - center.y());
+  double dist = d.length();
+  double r = move.getRadius();
+  double R = getRadius();
+  if (r + R < dist || dist + R < r) return -1;
+  if (!r) return depth(move.getPtAt(s0 / sweep), move.getPtAt(s1 / sweep), p);
+
+  // Angle travelled to reach the direction of p, in [0, 2Pi)
+  double direction = 0 < move.getAngle() ? 1 : -1;
+  double s = direction * (move.getStartAngle() - atan2(d.y(), d.x()));
+  s = fmod(s, 2 * M_PI);
+  if (s < 0) s += 2 * M_PI;
+
+  const cb::Vector3D &startPt = move.getStartPt();
+  const cb::Vector3D &endPt = move.getEndPt();
+
+  if (startPt.z() == endPt.z()) {
+    // A planar sweep of a round tool at p is the tool at the closest point on
+    // the arc, so no special case is needed in each sweep
+    cb::Vector3D a, b;
+    arcTangent(move, s0, s1, s, p, a, b);
+    return depth(a, b, p);
+  }
+
+  // Only the part of a helix within the tool's reach of p can cut it
+  double reach = M_PI;
+  if (dist && r) {
+    double c = (r * r + dist * dist - R * R) / (2 * r * dist);
+    if (-1 < c) reach = c < 1 ? acos(c) : 0;
+  }
+
+  double error = std::min(tolerance, r);
+  double step = std::min(2 * M_PI / 3, 2 * acos(1 - error / r));
+  double d2 = -1;
+
+  // Sweeps find where p enters the tool, so start a chord before the reach
+  reach += step;
+
+  for (double a = s - 2 * M_PI * ceil((s - s0 + reach) / (2 * M_PI));
+       a - reach <= s1; a += 2 * M_PI) {
+    double a0 = std::max(s0, a - reach);
+    double a1 = std::min(s1, a + reach);
+    if (a1 < a0) continue;
+
+    unsigned segments = std::max(1.0, ceil((a1 - a0) / step));
+    cb::Vector3D p1 = move.getPtAt(a0 / sweep);
+
+    for (unsigned i = 1; i <= segments; i++) {
+      cb::Vector3D p2 = move.getPtAt((a0 + (a1 - a0) * i / segments) / sweep);
+
+      double sd2 = depth(p1, p2, p);
+      if (0 <= sd2) return sd2;
+      if (d2 < sd2) d2 = sd2;
+
+      p1 = p2;
+    }
+  }
+
+  return d2;
+}
+
+
+cb::Vector3D Sweep::arcNormal(const GCode::Move &move, double startTime,
+                              double endTime, const cb::Vector3D &p) const {
+  if (move.getStartPt().z() != move.getEndPt().z()) return cb::Vector3D();
+
+  double sweep = fabs(move.getAngle());
+  double s0 = move.getFractionAtTime(startTime) * sweep;
+  double s1 = move.getFractionAtTime(endTime) * sweep;
+  if (s1 <= s0) return cb::Vector3D();
+
+  if (!move.getRadius())
+    return normal(move.getPtAt(s0 / sweep), move.getPtAt(s1 / sweep), p);
+
+  const cb::Vector2D &center = move.getCenter();
+  double direction = 0 < move.getAngle() ? 1 : -1;
+  double s = direction *
+    (move.getStartAngle() - atan2(p.y() - center.y(), p.x() - center.x()));
+  s = fmod(s, 2 * M_PI);
+  if (s < 0) s += 2 * M_PI;
+
+  cb::Vector3D a, b;
+  arcTangent(move, s0, s1, s, p, a, b);
+  return normal(a, b, p);
+}
@@ -42,7 +42,43 @@ namespace CAMotics {
                            double tolerance = 0.01) const = 0;
     virtual bool intersects(const GCode::Move &move,
                             const cb::Rectangle3D &box) const {return false;}
+    /// @return the signed distance from @param p to the volume swept from
+    /// @param start to @param end, positive inside, or only 1 or -1 where
+    /// a sweep has no cheap distance.
     virtual double depth(const cb::Vector3D &start, const cb::Vector3D &end,
                        const cb::Vector3D &p) const = 0;
+    /// @return the outward unit normal of the swept volume at the surface
+    /// nearest @param p or a zero vector where a sweep has no closed form.
+    virtual cb::Vector3D normal(const cb::Vector3D &start,
+                                const cb::Vector3D &end,
+                                const cb::Vector3D &p) const
+    {return cb::Vector3D();}
+
+    /// @return the widest cross section of the tool.
+    virtual double getRadius() const = 0;
+    /// True if the tool, and so every straight sweep of it, is convex.
+    virtual bool isConvex() const {return true;}
+
+    /// Depth of @param p swept along the part of the arc @param move between
+    /// @param startTime and @param endTime.  Planar arcs are exact, helices
+    /// are evaluated as chords within @param tolerance of the arc near p.
+    double arcDepth(const GCode::Move &move, double startTime, double endTime,
+                    const cb::Vector3D &p, double tolerance = 0.001) const;
+    /// The normal to the part of the arc swept between the times, known for
+    /// planar arcs only.
+    cb::Vector3D arcNormal(const GCode::Move &move, double startTime,
+                           double endTime, const cb::Vector3D &p) const;
+
+    /// Evaluate @param n points, given as separate coordinate arrays, at once.
+    virtual void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                       const double *x, const double *y, const double *z,
+                       unsigned n, double *out) const;
+    /// Evaluate @param n points in single precision.  The points,
+    /// @param start and @param end must be relative to a nearby origin so
+    /// they round to much less than the grid resolution.  By default the
+    /// points are widened and given to the double precision batch.
+    virtual void depth(const cb::Vector3D &start, const cb::Vector3D &end,
+                       const float *x, const float *y, const float *z,
+                       unsigned n, float *out) const;
   };
 }
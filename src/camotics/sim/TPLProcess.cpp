@@ -0,0 +1,107 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "TPLProcess.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/log/Logger.h>
+#include <cbang/os/Subprocess.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/log/AsyncCopyStreamToLog.h>
+#include <cbang/util/DefaultCatch.h>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+TPLProcess::TPLProcess(const string &filename, const string &units,
+                       const string &simJSON) :
+  proc(new Subprocess), gcode(new vector<char>), failed(false) {
+
+  // Get executable name
+  string cmd =
+    SystemUtilities::joinPath
+    (SystemUtilities::dirname(SystemUtilities::getExecutablePath()), "tplang");
+#ifdef _WIN32
+  cmd += ".exe";
+#endif
+
+  if (!SystemUtilities::exists(cmd)) cmd = "tplang";
+
+  // Build args
+  args.push_back(cmd);
+  args.push_back("--" + String::toLower(units));
+  args.push_back("--sim-json=" + simJSON);
+  args.push_back(filename);
+}
+
+
+TPLProcess::~TPLProcess() {
+  kill();
+  if (getState() != THREAD_STOPPED) join();
+}
+
+
+void TPLProcess::kill() {
+  Thread::stop();
+  if (getState() == THREAD_RUNNING) try {proc->kill(true);} CATCH_ERROR;
+  if (!logCopier.isNull()) logCopier->stop();
+}
+
+
+void TPLProcess::run() {
+  try {
+    // Add pipe
+    unsigned pipe = proc->createPipe(false);
+    args.push_back("--pipe");
+    args.push_back(String((uint64_t)proc->getPipeHandle(pipe)));
+
+    // Execute
+    proc->exec(args, Subprocess::REDIR_STDOUT |
+               Subprocess::MERGE_STDOUT_AND_STDERR |
+               Subprocess::W32_HIDE_WINDOW, ProcessPriority::PRIORITY_LOW);
+
+    // Copy output to log
+    logCopier = new AsyncCopyStreamToLog(proc->getStream(1));
+    logCopier->start();
+
+    // Read the GCode
+    istream &stream = *proc->getStream(pipe);
+    const streamsize blockSize = 1 << 20;
+
+    while (stream && !shouldShutdown()) {
+      size_t fill = gcode->size();
+      gcode->resize(fill + blockSize);
+      stream.read(&(*gcode)[fill], blockSize);
+      gcode->resize(fill + stream.gcount());
+    }
+
+    if (proc->waitFor(5, 10)) failed = true;
+
+  } catch (const Exception &e) {
+    if (!shouldShutdown()) LOG_ERROR(e);
+    failed = true;
+  }
+
+  // Stop the log copier
+  if (!logCopier.isNull()) logCopier->join();
+}
@@ -0,0 +1,62 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/os/Thread.h>
+
+#include <string>
+#include <vector>
+
+
+namespace cb {class Subprocess;}
+
+namespace CAMotics {
+  /***
+   * Runs a TPL program in a tplang subprocess and collects the GCode it
+   * generates.  Several may run at once while their GCode is interpreted in
+   * order.
+   */
+  class TPLProcess : public cb::Thread {
+    std::vector<std::string> args;
+    cb::SmartPointer<cb::Subprocess> proc;
+    cb::SmartPointer<cb::Thread> logCopier;
+    cb::SmartPointer<std::vector<char> > gcode;
+    bool failed;
+
+  public:
+    /// @param simJSON and @param units are passed on to tplang.
+    TPLProcess(const std::string &filename, const std::string &units,
+               const std::string &simJSON);
+    ~TPLProcess();
+
+    /// @return the GCode, complete once the thread is joined.
+    const cb::SmartPointer<std::vector<char> > &getGCode() const
+    {return gcode;}
+    bool hasFailed() const {return failed;}
+
+    void kill();
+
+    // From cb::Thread
+    void run();
+  };
+}
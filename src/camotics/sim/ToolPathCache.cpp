@@ -0,0 +1,170 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "ToolPathCache.h"
+#include "SurfaceCache.h"
+#include "ToolPathFile.h"
+
+#include <gcode/ToolPath.h>
+#include <gcode/interp/Checkpoints.h>
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/log/Logger.h>
+#include <cbang/util/SmartLock.h>
+#include <cbang/os/SystemUtilities.h>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  SmartPointer<GCode::ToolPath> unpack(const vector<char> &data,
+                                       const GCode::ToolTable &tools) {
+    SmartPointer<GCode::ToolPath> toolPath = new GCode::ToolPath(tools);
+    toolPath->unpack(data.data(), data.size());
+    return toolPath;
+  }
+}
+
+
+ToolPathCache::ToolPathCache(const string &path, unsigned maxEntries) :
+  path(path), maxEntries(maxEntries) {}
+
+
+ToolPathCache::~ToolPathCache() {}
+
+
+string ToolPathCache::getFilename(const string &key) const {
+  string name;
+
+  for (unsigned i = 0; i < key.size(); i++)
+    name += String::printf("%02x", (uint8_t)key[i]);
+
+  return SystemUtilities::joinPath(path, name + ".tpc");
+}
+
+
+SmartPointer<GCode::ToolPath>
+ToolPathCache::load(const string &key, const GCode::ToolTable &tools) {
+  {
+    SmartLock lock(this);
+
+    for (iterator it = entries.begin(); it != entries.end(); it++)
+      if (it->key == key) {
+        entries.splice(entries.begin(), entries, it);
+
+        try {
+          SmartPointer<GCode::ToolPath> toolPath = unpack(it->data, tools);
+          LOG_INFO(1, "Reusing tool path from memory");
+          return toolPath;
+
+        } catch (const Exception &e) {
+          LOG_WARNING("Ignoring cached tool path: " << e.getMessage());
+          entries.erase(it);
+        }
+
+        break;
+      }
+  }
+
+  if (path.empty()) return 0;
+
+  string filename = getFilename(key);
+  if (!SystemUtilities::exists(filename)) return 0;
+
+  try {
+    vector<char> data;
+    ToolPathFile::read(filename, data);
+
+    SmartPointer<GCode::ToolPath> toolPath = unpack(data, tools);
+
+    LOG_INFO(1, "Loaded cached tool path " << filename);
+
+    SmartLock lock(this);
+    remember(key, data);
+
+    return toolPath;
+
+  } catch (const Exception &e) {
+    LOG_WARNING("Ignoring tool path cache file '" << filename << "': "
+                << e.getMessage());
+  }
+
+  return 0;
+}
+
+
+void ToolPathCache::store(const string &key,
+                          const GCode::ToolPath &toolPath) {
+  vector<char> data;
+  toolPath.pack(data);
+
+  if (!path.empty()) {
+    string filename = getFilename(key);
+
+    try {
+      SystemUtilities::ensureDirectory(path);
+      uint64_t stored = ToolPathFile::write(filename, data);
+
+      LOG_INFO(1, "Cached tool path " << filename << " " << stored
+               << " bytes");
+
+    } catch (const Exception &e) {
+      LOG_WARNING("Failed to cache tool path: " << e.getMessage());
+    }
+  }
+
+  SmartLock lock(this);
+  remember(key, data);
+}
+
+
+SmartPointer<GCode::Checkpoints> ToolPathCache::getCheckpoints() {
+  SmartLock lock(this);
+  return checkpoints;
+}
+
+
+void ToolPathCache::setCheckpoints
+(const SmartPointer<GCode::Checkpoints> &checkpoints) {
+  SmartLock lock(this);
+  this->checkpoints = checkpoints;
+}
+
+
+string ToolPathCache::getDefaultPath() {
+  return SurfaceCache::getDefaultPath();
+}
+
+
+void ToolPathCache::remember(const string &key, vector<char> &data) {
+  for (iterator it = entries.begin(); it != entries.end(); it++)
+    if (it->key == key) {
+      entries.erase(it);
+      break;
+    }
+
+  entries.push_front(Entry());
+  entries.front().key = key;
+  entries.front().data.swap(data);
+
+  while (maxEntries < entries.size()) entries.pop_back();
+}
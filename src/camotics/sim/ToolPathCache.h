@@ -0,0 +1,84 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <vector>
+#include <list>
+
+
+namespace GCode {
+  class ToolPath;
+  class ToolTable;
+  class Checkpoints;
+}
+
+namespace CAMotics {
+  /***
+   * Keeps generated tool paths, named by a hash of everything which went in
+   * to them, so an unchanged program is not interpreted again.  The most
+   * recent paths are kept packed in memory and, if a path is given, on disk
+   * compressed with LZ4 when available.  Failures are logged and otherwise
+   * treated as a cache miss.  The checkpoints of the last run are also kept,
+   * so an edited program can be interpreted again from the first change.
+   */
+  class ToolPathCache : public cb::Mutex {
+    std::string path;
+
+    struct Entry {
+      std::string key;
+      std::vector<char> data;
+    };
+
+    typedef std::list<Entry> entries_t;
+    typedef entries_t::iterator iterator;
+    entries_t entries; ///< Most recently used first
+    unsigned maxEntries;
+
+    cb::SmartPointer<GCode::Checkpoints> checkpoints;
+
+  public:
+    /// An empty @param path only caches in memory.
+    ToolPathCache(const std::string &path = getDefaultPath(),
+                  unsigned maxEntries = 4);
+    ~ToolPathCache();
+
+    const std::string &getPath() const {return path;}
+    std::string getFilename(const std::string &key) const;
+
+    /// @return the path cached under @param key or null if there is none.
+    cb::SmartPointer<GCode::ToolPath> load(const std::string &key,
+                                           const GCode::ToolTable &tools);
+    void store(const std::string &key, const GCode::ToolPath &toolPath);
+
+    cb::SmartPointer<GCode::Checkpoints> getCheckpoints();
+    void
+    setCheckpoints(const cb::SmartPointer<GCode::Checkpoints> &checkpoints);
+
+    static std::string getDefaultPath();
+
+  protected:
+    void remember(const std::string &key, std::vector<char> &data);
+  };
+}
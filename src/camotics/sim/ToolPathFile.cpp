@@ -0,0 +1,278 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "ToolPathFile.h"
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+#include <cbang/os/SysError.h>
+#include <cbang/os/SystemUtilities.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  const char magic[4] = {'C', 'T', 'P', 'H'};
+  const uint32_t version = 2;
+
+  enum {
+    UNCOMPRESSED,
+    LZ4_COMPRESSED,
+  };
+
+  // Larger files are assumed to be corrupt
+  const uint64_t maxFileSize = (uint64_t)1 << 36;
+
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t compression;
+    uint32_t reserved;
+    uint64_t size;   // Packed tool path
+    uint64_t stored; // Bytes which follow the header
+  };
+
+
+  class MappedFile {
+  public:
+    const char *data;
+    uint64_t size;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    MappedFile(const string &path) : data(0), size(0) {
+#ifdef _WIN32
+      mapping = 0;
+      file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+      if (file == INVALID_HANDLE_VALUE)
+        THROWS("Failed to open '" << path << "': " << SysError());
+
+      LARGE_INTEGER fileSize;
+      if (GetFileSizeEx(file, &fileSize)) size = fileSize.QuadPart;
+
+      if (size) {
+        mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping)
+          data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      }
+
+#else
+      fd = open(path.c_str(), O_RDONLY);
+      if (fd == -1) THROWS("Failed to open '" << path << "': " << SysError());
+
+      struct stat info;
+      if (!fstat(fd, &info)) size = info.st_size;
+
+      if (size) {
+        void *addr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+          data = (const char *)addr;
+          madvise(addr, size, MADV_SEQUENTIAL);
+        }
+      }
+#endif
+
+      if (!data) {
+        close();
+        THROWS("Failed to map '" << path << "'");
+      }
+    }
+
+
+    ~MappedFile() {close();}
+
+
+    void close() {
+#ifdef _WIN32
+      if (data) UnmapViewOfFile(data);
+      if (mapping) CloseHandle(mapping);
+      if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+      mapping = 0;
+      file = INVALID_HANDLE_VALUE;
+
+#else
+      if (data) munmap((void *)data, size);
+      if (fd != -1) ::close(fd);
+      fd = -1;
+#endif
+
+      data = 0;
+    }
+  };
+
+
+  /// @return the packed moves, in the mapping if they are stored
+  /// uncompressed, otherwise decompressed in to @param buffer.
+  const char *decode(const MappedFile &file, vector<char> &buffer,
+                     uint64_t &size) {
+    Header header;
+    if (file.size < sizeof(header)) THROW("Not a tool path file");
+    memcpy(&header, file.data, sizeof(header));
+
+    if (memcmp(header.magic, magic, sizeof(magic)) ||
+        header.version != version)
+      THROW("Not a tool path file");
+
+    if (maxFileSize < header.size || maxFileSize < header.stored)
+      THROW("Tool path file is corrupt");
+
+    if (file.size - sizeof(header) < header.stored)
+      THROW("Tool path file is truncated");
+
+    const char *stored = file.data + sizeof(header);
+    size = header.size;
+
+    switch (header.compression) {
+    case UNCOMPRESSED:
+      if (header.size != header.stored) THROW("Tool path file is corrupt");
+      return stored;
+
+#ifdef HAVE_LZ4
+    case LZ4_COMPRESSED:
+      if (LZ4_MAX_INPUT_SIZE < header.size ||
+          LZ4_MAX_INPUT_SIZE < header.stored)
+        THROW("Tool path file is corrupt");
+
+      buffer.resize(header.size);
+      if (LZ4_decompress_safe(stored, buffer.data(), header.stored,
+                              buffer.size()) != (int)buffer.size())
+        THROW("Failed to decompress tool path file");
+      return buffer.data();
+#endif
+
+    default: THROWS("Unsupported tool path compression "
+                    << header.compression);
+    }
+  }
+}
+
+
+uint64_t ToolPathFile::write(const string &filename,
+                             const vector<char> &packed) {
+  Header header;
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.compression = UNCOMPRESSED;
+  header.reserved = 0;
+  header.size = packed.size();
+
+  const vector<char> *stored = &packed;
+
+#ifdef HAVE_LZ4
+  vector<char> compressed;
+
+  if (packed.size() <= LZ4_MAX_INPUT_SIZE) {
+    compressed.resize(LZ4_compressBound(packed.size()));
+    int size = LZ4_compress_default(packed.data(), compressed.data(),
+                                    packed.size(), compressed.size());
+
+    if (0 < size) {
+      compressed.resize(size);
+      stored = &compressed;
+      header.compression = LZ4_COMPRESSED;
+    }
+  }
+#endif
+
+  header.stored = stored->size();
+
+  string tmp = filename + ".tmp";
+
+  try {
+    {
+      SmartPointer<ostream> stream = SystemUtilities::oopen(tmp);
+      stream->write((const char *)&header, sizeof(header));
+      stream->write(stored->data(), stored->size());
+      stream->flush();
+      if (stream->fail()) THROWS("Failed to write '" << tmp << "'");
+    }
+
+    SystemUtilities::rename(tmp, filename);
+
+  } catch (...) {
+    if (SystemUtilities::exists(tmp)) SystemUtilities::unlink(tmp);
+    throw;
+  }
+
+  return header.stored;
+}
+
+
+uint64_t ToolPathFile::write(const string &filename,
+                             const GCode::ToolPath &path) {
+  vector<char> packed;
+  path.pack(packed);
+  return write(filename, packed);
+}
+
+
+void ToolPathFile::read(const string &filename, vector<char> &packed) {
+  MappedFile file(filename);
+
+  uint64_t size;
+  vector<char> buffer;
+  const char *data = decode(file, buffer, size);
+
+  if (data == buffer.data()) packed.swap(buffer);
+  else packed.assign(data, data + size);
+}
+
+
+SmartPointer<GCode::ToolPath>
+ToolPathFile::read(const string &filename, const GCode::ToolTable &tools) {
+  MappedFile file(filename);
+
+  uint64_t size;
+  vector<char> buffer;
+  const char *data = decode(file, buffer, size);
+
+  SmartPointer<GCode::ToolPath> path = new GCode::ToolPath(tools);
+  path->unpack(data, size);
+
+  return path;
+}
@@ -0,0 +1,60 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <vector>
+
+
+namespace GCode {
+  class ToolPath;
+  class ToolTable;
+}
+
+namespace CAMotics {
+  /***
+   * A tool path saved in binary, the moves of ToolPath::pack() behind a
+   * small versioned header, compressed with LZ4 when available.  Used by
+   * the tool path cache and to pass paths between processes instead of
+   * JSON.  Files are read by mapping them in to memory, so an uncompressed
+   * path is unpacked without copying the file first.
+   */
+  class ToolPathFile {
+  public:
+    /// Write the output of ToolPath::pack() to @param filename, through a
+    /// temporary file so readers never see a partial one.
+    /// @return the bytes written after the header.
+    static uint64_t write(const std::string &filename,
+                          const std::vector<char> &packed);
+    static uint64_t write(const std::string &filename,
+                          const GCode::ToolPath &path);
+
+    /// Read the packed moves from @param filename in to @param packed.
+    static void read(const std::string &filename, std::vector<char> &packed);
+    static cb::SmartPointer<GCode::ToolPath>
+    read(const std::string &filename, const GCode::ToolTable &tools);
+  };
+}
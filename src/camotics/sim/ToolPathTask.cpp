@@ -19,40 +19,170 @@
 \******************************************************************************/
 
 #include "ToolPathTask.h"
+#include "ToolPathCache.h"
+#include "TPLProcess.h"
 
-#include <camotics/TaskFilter.h>
+#include <camotics/SHA256.h>
+#include <camotics/Trace.h>
 #include <camotics/sim/Project.h>
 #include <camotics/sim/Simulation.h>
 #include <gcode/Controller.h>
 #include <gcode/interp/Interpreter.h>
+#include <gcode/interp/IncrementalInterpreter.h>
 #include <gcode/machine/Machine.h>
+#include <gcode/plan/MoveTimer.h>
+#include <gcode/parse/Tokenizer.h>
+#include <gcode/parse/ChunkParser.h>
+#include <gcode/machine/MachineUnitAdapter.h>
+#include <tplang/TPLContext.h>
+#include <tplang/Interpreter.h>
 
 #include <cbang/util/DefaultCatch.h>
 #include <cbang/util/SmartFunctor.h>
+#include <cbang/util/SmartLock.h>
 
 #include <cbang/os/SystemUtilities.h>
-#include <cbang/os/Subprocess.h>
+#include <cbang/os/Thread.h>
+#include <cbang/os/SystemInfo.h>
 
-#include <cbang/iostream/VectorDevice.h>
-#include <cbang/iostream/TeeFilter.h>
+#include <cbang/io/StringInputSource.h>
+#include <cbang/json/Reader.h>
 
-#include <cbang/log/AsyncCopyStreamToLog.h>
-
-#include <boost/ref.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/device/file.hpp>
-namespace io = boost::iostreams;
+#include <sstream>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
-ToolPathTask::ToolPathTask(const Project &project) :
+namespace {
+  // Parse in parallel chunks when there is at least this much GCode
+  const uint64_t minChunkedSize = 1 << 22;
+
+  // How many files past the current one are loaded and parsed ahead
+  const unsigned maxPrefetch = 4;
+
+
+  // Arcs are linearized no finer than the simulation can resolve.  Chords
+  // within half a voxel of the arc cut the same surface.
+  double computeMaxArcError(double resolution) {
+    return std::max(0.01, resolution / 2);
+  }
+
+
+  // Reports how much of the program has been parsed, T is a
+  // GCode::Tokenizer or GCode::ChunkParser
+  template <typename T>
+  class ParseProgress : public GCode::Interrupter {
+    Task &task;
+    const T &parser;
+    mutable unsigned count;
+
+  public:
+    ParseProgress(Task &task, const T &parser) :
+      task(task), parser(parser), count(0) {}
+
+    // From GCode::Interrupter
+    bool interrupt() const {
+      if (!(++count & 1023) && parser.getLength()) {
+        task.update((double)parser.getOffset() / parser.getLength());
+        CAMOTICS_TRACE_COUNT("GCode bytes parsed", parser.getOffset());
+      }
+
+      return task.shouldQuit();
+    }
+  };
+
+
+  // Forwards to the progress of the parser in use, if any
+  class ProgressProxy : public GCode::Interrupter {
+    Task &task;
+    const GCode::Interrupter *target;
+
+  public:
+    ProgressProxy(Task &task) : task(task), target(0) {}
+
+    void setTarget(const GCode::Interrupter *target) {this->target = target;}
+
+    // From GCode::Interrupter
+    bool interrupt() const {
+      return target ? target->interrupt() : task.shouldQuit();
+    }
+  };
+
+
+  void read(istream &stream, vector<char> &data) {
+    const streamsize blockSize = 1 << 20;
+
+    while (stream) {
+      size_t fill = data.size();
+      data.resize(fill + blockSize);
+      stream.read(&data[fill], blockSize);
+      data.resize(fill + stream.gcount());
+    }
+  }
+
+
+  SmartPointer<vector<char> > loadFile(const string &filename) {
+    if (!SystemUtilities::exists(filename)) return 0;
+
+    SmartPointer<vector<char> > data = new vector<char>;
+    data->reserve(SystemUtilities::getFileSize(filename));
+    read(*SystemUtilities::iopen(filename), *data);
+
+    return data;
+  }
+
+
+  // Loads a GCode file and starts parsing it while earlier files are
+  // interpreted.  Parse errors are only reported when the blocks are
+  // processed, so they still come out in order.
+  class Prefetch : public Thread {
+    string filename;
+    unsigned threads;
+    SmartPointer<vector<char> > data;
+    SmartPointer<GCode::ChunkParser> parser;
+
+  public:
+    Prefetch(const string &filename, unsigned threads,
+             const SmartPointer<vector<char> > &data = 0) :
+      filename(filename), threads(threads), data(data) {}
+    ~Prefetch() {join();}
+
+    /// Only valid after join().
+    const SmartPointer<vector<char> > &getData() const {return data;}
+    const SmartPointer<GCode::ChunkParser> &getParser() const {return parser;}
+
+    // From Thread
+    void run() {
+      try {
+        if (data.isNull()) data = loadFile(filename);
+        if (data.isNull()) return;
+
+        const char *ptr = data->empty() ? 0 : &data->front();
+        parser = new GCode::ChunkParser(ptr, data->size(), filename, threads);
+        parser->start();
+
+      } catch (const Exception &e) {
+        // Loaded again in order, reporting the error
+        LOG_DEBUG(3, e);
+        data.release();
+        parser.release();
+      }
+    }
+  };
+}
+
+
+ToolPathTask::ToolPathTask(const Project &project,
+                           const SmartPointer<ToolPathCache> &cache) :
   tools(project.getToolTable()),
   units(project.getUnits() ==
         GCode::ToolUnits::UNITS_MM ? GCode::Units::METRIC :
-        GCode::Units::IMPERIAL), simJSON(project.toString()), errors(0) {
+        GCode::Units::IMPERIAL),
+  maxArcError(computeMaxArcError(project.getResolution())),
+  planTimes(project.getPlanTimes()), simJSON(project.toString()),
+  inProcessTPL(false), errors(0), cache(cache) {
 
   for (Project::iterator it = project.begin(); it != project.end(); it++)
     files.push_back((*it)->getAbsolutePath());
@@ -62,123 +192,302 @@ ToolPathTask::ToolPathTask(const Project &project) :
 ToolPathTask::~ToolPathTask() {interrupt();}
 
 
+void ToolPathTask::setContents(const string &filename,
+                               const SmartPointer<vector<char> > &data) {
+  contents[filename] = data;
+}
+
+
 void ToolPathTask::run() {
   // Task tracking
   Task::begin();
   SmartFunctor<Task, double (Task::*)()> endTask(this, &Task::end);
 
+  // Reuse the path if none of its inputs changed
+  string key;
+  if (!cache.isNull()) {
+    try {key = computeKey();} CATCH_ERROR;
+
+    if (!key.empty()) {
+      SmartPointer<GCode::ToolPath> cached = cache->load(key, tools);
+      if (!cached.isNull()) {
+        path = cached;
+        return;
+      }
+    }
+  }
+
   // Setup
   path = new GCode::ToolPath(tools);
 
-  // TODO load machine configuration, including rapidFeed & maxArcError
-  GCode::Machine machine(*path);
+  // A single program may be interpreted again from where it was edited
+  string runKey;
+  if (!cache.isNull() && files.size() == 1 && isCacheable())
+    runKey = units.toString() + "\n" + String(maxArcError) + "\n" +
+      (planTimes ? "planned\n" : "\n") + tools.toString() + "\n" + files[0];
+
+  // TODO load machine configuration, including rapidFeed
+  GCode::Machine machine(*path, 10000, maxArcError, true);
   machine.reset();
   GCode::Controller controller(machine, tools);
 
+  // Start all the TPL programs now so they run side by side.  Their GCode
+  // is still interpreted in order.
+  if (!inProcessTPL) {
+    SmartLock lock(this);
+
+    tplProcs.resize(files.size());
+    for (unsigned i = 0; i < files.size() && !Task::shouldQuit(); i++)
+      if (String::endsWith(files[i], ".tpl") &&
+          SystemUtilities::exists(files[i])) {
+        tplProcs[i] = new TPLProcess(files[i], units.toString(), simJSON);
+        tplProcs[i]->start();
+      }
+  }
+
+  // Files after the current one are loaded and parsed ahead.  Only
+  // interpreting has to be in order, modal state carries across files.
+  unsigned cpus = SystemInfo::instance().getCPUCount();
+  vector<SmartPointer<Prefetch> > prefetch(files.size());
+  unsigned prefetched = 1;
+
   // Interpret code
   for (unsigned i = 0; i < files.size() && !Task::shouldQuit(); i++) {
     string filename = files[i];
 
-    if (!SystemUtilities::exists(filename)) continue;
+    for (; prefetched < files.size() && prefetched <= i + maxPrefetch;
+         prefetched++) {
+      const string &name = files[prefetched];
+      if (String::endsWith(name, ".tpl")) continue; // Run by TPLProcess
 
-    Task::update(0, "Running " + filename);
-
-    SmartPointer<istream> stream;
-    io::filtering_istream filter;
-
-    // Track the file load
-    TaskFilter taskFilter(*this);
-    filter.push(boost::ref(taskFilter));
+      contents_t::const_iterator it = contents.find(name);
+      SmartPointer<vector<char> > data;
+      if (it != contents.end()) data = it->second;
 
-    // Copy the GCode
-    gcode = new vector<char>;
-    VectorStream<> vstream(*gcode);
-    TeeFilter teeFilter(vstream);
-    filter.push(teeFilter);
+      prefetch[prefetched] =
+        new Prefetch(name, 1 < cpus ? cpus - 1 : 1, data);
+      prefetch[prefetched]->start();
+    }
 
-    // Generate tool path
-    if (String::endsWith(filename, ".tpl")) {
-      // Get executable name
-      string cmd =
-        SystemUtilities::joinPath
-        (SystemUtilities::dirname(SystemUtilities::getExecutablePath()),
-         "tplang");
-#ifdef _WIN32
-      cmd += ".exe";
-#endif
+    if (!contents.count(filename) && !SystemUtilities::exists(filename))
+      continue;
 
-      if (!SystemUtilities::exists(cmd)) cmd = "tplang";
+    Task::update(0, "Running " + filename);
 
-      // Build args
-      vector<string> args;
-      args.push_back(cmd);
+    if (inProcessTPL && String::endsWith(filename, ".tpl")) {
+      CAMOTICS_TRACE("TPL");
+      runTPL(filename, machine);
+      continue;
+    }
 
-      // Add units
-      args.push_back(string("--") + String::toLower(units.toString()));
+    try {
+      SmartPointer<GCode::ChunkParser> parser;
+
+      // Load the whole GCode, it is kept and tokenized in place
+      if (i < tplProcs.size() && !tplProcs[i].isNull()) {
+        CAMOTICS_TRACE("TPL");
+        tplProcs[i]->join();
+        if (tplProcs[i]->hasFailed()) errors++;
+        gcode = tplProcs[i]->getGCode();
+
+        // So GCode error messages make sense
+        filename = "<generated gcode>";
+
+      } else if (!prefetch[i].isNull()) {
+        CAMOTICS_TRACE("Load GCode");
+        prefetch[i]->join();
+        gcode = prefetch[i]->getData();
+        parser = prefetch[i]->getParser();
+        if (gcode.isNull()) load(filename);
+
+      } else {
+        CAMOTICS_TRACE("Load GCode");
+        load(filename); // Assume it's just GCode
+      }
+
+      CAMOTICS_TRACE("Parse and interpret");
+
+      const char *data = gcode->empty() ? 0 : &gcode->front();
+
+      // The interpreter reports the progress of whichever parser is used
+      ProgressProxy proxy(*this);
+      SmartPointer<ProgressProxy> proxyPtr =
+        SmartPointer<ProgressProxy>::Phony(&proxy);
+
+      SmartPointer<GCode::Interpreter> interp;
+      GCode::IncrementalInterpreter *incremental = 0;
+      int64_t line = 0;
+      uint64_t offset = 0;
+
+      if (!runKey.empty()) {
+        interp = incremental = new GCode::IncrementalInterpreter
+          (controller, machine, path, gcode, runKey, cache->getCheckpoints(),
+           proxyPtr);
+        offset = incremental->resume(line);
+
+      } else interp = new GCode::Interpreter(controller, proxyPtr);
+
+      if (!parser.isNull()) {
+        // Parsing started while the previous files were interpreted
+        ParseProgress<GCode::ChunkParser> progress(*this, *parser);
+        proxy.setTarget(&progress);
+        interp->read(*parser);
+
+      } else if (!offset && 1 < cpus && minChunkedSize <= gcode->size()) {
+        // Parse chunks of large programs on the spare cores
+        GCode::ChunkParser chunks(data, gcode->size(), filename, cpus - 1);
+        ParseProgress<GCode::ChunkParser> progress(*this, chunks);
+        proxy.setTarget(&progress);
+        interp->read(chunks);
+
+      } else {
+        GCode::Tokenizer tokenizer(data + offset, gcode->size() - offset,
+                                   filename, line);
+
+        // Parse GCode
+        typedef ParseProgress<GCode::Tokenizer> TokenizerProgress;
+        TokenizerProgress progress(*this, tokenizer);
+
+        // Parse in another thread, ahead of the interpreter, if there are
+        // cores to spare.  Progress is then only read from that thread.
+        if (1 < cpus)
+          interp->readPipelined
+            (tokenizer, SmartPointer<TokenizerProgress>::Phony(&progress));
+
+        else {
+          proxy.setTarget(&progress);
+          interp->read(tokenizer);
+        }
+      }
+
+      proxy.setTarget(0);
+      errors += interp->getErrorCount();
+
+      if (incremental) {
+        if (line) LOG_INFO(1, "Resumed at line " << line + 1);
+        if (incremental->hasConverged())
+          LOG_INFO(1, "Reused the rest of the last tool path");
+
+        // Later edits resume from this run
+        if (!errors && !Task::shouldQuit())
+          cache->setCheckpoints(incremental->getCheckpoints());
+      }
 
-      // Add simulation JSON
-      args.push_back("--sim-json=" + simJSON);
+    } catch (const Exception &e) {
+      LOG_ERROR(e);
+      errors++;
+    }
 
-      // Add file
-      args.push_back(filename);
+    prefetch[i].release(); // Free the parsed blocks
+  }
 
-      // Create process
-      proc = new Subprocess;
+  {
+    SmartLock lock(this);
+    tplProcs.clear(); // Kills any still running
+  }
 
-      // Add pipe
-      unsigned pipe = proc->createPipe(false);
-      args.push_back("--pipe");
-      args.push_back(String((uint64_t)proc->getPipeHandle(pipe)));
+  if (planTimes && !Task::shouldQuit()) {
+    Task::update(0, "Planning move times");
+    CAMOTICS_TRACE("Plan move times");
 
-      // Execute
-      proc->exec(args, Subprocess::REDIR_STDOUT |
-                 Subprocess::MERGE_STDOUT_AND_STDERR |
-                 Subprocess::W32_HIDE_WINDOW,
-                 ProcessPriority::PRIORITY_LOW);
+    try {
+      GCode::MoveTimer().time(*path);
+    } catch (const Exception &e) {
+      LOG_ERROR(e);
+      errors++;
+    }
+  }
 
-      // Get pipe stream
-      stream = proc->getStream(pipe);
-      filter.push(*stream);
+  // Errors are only reported when the program is interpreted
+  if (!key.empty() && !errors && !Task::shouldQuit()) cache->store(key, *path);
+}
 
-      // Copy output to log
-      logCopier = new AsyncCopyStreamToLog(proc->getStream(1));
-      logCopier->start();
 
-      // Change file name so GCode error messages make sense
-      filename = "<generated gcode>";
+void ToolPathTask::runTPL(const string &filename,
+                          GCode::MachineInterface &machine) {
+  // TPL programs are in metric unless they say otherwise, as with tplang
+  GCode::MachineUnitAdapter unitAdapter;
+  unitAdapter.setParent(SmartPointer<GCode::MachineInterface>::Phony(&machine));
 
-    } else // Assume it's just GCode
-      filter.push(io::file_source(filename));
+  ostringstream out;
 
-    try {
-      InputSource src(filter, filename);
+  try {
+    tplContext = new tplang::TPLContext(out, unitAdapter);
+    tplContext->sim = JSON::Reader::parse(StringInputSource(simJSON));
 
-      // Parse GCode
-      GCode::Interpreter interp(controller, SmartPointer<Task>::Phony(this));
-      interp.read(src);
-      errors += interp.getErrorCount();
+    // Moves go straight into the machine, no GCode is generated
+    tplang::Interpreter(*tplContext).read(InputSource(filename));
 
-    } catch (const Exception &e) {
+  } catch (const Exception &e) {
+    if (!Task::shouldQuit()) {
       LOG_ERROR(e);
       errors++;
     }
+  }
+
+  tplContext.release();
+
+  if (!out.str().empty()) LOG_INFO(1, String::trim(out.str()));
+}
+
 
-    // Wait for Subprocess
-    if (!proc.isNull() && proc->waitFor(5, 10)) errors++;
+bool ToolPathTask::load(const string &filename) {
+  contents_t::const_iterator it = contents.find(filename);
+
+  if (it != contents.end()) {
+    gcode = it->second;
+    return true;
+  }
+
+  SmartPointer<vector<char> > data = loadFile(filename);
+  if (data.isNull()) return false;
+
+  gcode = data;
+  return true;
+}
 
-    // Stop the log copier
-    if (!logCopier.isNull()) {
-      logCopier->join();
-      logCopier.release();
+
+bool ToolPathTask::isCacheable() const {
+  // TPL programs and external subroutines read files which are not known
+  // until they run
+  const char *scriptPath = SystemUtilities::getenv("GCODE_SCRIPT_PATH");
+  if (scriptPath && *scriptPath) return false;
+
+  for (unsigned i = 0; i < files.size(); i++)
+    if (String::endsWith(files[i], ".tpl")) return false;
+
+  return true;
+}
+
+
+string ToolPathTask::computeKey() {
+  if (!isCacheable()) return "";
+
+  SHA256 sha256;
+  sha256.update(units.toString() + "\n");
+  sha256.update(String(maxArcError) + "\n");
+  sha256.update(planTimes ? "planned\n" : "\n");
+  sha256.update(tools.toString() + "\n");
+
+  for (unsigned i = 0; i < files.size(); i++) {
+    if (!load(files[i])) {
+      sha256.update("missing\n");
+      continue;
     }
+
+    sha256.update(String((uint64_t)gcode->size()) + "\n");
+    if (!gcode->empty()) sha256.update(&gcode->front(), gcode->size());
   }
 
-  proc.release();
+  return sha256.finalize();
 }
 
 
 void ToolPathTask::interrupt() {
   Task::interrupt();
-  if (!proc.isNull()) try {proc->kill(true);} CATCH_ERROR;
-  if (!logCopier.isNull()) logCopier->stop();
+
+  SmartLock lock(this);
+  for (unsigned i = 0; i < tplProcs.size(); i++)
+    if (!tplProcs[i].isNull()) tplProcs[i]->kill();
+  if (!tplContext.isNull()) tplContext->interrupt();
 }
@@ -28,33 +28,52 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 
-namespace cb {
-  class Subprocess;
-  class Thread;
-}
+namespace GCode {class MachineInterface;}
+namespace tplang {class TPLContext;}
 
 namespace CAMotics {
   class Project;
+  class ToolPathCache;
+  class TPLProcess;
 
   class ToolPathTask : public Task {
     GCode::ToolTable tools;
     GCode::Units units;
+    double maxArcError;
+    bool planTimes;
     std::vector<std::string> files;
     std::string simJSON;
+    bool inProcessTPL;
+
+    typedef std::map<std::string, cb::SmartPointer<std::vector<char> > >
+    contents_t;
+    contents_t contents; ///< Unsaved GCode, by absolute path
 
     unsigned errors;
     cb::SmartPointer<GCode::ToolPath> path;
     cb::SmartPointer<std::vector<char> > gcode;
 
-    cb::SmartPointer<cb::Subprocess> proc;
-    cb::SmartPointer<cb::Thread> logCopier;
+    cb::SmartPointer<ToolPathCache> cache;
+    std::vector<cb::SmartPointer<TPLProcess> > tplProcs; ///< By file
+    cb::SmartPointer<tplang::TPLContext> tplContext;
 
     public:
-    ToolPathTask(const Project &project);
+    ToolPathTask(const Project &project,
+                 const cb::SmartPointer<ToolPathCache> &cache = 0);
     ~ToolPathTask();
 
+    /// Interpret @param data instead of the GCode file @param filename.
+    void setContents(const std::string &filename,
+                     const cb::SmartPointer<std::vector<char> > &data);
+
+    /// Run TPL programs on a Javascript engine in this process, instead of
+    /// in a tplang subprocess whose GCode is then parsed again.
+    void setInProcessTPL(bool inProcessTPL)
+    {this->inProcessTPL = inProcessTPL;}
+
     unsigned getErrorCount() const {return errors;}
     const cb::SmartPointer<GCode::ToolPath> &getPath() const {return path;}
     const cb::SmartPointer<std::vector<char> > &getGCode() const {return gcode;}
@@ -62,5 +81,15 @@ namespace CAMotics {
     // From Task
     void run();
     void interrupt();
+
+  protected:
+    void runTPL(const std::string &filename, GCode::MachineInterface &machine);
+    /// @return true if the GCode of @param filename was loaded.
+    bool load(const std::string &filename);
+    /// @return false if the inputs are not all known before running.
+    bool isCacheable() const;
+    /// @return a hash of the inputs or empty if the path cannot be cached.
+    /// Also loads the GCode of the last file.
+    std::string computeKey();
   };
 }
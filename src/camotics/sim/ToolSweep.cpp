@@ -24,29 +24,131 @@
 #include "ConicSweep.h"
 #include "CompositeSweep.h"
 #include "SpheroidSweep.h"
+#include "ProfileSweep.h"
+#include "AABBTree.h"
+#include "OctTree.h"
+#include "LinearBVH.h"
+
+#include <camotics/Task.h>
+#include <camotics/Trace.h>
+#include <camotics/contour/FieldStats.h>
 
 #include <gcode/ToolTable.h>
 
 #include <cbang/log/Logger.h>
+#include <cbang/os/Thread.h>
 #include <cbang/time/TimeInterval.h>
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <cmath>
 
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
 
 
+namespace {
+  // Below this many moves per thread box generation is not worth a thread
+  const unsigned minMovesPerJob = 10000;
+
+  // Below this many point move pairs a device launch costs more than it saves
+  const unsigned minDeviceHits = 1 << 14;
+}
+
+
+class ToolSweep::BoxJob : public Thread {
+  const ToolSweep &sweep;
+  int firstMove;
+  int lastMove;
+  boxes_t boxes;
+  exception_ptr error;
+
+public:
+  BoxJob(const ToolSweep &sweep, int firstMove, int lastMove) :
+    sweep(sweep), firstMove(firstMove), lastMove(lastMove) {}
+
+  /// Rethrows what run() caught, so no moves are silently missing
+  const boxes_t &getBoxes() const {
+    if (error) rethrow_exception(error);
+    return boxes;
+  }
+
+  // From Thread
+  void run() {
+    try {
+      CAMOTICS_TRACE("Move boxes");
+      sweep.getBBoxes(firstMove, lastMove, boxes);
+    } catch (...) {error = current_exception();}
+  }
+};
+
+
+class ToolSweep::CutTimeJob : public Thread {
+  ToolSweep &sweep;
+  uint64_t begin;
+  uint64_t end;
+  Task *task;
+  exception_ptr error;
+
+public:
+  CutTimeJob(ToolSweep &sweep, uint64_t begin, uint64_t end, Task *task) :
+    sweep(sweep), begin(begin), end(end), task(task) {}
+
+
+  /// Rethrows what run() caught, after join()
+  void check() const {if (error) rethrow_exception(error);}
+
+
+  void compute() {
+    const Grid &grid = sweep.cutGrid;
+    const cb::Vector3D &offset = grid.getOffset();
+    const double res = grid.getResolution();
+    const uint64_t nx = grid.getSteps().x() + 1;
+    const uint64_t ny = grid.getSteps().y() + 1;
+
+    for (uint64_t i = begin; i < end; i++) {
+      if (task && !(i & 4095)) {
+        if (task->shouldQuit()) return;
+        task->setProgress((double)(i - begin) / (end - begin));
+      }
+
+      cb::Vector3D p(offset.x() + i % nx * res, offset.y() + i / nx % ny * res,
+                     offset.z() + i / (nx * ny) * res);
+      sweep.cutTimes[i] = sweep.findCutTime(p);
+    }
+  }
+
+
+  // From Thread
+  void run() {
+    try {
+      compute();
+    } catch (...) {error = current_exception();}
+  }
+};
+
+
+namespace {
+  atomic<uint64_t> serials(0);
+}
+
+
 ToolSweep::ToolSweep(const SmartPointer<GCode::ToolPath> &path, double startTime,
-                     double endTime) :
-  path(path), startTime(startTime), endTime(endTime) {
+                     double endTime, LookupMode mode, unsigned threads) :
+  path(path), mode(mode), startTime(startTime), endTime(endTime),
+  firstSegment(0),
+  serial(++serials), precision(0), blockSize(0) {
 
   if (endTime < startTime) {
     swap(startTime, endTime);
     swap(this->startTime, this->endTime);
   }
 
-  unsigned boxes = 0;
+  if (!threads) threads = 1;
+
+  boxes_t boxes;
 
   if (!path->empty()) {
     int firstMove = path->find(startTime);
@@ -62,10 +164,11 @@ ToolSweep::ToolSweep(const SmartPointer<GCode::ToolPath> &path, double startTime
               << TimeInterval(duration));
     LOG_DEBUG(1, "GCode::Moves: first=" << firstMove << " last=" << lastMove);
 
-    GCode::ToolTable &tools = path->getTools();
-    vector<cb::Rectangle3D> bboxes;
+    firstSegment = firstMove;
+    if (firstMove <= lastMove) segments.resize(lastMove - firstMove + 1);
+    clip();
 
-    // Gather nodes in a list
+    // Create sweeps
     for (int i = firstMove; i <= lastMove; i++) {
       const GCode::Move &move = path->at(i);
       int tool = move.getTool();
@@ -74,24 +177,150 @@ ToolSweep::ToolSweep(const SmartPointer<GCode::ToolPath> &path, double startTime
 
       if (sweeps.size() <= (unsigned)tool) sweeps.resize(tool + 1);
       if (sweeps[tool].isNull())
-        sweeps[tool] = getSweep(tools.get(tool));
+        sweeps[tool] = getSweep(*path->getTool(move));
+    }
 
-      cb::Vector3D startPt = move.getPtAtTime(startTime);
-      cb::Vector3D endPt = move.getPtAtTime(endTime);
+    // Gather boxes, in parallel if there are enough moves
+    unsigned moves = firstMove <= lastMove ? lastMove - firstMove + 1 : 0;
+    unsigned jobCount = min(threads, moves / minMovesPerJob);
 
-      sweeps[tool]->getBBoxes(startPt, endPt, bboxes);
+    if (jobCount < 2) {
+      CAMOTICS_TRACE("Move boxes");
+      getBBoxes(firstMove, lastMove, boxes);
+    }
 
-      for (unsigned j = 0; j < bboxes.size(); j++)
-        insert(&move, bboxes[j]);
+    else {
+      vector<SmartPointer<BoxJob> > jobs;
+
+      for (unsigned i = 0; i < jobCount; i++) {
+        int first = firstMove + (uint64_t)moves * i / jobCount;
+        int last = firstMove + (uint64_t)moves * (i + 1) / jobCount - 1;
+
+        jobs.push_back(new BoxJob(*this, first, last));
+        jobs.back()->start();
+      }
 
-      boxes += bboxes.size();
-      bboxes.clear();
+      // All jobs are joined before any error is rethrown
+      for (unsigned i = 0; i < jobs.size(); i++) jobs[i]->join();
+
+      // In order so boxes stay in path order
+      for (unsigned i = 0; i < jobs.size(); i++) {
+        const boxes_t &jobBoxes = jobs[i]->getBoxes();
+        boxes.insert(boxes.end(), jobBoxes.begin(), jobBoxes.end());
+      }
     }
   }
 
-  finalize(); // Finalize MoveLookup
+  // Bounds
+  cb::Rectangle3D bounds;
+  for (unsigned i = 0; i < boxes.size(); i++) bounds.add(boxes[i].second);
+
+  // Build MoveLookup
+  CAMOTICS_TRACE("Build move lookup");
+  CAMOTICS_TRACE_COUNT("Move boxes", boxes.size());
+  if (mode == LookupMode::LOOKUP_AUTO) mode = chooseLookup(boxes, bounds);
+  this->mode = mode;
+  lookup = createLookup(mode, bounds, boxes.size(), threads);
+
+  for (unsigned i = 0; i < boxes.size(); i++)
+    insert(boxes[i].first, boxes[i].second);
 
-  LOG_DEBUG(1, "AABBTree boxes=" << boxes << " height=" << getHeight());
+  finalize();
+
+  LOG_DEBUG(1, "MoveLookup " << mode << " boxes=" << boxes.size());
+}
+
+
+
+SmartPointer<ToolSweep> ToolSweep::replicate(unsigned threads) const {
+  CAMOTICS_TRACE("Replicate sweep");
+
+  SmartPointer<GCode::ToolPath> copy = new GCode::ToolPath(path->getTools());
+  for (unsigned i = 0; i < path->size(); i++) {
+    GCode::Move move = path->at(i);
+    copy->move(move);
+  }
+
+  SmartPointer<ToolSweep> sweep =
+    new ToolSweep(copy, startTime, endTime, mode, threads);
+
+  sweep->setBlockSize(blockSize);
+  sweep->precision = precision;
+  sweep->change = change;
+  sweep->device = device;
+  sweep->cutGrid = cutGrid;
+  sweep->cutTimes = cutTimes;
+
+  return sweep;
+}
+
+void ToolSweep::setStartTime(double startTime) {
+  if (this->startTime == startTime) return;
+  this->startTime = startTime;
+  for (unsigned i = 0; i < blocks.size(); i++) blocks[i] = BLOCK_UNKNOWN;
+  clip();
+}
+
+
+void ToolSweep::setEndTime(double endTime) {
+  if (this->endTime == endTime) return;
+  this->endTime = endTime;
+  for (unsigned i = 0; i < blocks.size(); i++) blocks[i] = BLOCK_UNKNOWN;
+  clip();
+}
+
+
+void ToolSweep::clip() {
+  for (unsigned i = 0; i < segments.size(); i++) {
+    const GCode::Move &move = path->at(firstSegment + i);
+    Segment &segment = segments[i];
+
+    segment.a = move.getPtAtTime(startTime);
+    segment.b = move.getPtAtTime(endTime);
+    segment.dx = segment.b.x() - segment.a.x();
+    segment.dy = segment.b.y() - segment.a.y();
+
+    double length2 = segment.dx * segment.dx + segment.dy * segment.dy;
+    segment.invLength2 = length2 ? 1 / length2 : 0;
+  }
+}
+
+
+uint64_t ToolSweep::getMemoryUsage() const {
+  return sizeof(ToolSweep) + lookup->getMemoryUsage() +
+    segments.capacity() * sizeof(Segment) + blocks.size() +
+    cutTimes.capacity() * sizeof(float) +
+    (change.isNull() ? 0 : change->getMemoryUsage());
+}
+
+
+void ToolSweep::setBlockSize(double size) {
+  blockSize = 0;
+  vector<atomic<uint32_t> >().swap(blocks);
+
+  cb::Rectangle3D bounds = getBounds();
+  if (size <= 0 || !bounds.getVolume()) return;
+
+  // Keep the grid to a few MiB by coarsening it
+  const uint64_t maxBlocks = 1 << 20;
+  cb::Vector3D dims = bounds.getDimensions();
+
+  while (true) {
+    uint64_t count = 1;
+    for (unsigned i = 0; i < 3; i++)
+      count *= (uint64_t)ceil(dims[i] / size);
+
+    if (count <= maxBlocks) break;
+    size *= 2;
+  }
+
+  blockSize = size;
+  blockOrigin = bounds.getMin();
+  for (unsigned i = 0; i < 3; i++) blockSteps[i] = ceil(dims[i] / size);
+
+  vector<atomic<uint32_t> >
+    (blockSteps.x() * blockSteps.y() * blockSteps.z()).swap(blocks);
+  for (unsigned i = 0; i < blocks.size(); i++) blocks[i] = BLOCK_UNKNOWN;
 }
 
 
@@ -101,21 +330,436 @@ bool ToolSweep::cull(const cb::Rectangle3D &r) const {
 }
 
 
+int ToolSweep::classify(const cb::Rectangle3D &r) const {
+  // No move reaches it or one move sweeps all of it
+  if (!intersects(r)) return -1;
+  return coveringMove(r) ? 1 : 0;
+}
+
+
 namespace {
-  struct move_sort {
-    bool operator()(const GCode::Move *a, const GCode::Move *b) const {
-      return a->getStartTime() < b->getStartTime();
+  // Put candidate moves in time order and drop duplicates.  The path stores
+  // its moves in time order, so their offsets from @param first are marked
+  // in a bitset and read back in order instead of sorting.  Only candidates
+  // spread far apart in time, where the bitset would be mostly empty words,
+  // are sorted.
+  void timeOrder(const GCode::Move *first,
+                 vector<const GCode::Move *> &moves) {
+    if (moves.size() < 2) return;
+
+    unsigned lo = ~0U, hi = 0;
+    for (unsigned i = 0; i < moves.size(); i++) {
+      unsigned offset = moves[i] - first;
+      lo = min(lo, offset);
+      hi = max(hi, offset);
+    }
+
+    unsigned base = lo / 64;
+    unsigned words = hi / 64 - base + 1;
+
+    if (4 * moves.size() < words) {
+      sort(moves.begin(), moves.end());
+      moves.erase(unique(moves.begin(), moves.end()), moves.end());
+      return;
+    }
+
+    // Words are left cleared after reading so they need no reset
+    static thread_local vector<uint64_t> bits;
+    if (bits.size() < words) bits.resize(words);
+
+    for (unsigned i = 0; i < moves.size(); i++) {
+      unsigned offset = moves[i] - first - base * 64;
+      bits[offset / 64] |= (uint64_t)1 << (offset % 64);
+    }
+
+    moves.clear();
+
+    for (unsigned i = 0; i < words; i++) {
+      uint64_t word = bits[i];
+      bits[i] = 0;
+
+      for (unsigned j = 0; word; j++, word >>= 1)
+        if (word & 1) moves.push_back(first + (base + i) * 64 + j);
     }
+  }
+
+
+  // Every tool is round about z so it can only cut points within its
+  // radius, in XY, of a straight move.  Far cheaper than the sweep's depth
+  // and it rejects most of what the move's boxes let through.
+  inline bool inReach(const cb::Vector3D &a, double ABx, double ABy,
+                      double invLength2, const cb::Vector3D &p,
+                      double radius) {
+    const double APx = p.x() - a.x(), APy = p.y() - a.y();
+
+    double t = (APx * ABx + APy * ABy) * invLength2;
+    t = t < 0 ? 0 : (1 < t ? 1 : t);
+
+    const double dx = APx - t * ABx, dy = APy - t * ABy;
+    const double reach = radius * (1 + 1e-9) + 1e-9; // Rounding margin
+
+    return dx * dx + dy * dy <= reach * reach;
+  }
+
+
+  inline bool inReach(const cb::Vector3D &a, const cb::Vector3D &b,
+                      const cb::Vector3D &p, double radius) {
+    const double ABx = b.x() - a.x(), ABy = b.y() - a.y();
+    const double length2 = ABx * ABx + ABy * ABy;
+    return inReach(a, ABx, ABy, length2 ? 1 / length2 : 0, p, radius);
+  }
+
+
+  // The candidate moves of the segment being searched by this thread
+  thread_local vector<const GCode::Move *> segmentMoves;
+
+
+  // The boxes found around an earlier segment, reused while the segments
+  // searched next by this thread stay inside the same bounds
+  struct SegmentTile {
+    uint64_t serial;
+    cb::Rectangle3D bounds;
+    MoveLookup::boxes_t boxes;
+
+    SegmentTile() : serial(0) {}
   };
+
+  thread_local SegmentTile segmentTile;
+}
+
+
+bool ToolSweep::inRemovedBlock(const cb::Vector3D &p, double &depth) const {
+  if (blocks.empty()) return false;
+
+  unsigned c[3];
+  for (unsigned i = 0; i < 3; i++) {
+    double x = floor((p[i] - blockOrigin[i]) / blockSize);
+    if (x < 0 || blockSteps[i] <= x) return false;
+    c[i] = x;
+  }
+
+  atomic<uint32_t> &block =
+    blocks[(c[0] * blockSteps.y() + c[1]) * blockSteps.z() + c[2]];
+  cb::Rectangle3D box(blockOrigin + cb::Vector3D(c[0], c[1], c[2]) * blockSize,
+                      blockOrigin + cb::Vector3D(c[0] + 1, c[1] + 1, c[2] + 1) *
+                      blockSize);
+
+  // Threads reaching a new block together classify it alike
+  uint32_t state = block.load(memory_order_relaxed);
+  if (state == BLOCK_UNKNOWN) {
+    const GCode::Move *move = coveringMove(box);
+    state = move ? BLOCK_REMOVED + (move - &path->at(0)) : BLOCK_KEPT;
+    block.store(state, memory_order_relaxed);
+  }
+
+  if (state < BLOCK_REMOVED) return false;
+
+  // The distance to the block's faces is only a lower bound, so interpolated
+  // crossings need the depth in the move's sweep
+  const GCode::Move &move = path->at(state - BLOCK_REMOVED);
+  const Segment &segment = getSegment(move);
+  depth = sweeps[move.getTool()]->depth(segment.a, segment.b, p);
+
+  FieldStats::local().removed++;
+
+  return true;
+}
+
+
+const GCode::Move *
+ToolSweep::coveringMove(const cb::Rectangle3D &box) const {
+  // A straight sweep of a convex tool is convex, so it holds the whole
+  // block if it holds the block's corners.  Every corner's candidates
+  // include the move, so the first corner's are enough to search.
+  static thread_local vector<const GCode::Move *> moves;
+  moves.clear();
+  collisions(box.getMin(), moves);
+
+  FieldStats::local().lookups++;
+
+  for (unsigned i = 0; i < moves.size(); i++) {
+    const GCode::Move &move = *moves[i];
+
+    if (move.isArc() || move.getEndTime() < startTime ||
+        endTime < move.getStartTime()) continue;
+
+    const Sweep &sweep = *sweeps[move.getTool()];
+    if (!sweep.isConvex()) continue;
+
+    const Segment &segment = getSegment(move);
+    const cb::Vector3D &a = segment.a;
+    const cb::Vector3D &b = segment.b;
+
+    bool inside = true;
+    for (unsigned j = 0; j < 8 && inside; j++) {
+      cb::Vector3D corner((j & 1 ? box.getMax() : box.getMin()).x(),
+                          (j & 2 ? box.getMax() : box.getMin()).y(),
+                          (j & 4 ? box.getMax() : box.getMin()).z());
+      inside = 0 <= sweep.depth(a, b, corner);
+    }
+
+    if (inside) return &move;
+  }
+
+  return 0;
 }
 
 
 double ToolSweep::depth(const cb::Vector3D &p) const {
-  vector<const GCode::Move *> moves;
+  if (hasCutTimes()) return cutTimeDepth(p);
+
+  double removed;
+  if (inRemovedBlock(p, removed)) return removed;
+
+  // Reuse a per thread buffer so render threads do not allocate per vertex
+  static thread_local vector<const GCode::Move *> moves;
+  moves.clear();
   collisions(p, moves);
 
+  FieldStats::local().lookups++;
+
   // Eariler moves first
-  sort(moves.begin(), moves.end(), move_sort());
+  if (!moves.empty()) timeOrder(&path->at(0), moves);
+
+  return depth(p, moves);
+}
+
+
+double ToolSweep::depthBefore(const cb::Vector3D &p, double time) const {
+  // Removed blocks may have been cut later, so always search the moves
+  static thread_local vector<const GCode::Move *> moves;
+  moves.clear();
+  collisions(p, moves);
+
+  FieldStats::local().lookups++;
+
+  if (!moves.empty()) timeOrder(&path->at(0), moves);
+
+  return depth(p, moves, startTime, min(time, endTime));
+}
+
+
+void ToolSweep::computeCutTimes(const Grid &grid, unsigned threads,
+                                Task *task) {
+  CAMOTICS_TRACE("Cut times");
+
+  cutGrid = grid;
+  const cb::Vector3U &steps = grid.getSteps();
+  uint64_t count =
+    (uint64_t)(steps.x() + 1) * (steps.y() + 1) * (steps.z() + 1);
+  cutTimes.assign(count, 0);
+
+  if (task) task->update(0, "Finding cut times");
+  if (!threads) threads = 1;
+
+  // Only the first job, run here, reports progress
+  vector<SmartPointer<CutTimeJob> > jobs;
+  for (unsigned i = 0; i < threads; i++)
+    jobs.push_back(new CutTimeJob(*this, count * i / threads,
+                                  count * (i + 1) / threads,
+                                  i ? 0 : task));
+
+  try {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->start();
+    jobs[0]->compute();
+
+  } catch (...) {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+    vector<float>().swap(cutTimes);
+    throw;
+  }
+
+  for (unsigned i = 1; i < threads; i++) jobs[i]->join();
+
+  try {
+    for (unsigned i = 1; i < threads; i++) jobs[i]->check();
+  } catch (...) {
+    vector<float>().swap(cutTimes);
+    throw;
+  }
+
+  // An incomplete table would show uncut stock as cut
+  if (task && task->shouldQuit()) vector<float>().swap(cutTimes);
+}
+
+
+float ToolSweep::findCutTime(const cb::Vector3D &p) const {
+  static thread_local vector<const GCode::Move *> moves;
+  moves.clear();
+  collisions(p, moves);
+
+  if (!moves.empty()) timeOrder(&path->at(0), moves);
+
+  // Moves do not overlap in time so the first to reach p cuts it first
+  for (unsigned i = 0; i < moves.size(); i++) {
+    const GCode::Move &move = *moves[i];
+    if (move.getEndTime() < startTime) continue;
+
+    const Sweep &sweep = *sweeps[move.getTool()];
+    double begin = max(startTime, move.getStartTime());
+    double lo = begin;
+    double hi = move.getEndTime();
+
+    if (move.isArc()) {
+      if (sweep.arcDepth(move, begin, hi, p) < 0) continue;
+    } else if (sweep.depth(move.getPtAtTime(begin), move.getEndPt(), p) < 0)
+      continue;
+
+    // Bisect for when the tool reaches p
+    cb::Vector3D a = move.getPtAtTime(begin);
+    for (unsigned j = 0; j < 16; j++) {
+      double t = (lo + hi) / 2;
+      double d = move.isArc() ? sweep.arcDepth(move, begin, t, p) :
+        sweep.depth(a, move.getPtAtTime(t), p);
+
+      if (0 <= d) hi = t;
+      else lo = t;
+    }
+
+    return hi;
+  }
+
+  return numeric_limits<float>::infinity();
+}
+
+
+double ToolSweep::cutTimeDepth(const cb::Vector3D &p) const {
+  // The time since each vertex was cut, uncut vertices a second short
+  double last = path->empty() ? 0 : path->getTime();
+  double time = min(endTime, last);
+  double never = last + 1;
+
+  const cb::Vector3U &steps = cutGrid.getSteps();
+  const double res = cutGrid.getResolution();
+  const cb::Vector3D &offset = cutGrid.getOffset();
+
+  unsigned i0[3];
+  double f[3];
+  for (unsigned a = 0; a < 3; a++) {
+    double u = (p[a] - offset[a]) / res;
+    u = u < 0 ? 0 : (steps[a] < u ? steps[a] : u);
+    i0[a] = u;
+    f[a] = u - i0[a];
+  }
+
+  const uint64_t nx = steps.x() + 1;
+  const uint64_t nxy = nx * (steps.y() + 1);
+  double depth = 0;
+
+  // Trilinear interpolation between the cell's corners
+  for (unsigned c = 0; c < 8; c++) {
+    unsigned v[3];
+    double w = 1;
+
+    for (unsigned a = 0; a < 3; a++) {
+      bool upper = c & (1 << a);
+      v[a] = min(i0[a] + upper, steps[a]);
+      w *= upper ? f[a] : 1 - f[a];
+    }
+
+    if (!w) continue;
+
+    double t = cutTimes[v[0] + v[1] * nx + v[2] * nxy];
+    depth += w * (time - min(t, never));
+  }
+
+  return depth;
+}
+
+
+void ToolSweep::beginSegment(const cb::Vector3D &a,
+                             const cb::Vector3D &b) const {
+  if (hasCutTimes()) return;
+
+  // Neighbouring segments share their candidates, so search around them
+  SegmentTile &tile = segmentTile;
+
+  if (tile.serial != serial || !tile.bounds.contains(a) ||
+      !tile.bounds.contains(b)) {
+    tile.serial = serial;
+    tile.bounds =
+      cb::Rectangle3D(a, a).add(b).grow(TILE_SEGMENTS * a.distance(b));
+    tile.boxes.clear();
+    collisions(tile.bounds, tile.boxes);
+
+    FieldStats::local().lookups++;
+  }
+
+  // A move whose box holds neither end could only change the depth inside
+  // the segment if the box were shorter than it, and moves are at least as
+  // wide as their tool, much more than a grid cell
+  vector<const GCode::Move *> &moves = segmentMoves;
+  moves.clear();
+
+  for (unsigned i = 0; i < tile.boxes.size(); i++) {
+    const cb::Rectangle3D &box = tile.boxes[i].second;
+    if (box.contains(a) || box.contains(b))
+      moves.push_back(tile.boxes[i].first);
+  }
+
+  if (!moves.empty()) timeOrder(&path->at(0), moves);
+}
+
+
+double ToolSweep::segmentDepth(const cb::Vector3D &p) const {
+  if (hasCutTimes()) return cutTimeDepth(p);
+
+  double removed;
+  if (inRemovedBlock(p, removed)) return removed;
+  return depth(p, segmentMoves);
+}
+
+
+cb::Vector3D ToolSweep::segmentNormal(const cb::Vector3D &p) const {
+  // Cut times keep no moves, the normal comes from the depth gradient
+  if (hasCutTimes()) return cb::Vector3D();
+
+  // At the surface the deepest move is the one that cut it
+  const GCode::Move *deepest = 0;
+  double d2 = -numeric_limits<double>::max();
+
+  for (unsigned i = 0; i < segmentMoves.size(); i++) {
+    const GCode::Move &move = *segmentMoves[i];
+
+    if (move.getEndTime() < startTime || endTime < move.getStartTime())
+      continue;
+
+    const Sweep &sweep = *sweeps[move.getTool()];
+    double sd2;
+
+    if (move.isArc()) sd2 = sweep.arcDepth(move, startTime, endTime, p);
+    else {
+      const Segment &segment = getSegment(move);
+      sd2 = sweep.depth(segment.a, segment.b, p);
+    }
+
+    if (d2 < sd2) {
+      d2 = sd2;
+      deepest = &move;
+    }
+  }
+
+  if (!deepest) return cb::Vector3D();
+
+  const Sweep &sweep = *sweeps[deepest->getTool()];
+  if (deepest->isArc())
+    return sweep.arcNormal(*deepest, startTime, endTime, p);
+
+  const Segment &segment = getSegment(*deepest);
+  return sweep.normal(segment.a, segment.b, p);
+}
+
+
+double ToolSweep::depth(const cb::Vector3D &p,
+                        const vector<const GCode::Move *> &moves,
+                        double startTime, double endTime) const {
+  // Only the run's own window is clipped in advance
+  const bool clipped =
+    startTime == this->startTime && endTime == this->endTime;
+
+  FieldStats &stats = FieldStats::local();
+  stats.depthCalls++;
+  stats.candidates += moves.size();
 
   double d2 = -numeric_limits<double>::max();
 
@@ -125,11 +769,38 @@ double ToolSweep::depth(const cb::Vector3D &p) const {
     if (move.getEndTime() < startTime || endTime < move.getStartTime())
       continue;
 
-    cb::Vector3D startPt = move.getPtAtTime(startTime);
-    cb::Vector3D endPt = move.getPtAtTime(endTime);
+    const Sweep &sweep = *sweeps[move.getTool()];
+    double sd2;
+
+    if (move.isArc()) sd2 = sweep.arcDepth(move, startTime, endTime, p);
+
+    else if (clipped) {
+      const Segment &segment = getSegment(move);
+
+      if (!inReach(segment.a, segment.dx, segment.dy, segment.invLength2, p,
+                   sweep.getRadius())) {
+        stats.rejected++;
+        continue;
+      }
+
+      sd2 = sweep.depth(segment.a, segment.b, p);
+
+    } else {
+      cb::Vector3D a = move.getPtAtTime(startTime);
+      cb::Vector3D b = move.getPtAtTime(endTime);
+
+      if (!inReach(a, b, p, sweep.getRadius())) {
+        stats.rejected++;
+        continue;
+      }
 
-    double sd2 = sweeps[move.getTool()]->depth(startPt, endPt, p);
-    if (0 <= sd2) return sd2; // Approx 5% faster
+      sd2 = sweep.depth(a, b, p);
+    }
+
+    if (0 <= sd2) { // Approx 5% faster
+      stats.earlyExits += moves.size() - i - 1;
+      return sd2;
+    }
     if (d2 < sd2) d2 = sd2;
   }
 
@@ -137,6 +808,209 @@ double ToolSweep::depth(const cb::Vector3D &p) const {
 }
 
 
+namespace {
+  struct hit_sort {
+    typedef pair<const GCode::Move *, unsigned> hit_t;
+
+    bool operator()(const hit_t &a, const hit_t &b) const {
+      double aTime = a.first->getStartTime();
+      double bTime = b.first->getStartTime();
+      if (aTime != bTime) return aTime < bTime;
+      if (a.first != b.first) return a.first < b.first;
+      return a.second < b.second;
+    }
+  };
+}
+
+
+void ToolSweep::depth(const vector<cb::Vector3D> &points,
+                      vector<double> &depths) const {
+  if (hasCutTimes()) {
+    depths.resize(points.size());
+    for (unsigned i = 0; i < points.size(); i++)
+      depths[i] = cutTimeDepth(points[i]);
+    return;
+  }
+
+  depths.assign(points.size(), -numeric_limits<double>::max());
+
+  // Pair every point with its candidate moves then group by move, earlier
+  // moves first, so each move is evaluated once against all of its points.
+  // Neighbouring points share most candidates, so the lookup is searched
+  // once per tile of points and each point only tests the boxes found.
+  static thread_local boxes_t boxes;
+  static thread_local vector<hit_t> hits;
+  hits.clear();
+
+  unsigned tiles = 0;
+
+  for (unsigned first = 0; first < points.size(); first += TILE_POINTS) {
+    unsigned last = min((unsigned)points.size(), first + TILE_POINTS);
+
+    cb::Rectangle3D bounds;
+    for (unsigned i = first; i < last; i++) bounds.add(points[i]);
+
+    boxes.clear();
+    collisions(bounds, boxes);
+    tiles++;
+
+    for (unsigned i = first; i < last; i++) {
+      if (inRemovedBlock(points[i], depths[i])) continue;
+
+      for (unsigned j = 0; j < boxes.size(); j++)
+        if (boxes[j].second.contains(points[i]))
+          hits.push_back(hit_t(boxes[j].first, i));
+    }
+  }
+
+  FieldStats &stats = FieldStats::local();
+  stats.depthCalls += points.size();
+  stats.lookups += tiles;
+  stats.candidates += hits.size();
+
+  if (!device.isNull() && minDeviceHits <= hits.size()) {
+    deviceDepth(points, hits, depths);
+    return;
+  }
+
+  sort(hits.begin(), hits.end(), hit_sort());
+
+  static thread_local vector<double> xs, ys, zs, out;
+  static thread_local vector<float> xf, yf, zf, outf;
+  static thread_local vector<unsigned> index;
+
+  // Largest offset from a move's start whose float rounding is fine
+  const double maxOffset = precision / (4 * numeric_limits<float>::epsilon());
+
+  for (unsigned i = 0; i < hits.size();) {
+    const GCode::Move &move = *hits[i].first;
+    unsigned j = i;
+
+    while (j < hits.size() && hits[j].first == &move) j++;
+
+    if (move.getEndTime() < startTime || endTime < move.getStartTime()) {
+      i = j;
+      continue;
+    }
+
+    // Gather points not already inside an earlier move, for straight moves
+    // as floats relative to the move's start
+    xs.clear(); ys.clear(); zs.clear(); index.clear();
+    xf.clear(); yf.clear(); zf.clear();
+
+    const Sweep &sweep = *sweeps[move.getTool()];
+    const bool arc = move.isArc();
+    const Segment &segment = getSegment(move);
+    const cb::Vector3D &a = segment.a;
+    const cb::Vector3D &b = segment.b;
+
+    bool single = !arc && maxOffset && a.distance(b) < maxOffset;
+
+    for (; i < j; i++) {
+      unsigned k = hits[i].second;
+      if (0 <= depths[k]) {
+        stats.earlyExits++;
+        continue;
+      }
+
+      const cb::Vector3D &p = points[k];
+      if (!arc && !inReach(a, segment.dx, segment.dy, segment.invLength2, p,
+                           sweep.getRadius())) {
+        stats.rejected++;
+        continue;
+      }
+
+      index.push_back(k);
+
+      if (single) {
+        cb::Vector3D offset = p - a;
+        single = fabs(offset.x()) < maxOffset &&
+          fabs(offset.y()) < maxOffset && fabs(offset.z()) < maxOffset;
+
+        xf.push_back(offset.x());
+        yf.push_back(offset.y());
+        zf.push_back(offset.z());
+      }
+    }
+
+    if (index.empty()) continue;
+
+    if (single) {
+      outf.resize(index.size());
+      sweep.depth(cb::Vector3D(), b - a, &xf[0], &yf[0], &zf[0],
+                  index.size(), &outf[0]);
+
+      for (unsigned k = 0; k < index.size(); k++)
+        if (depths[index[k]] < outf[k]) depths[index[k]] = outf[k];
+
+      continue;
+    }
+
+    // Arcs, and points too far from the move's start for floats
+    out.resize(index.size());
+
+    if (arc)
+      for (unsigned k = 0; k < index.size(); k++)
+        out[k] = sweep.arcDepth(move, startTime, endTime, points[index[k]]);
+
+    else {
+      for (unsigned k = 0; k < index.size(); k++) {
+        const cb::Vector3D &p = points[index[k]];
+        xs.push_back(p.x());
+        ys.push_back(p.y());
+        zs.push_back(p.z());
+      }
+
+      sweep.depth(a, b, &xs[0], &ys[0], &zs[0], index.size(), &out[0]);
+    }
+
+    for (unsigned k = 0; k < index.size(); k++)
+      if (depths[index[k]] < out[k]) depths[index[k]] = out[k];
+  }
+}
+
+
+void ToolSweep::deviceDepth(const vector<cb::Vector3D> &points,
+                            const vector<hit_t> &hits,
+                            vector<double> &depths) const {
+  static thread_local vector<OpenCLSweep::hit_t> deviceHits;
+  static thread_local vector<char> cut;
+  deviceHits.clear();
+
+  const GCode::Move *first = &path->at(0);
+
+  for (unsigned i = 0; i < hits.size(); i++) {
+    const GCode::Move &move = *hits[i].first;
+
+    if (move.getEndTime() < startTime || endTime < move.getStartTime())
+      continue;
+
+    unsigned k = hits[i].second;
+    depths[k] = -1; // The device only reports whether points are cut
+
+    // The device only sweeps straight moves
+    if (!move.isArc())
+      deviceHits.push_back(OpenCLSweep::hit_t(&move - first, k));
+  }
+
+  device->cut(startTime, endTime, points, deviceHits, cut);
+
+  for (unsigned i = 0; i < cut.size(); i++)
+    if (cut[i]) depths[i] = 1;
+
+  for (unsigned i = 0; i < hits.size(); i++) {
+    const GCode::Move &move = *hits[i].first;
+    unsigned k = hits[i].second;
+
+    if (!move.isArc() || 0 <= depths[k] || move.getEndTime() < startTime ||
+        endTime < move.getStartTime()) continue;
+
+    depths[k] = sweeps[move.getTool()]->arcDepth(move, startTime, endTime,
+                                                 points[k]);
+  }
+}
+
+
 SmartPointer<Sweep> ToolSweep::getSweep(const GCode::Tool &tool) {
   switch (tool.getShape()) {
   case GCode::ToolShape::TS_CYLINDRICAL:
@@ -160,7 +1034,86 @@ SmartPointer<Sweep> ToolSweep::getSweep(const GCode::Tool &tool) {
   case GCode::ToolShape::TS_SNUBNOSE:
     return new ConicSweep(tool.getLength(), tool.getRadius(),
                           tool.getSnubDiameter() / 2);
+
+  case GCode::ToolShape::TS_PROFILE: return new ProfileSweep(tool.getProfile());
   }
 
   THROWS("Invalid tool shape " << tool.getShape());
 }
+
+
+LookupMode ToolSweep::chooseLookup(const boxes_t &boxes,
+                                   const cb::Rectangle3D &bounds) {
+  // Building is most of the cost of a short path
+  if (boxes.size() < 1024) return LookupMode::LOOKUP_AABB_TREE;
+
+  double volume = bounds.getVolume();
+  if (!volume) return LookupMode::LOOKUP_AABB_TREE;
+
+  // How many boxes cover an average point in the bounds
+  double covered = 0;
+  for (unsigned i = 0; i < boxes.size(); i++)
+    covered += boxes[i].second.getVolume();
+
+  return covered < volume ?
+    LookupMode::LOOKUP_OCT_TREE : LookupMode::LOOKUP_LINEAR_BVH;
+}
+
+
+SmartPointer<MoveLookup> ToolSweep::createLookup(LookupMode mode,
+                                                 const cb::Rectangle3D &bounds,
+                                                 unsigned count,
+                                                 unsigned threads) {
+  switch (mode) {
+  case LookupMode::LOOKUP_AABB_TREE: return new AABBTree(threads);
+
+  case LookupMode::LOOKUP_OCT_TREE: {
+    // Aim for a handful of boxes per leaf
+    unsigned depth = count < 8 ? 1 : ceil(log((double)count) / log(8.0));
+    if (10 < depth) depth = 10;
+    return new OctTree(bounds, depth);
+  }
+
+  case LookupMode::LOOKUP_LINEAR_BVH: return new LinearBVH;
+  case LookupMode::LOOKUP_AUTO: break;
+  }
+
+  THROWS("Invalid move lookup mode " << mode);
+}
+
+
+void ToolSweep::getBBoxes(int firstMove, int lastMove, boxes_t &boxes) const {
+  vector<cb::Rectangle3D> bboxes;
+
+  for (int i = firstMove; i <= lastMove; i++) {
+    const GCode::Move &move = path->at(i);
+    int tool = move.getTool();
+
+    if (tool < 0) continue;
+
+    if (move.isArc()) {
+      // Pieces of at most an eighth of a turn grown by their bulge
+      double u0 = move.getFractionAtTime(startTime);
+      double u1 = move.getFractionAtTime(endTime);
+      double angle = fabs(move.getAngle()) * (u1 - u0);
+      unsigned pieces = ceil(angle / (M_PI / 4));
+      if (!pieces) pieces = 1;
+      double bulge = move.getRadius() * (1 - cos(angle / pieces / 2));
+
+      for (unsigned j = 0; j < pieces; j++)
+        sweeps[tool]->getBBoxes(move.getPtAt(u0 + (u1 - u0) * j / pieces),
+                                move.getPtAt(u0 + (u1 - u0) * (j + 1) / pieces),
+                                bboxes);
+
+      for (unsigned j = 0; j < bboxes.size(); j++)
+        bboxes[j] = bboxes[j].grow(cb::Vector3D(bulge, bulge, 0));
+
+    } else sweeps[tool]->getBBoxes(move.getPtAtTime(startTime),
+                                   move.getPtAtTime(endTime), bboxes);
+
+    for (unsigned j = 0; j < bboxes.size(); j++)
+      boxes.push_back(boxes_t::value_type(&move, bboxes[j]));
+
+    bboxes.clear();
+  }
+}
@@ -20,47 +20,188 @@
 
 #pragma once
 
-#include "AABBTree.h"
+#include "MoveLookup.h"
+#include "LookupMode.h"
+#include "OpenCLSweep.h"
+
 #include <gcode/ToolPath.h>
 
+#include <camotics/Grid.h>
 #include <camotics/contour/FieldFunction.h>
 
 #include <cbang/StdTypes.h>
 #include <cbang/SmartPointer.h>
 
 #include <vector>
+#include <utility>
 #include <limits>
+#include <atomic>
 
 
 namespace GCode {class ToolTable;}
 
 namespace CAMotics {
   class Sweep;
+  class Task;
+
+  class ToolSweep : public FieldFunction, public MoveLookup {
+    typedef std::pair<const GCode::Move *, unsigned> hit_t;
+    class BoxJob;
+    class CutTimeJob;
 
-  class ToolSweep : public FieldFunction, public AABBTree {
     cb::SmartPointer<GCode::ToolPath> path;
     std::vector<cb::SmartPointer<Sweep> > sweeps;
+    cb::SmartPointer<MoveLookup> lookup;
+    LookupMode mode;
 
     double startTime;
     double endTime;
 
+    // The moves in the lookup clipped to the start and end times, so
+    // depths need not clip them again for each point
+    struct Segment {
+      cb::Vector3D a;
+      cb::Vector3D b;
+      double dx;         ///< XY direction, from a to b
+      double dy;
+      double invLength2; ///< Of the XY direction or zero if it has none
+    };
+    unsigned firstSegment; ///< Path index of the first segment
+    std::vector<Segment> segments;
+
     cb::SmartPointer<MoveLookup> change;
+    cb::SmartPointer<OpenCLSweep> device;
+
+    uint64_t serial; ///< Identifies this sweep to per thread caches
+    double precision;
+
+    // Blocks found to lie wholly inside one move's sweep, by x then y then
+    // z.  Removed blocks hold BLOCK_REMOVED plus that move's path index.
+    enum {BLOCK_UNKNOWN, BLOCK_KEPT, BLOCK_REMOVED};
+    double blockSize;
+    cb::Vector3D blockOrigin;
+    cb::Vector3U blockSteps;
+    mutable std::vector<std::atomic<uint32_t> > blocks;
+
+    // When each vertex of a grid is first cut, by x then y then z
+    Grid cutGrid;
+    std::vector<float> cutTimes;
 
   public:
-    ToolSweep(const cb::SmartPointer<GCode::ToolPath> &path, double startTime = 0,
-              double endTime = std::numeric_limits<double>::max());
+    /// Points searched together by the batch depth()
+    static const unsigned TILE_POINTS = 64;
+    /// Segment lengths around a segment searched for those that follow it
+    static const unsigned TILE_SEGMENTS = 4;
 
-    void setStartTime(double startTime) {this->startTime = startTime;}
-    void setEndTime(double endTime) {this->endTime = endTime;}
+    ToolSweep(const cb::SmartPointer<GCode::ToolPath> &path, double startTime = 0,
+              double endTime = std::numeric_limits<double>::max(),
+              LookupMode mode = LookupMode::LOOKUP_AABB_TREE,
+              unsigned threads = 1);
+
+    void setStartTime(double startTime);
+    void setEndTime(double endTime);
+
+    /// Remember which blocks about @param size wide lie wholly inside the
+    /// sweep of one move, so later depths in them need no lookup.  Blocks
+    /// are classified when first reached.  Zero turns this off.
+    void setBlockSize(double size);
+
+    /// Find when each vertex of @param grid is first cut, on up to
+    /// @param threads threads.  Depths then come from these times, between
+    /// vertices by interpolation, so the end time can be moved without
+    /// evaluating any moves.
+    void computeCutTimes(const Grid &grid, unsigned threads = 1,
+                         Task *task = 0);
+    bool hasCutTimes() const {return !cutTimes.empty();}
+
+    /// Evaluate batches of points in single precision, relative to each
+    /// move's start, where their rounding error stays below
+    /// @param precision.  Zero always uses double precision.
+    void setPrecision(double precision) {this->precision = precision;}
+
+    /// A copy of this sweep, over a copy of its path, with the same times
+    /// and settings, built on up to @param threads threads.  Memory is
+    /// allocated by the calling thread, so a thread pinned to a NUMA node
+    /// gets a replica local to that node.  The change and device are shared.
+    cb::SmartPointer<ToolSweep> replicate(unsigned threads = 1) const;
 
     const cb::SmartPointer<MoveLookup> &getChange() const {return change;}
     void setChange(const cb::SmartPointer<MoveLookup> &change)
     {this->change = change;}
 
-    // From FieldFunction
+    const cb::SmartPointer<GCode::ToolPath> &getPath() const {return path;}
+    const Sweep &getSweep(const GCode::Move &move) const
+    {return *sweeps[move.getTool()];}
+
+    /// @return the depth of @param p in the sweep of the moves made before
+    /// @param time, within the start and end times.
+    double depthBefore(const cb::Vector3D &p, double time) const;
+
+    /// Evaluate large batches of points on @param device when set
+    void setDevice(const cb::SmartPointer<OpenCLSweep> &device)
+    {this->device = device;}
+
+    // From FieldFunction, with thread_local scratch space as described there
     bool cull(const cb::Rectangle3D &r) const;
+    int classify(const cb::Rectangle3D &r) const;
     double depth(const cb::Vector3D &p) const;
+    void depth(const std::vector<cb::Vector3D> &points,
+               std::vector<double> &depths) const;
+    void beginSegment(const cb::Vector3D &a, const cb::Vector3D &b) const;
+    double segmentDepth(const cb::Vector3D &p) const;
+    cb::Vector3D segmentNormal(const cb::Vector3D &p) const;
+
+    // From MoveLookup
+    cb::Rectangle3D getBounds() const {return lookup->getBounds();}
+    void insert(const GCode::Move *move, const cb::Rectangle3D &bbox)
+    {lookup->insert(move, bbox);}
+    bool intersects(const cb::Rectangle3D &r) const
+    {return lookup->intersects(r);}
+    unsigned intersections(const cb::Rectangle3D &r) const
+    {return lookup->intersections(r);}
+    void collisions(const cb::Vector3D &p,
+                    std::vector<const GCode::Move *> &moves) const
+    {lookup->collisions(p, moves);}
+    void collisions(const cb::Rectangle3D &r, boxes_t &boxes) const
+    {lookup->collisions(r, boxes);}
+    void finalize() {lookup->finalize();}
+    void draw(bool leavesOnly = false) {lookup->draw(leavesOnly);}
+    /// Includes the change, the blocks and the cut times.
+    uint64_t getMemoryUsage() const;
 
     static cb::SmartPointer<Sweep> getSweep(const GCode::Tool &tool);
+    /// Pick a lookup for the path's boxes, an AABBTree for short paths, an
+    /// OctTree when the boxes are small and spread out, as when drilling,
+    /// and a LinearBVH when they pile up, as when finishing.
+    static LookupMode chooseLookup(const boxes_t &boxes,
+                                   const cb::Rectangle3D &bounds);
+    static cb::SmartPointer<MoveLookup>
+    createLookup(LookupMode mode, const cb::Rectangle3D &bounds,
+                 unsigned count, unsigned threads = 1);
+
+  protected:
+    void clip();
+    /// @return the time @param p is first cut or infinity if it is not.
+    float findCutTime(const cb::Vector3D &p) const;
+    double cutTimeDepth(const cb::Vector3D &p) const;
+    const Segment &getSegment(const GCode::Move &move) const
+    {return segments[&move - &path->at(firstSegment)];}
+
+    /// @param moves must be sorted by start time.
+    double depth(const cb::Vector3D &p,
+                 const std::vector<const GCode::Move *> &moves) const
+    {return depth(p, moves, startTime, endTime);}
+    double depth(const cb::Vector3D &p,
+                 const std::vector<const GCode::Move *> &moves,
+                 double startTime, double endTime) const;
+    void getBBoxes(int firstMove, int lastMove, boxes_t &boxes) const;
+    /// True, with the depth in the sweep of the move that removed it, if
+    /// @param p is in a block removed by a single move.
+    bool inRemovedBlock(const cb::Vector3D &p, double &depth) const;
+    /// @return the straight move whose sweep holds all of @param box or 0.
+    const GCode::Move *coveringMove(const cb::Rectangle3D &box) const;
+    void deviceDepth(const std::vector<cb::Vector3D> &points,
+                     const std::vector<hit_t> &hits,
+                     std::vector<double> &depths) const;
   };
 }
@@ -0,0 +1,486 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "TriDexel.h"
+#include "Sweep.h"
+#include "ToolSweep.h"
+
+#include <camotics/Grid.h>
+#include <camotics/Task.h>
+#include <camotics/contour/Edge.h>
+#include <camotics/contour/MarchingCubes.h>
+#include <camotics/contour/TriangleSurface.h>
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+#include <cbang/os/Thread.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <algorithm>
+#include <map>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  // Moves are cut in batches, between which progress is reported
+  const unsigned batchSize = 4096;
+
+  // Halvings of a sample step to find where a ray crosses a sweep
+  const unsigned refinements = 6;
+
+
+  bool isCut(const TriDexel::Cut &cut, const Vector3D &p) {
+    return 0 < cut.sweep->depth(cut.start, cut.end, p);
+  }
+
+
+  // Where the ray through @param p along @param axis crosses the sweep,
+  // between @param a, where it is not in the sweep, and @param b where it is
+  double findCrossing(const TriDexel::Cut &cut, Vector3D p, unsigned axis,
+                      double a, double b) {
+    for (unsigned i = 0; i < refinements; i++) {
+      double mid = (a + b) / 2;
+      p[axis] = mid;
+      if (isCut(cut, p)) b = mid;
+      else a = mid;
+    }
+
+    return (a + b) / 2;
+  }
+
+
+  void addCuts(vector<TriDexel::Cut> &cuts, const Sweep &sweep,
+               const Vector3D &start, const Vector3D &end,
+               const cb::Rectangle3D &bounds, double resolution) {
+    // Diagonal moves are split in to boxes which bound them more tightly
+    vector<cb::Rectangle3D> bboxes;
+    sweep.getBBoxes(start, end, bboxes, resolution / 2);
+
+    for (unsigned i = 0; i < bboxes.size(); i++) {
+      if (!bboxes[i].intersects(bounds)) continue;
+
+      TriDexel::Cut cut = {&sweep, start, end, bboxes[i]};
+      cuts.push_back(cut);
+    }
+  }
+
+
+  class CutJob : public Thread {
+    TriDexel &model;
+    const vector<TriDexel::Cut> &cuts;
+    unsigned axis;
+    unsigned first;
+    unsigned last;
+    const Task *task;
+
+  public:
+    CutJob(TriDexel &model, const vector<TriDexel::Cut> &cuts, unsigned axis,
+           unsigned first, unsigned last, const Task *task) :
+      model(model), cuts(cuts), axis(axis), first(first), last(last),
+      task(task) {}
+
+    // From Thread
+    void run() {
+      try {
+        for (unsigned i = 0; i < cuts.size(); i++) {
+          if (task && !(i & 255) && task->shouldQuit()) break;
+          model.cut(cuts[i], axis, first, last);
+        }
+      } CATCH_ERROR;
+    }
+  };
+
+
+  class ContourJob : public Thread {
+    const TriDexel &model;
+    unsigned first;
+    unsigned last;
+    SmartPointer<Surface> surface;
+
+  public:
+    ContourJob(const TriDexel &model, unsigned first, unsigned last) :
+      model(model), first(first), last(last) {}
+
+    const SmartPointer<Surface> &getSurface() const {return surface;}
+
+    // From Thread
+    void run() {
+      try {
+        surface = model.getSurface(first, last);
+      } CATCH_ERROR;
+    }
+  };
+}
+
+
+TriDexel::TriDexel(const cb::Rectangle3D &bounds, double resolution,
+                   unsigned threads) :
+  bounds(bounds), resolution(resolution), threads(threads ? threads : 1),
+  time(0) {
+  if (resolution <= 0) THROWS("Invalid tri-dexel resolution " << resolution);
+
+  // One more vertex outside each side so the sides are contoured
+  origin = bounds.getMin() - Vector3D(resolution);
+  for (unsigned axis = 0; axis < 3; axis++)
+    steps[axis] = ceil(bounds.getDimensions()[axis] / resolution) + 3;
+
+  // Each ray starts through the whole block of material
+  for (unsigned axis = 0; axis < 3; axis++) {
+    Segment segment = {(float)bounds.getMin()[axis],
+                       (float)bounds.getMax()[axis]};
+    unsigned count = steps[(axis + 1) % 3] * steps[(axis + 2) % 3];
+    dexels[axis].resize(count, Dexel(1, segment));
+  }
+}
+
+
+void TriDexel::cut(const GCode::ToolPath &path, double time, Task *task) {
+  if (time < this->time) THROWS("Cannot uncut tri-dexel model from time "
+                                << this->time << " to " << time);
+
+  int first = path.find(this->time);
+  if (first == -1) {
+    this->time = time;
+    return;
+  }
+
+  typedef map<const GCode::Tool *, SmartPointer<Sweep> > sweeps_t;
+  sweeps_t sweeps;
+  vector<Cut> cuts;
+  double batchStart = this->time;
+
+  for (unsigned i = first; i < path.size(); i++) {
+    const GCode::Move &move = path[i];
+    if (time <= move.getStartTime()) break;
+
+    const GCode::Tool *tool = path.getTool(move);
+    if (!tool) continue;
+
+    SmartPointer<Sweep> &sweep = sweeps[tool];
+    if (sweep.isNull()) sweep = ToolSweep::getSweep(*tool);
+
+    if (!move.isArc())
+      addCuts(cuts, *sweep, move.getPtAtTime(this->time),
+              move.getPtAtTime(time), bounds, resolution);
+
+    else {
+      // Cut arcs as chords within half the grid resolution of the arc
+      double u0 = move.getFractionAtTime(this->time);
+      double u1 = move.getFractionAtTime(time);
+      double radius = move.getRadius();
+      double error = min(resolution / 2, radius);
+      double step = min(2 * M_PI / 3, 2 * acos(1 - error / radius));
+      unsigned segments = ceil(fabs(move.getAngle()) * (u1 - u0) / step);
+
+      for (unsigned j = 0; j < segments; j++)
+        addCuts(cuts, *sweep, move.getPtAt(u0 + (u1 - u0) * j / segments),
+                move.getPtAt(u0 + (u1 - u0) * (j + 1) / segments), bounds,
+                resolution);
+    }
+
+    if (cuts.size() < batchSize && i + 1 < path.size()) continue;
+
+    cut(cuts, task);
+    cuts.clear();
+
+    // Cutting is idempotent so after an interrupt we can resume here
+    if (task) {
+      if (task->shouldQuit()) {
+        this->time = batchStart;
+        return;
+      }
+
+      double total = time - this->time;
+      if (total) task->update((move.getEndTime() - this->time) / total,
+                              "Cutting tri-dexel model");
+    }
+
+    batchStart = max(this->time, move.getEndTime());
+  }
+
+  cut(cuts, task);
+  if (task && task->shouldQuit()) this->time = batchStart;
+  else this->time = time;
+}
+
+
+void TriDexel::cut(const Cut &cut, unsigned axis, unsigned first,
+                   unsigned last) {
+  const unsigned ua = (axis + 1) % 3;
+  const unsigned va = (axis + 2) % 3;
+  const Vector3D &bMin = cut.bounds.getMin();
+  const Vector3D &bMax = cut.bounds.getMax();
+
+  unsigned u0, u1, v0, v1;
+  if (!Grid::vertexRange(bMin[ua], bMax[ua], origin[ua], resolution,
+                         steps[ua], u0, u1) ||
+      !Grid::vertexRange(bMin[va], bMax[va], origin[va], resolution,
+                         steps[va], v0, v1))
+    return;
+
+  u0 = std::max(u0, first);
+  if (last <= u0) return;
+  u1 = std::min(u1, last - 1);
+  if (u1 < u0) return;
+
+  const bool convex = cut.sweep->isConvex();
+  Vector3D p;
+
+  for (unsigned v = v0; v <= v1; v++) {
+    p[va] = origin[va] + v * resolution;
+
+    for (unsigned u = u0; u <= u1; u++) {
+      Dexel &dexel = getDexel(axis, u, v);
+      if (dexel.empty()) continue;
+
+      // Only sample where there is material left
+      double lo = std::max(bMin[axis], (double)dexel.front().start);
+      double hi = std::min(bMax[axis], (double)dexel.back().end);
+      if (hi <= lo) continue;
+
+      p[ua] = origin[ua] + u * resolution;
+
+      unsigned samples = ceil((hi - lo) / resolution) + 1;
+      double step = (hi - lo) / (samples - 1);
+      double prev = lo;
+      double enter = lo;
+      p[axis] = lo;
+      bool inside = isCut(cut, p);
+
+      for (unsigned i = 1; i < samples; i++) {
+        double t = i + 1 == samples ? hi : lo + i * step;
+        p[axis] = t;
+        bool in = isCut(cut, p);
+
+        if (in && !inside) enter = findCrossing(cut, p, axis, prev, t);
+
+        else if (!in && inside) {
+          subtract(dexel, enter, findCrossing(cut, p, axis, t, prev));
+          if (convex) break; // A straight sweep crosses a ray once
+        }
+
+        inside = in;
+        prev = t;
+      }
+
+      if (inside) subtract(dexel, enter, hi);
+    }
+  }
+}
+
+
+uint64_t TriDexel::getMemoryUsage() const {
+  uint64_t bytes = 0;
+
+  for (unsigned axis = 0; axis < 3; axis++) {
+    bytes += dexels[axis].capacity() * sizeof(Dexel);
+    for (unsigned i = 0; i < dexels[axis].size(); i++)
+      bytes += dexels[axis][i].capacity() * sizeof(Segment);
+  }
+
+  return bytes;
+}
+
+
+SmartPointer<Surface> TriDexel::getSurface(Task *task) const {
+  unsigned layers = steps.z() - 1;
+  unsigned count = std::min(threads, layers);
+
+  vector<SmartPointer<ContourJob> > jobs;
+  for (unsigned i = 0; i < count; i++) {
+    unsigned first = (uint64_t)layers * i / count;
+    unsigned last = (uint64_t)layers * (i + 1) / count;
+    jobs.push_back(new ContourJob(*this, first, last));
+    jobs.back()->start();
+  }
+
+  vector<SmartPointer<Surface> > surfaces;
+  for (unsigned i = 0; i < jobs.size(); i++) {
+    jobs[i]->join();
+    if (!jobs[i]->getSurface().isNull())
+      surfaces.push_back(jobs[i]->getSurface());
+  }
+
+  if (task && task->shouldQuit()) return 0;
+
+  return new TriangleSurface(surfaces);
+}
+
+
+SmartPointer<Surface> TriDexel::getSurface(unsigned first,
+                                           unsigned last) const {
+  SmartPointer<TriangleSurface> surface = new TriangleSurface;
+
+  // Corners in the order of the marching cubes tables, bottom then top
+  static const unsigned corners[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+    {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},
+  };
+
+  // The lower corner and axis of each marching cubes edge
+  static const unsigned edgeAxes[12][4] = {
+    {0, 0, 0, 0}, {1, 0, 0, 1}, {0, 1, 0, 0}, {0, 0, 0, 1},
+    {0, 0, 1, 0}, {1, 0, 1, 1}, {0, 1, 1, 0}, {0, 0, 1, 1},
+    {0, 0, 0, 2}, {1, 0, 0, 2}, {1, 1, 0, 2}, {0, 1, 0, 2},
+  };
+
+  static const unsigned edgeCorners[12][2] = {
+    {0, 1}, {1, 2}, {3, 2}, {0, 3}, {4, 5}, {5, 6}, {7, 6}, {4, 7},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7},
+  };
+
+  Edge edgeData[12];
+  const Edge *edges[12];
+  for (unsigned i = 0; i < 12; i++) edges[i] = &edgeData[i];
+
+  vector<Triangle> triangles;
+
+  for (unsigned z = first; z < last; z++)
+    for (unsigned y = 0; y + 1 < steps.y(); y++)
+      for (unsigned x = 0; x + 1 < steps.x(); x++) {
+        // Flag the corners outside the material
+        uint8_t index = 0;
+        for (unsigned i = 0; i < 8; i++) {
+          Vector3U v(x + corners[i][0], y + corners[i][1], z + corners[i][2]);
+          if (!isInside(v)) index |= 1 << i;
+        }
+
+        if (!MarchingCubes::hasTriangles(index)) continue;
+
+        for (unsigned i = 0; i < 12; i++) {
+          bool a = index & (1 << edgeCorners[i][0]);
+          bool b = index & (1 << edgeCorners[i][1]);
+          if (a == b) continue;
+
+          const unsigned *e = edgeAxes[i];
+          Vector3U v(x + e[0], y + e[1], z + e[2]);
+          edgeData[i].vertex = getCrossing(v, e[3]);
+        }
+
+        triangles.clear();
+        MarchingCubes::addTriangles(index, edges, triangles);
+
+        for (unsigned i = 0; i < triangles.size(); i++) {
+          const Triangle &t = triangles[i];
+          const Vector3F vertices[3] = {t[0], t[1], t[2]};
+          surface->add(vertices, t.normal);
+        }
+      }
+
+  return surface;
+}
+
+
+void TriDexel::cut(const vector<Cut> &cuts, Task *task) {
+  if (cuts.empty()) return;
+
+  // Each job cuts the rays of one band of each axis so none are shared
+  unsigned bands = (threads + 2) / 3;
+  vector<SmartPointer<CutJob> > jobs;
+
+  for (unsigned axis = 0; axis < 3; axis++) {
+    unsigned width = steps[(axis + 1) % 3];
+
+    for (unsigned i = 0; i < bands; i++) {
+      unsigned first = (uint64_t)width * i / bands;
+      unsigned last = (uint64_t)width * (i + 1) / bands;
+      if (first == last) continue;
+
+      jobs.push_back(new CutJob(*this, cuts, axis, first, last, task));
+      jobs.back()->start();
+    }
+  }
+
+  for (unsigned i = 0; i < jobs.size(); i++) jobs[i]->join();
+}
+
+
+bool TriDexel::isInside(const Vector3U &v) const {
+  // Vertices on rays along Z, which are the longest in most workpieces
+  const Dexel &dexel = getDexel(2, v.x(), v.y());
+  float z = origin.z() + v.z() * resolution;
+
+  for (unsigned i = 0; i < dexel.size(); i++) {
+    if (z < dexel[i].start) return false;
+    if (z <= dexel[i].end) return true;
+  }
+
+  return false;
+}
+
+
+Vector3D TriDexel::getCrossing(const Vector3U &a, unsigned axis) const {
+  const unsigned ua = (axis + 1) % 3;
+  const unsigned va = (axis + 2) % 3;
+  const Dexel &dexel = getDexel(axis, a[ua], a[va]);
+
+  Vector3D p = origin + Vector3D(a) * resolution;
+  double lo = p[axis];
+  double hi = lo + resolution;
+  double mid = lo + resolution / 2;
+
+  // The end of material on the edge nearest its middle, where the rays
+  // through the two vertices disagree there may be none
+  double best = mid;
+  double bestDist = resolution;
+
+  for (unsigned i = 0; i < dexel.size(); i++) {
+    const double ends[2] = {dexel[i].start, dexel[i].end};
+
+    for (unsigned j = 0; j < 2; j++)
+      if (lo <= ends[j] && ends[j] <= hi && fabs(ends[j] - mid) < bestDist) {
+        best = ends[j];
+        bestDist = fabs(ends[j] - mid);
+      }
+
+    if (hi < dexel[i].start) break;
+  }
+
+  p[axis] = best;
+  return p;
+}
+
+
+void TriDexel::subtract(Dexel &dexel, float start, float end) {
+  Dexel::iterator it = dexel.begin();
+
+  while (it != dexel.end()) {
+    if (it->end <= start) {it++; continue;}
+    if (end <= it->start) break;
+
+    if (it->start < start && end < it->end) {
+      // Split in two
+      Segment after = {end, it->end};
+      it->end = start;
+      dexel.insert(it + 1, after);
+      break;
+    }
+
+    if (it->start < start) {it->end = start; it++; continue;}
+    if (end < it->end) {it->start = end; break;}
+
+    it = dexel.erase(it);
+  }
+}
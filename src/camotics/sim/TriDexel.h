@@ -0,0 +1,109 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+
+
+namespace GCode {class ToolPath;}
+
+namespace CAMotics {
+  class Surface;
+  class Sweep;
+  class Task;
+
+  /***
+   * A model of the workpiece as the material along rays parallel to each
+   * axis, through the vertices of a grid.  Unlike a HeightMap it holds
+   * undercuts, tilted cuts and tools of any shape, yet a move only costs
+   * sweep depth tests along the rays it crosses instead of a field
+   * evaluation at every grid vertex.  The surface is contoured from where
+   * the rays enter and leave the material.
+   */
+  class TriDexel {
+  public:
+    /// Material along a ray, from start to end.
+    struct Segment {
+      float start;
+      float end;
+    };
+
+    typedef std::vector<Segment> Dexel;
+
+    /// A straight cut by one tool
+    struct Cut {
+      const Sweep *sweep;
+      cb::Vector3D start;
+      cb::Vector3D end;
+      cb::Rectangle3D bounds;
+    };
+
+  protected:
+    cb::Rectangle3D bounds;
+    double resolution;
+    unsigned threads;
+    cb::Vector3D origin;          ///< Of the grid, a cell outside bounds
+    cb::Vector3U steps;           ///< Grid vertices along each axis
+    std::vector<Dexel> dexels[3]; ///< Along each axis
+    double time;
+
+  public:
+    /// Cut and contour on up to @param threads threads.
+    TriDexel(const cb::Rectangle3D &bounds, double resolution,
+             unsigned threads = 1);
+
+    const cb::Rectangle3D &getBounds() const {return bounds;}
+    double getResolution() const {return resolution;}
+    double getTime() const {return time;}
+    uint64_t getMemoryUsage() const;
+
+    /// Cut all moves between the current time and @param time.
+    void cut(const GCode::ToolPath &path, double time, Task *task = 0);
+    /// Cut the rays along @param axis from @param first up to
+    /// @param last, by their index along the next axis.
+    void cut(const Cut &cut, unsigned axis, unsigned first, unsigned last);
+
+    cb::SmartPointer<Surface> getSurface(Task *task = 0) const;
+    /// Contour the layers of cells from @param first up to @param last
+    /// along Z.
+    cb::SmartPointer<Surface> getSurface(unsigned first, unsigned last) const;
+
+  protected:
+    void cut(const std::vector<Cut> &cuts, Task *task);
+
+    Dexel &getDexel(unsigned axis, unsigned u, unsigned v)
+    {return dexels[axis][v * steps[(axis + 1) % 3] + u];}
+    const Dexel &getDexel(unsigned axis, unsigned u, unsigned v) const
+    {return dexels[axis][v * steps[(axis + 1) % 3] + u];}
+
+    /// True if the grid vertex @param v is in the material.
+    bool isInside(const cb::Vector3U &v) const;
+    /// @return where the surface crosses the grid edge from vertex @param a
+    /// one step along @param axis.
+    cb::Vector3D getCrossing(const cb::Vector3U &a, unsigned axis) const;
+
+    static void subtract(Dexel &dexel, float start, float end);
+  };
+}
@@ -20,6 +20,8 @@
 
 #include "Workpiece.h"
 
+#include <limits>
+
 using namespace std;
 using namespace cb;
 using namespace CAMotics;
@@ -32,7 +34,51 @@ Workpiece::Workpiece(const cb::Rectangle3D &r) :
 }
 
 
+void Workpiece::setStock(const SmartPointer<StockField> &stock) {
+  this->stock = stock;
+  if (stock.isNull()) return;
+
+  cb::Rectangle3D::operator=(stock->getBounds());
+  center = getCenter();
+  cb::Vector3D halfDim = getDimensions() / 2;
+  halfDim2 = halfDim * halfDim;
+}
+
+
+int Workpiece::classify(const cb::Rectangle3D &r) const {
+  if (!intersects(r)) return -1;
+  return stock.isNull() && contains(r) ? 1 : 0;
+}
+
+
 double Workpiece::depth(const cb::Vector3D &p) const {
-  double d2 = p.distanceSquared(closestPointOnSurface(p));
-  return cb::Rectangle3D::contains(p) ? d2 : -d2;
+  if (!stock.isNull()) return stock->depth(p);
+
+  double d = p.distance(closestPointOnSurface(p));
+  return cb::Rectangle3D::contains(p) ? d : -d;
+}
+
+
+cb::Vector3D Workpiece::segmentNormal(const cb::Vector3D &p) const {
+  if (!stock.isNull()) return cb::Vector3D(); // From the depth gradient
+
+  if (!cb::Rectangle3D::contains(p)) {
+    cb::Vector3D n = p - closestPointOnSurface(p);
+    double length = n.length();
+    return length ? n / length : n;
+  }
+
+  // Inside, the nearest face
+  cb::Vector3D n;
+  double nearest = numeric_limits<double>::max();
+
+  for (unsigned i = 0; i < 3; i++) {
+    double below = p[i] - getMin()[i];
+    double above = getMax()[i] - p[i];
+
+    if (below < nearest) {nearest = below; n = cb::Vector3D(); n[i] = -1;}
+    if (above < nearest) {nearest = above; n = cb::Vector3D(); n[i] = 1;}
+  }
+
+  return n;
 }
@@ -22,22 +22,33 @@
 
 
 
+#include "StockField.h"
+
 #include <camotics/contour/FieldFunction.h>
 
+#include <cbang/SmartPointer.h>
+
 
 namespace CAMotics {
   class Workpiece : public cb::Rectangle3D, public FieldFunction {
     cb::Vector3D center;
     cb::Vector3D halfDim2;
+    cb::SmartPointer<StockField> stock;
 
   public:
     Workpiece(const cb::Rectangle3D &r = cb::Rectangle3D());
 
+    const cb::SmartPointer<StockField> &getStock() const {return stock;}
+    /// Cut @param stock, rather than the box, which becomes its bounds.
+    void setStock(const cb::SmartPointer<StockField> &stock);
+
     cb::Rectangle3D getBounds() const {return *this;}
     bool isValid() const {return getVolume();}
     using cb::Rectangle3D::contains;
 
     // From FieldFunction
+    int classify(const cb::Rectangle3D &r) const;
     double depth(const cb::Vector3D &p) const;
+    cb::Vector3D segmentNormal(const cb::Vector3D &p) const;
   };
 }
@@ -30,12 +30,13 @@ namespace CAMotics {
     CLASS *object;
     typedef T (CLASS::*member_t)() const;
     member_t member;
+    T last;
 
   public:
     MemberFunctorValue(const std::string name, CLASS *object, member_t member) :
-      Value(name), object(object), member(member) {}
+      Value(name), object(object), member(member), last() {}
 
     // From Value
-    void updated() {set((*object.*member)());}
+    void updated() {setChanged((*object.*member)(), last);}
   };
 }
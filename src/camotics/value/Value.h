@@ -35,9 +35,10 @@ namespace CAMotics {
 
     typedef std::vector<cb::SmartPointer<Observer> > observers_t;
     observers_t observers;
+    bool published;
 
   public:
-    Value(const std::string &name) : name(name) {}
+    Value(const std::string &name) : name(name), published(false) {}
     virtual ~Value() {} // Complier needs this
 
     const std::string &getName() const {return name;}
@@ -53,6 +54,18 @@ namespace CAMotics {
         observers[i]->updated(name, value);
     }
 
+    /// Publish @param value only if it differs from @param last.
+    template <typename T>
+    void setChanged(const T &value, T &last) {
+      if (published && value == last) return;
+      last = value;
+      published = true;
+      set(value);
+    }
+
+    /// Force the next update to publish even if the value has not changed.
+    void invalidate() {published = false;}
+
     virtual void updated() = 0;
   };
 }
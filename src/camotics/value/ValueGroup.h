@@ -53,5 +53,6 @@ namespace CAMotics {
     }
 
     void updated();
+    void markDirty() {set.markDirty();}
   };
 }
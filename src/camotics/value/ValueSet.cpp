@@ -35,5 +35,11 @@ const SmartPointer<Value> &ValueSet::get(const string &name) const {
 
 
 void ValueSet::updated() {
+  dirty = false;
   for (iterator it = begin(); it != end(); it++) it->second->updated();
 }
+
+
+void ValueSet::invalidate() {
+  for (iterator it = begin(); it != end(); it++) it->second->invalidate();
+}
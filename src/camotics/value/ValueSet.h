@@ -32,8 +32,11 @@ namespace CAMotics {
     typedef std::map<std::string, cb::SmartPointer<Value> >
     values_t;
     values_t values;
+    bool dirty;
 
   public:
+    ValueSet() : dirty(false) {}
+
     typedef values_t::const_iterator iterator;
     iterator begin() const {return values.begin();}
     iterator end() const {return values.end();}
@@ -65,5 +68,13 @@ namespace CAMotics {
     {return add(new MemberFunctorValue<CLASS, T>(name, object, member));}
 
     void updated();
+
+    /// Defer updates until the next flush().
+    void markDirty() {dirty = true;}
+    bool isDirty() const {return dirty;}
+    /// Update all values if any were marked dirty since the last flush.
+    void flush() {if (dirty) updated();}
+    /// Republish every value on the next update, e.g. after a units change.
+    void invalidate();
   };
 }
@@ -28,12 +28,13 @@ namespace CAMotics {
   template <typename T>
   class VarValue : public Value {
     T &var;
+    T last;
 
   public:
     VarValue(const std::string name, T &var) :
-      Value(name), var(var) {}
+      Value(name), var(var), last() {}
 
     // From Value
-    void updated() {set(var);}
+    void updated() {setChanged(var, last);}
   };
 }
@@ -0,0 +1,69 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "Frustum.h"
+
+#include "GL.h"
+
+using namespace cb;
+using namespace CAMotics;
+
+
+Frustum::Frustum() {
+  double p[16], m[16];
+  GLFuncs &glFuncs = getGLFuncs();
+  glFuncs.glGetDoublev(GL_PROJECTION_MATRIX, p);
+  glFuncs.glGetDoublev(GL_MODELVIEW_MATRIX, m);
+
+  // Rows of the column major clip matrix, projection * model view
+  double clip[4][4];
+  for (unsigned row = 0; row < 4; row++)
+    for (unsigned col = 0; col < 4; col++) {
+      clip[row][col] = 0;
+      for (unsigned k = 0; k < 4; k++)
+        clip[row][col] += p[k * 4 + row] * m[col * 4 + k];
+    }
+
+  // Left, right, bottom, top, near and far
+  for (unsigned i = 0; i < 6; i++) {
+    double sign = i & 1 ? -1 : 1;
+    for (unsigned j = 0; j < 4; j++)
+      planes[i][j] = clip[3][j] + sign * clip[i / 2][j];
+  }
+}
+
+
+bool Frustum::intersects(const Rectangle3D &box) const {
+  const Vector3D &min = box.getMin();
+  const Vector3D &max = box.getMax();
+
+  for (unsigned i = 0; i < 6; i++) {
+    const double *plane = planes[i];
+
+    // The box corner furthest along the plane normal
+    double d = plane[3];
+    for (unsigned j = 0; j < 3; j++)
+      d += plane[j] * (0 <= plane[j] ? max[j] : min[j]);
+
+    if (d < 0) return false;
+  }
+
+  return true;
+}
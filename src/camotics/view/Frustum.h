@@ -20,19 +20,18 @@
 
 #pragma once
 
-#include "PlannerCommand.h"
+#include <cbang/geom/Rectangle.h>
 
 
-namespace GCode {
-  class SpeedCommand : public PlannerCommand {
-    double speed;
+namespace CAMotics {
+  /// The view volume of the current GL projection and model view matrices.
+  class Frustum {
+    double planes[6][4]; ///< Pointing inwards
 
   public:
-    SpeedCommand(uint64_t line, double speed) :
-      PlannerCommand(line), speed(speed) {}
+    Frustum();
 
-    // From PlannerCommand
-    const char *getType() {return "speed";}
-    void insert(cb::JSON::Sink &sink);
+    /// @return false if @param box is certainly outside the view.
+    bool intersects(const cb::Rectangle3D &box) const;
   };
 }
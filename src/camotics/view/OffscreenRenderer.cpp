@@ -0,0 +1,110 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "OffscreenRenderer.h"
+
+#include "View.h"
+#include "Viewer.h"
+#include "GL.h"
+
+#include <cbang/Exception.h>
+
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QImage>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  int argc = 1;
+  char arg0[] = "camotics";
+  char *argv[] = {arg0, 0};
+}
+
+
+OffscreenRenderer::OffscreenRenderer(unsigned width, unsigned height) :
+  width(width), height(height) {
+  if (!QGuiApplication::instance()) {
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    app = new QGuiApplication(argc, argv);
+  }
+
+  QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+  format.setDepthBufferSize(24);
+
+  surface = new QOffscreenSurface;
+  surface->setFormat(format);
+  surface->create();
+  if (!surface->isValid()) THROW("Failed to create off-screen surface");
+
+  context = new QOpenGLContext;
+  context->setFormat(format);
+  if (!context->create()) THROW("Failed to create OpenGL context");
+
+  makeCurrent();
+
+  QOpenGLFramebufferObjectFormat fboFormat;
+  fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  fboFormat.setSamples(4);
+  fbo = new QOpenGLFramebufferObject(width, height, fboFormat);
+  if (!fbo->isValid()) THROW("Failed to create OpenGL frame buffer");
+}
+
+
+OffscreenRenderer::~OffscreenRenderer() {
+  if (context.isNull()) return;
+  if (context->makeCurrent(surface.get())) fbo.release();
+  context->doneCurrent();
+}
+
+
+void OffscreenRenderer::makeCurrent() {
+  if (!context->makeCurrent(surface.get()))
+    THROW("Failed to make OpenGL context current");
+}
+
+
+void OffscreenRenderer::doneCurrent() {context->doneCurrent();}
+
+
+void OffscreenRenderer::render(View &view, const string &filename) {
+  makeCurrent();
+  fbo->bind();
+
+  view.glInit();
+  view.resize(width, height);
+
+  getGLFuncs().glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  Viewer().draw(view);
+  getGLFuncs().glFinish();
+
+  QImage image = fbo->toImage();
+  fbo->release();
+
+  if (!image.save(QString::fromUtf8(filename.c_str())))
+    THROWS("Failed to save snapshot to '" << filename << "'");
+}
@@ -0,0 +1,62 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include <cbang/SmartPointer.h>
+
+#include <string>
+
+class QGuiApplication;
+class QOpenGLContext;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+
+
+namespace CAMotics {
+  class View;
+
+  /// Draws a View to images without a window.  Qt's platform plugin is
+  /// chosen by QT_QPA_PLATFORM and defaults to "offscreen" here, so no X
+  /// server is needed.  Use "eglfs" or a Mesa build to render on nodes
+  /// without one either.
+  class OffscreenRenderer {
+    unsigned width;
+    unsigned height;
+
+    cb::SmartPointer<QGuiApplication> app;
+    cb::SmartPointer<QOffscreenSurface> surface;
+    cb::SmartPointer<QOpenGLContext> context;
+    cb::SmartPointer<QOpenGLFramebufferObject> fbo;
+
+  public:
+    OffscreenRenderer(unsigned width, unsigned height);
+    ~OffscreenRenderer();
+
+    /// Makes the off-screen context current.  GL objects, including those
+    /// of a View, must be created and destroyed while it is.
+    void makeCurrent();
+    void doneCurrent();
+
+    /// Draws @param view and saves it to @param filename.  The format
+    /// follows the file extension.
+    void render(View &view, const std::string &filename);
+  };
+}
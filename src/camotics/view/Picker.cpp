@@ -0,0 +1,348 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "Picker.h"
+
+#include <camotics/Task.h>
+#include <camotics/contour/TriangleSurface.h>
+#include <camotics/sim/ToolSweep.h>
+#include <camotics/sim/Sweep.h>
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/os/Thread.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <atomic>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  cb::Vector3D getVertex(const vector<float> &vertices,
+                         const vector<uint32_t> &indices, unsigned i) {
+    const float *v = &vertices[indices[i] * 3];
+    return cb::Vector3D(v[0], v[1], v[2]);
+  }
+
+
+  // Möller-Trumbore, @return the distance along the ray or -1
+  double intersectTriangle(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                           const cb::Vector3D &a, const cb::Vector3D &b,
+                           const cb::Vector3D &c) {
+    cb::Vector3D e1 = b - a;
+    cb::Vector3D e2 = c - a;
+    cb::Vector3D p = dir.cross(e2);
+    double det = e1.dot(p);
+    if (!det) return -1;
+
+    double inv = 1 / det;
+    cb::Vector3D s = origin - a;
+    double u = s.dot(p) * inv;
+    if (u < 0 || 1 < u) return -1;
+
+    cb::Vector3D q = s.cross(e1);
+    double v = dir.dot(q) * inv;
+    if (v < 0 || 1 < u + v) return -1;
+
+    return e2.dot(q) * inv;
+  }
+
+
+  class TriangleVisitor : public RayBVH::Visitor {
+    const vector<float> &vertices;
+    const vector<uint32_t> &indices;
+    const cb::Vector3D &origin;
+    const cb::Vector3D &dir;
+
+  public:
+    double t;
+
+    TriangleVisitor(const vector<float> &vertices,
+                    const vector<uint32_t> &indices,
+                    const cb::Vector3D &origin, const cb::Vector3D &dir) :
+      vertices(vertices), indices(indices), origin(origin), dir(dir),
+      t(-1) {}
+
+    // From RayBVH::Visitor
+    double visit(unsigned id, double tMax) {
+      double t =
+        intersectTriangle(origin, dir, getVertex(vertices, indices, id * 3),
+                          getVertex(vertices, indices, id * 3 + 1),
+                          getVertex(vertices, indices, id * 3 + 2));
+      if (t < 0 || tMax <= t) return tMax;
+
+      return this->t = t;
+    }
+  };
+
+
+  class LineVisitor : public RayBVH::Visitor {
+    const vector<cb::Vector3D> &starts;
+    const vector<cb::Vector3D> &ends;
+    const cb::Vector3D &origin;
+    const cb::Vector3D &dir;
+    double tolerance;
+
+  public:
+    int line;
+    double t;
+
+    LineVisitor(const vector<cb::Vector3D> &starts,
+                const vector<cb::Vector3D> &ends, const cb::Vector3D &origin,
+                const cb::Vector3D &dir, double tolerance) :
+      starts(starts), ends(ends), origin(origin), dir(dir),
+      tolerance(tolerance), line(-1), t(-1) {}
+
+    // From RayBVH::Visitor
+    double visit(unsigned id, double tMax) {
+      // Closest points of the ray, o + t * dir, and the line, a + s * u
+      cb::Vector3D u = ends[id] - starts[id];
+      cb::Vector3D w = origin - starts[id];
+      double b = dir.dot(u);
+      double c = u.dot(u);
+      double d = dir.dot(w);
+      double e = u.dot(w);
+      double den = c - b * b;
+
+      double s = den ? std::min(1.0, std::max(0.0, (e - d * b) / den)) : 0;
+      double t = s * b - d;
+      if (t < 0) {
+        t = 0;
+        s = c ? std::min(1.0, std::max(0.0, e / c)) : 0;
+      }
+
+      if (tMax <= t || tolerance < (w + dir * t - u * s).length()) return tMax;
+
+      line = id;
+      return this->t = t;
+    }
+  };
+}
+
+
+class Picker::SurfaceJob : public Thread {
+  SmartPointer<Surface> owner;
+  const TriangleSurface *surface;
+  Task task;
+  RayBVH bvh;
+  atomic<bool> ready;
+
+public:
+  SurfaceJob(const SmartPointer<Surface> &owner,
+             const TriangleSurface *surface) :
+    owner(owner), surface(surface), ready(false) {}
+
+  bool isReady() const {return ready;}
+  void cancel() {task.interrupt();}
+
+
+  bool intersect(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                 double &t) const {
+    TriangleVisitor visitor(surface->getVertices(), surface->getIndices(),
+                            origin, dir);
+    bvh.intersect(origin, dir, t, visitor);
+    if (visitor.t < 0) return false;
+
+    t = visitor.t;
+    return true;
+  }
+
+
+  // From Thread
+  void run() {
+    try {
+      const vector<float> &vertices = surface->getVertices();
+      const vector<uint32_t> &indices = surface->getIndices();
+
+      vector<cb::Rectangle3D> boxes;
+      boxes.reserve(indices.size() / 3);
+
+      for (unsigned i = 0; i + 2 < indices.size(); i += 3) {
+        if (!(i & 0xffff) && task.isInterrupted()) return;
+
+        cb::Rectangle3D box;
+        for (unsigned j = 0; j < 3; j++)
+          box.add(getVertex(vertices, indices, i + j));
+        boxes.push_back(box);
+      }
+
+      bvh.build(boxes, &task);
+      ready = !task.isInterrupted();
+    } CATCH_ERROR;
+  }
+};
+
+
+Picker::Picker() : pathDirty(false), pathRevision(0) {}
+
+
+Picker::~Picker() {setSurface(0);}
+
+
+void Picker::setSurface(const SmartPointer<Surface> &surface) {
+  if (!surfaceJob.isNull()) {
+    surfaceJob->cancel();
+    surfaceJob->join();
+    surfaceJob.release();
+  }
+
+  // Only triangle surfaces are picked
+  TriangleSurface *triangles = dynamic_cast<TriangleSurface *>(surface.get());
+  if (!triangles || !triangles->getCount()) return;
+
+  surfaceJob = new SurfaceJob(surface, triangles);
+  surfaceJob->start();
+}
+
+
+void Picker::setPath(const SmartPointer<const GCode::ToolPath> &path) {
+  if (this->path == path) return;
+  this->path = path;
+  pathDirty = true;
+}
+
+
+void Picker::setMoveLookup(const SmartPointer<MoveLookup> &moveLookup) {
+  this->moveLookup = moveLookup;
+}
+
+
+bool Picker::pick(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                  double tolerance, bool withPath, Pick &pick) {
+  double tSurface = numeric_limits<double>::infinity();
+  bool onSurface = pickSurface(origin, dir, tSurface);
+
+  double tPath = numeric_limits<double>::infinity();
+  int line = withPath ? pickPath(origin, dir, tolerance, tPath) : -1;
+
+  if (!onSurface && line < 0) return false;
+
+  // Lines drawn on the surface are picked before it
+  if (0 <= line && (!onSurface || tPath <= tSurface + tolerance)) {
+    pick.point = origin + dir * tPath;
+    pick.onSurface = false;
+    pick.hasMove = true;
+    pick.move = path->at(lineMoves[line]);
+
+  } else {
+    pick.point = origin + dir * tSurface;
+    pick.onSurface = true;
+
+    const GCode::Move *move = findCut(pick.point);
+    pick.hasMove = move;
+    if (move) pick.move = *move;
+  }
+
+  return true;
+}
+
+
+void Picker::buildPath() {
+  pathDirty = false;
+  pathRevision = path.isNull() ? 0 : path->getRevision();
+  lineStarts.clear();
+  lineEnds.clear();
+  lineMoves.clear();
+
+  vector<cb::Rectangle3D> boxes;
+
+  if (!path.isNull())
+    for (unsigned i = 0; i < path->size(); i++) {
+      const GCode::Move &move = path->at(i);
+
+      // Arcs in chords of at most 1/64th of a turn
+      unsigned chords = 1;
+      if (move.isArc())
+        chords = std::max(1.0, ceil(fabs(move.getAngle()) / (M_PI / 32)));
+
+      cb::Vector3D start = move.getStartPt();
+      for (unsigned j = 1; j <= chords; j++) {
+        cb::Vector3D end =
+          j == chords ? move.getEndPt() : move.getPtAt((double)j / chords);
+
+        lineStarts.push_back(start);
+        lineEnds.push_back(end);
+        lineMoves.push_back(i);
+        boxes.push_back(cb::Rectangle3D().add(start).add(end));
+
+        start = end;
+      }
+    }
+
+  pathBVH.build(boxes);
+}
+
+
+bool Picker::pickSurface(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                         double &t) const {
+  if (surfaceJob.isNull() || !surfaceJob->isReady()) return false;
+  return surfaceJob->intersect(origin, dir, t);
+}
+
+
+int Picker::pickPath(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                     double tolerance, double &t) {
+  if (pathDirty || (!path.isNull() && path->getRevision() != pathRevision))
+    buildPath();
+
+  LineVisitor visitor(lineStarts, lineEnds, origin, dir, tolerance);
+  pathBVH.intersect(origin, dir, t, visitor, tolerance);
+  if (0 <= visitor.line) t = visitor.t;
+
+  return visitor.line;
+}
+
+
+const GCode::Move *Picker::findCut(const cb::Vector3D &p) const {
+  const ToolSweep *sweep = dynamic_cast<const ToolSweep *>(moveLookup.get());
+  if (!sweep) return 0;
+
+  vector<const GCode::Move *> moves;
+  sweep->collisions(p, moves);
+
+  // The point is on the boundary of the sweep of the move which cut it.  Of
+  // equally near moves the last cut last.
+  const GCode::Move *best = 0;
+  double bestDepth = numeric_limits<double>::infinity();
+
+  for (unsigned i = 0; i < moves.size(); i++) {
+    const GCode::Move &move = *moves[i];
+    if (move.getTool() < 0) continue;
+
+    const Sweep &s = sweep->getSweep(move);
+    double depth = fabs(move.isArc() ?
+                        s.arcDepth(move, move.getStartTime(),
+                                   move.getEndTime(), p) :
+                        s.depth(move.getStartPt(), move.getEndPt(), p));
+
+    if (depth < bestDepth || (depth == bestDepth &&
+                              best->getStartTime() < move.getStartTime())) {
+      best = &move;
+      bestDepth = depth;
+    }
+  }
+
+  return best;
+}
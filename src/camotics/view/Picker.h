@@ -0,0 +1,93 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include "RayBVH.h"
+
+#include <gcode/Move.h>
+
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+
+
+namespace GCode {class ToolPath;}
+
+namespace CAMotics {
+  class Surface;
+  class MoveLookup;
+
+  /***
+   * Finds what a ray from the view hits, the simulated surface or a line of
+   * the tool path, and the move responsible.  The surface's hierarchy is
+   * built in the background when it is set and is used once ready.  The
+   * path's is built on the first pick after it is set or changes.
+   */
+  class Picker {
+    class SurfaceJob;
+    cb::SmartPointer<SurfaceJob> surfaceJob;
+
+    cb::SmartPointer<const GCode::ToolPath> path;
+    cb::SmartPointer<MoveLookup> moveLookup;
+
+    // Path lines, arcs split in to chords, and the move of each
+    std::vector<cb::Vector3D> lineStarts;
+    std::vector<cb::Vector3D> lineEnds;
+    std::vector<unsigned> lineMoves;
+    RayBVH pathBVH;
+    bool pathDirty;
+    uint64_t pathRevision;
+
+  public:
+    struct Pick {
+      cb::Vector3D point;
+      bool onSurface;
+      bool hasMove;
+      GCode::Move move;
+
+      Pick() : onSurface(false), hasMove(false) {}
+    };
+
+    Picker();
+    ~Picker();
+
+    void setSurface(const cb::SmartPointer<Surface> &surface);
+    void setPath(const cb::SmartPointer<const GCode::ToolPath> &path);
+    /// Moves which cut a surface point are found with @param moveLookup.
+    void setMoveLookup(const cb::SmartPointer<MoveLookup> &moveLookup);
+
+    /// @return true if the ray from @param origin along unit @param dir hits
+    /// the surface or, if @param withPath, passes within @param tolerance
+    /// of a path line.  The nearest is returned in @param pick.
+    bool pick(const cb::Vector3D &origin, const cb::Vector3D &dir,
+              double tolerance, bool withPath, Pick &pick);
+
+  protected:
+    void buildPath();
+    bool pickSurface(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                     double &t) const;
+    int pickPath(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                 double tolerance, double &t);
+    /// @return the move whose sweep's boundary passes nearest @param p.
+    const GCode::Move *findCut(const cb::Vector3D &p) const;
+  };
+}
@@ -0,0 +1,180 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "RayBVH.h"
+
+#include <camotics/Task.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  struct CenterLess {
+    const vector<cb::Rectangle3D> &boxes;
+    unsigned axis;
+
+    CenterLess(const vector<cb::Rectangle3D> &boxes, unsigned axis) :
+      boxes(boxes), axis(axis) {}
+
+    bool operator()(uint32_t a, uint32_t b) const {
+      return boxes[a].getMin()[axis] + boxes[a].getMax()[axis] <
+        boxes[b].getMin()[axis] + boxes[b].getMax()[axis];
+    }
+  };
+
+
+  float roundDown(double x) {
+    float f = x;
+    return x < f ? nextafterf(f, -numeric_limits<float>::max()) : f;
+  }
+
+
+  float roundUp(double x) {
+    float f = x;
+    return f < x ? nextafterf(f, numeric_limits<float>::max()) : f;
+  }
+}
+
+
+void RayBVH::build(const vector<cb::Rectangle3D> &boxes, const Task *task) {
+  nodes.clear();
+  ids.clear();
+  if (boxes.empty()) return;
+
+  vector<uint32_t> order(boxes.size());
+  for (unsigned i = 0; i < order.size(); i++) order[i] = i;
+
+  nodes.reserve(2 * boxes.size() / LEAF_SIZE + 1);
+  build(order, boxes, 0, order.size(), task);
+
+  if (task && task->isInterrupted()) {
+    nodes.clear();
+    ids.clear();
+  }
+}
+
+
+void RayBVH::intersect(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                       double tMax, Visitor &visitor, double grow) const {
+  if (nodes.empty()) return;
+
+  // Division by zero gives infinities which the slab test handles
+  cb::Vector3D invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+
+  if (enter(nodes[0], origin, invDir, tMax, grow) < 0) return;
+
+  vector<uint32_t> stack;
+  stack.push_back(0);
+
+  while (!stack.empty()) {
+    unsigned index = stack.back();
+    const Node &node = nodes[index];
+    stack.pop_back();
+
+    if (node.count) {
+      for (unsigned i = 0; i < node.count; i++)
+        tMax = visitor.visit(ids[node.first + i], tMax);
+      continue;
+    }
+
+    // Nearer child last, so it is visited first
+    unsigned left = index + 1;
+    unsigned right = node.first;
+    double tLeft = enter(nodes[left], origin, invDir, tMax, grow);
+    double tRight = enter(nodes[right], origin, invDir, tMax, grow);
+
+    if (tLeft < tRight) {
+      if (0 <= tRight) stack.push_back(right);
+      if (0 <= tLeft) stack.push_back(left);
+
+    } else {
+      if (0 <= tLeft) stack.push_back(left);
+      if (0 <= tRight) stack.push_back(right);
+    }
+  }
+}
+
+
+void RayBVH::build(vector<uint32_t> &order,
+                   const vector<cb::Rectangle3D> &boxes, unsigned begin,
+                   unsigned end, const Task *task) {
+  unsigned index = nodes.size();
+  nodes.push_back(Node());
+
+  cb::Rectangle3D bounds;
+  cb::Rectangle3D centers;
+  for (unsigned i = begin; i < end; i++) {
+    bounds.add(boxes[order[i]]);
+    centers.add(boxes[order[i]].getCenter());
+  }
+
+  for (unsigned i = 0; i < 3; i++) {
+    nodes[index].min[i] = roundDown(bounds.getMin()[i]);
+    nodes[index].max[i] = roundUp(bounds.getMax()[i]);
+  }
+
+  // Leaf
+  cb::Vector3D dims = centers.getDimensions();
+  if (end - begin <= LEAF_SIZE || (!dims.x() && !dims.y() && !dims.z()) ||
+      (task && task->isInterrupted())) {
+    nodes[index].first = ids.size();
+    nodes[index].count = end - begin;
+    for (unsigned i = begin; i < end; i++) ids.push_back(order[i]);
+    return;
+  }
+
+  unsigned axis = dims.x() < dims.y() ? 1 : 0;
+  if (dims[axis] < dims.z()) axis = 2;
+
+  unsigned mid = (begin + end) / 2;
+  nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+              CenterLess(boxes, axis));
+
+  build(order, boxes, begin, mid, task);
+  nodes[index].first = nodes.size();
+  nodes[index].count = 0;
+  build(order, boxes, mid, end, task);
+}
+
+
+double RayBVH::enter(const Node &node, const cb::Vector3D &origin,
+                     const cb::Vector3D &invDir, double tMax,
+                     double grow) const {
+  double tMin = 0;
+
+  for (unsigned i = 0; i < 3; i++) {
+    double t0 = (node.min[i] - grow - origin[i]) * invDir[i];
+    double t1 = (node.max[i] + grow - origin[i]) * invDir[i];
+    if (t1 < t0) swap(t0, t1);
+
+    // NaN, from a ray in the plane of a face, fails neither test
+    if (tMin < t0) tMin = t0;
+    if (t1 < tMax) tMax = t1;
+    if (tMax < tMin) return -1;
+  }
+
+  return tMin;
+}
@@ -0,0 +1,84 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include <cbang/StdTypes.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+
+
+namespace CAMotics {
+  class Task;
+
+  /***
+   * A binary bounding volume hierarchy of boxes, by id, for finding what a
+   * ray hits.  Built by splitting the boxes at the median of their centers
+   * along the longest axis.  Bounds are kept in single precision, rounded
+   * outward.
+   */
+  class RayBVH {
+  public:
+    static const unsigned LEAF_SIZE = 4;
+
+    /// Tests the primitives whose boxes a ray reaches.
+    class Visitor {
+    public:
+      virtual ~Visitor() {}
+      /// @return the distance along the ray beyond which primitives are no
+      /// longer wanted, @param tMax or less.
+      virtual double visit(unsigned id, double tMax) = 0;
+    };
+
+  protected:
+    struct Node {
+      float min[3];
+      float max[3];
+      uint32_t first; ///< First primitive of a leaf or the right child
+      uint32_t count; ///< Primitives in a leaf, zero for inner nodes
+    };
+
+    std::vector<Node> nodes; ///< The left child follows its parent
+    std::vector<uint32_t> ids;
+
+  public:
+    /// Build over @param boxes, identified by their index.  Stops early,
+    /// leaving the hierarchy empty, if @param task is interrupted.
+    void build(const std::vector<cb::Rectangle3D> &boxes,
+               const Task *task = 0);
+
+    bool empty() const {return nodes.empty();}
+
+    /// Visit the primitives whose boxes, grown by @param grow, the ray from
+    /// @param origin along @param dir reaches within @param tMax, nearest
+    /// boxes first.
+    void intersect(const cb::Vector3D &origin, const cb::Vector3D &dir,
+                   double tMax, Visitor &visitor, double grow = 0) const;
+
+  protected:
+    void build(std::vector<uint32_t> &order,
+               const std::vector<cb::Rectangle3D> &boxes, unsigned begin,
+               unsigned end, const Task *task);
+    /// @return the distance along the ray it enters @param node or -1.
+    double enter(const Node &node, const cb::Vector3D &origin,
+                 const cb::Vector3D &invDir, double tMax, double grow) const;
+  };
+}
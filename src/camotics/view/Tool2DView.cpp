@@ -176,6 +176,21 @@ void Tool2DView::draw() {
     cairo_arc(cr, 0, 0, 1, 0, 2 * M_PI);
     cairo_restore(cr);
     break;
+
+  case GCode::ToolShape::TS_PROFILE: {
+    // Up the right side from the tip and back down the left
+    const vector<Vector2D> &profile = tool.getProfile();
+
+    for (unsigned i = 0; i < profile.size(); i++)
+      cairo_line_to(cr, w / 2.0 + profile[i].x(), y + length - profile[i].y());
+
+    for (unsigned i = profile.size(); i; i--)
+      cairo_line_to(cr, w / 2.0 - profile[i - 1].x(),
+                    y + length - profile[i - 1].y());
+
+    cairo_close_path(cr);
+    break;
+  }
   }
 
   cairo_fill(cr);
@@ -0,0 +1,204 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "ToolPathLOD.h"
+
+#include <cbang/Exception.h>
+#include <cbang/log/Logger.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+namespace {
+  double distanceSquared(const Vector3F &p, const Vector3F &a,
+                         const Vector3F &b) {
+    Vector3F ab = b - a;
+    Vector3F ap = p - a;
+    double len2 = ab.dot(ab);
+    if (!len2) return ap.dot(ap);
+
+    double t = ap.dot(ab) / len2;
+    if (t < 0) t = 0;
+    else if (1 < t) t = 1;
+
+    Vector3F d = ap - ab * t;
+    return d.dot(d);
+  }
+}
+
+
+ToolPathLOD::ToolPathLOD(vector<float> &vertices, vector<uint8_t> &colors,
+                         const vector<unsigned> &runs, double tolerance,
+                         unsigned maxLevels) :
+  runs(runs), tolerance(tolerance), maxLevels(maxLevels), stopped(false) {
+  this->vertices.swap(vertices);
+  this->colors.swap(colors);
+}
+
+
+const ToolPathLOD::Level *ToolPathLOD::find(double tolerance) const {
+  const Level *level = 0;
+
+  for (unsigned i = 0; i < levels.size(); i++)
+    if (levels[i].tolerance <= tolerance) level = &levels[i];
+
+  return level;
+}
+
+
+void ToolPathLOD::run() {
+  try {
+    Polyline line;
+    load(line);
+
+    // The full detail geometry is no longer needed
+    vector<float>().swap(vertices);
+    vector<uint8_t>().swap(colors);
+
+    unsigned lastCount = line.points.size();
+    double tolerance = this->tolerance;
+
+    for (unsigned i = 0; i < maxLevels && !stopped; i++) {
+      Polyline simple;
+      simplify(line, simple, tolerance);
+      line.points.swap(simple.points);
+      line.runs.swap(simple.runs);
+      line.runColors.swap(simple.runColors);
+
+      // Only keep levels which save at least a quarter of the lines
+      unsigned count = line.points.size();
+      if (count < lastCount * 0.75) {
+        levels.push_back(Level());
+        levels.back().tolerance = tolerance;
+        build(line, levels.back());
+        lastCount = count;
+      }
+
+      tolerance *= 4;
+    }
+
+    LOG_DEBUG(3, "Built " << levels.size() << " tool path detail levels");
+  } CATCH_WARNING;
+}
+
+
+void ToolPathLOD::load(Polyline &line) const {
+  unsigned count = vertices.size() / 3;
+  unsigned run = 0;
+
+  for (unsigned v = 0; v < count && !stopped; v += 2) {
+    Vector3F p1(vertices[v * 3], vertices[v * 3 + 1], vertices[v * 3 + 2]);
+    Vector3F p2(vertices[v * 3 + 3], vertices[v * 3 + 4], vertices[v * 3 + 5]);
+
+    bool start = run < runs.size() && runs[run] == v;
+    if (start) run++;
+
+    // Also break runs where the path is not connected
+    if (start || line.points.empty() || line.points.back().p != p1) {
+      unsigned color;
+      memcpy(&color, &colors[v * 4], 4);
+
+      line.runs.push_back(line.points.size());
+      line.runColors.push_back(color);
+      line.points.push_back(Point(p1, v));
+    }
+
+    line.points.push_back(Point(p2, v + 2));
+  }
+
+  line.runs.push_back(line.points.size());
+}
+
+
+void ToolPathLOD::simplify(const Polyline &in, Polyline &out,
+                           double tolerance) const {
+  double tolerance2 = tolerance * tolerance;
+  const vector<Point> &points = in.points;
+  vector<bool> keep(points.size());
+  vector<pair<unsigned, unsigned> > stack;
+
+  for (unsigned r = 0; r + 1 < in.runs.size() && !stopped; r++) {
+    unsigned first = in.runs[r];
+    unsigned last = in.runs[r + 1] - 1;
+
+    keep[first] = keep[last] = true;
+    stack.push_back(make_pair(first, last));
+
+    while (!stack.empty()) {
+      unsigned a = stack.back().first;
+      unsigned b = stack.back().second;
+      stack.pop_back();
+
+      double maxDist = 0;
+      unsigned index = a;
+
+      for (unsigned i = a + 1; i < b; i++) {
+        double d = distanceSquared(points[i].p, points[a].p, points[b].p);
+        if (maxDist < d) {maxDist = d; index = i;}
+      }
+
+      if (tolerance2 < maxDist) {
+        keep[index] = true;
+        stack.push_back(make_pair(a, index));
+        stack.push_back(make_pair(index, b));
+      }
+    }
+
+    out.runs.push_back(out.points.size());
+    out.runColors.push_back(in.runColors[r]);
+
+    for (unsigned i = first; i <= last; i++)
+      if (keep[i]) out.points.push_back(points[i]);
+  }
+
+  out.runs.push_back(out.points.size());
+}
+
+
+void ToolPathLOD::build(const Polyline &line, Level &level) const {
+  unsigned lines = line.points.size() - (line.runs.size() - 1);
+
+  level.vertices.reserve(lines * 6);
+  level.colors.reserve(lines * 8);
+  level.ends.reserve(lines);
+
+  for (unsigned r = 0; r + 1 < line.runs.size(); r++) {
+    uint8_t color[4];
+    memcpy(color, &line.runColors[r], 4);
+
+    for (unsigned i = line.runs[r] + 1; i < line.runs[r + 1]; i++) {
+      const Point &p1 = line.points[i - 1];
+      const Point &p2 = line.points[i];
+
+      for (unsigned j = 0; j < 3; j++) level.vertices.push_back(p1.p[j]);
+      for (unsigned j = 0; j < 3; j++) level.vertices.push_back(p2.p[j]);
+
+      level.colors.insert(level.colors.end(), color, color + 4);
+      level.colors.insert(level.colors.end(), color, color + 4);
+
+      level.ends.push_back(p2.end);
+    }
+  }
+}
@@ -0,0 +1,99 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include <cbang/StdTypes.h>
+#include <cbang/os/Thread.h>
+#include <cbang/geom/Vector.h>
+
+#include <vector>
+
+
+namespace CAMotics {
+  /***
+   * Builds simplified copies of a tool path's line geometry in a background
+   * thread.  Each level is a Douglas-Peucker simplification of the one
+   * before it with four times the tolerance.  Points are only dropped within
+   * a run of moves with the same tool and move type, so color changes and
+   * tool changes stay where they are.
+   *
+   * For each line a level records how many vertices of the full detail
+   * geometry it covers so that any prefix of the path can be drawn as a
+   * simplified prefix followed by a short full detail remainder.
+   */
+  class ToolPathLOD : public cb::Thread {
+  public:
+    struct Level {
+      double tolerance;
+      std::vector<float> vertices;
+      std::vector<uint8_t> colors; ///< RGBA
+      std::vector<unsigned> ends;  ///< Full detail vertices covered per line
+    };
+
+  protected:
+    struct Point {
+      cb::Vector3F p;
+      unsigned end; ///< Full detail vertices covered up to this point
+      Point(const cb::Vector3F &p, unsigned end) : p(p), end(end) {}
+    };
+
+    struct Polyline {
+      std::vector<Point> points;
+      std::vector<unsigned> runs; ///< Start of each run, plus the end
+      std::vector<unsigned> runColors;
+    };
+
+    std::vector<float> vertices;
+    std::vector<uint8_t> colors;
+    std::vector<unsigned> runs;
+    double tolerance;
+    unsigned maxLevels;
+
+    std::vector<Level> levels;
+    bool stopped;
+
+  public:
+    /***
+     * @param vertices, colors the full detail GL_LINES geometry.  They are
+     * swapped out of the vectors passed in.
+     * @param runs the first vertex of each tool and move type run.
+     * @param tolerance of the finest level.
+     */
+    ToolPathLOD(std::vector<float> &vertices, std::vector<uint8_t> &colors,
+                const std::vector<unsigned> &runs, double tolerance,
+                unsigned maxLevels = 5);
+
+    /// Only valid once the thread is done.
+    std::vector<Level> &getLevels() {return levels;}
+
+    /// @return the coarsest level finer than @param tolerance or null.
+    const Level *find(double tolerance) const;
+
+    // From Thread
+    void run();
+    void stop() {stopped = true;}
+
+  protected:
+    void load(Polyline &line) const;
+    void simplify(const Polyline &in, Polyline &out, double tolerance) const;
+    void build(const Polyline &line, Level &level) const;
+  };
+}
@@ -26,6 +26,8 @@
 #include <cbang/log/Logger.h>
 
 #include <limits>
+#include <cmath>
+#include <algorithm>
 
 using namespace std;
 using namespace cb;
@@ -34,8 +36,10 @@ using namespace CAMotics;
 
 ToolPathView::ToolPathView(ValueSet &valueSet) :
   values(valueSet), byRemote(true), ratio(1), line(0), currentTime(0),
-  currentDistance(0), currentLine(0), dirty(true), colorVBuf(0), vertexVBuf(0),
-  numVertices(0), numColors(0), useVBOs(true) {
+  currentDistance(0), currentLine(0), dirty(true), pathDirty(true),
+  hiddenTypes(0), onlyTool(-1), firstLine(0), lastLine(0), filterDirty(true),
+  colorVBuf(0), vertexVBuf(0), numVertices(0),
+  lodLoaded(false), useVBOs(true) {
 
   values.add("x", currentPosition.x());
   values.add("y", currentPosition.y());
@@ -61,6 +65,8 @@ ToolPathView::ToolPathView(ValueSet &valueSet) :
 
 
 ToolPathView::~ToolPathView() {
+  clearLOD();
+
   GLFuncs &glFuncs = getGLFuncs();
 
   if (colorVBuf) glFuncs.glDeleteBuffers(1, &colorVBuf);
@@ -72,9 +78,10 @@ void ToolPathView::setPath(const SmartPointer<const GCode::ToolPath> &path,
                            bool withVBOs) {
   this->path = path;
   useVBOs = haveVBOs() && withVBOs;
+  rates.clear();
 
   currentMove = GCode::Move();
-  dirty = true;
+  dirty = pathDirty = true;
   update();
 
   if (path.isNull() || path->empty()) return;
@@ -86,6 +93,44 @@ void ToolPathView::setPath(const SmartPointer<const GCode::ToolPath> &path,
 }
 
 
+void ToolPathView::setShowMoveType(GCode::MoveType type, bool show) {
+  unsigned types = show ? hiddenTypes & ~(1 << type) : hiddenTypes | 1 << type;
+
+  if (types != hiddenTypes) {
+    hiddenTypes = types;
+    filterDirty = dirty = true;
+  }
+}
+
+
+void ToolPathView::setOnlyTool(int tool) {
+  if (tool < 0) tool = -1;
+
+  if (onlyTool != tool) {
+    onlyTool = tool;
+    filterDirty = dirty = true;
+  }
+}
+
+
+void ToolPathView::setLineRange(unsigned first, unsigned last) {
+  if (firstLine != first || lastLine != last) {
+    firstLine = first;
+    lastLine = last;
+    filterDirty = dirty = true;
+  }
+}
+
+
+bool ToolPathView::isShown(const GCode::Move &move) const {
+  if (hiddenTypes & (1 << move.getType())) return false;
+  if (0 <= onlyTool && move.getTool() != onlyTool) return false;
+
+  unsigned line = move.getLine() + 1; // EMC2 counts from 0
+  return (!firstLine || firstLine <= line) && (!lastLine || line <= lastLine);
+}
+
+
 void ToolPathView::setByRatio(double ratio) {
   if (byRemote || this->ratio != ratio) {
     this->ratio = ratio;
@@ -95,6 +140,19 @@ void ToolPathView::setByRatio(double ratio) {
 }
 
 
+void ToolPathView::setRemovalRates(const vector<double> &rates) {
+  double maxRate = 0;
+  for (unsigned i = 0; i < rates.size(); i++)
+    maxRate = max(maxRate, rates[i]);
+
+  this->rates.clear();
+  for (unsigned i = 0; maxRate && i < rates.size(); i++)
+    this->rates.push_back(rates[i] / maxRate);
+
+  dirty = pathDirty = true;
+}
+
+
 void ToolPathView::setByRemote(const cb::Vector3D &position, unsigned line) {
   if (!byRemote || this->position != position || this->line != line) {
     byRemote = true;
@@ -136,78 +194,109 @@ Color ToolPathView::getColor(GCode::MoveType type) {
 }
 
 
-void ToolPathView::update() {
-  if (!dirty || !QOpenGLContext::currentContext()) return;
+Color ToolPathView::getColor(unsigned index) {
+  const GCode::Move &move = path->at(index);
 
-  currentTime = 0;
-  currentDistance = 0;
-  currentPosition = byRemote ? position : cb::Vector3D();
-  currentLine = 0;
-  currentMove = GCode::Move();
+  if (index < rates.size() &&
+      move.getType() == GCode::MoveType::MOVE_CUTTING) {
+    // Blue through green to red as the rate rises
+    float r = rates[index];
+    if (r < 0.5) return Color(0, 2 * r, 1 - 2 * r);
+    return Color(2 * r - 1, 2 - 2 * r, 0);
+  }
+
+  return getColor(move.getType());
+}
+
+
+void ToolPathView::addMove(unsigned index, const cb::Vector3D &end,
+                           double u, vector<float> &vertices,
+                           vector<uint8_t> &colors) {
+  const GCode::Move &move = path->at(index);
+
+  // Arcs as chords of at most 1/64th of a turn
+  Color color = getColor(index);
+  unsigned segments = ceil(fabs(move.getAngle()) * u / (M_PI / 32));
+  if (!segments) segments = 1;
+  cb::Vector3D p1 = move.getStartPt();
+
+  uint8_t rgba[4];
+  for (unsigned i = 0; i < 4; i++) rgba[i] = color[i] * 255;
+
+  for (unsigned j = 1; j <= segments; j++) {
+    cb::Vector3D p2 = j == segments ? end : move.getPtAt(u * j / segments);
+
+    colors.insert(colors.end(), rgba, rgba + 4);
+    colors.insert(colors.end(), rgba, rgba + 4);
+
+    for (unsigned i = 0; i < 3; i++) vertices.push_back(p1[i]);
+    for (unsigned i = 0; i < 3; i++) vertices.push_back(p2[i]);
+
+    p1 = p2;
+  }
+}
+
+
+void ToolPathView::updatePath() {
+  clearLOD();
 
   vertices.clear();
   colors.clear();
+  firstVertex.clear();
+  distances.clear();
+  runs.clear();
+
+  double distance = 0;
+  vector<unsigned> runVertices; // For the levels of detail
+
+  if (!path.isNull()) {
+    // Straight moves take one line, arcs more
+    unsigned lines = path->size();
+    for (unsigned i = 0; i < path->size(); i++)
+      if (path->at(i).isArc())
+        lines += ceil(fabs(path->at(i).getAngle()) / (M_PI / 32));
+
+    vertices.reserve(lines * 6);
+    colors.reserve(lines * 8);
+    firstVertex.reserve(path->size() + 1);
+    distances.reserve(path->size());
+  }
 
-  // Find position on path
-  GCode::ToolPath::const_iterator it;
   if (!path.isNull())
-    for (it = path->begin(); it != path->end(); it++) {
-      GCode::Move move = *it;
-      currentMove = move;
-
-      const cb::Vector3D &start = move.getStartPt();
-      cb::Vector3D end = move.getEndPt();
-      double moveTime = move.getTime();
-      double moveDistance = move.getDistance();
-      uint32_t moveLine = move.getLine() + 1; // EMC2 counts from zero
-      bool partial = false;
-
-      if (byRemote) {
-        if (line < moveLine && !(byRemote && line < 1)) break; // Too far
-        if (line == moveLine) {
-          double distance = move.distance(position, end);
-
-          // TODO should find the closest point on the closest move at this line
-          if (distance < 0.00001) {
-            double delta = start.distance(end);
-            moveTime *= delta / moveDistance;
-            moveDistance = delta;
-            partial = true;
-          }
-        }
-      } else {
-        double time = ratio * getTotalTime();
-        if (time < currentTime + moveTime) {
-          double delta = time - currentTime;
-          end = move.getPtAtTime(time);
-          moveDistance *= delta / moveTime;
-          moveTime = delta;
-          partial = true;
-        }
-      }
-      currentPosition = byRemote ? position : end;
-      currentLine = moveLine;
-      currentTime += moveTime;
-      currentDistance += moveDistance;
-
-      // Store GL data
-      Color color = getColor(move.getType());
-      for (unsigned i = 0; i < 3; i++) {
-        colors.push_back(color[i]);
-        vertices.push_back(start[i]);
-      }
-
-      for (unsigned i = 0; i < 3; i++) {
-        colors.push_back(color[i]);
-        vertices.push_back(end[i]);
+    for (unsigned i = 0; i < path->size(); i++) {
+      const GCode::Move &move = path->at(i);
+
+      if (!i || move.getType() != path->at(i - 1).getType() ||
+          move.getTool() != path->at(i - 1).getTool()) {
+        Run run = {i, (unsigned)vertices.size() / 3, move.getTool(),
+                   move.getType()};
+        runs.push_back(run);
+        runVertices.push_back(run.vertex);
       }
 
-      if (partial) break;
+      firstVertex.push_back(vertices.size() / 3);
+      distances.push_back(distance);
+      addMove(i, move.getEndPt(), 1, vertices, colors);
+      distance += move.getDistance();
     }
 
-  numColors = colors.size() / 3;
+  firstVertex.push_back(vertices.size() / 3);
   numVertices = vertices.size() / 3;
 
+  indexLines();
+
+  // Large paths also get simplified levels, built in the background.  The
+  // finest is good for about a pixel when the whole path is in view.
+  const unsigned minLODLines = 1 << 16;
+  vector<float> lodVertices;
+  vector<uint8_t> lodColors;
+  bool buildLOD = minLODLines <= numVertices / 2;
+
+  if (buildLOD && !useVBOs) {
+    lodVertices = vertices;
+    lodColors = colors;
+  }
+
   // Setup GL Buffers
   GLFuncs &glFuncs = getGLFuncs();
 
@@ -215,9 +304,10 @@ void ToolPathView::update() {
   if (useVBOs && !colors.empty()) {
     if (!colorVBuf) glFuncs.glGenBuffers(1, &colorVBuf);
     glFuncs.glBindBuffer(GL_ARRAY_BUFFER, colorVBuf);
-    glFuncs.glBufferData(GL_ARRAY_BUFFER, numColors * 3 * sizeof(float),
-                          &colors[0], GL_STATIC_DRAW);
-    colors.clear();
+    glFuncs.glBufferData(GL_ARRAY_BUFFER, colors.size(), &colors[0],
+                          GL_STATIC_DRAW);
+    lodColors.swap(colors);
+    vector<uint8_t>().swap(colors);
   }
 
   // Vertices
@@ -226,42 +316,309 @@ void ToolPathView::update() {
     glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vertexVBuf);
     glFuncs.glBufferData(GL_ARRAY_BUFFER, numVertices * 3 * sizeof(float),
                           &vertices[0], GL_STATIC_DRAW);
-    vertices.clear();
+    lodVertices.swap(vertices);
+    vector<float>().swap(vertices);
   }
 
-  values.updated();
-  dirty = false;
+  if (useVBOs) glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (buildLOD) {
+    cb::Vector3D dims = getBounds().getDimensions();
+    double radius = max(dims.x(), max(dims.y(), dims.z()));
+
+    lod = new ToolPathLOD(lodVertices, lodColors, runVertices, radius / 4096);
+    lod->start();
+  }
+
+  pathDirty = false;
+  filterDirty = true;
 }
 
 
-void ToolPathView::draw() {
-  if (path.isNull()) return;
-  update();
+void ToolPathView::indexLines() {
+  unsigned size = path.isNull() ? 0 : path->size();
+  unsigned maxLine = 0;
+
+  for (unsigned i = 0; i < size; i++)
+    maxLine = max(maxLine, path->at(i).getLine() + 1); // EMC2 counts from 0
+
+  // Count the moves of each line then place them, a counting sort
+  lineOffsets.assign(maxLine + 2, 0);
+  for (unsigned i = 0; i < size; i++)
+    lineOffsets[path->at(i).getLine() + 2]++;
+
+  for (unsigned l = 1; l < lineOffsets.size(); l++)
+    lineOffsets[l] += lineOffsets[l - 1];
+
+  lineMoves.resize(size);
+  vector<unsigned> fill(lineOffsets.begin(), lineOffsets.end() - 1);
+  for (unsigned i = 0; i < size; i++)
+    lineMoves[fill[path->at(i).getLine() + 1]++] = i;
+}
+
+
+void ToolPathView::addRange(unsigned first, unsigned end) {
+  if (first == end) return;
+
+  // Join ranges which meet
+  if (!drawFirst.empty() &&
+      (unsigned)(drawFirst.back() + drawCount.back()) == first)
+    drawCount.back() += end - first;
+
+  else {
+    drawFirst.push_back(first);
+    drawCount.push_back(end - first);
+  }
+}
+
+
+void ToolPathView::updateFilter() {
+  drawFirst.clear();
+  drawCount.clear();
+  filterDirty = false;
+
+  if (!isFiltered()) return;
 
-  if (!numColors || !numVertices) return;
+  for (unsigned i = 0; i < runs.size(); i++) {
+    const Run &run = runs[i];
+    if (hiddenTypes & (1 << run.type)) continue;
+    if (0 <= onlyTool && run.tool != onlyTool) continue;
+
+    unsigned end = i + 1 < runs.size() ? runs[i + 1].move : path->size();
+
+    // Only a line range needs the moves of the run
+    if (!firstLine && !lastLine) addRange(run.vertex, firstVertex[end]);
+    else
+      for (unsigned j = run.move; j < end; j++)
+        if (isShown(path->at(j))) addRange(firstVertex[j], firstVertex[j + 1]);
+  }
+}
+
+
+void ToolPathView::clearLOD() {
+  if (lod.isNull()) return;
+
+  lod->stop();
+  lod->join();
+  lod.release();
+
+  if (!lodVBufs.empty())
+    getGLFuncs().glDeleteBuffers(lodVBufs.size(), &lodVBufs[0]);
+  lodVBufs.clear();
+  lodLoaded = false;
+}
+
+
+void ToolPathView::loadLOD() {
+  if (lodLoaded || lod.isNull() ||
+      lod->getState() != cb::Thread::THREAD_DONE) return;
+
+  lodLoaded = true;
+  if (!useVBOs) return;
 
   GLFuncs &glFuncs = getGLFuncs();
+  vector<ToolPathLOD::Level> &levels = lod->getLevels();
 
-  if (useVBOs) {
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, colorVBuf);
-    glFuncs.glColorPointer(3, GL_FLOAT, 0, 0);
+  if (levels.empty()) return;
+  lodVBufs.resize(levels.size() * 2);
+  glFuncs.glGenBuffers(lodVBufs.size(), &lodVBufs[0]);
 
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vertexVBuf);
-    glFuncs.glVertexPointer(3, GL_FLOAT, 0, 0);
+  for (unsigned i = 0; i < levels.size(); i++) {
+    ToolPathLOD::Level &level = levels[i];
+
+    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, lodVBufs[i * 2]);
+    glFuncs.glBufferData(GL_ARRAY_BUFFER, level.colors.size(),
+                         &level.colors[0], GL_STATIC_DRAW);
+    vector<uint8_t>().swap(level.colors);
+
+    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, lodVBufs[i * 2 + 1]);
+    glFuncs.glBufferData(GL_ARRAY_BUFFER,
+                         level.vertices.size() * sizeof(float),
+                         &level.vertices[0], GL_STATIC_DRAW);
+    vector<float>().swap(level.vertices);
+  }
+
+  glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void ToolPathView::update() {
+  if (!dirty || !QOpenGLContext::currentContext()) return;
+  if (pathDirty) updatePath();
+  if (filterDirty) updateFilter();
+
+  currentTime = 0;
+  currentDistance = 0;
+  currentPosition = byRemote ? position : cb::Vector3D();
+  currentLine = 0;
+  currentMove = GCode::Move();
+
+  partialVertices.clear();
+  partialColors.clear();
+
+  unsigned size = path.isNull() ? 0 : path->size();
+  unsigned full = size; // Moves drawn in full
+  bool partial = false;
+  cb::Vector3D end;
+  double u = 1;
+  double fraction = 1; // Of the partial move's time and distance
+
+  // Find position on path
+  if (byRemote) {
+    if (0 < line && line + 1 < lineOffsets.size()) {
+      // The closest point on the closest move of this line
+      double best = numeric_limits<double>::max();
+
+      for (unsigned j = lineOffsets[line]; j < lineOffsets[line + 1]; j++) {
+        const GCode::Move &move = path->at(lineMoves[j]);
+        cb::Vector3D closest;
+        double d = move.distance(position, closest);
+
+        if (d < best) {
+          double length = move.getDistance();
+          fraction = length ? move.getStartPt().distance(closest) / length : 0;
+          full = lineMoves[j];
+          end = closest;
+          partial = true;
+          best = d;
+        }
+      }
+
+      // Otherwise up to the first move of a later line
+      if (!partial && lineOffsets[line + 1] < lineMoves.size())
+        full = lineMoves[lineOffsets[line + 1]];
+    }
+
+  } else if (size) {
+    double time = ratio * getTotalTime();
+    int i = path->find(time);
+
+    if (0 <= i) {
+      const GCode::Move &move = path->at(i);
 
-    glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+      full = i;
+      partial = true;
+      end = move.getPtAtTime(time);
+      u = move.getFractionAtTime(time);
+      fraction = move.getTime() ? (time - move.getStartTime()) / move.getTime()
+        : 1;
 
-  } else {
-    glFuncs.glColorPointer(3, GL_FLOAT, 0, &colors[0]);
-    glFuncs.glVertexPointer(3, GL_FLOAT, 0, &vertices[0]);
+    } else if (time < path->at(0).getStartTime()) full = 0;
   }
 
+  if (partial) {
+    const GCode::Move &move = path->at(full);
+
+    currentMove = move;
+    currentPosition = byRemote ? position : end;
+    currentLine = move.getLine() + 1;
+    currentTime = move.getStartTime() + move.getTime() * fraction;
+    currentDistance = distances[full] + move.getDistance() * fraction;
+
+    if (isShown(move)) addMove(full, end, u, partialVertices, partialColors);
+
+  } else if (full) {
+    const GCode::Move &move = path->at(full - 1);
+
+    currentMove = move;
+    if (!byRemote) currentPosition = move.getEndPt();
+    currentLine = move.getLine() + 1;
+    currentTime = move.getEndTime();
+    currentDistance = distances[full - 1] + move.getDistance();
+  }
+
+  numVertices = firstVertex[full];
+
+  values.markDirty(); // Flushed once per frame
+  dirty = false;
+}
+
+
+void ToolPathView::draw(double pixelSize) {
+  if (path.isNull()) return;
+  update();
+  loadLOD();
+
+  GLFuncs &glFuncs = getGLFuncs();
+
   glFuncs.glEnableClientState(GL_VERTEX_ARRAY);
   glFuncs.glEnableClientState(GL_COLOR_ARRAY);
-
-  // Draw
   glFuncs.glLineWidth(1);
-  glFuncs.glDrawArrays(GL_LINES, 0, numVertices);
+
+  // Simplified moves, if they would be within half a pixel.  They merge
+  // moves the filters may tell apart, so filtered paths are drawn in full.
+  const ToolPathLOD::Level *level = lodLoaded && pixelSize && !isFiltered() ?
+    lod->find(pixelSize / 2) : 0;
+  unsigned first = 0; // Full detail vertices already covered
+
+  if (level) {
+    const vector<unsigned> &ends = level->ends;
+    unsigned lines =
+      upper_bound(ends.begin(), ends.end(), numVertices) - ends.begin();
+
+    if (lines) {
+      if (useVBOs) {
+        unsigned i = level - &lod->getLevels()[0];
+
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, lodVBufs[i * 2]);
+        glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0, 0);
+
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, lodVBufs[i * 2 + 1]);
+        glFuncs.glVertexPointer(3, GL_FLOAT, 0, 0);
+
+        glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      } else {
+        glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0, &level->colors[0]);
+        glFuncs.glVertexPointer(3, GL_FLOAT, 0, &level->vertices[0]);
+      }
+
+      glFuncs.glDrawArrays(GL_LINES, 0, lines * 2);
+      first = ends[lines - 1];
+    }
+  }
+
+  // The rest of the moves already travelled in full
+  if (first < numVertices) {
+    if (useVBOs) {
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, colorVBuf);
+      glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0, 0);
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, vertexVBuf);
+      glFuncs.glVertexPointer(3, GL_FLOAT, 0, 0);
+
+      glFuncs.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    } else {
+      glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0, &colors[0]);
+      glFuncs.glVertexPointer(3, GL_FLOAT, 0, &vertices[0]);
+    }
+
+    if (!isFiltered())
+      glFuncs.glDrawArrays(GL_LINES, first, numVertices - first);
+
+    else {
+      // The ranges shown which start before the current move
+      unsigned ranges = lower_bound(drawFirst.begin(), drawFirst.end(),
+                                    (int)numVertices) - drawFirst.begin();
+
+      if (ranges) {
+        int count = drawCount[ranges - 1];
+        drawCount[ranges - 1] =
+          min(count, (int)numVertices - drawFirst[ranges - 1]);
+        glFuncs.glMultiDrawArrays(GL_LINES, &drawFirst[0], &drawCount[0],
+                                  ranges);
+        drawCount[ranges - 1] = count;
+      }
+    }
+  }
+
+  // The current move
+  if (!partialVertices.empty()) {
+    glFuncs.glColorPointer(4, GL_UNSIGNED_BYTE, 0, &partialColors[0]);
+    glFuncs.glVertexPointer(3, GL_FLOAT, 0, &partialVertices[0]);
+    glFuncs.glDrawArrays(GL_LINES, 0, partialVertices.size() / 3);
+  }
 
   glFuncs.glDisableClientState(GL_VERTEX_ARRAY);
   glFuncs.glDisableClientState(GL_COLOR_ARRAY);
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "Color.h"
+#include "ToolPathLOD.h"
 
 #include <gcode/ToolPath.h>
 #include <camotics/value/ValueGroup.h>
@@ -47,14 +48,54 @@ namespace CAMotics {
     GCode::Move currentMove;
 
     bool dirty;
+    bool pathDirty;
 
+    // The whole path is built once, then each update only finds the current
+    // move and builds the part of it already travelled.
     std::vector<float> vertices;
-    std::vector<float> colors;
+    std::vector<uint8_t> colors; ///< RGBA
+    std::vector<unsigned> firstVertex; ///< Per move, plus one past the end
+    std::vector<double> distances;     ///< Distance before each move
+    std::vector<float> rates; ///< Per move removal rate, from zero to one
+
+    std::vector<float> partialVertices;
+    std::vector<uint8_t> partialColors;
+
+    // Moves by program line, counting from one, for remote positions.  The
+    // moves of line l are lineMoves[lineOffsets[l]] up to, but excluding,
+    // lineMoves[lineOffsets[l + 1]], in path order.
+    std::vector<unsigned> lineOffsets;
+    std::vector<unsigned> lineMoves;
+
+    // Runs of moves with one tool and move type, in path order
+    struct Run {
+      unsigned move;   ///< First move
+      unsigned vertex; ///< First vertex
+      int tool;
+      GCode::MoveType type;
+    };
+    std::vector<Run> runs;
+
+    // Moves shown, by move type, tool and program line
+    unsigned hiddenTypes; ///< A bit per GCode::MoveType
+    int onlyTool;         ///< Or negative for all
+    unsigned firstLine;   ///< Counting from one, zero for no limit
+    unsigned lastLine;
+    bool filterDirty;
+
+    // The vertex ranges of the runs shown, in path order, drawn from the
+    // same buffers as the whole path
+    std::vector<int> drawFirst;
+    std::vector<int> drawCount;
 
     unsigned colorVBuf;
     unsigned vertexVBuf;
     unsigned numVertices;
-    unsigned numColors;
+
+    // Simplified geometry for large paths seen from afar
+    cb::SmartPointer<ToolPathLOD> lod;
+    bool lodLoaded;
+    std::vector<unsigned> lodVBufs; ///< Color and vertex buffer per level
 
     bool useVBOs;
 
@@ -71,8 +112,29 @@ namespace CAMotics {
     cb::Rectangle3D getBounds() const
     {return path.isNull() ? cb::Rectangle3D() : path->getBounds();}
 
+    /// Color cutting moves by their material removal rate, per move, or by
+    /// move type if @param rates is empty.
+    void setRemovalRates(const std::vector<double> &rates);
+
+    /// Show or hide the moves of @param type.
+    void setShowMoveType(GCode::MoveType type, bool show);
+    bool getShowMoveType(GCode::MoveType type) const
+    {return !(hiddenTypes & (1 << type));}
+    /// Show only the moves of @param tool, or all if it is negative.
+    void setOnlyTool(int tool);
+    int getOnlyTool() const {return onlyTool;}
+    /// Show only the moves of program lines @param first to @param last,
+    /// counting from one.  Zero leaves that end open.
+    void setLineRange(unsigned first, unsigned last);
+    /// @return true if any moves are hidden by the filters.
+    bool isFiltered() const
+    {return hiddenTypes || 0 <= onlyTool || firstLine || lastLine;}
+    bool isShown(const GCode::Move &move) const;
+
     void setByRatio(double ratio);
     void setByRemote(const cb::Vector3D &position, unsigned line);
+    /// @return true if following a remote machine rather than a ratio.
+    bool isByRemote() const {return byRemote;}
 
     void incTime(double amount = 1);
     void decTime(double amount = 1);
@@ -103,8 +165,22 @@ namespace CAMotics {
     const char *getDirection() const;
 
     Color getColor(GCode::MoveType type);
+    Color getColor(unsigned index);
 
     void update();
-    void draw();
+
+    /// @param pixelSize the size of a pixel in path units or zero for full
+    /// detail.
+    void draw(double pixelSize = 0);
+
+  protected:
+    void addMove(unsigned index, const cb::Vector3D &end, double u,
+                 std::vector<float> &vertices, std::vector<uint8_t> &colors);
+    void updatePath();
+    void indexLines();
+    void addRange(unsigned first, unsigned end);
+    void updateFilter();
+    void clearLOD();
+    void loadLOD();
   };
 }
@@ -48,7 +48,38 @@ namespace {
 }
 
 
-void ToolView::draw() {
+ToolView::ToolView() :
+  shape(GCode::ToolShape::TS_CYLINDRICAL), radius(0), length(0),
+  snubDiameter(0), list(0) {}
+
+
+ToolView::~ToolView() {
+  if (list && QOpenGLContext::currentContext())
+    getGLFuncs().glDeleteLists(list, 1);
+}
+
+
+void ToolView::draw(const GCode::Tool &tool, const cb::Vector3D &position) {
+  GLFuncs &glFuncs = getGLFuncs();
+
+  if (!list || tool.getShape() != shape || tool.getRadius() != radius ||
+      tool.getLength() != length || tool.getSnubDiameter() != snubDiameter) {
+    shape = tool.getShape();
+    radius = tool.getRadius();
+    length = tool.getLength();
+    snubDiameter = tool.getSnubDiameter();
+
+    build(tool);
+  }
+
+  glFuncs.glPushMatrix();
+  glFuncs.glTranslatef(position.x(), position.y(), position.z());
+  glFuncs.glCallList(list);
+  glFuncs.glPopMatrix();
+}
+
+
+void ToolView::build(const GCode::Tool &tool) {
   double diameter = tool.getDiameter();
   double radius = tool.getRadius();
   double length = tool.getLength();
@@ -56,8 +87,8 @@ void ToolView::draw() {
 
   GLFuncs &glFuncs = getGLFuncs();
 
-  glFuncs.glPushMatrix();
-  glFuncs.glTranslatef(position.x(), position.y(), position.z());
+  if (!list) list = glFuncs.glGenLists(1);
+  glFuncs.glNewList(list, GL_COMPILE);
 
   if (radius <= 0) {
     // Default tool specs
@@ -95,9 +126,28 @@ void ToolView::draw() {
 
   case GCode::ToolShape::TS_CONICAL: drawCylinder(0, radius, length); break;
 
+  case GCode::ToolShape::TS_PROFILE: {
+    const std::vector<cb::Vector2D> &profile = tool.getProfile();
+    if (profile.size() < 2) {
+      drawCylinder(radius, radius, length);
+      break;
+    }
+
+    glFuncs.glPushMatrix();
+    for (unsigned i = 1; i < profile.size(); i++) {
+      double height = profile[i].y() - profile[i - 1].y();
+      if (!height) continue;
+
+      drawCylinder(profile[i - 1].x(), profile[i].x(), height);
+      glFuncs.glTranslatef(0, 0, height);
+    }
+    glFuncs.glPopMatrix();
+    break;
+  }
+
   case GCode::ToolShape::TS_CYLINDRICAL:
   default: drawCylinder(radius, radius, length); break;
   }
 
-  glFuncs.glPopMatrix();
+  glFuncs.glEndList();
 }
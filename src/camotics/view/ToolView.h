@@ -25,14 +25,22 @@
 
 
 namespace CAMotics {
+  /// Draws the current tool.  Its geometry is compiled into a display list
+  /// the first time a tool is seen so animation frames only move it.
   class ToolView {
-    const GCode::Tool &tool;
-    const cb::Vector3D &position;
+    GCode::ToolShape shape;
+    double radius;
+    double length;
+    double snubDiameter;
+    unsigned list;
 
   public:
-    ToolView(const GCode::Tool &tool,
-             const cb::Vector3D &position) : tool(tool), position(position) {}
+    ToolView();
+    ~ToolView();
 
-    void draw();
+    void draw(const GCode::Tool &tool, const cb::Vector3D &position);
+
+  protected:
+    void build(const GCode::Tool &tool);
   };
 }
@@ -62,6 +62,7 @@ void View::decSpeed() {
 
 void View::setToolPath(const SmartPointer<GCode::ToolPath> &toolPath) {
   path->setPath(toolPath, flags & PATH_VBOS_FLAG);
+  picker.setPath(toolPath);
 }
 
 
@@ -72,11 +73,39 @@ void View::setWorkpiece(const cb::Rectangle3D &bounds) {
 
 void View::setSurface(const SmartPointer<Surface> &surface) {
   this->surface = surface;
+  picker.setSurface(surface);
 }
 
 
 void View::setMoveLookup(const SmartPointer<MoveLookup> &moveLookup) {
   this->moveLookup = moveLookup;
+  picker.setMoveLookup(moveLookup);
+}
+
+
+cb::Rectangle3D View::getViewBounds() const {
+  cb::Rectangle3D bounds = path->getBounds();
+  if (!surface.isNull()) bounds.add(surface->getBounds());
+  bounds.add(workpiece->getBounds());
+  if (!machine.isNull() && isFlagSet(SHOW_MACHINE_FLAG))
+    bounds.add(machine->getBounds());
+
+  return bounds;
+}
+
+
+bool View::pick(int x, int y, Picker::Pick &pick) {
+  cb::Rectangle3D bounds = getViewBounds();
+  cb::Vector3D origin;
+  cb::Vector3D dir;
+  getRay(x, y, bounds, workpiece->getBounds().getCenter(), origin, dir);
+
+  // The path and surface are drawn moved with the machine
+  if (!machine.isNull() && isFlagSet(SHOW_MACHINE_FLAG))
+    origin -= machine->getWorkpiece() * path->getPosition();
+
+  double tolerance = getPixelSize(bounds) * 4;
+  return picker.pick(origin, dir, tolerance, isFlagSet(SHOW_PATH_FLAG), pick);
 }
 
 
@@ -24,6 +24,7 @@
 #include "ViewPort.h"
 #include "ToolPathView.h"
 #include "CuboidView.h"
+#include "Picker.h"
 
 #include <camotics/contour/Surface.h>
 #include <camotics/value/ValueGroup.h>
@@ -48,6 +49,8 @@ namespace CAMotics {
 
     double lastTime;
 
+    Picker picker;
+
   public:
     cb::SmartPointer<ToolPathView> path;
     cb::SmartPointer<CuboidView> workpiece;
@@ -94,6 +97,12 @@ namespace CAMotics {
     void setMoveLookup(const cb::SmartPointer<MoveLookup> &moveLookup);
     double getTime() const {return path.isNull() ? 0 : path->getTime();}
 
+    /// @return the bounds the view is drawn to fit.
+    cb::Rectangle3D getViewBounds() const;
+    /// @return true if something is drawn at window pixel @param x, @param y.
+    /// The point picked is in model coordinates.
+    bool pick(int x, int y, Picker::Pick &pick);
+
     bool update();
     void clear();
   };
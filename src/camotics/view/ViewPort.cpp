@@ -211,6 +211,13 @@ void ViewPort::resetView(char c) {
 }
 
 
+void ViewPort::spin(double angle) {
+  QuaternionD delta(AxisAngleD(angle, cb::Vector3D(0, 0, 1)));
+  rotationQuat = rotationQuat.multiply(delta.normalize()).normalize();
+  rotationQuat.toAxisAngle().toGLRotation(rotation);
+}
+
+
 void ViewPort::glInit() const {
   static const float ambient[]          = {0.50, 0.50, 0.50, 1.00};
   static const float diffuse[]          = {0.75, 0.75, 0.75, 1.00};
@@ -241,6 +248,52 @@ void ViewPort::glInit() const {
 }
 
 
+double ViewPort::getPixelSize(const cb::Rectangle3D &bbox) const {
+  cb::Vector3D dims = bbox.getDimensions();
+  double radius = dims.x() < dims.y() ? dims.y() : dims.x();
+  radius = dims.z() < radius ? radius : dims.z();
+
+  // The eye is radius / zoom from the center with a 45 degree field of view
+  return 2 * tan(M_PI / 8) * radius / zoom / height;
+}
+
+
+void ViewPort::getRay(int x, int y, const cb::Rectangle3D &bbox,
+                      const cb::Vector3D &center, cb::Vector3D &origin,
+                      cb::Vector3D &dir) const {
+  cb::Vector3D dims = bbox.getDimensions();
+  double radius = dims.x() < dims.y() ? dims.y() : dims.x();
+  radius = dims.z() < radius ? radius : dims.z();
+
+  // The eye, at the origin of eye coordinates, and the direction through the
+  // pixel with the 45 degree field of view of glDraw()
+  cb::Vector3D shift(translation.x() * radius / zoom,
+                     translation.y() * radius / zoom, -radius / zoom);
+  double f = tan(M_PI / 8);
+  cb::Vector3D eyeDir((2.0 * x / width - 1) * f * width / height,
+                      (1 - 2.0 * y / height) * f, -1);
+
+  // Undo the model rotation, by the negated angle about the same axis
+  cb::Vector3D axis(rotation[1], rotation[2], rotation[3]);
+  double length = axis.length();
+  double angle = -rotation[0] * M_PI / 180;
+
+  cb::Vector3D eye = cb::Vector3D() - shift;
+  if (length && angle) {
+    axis = axis / length;
+    double c = cos(angle);
+    double s = sin(angle);
+
+    eye = eye * c + axis.cross(eye) * s + axis * axis.dot(eye) * (1 - c);
+    eyeDir = eyeDir * c + axis.cross(eyeDir) * s +
+      axis * axis.dot(eyeDir) * (1 - c);
+  }
+
+  origin = eye + center;
+  dir = eyeDir.normalize();
+}
+
+
 void ViewPort::glDraw(const cb::Rectangle3D &bbox,
                       const cb::Vector3D &center) const {
   GLFuncs &glFuncs = getGLFuncs();
@@ -63,6 +63,17 @@ namespace CAMotics {
     void updateTranslation(int x, int y);
 
     void resetView(char c = 'p');
+    /// Turns the model about its Z axis by @param angle radians.
+    void spin(double angle);
+
+    /// @return the size of a pixel at the center of the view, in model units.
+    double getPixelSize(const cb::Rectangle3D &bounds) const;
+    /// Find the ray, in model coordinates, through the pixel at @param x,
+    /// @param y of a view drawn by glDraw() with the same @param bounds and
+    /// @param center.  @param dir is a unit vector.
+    void getRay(int x, int y, const cb::Rectangle3D &bounds,
+                const cb::Vector3D &center, cb::Vector3D &origin,
+                cb::Vector3D &dir) const;
 
     virtual void glInit() const;
     virtual void glDraw(const cb::Rectangle3D &bounds,
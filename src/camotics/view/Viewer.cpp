@@ -23,7 +23,6 @@
 #include "View.h"
 #include "GL.h"
 #include "BoundsView.h"
-#include "ToolView.h"
 
 #include <gcode/ToolTable.h>
 #include <camotics/sim/MoveLookup.h>
@@ -50,10 +49,7 @@ void Viewer::draw(const View &view) {
     !view.machine.isNull() && view.isFlagSet(View::SHOW_MACHINE_FLAG);
 
   // Setup view port
-  cb::Rectangle3D bounds = view.path->getBounds();
-  if (!surface.isNull()) bounds.add(surface->getBounds());
-  bounds.add(view.workpiece->getBounds());
-  if (showMachine) bounds.add(view.machine->getBounds());
+  cb::Rectangle3D bounds = view.getViewBounds();
   view.glDraw(bounds, view.workpiece->getBounds().getCenter());
 
   // Enable Lighting
@@ -81,7 +77,8 @@ void Viewer::draw(const View &view) {
   }
 
   // GCode::Tool path
-  if (view.isFlagSet(View::SHOW_PATH_FLAG)) view.path->draw();
+  if (view.isFlagSet(View::SHOW_PATH_FLAG))
+    view.path->draw(view.getPixelSize(bounds));
   else view.path->update();
 
   // Model
@@ -130,14 +127,13 @@ void Viewer::draw(const View &view) {
 
   // GCode::Tool
   if (view.isFlagSet(View::SHOW_TOOL_FLAG) && !view.path->isEmpty()) {
-    const GCode::ToolTable &tools = view.path->getPath()->getTools();
-    const GCode::Move &move = view.path->getMove();
-    int toolID = move.getTool();
+    const GCode::Tool *tool =
+      view.path->getPath()->getTool(view.path->getMove());
 
-    if (tools.has(toolID)) {
+    if (tool) {
       Vector3D position = currentPosition;
       if (showMachine) position *= view.machine->getTool();
-      ToolView(tools.get(toolID), position).draw();
+      toolView.draw(*tool, position);
     }
   }
 
@@ -20,11 +20,14 @@
 
 #pragma once
 
+#include "ToolView.h"
 
 namespace CAMotics {
   class View;
 
   class Viewer {
+    ToolView toolView;
+
   public:
     void draw(const View &view);
   };
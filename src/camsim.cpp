@@ -19,18 +19,40 @@
 \******************************************************************************/
 
 #include <camotics/Application.h>
+#include <camotics/MemoryUsage.h>
 #include <camotics/sim/CutSim.h>
+#include <camotics/sim/SurfaceCache.h>
+#include <camotics/sim/ToolPathCache.h>
 #include <camotics/sim/Project.h>
+#include <camotics/sim/RapidCheck.h>
+#include <camotics/sim/HeightMap.h>
+#include <camotics/opt/FeedOpt.h>
+#include <camotics/sim/SimBatch.h>
+#include <camotics/sim/SimCluster.h>
+#include <camotics/sim/SimServer.h>
+#include <camotics/sim/SimulationRun.h>
+#include <camotics/sim/StockField.h>
 #include <stl/Writer.h>
+#include <gcode/Printer.h>
+#include <gcode/parse/Parser.h>
+#include <gcode/plan/PlannerConfig.h>
 #include <camotics/contour/Surface.h>
+#include <camotics/value/ValueSet.h>
+#include <camotics/view/View.h>
+#include <camotics/view/OffscreenRenderer.h>
 
 #include <cbang/Exception.h>
 #include <cbang/ApplicationMain.h>
 #include <cbang/os/SystemUtilities.h>
 #include <cbang/os/SystemInfo.h>
+#include <cbang/json/Reader.h>
+#include <cbang/io/StringInputSource.h>
+#include <cbang/time/TimeInterval.h>
 
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <cmath>
 
 using namespace cb;
 using namespace std;
@@ -58,39 +80,210 @@ namespace CAMotics {
   }
 
 
+  class SnapshotServer : public SimServer {
+  public:
+    SnapshotServer(unsigned threads, const string &cache, unsigned runs,
+                   unsigned surfaces) :
+      SimServer(threads, cache, runs, surfaces) {}
+
+    // From SimServer
+    void writeSnapshot(const Project &project,
+                       const SmartPointer<Surface> &surface,
+                       const string &filename, unsigned width,
+                       unsigned height) {
+      OffscreenRenderer renderer(width, height);
+      ValueSet values;
+      View view(values);
+
+      view.setFlag(View::SURFACE_VBOS_FLAG, false);
+      view.setToolPath(project.path);
+      view.setWorkpiece(project.getWorkpieceBounds());
+      view.setSurface(surface);
+
+      renderer.render(view, filename);
+    }
+  };
+
+
   class SimApp : public Application {
     double time;
+    string times;
+    bool atToolChanges;
     bool reduce;
+    unsigned reduceTriangles;
+    double reduceError;
     bool binary;
+    unsigned lods;
+    bool gltf;
+    bool stream;
+    bool checkRapids;
+    bool resume;
+    bool numa;
+    string removal;
+    string optimizeFeeds;
+    string plannerConfig;
     string resolution;
+    string stock;
     unsigned threads;
+    string lookup;
+    string cache;
+    string snapshot;
+    unsigned width;
+    unsigned height;
+    unsigned turntable;
+    string batch;
+    unsigned batchJobs;
+    unsigned memory;
+    string cluster;
+    string clusterDir;
+    unsigned partCount;
+    string partition;
+    unsigned part;
+    string serve;
+    string serveDir;
+    unsigned serveRuns;
+    unsigned serveSurfaces;
 
     string input;
+    string outputPath;
     SmartPointer<ostream> output;
 
     Project project;
     CutSim cutSim;
+    SmartPointer<SimBatch> simBatch;
+    SmartPointer<SimCluster> simCluster;
+    SmartPointer<SimServer> simServer;
 
   public:
     SimApp() :
-      Application("CAMotics Sim"), time(0),
-      reduce(true), binary(true), threads(SystemInfo::instance().getCPUCount()),
-      project(options) {
+      Application("CAMotics Sim"), time(0), atToolChanges(false),
+      reduce(true), reduceTriangles(0), reduceError(0), binary(true), lods(2),
+      gltf(false), stream(false),
+      checkRapids(false), resume(false), numa(false),
+      threads(SystemInfo::instance().getCPUCount()),
+      cache(SurfaceCache::getDefaultPath()), width(1024), height(768),
+      turntable(0), batchJobs(0), memory(0), partCount(0), part(0),
+      serveRuns(4), serveSurfaces(16), project(options) {
 
       cmdLine.setUsageArgs
-        ("[OPTIONS] <project.xml | input.gcode | input.tpl> <output.stl>");
+        ("[OPTIONS] <project.xml | input.gcode | input.tpl> [output.stl]");
 
       cmdLine.setAllowConfigAsFirstArg(false);
       cmdLine.setAllowPositionalArgs(true);
 
       cmdLine.addTarget("time", time, "Simulation end time in seconds.  "
                         "A value of zero simulates the entire path.");
+      cmdLine.addTarget("times", times, "Comma separated simulation times "
+                        "in seconds.  A surface is written at each, in one "
+                        "pass, with the index added to the output file name.");
+      cmdLine.addTarget("at-tool-changes", atToolChanges, "Write a surface "
+                        "before each tool change and at the end, in one "
+                        "pass, as with 'times'.");
       cmdLine.addTarget("reduce", reduce, "Reduce cut workpiece.");
+      cmdLine.addTarget("reduce-triangles", reduceTriangles, "Stop reducing "
+                        "once no more than this many triangles remain.  "
+                        "Zero is no limit.");
+      cmdLine.addTarget("reduce-error", reduceError, "Largest change to the "
+                        "surface, in mm, allowed while reducing.  Zero "
+                        "allows a small fraction of the average edge length "
+                        "or, with 'reduce-triangles', any change.");
       cmdLine.addTarget("binary", binary,
                         "Output binary STL, otherwise ASCII.");
+      cmdLine.addTarget("lods", lods, "Coarser levels of detail added to "
+                        "glTF output, which is written instead of STL when "
+                        "the output file ends in '.glb'.");
+      cmdLine.addTarget("stream", stream, "Write the surface while it is "
+                        "computed without holding all of it in memory.  The "
+                        "surface is not reduced.  Binary output must be "
+                        "seekable.");
+      cmdLine.addTarget("check-rapids", checkRapids, "Report rapid moves "
+                        "which pass through stock, without computing a "
+                        "surface.  The STL output is then optional.");
+      cmdLine.addTarget("removal", removal, "Write the volume removed by "
+                        "each program line, its removal rate and the tool's "
+                        "engagement in degrees to this CSV file.  Computed "
+                        "with a height map.  The STL output is then "
+                        "optional.");
+      cmdLine.addTarget("optimize-feeds", optimizeFeeds, "Write the GCode "
+                        "input to this file with its feeds scaled by the "
+                        "material each line removes, see 'removal'.  The "
+                        "STL output is then optional.");
+      cmdLine.addTarget("planner-config", plannerConfig, "JSON planner "
+                        "configuration, or a file holding it, whose axis "
+                        "velocities limit 'optimize-feeds'.");
       cmdLine.addTarget("resolution", resolution, "Valid values are 'low', "
-                        "'medium', 'high' or a decimal value.");
+                        "'medium', 'high', 'budget' or a decimal value.");
+      cmdLine.addTarget("stock", stock, "STL surface of the stock, such as "
+                        "the output of an earlier setup, cut instead of a box "
+                        "workpiece.");
       cmdLine.addTarget("threads", threads, "Number of simulation threads.");
+      cmdLine.addTarget("numa", numa, "Pin the surface rendering threads to "
+                        "NUMA nodes, each with its own copy of the tool path "
+                        "and move lookup.  Helps on multi-socket machines.");
+      cmdLine.addTarget("lookup", lookup, "Move lookup structure.  Valid "
+                        "values are 'aabb_tree', 'oct_tree', 'linear_bvh' or "
+                        "'auto'.");
+      cmdLine.addTarget("cache", cache, "Directory where tool paths and "
+                        "simulated surfaces are kept and reused when the same "
+                        "simulation is run again.  Empty disables the cache.");
+      cmdLine.addTarget("resume", resume, "Save the surface to the cache in "
+                        "parts as they are computed, so an interrupted "
+                        "simulation continues where it stopped when run "
+                        "again with the same options.");
+      cmdLine.addTarget("snapshot", snapshot, "Also draw the result to this "
+                        "image file, such as a PNG, without a window.  The "
+                        "STL output is then optional.");
+      cmdLine.addTarget("snapshot-width", width, "Snapshot width in pixels.");
+      cmdLine.addTarget("snapshot-height", height,
+                        "Snapshot height in pixels.");
+      cmdLine.addTarget("turntable", turntable, "Write this many snapshots "
+                        "turning once around the part.  The frame number is "
+                        "added to each file name.");
+      cmdLine.addTarget("batch", batch, "Simulate the jobs listed in this "
+                        "JSON file, or every project, GCode and TPL file in "
+                        "this directory, in one process.  Each job is a dict "
+                        "with an 'input' and optional 'output', "
+                        "'resolution', 'time', 'reduce' and 'binary'.  Jobs "
+                        "of the same input share one tool path.");
+      cmdLine.addTarget("batch-jobs", batchJobs, "Number of batch jobs run "
+                        "at once, sharing 'threads' between them.  Zero "
+                        "picks one job per four threads.");
+      cmdLine.addTarget("memory", memory, "Memory budget in MiB, zero is "
+                        "unlimited.  Batch jobs wait until they fit.  A "
+                        "simulation estimated to need more is computed and "
+                        "written in bands, each reduced on its own.  Binary "
+                        "output must then be seekable.");
+      cmdLine.addTarget("cluster", cluster, "Split the simulation between "
+                        "the nodes listed in this file, one launch command "
+                        "per line such as 'ssh node1' or 'local'.  Each node "
+                        "runs camsim on a slab of the workpiece and the "
+                        "slabs are stitched together.");
+      cmdLine.addTarget("cluster-dir", clusterDir, "Directory, at the same "
+                        "path on every node, where the cluster job and its "
+                        "parts are written.  Defaults to the current "
+                        "directory.");
+      cmdLine.addTarget("parts", partCount, "Number of slabs simulated by "
+                        "the cluster.  Zero is one per node.");
+      cmdLine.addTarget("partition", partition, "Simulate only slab 'I/N' "
+                        "of a cluster job file and write it unreduced.  "
+                        "Used by 'cluster' on each node.");
+      cmdLine.addTarget("serve", serve, "Answer simulation requests on this "
+                        "'host:port', or port on localhost, one JSON object "
+                        "per line, keeping tool paths, runs and surfaces in "
+                        "memory between them.  Each request is a dict with "
+                        "an 'input' and optional 'output', 'time', "
+                        "'resolution', 'reduce', 'binary', 'snapshot', "
+                        "'width' and 'height'.");
+      cmdLine.addTarget("serve-dir", serveDir, "Directory 'serve' reads and "
+                        "writes files in.  Requests naming absolute paths or "
+                        "'..' are refused.  Defaults to the current "
+                        "directory.");
+      cmdLine.addTarget("serve-runs", serveRuns, "Number of simulation runs, "
+                        "with their move lookups and grids, kept by 'serve'. "
+                        " Requests for other times of a kept run only "
+                        "contour its grid.");
+      cmdLine.addTarget("serve-surfaces", serveSurfaces, "Number of "
+                        "finished surfaces kept by 'serve'.");
 
       Logger::instance().setLogTime(false);
       Logger::instance().setLogNoInfoHeader(true);
@@ -104,20 +297,106 @@ namespace CAMotics {
       if (ret == -1) return ret;
 
       vector<string> args = cmdLine.getPositionalArgs();
+
+      if (!batch.empty()) {
+        if (!args.empty()) THROW("Positional arguments given with 'batch'.");
+        return 0;
+      }
+
+      if (!serve.empty()) {
+        if (!args.empty()) THROW("Positional arguments given with 'serve'.");
+        return 0;
+      }
+
       if (2 < args.size())
         THROWS("Too many (" << args.size() << ") positional arguments.");
       if (args.size() < 1)
         THROW("Missing project, GCode or TPL input argument.");
-      if (args.size() < 2) THROW("Missing STL output argument.");
+      if (args.size() < 2 && snapshot.empty() && !checkRapids &&
+          removal.empty() && optimizeFeeds.empty())
+        THROW("Missing STL output argument.");
+      if (stream && args.size() < 2)
+        THROW("Streaming needs an STL output argument.");
+      if ((!times.empty() || atToolChanges) && (stream || args.size() < 2))
+        THROW("Multiple times need an STL output argument and no streaming.");
+
+      if ((!cluster.empty() || !partition.empty()) &&
+          (stream || !times.empty() || atToolChanges))
+        THROW("Cluster simulation cannot stream or use multiple times.");
 
       input = args[0];
-      output = SystemUtilities::oopen(args[1]);
+
+      if (!partition.empty()) {
+        if (args.size() < 2) THROW("Partition needs an STL output argument.");
+        if (SystemUtilities::extension(input) != "json")
+          THROW("Partition input must be a cluster job file.");
+
+        vector<string> fields;
+        String::tokenize(partition, fields, "/");
+        if (fields.size() != 2)
+          THROWS("Invalid partition '" << partition << "'");
+        part = String::parseU32(fields[0]);
+        partCount = String::parseU32(fields[1]);
+      }
+
+      if (!cluster.empty())
+        simCluster =
+          new SimCluster(cluster, clusterDir.empty() ? "." : clusterDir);
+
+      if (1 < args.size()) {
+        outputPath = args[1];
+        gltf = String::toLower(SystemUtilities::extension(outputPath)) ==
+          "glb";
+        if (gltf && stream) THROW("glTF output cannot be streamed.");
+        if (times.empty() && !atToolChanges)
+          output = SystemUtilities::oopen(outputPath);
+      }
 
       return 0;
     }
 
 
+    void runBatch() {
+      unsigned jobs = batchJobs ? batchJobs : std::max(1U, threads / 4);
+      simBatch = new SimBatch(jobs, threads, (uint64_t)memory << 20, cache);
+      simBatch->read(batch);
+
+      LOG_INFO(1, "Running " << simBatch->getJobCount() << " jobs, " << jobs
+               << " at a time");
+
+      unsigned failed = simBatch->run();
+      if (failed) THROWS(failed << " batch jobs failed");
+    }
+
+
+    void runServe() {
+      simServer = new SnapshotServer(threads, cache, serveRuns, serveSurfaces);
+      simServer->setRoot(serveDir);
+      simServer->serve(serve);
+    }
+
+
+    void runPartition() {
+      Simulation sim = SimCluster::readJob(input);
+      sim.threads = threads;
+      if (!lookup.empty()) sim.lookup = LookupMode::parse(lookup);
+
+      SmartPointer<SimulationRun> run = new SimulationRun(sim);
+      run->setPartition(part, partCount);
+
+      SmartPointer<Surface> surface = cutSim.computeSurface(run);
+      if (surface.isNull() || shouldQuit()) THROW("Interrupted");
+
+      surface->writeSTL(*output, binary, "CAMotics Surface",
+                        sim.computeHash());
+    }
+
+
     void run() {
+      if (!batch.empty()) return runBatch();
+      if (!serve.empty()) return runServe();
+      if (!partition.empty()) return runPartition();
+
       // Open project
       if (is_xml(input)) project.load(input);
       else project.addFile(input); // Assume TPL or G-Code
@@ -140,29 +419,264 @@ namespace CAMotics {
       // Generate tool path
       project.time = time ? time : numeric_limits<double>::max();
       project.threads = threads;
+      cutSim.setNUMA(numa);
+      if (!lookup.empty()) project.lookup = LookupMode::parse(lookup);
       project.workpiece = project.getWorkpieceBounds();
-      project.path = cutSim.computeToolPath(project);
+      project.path =
+        cutSim.computeToolPath(project, new ToolPathCache(cache));
 
       // Configure simulation
       project.updateAutomaticWorkpiece(*project.path);
+      project.updateResolution(); // Budget resolutions depend on the path
+
+      if (project.getResolutionMode() == ResolutionMode::RESOLUTION_BUDGET) {
+        CostModel::Cost cost = project.getPredictedCost();
+        LOG_INFO(1, "Resolution " << project.getResolution()
+                 << " predicted to take " << TimeInterval(cost.time)
+                 << " and " << MemoryUsage::format(cost.memory));
+      }
+
+      if (!stock.empty())
+        project.workpiece.setStock(StockField::read(stock, project.resolution));
+
+      // Analyses which need no surface
+      if (checkRapids) runRapidCheck();
+      if (!removal.empty() || !optimizeFeeds.empty()) runRemoval();
+      if (outputPath.empty() && snapshot.empty()) return;
+
+      if (!times.empty() || atToolChanges) return runCheckpoints();
+
+      // Simulate straight to the output
+      if (stream) {
+        const string name = "CAMotics Surface";
+        const string hash = project.computeHash();
+        STL::Writer writer(*output, binary);
+
+        writer.writeHeader(name, 0, hash);
+        string checkpoint;
+        if (resume && !cache.empty())
+          checkpoint = SurfaceCache(cache).getCheckpointFilename(project);
+
+        uint64_t count = cutSim.streamSurface(project, writer, checkpoint);
+        writer.writeFooter(name, hash);
+
+        if (binary && numeric_limits<uint32_t>::max() < count)
+          THROW("Too many facets for a binary STL");
+        writer.updateCount(count);
+
+        if (!snapshot.empty() && !shouldQuit()) writeSnapshots(0);
+
+        return;
+      }
+
+      // Simulate in bands if the whole surface would not fit
+      if (memory && simCluster.isNull() && !output.isNull() && !gltf) {
+        uint64_t needed = SimBatch::estimateMemory(project);
+        uint64_t budget = (uint64_t)memory << 20;
+        if (budget < needed) return runBands((needed + budget - 1) / budget);
+      }
 
       // Simulate
       SmartPointer<Surface> surface;
-      if (!shouldQuit()) surface = cutSim.computeSurface(project);
+      if (!shouldQuit()) {
+        if (simCluster.isNull())
+          surface =
+            cutSim.computeSurface(project, new SurfaceCache(cache), resume);
+        else surface = simCluster->compute(project, clusterName(), partCount);
+      }
 
       // Reduce
-      if (reduce && !shouldQuit()) cutSim.reduceSurface(*surface);
+      if (reduce && !shouldQuit())
+        surface = cutSim.reduceSurface
+          (surface, threads, ReduceTarget(reduceTriangles, reduceError));
 
       // Export surface
-      if (!shouldQuit())
-        surface->writeSTL
-          (*output, binary, "CAMotics Surface", project.computeHash());
+      if (!output.isNull() && !shouldQuit()) writeSurface(*surface, *output);
+
+      if (!snapshot.empty() && !shouldQuit()) writeSnapshots(surface);
+    }
+
+
+    void runRapidCheck() {
+      RapidCheck check(project);
+      unsigned count = check.run(threads);
+
+      const vector<RapidCheck::Crash> &crashes = check.getCrashes();
+      for (unsigned i = 0; i < crashes.size(); i++)
+        LOG_WARNING("Rapid move " << crashes[i].move << " on line "
+                    << crashes[i].line << " at "
+                    << TimeInterval(crashes[i].time)
+                    << " crashes into stock at " << crashes[i].point);
+
+      LOG_INFO(1, count << " rapid moves crash");
+    }
+
+
+    void runRemoval() {
+      if (!HeightMap::isSupported(*project.path))
+        THROW("Removal needs tools a height map can simulate");
+
+      HeightMap heightMap(project.workpiece.getBounds(), project.resolution);
+      heightMap.cut(*project.path, project.time);
+
+      if (!removal.empty())
+        heightMap.writeRemoval(*SystemUtilities::oopen(removal),
+                               *project.path);
+
+      if (!optimizeFeeds.empty()) runFeedOpt(heightMap);
+    }
+
+
+    void runFeedOpt(const HeightMap &heightMap) {
+      string ext = SystemUtilities::extension(input);
+      if (is_xml(input) || ext == "tpl" || ext == "json")
+        THROW("Feeds can only be optimized for a GCode input");
+
+      GCode::PlannerConfig config;
+      string s = String::trim(plannerConfig);
+      if (!s.empty()) {
+        SmartPointer<InputSource> source;
+        if (s[0] == '{') source = new StringInputSource(s);
+        else source = new InputSource(s);
+
+        config.read(*JSON::Reader::parse(*source));
+      }
+
+      SmartPointer<ostream> out = SystemUtilities::oopen(optimizeFeeds);
+      GCode::Printer printer(*out);
+      FeedOpt feedOpt(printer);
+
+      feedOpt.compute(*project.path, heightMap.getRemoval(), config);
+      GCode::Parser().parse(InputSource(input), feedOpt);
+    }
+
+
+    void runBands(unsigned bands) {
+      LOG_INFO(1, "Simulating in " << bands << " bands to fit in " << memory
+               << " MiB");
+
+      const string name = "CAMotics Surface";
+      const string hash = project.computeHash();
+      STL::Writer writer(*output, binary);
+
+      writer.writeHeader(name, 0, hash);
+      uint64_t count =
+        cutSim.computeBands(project, bands, writer, reduce ? threads : 0);
+      writer.writeFooter(name, hash);
+
+      if (binary && numeric_limits<uint32_t>::max() < count)
+        THROW("Too many facets for a binary STL");
+      writer.updateCount(count);
+
+      if (!snapshot.empty())
+        LOG_WARNING("No snapshot is drawn of a surface computed in bands");
+    }
+
+
+    string clusterName() const {
+      string name = SystemUtilities::basename(outputPath.empty() ?
+                                              input : outputPath);
+      string ext = SystemUtilities::extension(name);
+      if (!ext.empty()) name = name.substr(0, name.length() - ext.length() - 1);
+      return name + "-cluster";
+    }
+
+
+    void getCheckpoints(vector<double> &checkpoints) {
+      vector<string> parts;
+      String::tokenize(times, parts, ", ");
+      for (unsigned i = 0; i < parts.size(); i++)
+        checkpoints.push_back(String::parseDouble(parts[i]));
+
+      const GCode::ToolPath &path = *project.path;
+      for (unsigned i = 1; atToolChanges && i < path.size(); i++)
+        if (path.at(i).getTool() != path.at(i - 1).getTool())
+          checkpoints.push_back(path.at(i).getStartTime());
+
+      if (atToolChanges && !path.empty())
+        checkpoints.push_back
+          (std::min(project.time, path.at(path.size() - 1).getEndTime()));
+
+      sort(checkpoints.begin(), checkpoints.end());
+      checkpoints.erase(unique(checkpoints.begin(), checkpoints.end()),
+                        checkpoints.end());
+    }
+
+
+    void runCheckpoints() {
+      vector<double> checkpoints;
+      getCheckpoints(checkpoints);
+
+      string ext = SystemUtilities::extension(outputPath);
+      string base = outputPath.substr(0, outputPath.length() - ext.length());
+      if (!ext.empty()) base = base.substr(0, base.length() - 1);
+      else ext = "stl";
+
+      // Each surface only recomputes the cuts made since the last
+      SmartPointer<SimulationRun> run = new SimulationRun(project);
+
+      for (unsigned i = 0; i < checkpoints.size() && !shouldQuit(); i++) {
+        run->setEndTime(checkpoints[i]);
+        SmartPointer<Surface> surface = cutSim.computeSurface(run);
+        if (surface.isNull() || shouldQuit()) break;
+
+        if (reduce)
+          surface = cutSim.reduceSurface
+            (surface, threads, ReduceTarget(reduceTriangles, reduceError));
+        if (surface.isNull()) break;
+
+        string filename =
+          String::printf("%s-%04u.%s", base.c_str(), i, ext.c_str());
+        LOG_INFO(1, "Writing " << filename << " at "
+                 << TimeInterval(checkpoints[i]));
+
+        writeSurface(*surface, *SystemUtilities::oopen(filename));
+      }
+    }
+
+
+    void writeSurface(const Surface &surface, const OutputSink &sink) {
+      if (gltf) surface.writeGLTF(sink, "CAMotics Surface", lods);
+      else surface.writeSTL(sink, binary, "CAMotics Surface",
+                            project.computeHash());
+    }
+
+
+    void writeSnapshots(const SmartPointer<Surface> &surface) {
+      // Declared after the renderer so the view's GL buffers are freed
+      // while its context is still current
+      OffscreenRenderer renderer(width, height);
+      ValueSet values;
+      View view(values);
+
+      // The surface outlives the context so it is drawn without buffers
+      view.setFlag(View::SURFACE_VBOS_FLAG, false);
+
+      view.setToolPath(project.path);
+      view.setWorkpiece(project.getWorkpieceBounds());
+      view.setSurface(surface);
+
+      if (!turntable) renderer.render(view, snapshot);
+
+      string ext = SystemUtilities::extension(snapshot);
+      string base = snapshot.substr(0, snapshot.length() - ext.length());
+      if (!ext.empty()) base = base.substr(0, base.length() - 1);
+      else ext = "png";
+
+      for (unsigned i = 0; i < turntable && !shouldQuit(); i++) {
+        if (i) view.spin(2 * M_PI / turntable);
+        renderer.render(view, String::printf("%s-%04u.%s", base.c_str(), i,
+                                             ext.c_str()));
+      }
     }
 
 
     void requestExit() {
       Application::requestExit();
       cutSim.interrupt();
+      if (!simBatch.isNull()) simBatch->interrupt();
+      if (!simCluster.isNull()) simCluster->interrupt();
+      if (!simServer.isNull()) simServer->interrupt();
     }
   };
 }
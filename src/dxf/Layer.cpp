@@ -0,0 +1,216 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "Layer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cb;
+using namespace std;
+using namespace DXF;
+
+
+namespace {
+  const unsigned nodeSize = 16;
+
+
+  Vector2D xy(const Vector3D &v) {return Vector2D(v.x(), v.y());}
+
+
+  // Sort-Tile-Recursive order, runs of nodeSize items become tree nodes
+  template <typename T, typename BOUNDS>
+  void tile(typename vector<T>::iterator begin,
+            typename vector<T>::iterator end, BOUNDS bounds) {
+    unsigned n = end - begin;
+    unsigned leaves = (n + nodeSize - 1) / nodeSize;
+    unsigned slice = nodeSize * (unsigned)ceil(sqrt((double)leaves));
+
+    sort(begin, end, [&] (const T &a, const T &b) {
+        return bounds(a).getCenter().x() < bounds(b).getCenter().x();
+      });
+
+    for (unsigned i = 0; i < n; i += slice)
+      sort(begin + i, begin + min(n, i + slice), [&] (const T &a, const T &b) {
+          return bounds(a).getCenter().y() < bounds(b).getCenter().y();
+        });
+  }
+}
+
+
+void Layer::addPoint(const Vector3D &p) {
+  values.push_back(p.x());
+  values.push_back(p.y());
+  values.push_back(p.z());
+
+  add(Entity::DXF_POINT, Rectangle2D(xy(p), xy(p)));
+}
+
+
+void Layer::addLine(const Vector3D &start, const Vector3D &end) {
+  for (int i = 0; i < 3; i++) values.push_back(start[i]);
+  for (int i = 0; i < 3; i++) values.push_back(end[i]);
+
+  Rectangle2D bbox;
+  bbox.add(xy(start));
+  bbox.add(xy(end));
+  add(Entity::DXF_LINE, bbox);
+}
+
+
+void Layer::addArc(const Vector3D &center, double radius, double startAngle,
+                   double endAngle, bool clockwise) {
+  for (int i = 0; i < 3; i++) values.push_back(center[i]);
+  values.push_back(radius);
+  values.push_back(startAngle);
+  values.push_back(endAngle);
+  values.push_back(clockwise);
+
+  // The whole circle, arcs are rarely small enough for this to matter
+  Vector2D r(radius, radius);
+  add(Entity::DXF_ARC, Rectangle2D(xy(center) - r, xy(center) + r));
+}
+
+
+void Layer::beginPolyLine() {
+  end();
+  pendingType = Entity::DXF_POLYLINE;
+}
+
+
+void Layer::beginSpline(unsigned degree) {
+  end();
+  pendingType = Entity::DXF_SPLINE;
+  this->degree = degree;
+}
+
+
+void Layer::addVertex(const Vector3D &v) {
+  if (pendingType == Entity::DXF_LAST) THROW("Cannot add vertex");
+  vertices.push_back(v);
+}
+
+
+void Layer::addKnot(double k) {
+  if (pendingType != Entity::DXF_SPLINE) THROW("Cannot add knot");
+  knots.push_back(k);
+}
+
+
+void Layer::end() {
+  if (pendingType == Entity::DXF_LAST) return;
+
+  if (pendingType == Entity::DXF_POLYLINE) values.push_back(vertices.size());
+  else {
+    values.push_back(degree);
+    values.push_back(vertices.size());
+    values.push_back(knots.size());
+  }
+
+  // Splines lie within the hull of their control points
+  Rectangle2D bbox;
+  for (unsigned i = 0; i < vertices.size(); i++) {
+    for (int j = 0; j < 3; j++) values.push_back(vertices[i][j]);
+    bbox.add(xy(vertices[i]));
+  }
+
+  values.insert(values.end(), knots.begin(), knots.end());
+
+  add(pendingType, bbox);
+
+  pendingType = Entity::DXF_LAST;
+  vertices.clear();
+  knots.clear();
+}
+
+
+void Layer::index() {
+  end();
+  nodes.clear();
+  order.clear();
+  if (types.empty()) return;
+
+  // Leaves
+  for (unsigned i = 0; i < size(); i++) order.push_back(i);
+  tile<uint32_t>(order.begin(), order.end(),
+                 [this] (uint32_t i) -> const Rectangle2D & {
+                   return bounds[i];
+                 });
+
+  vector<Node> level;
+  for (unsigned i = 0; i < order.size(); i += nodeSize) {
+    Node node = {Rectangle2D(), i, min(nodeSize, size() - i), true};
+    for (unsigned j = 0; j < node.count; j++)
+      node.bounds.add(bounds[order[i + j]]);
+    level.push_back(node);
+  }
+
+  // Inner nodes, each level's children are contiguous in nodes
+  while (1 < level.size()) {
+    tile<Node>(level.begin(), level.end(),
+               [] (const Node &n) -> const Rectangle2D & {return n.bounds;});
+
+    unsigned base = nodes.size();
+    nodes.insert(nodes.end(), level.begin(), level.end());
+
+    vector<Node> parents;
+    for (unsigned i = 0; i < level.size(); i += nodeSize) {
+      Node node = {Rectangle2D(), base + i,
+                   min(nodeSize, (unsigned)level.size() - i), false};
+      for (unsigned j = 0; j < node.count; j++)
+        node.bounds.add(level[i + j].bounds);
+      parents.push_back(node);
+    }
+
+    level.swap(parents);
+  }
+
+  nodes.push_back(level[0]);
+}
+
+
+void Layer::find(const Rectangle2D &region, vector<unsigned> &results) const {
+  if (nodes.empty()) return;
+
+  vector<uint32_t> stack;
+  stack.push_back(nodes.size() - 1);
+
+  while (!stack.empty()) {
+    const Node &node = nodes[stack.back()];
+    stack.pop_back();
+
+    if (!node.bounds.intersects(region)) continue;
+
+    for (unsigned i = node.first; i < node.first + node.count; i++)
+      if (!node.leaf) stack.push_back(i);
+      else if (bounds[order[i]].intersects(region))
+        results.push_back(order[i]);
+  }
+}
+
+
+void Layer::add(Entity::type_t type, const Rectangle2D &bbox) {
+  types.push_back(type);
+  bounds.push_back(bbox);
+
+  // The values were appended since the last entity
+  offsets.push_back(nextOffset);
+  nextOffset = values.size();
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Entity.h"
+
+#include <cbang/StdTypes.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+
+
+namespace DXF {
+  /***
+   * The entities of one layer packed in to flat arrays, so large drawings
+   * do not need an allocation per entity.  Each entity's values are:
+   *
+   *   POINT     x y z
+   *   LINE      x1 y1 z1 x2 y2 z2
+   *   ARC       cx cy cz radius startAngle endAngle clockwise
+   *   POLYLINE  count, count * (x y z)
+   *   SPLINE    degree ctrlCount knotCount, ctrlCount * (x y z), knots
+   *
+   * After index() a packed R-tree over the XY bounds answers region queries.
+   */
+  class Layer {
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> offsets;
+    std::vector<double> values;
+    std::vector<cb::Rectangle2D> bounds;
+    uint32_t nextOffset;
+
+    // Entity being built
+    Entity::type_t pendingType;
+    unsigned degree;
+    std::vector<cb::Vector3D> vertices;
+    std::vector<double> knots;
+
+    struct Node {
+      cb::Rectangle2D bounds;
+      uint32_t first;
+      uint32_t count;
+      bool leaf;
+    };
+
+    std::vector<Node> nodes; ///< Root last
+    std::vector<uint32_t> order; ///< Entities in leaf order
+
+  public:
+    Layer() : nextOffset(0), pendingType(Entity::DXF_LAST), degree(0) {}
+
+    unsigned size() const {return types.size();}
+    Entity::type_t getType(unsigned i) const {return (Entity::type_t)types[i];}
+    const double *getValues(unsigned i) const {return &values[offsets[i]];}
+    const cb::Rectangle2D &getBounds(unsigned i) const {return bounds[i];}
+
+    void addPoint(const cb::Vector3D &p);
+    void addLine(const cb::Vector3D &start, const cb::Vector3D &end);
+    void addArc(const cb::Vector3D &center, double radius, double startAngle,
+                double endAngle, bool clockwise);
+
+    void beginPolyLine();
+    void beginSpline(unsigned degree);
+    void addVertex(const cb::Vector3D &v);
+    void addKnot(double k);
+    void end();
+
+    void index();
+    /// Append the entities whose bounds intersect @param region.
+    void find(const cb::Rectangle2D &region,
+              std::vector<unsigned> &results) const;
+
+  protected:
+    void add(Entity::type_t type, const cb::Rectangle2D &bbox);
+  };
+}
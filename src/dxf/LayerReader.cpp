@@ -0,0 +1,143 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "LayerReader.h"
+
+#include <dxflib/dl_dxf.h>
+
+#include <cbang/log/Logger.h>
+
+using namespace cb;
+using namespace std;
+using namespace DXF;
+
+
+void LayerReader::read(const InputSource &source) {
+  SmartPointer<DL_Dxf> dxf = new DL_Dxf;
+
+  if (!dxf->in(source.getStream(), this))
+    THROWS("Failed to read '" << source << "' as DXF");
+
+  for (layers_t::iterator it = layers.begin(); it != layers.end(); it++)
+    it->second->index();
+}
+
+
+Layer *LayerReader::getLayer() {
+  if (inBlock) return 0; // TODO handle blocks
+
+  const string &name = attributes.getLayer();
+  layers_t::iterator it = layers.find(name);
+  if (it != layers.end()) return it->second.get();
+
+  if (!defined.count(name)) THROWS("DXF Undefined layer '" << name << "'");
+
+  return 0;
+}
+
+
+void LayerReader::addLayer(const DL_LayerData &data) {
+  defined.insert(data.name);
+  if (wanted.empty() || wanted.count(data.name))
+    layers[data.name] = new Layer;
+}
+
+
+void LayerReader::addPoint(const DL_PointData &point) {
+  Layer *layer = getLayer();
+  if (layer) layer->addPoint(Vector3D(point.x, point.y, point.z));
+}
+
+
+void LayerReader::addLine(const DL_LineData &line) {
+  Layer *layer = getLayer();
+  if (layer) layer->addLine(Vector3D(line.x1, line.y1, line.z1),
+                            Vector3D(line.x2, line.y2, line.z2));
+}
+
+
+void LayerReader::addArc(const DL_ArcData &arc) {
+  Layer *layer = getLayer();
+  if (layer) layer->addArc(Vector3D(arc.cx, arc.cy, arc.cz), arc.radius,
+                           arc.angle1, arc.angle2,
+                           0 < getExtrusion()->getDirection()[2]);
+}
+
+
+void LayerReader::addCircle(const DL_CircleData &circle) {
+  Layer *layer = getLayer();
+  if (layer) layer->addArc(Vector3D(circle.cx, circle.cy, circle.cz),
+                           circle.radius, 0, 360, true);
+}
+
+
+void LayerReader::addPolyline(const DL_PolylineData &polyline) {
+  if (current) THROW("DXF Already in DXF entity");
+  current = getLayer();
+  if (current) current->beginPolyLine();
+}
+
+
+void LayerReader::addVertex(const DL_VertexData &vertex) {
+  if (!current) return;
+  if (vertex.bulge) LOG_WARNING("Cannot handle vertex with bulge");
+  current->addVertex(Vector3D(vertex.x, vertex.y, vertex.z));
+}
+
+
+void LayerReader::addSpline(const DL_SplineData &spline) {
+  if (current) THROW("DXF Already in DXF entity");
+  current = getLayer();
+  if (current) current->beginSpline(spline.degree);
+}
+
+
+void LayerReader::addControlPoint(const DL_ControlPointData &ctrlPt) {
+  if (current) current->addVertex(Vector3D(ctrlPt.x, ctrlPt.y, ctrlPt.z));
+}
+
+
+void LayerReader::addKnot(const DL_KnotData &knot) {
+  if (current) current->addKnot(knot.k);
+}
+
+
+void LayerReader::endEntity() {
+  if (current) current->end();
+  current = 0;
+}
+
+
+void LayerReader::addEllipse(const DL_EllipseData &ellipse) {
+  if (warnEllipse) LOG_WARNING("DXF Ellipse not supported");
+  warnEllipse = false;
+}
+
+
+void LayerReader::add3dFace(const DL_3dFaceData &face) {
+  if (warn3DFace) LOG_WARNING("DXF 3D Face not supported");
+  warn3DFace = false;
+}
+
+
+void LayerReader::addSolid(const DL_SolidData &solid) {
+  if (warnSolid) LOG_WARNING("DXF Solid not supported");
+  warnSolid = false;
+}
@@ -0,0 +1,85 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Layer.h"
+
+#include <dxflib/dl_creationadapter.h>
+
+#include <cbang/SmartPointer.h>
+#include <cbang/io/InputSource.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+
+namespace DXF {
+  /// Reads entities straight in to packed Layers, skipping unwanted layers.
+  class LayerReader : public DL_CreationAdapter {
+  public:
+    typedef std::map<std::string, cb::SmartPointer<Layer> > layers_t;
+
+  protected:
+    std::set<std::string> wanted; ///< Empty for all
+    std::set<std::string> defined;
+    layers_t layers;
+
+    Layer *current; ///< Receiving vertices and knots, if any
+
+    bool inBlock;
+    bool warnEllipse;
+    bool warn3DFace;
+    bool warnSolid;
+
+  public:
+    LayerReader() :
+      current(0), inBlock(false), warnEllipse(true), warn3DFace(true),
+      warnSolid(true) {}
+
+    void want(const std::string &name) {wanted.insert(name);}
+    void read(const cb::InputSource &source);
+
+    const layers_t &getLayers() const {return layers;}
+
+    /// @return the layer of the current entity or null if it is skipped.
+    Layer *getLayer();
+
+    // From DL_CreationAdapter
+    void addLayer(const DL_LayerData &data);
+    void addBlock(const DL_BlockData &block) {inBlock = true;}
+    void endBlock() {inBlock = false;}
+    void addPoint(const DL_PointData &point);
+    void addLine(const DL_LineData &line);
+    void addArc(const DL_ArcData &arc);
+    void addCircle(const DL_CircleData &circle);
+    void addPolyline(const DL_PolylineData &polyline);
+    void addVertex(const DL_VertexData &vertex);
+    void addSpline(const DL_SplineData &spline);
+    void addControlPoint(const DL_ControlPointData &ctrlPt);
+    void addKnot(const DL_KnotData &knot);
+    void endEntity();
+    void addEllipse(const DL_EllipseData &ellipse);
+    void add3dFace(const DL_3dFaceData &face);
+    void addSolid(const DL_SolidData &solid);
+  };
+}
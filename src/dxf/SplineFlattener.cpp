@@ -0,0 +1,150 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "SplineFlattener.h"
+
+#include <cbang/Exception.h>
+
+#include <algorithm>
+
+using namespace cb;
+using namespace std;
+using namespace DXF;
+
+
+namespace {
+  const unsigned maxDepth = 20;
+
+
+  double distanceToChord(const Vector3D &p, const Vector3D &a,
+                         const Vector3D &b) {
+    Vector3D ab = b - a;
+    double length2 = ab.dot(ab);
+    if (!length2) return p.distance(a);
+
+    double t = std::max(0.0, std::min(1.0, (p - a).dot(ab) / length2));
+    return p.distance(a + ab * t);
+  }
+}
+
+
+SplineFlattener::SplineFlattener(unsigned degree,
+                                 const vector<Vector3D> &ctrlPts,
+                                 const vector<double> &knots,
+                                 double tolerance) :
+  degree(degree), ctrlPts(ctrlPts), knots(knots), tolerance(tolerance) {
+  if (ctrlPts.empty()) THROW("Spline has no control points");
+  if (tolerance <= 0) THROW("Spline tolerance must be positive");
+
+  unsigned n = ctrlPts.size();
+  if (n <= this->degree) this->degree = n - 1;
+
+  // Clamped uniform knots
+  unsigned p = this->degree;
+  if (this->knots.size() != n + p + 1) {
+    this->knots.clear();
+
+    for (unsigned i = 0; i <= p; i++) this->knots.push_back(0);
+    for (unsigned i = 1; i < n - p; i++) this->knots.push_back(i);
+    for (unsigned i = 0; i <= p; i++) this->knots.push_back(n - p);
+  }
+}
+
+
+Vector3D SplineFlattener::evaluate(double t) const {
+  // de Boor's algorithm
+  unsigned p = degree;
+  unsigned k = findSpan(t);
+
+  vector<Vector3D> d(ctrlPts.begin() + k - p, ctrlPts.begin() + k + 1);
+
+  for (unsigned r = 1; r <= p; r++)
+    for (unsigned j = p; r <= j; j--) {
+      unsigned i = j + k - p;
+      double span = knots[i + p + 1 - r] - knots[i];
+      double alpha = span ? (t - knots[i]) / span : 0;
+
+      d[j] = d[j - 1] * (1 - alpha) + d[j] * alpha;
+    }
+
+  return d[p];
+}
+
+
+void SplineFlattener::flatten(vector<Vector3D> &points) const {
+  unsigned n = ctrlPts.size();
+  unsigned p = degree;
+
+  points.push_back(evaluate(knots[p]));
+  if (!p) {
+    points.insert(points.end(), ctrlPts.begin() + 1, ctrlPts.end());
+    return;
+  }
+
+  for (unsigned k = p; k < n; k++) {
+    double t0 = knots[k];
+    double t1 = knots[k + 1];
+    if (t0 == t1) continue;
+
+    // Start with one piece per degree so S-bends are not mistaken for flat
+    double step = (t1 - t0) / p;
+    for (unsigned i = 0; i < p; i++) {
+      double a = t0 + step * i;
+      double b = i == p - 1 ? t1 : a + step;
+      Vector3D start = points.back();
+      subdivide(a, start, b, evaluate(b), 0, points);
+    }
+  }
+}
+
+
+unsigned SplineFlattener::findSpan(double t) const {
+  unsigned n = ctrlPts.size();
+  unsigned p = degree;
+
+  // The last non-empty span includes the end of the curve
+  if (knots[n] <= t) {
+    unsigned k = n - 1;
+    while (p < k && knots[k] == knots[k + 1]) k--;
+    return k;
+  }
+
+  if (t <= knots[p]) return p;
+
+  return upper_bound(knots.begin() + p, knots.begin() + n, t) -
+    knots.begin() - 1;
+}
+
+
+void SplineFlattener::subdivide(double t0, const Vector3D &p0, double t1,
+                                const Vector3D &p1, unsigned depth,
+                                vector<Vector3D> &points) const {
+  double tm = (t0 + t1) / 2;
+  Vector3D pm = evaluate(tm);
+
+  if (depth < maxDepth &&
+      (tolerance < distanceToChord(pm, p0, p1) ||
+       tolerance < distanceToChord(evaluate((t0 + tm) / 2), p0, p1) ||
+       tolerance < distanceToChord(evaluate((tm + t1) / 2), p0, p1))) {
+    subdivide(t0, p0, tm, pm, depth + 1, points);
+    subdivide(tm, pm, t1, p1, depth + 1, points);
+
+  } else points.push_back(p1);
+}
@@ -0,0 +1,55 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/geom/Vector.h>
+
+#include <vector>
+
+
+namespace DXF {
+  /***
+   * Turns a B-spline in to a polyline which stays within tolerance of the
+   * curve.  Spans are split in half until the curve is flat enough between
+   * the points, so tight bends get more points than gentle ones.  Splines
+   * without a usable knot vector get a clamped uniform one.
+   */
+  class SplineFlattener {
+    unsigned degree;
+    const std::vector<cb::Vector3D> &ctrlPts;
+    std::vector<double> knots;
+    double tolerance;
+
+  public:
+    SplineFlattener(unsigned degree, const std::vector<cb::Vector3D> &ctrlPts,
+                    const std::vector<double> &knots, double tolerance);
+
+    cb::Vector3D evaluate(double t) const;
+    void flatten(std::vector<cb::Vector3D> &points) const;
+
+  protected:
+    unsigned findSpan(double t) const;
+    void subdivide(double t0, const cb::Vector3D &p0, double t1,
+                   const cb::Vector3D &p1, unsigned depth,
+                   std::vector<cb::Vector3D> &points) const;
+  };
+}
@@ -20,6 +20,8 @@
 
 #include "Codes.h"
 
+#include <vector>
+
 using namespace std;
 using namespace GCode;
 
@@ -27,6 +29,38 @@ typedef ModalGroup MG;
 typedef VarTypes VT;
 
 
+namespace {
+  // Codes of one table by number times ten, which covers codes like G38.2
+  class CodeIndex {
+    vector<const Code *> index;
+
+  public:
+    CodeIndex(const Code *table) {
+      for (int i = 0; table[i].type; i++) {
+        unsigned key = getKey(table[i].number);
+        if (index.size() <= key) index.resize(key + 1);
+        if (!index[key]) index[key] = &table[i]; // First match, as before
+      }
+    }
+
+
+    static unsigned getKey(float number) {return (unsigned)(number * 10 + 0.5);}
+
+
+    const Code *find(float number) const {
+      if (number < 0 || index.size() <= number * 10) return 0;
+
+      unsigned key = getKey(number);
+      if (index.size() <= key) return 0;
+
+      // Must still match exactly
+      const Code *code = index[key];
+      return code && code->number == number ? code : 0;
+    }
+  };
+}
+
+
 ostream &GCode::operator<<(ostream &stream, const Code &code) {
   return stream << code.type << code.number << " (" << code.description << ')';
 }
@@ -308,28 +342,20 @@ const Code Codes::mcodes[] = {
 
 
 const Code *Codes::find(char type, float number, float L) {
-  const Code *table = 0;
+  static const CodeIndex gIndex(gcodes);
+  static const CodeIndex g10Index(g10codes);
+  static const CodeIndex mIndex(mcodes);
 
   switch (type) {
   case 'G':
-    if (number == 10 && L) {
-      number = L;
-      table = g10codes;
+    if (number == 10 && L) return g10Index.find(L);
+    return gIndex.find(number);
 
-    } else table = gcodes;
-    break;
-
-  case 'M': table = mcodes; break;
+  case 'M': return mIndex.find(number);
 
   default:
     for (int i = 0; codes[i].type; i++)
       if (codes[i].type == type) return &codes[i];
     return 0;
   }
-
-  // A linear search will do pig
-  for (int i = 0; table[i].type; i++)
-    if (table[i].number == number) return &table[i];
-
-  return 0;
 }
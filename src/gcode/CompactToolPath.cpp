@@ -0,0 +1,151 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "CompactToolPath.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+bool CompactToolPath::State::operator<(const State &o) const {
+  if (type != o.type) return type < o.type;
+  if (tool != o.tool) return tool < o.tool;
+  if (feed != o.feed) return feed < o.feed;
+  return speed < o.speed;
+}
+
+
+uint64_t CompactToolPath::getMemoryUse() const {
+  uint64_t bytes = 3 * x.capacity() * sizeof(float);
+  for (unsigned i = 0; i < 6; i++) bytes += extra[i].capacity() * sizeof(float);
+  bytes += breaks.capacity() * sizeof(uint32_t);
+  bytes += states.capacity() * sizeof(State);
+  bytes += stateIndex.size() * (sizeof(State) + 4 * sizeof(void *));
+  bytes += (state.capacity() + lines.capacity()) * sizeof(uint32_t);
+  bytes += startTimes.capacity() * sizeof(double);
+  bytes += times.capacity() * sizeof(float);
+  bytes += arcs.capacity() * sizeof(Arc);
+
+  return bytes;
+}
+
+
+Move CompactToolPath::get(unsigned i) const {
+  Axes start;
+  Axes end;
+  unsigned p = getStartPoint(i);
+  getPoint(p, start);
+  getPoint(p + 1, end);
+
+  const State &s = states[state[i]];
+  Move move((MoveType::enum_t)s.type, start, end, startTimes[i], s.tool,
+            s.feed, s.speed, lines[i]);
+
+  auto it = lower_bound(arcs.begin(), arcs.end(), i,
+                        [] (const Arc &arc, unsigned i) {return arc.move < i;});
+  if (it != arcs.end() && it->move == i)
+    move.setArc(Vector2D(origin.x() + it->centerX, origin.y() + it->centerY),
+                it->angle);
+
+  // Times may have been planned rather than computed from the feed
+  move.setTime(times[i]);
+
+  return move;
+}
+
+
+void CompactToolPath::add(const Move &move) {
+  unsigned i = size();
+
+  if (!i) origin = move.getStartPt();
+
+  Axes start = move.getStart();
+  if (!i || start != lastEnd) {
+    breaks.push_back(i);
+    addPoint(start);
+  }
+
+  Axes end = move.getEnd();
+  addPoint(end);
+  lastEnd = end;
+
+  State s = {(uint8_t)move.getType(), move.getTool(), move.getFeed(),
+             move.getSpeed()};
+  auto it = stateIndex.find(s);
+
+  if (it == stateIndex.end()) {
+    it = stateIndex.insert(make_pair(s, (uint32_t)states.size())).first;
+    states.push_back(s);
+  }
+
+  state.push_back(it->second);
+  lines.push_back(move.getLine());
+  startTimes.push_back(move.getStartTime());
+  times.push_back(move.getTime());
+
+  if (move.isArc()) {
+    Arc arc = {i, (float)(move.getCenter().x() - origin.x()),
+               (float)(move.getCenter().y() - origin.y()), move.getAngle()};
+    arcs.push_back(arc);
+  }
+
+  bounds.add(move.getBounds());
+  time += move.getTime();
+}
+
+
+void CompactToolPath::write(MoveStream &stream) const {
+  for (unsigned i = 0; i < size(); i++) {
+    Move move = get(i);
+    stream.move(move);
+  }
+}
+
+
+unsigned CompactToolPath::getStartPoint(unsigned i) const {
+  // Every move adds its end point and each break also adds a start point
+  auto it = upper_bound(breaks.begin(), breaks.end(), i);
+  return i + (it - breaks.begin()) - 1;
+}
+
+
+void CompactToolPath::getPoint(unsigned p, Axes &axes) const {
+  axes.setXYZ(origin + Vector3D(x[p], y[p], z[p]));
+
+  for (unsigned j = 0; j < 6; j++)
+    if (!extra[j].empty()) axes[j + 3] = extra[j][p];
+}
+
+
+void CompactToolPath::addPoint(const Axes &axes) {
+  Vector3D offset = axes.getXYZ() - origin;
+  x.push_back(offset.x());
+  y.push_back(offset.y());
+  z.push_back(offset.z());
+
+  for (unsigned j = 0; j < 6; j++) {
+    double value = axes[j + 3];
+    if (value && extra[j].empty()) extra[j].resize(x.size() - 1, 0);
+    if (!extra[j].empty()) extra[j].push_back(value);
+  }
+}
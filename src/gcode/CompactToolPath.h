@@ -0,0 +1,105 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include "MoveStream.h"
+
+#include <cbang/StdTypes.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
+#include <map>
+
+
+namespace GCode {
+  /***
+   * A tool path stored by column, for paths too large to keep as Moves.
+   * Consecutive moves share their end points, XYZ are floats relative to
+   * the first point and the other axes are only stored once one is used.
+   * Type, tool, feed and speed are kept in a table of distinct states.
+   * A straight XYZ move takes 32 bytes.  Moves are rebuilt on access, with
+   * positions within float precision of the originals.
+   */
+  class CompactToolPath : public MoveStream {
+    cb::Rectangle3D bounds;
+    double time;
+
+    // Points, one per move plus one for each move not starting where the
+    // previous one ended
+    cb::Vector3D origin;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> extra[6]; ///< ABCUVW, empty until an axis is used
+    std::vector<uint32_t> breaks; ///< Moves with their own start point
+    Axes lastEnd;
+
+    struct State {
+      uint8_t type;
+      int tool;
+      double feed;
+      double speed;
+
+      bool operator<(const State &o) const;
+    };
+
+    std::vector<State> states;
+    std::map<State, uint32_t> stateIndex;
+
+    // Per move columns
+    std::vector<uint32_t> state;
+    std::vector<uint32_t> lines;
+    std::vector<double> startTimes;
+    std::vector<float> times;
+
+    struct Arc {
+      uint32_t move;
+      float centerX;
+      float centerY;
+      double angle;
+    };
+
+    std::vector<Arc> arcs;
+
+  public:
+    CompactToolPath() : time(0) {}
+
+    unsigned size() const {return lines.size();}
+    bool empty() const {return lines.empty();}
+    const cb::Rectangle3D &getBounds() const {return bounds;}
+    double getTime() const {return time;}
+    /// @return the bytes used by the columns.
+    uint64_t getMemoryUse() const;
+
+    Move get(unsigned i) const;
+    void add(const Move &move);
+    /// Send every move to @param stream, in order.
+    void write(MoveStream &stream) const;
+
+    // From MoveStream
+    void move(Move &move) {add(move);}
+
+  protected:
+    unsigned getStartPoint(unsigned i) const;
+    void getPoint(unsigned p, Axes &axes) const;
+    void addPoint(const Axes &axes);
+  };
+}
@@ -21,6 +21,7 @@
 #include "Controller.h"
 
 #include <gcode/Codes.h>
+#include <gcode/Names.h>
 
 #include <cbang/log/Logger.h>
 #include <cbang/SStream.h>
@@ -45,6 +46,44 @@ Controller::Controller(MachineInterface &machine, const ToolTable &tools) :
 }
 
 
+void Controller::restore(const Controller &o) {
+  SmartPointer<MachineInterface> parent = machine.getParent();
+  *this = o;
+  machine.setParent(parent);
+}
+
+
+bool Controller::sameState(const Controller &o) const {
+  if (memcmp(params, o.params, sizeof(params)) || named != o.named ||
+      memcmp(vars, o.vars, sizeof(vars)) ||
+      memcmp(used, o.used, sizeof(used))) return false;
+
+  // Variable expressions are only kept for the probe tool
+
+  for (int i = 0; i < 9; i++)
+    if (coordSystems[i].number != o.coordSystems[i].number ||
+        coordSystems[i].rotation != o.coordSystems[i].rotation)
+      return false;
+
+  return activeMotion == o.activeMotion && plane == o.plane &&
+    latheDiameterMode == o.latheDiameterMode &&
+    cutterRadiusComp == o.cutterRadiusComp &&
+    toolLengthComp == o.toolLengthComp && pathMode == o.pathMode &&
+    returnMode == o.returnMode &&
+    motionBlendingTolerance == o.motionBlendingTolerance &&
+    naiveCamTolerance == o.naiveCamTolerance &&
+    modalMotion == o.modalMotion &&
+    incrementalDistanceMode == o.incrementalDistanceMode &&
+    arcIncrementalDistanceMode == o.arcIncrementalDistanceMode &&
+    moveInAbsoluteCoords == o.moveInAbsoluteCoords &&
+    feedMode == o.feedMode && spinMode == o.spinMode &&
+    spindleDir == o.spindleDir && speed == o.speed &&
+    maxSpindleSpeed == o.maxSpindleSpeed &&
+    machine.getUnits() == o.machine.getUnits() &&
+    tools.toString() == o.tools.toString();
+}
+
+
 const LocationRange &Controller::getLocation() const {
   return machine.getLocation();
 }
@@ -104,13 +143,18 @@ bool Controller::getFloodCoolant() {
 
 
 double Controller::get(const string &name) const {
-  named_t::const_iterator it = named.find(name);
-  return it == named.end() ? 0 : it->second;
+  return getNamed(Names::intern(name));
 }
 
 
 void Controller::set(const string &name, double value) {
-  named[name] = value;
+  setNamed(Names::intern(name), value);
+}
+
+
+void Controller::setNamed(unsigned slot, double value) {
+  if (named.size() <= slot) named.resize(slot + 1);
+  named[slot] = value;
 }
 
 
@@ -34,7 +34,7 @@
 #include <cbang/LocationRange.h>
 #include <cbang/SmartPointer.h>
 
-#include <map>
+#include <vector>
 #include <string>
 
 
@@ -72,8 +72,7 @@ namespace GCode {
     ToolTable tools;
 
     double params[MAX_ADDRESS];
-    typedef std::map<std::string, double> named_t;
-    named_t named;
+    std::vector<double> named; // By Names slot
 
     double vars[MAX_VAR];
     cb::SmartPointer<Entity> varExprs[MAX_VAR];
@@ -106,6 +105,13 @@ namespace GCode {
                const ToolTable &tools = ToolTable());
     virtual ~Controller() {}
 
+    /// Take the state of @param o, a copy of this or another controller,
+    /// but keep driving this controller's machine.
+    void restore(const Controller &o);
+    /// @return true if @param o would interpret the rest of a program the
+    /// same way, ignoring the machine it drives.
+    bool sameState(const Controller &o) const;
+
     // State variables
     const ToolTable &getToolTable() {return tools;}
     Tool &getTool(unsigned tool) {return tools.get(tool);}
@@ -155,6 +161,9 @@ namespace GCode {
     {if (addr < MAX_ADDRESS) params[addr] = value;}
     double get(const std::string &name) const;
     void set(const std::string &name, double value);
+    double getNamed(unsigned slot) const
+    {return slot < named.size() ? named[slot] : 0;}
+    void setNamed(unsigned slot, double value);
 
     // Variables
     void setVar(char c, double value)
@@ -23,6 +23,8 @@
 #include <cbang/Math.h>
 #include <cbang/log/Logger.h>
 
+#include <algorithm>
+
 using namespace GCode;
 using namespace cb;
 using namespace std;
@@ -30,9 +32,22 @@ using namespace std;
 
 Move::Move(MoveType type, const Axes &start, const Axes &end, double startTime,
            int tool, double feed, double speed, unsigned line) :
-  cb::Segment3D(start.getXYZ(), end.getXYZ()), type(type),
-  start(start), end(end), tool(tool), speed(speed), line(line),
-  dist(start.distance(end)), startTime(startTime) {
+  cb::Segment3D(start.getXYZ(), end.getXYZ()), type(type), tool(tool),
+  speed(speed), line(line), dist(start.distance(end)), startTime(startTime),
+  angle(0), radius(0), startAngle(0) {
+
+  for (unsigned i = 3; i < 9; i++)
+    if (start[i] || end[i]) {
+      ExtraAxes *axes = new ExtraAxes;
+
+      for (unsigned j = 0; j < 6; j++) {
+        axes->start[j] = start[j + 3];
+        axes->end[j] = end[j + 3];
+      }
+
+      extra = axes;
+      break;
+    }
 
   if (type != MoveType::MOVE_RAPID && !feed)
     THROW("Cutting move with zero feed");
@@ -48,23 +63,89 @@ void Move::setFeed(double feed) {
 }
 
 
+void Move::setArc(const cb::Vector2D &center, double angle) {
+  const cb::Vector3D &startPt = getStartPt();
+  cb::Vector2D offset(startPt.x() - center.x(), startPt.y() - center.y());
+
+  this->center = center;
+  this->angle = angle;
+  radius = offset.length();
+  startAngle = atan2(offset.y(), offset.x());
+
+  // Helix length
+  double zDelta = getEndPt().z() - startPt.z();
+  dist = sqrt(radius * angle * radius * angle + zDelta * zDelta);
+
+  setFeed(feed);
+}
+
+
+double Move::getFractionAtTime(double time) const {
+  if (getEndTime() <= time) return 1;
+  if (time <= getStartTime()) return 0;
+  return (time - getStartTime()) / getTime();
+}
+
+
+cb::Vector3D Move::getPtAt(double u) const {
+  if (u <= 0) return getStartPt();
+  if (1 <= u) return getEndPt();
+
+  const cb::Vector3D &startPt = getStartPt();
+  if (!angle) return startPt + (getEndPt() - startPt) * u;
+
+  double z = startPt.z() + (getEndPt().z() - startPt.z()) * u;
+  double a = startAngle - angle * u;
+  return cb::Vector3D(center.x() + radius * cos(a),
+                      center.y() + radius * sin(a), z);
+}
+
+
 cb::Vector3D Move::getPtAtTime(double time) const {
-  if (getEndTime() <= time) return getEndPt();
-  if (time <= getStartTime()) return getStartPt();
+  return getPtAt(getFractionAtTime(time));
+}
+
+
+cb::Rectangle3D Move::getBounds() const {
+  cb::Rectangle3D bounds(getStartPt(), getEndPt());
+  if (!angle) return bounds;
 
-  double delta = time - getStartTime();
-  return getStartPt() + (getEndPt() - getStartPt()) * delta / getTime();
+  // Add each axis extreme the arc passes through
+  double a0 = std::min(startAngle, startAngle - angle);
+  double a1 = std::max(startAngle, startAngle - angle);
+  double z = getStartPt().z();
+
+  for (int i = std::ceil(a0 / (M_PI / 2)); i * (M_PI / 2) <= a1; i++) {
+    double a = i * (M_PI / 2);
+    bounds.add(cb::Vector3D(center.x() + radius * cos(a),
+                            center.y() + radius * sin(a), z));
+  }
+
+  return bounds;
 }
 
 
 void Move::print(std::ostream &stream) const {
   stream
     << "type:" << type << ' '
-    << "x:" << end.getX() << ' '
-    << "y:" << end.getY() << ' '
-    << "z:" << end.getZ() << ' '
+    << "x:" << getEndPt().x() << ' '
+    << "y:" << getEndPt().y() << ' '
+    << "z:" << getEndPt().z() << ' '
     << "tool:" << tool << ' '
     << "feed:" << feed << ' '
     << "speed:" << speed << ' '
     << "line:" << line;
 }
+
+
+Axes Move::getAxes(bool atEnd) const {
+  Axes axes;
+  axes.setXYZ(atEnd ? getEndPt() : getStartPt());
+
+  if (!extra.isNull()) {
+    const double *v = atEnd ? extra->end : extra->start;
+    for (unsigned i = 0; i < 6; i++) axes[i + 3] = v[i];
+  }
+
+  return axes;
+}
@@ -26,7 +26,9 @@
 #include <gcode/Tool.h>
 #include <gcode/Axes.h>
 
+#include <cbang/SmartPointer.h>
 #include <cbang/geom/Segment.h>
+#include <cbang/geom/Rectangle.h>
 
 #include <ostream>
 
@@ -34,9 +36,15 @@
 namespace GCode {
   class Move : public cb::Segment3D, public MoveType {
   protected:
+    // X, Y and Z are kept by the segment.  The other axes are only stored
+    // for the rare moves which leave any of them off zero.
+    struct ExtraAxes {
+      double start[6];
+      double end[6];
+    };
+
     MoveType type;
-    Axes start;
-    Axes end;
+    cb::SmartPointer<const ExtraAxes> extra;
     int tool;
     double feed;
     double speed;
@@ -46,15 +54,24 @@ namespace GCode {
     double time;
     double startTime;
 
+    // XY arcs, otherwise angle is zero and the move is a straight line
+    cb::Vector2D center;
+    double angle;
+    double radius;
+    double startAngle;
+
   public:
     Move() : type(MoveType::MOVE_RAPID), tool(0), feed(0), speed(0), line(0),
-             dist(0), time(0), startTime(0) {}
+             dist(0), time(0), startTime(0), angle(0), radius(0),
+             startAngle(0) {}
     Move(MoveType type, const Axes &start, const Axes &end,
          double startTime, int tool, double feed, double speed, unsigned line);
 
     MoveType getType() const {return type;}
-    const Axes &getStart() const {return start;}
-    const Axes &getEnd() const {return end;}
+    Axes getStart() const {return getAxes(false);}
+    Axes getEnd() const {return getAxes(true);}
+    /// @return true if the move uses any axis other than X, Y and Z.
+    bool hasExtraAxes() const {return !extra.isNull();}
     const cb::Vector3D &getStartPt() const {return cb::Segment3D::getStart();}
     const cb::Vector3D &getEndPt() const {return cb::Segment3D::getEnd();}
     int getTool() const {return tool;}
@@ -62,15 +79,37 @@ namespace GCode {
     void setFeed(double feed);
     double getSpeed() const {return speed;}
     unsigned getLine() const {return line;}
+    void setLine(unsigned line) {this->line = line;}
 
     double getDistance() const {return dist;}
     double getTime() const {return time;}
+    void setTime(double time) {this->time = time;}
     double getStartTime() const {return startTime;}
+    void setStartTime(double startTime) {this->startTime = startTime;}
     double getEndTime() const {return startTime + time;}
 
+    bool isArc() const {return angle;}
+    const cb::Vector2D &getCenter() const {return center;}
+    /// @return the arc's angle in radians, positive is clockwise.
+    double getAngle() const {return angle;}
+    double getRadius() const {return radius;}
+    /// @return the angle of the start point about the center.
+    double getStartAngle() const {return startAngle;}
+    /// Make this a helical move about @param center in the XY plane.
+    void setArc(const cb::Vector2D &center, double angle);
+
+    /// @return how far along the move it is at @param time, from 0 to 1.
+    double getFractionAtTime(double time) const;
+    /// @return the point @param u of the way along the move.
+    cb::Vector3D getPtAt(double u) const;
     cb::Vector3D getPtAtTime(double time) const;
+    /// @return the bounds of the XYZ path, including the arc's bulge.
+    cb::Rectangle3D getBounds() const;
 
     void print(std::ostream &stream) const;
+
+  protected:
+    Axes getAxes(bool atEnd) const;
   };
 
 
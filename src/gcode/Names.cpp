@@ -0,0 +1,70 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "Names.h"
+
+#include <cbang/Exception.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/util/SmartLock.h>
+
+#include <map>
+#include <vector>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+namespace {
+  // Names are interned from parse threads too
+  struct Table : public Mutex {
+    map<string, unsigned> slots;
+    vector<string> names;
+  };
+
+
+  Table &getTable() {
+    static Table table;
+    return table;
+  }
+}
+
+
+unsigned Names::intern(const string &name) {
+  Table &table = getTable();
+  SmartLock lock(&table);
+
+  map<string, unsigned>::iterator it = table.slots.find(name);
+  if (it != table.slots.end()) return it->second;
+
+  unsigned slot = table.names.size();
+  table.slots[name] = slot;
+  table.names.push_back(name);
+
+  return slot;
+}
+
+
+string Names::get(unsigned slot) {
+  Table &table = getTable();
+  SmartLock lock(&table);
+
+  if (table.names.size() <= slot) THROWS("Invalid name slot " << slot);
+  return table.names[slot];
+}
@@ -17,24 +17,22 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 \******************************************************************************/
-
 #pragma once
 
-#include "PlannerCommand.h"
 
+#include <string>
 
-namespace GCode {
-  class DwellCommand : public PlannerCommand {
-    double seconds;
 
+namespace GCode {
+  /***
+   * Interns the names of named parameters in to small integer slots, so
+   * that named parameters can be stored in flat arrays.  Slots are only
+   * ever added and are shared by all parsers and interpreters.
+   */
+  class Names {
   public:
-    DwellCommand(uint64_t line, double seconds) :
-      PlannerCommand(line), seconds(seconds) {}
-
-    // From PlannerCommand
-    const char *getType() {return "dwell";}
-    void setEntryVelocity(double entryVel) {}
-    void setExitVelocity(double exitVel) {}
-    void insert(cb::JSON::Sink &sink);
+    /// @return the slot of @param name, adding it if needed.
+    static unsigned intern(const std::string &name);
+    static std::string get(unsigned slot);
   };
 }
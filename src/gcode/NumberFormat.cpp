@@ -0,0 +1,106 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "NumberFormat.h"
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+using namespace std;
+
+
+namespace {
+  const unsigned maxDigits = 9;
+  const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+
+  void appendSlow(string &s, double x, unsigned digits) {
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf), "%.*f", digits, x);
+    if (n <= 0 || (int)sizeof(buf) <= n) n = snprintf(buf, 32, "%g", x);
+
+    // Trim trailing zeros and the decimal point
+    if (digits) {
+      while (buf[n - 1] == '0') n--;
+      if (buf[n - 1] == '.') n--;
+    }
+
+    if (n == 2 && buf[0] == '-' && buf[1] == '0') s += '0';
+    else s.append(buf, n);
+  }
+}
+
+
+void GCode::appendNumber(string &s, double x, unsigned digits) {
+  digits = min(digits, maxDigits);
+
+  double scaled = fabs(x) * pow10[digits];
+  if (!(scaled < 1e15)) return appendSlow(s, x, digits);
+
+  double whole = floor(scaled);
+  double frac = scaled - whole;
+
+  // The scaling above can round, so leave near ties to printf()
+  double tolerance = max(1e-6, scaled * 1e-15);
+  if (fabs(frac - 0.5) < tolerance) return appendSlow(s, x, digits);
+
+  uint64_t n = (uint64_t)whole + (0.5 < frac ? 1 : 0);
+  if (!n) {s += '0'; return;}
+
+  uint64_t unit = (uint64_t)pow10[digits];
+  uint64_t intPart = n / unit;
+  uint64_t fracPart = n % unit;
+
+  char buf[40];
+  char *end = buf + sizeof(buf);
+  char *p = end;
+
+  if (fracPart) {
+    unsigned count = digits;
+    while (!(fracPart % 10)) {fracPart /= 10; count--;}
+
+    for (unsigned i = 0; i < count; i++) {
+      *--p = '0' + fracPart % 10;
+      fracPart /= 10;
+    }
+
+    *--p = '.';
+  }
+
+  do {
+    *--p = '0' + intPart % 10;
+    intPart /= 10;
+  } while (intPart);
+
+  if (x < 0) *--p = '-';
+
+  s.append(p, end - p);
+}
+
+
+string GCode::formatNumber(double x, unsigned digits) {
+  string s;
+  appendNumber(s, x, digits);
+  return s;
+}
@@ -18,23 +18,20 @@
 
 \******************************************************************************/
 
+
 #pragma once
 
-#include "PlannerCommand.h"
+
+#include <string>
 
 
 namespace GCode {
-  class PauseCommand : public PlannerCommand {
-    bool optional;
-
-  public:
-    PauseCommand(uint64_t line, bool optional) :
-      PlannerCommand(line), optional(optional) {}
-
-    // From PlannerCommand
-    const char *getType() {return "pause";}
-    void setEntryVelocity(double entryVel) {}
-    void setExitVelocity(double exitVel) {}
-    void insert(cb::JSON::Sink &sink);
-  };
+  /***
+   * Fixed point number formatting for G-code output.  Values are rounded to
+   * at most @param digits decimal places, trailing zeros are trimmed and
+   * negative zero is written as 0.  Digits are generated from integers, only
+   * falling back to printf() when rounding is too close to call.
+   */
+  void appendNumber(std::string &s, double x, unsigned digits);
+  std::string formatNumber(double x, unsigned digits);
 }
@@ -22,6 +22,7 @@
 
 
 #include <gcode/ast/Block.h>
+#include <gcode/ast/SimpleBlock.h>
 
 #include <cbang/SmartPointer.h>
 
@@ -29,5 +30,11 @@ namespace GCode {
   class Processor {
   public:
     virtual void operator()(const cb::SmartPointer<Block> &block) = 0;
+
+    /// Blocks of constant words are passed to the SimpleBlock operator
+    /// instead, without building an AST, while this returns true.
+    virtual bool wantsSimpleBlocks() const {return false;}
+    /// @param block is reused for the next block so it must not be kept.
+    virtual void operator()(const SimpleBlock &block) {}
   };
 }
@@ -29,7 +29,7 @@ using namespace std;
 
 
 Runner::Runner(Controller &controller, const InputSource &source) :
-  interpreter(controller), scanner(source), tokenizer(scanner), done(false) {
+  interpreter(controller), tokenizer(source), done(false) {
 }
 
 
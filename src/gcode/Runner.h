@@ -29,7 +29,6 @@ namespace GCode {
 
   class Runner {
     Interpreter interpreter;
-    cb::Scanner scanner;
     GCode::Tokenizer tokenizer;
 
     bool done;
@@ -96,6 +96,19 @@ void Tool::setLengthFromAngle(double angle) {
 }
 
 
+void Tool::setProfile(const vector<Vector2D> &profile) {
+  this->profile = profile;
+  if (profile.empty()) return;
+
+  double radius = 0;
+  for (unsigned i = 0; i < profile.size(); i++)
+    if (radius < profile[i].x()) radius = profile[i].x();
+
+  setRadius(radius);
+  setLength(profile.back().y());
+}
+
+
 ostream &Tool::print(ostream &stream) const {
   stream << "T" << number << " R" << getRadius() << " L" << getLength();
   return Axes::print(stream);
@@ -125,6 +138,25 @@ void Tool::read(const XMLAttributes &attrs) {
 
   if (attrs.has("snub_diameter"))
     setSnubDiameter(String::parseDouble(attrs["snub_diameter"]) * scale);
+
+  // Space separated radius,height pairs
+  if (attrs.has("profile")) {
+    vector<string> points;
+    String::tokenize(attrs["profile"], points);
+
+    vector<Vector2D> profile;
+    for (unsigned i = 0; i < points.size(); i++) {
+      vector<string> coords;
+      String::tokenize(points[i], coords, ",");
+      if (coords.size() != 2)
+        THROWS("Tool " << number << " invalid profile point " << points[i]);
+
+      profile.push_back(Vector2D(String::parseDouble(coords[0]) * scale,
+                                 String::parseDouble(coords[1]) * scale));
+    }
+
+    setProfile(profile);
+  }
 }
 
 
@@ -141,6 +173,16 @@ void Tool::write(XMLWriter &writer) const {
   if (getShape() == ToolShape::TS_SNUBNOSE && small < getSnubDiameter())
     attrs["snub_diameter"] = String(getSnubDiameter() * scale);
 
+  if (getShape() == ToolShape::TS_PROFILE && !profile.empty()) {
+    string points;
+
+    for (unsigned i = 0; i < profile.size(); i++)
+      points += String::printf("%s%g,%g", i ? " " : "",
+                               profile[i].x() * scale, profile[i].y() * scale);
+
+    attrs["profile"] = points;
+  }
+
   writer.simpleElement("tool", getDescription(), attrs);
 }
 
@@ -157,6 +199,20 @@ void Tool::write(JSON::Sink &sink, bool withNumber) const {
   sink.insert("diameter", getDiameter() * scale);
   if (getShape() == ToolShape::TS_SNUBNOSE)
     sink.insert("snub_diameter", getSnubDiameter() * scale);
+
+  if (getShape() == ToolShape::TS_PROFILE) {
+    sink.insertList("profile");
+
+    for (unsigned i = 0; i < profile.size(); i++) {
+      sink.appendList(true);
+      sink.append(profile[i].x() * scale);
+      sink.append(profile[i].y() * scale);
+      sink.endList();
+    }
+
+    sink.endList();
+  }
+
   sink.insert("description", getDescription());
 
   sink.endDict();
@@ -183,5 +239,18 @@ void Tool::read(const JSON::Value &value) {
   if (value.hasNumber("snub_diameter"))
     setSnubDiameter(value.getNumber("snub_diameter") * scale);
 
+  if (value.hasList("profile")) {
+    const JSON::Value &points = value.getList("profile");
+    vector<Vector2D> profile;
+
+    for (unsigned i = 0; i < points.size(); i++) {
+      const JSON::Value &point = points.getList(i);
+      profile.push_back(Vector2D(point.getNumber(0) * scale,
+                                 point.getNumber(1) * scale));
+    }
+
+    setProfile(profile);
+  }
+
   setDescription(value.getString("description", ""));
 }
@@ -27,6 +27,9 @@
 #include <gcode/Axes.h>
 
 #include <cbang/json/Serializable.h>
+#include <cbang/geom/Vector.h>
+
+#include <vector>
 
 
 namespace cb {
@@ -46,6 +49,7 @@ namespace GCode {
     ToolShape shape;
     double vars[4];
     double snubDiameter;
+    std::vector<cb::Vector2D> profile; ///< Radius by height above the tip
     std::string description;
 
   public:
@@ -89,6 +93,11 @@ namespace GCode {
     void setDiameter(double value) {vars[0] = value / 2;}
     void setSnubDiameter(double value) {snubDiameter = value;}
 
+    const std::vector<cb::Vector2D> &getProfile() const {return profile;}
+    /// Set the (radius, height) points of a profile tool, from the tip up.
+    /// The radius and length become the profile's widest radius and height.
+    void setProfile(const std::vector<cb::Vector2D> &profile);
+
     std::ostream &print(std::ostream &stream) const;
 
     void read(const cb::XMLAttributes &attrs);
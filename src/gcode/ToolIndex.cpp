@@ -18,12 +18,30 @@
 
 \******************************************************************************/
 
-#include "DwellCommand.h"
 
-#include <cbang/json/Sink.h>
+#include "ToolIndex.h"
 
 using namespace GCode;
-using namespace cb;
 
 
-void DwellCommand::insert(JSON::Sink &sink) {sink.insert("seconds", seconds);}
+void ToolIndex::clear() {
+  dense.clear();
+  overflow.clear();
+}
+
+
+void ToolIndex::set(unsigned number, const Tool *tool) {
+  if (maxDense <= number) {
+    overflow[number] = tool;
+    return;
+  }
+
+  if (dense.size() <= number) dense.resize(number + 1, 0);
+  dense[number] = tool;
+}
+
+
+const Tool *ToolIndex::findOverflow(unsigned number) const {
+  auto it = overflow.find(number);
+  return it == overflow.end() ? 0 : it->second;
+}
@@ -0,0 +1,57 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <vector>
+#include <map>
+
+
+namespace GCode {
+  class Tool;
+
+  /***
+   * Tool lookup by number without map traversal.  Numbers below maxDense
+   * are kept in a vector indexed by number and any others in an overflow
+   * map.  The index only points at tools, it does not own them.
+   */
+  class ToolIndex {
+    std::vector<const Tool *> dense;
+    std::map<unsigned, const Tool *> overflow;
+
+  public:
+    static const unsigned maxDense = 1024;
+
+    void clear();
+    void set(unsigned number, const Tool *tool);
+
+    /// @return the tool with @param number or null if it is not indexed.
+    const Tool *find(int number) const {
+      if (number < 0) return 0;
+      if ((unsigned)number < dense.size()) return dense[number];
+      return maxDense <= (unsigned)number ? findOverflow(number) : 0;
+    }
+
+  protected:
+    const Tool *findOverflow(unsigned number) const;
+  };
+}
@@ -20,27 +20,83 @@
 
 #include "ToolPath.h"
 
+#include <cbang/Exception.h>
+#include <cbang/util/SmartLock.h>
 #include <cbang/json/Sink.h>
 #include <cbang/json/Dict.h>
 
 #include <string>
 #include <limits>
+#include <atomic>
+#include <cstring>
 
 using namespace std;
 using namespace cb;
 using namespace GCode;
 
 
+namespace {
+  // Packed moves start with a mask of the fields which differ from the
+  // previous move, followed by those fields in this order
+  enum {
+    PACK_START      = 1 << 0, // Not where the previous move ended
+    PACK_AXIS       = 1 << 1, // One bit for each changed end axis
+    PACK_TYPE       = 1 << 10,
+    PACK_LINE       = 1 << 11,
+    PACK_TOOL       = 1 << 12,
+    PACK_FEED       = 1 << 13,
+    PACK_SPEED      = 1 << 14,
+    PACK_START_TIME = 1 << 15, // Not when the previous move ended
+    PACK_ARC        = 1 << 16, // Arc center and angle
+  };
+
+  typedef uint32_t mask_t;
+
+
+  atomic<uint64_t> revisions(0);
+
+
+  template <typename T> void append(vector<char> &data, const T &value) {
+    const char *bytes = (const char *)&value;
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+  }
+
+
+  template <typename T>
+  T extract(const char *&data, const char *end) {
+    if (end - data < (ptrdiff_t)sizeof(T)) THROW("Tool path data truncated");
+
+    T value;
+    memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+
+    return value;
+  }
+}
+
+
 ToolPath::~ToolPath() {}
 
 
+void ToolPath::setMoveTime(unsigned i, double startTime, double time) {
+  GCode::Move &move = path_t::at(i);
+
+  this->time += time - move.getTime();
+  move.setStartTime(startTime);
+  move.setTime(time);
+  timeIndex.clear();
+  revision = nextRevision();
+}
+
+
 int ToolPath::find(double time, unsigned first, unsigned last) const {
   // Base case, empty list
   if (first == last) return -1;
 
   // Base case, one item
   if (first == last - 1) {
-    if (at(first).getStartTime() <= time && time <= at(first).getEndTime())
+    const Move &move = (*this)[first];
+    if (move.getStartTime() <= time && time <= move.getEndTime())
       return first;
 
     return -1;
@@ -48,13 +104,155 @@ int ToolPath::find(double time, unsigned first, unsigned last) const {
 
   // Recur
   unsigned mid = (first + last) / 2;
-  if (time < at(mid).getStartTime()) return find(time, first, mid);
+  if (time < (*this)[mid].getStartTime()) return find(time, first, mid);
   return find(time, mid, last);
 }
 
 
+uint64_t ToolPath::getMemoryUsage() const {
+  SmartLock lock(&indexLock);
+
+  // Map nodes hold a key, a value and about four pointers
+  return sizeof(ToolPath) + capacity() * sizeof(Move) +
+    timeIndex.capacity() * sizeof(uint32_t) +
+    cutBounds.size() * (sizeof(int) + sizeof(cb::Rectangle3D) + 32);
+}
+
+
 int ToolPath::find(double time) const {
-  return find(time, 0, size());
+  if (empty() || time < (*this)[0].getStartTime()) return -1;
+
+  unsigned i;
+  {
+    SmartLock lock(&indexLock);
+    if (timeIndex.empty()) updateTimeIndex();
+
+    double bucket = time / timeStep;
+    i = bucket < timeIndex.size() ? timeIndex[bucket] : timeIndex.back();
+  }
+
+  // Step to the last move starting at or before time
+  while (i + 1 < size() && (*this)[i + 1].getStartTime() <= time) i++;
+
+  const Move &move = (*this)[i];
+  if (move.getStartTime() <= time && time <= move.getEndTime()) return i;
+
+  return -1;
+}
+
+
+void ToolPath::pack(vector<char> &data) const {
+  GCode::Axes lastEnd;
+  GCode::MoveType type = GCode::MoveType::MOVE_RAPID;
+  unsigned line = 0;
+  int tool = 1;
+  double feed = 0;
+  double speed = 0;
+  double time = 0;
+
+  append<uint64_t>(data, size());
+
+  for (unsigned i = 0; i < size(); i++) {
+    const GCode::Move &move = at(i);
+    GCode::Axes start = move.getStart();
+    GCode::Axes end = move.getEnd();
+    mask_t mask = 0;
+
+    if (start != lastEnd) mask |= PACK_START;
+    for (unsigned j = 0; j < 9; j++)
+      if (end[j] != lastEnd[j]) mask |= PACK_AXIS << j;
+    if (move.getType() != type) mask |= PACK_TYPE;
+    if (move.getLine() != line) mask |= PACK_LINE;
+    if (move.getTool() != tool) mask |= PACK_TOOL;
+    if (move.getFeed() != feed) mask |= PACK_FEED;
+    if (move.getSpeed() != speed) mask |= PACK_SPEED;
+    if (move.getStartTime() != time) mask |= PACK_START_TIME;
+    if (move.isArc()) mask |= PACK_ARC;
+
+    append(data, mask);
+
+    if (mask & PACK_START)
+      for (unsigned j = 0; j < 9; j++) append(data, start[j]);
+    for (unsigned j = 0; j < 9; j++)
+      if (mask & (PACK_AXIS << j)) append(data, end[j]);
+    if (mask & PACK_TYPE) append<uint8_t>(data, move.getType());
+    if (mask & PACK_LINE) append<uint32_t>(data, move.getLine());
+    if (mask & PACK_TOOL) append<int32_t>(data, move.getTool());
+    if (mask & PACK_FEED) append(data, move.getFeed());
+    if (mask & PACK_SPEED) append(data, move.getSpeed());
+    if (mask & PACK_START_TIME) append(data, move.getStartTime());
+    if (mask & PACK_ARC) {
+      append(data, move.getCenter().x());
+      append(data, move.getCenter().y());
+      append(data, move.getAngle());
+    }
+
+    lastEnd = end;
+    type = move.getType();
+    line = move.getLine();
+    tool = move.getTool();
+    feed = move.getFeed();
+    speed = move.getSpeed();
+    time = move.getEndTime();
+  }
+}
+
+
+void ToolPath::unpack(const char *data, uint64_t length) {
+  const char *end = data + length;
+  GCode::Axes lastEnd;
+  GCode::MoveType type = GCode::MoveType::MOVE_RAPID;
+  unsigned line = 0;
+  int tool = 1;
+  double feed = 0;
+  double speed = 0;
+  double time = 0;
+
+  uint64_t count = extract<uint64_t>(data, end);
+  // Each move takes at least its mask
+  if ((uint64_t)(end - data) / sizeof(mask_t) < count)
+    THROW("Tool path data truncated");
+  reserve(size() + count);
+
+  for (uint64_t i = 0; i < count; i++) {
+    mask_t mask = extract<mask_t>(data, end);
+
+    GCode::Axes start = lastEnd;
+    if (mask & PACK_START)
+      for (unsigned j = 0; j < 9; j++) start[j] = extract<double>(data, end);
+
+    GCode::Axes moveEnd = lastEnd;
+    for (unsigned j = 0; j < 9; j++)
+      if (mask & (PACK_AXIS << j)) moveEnd[j] = extract<double>(data, end);
+
+    if (mask & PACK_TYPE) {
+      uint8_t t = extract<uint8_t>(data, end);
+      if (!GCode::MoveType::isValid((GCode::MoveType::enum_t)t))
+        THROW("Invalid move type in tool path data");
+      type = (GCode::MoveType::enum_t)t;
+    }
+
+    if (mask & PACK_LINE) line = extract<uint32_t>(data, end);
+    if (mask & PACK_TOOL) tool = extract<int32_t>(data, end);
+    if (mask & PACK_FEED) feed = extract<double>(data, end);
+    if (mask & PACK_SPEED) speed = extract<double>(data, end);
+    if (mask & PACK_START_TIME) time = extract<double>(data, end);
+
+    GCode::Move m(type, start, moveEnd, time, tool, feed, speed, line);
+
+    if (mask & PACK_ARC) {
+      double x = extract<double>(data, end);
+      double y = extract<double>(data, end);
+      m.setArc(cb::Vector2D(x, y), extract<double>(data, end));
+    }
+
+    move(m);
+
+    time = m.getEndTime();
+    lastEnd = moveEnd;
+  }
+
+  if (data != end) THROW("Tool path data has trailing bytes");
 }
 
 
@@ -82,6 +280,11 @@ void ToolPath::read(const JSON::Value &value) {
     speed = dict.getNumber("speed", speed);
 
     GCode::Move m(type, start, end, time, tool, feed, speed, line);
+
+    if (dict.hasNumber("angle"))
+      m.setArc(cb::Vector2D(dict.getNumber("cx"), dict.getNumber("cy")),
+               dict.getNumber("angle"));
+
     move(m);
 
     time += m.getTime();
@@ -104,10 +307,10 @@ void ToolPath::write(JSON::Sink &sink) const {
     sink.appendDict(true);
 
     // Axes
+    GCode::Axes end = move.getEnd();
     for (unsigned j = 0; j < 9; j++)
-      if (move.getEnd()[j] != lastPos[j])
-        sink.insert(string(1, GCode::Axes::toAxis(j)),
-                    lastPos[j] = move.getEnd()[j]);
+      if (end[j] != lastPos[j])
+        sink.insert(string(1, GCode::Axes::toAxis(j)), lastPos[j] = end[j]);
 
     // Type
     if (type != move.getType())
@@ -129,6 +332,13 @@ void ToolPath::write(JSON::Sink &sink) const {
     if (speed != move.getSpeed())
       sink.insert("speed", speed = move.getSpeed());
 
+    // Arc
+    if (move.isArc()) {
+      sink.insert("cx", move.getCenter().x());
+      sink.insert("cy", move.getCenter().y());
+      sink.insert("angle", move.getAngle());
+    }
+
     sink.endDict();
   }
 
@@ -136,12 +346,45 @@ void ToolPath::write(JSON::Sink &sink) const {
 }
 
 
+uint64_t ToolPath::nextRevision() {return ++revisions;}
+
+
+void ToolPath::updateTimeIndex() const {
+  // About one move per bucket, so moves of very different lengths only
+  // cost a short scan
+  double endTime = back().getEndTime();
+  unsigned buckets = size();
+  timeStep = endTime / buckets;
+  if (!timeStep) timeStep = 1;
+
+  timeIndex.resize(buckets);
+
+  unsigned i = 0;
+  for (unsigned b = 0; b < buckets; b++) {
+    double t = b * timeStep;
+    while (i + 1 < size() && (*this)[i + 1].getStartTime() <= t) i++;
+    timeIndex[b] = i;
+  }
+}
+
+
 void ToolPath::move(GCode::Move &move) {
   push_back(move);
+  timeIndex.clear();
+  revision = nextRevision();
+
+  // Resolve the tool now so per move lookups need not search the table
+  int tool = move.getTool();
+  if (0 <= tool && !toolIndex.find(tool)) toolIndex.set(tool, &tools.get(tool));
 
   // Bounds
-  cb::Rectangle3D::add(move.getStartPt());
-  cb::Rectangle3D::add(move.getEndPt());
+  cb::Rectangle3D bounds;
+  if (move.isArc()) bounds = move.getBounds();
+  else bounds.add(move.getStartPt()).add(move.getEndPt());
+  cb::Rectangle3D::add(bounds);
+
+  if (move.getType() != MoveType::MOVE_RAPID && 0 <= move.getTool())
+    cutBounds[move.getTool()].add(bounds);
 
   time += move.getTime();
   distance += move.getDistance();
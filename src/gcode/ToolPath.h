@@ -22,11 +22,14 @@
 
 #include <gcode/MoveStream.h>
 #include <gcode/ToolTable.h>
+#include <gcode/ToolIndex.h>
 
 #include <cbang/json/Serializable.h>
 #include <cbang/geom/Rectangle.h>
+#include <cbang/os/Mutex.h>
 
 #include <vector>
+#include <map>
 #include <ostream>
 
 
@@ -39,26 +42,59 @@ namespace GCode {
     protected std::vector<GCode::Move>, public cb::Rectangle3D,
     public GCode::MoveStream, public cb::JSON::Serializable {
     GCode::ToolTable tools;
+    GCode::ToolIndex toolIndex; ///< The tools of the moves, see move()
 
     double time;
     double distance;
+    uint64_t revision;
+    std::map<int, cb::Rectangle3D> cutBounds;
+
+    // Built on the first find() after a change.  Bucket b holds the move
+    // find() would return for time b * timeStep.
+    mutable cb::Mutex indexLock;
+    mutable std::vector<uint32_t> timeIndex;
+    mutable double timeStep;
 
   public:
     ToolPath(const GCode::ToolTable &tools) :
-      tools(tools), time(0), distance(0) {}
+      tools(tools), time(0), distance(0), revision(nextRevision()),
+      timeStep(0) {}
     ~ToolPath();
 
     const cb::Rectangle3D &getBounds() const {return *this;}
     const GCode::ToolTable &getTools() const {return tools;}
-    GCode::ToolTable &getTools() {return tools;}
+    /// @return the tool of @param move or null if it has none.  Missing
+    /// tools are created when a move using them is added.
+    const GCode::Tool *getTool(const GCode::Move &move) const
+    {return toolIndex.find(move.getTool());}
     double getTime() const {return time;}
     double getDistance() const {return distance;}
+    /// Changes whenever the moves do and is never shared with another path,
+    /// so anything computed from the moves can be kept by revision.
+    uint64_t getRevision() const {return revision;}
+    /// The bounds of the non-rapid moves of each tool, kept as moves are
+    /// added.  They include the bulge of arcs but not the tool.
+    const std::map<int, cb::Rectangle3D> &getCutBounds() const
+    {return cutBounds;}
+
+    /// Replace the timing of move @param i, see MoveTimer.
+    void setMoveTime(unsigned i, double startTime, double time);
+
+    /// @return the bytes held by the moves and their index.
+    uint64_t getMemoryUsage() const;
 
     int find(double time, unsigned first, unsigned last) const;
+    /// @return the last move starting at or before @param time if it is
+    /// still running at that time, otherwise -1.  Constant time on average.
     int find(double time) const;
 
     void print() const {}
 
+    /// Append the moves to @param data in a compact binary form.
+    void pack(std::vector<char> &data) const;
+    /// Append the moves from pack().  Throws if the data is corrupt.
+    void unpack(const char *data, uint64_t length);
+
     // From std::vector<GCode::Move>
     typedef std::vector<GCode::Move> path_t;
     using path_t::size;
@@ -79,5 +115,9 @@ namespace GCode {
 
     // From GCode::MoveStream
     void move(GCode::Move &move);
+
+  protected:
+    static uint64_t nextRevision();
+    void updateTimeIndex() const;
   };
 }
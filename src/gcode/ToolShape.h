@@ -39,5 +39,6 @@ CBANG_ENUM_EXPAND(TS_BALLNOSE,      2)
 CBANG_ENUM_EXPAND(TS_SPHEROID,      3)
 CBANG_ENUM_ALIAS(TS_SPHERE,         TS_SPHEROID)
 CBANG_ENUM_EXPAND(TS_SNUBNOSE,      4)
+CBANG_ENUM_EXPAND(TS_PROFILE,       5)
 
 #endif // CBANG_ENUM_EXPAND
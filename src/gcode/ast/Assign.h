@@ -41,6 +41,8 @@ namespace GCode {
 
     cb::SmartPointer<Entity> getReference() const {return ref;}
     cb::SmartPointer<Entity> getExpression() const {return expr;}
+    void setExpression(const cb::SmartPointer<Entity> &expr)
+    {this->expr = expr;}
 
     double getExprValue() const {return exprValue;}
 
@@ -0,0 +1,305 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "CompiledExpr.h"
+
+#include "UnaryOp.h"
+#include "BinaryOp.h"
+#include "QuotedExpr.h"
+#include "Reference.h"
+#include "NamedReference.h"
+#include "FunctionCall.h"
+#include "Number.h"
+#include "FoldedExpr.h"
+
+#include <gcode/Addresses.h>
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/Math.h>
+#include <cbang/log/Logger.h>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+namespace {
+  struct Function {
+    const char *name;
+    unsigned args;
+    CompiledExpr::opcode_t op;
+  };
+
+
+  const Function functions[] = {
+    {"ABS",   1, CompiledExpr::OP_ABS},
+    {"ACOS",  1, CompiledExpr::OP_ACOS},
+    {"ASIN",  1, CompiledExpr::OP_ASIN},
+    {"COS",   1, CompiledExpr::OP_COS},
+    {"EXP",   1, CompiledExpr::OP_EXP_FUNC},
+    {"FIX",   1, CompiledExpr::OP_FIX},
+    {"FUP",   1, CompiledExpr::OP_FUP},
+    {"ROUND", 1, CompiledExpr::OP_ROUND},
+    {"LN",    1, CompiledExpr::OP_LN},
+    {"SIN",   1, CompiledExpr::OP_SIN},
+    {"SQRT",  1, CompiledExpr::OP_SQRT},
+    {"TAN",   1, CompiledExpr::OP_TAN},
+    {"ATAN",  2, CompiledExpr::OP_ATAN},
+    {0, 0, CompiledExpr::OP_CONST},
+  };
+
+
+  // Same order as Operator, from EXP_OP
+  const CompiledExpr::opcode_t binaryOps[] = {
+    CompiledExpr::OP_EXP, CompiledExpr::OP_MUL, CompiledExpr::OP_DIV,
+    CompiledExpr::OP_MOD, CompiledExpr::OP_ADD, CompiledExpr::OP_SUB,
+    CompiledExpr::OP_EQ, CompiledExpr::OP_NE, CompiledExpr::OP_GT,
+    CompiledExpr::OP_GE, CompiledExpr::OP_LT, CompiledExpr::OP_LE,
+    CompiledExpr::OP_AND, CompiledExpr::OP_OR, CompiledExpr::OP_XOR,
+  };
+}
+
+
+CompiledExpr::CompiledExpr(const SmartPointer<Entity> &expr) :
+  expr(expr), result(0), cached(false) {
+  location = expr->getLocation();
+}
+
+
+SmartPointer<Entity> CompiledExpr::compile(const SmartPointer<Entity> &expr) {
+  if (expr.isNull() || expr->instance<CompiledExpr>() ||
+      expr->instance<Number>() || expr->instance<FoldedExpr>()) return expr;
+
+  SmartPointer<CompiledExpr> compiled = new CompiledExpr(expr);
+  if (!compiled->compile(*expr, 0)) return expr;
+  compiled->memoize();
+
+  return compiled;
+}
+
+
+double CompiledExpr::eval(Evaluator &evaluator) {
+  // Reuse the last result if the parameters read are unchanged
+  if (!loads.empty()) {
+    bool same = cached;
+
+    for (unsigned i = 0; i < loads.size(); i++) {
+      double value = load(evaluator, loads[i]);
+      if (value != inputs[i]) {
+        inputs[i] = value;
+        same = cached = false;
+      }
+    }
+
+    if (same) return result;
+    cached = true;
+  }
+
+  double r[maxRegisters];
+
+  for (unsigned i = 0; i < code.size(); i++) {
+    const Instruction &ins = code[i];
+    double &dst = r[ins.dst];
+    const double &a = r[ins.a]; // Only read by instructions that use them
+    const double &b = r[ins.b];
+
+    switch (ins.op) {
+    case OP_CONST: dst = constants[ins.arg]; break;
+    case OP_REF: dst = load(evaluator, ins); break;
+
+    case OP_REF_EXPR:
+      if (a < 1 || MAX_ADDRESS < a || ((unsigned)a) != a)
+        THROWS(ins.entity->getLocation() << " Invalid reference number "
+               << a);
+
+      dst = evaluator.lookupReference((unsigned)a);
+      break;
+
+    case OP_NAMED_REF: dst = load(evaluator, ins); break;
+    case OP_INPUT: dst = inputs[ins.arg]; break;
+    case OP_NEG: dst = -a; break;
+
+    case OP_DIV: case OP_MOD:
+      if (b == 0) {
+        LOG_ERROR(ins.entity->getLocation() << ": Divide by zero");
+        dst = 0;
+        cached = false; // Report it every time
+
+      } else dst = ins.op == OP_DIV ? a / b : fmod(a, b);
+      break;
+
+    case OP_EXP: dst = pow(a, b); break;
+    case OP_MUL: dst = a * b; break;
+    case OP_ADD: dst = a + b; break;
+    case OP_SUB: dst = a - b; break;
+    case OP_EQ: dst = a == b; break;
+    case OP_NE: dst = a != b; break;
+    case OP_GT: dst = a > b; break;
+    case OP_GE: dst = a >= b; break;
+    case OP_LT: dst = a < b; break;
+    case OP_LE: dst = a <= b; break;
+    case OP_AND: dst = a && b; break;
+    case OP_OR: dst = a || b; break;
+    case OP_XOR: dst = (bool)a ^ (bool)b; break;
+
+    case OP_ABS: dst = fabs(a); break;
+    case OP_ACOS: dst = acos(a) * 180.0 / M_PI; break;
+    case OP_ASIN: dst = asin(a) * 180.0 / M_PI; break;
+    case OP_COS: dst = cos(a * M_PI / 180.0); break;
+    case OP_EXP_FUNC: dst = exp(a); break;
+    case OP_FIX: dst = floor(a); break;
+    case OP_FUP: dst = ceil(a); break;
+    case OP_ROUND: dst = Math::round(a); break;
+    case OP_LN: dst = log(a); break;
+    case OP_SIN: dst = sin(a * M_PI / 180.0); break;
+    case OP_SQRT: dst = sqrt(a); break;
+    case OP_TAN: dst = tan(a * M_PI / 180.0); break;
+    case OP_ATAN: dst = atan2(a, b) * 180.0 / M_PI; break;
+    }
+  }
+
+  return result = r[0];
+}
+
+
+void CompiledExpr::print(ostream &stream) const {stream << *expr;}
+
+
+bool CompiledExpr::compile(Entity &entity, unsigned reg) {
+  if (maxRegisters < reg + 2) return false;
+
+  // Fold constants
+  if (entity.isConstant()) {
+    Evaluator evaluator;
+    emit(OP_CONST, reg, 0, 0, constants.size(), entity);
+    constants.push_back(entity.eval(evaluator));
+    return true;
+  }
+
+  QuotedExpr *quoted = entity.instance<QuotedExpr>();
+  if (quoted) return compile(*quoted->getExpression(), reg);
+
+  UnaryOp *unary = entity.instance<UnaryOp>();
+  if (unary) {
+    if (!compile(*unary->getExpr(), reg)) return false;
+
+    switch (unary->getType()) {
+    case Operator::ADD_OP: return true;
+    case Operator::SUB_OP: emit(OP_NEG, reg, reg, 0, 0, entity); return true;
+    default: return false;
+    }
+  }
+
+  BinaryOp *binary = entity.instance<BinaryOp>();
+  if (binary) {
+    unsigned type = binary->getType();
+    if (type < Operator::EXP_OP || Operator::XOR_OP < type) return false;
+
+    if (!compile(*binary->getLeft(), reg) ||
+        !compile(*binary->getRight(), reg + 1)) return false;
+
+    emit(binaryOps[type - Operator::EXP_OP], reg, reg, reg + 1, 0, entity);
+    return true;
+  }
+
+  Reference *ref = entity.instance<Reference>();
+  if (ref) {
+    Entity &number = *ref->getExpression();
+
+    if (number.isConstant()) {
+      Evaluator evaluator;
+      double num = number.eval(evaluator);
+
+      if (1 <= num && num <= MAX_ADDRESS && ((unsigned)num) == num) {
+        emit(OP_REF, reg, 0, 0, (unsigned)num, entity);
+        return true;
+      }
+    }
+
+    // Checked when evaluated
+    if (!compile(number, reg)) return false;
+    emit(OP_REF_EXPR, reg, reg, 0, 0, entity);
+    return true;
+  }
+
+  NamedReference *named = entity.instance<NamedReference>();
+  if (named) {
+    emit(OP_NAMED_REF, reg, 0, 0, 0, entity);
+    return true;
+  }
+
+  FunctionCall *call = entity.instance<FunctionCall>();
+  if (call) {
+    string name = String::toUpper(call->getName());
+    unsigned args = call->getArg2().isNull() ? 1 : 2;
+
+    // Unsupported functions are reported when evaluated
+    for (unsigned i = 0; functions[i].name; i++)
+      if (functions[i].args == args && name == functions[i].name) {
+        if (!compile(*call->getArg1(), reg) ||
+            (args == 2 && !compile(*call->getArg2(), reg + 1))) return false;
+
+        emit(functions[i].op, reg, reg, reg + 1, 0, entity);
+        return true;
+      }
+  }
+
+  return false;
+}
+
+
+void CompiledExpr::emit(opcode_t op, unsigned dst, unsigned a, unsigned b,
+                        unsigned arg, const Entity &entity) {
+  Instruction ins = {(unsigned char)op, (unsigned char)dst, (unsigned char)a,
+                     (unsigned char)b, arg, &entity};
+  code.push_back(ins);
+}
+
+
+void CompiledExpr::memoize() {
+  // Computed addresses could read anything
+  unsigned count = 0;
+  for (unsigned i = 0; i < code.size(); i++)
+    switch (code[i].op) {
+    case OP_REF_EXPR: return;
+    case OP_REF: case OP_NAMED_REF: count++; break;
+    default: break;
+    }
+
+  // Only worth it if there is arithmetic to skip
+  if (!count || count == code.size()) return;
+
+  for (unsigned i = 0; i < code.size(); i++) {
+    Instruction &ins = code[i];
+    if (ins.op != OP_REF && ins.op != OP_NAMED_REF) continue;
+
+    loads.push_back(ins);
+    ins.op = OP_INPUT;
+    ins.arg = loads.size() - 1;
+  }
+
+  inputs.resize(loads.size());
+}
+
+
+double CompiledExpr::load(Evaluator &evaluator, const Instruction &ins) const {
+  if (ins.op == OP_REF) return evaluator.lookupReference(ins.arg);
+  return evaluator.lookupReference(*(const NamedReference *)ins.entity);
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include "Entity.h"
+
+#include <cbang/SmartPointer.h>
+
+#include <vector>
+
+
+namespace GCode {
+  /***
+   * An expression compiled to register bytecode, so it can be evaluated
+   * again without walking the AST.  Subroutine and loop bodies are
+   * evaluated many times.  Errors report the locations of the original
+   * AST, which is kept for that and for printing.
+   *
+   * Expressions which only read parameters at fixed addresses remember
+   * their inputs and last result, so evaluating them again with the same
+   * parameters skips the arithmetic.
+   */
+  class CompiledExpr : public Entity {
+  public:
+    static const unsigned maxRegisters = 32;
+
+    typedef enum {
+      OP_CONST, OP_REF, OP_REF_EXPR, OP_NAMED_REF, OP_INPUT, OP_NEG,
+      OP_EXP, OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB,
+      OP_EQ, OP_NE, OP_GT, OP_GE, OP_LT, OP_LE, OP_AND, OP_OR, OP_XOR,
+      OP_ABS, OP_ACOS, OP_ASIN, OP_COS, OP_EXP_FUNC, OP_FIX, OP_FUP,
+      OP_ROUND, OP_LN, OP_SIN, OP_SQRT, OP_TAN, OP_ATAN,
+    } opcode_t;
+
+    struct Instruction {
+      unsigned char op;
+      unsigned char dst;
+      unsigned char a;
+      unsigned char b;
+      unsigned arg; // Constant index, reference number or input index
+      const Entity *entity; // The source, for named references and errors
+    };
+
+  protected:
+    cb::SmartPointer<Entity> expr;
+    std::vector<Instruction> code;
+    std::vector<double> constants;
+
+    // Memoization
+    std::vector<Instruction> loads; ///< Read before OP_INPUT instructions
+    std::vector<double> inputs;
+    double result;
+    bool cached;
+
+    CompiledExpr(const cb::SmartPointer<Entity> &expr);
+
+  public:
+    /// @return @param expr compiled or @param expr itself, if it is null,
+    /// a Number, already compiled or has something the bytecode cannot
+    /// express.
+    static cb::SmartPointer<Entity>
+    compile(const cb::SmartPointer<Entity> &expr);
+
+    const cb::SmartPointer<Entity> &getExpression() const {return expr;}
+
+    // From Entity
+    double eval(Evaluator &evaluator);
+    void print(std::ostream &stream) const;
+
+  protected:
+    bool compile(Entity &entity, unsigned reg);
+    void emit(opcode_t op, unsigned dst, unsigned a, unsigned b,
+              unsigned arg, const Entity &entity);
+    void memoize();
+    double load(Evaluator &evaluator, const Instruction &ins) const;
+  };
+}
@@ -21,6 +21,8 @@
 #pragma once
 
 
+#include "EntityPool.h"
+
 #include <gcode/parse/Token.h>
 #include <gcode/interp/Evaluator.h>
 
@@ -39,6 +41,11 @@ namespace GCode {
     Entity(const Token &token) : location(token.getLocation()) {}
     virtual ~Entity() {}
 
+    static void *operator new(std::size_t size)
+    {return EntityPool::allocate(size);}
+    static void operator delete(void *ptr, std::size_t size)
+    {EntityPool::release(ptr, size);}
+
     cb::LocationRange &getLocation() {return location;}
     const cb::LocationRange &getLocation() const {return location;}
     const int getLine() const {return location.getStart().getLine();}
@@ -0,0 +1,164 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "EntityPool.h"
+
+#include <cbang/os/Mutex.h>
+#include <cbang/util/SmartLock.h>
+
+#include <new>
+#include <vector>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+namespace {
+  const unsigned granularity = 16;
+  const unsigned classes = 16;     // Larger nodes use the heap
+  const unsigned batchSize = 256;  // Nodes moved between threads at once
+  const unsigned maxBatches = 64;  // Shared per class, the rest are freed
+
+
+  struct Node {Node *next;};
+
+
+  unsigned getClass(size_t size) {
+    return size ? (size - 1) / granularity : 0;
+  }
+
+
+  void freeList(Node *node) {
+    while (node) {
+      Node *next = node->next;
+      ::operator delete(node);
+      node = next;
+    }
+  }
+
+
+  struct Shared : public Mutex {
+    vector<Node *> batches[classes];
+
+    void put(unsigned c, Node *batch) {
+      {
+        SmartLock lock(this);
+        if (batches[c].size() < maxBatches) {
+          batches[c].push_back(batch);
+          return;
+        }
+      }
+
+      freeList(batch);
+    }
+
+
+    Node *take(unsigned c) {
+      SmartLock lock(this);
+      if (batches[c].empty()) return 0;
+
+      Node *batch = batches[c].back();
+      batches[c].pop_back();
+      return batch;
+    }
+  };
+
+
+  Shared &getShared() {
+    static Shared *shared = new Shared; // Never destroyed
+    return *shared;
+  }
+
+
+  // Set once this thread's cache is destroyed.  Entities freed later by
+  // other thread_local destructors then go straight to the heap.
+  thread_local bool cacheDestroyed = false;
+
+
+  struct ThreadCache {
+    Node *heads[classes];
+    unsigned counts[classes];
+
+    ThreadCache() {
+      for (unsigned c = 0; c < classes; c++) {heads[c] = 0; counts[c] = 0;}
+    }
+
+
+    ~ThreadCache() {
+      cacheDestroyed = true;
+      for (unsigned c = 0; c < classes; c++) freeList(heads[c]);
+    }
+
+
+    void *allocate(unsigned c) {
+      if (!heads[c]) {
+        heads[c] = getShared().take(c);
+        counts[c] = heads[c] ? batchSize : 0;
+        if (!heads[c]) return ::operator new((c + 1) * granularity);
+      }
+
+      Node *node = heads[c];
+      heads[c] = node->next;
+      counts[c]--;
+
+      return node;
+    }
+
+
+    void release(unsigned c, void *ptr) {
+      Node *node = (Node *)ptr;
+      node->next = heads[c];
+      heads[c] = node;
+
+      // Keep one batch here and share the other
+      if (++counts[c] == 2 * batchSize) {
+        Node *batch = heads[c];
+        Node *last = batch;
+        for (unsigned i = 1; i < batchSize; i++) last = last->next;
+
+        heads[c] = last->next;
+        last->next = 0;
+        counts[c] = batchSize;
+
+        getShared().put(c, batch);
+      }
+    }
+  };
+
+
+  thread_local ThreadCache cache;
+}
+
+
+void *EntityPool::allocate(size_t size) {
+  unsigned c = getClass(size);
+  if (classes <= c || cacheDestroyed) return ::operator new(size);
+  return cache.allocate(c);
+}
+
+
+void EntityPool::release(void *ptr, size_t size) {
+  if (!ptr) return;
+
+  unsigned c = getClass(size);
+  if (classes <= c || cacheDestroyed) ::operator delete(ptr);
+  else cache.release(c, ptr);
+}
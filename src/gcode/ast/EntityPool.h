@@ -0,0 +1,42 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cstddef>
+
+
+namespace GCode {
+  /***
+   * Recycles the memory of AST nodes, which are small and mostly freed
+   * right after their block is interpreted.  Each thread keeps free lists
+   * by size, so the next block reuses the last one's nodes without locking.
+   * Blocks are often parsed on one thread and freed on another, so full
+   * lists pass batches of nodes through a shared list under a lock.  Nodes
+   * kept for subroutines are simply not returned until the program is
+   * freed.
+   */
+  class EntityPool {
+  public:
+    static void *allocate(std::size_t size);
+    static void release(void *ptr, std::size_t size);
+  };
+}
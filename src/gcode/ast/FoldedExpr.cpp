@@ -18,14 +18,17 @@
 
 \******************************************************************************/
 
-#include "PauseCommand.h"
+#include "FoldedExpr.h"
 
-#include <cbang/json/Sink.h>
-
-using namespace GCode;
+using namespace std;
 using namespace cb;
+using namespace GCode;
 
 
-void PauseCommand::insert(JSON::Sink &sink) {
-  sink.insertBoolean("optional", optional);
+FoldedExpr::FoldedExpr(const SmartPointer<Entity> &expr, double value) :
+  expr(expr), value(value) {
+  location = expr->getLocation();
 }
+
+
+void FoldedExpr::print(ostream &stream) const {stream << *expr;}
@@ -0,0 +1,48 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Entity.h"
+
+#include <cbang/SmartPointer.h>
+
+namespace GCode {
+  /***
+   * An expression of constants only, evaluated once when parsed.  The
+   * original is kept for printing.
+   */
+  class FoldedExpr : public Entity {
+    cb::SmartPointer<Entity> expr;
+    double value;
+
+  public:
+    FoldedExpr(const cb::SmartPointer<Entity> &expr, double value);
+
+    const cb::SmartPointer<Entity> &getExpression() const {return expr;}
+    double getValue() const {return value;}
+
+    // From Entity
+    bool isConstant() {return true;}
+    double eval(Evaluator &evaluator) {return value;}
+    void print(std::ostream &stream) const;
+  };
+}
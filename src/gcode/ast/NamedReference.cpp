@@ -20,11 +20,17 @@
 
 #include "NamedReference.h"
 
+#include <gcode/Names.h>
+
 using namespace std;
 using namespace cb;
 using namespace GCode;
 
 
+NamedReference::NamedReference(const string &name) :
+  name(name), slot(Names::intern(name)) {}
+
+
 void NamedReference::print(ostream &stream) const {
   stream << "#<" << name << '>';
 }
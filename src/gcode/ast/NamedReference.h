@@ -26,11 +26,15 @@
 namespace GCode {
   class NamedReference : public Entity {
     std::string name;
+    unsigned slot;
 
   public:
-    NamedReference(const std::string &name) : name(name) {}
+    NamedReference(const std::string &name);
 
     const std::string &getName() const {return name;}
+    /// @return the slot of the name, see Names.
+    unsigned getSlot() const {return slot;}
+    bool isGlobal() const {return !name.empty() && name[0] == '_';}
 
     // From Entity
     double eval(Evaluator &evaluator) {return evaluator.eval(*this);}
@@ -48,6 +48,8 @@ namespace GCode {
       number(0) {}
 
     cb::SmartPointer<Entity> getNumExpression() const {return numExpr;}
+    void setNumExpression(const cb::SmartPointer<Entity> &numExpr)
+    {this->numExpr = numExpr;}
     const std::string &getFilename() const {return filename;}
     const std::string &getKeyword() const {return keyword;}
     unsigned getNumber() const {return number;}
@@ -55,6 +57,8 @@ namespace GCode {
 
     void addExpression(const cb::SmartPointer<Entity> &expr)
     {expressions.push_back(expr);}
+    void setExpression(unsigned i, const cb::SmartPointer<Entity> &expr)
+    {expressions.at(i) = expr;}
 
     // From Entity
     double eval(Evaluator &evaluator);
@@ -34,6 +34,8 @@ namespace GCode {
     Reference(const cb::SmartPointer<Entity> &expr) : expr(expr), number(0) {}
 
     cb::SmartPointer<Entity> getExpression() const {return expr;}
+    void setExpression(const cb::SmartPointer<Entity> &expr)
+    {this->expr = expr;}
     double getNumber() const {return number;}
 
     double evalNumber(Evaluator &evaluator);  // Used by Assign
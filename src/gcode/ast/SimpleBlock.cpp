@@ -0,0 +1,72 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "SimpleBlock.h"
+#include "Block.h"
+#include "Word.h"
+#include "Number.h"
+
+#include <cbang/String.h>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+bool SimpleBlock::add(char type, double value, int col) {
+  if (count == maxWords) return false;
+
+  Word &word = words[count++];
+  word.type = type;
+  word.value = value;
+  word.col = col;
+
+  return true;
+}
+
+
+SmartPointer<Block> SimpleBlock::toBlock() const {
+  vector<SmartPointer<Entity> > children;
+  const FileLocation &start = location.getStart();
+
+  for (unsigned i = 0; i < count; i++) {
+    SmartPointer<GCode::Word> word =
+      new GCode::Word(words[i].type, new Number(words[i].value));
+    word->getLocation() =
+      LocationRange(FileLocation(start.getFilename(), start.getLine(),
+                                 words[i].col));
+    children.push_back(word);
+  }
+
+  SmartPointer<Block> block = new Block(deleted, line, children);
+  block->getLocation() = location;
+
+  return block;
+}
+
+
+void SimpleBlock::print(ostream &stream) const {
+  if (deleted) stream << '/';
+  if (line != -1) stream << 'N' << line;
+
+  for (unsigned i = 0; i < count; i++) {
+    if (i) stream << ' ';
+    stream << words[i].type << String(words[i].value);
+  }
+}
@@ -0,0 +1,84 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include <cbang/SmartPointer.h>
+#include <cbang/LocationRange.h>
+
+#include <ostream>
+
+
+namespace GCode {
+  class Block;
+
+  /***
+   * A block of words with constant values only, which is most GCode.
+   * The words are held inline so one instance can be reused for each
+   * block without allocating, unlike a Block and its AST.
+   */
+  class SimpleBlock {
+  public:
+    struct Word {
+      char type;
+      double value;
+      int col;
+    };
+
+    static const unsigned maxWords = 32;
+
+  protected:
+    bool deleted;
+    int line;
+    unsigned count;
+    Word words[maxWords];
+    cb::LocationRange location;
+
+  public:
+    SimpleBlock() : deleted(false), line(-1), count(0) {}
+
+    void clear() {deleted = false; line = -1; count = 0;}
+
+    void setDeleted(bool deleted) {this->deleted = deleted;}
+    bool isDeleted() const {return deleted;}
+    void setUserLine(int line) {this->line = line;}
+    int getUserLine() const {return line;}
+
+    unsigned size() const {return count;}
+    const Word &operator[](unsigned i) const {return words[i];}
+    /// @return false if the block is full.
+    bool add(char type, double value, int col);
+
+    cb::LocationRange &getLocation() {return location;}
+    const cb::LocationRange &getLocation() const {return location;}
+
+    /// Build the equivalent AST, for Processors which keep blocks.
+    cb::SmartPointer<Block> toBlock() const;
+
+    void print(std::ostream &stream) const;
+  };
+
+
+  inline static
+  std::ostream &operator<<(std::ostream &stream, const SimpleBlock &block) {
+    block.print(stream);
+    return stream;
+  }
+}
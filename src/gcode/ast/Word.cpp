@@ -37,8 +37,14 @@ Word::Word(const Code *code) :
 
 
 double Word::eval(Evaluator &evaluator) {
-  value = expr->eval(evaluator);
-  code = Codes::find(type, value);
+  double value = expr->eval(evaluator);
+
+  // Only look up the code again if the value changed
+  if (!code || value != this->value) {
+    this->value = value;
+    code = Codes::find(type, value);
+  }
+
   return value;
 }
 
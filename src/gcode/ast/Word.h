@@ -41,7 +41,7 @@ namespace GCode {
     Word(char type, const cb::SmartPointer<Entity> &expr) :
       type(std::toupper(type)), expr(expr), value(0), code(0) {}
 
-    void setType(char type) {this->type = type;}
+    void setType(char type) {this->type = type; code = 0;}
     char getType() const {return type;}
 
     void setExpression(const cb::SmartPointer<Entity> &expr)
@@ -0,0 +1,62 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include "OCodeInterpreter.h"
+
+#include <gcode/Controller.h>
+#include <gcode/machine/Machine.h>
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <vector>
+
+
+namespace GCode {
+  class ToolPath;
+
+  /// A program's tool path and the state it was made in every so many lines
+  class Checkpoints {
+  public:
+    struct State {
+      Controller controller;
+      Machine::Snapshot machine;
+      OCodeInterpreter::Snapshot interp;
+
+      State(const Controller &controller) : controller(controller) {}
+    };
+
+    struct Checkpoint {
+      int64_t line;   ///< The next line to interpret
+      unsigned moves; ///< Moves in the tool path before it
+      double time;    ///< Tool path time before it
+      cb::SmartPointer<State> state;
+    };
+
+    /// Runs may only resume from others with the same key
+    std::string key;
+    cb::SmartPointer<std::vector<char> > gcode;
+    cb::SmartPointer<ToolPath> path;
+    std::vector<Checkpoint> points; ///< In line order
+  };
+}
@@ -40,12 +40,12 @@ using namespace GCode;
 
 
 double Evaluator::lookupReference(unsigned num) {
-  THROW("Named reference not supported");
+  THROW("Numerical reference not supported");
 }
 
 
-double Evaluator::lookupReference(const string &name) {
-  THROW("Numerical reference not supported");
+double Evaluator::lookupReference(const NamedReference &ref) {
+  THROW("Named reference not supported");
 }
 
 
@@ -124,7 +124,7 @@ double Evaluator::eval(FunctionCall &e) {
 
 
 double Evaluator::eval(NamedReference &e) {
-  return lookupReference(e.getName());
+  return lookupReference(e);
 }
 
 
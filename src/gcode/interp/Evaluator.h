@@ -39,7 +39,7 @@ namespace GCode {
   class Evaluator {
   public:
     virtual double lookupReference(unsigned num);
-    virtual double lookupReference(const std::string &name);
+    virtual double lookupReference(const NamedReference &ref);
     virtual double eval(UnaryOp &e);
     virtual double eval(BinaryOp &e);
     virtual double eval(QuotedExpr &e);
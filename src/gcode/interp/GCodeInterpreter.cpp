@@ -49,110 +49,88 @@ void GCodeInterpreter::setReference(unsigned num, double value) {
 }
 
 
-void GCodeInterpreter::setReference(const std::string &name, double value) {
-  LOG_DEBUG(3, "Set global variable #<" << name << "> = " << value);
-  controller.set(name, value);
+void GCodeInterpreter::setReference(const NamedReference &ref, double value) {
+  LOG_DEBUG(3, "Set global variable #<" << ref.getName() << "> = " << value);
+  controller.setNamed(ref.getSlot(), value);
 }
 
 
-void GCodeInterpreter::operator()(const SmartPointer<Block> &block) {
-  if (block->isDeleted()) return;
-
-  LOG_DEBUG(5, "Block: " << *block);
-
-  Word *word;
-  Assign *assign;
-  int vars = 0;
-  int groups = 0;
-  unsigned lowestPriority = ~0;
-  bool implicitMotion = true;
-  vector<Word *> words;
+void GCodeInterpreter::beginBlock() {
+  words.clear();
+  vars = 0;
+  groups = 0;
+  lowestPriority = ~0;
+  implicitMotion = true;
 
   controller.newBlock();
+}
 
-  // Evaluate all expressions and set variables
-  for (Block::iterator it = block->begin(); it != block->end(); it++) {
-    (*it)->eval(*this);
-
-    if ((assign = (*it)->instance<Assign>())) {
-      Reference *ref;
-      NamedReference *nameRef;
 
-      if ((ref = assign->getReference()->instance<Reference>()))
-        setReference(ref->getNumber(), assign->getExprValue());
+bool GCodeInterpreter::addWord(const BlockWord &word) {
+  char c = word.type;
+  const Code *code = word.code;
+  bool isVar = false;
+
+  switch (c) {
+  case 'F': if (3 < lowestPriority) lowestPriority = 3; break;
+  case 'S': if (4 < lowestPriority) lowestPriority = 4; break;
+  case 'T': if (5 < lowestPriority) lowestPriority = 5; break;
+
+  case 'G': case 'M':
+    // Find word with lowest priority
+    if (!code)
+      LOG_WARNING(word.col << ':' << word << ": Invalid or unsupported code");
+
+    else {
+      // Check modal groups
+      if (groups & code->group) {
+        LOG_WARNING(word.col
+                    << ":Cannot have more than one word from modal group "
+                    << ModalGroup(code->group) << ", Ignoring " << *code);
+        return false;
+      }
 
-      else if ((nameRef = assign->getReference()->instance<NamedReference>()))
-        setReference(nameRef->getName(), assign->getExprValue());
+      groups |= code->group;
 
-      else THROW("Invalid reference type in Assign");
+      // Implicit motion
+      if (code->group == MG_MOTION || code->group == MG_ZERO)
+        implicitMotion = false;
 
-    } else if ((word = (*it)->instance<Word>())) {
-      double value = word->getValue(); // Must be after eval
-      char c = word->getType();
-      const Code *code;
-
-      switch (c) {
-      case 'F': if (3 < lowestPriority) lowestPriority = 3; break;
-      case 'S': if (4 < lowestPriority) lowestPriority = 4; break;
-      case 'T': if (5 < lowestPriority) lowestPriority = 5; break;
-
-      case 'G': case 'M':
-        // Find word with lowest priority
-        if (!(code = word->getCode())) // Must be after eval
-          LOG_WARNING(word->getCol() << ':' << *word
-                      << ": Invalid or unsupported code");
-
-        else {
-          // Check modal groups
-          if (groups & code->group) {
-            LOG_WARNING(word->getCol()
-                        << ":Cannot have more than one word from modal group "
-                        << ModalGroup(code->group) << ", Ignoring " << *code);
-            continue;
-          }
-
-          groups |= code->group;
-
-          // Implicit motion
-          if (code->group == MG_MOTION || code->group == MG_ZERO)
-            implicitMotion = false;
-
-          // Find lowest priority word
-          if (code->priority < lowestPriority) lowestPriority = code->priority;
-        }
-        break;
+      // Find lowest priority word
+      if (code->priority < lowestPriority) lowestPriority = code->priority;
+    }
+    break;
 
-      case 'O': THROW("Unexpected O-code"); break;
+  case 'O': THROW("Unexpected O-code"); break;
 
-      case 'N':
-      default:
-        if (c == 'N' || !isalpha(c))
-          LOG_WARNING(word->getCol() << ':' << *word
-                      << ": Invalid or unsupported code");
+  case 'N':
+  default:
+    if (c == 'N' || !isalpha(c))
+      LOG_WARNING(word.col << ':' << word << ": Invalid or unsupported code");
 
-        else {
-          int flag = 1 << (c - 'A');
-          if (vars & flag)
-            LOG_WARNING(word->getCol() << ":Word '" << c
-                        << "' repeated in block, only the last value will be "
-                        "recognized");
+    else {
+      int flag = 1 << (c - 'A');
+      if (vars & flag)
+        LOG_WARNING(word.col << ":Word '" << c
+                    << "' repeated in block, only the last value will be "
+                    "recognized");
 
-          vars |= flag; // Flag variable
+      vars |= flag; // Flag variable
 
-          // Set variable
-          controller.setVar(c, value);
-          controller.setVarExpr(c, word->getExpression());
-        }
-      }
+      // Set variable
+      controller.setVar(c, word.value);
+      isVar = true;
+    }
+  }
 
-      words.push_back(word);
+  words.push_back(word);
 
-    } else if ((*it)->instance<Comment>()) { // Ignore
+  return isVar;
+}
 
-    } else LOG_WARNING((*it)->getCol()
-                       << ":Unsupported or unexpected entity: " << **it);
-  }
 
+void GCodeInterpreter::executeWords(const LocationRange &location,
+                                    Block *block) {
   // Process command words in order of priority
   while (true) {
     unsigned priority = lowestPriority;
@@ -160,43 +138,51 @@ void GCodeInterpreter::operator()(const SmartPointer<Block> &block) {
     // Implicit motion
     if (implicitMotion && (vars & VT_AXIS) &&
         controller.getActiveMotion()->priority < priority) {
-      Word *implicitWord = new Word(controller.getActiveMotion());
-      implicitWord->getLocation() = block->getLocation();
+      const Code *motion = controller.getActiveMotion();
+      BlockWord implicitWord =
+        {motion->type, motion->number, motion, -1, 0};
+
+      if (block) {
+        implicitWord.word = new Word(motion);
+        implicitWord.word->getLocation() = location;
+        block->push_back(implicitWord.word);
+      }
+
       words.push_back(implicitWord);
-      block->push_back(implicitWord);
       implicitMotion = false;
-      priority = controller.getActiveMotion()->priority;
+      priority = motion->priority;
 
     } else if (lowestPriority == (unsigned)~0) break;
 
     lowestPriority = ~0;
 
     for (unsigned i = 0; i < words.size(); i++) {
-      word = words[i];
+      const BlockWord &word = words[i];
       unsigned wordPriority = ~0;
 
-      switch (word->getType()) {
+      switch (word.type) {
       case 'F':
         wordPriority = 3;
-        if (priority == 3) controller.setFeed(word->getValue());
+        if (priority == 3) controller.setFeed(word.value);
         break;
 
       case 'S':
         wordPriority = 4;
-        if (priority == 4) controller.setSpeed(word->getValue());
+        if (priority == 4) controller.setSpeed(word.value);
         break;
 
       case 'T':
         wordPriority = 5;
-        if (priority == 5) controller.setTool(word->getValue());
+        if (priority == 5) controller.setTool(word.value);
         break;
 
       case 'G': case 'M': {
-        const Code *code = word->getCode();
+        const Code *code = word.code;
         if (!code) continue; // Invalid or unsupported
 
         if (priority == code->priority) {
-          controller.setLocation(word->getLocation());
+          controller.setLocation(word.word ? word.word->getLocation() :
+                                 location);
           controller.execute(*code, vars);
           if (code->group == MG_MOTION) controller.setActiveMotion(code);
         }
@@ -215,11 +201,88 @@ void GCodeInterpreter::operator()(const SmartPointer<Block> &block) {
 }
 
 
+void GCodeInterpreter::operator()(const SmartPointer<Block> &block) {
+  if (block->isDeleted()) return;
+
+  LOG_DEBUG(5, "Block: " << *block);
+
+  Word *word;
+  Assign *assign;
+
+  beginBlock();
+
+  // Evaluate all expressions and set variables
+  for (Block::iterator it = block->begin(); it != block->end(); it++) {
+    (*it)->eval(*this);
+
+    if ((assign = (*it)->instance<Assign>())) {
+      Reference *ref;
+      NamedReference *nameRef;
+
+      if ((ref = assign->getReference()->instance<Reference>()))
+        setReference(ref->getNumber(), assign->getExprValue());
+
+      else if ((nameRef = assign->getReference()->instance<NamedReference>()))
+        setReference(*nameRef, assign->getExprValue());
+
+      else THROW("Invalid reference type in Assign");
+
+    } else if ((word = (*it)->instance<Word>())) {
+      // Must be after eval
+      BlockWord blockWord = {word->getType(), word->getValue(),
+                             word->getCode(), word->getCol(), word};
+
+      if (addWord(blockWord))
+        controller.setVarExpr(word->getType(), word->getExpression());
+
+    } else if ((*it)->instance<Comment>()) { // Ignore
+
+    } else LOG_WARNING((*it)->getCol()
+                       << ":Unsupported or unexpected entity: " << **it);
+  }
+
+  executeWords(block->getLocation(), block.get());
+}
+
+
+void GCodeInterpreter::operator()(const SimpleBlock &block) {
+  if (block.isDeleted()) return;
+
+  LOG_DEBUG(5, "Block: " << block);
+
+  beginBlock();
+
+  for (unsigned i = 0; i < block.size(); i++) {
+    const SimpleBlock::Word &word = block[i];
+    const Code *code = 0;
+
+    if (word.type == 'G' || word.type == 'M')
+      code = Codes::find(word.type, word.value);
+
+    BlockWord blockWord = {word.type, word.value, code, word.col, 0};
+
+    // There is no expression to keep
+    if (addWord(blockWord)) controller.setVarExpr(word.type, 0);
+  }
+
+  executeWords(block.getLocation(), 0);
+}
+
+
 double GCodeInterpreter::lookupReference(unsigned num) {
   return controller.get(num);
 }
 
 
-double GCodeInterpreter::lookupReference(const string &name) {
-  return controller.get(name);
+double GCodeInterpreter::lookupReference(const NamedReference &ref) {
+  return controller.getNamed(ref.getSlot());
+}
+
+
+namespace GCode {
+  ostream &operator<<(ostream &stream,
+                      const GCodeInterpreter::BlockWord &word) {
+    if (word.word) return stream << *word.word;
+    return stream << word.type << String(word.value);
+  }
 }
@@ -29,6 +29,8 @@
 
 #include <gcode/Controller.h>
 
+#include <vector>
+
 namespace GCode {
   class Code;
   class Word;
@@ -37,19 +39,50 @@ namespace GCode {
     public Processor, public Evaluator, public VarTypes, public ModalGroup {
     Controller &controller;
 
+  public:
+    /// A word of the block being interpreted, after evaluation
+    struct BlockWord {
+      char type;
+      double value;
+      const Code *code;
+      int col;
+      Word *word; // Null for SimpleBlocks
+    };
+
+  protected:
+    // The block being interpreted
+    std::vector<BlockWord> words;
+    int vars;
+    int groups;
+    unsigned lowestPriority;
+    bool implicitMotion;
+
+    void beginBlock();
+    /// @return true if @param word set a variable.
+    bool addWord(const BlockWord &word);
+    /// Execute the words added since beginBlock().  An implicit motion
+    /// word is also appended to @param block, if not null.
+    virtual void executeWords(const cb::LocationRange &location, Block *block);
+
   public:
     GCodeInterpreter(Controller &controller);
 
     Controller &getController() {return controller;}
 
     virtual void setReference(unsigned num, double value);
-    virtual void setReference(const std::string &name, double value);
+    virtual void setReference(const NamedReference &ref, double value);
 
     // From Processor
     void operator()(const cb::SmartPointer<Block> &block);
+    bool wantsSimpleBlocks() const {return true;}
+    void operator()(const SimpleBlock &block);
 
     // From Evaluator
     double lookupReference(unsigned num);
-    double lookupReference(const std::string &name);
+    double lookupReference(const NamedReference &ref);
   };
+
+
+  std::ostream &operator<<(std::ostream &stream,
+                           const GCodeInterpreter::BlockWord &word);
 }
@@ -0,0 +1,256 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "IncrementalInterpreter.h"
+
+#include <gcode/ToolPath.h>
+#include <gcode/ast/Program.h>
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+namespace {
+  // Checkpoints are at least this many lines apart and there are at most
+  // about maxCheckpoints of them
+  const int64_t minInterval = 1024;
+  const int64_t maxCheckpoints = 256;
+
+
+  int64_t countLines(const vector<char> &data, uint64_t length) {
+    return count(data.begin(), data.begin() + length, '\n');
+  }
+
+
+  uint64_t findLine(const vector<char> &data, int64_t line) {
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    const char *ptr = begin;
+
+    for (int64_t i = 0; i < line; i++) {
+      ptr = (const char *)memchr(ptr, '\n', end - ptr);
+      if (!ptr) return data.size();
+      ptr++;
+    }
+
+    return ptr - begin;
+  }
+}
+
+
+IncrementalInterpreter::
+IncrementalInterpreter(Controller &controller, Machine &machine,
+                       const SmartPointer<ToolPath> &path,
+                       const SmartPointer<vector<char> > &gcode,
+                       const string &key,
+                       const SmartPointer<Checkpoints> &last,
+                       const SmartPointer<Interrupter> &interrupter) :
+  Interpreter(controller, interrupter), machine(machine), path(path),
+  last(last), run(new Checkpoints), depth(0),
+  suffixLine(numeric_limits<int64_t>::max()), lineDelta(0), nextLast(0),
+  converged(false) {
+
+  run->key = key;
+  run->gcode = gcode;
+  run->path = path;
+
+  interval =
+    max(minInterval, countLines(*gcode, gcode->size()) / maxCheckpoints);
+  nextCheckpoint = interval;
+
+  if (!last.isNull() && (last->key != key || last->gcode.isNull() ||
+                         last->path.isNull()))
+    this->last.release();
+}
+
+
+uint64_t IncrementalInterpreter::resume(int64_t &line) {
+  line = 0;
+  if (last.isNull()) return 0;
+
+  const vector<char> &before = *last->gcode;
+  const vector<char> &after = *run->gcode;
+
+  // Find the unchanged start and end
+  uint64_t length = min(before.size(), after.size());
+  uint64_t prefix =
+    mismatch(before.begin(), before.begin() + length, after.begin()).first -
+    before.begin();
+
+  uint64_t suffix = 0;
+  while (suffix < length - prefix &&
+         before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix])
+    suffix++;
+
+  int64_t changed = countLines(after, prefix);
+  lineDelta = countLines(after, after.size()) -
+    countLines(before, before.size());
+
+  // Lines which start after a newline in the unchanged end
+  uint64_t suffixStart = after.size() - suffix;
+  if (find(after.begin() + suffixStart, after.end(), '\n') != after.end())
+    suffixLine = countLines(after, suffixStart) + 1;
+
+  // Checkpoints before the first changed line are still valid
+  const vector<Checkpoints::Checkpoint> &points = last->points;
+  unsigned i = 0;
+  while (i < points.size() && points[i].line <= changed) i++;
+  nextLast = i;
+
+  if (!i) return 0;
+
+  const Checkpoints::Checkpoint &point = points[i - 1];
+  Machine::Snapshot snapshot = point.state->machine;
+  snapshot.time = point.time;
+
+  getController().restore(point.state->controller);
+  machine.restore(snapshot);
+  OCodeInterpreter::restore(point.state->interp);
+
+  for (unsigned j = 0; j < point.moves; j++) {
+    Move move = last->path->at(j);
+    path->move(move);
+  }
+
+  run->points.assign(points.begin(), points.begin() + i);
+
+  line = point.line;
+  nextCheckpoint = line + interval;
+
+  return findLine(after, line);
+}
+
+
+void IncrementalInterpreter::operator()(const SmartPointer<Block> &block) {
+  depth++;
+
+  try {
+    Interpreter::operator()(block);
+  } catch (...) {
+    depth--;
+    throw;
+  }
+
+  if (!--depth) endBlock(block->getLocation().getStart().getLine());
+}
+
+
+void IncrementalInterpreter::operator()(const SimpleBlock &block) {
+  depth++;
+
+  try {
+    Interpreter::operator()(block);
+  } catch (...) {
+    depth--;
+    throw;
+  }
+
+  if (!--depth) endBlock(block.getLocation().getStart().getLine());
+}
+
+
+void IncrementalInterpreter::endBlock(int64_t line) {
+  int64_t next = line + 1;
+
+  if (!last.isNull() && suffixLine <= next && converge(next)) {
+    converged = true;
+    throw EndProgram(); // The rest of the last run was reused
+  }
+
+  if (next < nextCheckpoint) return;
+
+  SmartPointer<Checkpoints::State> state = snapshot();
+  if (state.isNull()) return;
+
+  addCheckpoint(next, state);
+  nextCheckpoint = next + interval;
+}
+
+
+SmartPointer<Checkpoints::State> IncrementalInterpreter::snapshot() {
+  OCodeInterpreter::Snapshot interp;
+  if (!save(interp)) return 0;
+
+  SmartPointer<Checkpoints::State> state =
+    new Checkpoints::State(getController());
+  state->interp = interp;
+  machine.save(state->machine);
+
+  return state;
+}
+
+
+void IncrementalInterpreter::addCheckpoint
+(int64_t line, const SmartPointer<Checkpoints::State> &state) {
+  Checkpoints::Checkpoint point =
+    {line, (unsigned)path->size(), state->machine.time, state};
+  run->points.push_back(point);
+}
+
+
+bool IncrementalInterpreter::converge(int64_t line) {
+  const vector<Checkpoints::Checkpoint> &points = last->points;
+  int64_t lastLine = line - lineDelta;
+
+  while (nextLast < points.size() && points[nextLast].line < lastLine)
+    nextLast++;
+
+  if (nextLast == points.size() || points[nextLast].line != lastLine)
+    return false;
+
+  const Checkpoints::Checkpoint &point = points[nextLast];
+  SmartPointer<Checkpoints::State> state = snapshot();
+
+  if (state.isNull() ||
+      !getController().sameState(point.state->controller) ||
+      !state->machine.sameState(point.state->machine) ||
+      !state->interp.sameState(point.state->interp)) return false;
+
+  // Reuse the rest of the last run's moves
+  double timeDelta = state->machine.time - point.time;
+  unsigned moves = path->size();
+  const ToolPath &lastPath = *last->path;
+
+  // Moves from subroutines defined before the change keep their lines
+  int64_t lastSuffixLine = suffixLine - lineDelta;
+
+  for (unsigned i = point.moves; i < lastPath.size(); i++) {
+    Move move = lastPath.at(i);
+    if (lastSuffixLine <= move.getLine())
+      move.setLine(move.getLine() + lineDelta);
+    move.setStartTime(move.getStartTime() + timeDelta);
+    path->move(move);
+  }
+
+  // And its checkpoints
+  for (unsigned i = nextLast; i < points.size(); i++) {
+    Checkpoints::Checkpoint p = points[i];
+    p.line += lineDelta;
+    p.moves = p.moves - point.moves + moves;
+    p.time += timeDelta;
+    run->points.push_back(p);
+  }
+
+  return true;
+}
@@ -0,0 +1,96 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include "Interpreter.h"
+#include "Checkpoints.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <vector>
+#include <string>
+
+
+namespace GCode {
+  class Machine;
+  class ToolPath;
+
+  /***
+   * Checkpoints the interpreter, controller and machine every so many lines
+   * of a program.  When it is run again after an edit, interpretation
+   * resumes from the last checkpoint before the first changed line.  It
+   * stops once, in the unchanged lines after the edit, the state is the
+   * same as at one of the last run's checkpoints.  The moves the last run
+   * made after that are then reused.
+   */
+  class IncrementalInterpreter : public Interpreter {
+    Machine &machine;
+    cb::SmartPointer<ToolPath> path;
+    cb::SmartPointer<Checkpoints> last;
+    cb::SmartPointer<Checkpoints> run;
+
+    int64_t interval; ///< Lines between checkpoints
+    int64_t nextCheckpoint;
+    unsigned depth;
+
+    // Lines with unchanged content from this one to the end map to the last
+    // run's by subtracting lineDelta
+    int64_t suffixLine;
+    int64_t lineDelta;
+    unsigned nextLast; ///< The next of the last run's checkpoints to test
+    bool converged;
+
+  public:
+    /// @param last is the run to resume from, if not null.
+    IncrementalInterpreter(Controller &controller, Machine &machine,
+                           const cb::SmartPointer<ToolPath> &path,
+                           const cb::SmartPointer<std::vector<char> > &gcode,
+                           const std::string &key,
+                           const cb::SmartPointer<Checkpoints> &last,
+                           const cb::SmartPointer<Interrupter> &interrupter =
+                           new NullInterrupter);
+
+    /// Restore the state and moves of the last run up to the last
+    /// checkpoint before the first change.
+    /// @return the offset in the GCode to read from, which is at @param line.
+    uint64_t resume(int64_t &line);
+
+    /// @return true if the end of the last run was reused.
+    bool hasConverged() const {return converged;}
+    /// @return this run to resume the next from.
+    const cb::SmartPointer<Checkpoints> &getCheckpoints() const {return run;}
+
+    // From Processor
+    void operator()(const cb::SmartPointer<Block> &block);
+    void operator()(const SimpleBlock &block);
+
+  protected:
+    /// Called after each top level block at @param line.
+    void endBlock(int64_t line);
+    /// @return the current state or null if inside a subroutine, loop or
+    /// condition.
+    cb::SmartPointer<Checkpoints::State> snapshot();
+    void addCheckpoint(int64_t line, const cb::SmartPointer<Checkpoints::State>
+                       &state);
+    bool converge(int64_t line);
+  };
+}
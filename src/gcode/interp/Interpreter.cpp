@@ -20,6 +20,9 @@
 
 #include "Interpreter.h"
 
+#include <gcode/parse/ParseThread.h>
+#include <gcode/parse/ChunkParser.h>
+
 #include <cbang/SStream.h>
 #include <cbang/util/SmartDepth.h>
 #include <cbang/log/SmartLogThreadPrefix.h>
@@ -33,6 +36,39 @@ bool Interpreter::readBlock(GCode::Tokenizer &tokenizer) {
 }
 
 
+void Interpreter::read(GCode::Tokenizer &tokenizer, unsigned maxErrors) {
+  try {
+    parser.parse(tokenizer, *this, maxErrors);
+  } catch (const EndProgram &) {}
+
+  errors += parser.getErrorCount();
+}
+
+
+void Interpreter::readPipelined(GCode::Tokenizer &tokenizer,
+                                const SmartPointer<Interrupter> &interrupter,
+                                unsigned maxErrors) {
+  ParseThread thread(tokenizer, interrupter, maxErrors);
+  thread.start();
+
+  try {
+    thread.process(*this);
+  } catch (const EndProgram &) {}
+
+  thread.join();
+  errors += thread.getErrorCount();
+}
+
+
+void Interpreter::read(ChunkParser &chunks) {
+  try {
+    chunks.process(*this, getInterrupter());
+  } catch (const EndProgram &) {}
+
+  errors += chunks.getErrorCount();
+}
+
+
 void Interpreter::read(const InputSource &source, unsigned maxErrors) {
   try {
     parser.parse(source, *this, maxErrors);
@@ -54,3 +90,14 @@ void Interpreter::operator()(const SmartPointer<Block> &block) {
 
   OCodeInterpreter::operator()(block);
 }
+
+
+void Interpreter::operator()(const SimpleBlock &block) {
+  if (block.isDeleted()) return;
+
+  FileLocation location = block.getLocation().getStart();
+  location.setCol(-1);
+  SmartLogThreadPrefix prefix(SSTR(location << ":"));
+
+  OCodeInterpreter::operator()(block);
+}
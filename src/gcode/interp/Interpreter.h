@@ -31,6 +31,7 @@
 
 namespace GCode {
   class Tokenizer;
+  class ChunkParser;
 
   class Interpreter : public OCodeInterpreter, public cb::Reader {
     Parser parser;
@@ -48,6 +49,14 @@ namespace GCode {
     unsigned getErrorCount() const {return errors;}
 
     bool readBlock(GCode::Tokenizer &tokenizer);
+    void read(GCode::Tokenizer &tokenizer, unsigned maxErrors = 32);
+    /// Parse @param tokenizer in another thread while interpreting.
+    /// @param interrupter is called from the parse thread.
+    void readPipelined(GCode::Tokenizer &tokenizer,
+                       const cb::SmartPointer<Interrupter> &interrupter,
+                       unsigned maxErrors = 32);
+    /// Interpret @param chunks as they are parsed in parallel.
+    void read(ChunkParser &chunks);
     void read(const cb::InputSource &source, unsigned maxErrors);
 
     // From cb::Reader
@@ -55,5 +64,6 @@ namespace GCode {
 
     // From Processor
     void operator()(const cb::SmartPointer<Block> &block);
+    void operator()(const SimpleBlock &block);
   };
 }
@@ -22,6 +22,10 @@
 
 #include <gcode/ast/Program.h>
 #include <gcode/ast/OCode.h>
+#include <gcode/ast/Word.h>
+#include <gcode/ast/Assign.h>
+#include <gcode/ast/NamedReference.h>
+#include <gcode/ast/CompiledExpr.h>
 
 #include <gcode/parse/Parser.h>
 
@@ -38,18 +42,73 @@ namespace {
   struct BreakException {unsigned n; BreakException(unsigned n) : n(n) {}};
   struct ContinueException
   {unsigned n; ContinueException(unsigned n) : n(n) {}};
+
+  const unsigned maxCallRecords = 1024;
+  const unsigned maxRecordedBlocks = 1 << 16;
+}
+
+
+struct OCodeInterpreter::CallRecord {
+  struct RecordedBlock {
+    LocationRange location;
+    vector<BlockWord> words;
+  };
+
+  SmartPointer<Program> program; // Keeps the recorded words alive
+  bool pure;
+  vector<RecordedBlock> blocks;
+
+  CallRecord(const SmartPointer<Program> &program) :
+    program(program), pure(true) {}
+};
+
+
+bool OCodeInterpreter::CallKey::operator<(const CallKey &o) const {
+  if (program != o.program) return program < o.program;
+  if (motion != o.motion) return motion < o.motion;
+  return values < o.values;
 }
 
 
 OCodeInterpreter::
 OCodeInterpreter(Controller &controller,
                  const cb::SmartPointer<Interrupter> &interrupter) :
-  GCodeInterpreter(controller), interrupter(interrupter), condition(true) {}
+  GCodeInterpreter(controller), interrupter(interrupter), condition(true),
+  memoize(true), compileExpressions(true) {}
 
 
 OCodeInterpreter::~OCodeInterpreter() {} // Hide member destructors
 
 
+OCodeInterpreter::Snapshot::Snapshot() {}
+OCodeInterpreter::Snapshot::~Snapshot() {}
+
+
+bool OCodeInterpreter::Snapshot::sameState(const Snapshot &o) const {
+  return subroutines == o.subroutines &&
+    namedSubroutines == o.namedSubroutines && loadedFiles == o.loadedFiles;
+}
+
+
+bool OCodeInterpreter::save(Snapshot &snapshot) const {
+  if (!subroutine.isNull() || !loop.isNull() || !stack.empty() ||
+      !conditions.empty()) return false;
+
+  snapshot.subroutines = subroutines;
+  snapshot.namedSubroutines = namedSubroutines;
+  snapshot.loadedFiles = loadedFiles;
+
+  return true;
+}
+
+
+void OCodeInterpreter::restore(const Snapshot &snapshot) {
+  subroutines = snapshot.subroutines;
+  namedSubroutines = snapshot.namedSubroutines;
+  loadedFiles = snapshot.loadedFiles;
+}
+
+
 void OCodeInterpreter::checkExpressions(OCode *ocode, const char *name,
                                         unsigned count) {
   const OCode::expressions_t &expressions = ocode->getExpressions();
@@ -63,21 +122,61 @@ void OCodeInterpreter::checkExpressions(OCode *ocode, const char *name,
 }
 
 
+void OCodeInterpreter::compile(Program &program) {
+  if (!compileExpressions) return;
+
+  for (Program::iterator it = program.begin(); it != program.end(); it++)
+    for (Block::iterator it2 = (*it)->begin(); it2 != (*it)->end(); it2++) {
+      Word *word;
+      Assign *assign;
+      OCode *ocode;
+
+      if ((word = (*it2)->instance<Word>()))
+        word->setExpression(CompiledExpr::compile(word->getExpression()));
+
+      else if ((assign = (*it2)->instance<Assign>())) {
+        assign->setExpression(CompiledExpr::compile(assign->getExpression()));
+
+        Reference *ref = assign->getReference()->instance<Reference>();
+        if (ref)
+          ref->setExpression(CompiledExpr::compile(ref->getExpression()));
+
+      } else if ((ocode = (*it2)->instance<OCode>())) {
+        ocode->setNumExpression
+          (CompiledExpr::compile(ocode->getNumExpression()));
+
+        const OCode::expressions_t &expressions = ocode->getExpressions();
+        for (unsigned i = 0; i < expressions.size(); i++)
+          ocode->setExpression(i, CompiledExpr::compile(expressions[i]));
+      }
+    }
+}
+
+
 void OCodeInterpreter::upScope() {
   stack.pop_back();
-  nameStack.pop_back();
+
+  // Restore hidden named locals
+  while (savedMarks.back() < savedLocals.size()) {
+    const SavedLocal &saved = savedLocals.back();
+    namedLocals[saved.slot] = saved.local;
+    savedLocals.pop_back();
+  }
+
+  savedMarks.pop_back();
 }
 
 
 void OCodeInterpreter::downScope() {
   stack.push_back(vector<double>(30));
-  nameStack.push_back(name_map_t());
+  savedMarks.push_back(savedLocals.size());
   if (stack.size() == 11) LOG_WARNING("exceeded recursion depth 10");
 }
 
 
 void OCodeInterpreter::doSub(OCode *ocode) {
   checkExpressions(ocode, "sub", 0);
+  markImpure();
 
   if (!subroutine.isNull()) THROWS("Nested subroutines not allowed");
   subroutine = new Program;
@@ -113,11 +212,82 @@ void OCodeInterpreter::doEndSub(OCode *ocode) {
   } else if (subroutineName != ocode->getFilename())
     LOG_WARNING("endsub name does not match");
 
+  if (!subroutine.isNull()) compile(*subroutine);
   subroutine = 0;
   subroutineName = "";
 }
 
 
+SmartPointer<Program> OCodeInterpreter::findSubroutine(OCode *ocode) {
+  if (ocode->getFilename().empty()) {
+    unsigned number = ocode->getNumber();
+    subroutines_t::iterator it = subroutines.find(number);
+
+    if (it == subroutines.end())
+      THROWS("Subroutine " << number << " not found");
+
+    return it->second;
+  }
+
+  string name = ocode->getFilename();
+  LOG_DEBUG(3, "Seeking subroutine \"" << name << '"');
+  named_subroutines_t::iterator it = namedSubroutines.find(name);
+
+  if (it == namedSubroutines.end()) {
+    // Try to load subroutine from file
+    const char *scriptPath = SystemUtilities::getenv("GCODE_SCRIPT_PATH");
+    if (!scriptPath)
+      LOG_WARNING("Environment variable GCODE_SCRIPT_PATH not set");
+
+    else {
+      if (loadedFiles.insert(name).second) {
+        markImpure(); // A replay would not load it
+
+        string path = SystemUtilities::findInPath(scriptPath, name);
+        if (path.empty())
+          THROWS("Subroutine \"" << name
+                 << "\" file not found in GCODE_SCRIPT_PATH");
+        Parser(interrupter).parse(InputSource(path), *this);
+      }
+
+      // Look up again
+      it = namedSubroutines.find(name);
+    }
+  }
+
+  if (it == namedSubroutines.end())
+    THROWS("Subroutine " << name << " not found");
+
+  return it->second;
+}
+
+
+void OCodeInterpreter::markImpure() {
+  if (recording.isNull()) return;
+  recording->pure = false;
+  recording->blocks.clear();
+}
+
+
+void OCodeInterpreter::replay(const CallRecord &record) {
+  LOG_DEBUG(3, "Replaying " << record.blocks.size() << " subroutine blocks");
+
+  for (unsigned i = 0; i < record.blocks.size(); i++) {
+    const CallRecord::RecordedBlock &block = record.blocks[i];
+
+    beginBlock();
+
+    for (unsigned j = 0; j < block.words.size(); j++) {
+      const BlockWord &word = block.words[j];
+      if (addWord(word))
+        getController().setVarExpr(word.type, word.word->getExpression());
+    }
+
+    executeWords(block.location, 0);
+  }
+}
+
+
 void OCodeInterpreter::doCall(OCode *ocode) {
   // Eval args in parent scope
   const OCode::expressions_t &expressions = ocode->getExpressions();
@@ -135,50 +305,53 @@ void OCodeInterpreter::doCall(OCode *ocode) {
   for (; i < expressions.size() && i < 30; i++) setReference(i + 1, args[i]);
   for (; i < 30; i++) setReference(i + 1, GCodeInterpreter::lookupReference(i));
 
-  try {
-    // Find subroute and call
-    if (ocode->getFilename().empty()) {
-      unsigned number = ocode->getNumber();
-      subroutines_t::iterator it = subroutines.find(number);
-
-      if (it == subroutines.end())
-        THROWS("Subroutine " << number << " not found");
-      it->second->process(*this);
-
-    } else {
-      string name = ocode->getFilename();
-      LOG_DEBUG(3, "Seeking subroutine \"" << name << '"');
-      named_subroutines_t::iterator it = namedSubroutines.find(name);
-
-      if (it == namedSubroutines.end()) {
-        // Try to load subroutine from file
-        const char *scriptPath = SystemUtilities::getenv("GCODE_SCRIPT_PATH");
-        if (!scriptPath)
-          LOG_WARNING("Environment variable GCODE_SCRIPT_PATH not set");
-
-        else {
-          if (loadedFiles.insert(name).second) {
-            string path = SystemUtilities::findInPath(scriptPath, name);
-            if (path.empty())
-              THROWS("Subroutine \"" << name
-                     << "\" file not found in GCODE_SCRIPT_PATH");
-            Parser(interrupter).parse(InputSource(path), *this);
-          }
-
-          // Look up again
-          it = namedSubroutines.find(name);
-        }
-      }
+  // Find subroutine
+  SmartPointer<Program> program = findSubroutine(ocode);
+
+  // Replay an earlier call with the same inputs
+  CallKey key = {program.get(), getController().getActiveMotion(),
+                 stack.back()};
+  bool record = false;
+
+  if (memoize) {
+    for (i = 0; i < 30; i++)
+      key.values.push_back(GCodeInterpreter::lookupReference(i));
 
-      if (it == namedSubroutines.end())
-        THROWS("Subroutine " << name << " not found");
+    calls_t::iterator it = calls.find(key);
+    if (it != calls.end() && it->second->pure) {
+      replay(*it->second);
+      return;
+    }
+
+    // Otherwise record the outermost call
+    record = recording.isNull() && it == calls.end() &&
+      calls.size() < maxCallRecords;
+  }
+
+  if (record) recording = new CallRecord(program);
+  unsigned depth = conditions.size();
+
+  try {
+    try {
+      program->process(*this);
 
-      it->second->process(*this);
+    } catch (const ReturnException &e) {
+      if (e.n != ocode->getNumber())
+        LOG_WARNING("Return number does not match subroutine");
     }
 
-  } catch (const ReturnException &e) {
-    if (e.n != ocode->getNumber())
-      LOG_WARNING("Return number does not match subroutine");
+  } catch (...) {
+    if (record) recording = 0;
+    throw;
+  }
+
+  if (record) {
+    // Unterminated conditions, loops or definitions change later blocks
+    if (conditions.size() != depth || !condition || !loop.isNull() ||
+        !subroutine.isNull()) markImpure();
+
+    calls[key] = recording;
+    recording = 0;
   }
 }
 
@@ -202,10 +375,12 @@ void OCodeInterpreter::doWhile(OCode *ocode) {
 
   const OCode::expressions_t &expressions = ocode->getExpressions();
   cb::SmartPointer<Entity> expr = expressions.empty() ? 0 : expressions[0];
+  if (compileExpressions) expr = CompiledExpr::compile(expr);
 
   if (loopEnd == "while" && loopNumber == ocode->getNumber()) {
     SmartPointer<Program> loop = this->loop;
     this->loop = 0;
+    if (!loop.isNull()) compile(*loop);
 
     do {
       try {
@@ -238,6 +413,7 @@ void OCodeInterpreter::doEndWhile(OCode *ocode) {
 
   this->loop = 0;
   loopExpr = 0;
+  if (!loop.isNull()) compile(*loop);
 
   while (!expr.isNull() && expr->eval(*this))
     try {
@@ -311,6 +487,7 @@ void OCodeInterpreter::doEndRepeat(OCode *ocode) {
   SmartPointer<Program> loop = this->loop;
   this->loop = 0;
   unsigned repeat = this->repeat;
+  if (1 < repeat && !loop.isNull()) compile(*loop);
   for (unsigned i = 0; i < repeat; i++) loop->process(*this);
 }
 
@@ -366,9 +543,35 @@ void OCodeInterpreter::operator()(const SmartPointer<Block> &block) {
 }
 
 
+void OCodeInterpreter::operator()(const SimpleBlock &block) {
+  if (block.isDeleted()) return;
+
+  // Simple blocks are never recorded, see wantsSimpleBlocks()
+  if (!conditions.empty() && !condition) return;
+
+  GCodeInterpreter::operator()(block);
+}
+
+
+void OCodeInterpreter::executeWords(const LocationRange &location,
+                                    Block *block) {
+  if (!recording.isNull() && recording->pure) {
+    if (recording->blocks.size() == maxRecordedBlocks) markImpure();
+    else {
+      CallRecord::RecordedBlock recorded = {location, words};
+      recording->blocks.push_back(recorded);
+    }
+  }
+
+  GCodeInterpreter::executeWords(location, block);
+}
+
+
 void OCodeInterpreter::setReference(unsigned num, double value) {
-  if (!num || 30 < num || stack.empty())
+  if (!num || 30 < num || stack.empty()) {
+    markImpure();
     GCodeInterpreter::setReference(num, value);
+  }
 
   else {
     LOG_DEBUG(3, "Set local variable #" << num << " = " << value);
@@ -377,33 +580,54 @@ void OCodeInterpreter::setReference(unsigned num, double value) {
 }
 
 
-void OCodeInterpreter::setReference(const string &name, double value) {
-  if (nameStack.empty() || name[0] == '_')
-    GCodeInterpreter::setReference(name, value);
+void OCodeInterpreter::setReference(const NamedReference &ref, double value) {
+  if (stack.empty() || ref.isGlobal()) {
+    markImpure();
+    GCodeInterpreter::setReference(ref, value);
+  }
 
   else {
-    LOG_DEBUG(3, "Set local variable #<" << name << "> = " << value);
-    nameStack.back()[name] = value; // Local variable assignment
+    LOG_DEBUG(3, "Set local variable #<" << ref.getName() << "> = " << value);
+
+    // Local variable assignment
+    unsigned slot = ref.getSlot();
+    if (namedLocals.size() <= slot) {
+      NamedLocal unset = {0, 0};
+      namedLocals.resize(slot + 1, unset);
+    }
+
+    NamedLocal &local = namedLocals[slot];
+    if (local.depth != stack.size()) {
+      SavedLocal saved = {slot, local};
+      savedLocals.push_back(saved);
+      local.depth = stack.size();
+    }
+
+    local.value = value;
   }
 }
 
 
 double OCodeInterpreter::lookupReference(unsigned num) {
-  if (!num || 30 < num || stack.empty())
+  if (!num || 30 < num || stack.empty()) {
+    markImpure();
     return GCodeInterpreter::lookupReference(num);
+  }
 
   // Local variable reference
   return stack.back()[num - 1];
 }
 
 
-double OCodeInterpreter::lookupReference(const string &name) {
-  if (name[0] != '_' && !nameStack.empty()) {
-    name_map_t &nameMap = nameStack.back();
-    name_map_t::iterator it = nameMap.find(name);
-    if (it != nameMap.end()) return it->second;
-    THROWS("Local reference to '" << name << "' not found");
+double OCodeInterpreter::lookupReference(const NamedReference &ref) {
+  if (!ref.isGlobal() && !stack.empty()) {
+    unsigned slot = ref.getSlot();
+    if (slot < namedLocals.size() && namedLocals[slot].depth == stack.size())
+      return namedLocals[slot].value;
+
+    THROWS("Local reference to '" << ref.getName() << "' not found");
   }
 
-  return GCodeInterpreter::lookupReference(name);
+  markImpure();
+  return GCodeInterpreter::lookupReference(ref);
 }
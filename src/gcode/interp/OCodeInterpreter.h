@@ -50,9 +50,21 @@ namespace GCode {
     // Variable call stack
     typedef std::vector<std::vector<double> > stack_t;
     stack_t stack;
-    typedef std::map<std::string, double> name_map_t;
-    typedef std::vector<name_map_t> name_stack_t;
-    name_stack_t nameStack;
+
+    // Named local variables by Names slot.  Only those set at the current
+    // depth are visible.  The ones they hid are saved and restored by
+    // upScope().
+    struct NamedLocal {
+      double value;
+      unsigned depth; // 0 if not set
+    };
+    std::vector<NamedLocal> namedLocals;
+    struct SavedLocal {
+      unsigned slot;
+      NamedLocal local;
+    };
+    std::vector<SavedLocal> savedLocals;
+    std::vector<unsigned> savedMarks;
 
     std::vector<unsigned> conditions;
     bool condition;
@@ -65,7 +77,44 @@ namespace GCode {
 
     std::set<std::string> loadedFiles;
 
+    // Memoized subroutine calls.  A call's output depends only on the
+    // subroutine, its locals, the globals copied into unset locals of
+    // nested calls and the active motion, unless it touches other
+    // references.  Its evaluated blocks are recorded in program
+    // coordinates so the controller applies the current offsets on replay.
+    struct CallKey {
+      const Program *program;
+      const Code *motion;
+      std::vector<double> values; // Locals then globals #0-#29
+
+      bool operator<(const CallKey &o) const;
+    };
+
+    struct CallRecord;
+    typedef std::map<CallKey, cb::SmartPointer<CallRecord> > calls_t;
+    calls_t calls;
+    cb::SmartPointer<CallRecord> recording;
+    bool memoize;
+    bool compileExpressions;
+
+  protected:
+    // From GCodeInterpreter
+    void executeWords(const cb::LocationRange &location, Block *block);
+
   public:
+    /// What carries over from one top level block to the next
+    struct Snapshot {
+      subroutines_t subroutines;
+      named_subroutines_t namedSubroutines;
+      std::set<std::string> loadedFiles;
+
+      Snapshot();
+      ~Snapshot();
+
+      /// Subroutines are compared by identity.
+      bool sameState(const Snapshot &o) const;
+    };
+
     OCodeInterpreter(Controller &controller,
                      const cb::SmartPointer<Interrupter> &interrupter
                      = new NullInterrupter);
@@ -74,10 +123,28 @@ namespace GCode {
     const cb::SmartPointer<Interrupter> &getInterrupter() const
     {return interrupter;}
 
+    /// Run every call rather than replaying earlier ones.
+    void setMemoize(bool memoize) {this->memoize = memoize;}
+    /// Evaluate every expression with the Evaluator, without bytecode.
+    void setCompileExpressions(bool compileExpressions)
+    {this->compileExpressions = compileExpressions;}
+
+    /// @return false if inside a subroutine definition, a call, a loop or
+    /// a condition, where no snapshot can be taken.
+    bool save(Snapshot &snapshot) const;
+    void restore(const Snapshot &snapshot);
+
     void checkExpressions(OCode *ocode, const char *name, unsigned count);
+    /// Compile the expressions of @param program, which is run repeatedly.
+    void compile(Program &program);
     void upScope();
     void downScope();
 
+    cb::SmartPointer<Program> findSubroutine(OCode *ocode);
+    /// The recorded call can no longer be replayed.
+    void markImpure();
+    void replay(const CallRecord &record);
+
     void doSub(OCode *ocode);
     void doEndSub(OCode *ocode);
     void doCall(OCode *ocode);
@@ -95,13 +162,16 @@ namespace GCode {
 
     // From Processor
     void operator()(const cb::SmartPointer<Block> &block);
+    bool wantsSimpleBlocks() const
+    {return subroutine.isNull() && loop.isNull();}
+    void operator()(const SimpleBlock &block);
 
     // From GCodeInterpreter
     void setReference(unsigned num, double value);
-    void setReference(const std::string &name, double value);
+    void setReference(const NamedReference &ref, double value);
 
     // From Evaluator
     double lookupReference(unsigned num);
-    double lookupReference(const std::string &name);
+    double lookupReference(const NamedReference &ref);
   };
 }
@@ -20,6 +20,8 @@
 
 #include "GCodeMachine.h"
 
+#include <gcode/NumberFormat.h>
+
 #include <cbang/Exception.h>
 #include <cbang/Math.h>
 #include <cbang/net/URI.h>
@@ -33,26 +35,13 @@ using namespace GCode;
 
 
 namespace {
-  struct dtos {
-    double x;
-    bool imperial;
-
-    dtos(double x, bool imperial) : x(x), imperial(imperial) {
-      if (Math::isnan(x))
-        THROW("Numerical error in GCode stream:  NaN, caused by a divide by "
-              "zero or other math error.");
-
-      if (Math::isinf(x))
-        THROW("Numerical error in GCode stream: Infinite value");
-    }
-
+  void checkNumber(double x) {
+    if (Math::isnan(x))
+      THROW("Numerical error in GCode stream:  NaN, caused by a divide by "
+            "zero or other math error.");
 
-    string toString() const {return String(x, imperial ? 3 : 2);}
-  };
-
-
-  inline ostream &operator<<(ostream &stream, const dtos &d) {
-    return stream << d.toString();
+    if (Math::isinf(x))
+      THROW("Numerical error in GCode stream: Infinite value");
   }
 }
 
@@ -69,17 +58,30 @@ void GCodeMachine::beginLine() {
   const string &filename = newLoc.getFilename();
 
   if (filename != location.getFilename()) {
-    stream << "(File: '" << URI::encode(filename, UNESCAPED) << "')\n";
+    line += "(File: '" + URI::encode(filename, UNESCAPED) + "')\n";
     location.setFilename(filename);
   }
 
   if (newLoc.getLine() != location.getLine()) {
-    stream << 'N' << newLoc.getLine() << ' ';
+    line += 'N' + String(newLoc.getLine()) + ' ';
     location.setLine(newLoc.getLine());
   }
 }
 
 
+void GCodeMachine::appendNumber(double x, unsigned digits) {
+  checkNumber(x);
+  GCode::appendNumber(line, x, digits);
+}
+
+
+void GCodeMachine::endLine() {
+  line += '\n';
+  stream.write(line.data(), line.size());
+  line.clear();
+}
+
+
 void GCodeMachine::start() {
   stream << (units == Units::METRIC ? "G21" : "G20") << "\n";
   // TODO set other GCode state
@@ -109,7 +111,9 @@ void GCodeMachine::setFeed(double feed, feed_mode_t mode) {
 
   if (feed != oldFeed) {
     beginLine();
-    stream << "F" << dtos(feed, false) << '\n';
+    line += 'F';
+    appendNumber(feed, 2);
+    endLine();
   }
 }
 
@@ -124,21 +128,30 @@ void GCodeMachine::setSpeed(double speed, spin_mode_t mode, double max) {
     beginLine();
 
     switch (mode) {
-    case REVOLUTIONS_PER_MINUTE: stream << "G97\n"; break;
+    case REVOLUTIONS_PER_MINUTE: line += "G97"; break;
     case CONSTANT_SURFACE_SPEED:
-      stream << "G96 S" << dtos(fabs(speed), false);
-      if (max) stream << " D" << dtos(max, false);
-      stream << '\n';
+      line += "G96 S";
+      appendNumber(fabs(speed), 2);
+      if (max) {
+        line += " D";
+        appendNumber(max, 2);
+      }
       break;
     }
+
+    endLine();
   }
 
   if (oldSpeed != speed) {
     beginLine();
 
-    if (0 < speed) stream << "M3 S" << dtos(speed, false) << '\n';
-    else if (speed < 0) stream << "M4 S" << dtos(-speed, false) << '\n';
-    else stream << "M5\n";
+    if (speed) {
+      line += 0 < speed ? "M3 S" : "M4 S";
+      appendNumber(fabs(speed), 2);
+
+    } else line += "M5";
+
+    endLine();
   }
 }
 
@@ -150,7 +163,8 @@ void GCodeMachine::setTool(unsigned tool) {
 
   if (oldTool != (int)tool) {
     beginLine();
-    stream << "M6 T" << tool << '\n';
+    line += "M6 T" + String(tool);
+    endLine();
   }
 }
 
@@ -197,7 +211,9 @@ void GCodeMachine::output(unsigned port, double value, bool sync) {
 
 void GCodeMachine::dwell(double seconds) {
   beginLine();
-  stream << "G4 P" << dtos(seconds, false) << '\n';
+  line += "G4 P";
+  appendNumber(seconds, 2);
+  endLine();
   MachineAdapter::dwell(seconds);
 }
 
@@ -210,26 +226,32 @@ bool is_near(double x, double y) {
 
 void GCodeMachine::move(const Axes &axes, bool rapid) {
   bool first = true;
-  bool imperial = units == Units::IMPERIAL;
+  unsigned digits = units == Units::IMPERIAL ? 3 : 2;
 
   for (const char *axis = Axes::AXES; *axis; axis++)
     if (!is_near(position.get(*axis), axes.get(*axis))) {
-      string last = dtos(position.get(*axis), imperial).toString();
-      string value = dtos(axes.get(*axis), imperial).toString();
+      // Skip axes which are unchanged at the output precision
+      lastWord.clear();
+      nextWord.clear();
+      checkNumber(axes.get(*axis));
+      GCode::appendNumber(lastWord, position.get(*axis), digits);
+      GCode::appendNumber(nextWord, axes.get(*axis), digits);
 
-      if (last == value) continue;
+      if (lastWord == nextWord) continue;
 
       if (first) {
         beginLine();
-        stream << 'G' << (rapid ? '0' : '1');
+        line += rapid ? "G0" : "G1";
         first = false;
       }
 
-      stream << ' ' << *axis << value;
+      line += ' ';
+      line += *axis;
+      line += nextWord;
     }
 
   if (!first) {
-    stream << '\n';
+    endLine();
     position = axes;
 
     MachineAdapter::move(position, rapid);
@@ -239,7 +261,8 @@ void GCodeMachine::move(const Axes &axes, bool rapid) {
 
 void GCodeMachine::pause(bool optional) {
   beginLine();
-  stream << (optional ? "M1" : "M0") << '\n';
+  line += optional ? "M1" : "M0";
+  endLine();
   MachineAdapter::pause(optional);
 }
 
@@ -26,6 +26,7 @@
 #include <gcode/Units.h>
 
 #include <ostream>
+#include <string>
 
 namespace GCode {
   class GCodeMachine : public MachineAdapter {
@@ -39,11 +40,17 @@ namespace GCode {
 
     cb::FileLocation location;
 
+    std::string line;
+    std::string lastWord;
+    std::string nextWord;
+
   public:
     GCodeMachine(std::ostream &stream, Units units) :
       stream(stream), units(units), mistCoolant(false), floodCoolant(false) {}
 
     void beginLine();
+    void appendNumber(double x, unsigned digits);
+    void endLine();
 
     // From MachineInterface
     void start();
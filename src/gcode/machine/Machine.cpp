@@ -20,12 +20,6 @@
 
 #include "Machine.h"
 
-#include "MachineState.h"
-#include "MoveSink.h"
-#include "MachineMatrix.h"
-#include "MachineLinearizer.h"
-#include "MachineUnitAdapter.h"
-
 #include <gcode/Move.h>
 
 #include <cbang/log/Logger.h>
@@ -35,13 +29,77 @@ using namespace std;
 using namespace GCode;
 
 
-Machine::Machine(MoveStream &stream, double rapidFeed, double maxArcError) :
-  stream(stream), rapidFeed(rapidFeed) {
-  add(new MachineUnitAdapter);
-  add(new MachineLinearizer(maxArcError));
-  add(new MachineMatrix);
-  add(new MoveSink(*this));
-  add(new MachineState);
+namespace {
+  bool sameMatrices(const vector<TransMatrix> &a,
+                    const vector<TransMatrix> &b) {
+    if (a.size() != b.size()) return false;
+
+    for (unsigned i = 0; i < a.size(); i++)
+      if (a[i].getMatrix() != b[i].getMatrix() ||
+          a[i].getInverse() != b[i].getInverse()) return false;
+
+    return true;
+  }
+}
+
+
+bool Machine::Snapshot::sameState(const Snapshot &o) const {
+  MachineInterface::feed_mode_t feedMode, oFeedMode;
+  MachineInterface::spin_mode_t spinMode, oSpinMode;
+  double maxSpeed, oMaxSpeed;
+
+  if (state.getFeed(&feedMode) != o.state.getFeed(&oFeedMode) ||
+      feedMode != oFeedMode ||
+      state.getSpeed(&spinMode, &maxSpeed) !=
+      o.state.getSpeed(&oSpinMode, &oMaxSpeed) ||
+      spinMode != oSpinMode || maxSpeed != oMaxSpeed ||
+      state.getTool() != o.state.getTool() ||
+      state.getPosition() != o.state.getPosition() ||
+      probePending != o.probePending) return false;
+
+  for (unsigned i = 0; i < AXES_COUNT; i++) {
+    axes_t axes = (axes_t)i;
+
+    if (state.getMatrix(axes) != o.state.getMatrix(axes) ||
+        !sameMatrices(matrices[i], o.matrices[i])) return false;
+  }
+
+  return true;
+}
+
+
+Machine::Machine(MoveStream &stream, double rapidFeed, double maxArcError,
+                 bool nativeArcs) : stream(stream), rapidFeed(rapidFeed) {
+  Linearizer *linearizer = new Linearizer(maxArcError);
+  linearizer->setNativeArcs(nativeArcs);
+
+  add(unitAdapter = new UnitAdapter);
+  add(linearizer);
+  add(matrix = new Matrix);
+  add(sink = new Sink(*this));
+  add(state = new MachineState);
+}
+
+
+void Machine::save(Snapshot &snapshot) const {
+  snapshot.state = *state;
+
+  for (unsigned i = 0; i < AXES_COUNT; i++)
+    snapshot.matrices[i] = matrix->getMatrices((axes_t)i);
+
+  snapshot.probePending = sink->getProbePending();
+  snapshot.time = sink->getTime();
+}
+
+
+void Machine::restore(const Snapshot &snapshot) {
+  *state = snapshot.state;
+
+  for (unsigned i = 0; i < AXES_COUNT; i++)
+    matrix->getMatrices((axes_t)i) = snapshot.matrices[i];
+
+  sink->setProbePending(snapshot.probePending);
+  sink->setTime(snapshot.time);
 }
 
 
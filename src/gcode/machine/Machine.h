@@ -22,25 +22,75 @@
 
 
 #include "MachinePipeline.h"
+#include "StaticAdapter.h"
+#include "MachineUnitAdapter.h"
+#include "MachineLinearizer.h"
+#include "MachineMatrix.h"
+#include "MoveSink.h"
+#include "MachineState.h"
+#include "TransMatrix.h"
 
 #include <gcode/MoveStream.h>
 
+#include <vector>
+
 
 namespace GCode {
   class Move;
-  class MachineMatrix;
 
   class Machine : public MachinePipeline, public MoveStream {
+  public:
+    // The simulation pipeline, composed at compile time so that the calls
+    // made for each move are not virtual
+    typedef MoveSinkStage<StaticAdapter<MachineState> > Sink;
+    typedef MachineMatrixStage<StaticAdapter<Sink> > Matrix;
+    typedef MachineLinearizerStage<StaticAdapter<Matrix> > Linearizer;
+    typedef MachineUnitAdapterStage<StaticAdapter<Linearizer> > UnitAdapter;
+
+  private:
     MoveStream &stream;
 
     // TODO Load machine configuration, ramp up/down, rapid feed, etc.
     double rapidFeed;
 
+    UnitAdapter *unitAdapter;
+    Matrix *matrix;
+    Sink *sink;
+    MachineState *state;
+
   public:
+    /// The state of the pipeline between moves
+    struct Snapshot {
+      MachineState state;
+      std::vector<TransMatrix> matrices[AXES_COUNT];
+      bool probePending;
+      double time;
+
+      /// Compares everything but the time and location.
+      bool sameState(const Snapshot &o) const;
+    };
+
+    /// With @param nativeArcs XY arcs are sent to @param stream as arc moves.
     Machine(MoveStream &stream, double rapidFeed = 10000,
-            double maxArcError = 0.01);
+            double maxArcError = 0.01, bool nativeArcs = false);
+
+    void save(Snapshot &snapshot) const;
+    void restore(const Snapshot &snapshot);
+
+    // From MachineInterface
+    Axes getPosition() const {return unitAdapter->UnitAdapter::getPosition();}
+    cb::Vector3D getPosition(axes_t axes) const
+    {return unitAdapter->UnitAdapter::getPosition(axes);}
+
+    void move(const Axes &axes, bool rapid = false)
+    {unitAdapter->UnitAdapter::move(axes, rapid);}
+    void arc(const cb::Vector3D &offset, double angle, plane_t plane = XY)
+    {unitAdapter->UnitAdapter::arc(offset, angle, plane);}
 
-    using MachineAdapter::move;
+    const cb::LocationRange &getLocation() const
+    {return unitAdapter->UnitAdapter::getLocation();}
+    void setLocation(const cb::LocationRange &location)
+    {unitAdapter->UnitAdapter::setLocation(location);}
 
     // From MoveStream
     void move(Move &move);
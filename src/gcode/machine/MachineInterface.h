@@ -30,8 +30,6 @@
 
 
 namespace GCode {
-  class MachineMatrix;
-
   class MachineInterface : public MachineEnum {
   public:
     virtual ~MachineInterface() {}
@@ -21,16 +21,145 @@
 #pragma once
 
 #include "MachineAdapter.h"
+#include "TransMatrix.h"
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <cmath>
 
 
 namespace GCode {
-  class MachineLinearizer : public MachineAdapter {
+  template <typename Base>
+  class MachineLinearizerStage : public Base {
     double maxArcError;
+    bool nativeArcs;
+
+    // Cosines and sines of each segment's angle from the start of recent
+    // arcs, by segment count and angle.  Pockets repeat the same arcs.
+    typedef std::vector<std::pair<double, double> > steps_t;
+    typedef std::map<std::pair<unsigned, double>, steps_t> stepCache_t;
+    stepCache_t stepCache;
+    unsigned cachedSteps;
 
   public:
-    MachineLinearizer(double maxArcError = 0.01) : maxArcError(maxArcError) {}
+    MachineLinearizerStage(double maxArcError = 0.01) :
+      maxArcError(maxArcError), nativeArcs(false), cachedSteps(0) {}
+
+    double getMaxArcError() const {return maxArcError;}
+
+    /// Pass XY arcs on, when not distorted by the matrix, rather than
+    /// breaking them into segments.  The next stages must handle arcs.
+    bool getNativeArcs() const {return nativeArcs;}
+    void setNativeArcs(bool nativeArcs) {this->nativeArcs = nativeArcs;}
 
     // From MachineInterface
-    void arc(const cb::Vector3D &offset, double degrees, plane_t plane);
+    void arc(const cb::Vector3D &offset, double degrees,
+             MachineEnum::plane_t plane);
+
+  protected:
+    const steps_t &getSteps(unsigned segments, double angle);
   };
+
+
+  template <typename Base>
+  const typename MachineLinearizerStage<Base>::steps_t &
+  MachineLinearizerStage<Base>::getSteps(unsigned segments, double angle) {
+    std::pair<unsigned, double> key(segments, angle);
+
+    typename stepCache_t::iterator it = stepCache.find(key);
+    if (it != stepCache.end()) return it->second;
+
+    // Bound the memory used
+    if (1 << 16 < cachedSteps + segments) {
+      stepCache.clear();
+      cachedSteps = 0;
+    }
+
+    steps_t &steps = stepCache[key];
+    double deltaAngle = -angle / segments;
+
+    steps.resize(segments);
+    for (unsigned i = 0; i < segments; i++) {
+      double a = deltaAngle * (i + 1);
+      steps[i] = std::make_pair(cos(a), sin(a));
+    }
+
+    cachedSteps += segments;
+
+    return steps;
+  }
+
+
+  template <typename Base> void MachineLinearizerStage<Base>::
+  arc(const cb::Vector3D &offset, double angle, MachineEnum::plane_t plane) {
+    if (nativeArcs && plane == MachineEnum::XY &&
+        TransMatrix::classify(Base::getMatrix(MachineEnum::XYZ)) !=
+        TransMatrix::GENERAL)
+      return Base::arc(offset, angle, plane);
+
+    const char *axesNames;
+    switch (plane) {
+    case MachineEnum::XY: axesNames = "XYZ"; break;
+    case MachineEnum::XZ: axesNames = "XZY"; break;
+    case MachineEnum::YZ: axesNames = "YZX"; break;
+    default: THROWS("Invalid plane: " << plane);
+    }
+
+    unsigned char axes[3];
+    for (unsigned i = 0; i < 3; i++)
+      axes[i] = Axes::toIndex(axesNames[i]);
+
+    Axes current = Base::getPosition();
+
+    // Initial point
+    double x = current[axes[0]];
+    double y = current[axes[1]];
+    double z = current[axes[2]];
+
+    // Center
+    cb::Vector2D center(x + offset.x(), y + offset.y());
+
+    // Start angle
+    double startAngle =
+      cb::Vector2D(-offset.x(), -offset.y()).angleBetween(cb::Vector2D(1, 0));
+
+    // Radius
+    double radius = cb::Vector2D(offset.x(), offset.y()).length();
+
+    // Allowed error cannot be greater than arc radius
+    double error = std::min(maxArcError, radius);
+    double errorAngle = 2 * acos(1 - error / radius);
+
+    // Error angle cannot be greater than 2Pi/3 because we need at least 3
+    // segments in a full circle
+    errorAngle = std::min(2 * M_PI / 3, errorAngle);
+
+    // Segments
+    unsigned segments = (unsigned)ceil(fabs(angle) / errorAngle);
+    double zDelta = offset.z() / segments;
+    const steps_t &steps = getSteps(segments, angle);
+    double startCos = radius * cos(startAngle);
+    double startSin = radius * sin(startAngle);
+
+    // TODO The estimated arc should straddle the actual arc.  This one
+
+    // Create segments
+    for (unsigned i = 0; i < segments; i++) {
+      // Rotate the start point by the segment's angle
+      const std::pair<double, double> &step = steps[i];
+      x = center.x() + startCos * step.first - startSin * step.second;
+      y = center.y() + startSin * step.first + startCos * step.second;
+      z += zDelta;
+
+      // Move
+      current[axes[0]] = x;
+      current[axes[1]] = y;
+      current[axes[2]] = z;
+      Base::move(current, false);
+    }
+  }
+
+
+  typedef MachineLinearizerStage<MachineAdapter> MachineLinearizer;
 }
@@ -28,21 +28,32 @@
 
 
 namespace GCode {
-  class MachineMatrix : virtual public MachineAdapter {
+  template <typename Base>
+  class MachineMatrixStage : public Base {
+  public:
+    typedef MachineEnum::axes_t axes_t;
+    typedef MachineEnum::plane_t plane_t;
     typedef std::vector<TransMatrix> matrices_t;
-    matrices_t matrices[AXES_COUNT];
+
+  private:
+    matrices_t matrices[MachineEnum::AXES_COUNT];
 
   public:
-    MachineMatrix();
+    MachineMatrixStage();
+
+    matrices_t &getMatrices(axes_t matrix);
+    const matrices_t &getMatrices(axes_t matrix) const;
 
-    void pushMatrix(axes_t matrix = XYZ);
-    void popMatrix(axes_t matrix = XYZ);
-    void loadIdentity(axes_t matrix = XYZ);
-    void scale(double x, double y, double z, axes_t matrix = XYZ);
-    void translate(double x, double y, double z, axes_t matrix = XYZ);
+    void pushMatrix(axes_t matrix = MachineEnum::XYZ);
+    void popMatrix(axes_t matrix = MachineEnum::XYZ);
+    void loadIdentity(axes_t matrix = MachineEnum::XYZ);
+    void scale(double x, double y, double z, axes_t matrix = MachineEnum::XYZ);
+    void translate(double x, double y, double z,
+                   axes_t matrix = MachineEnum::XYZ);
     void rotate(double angle, double x, double y, double z, double a, double b,
-                double c, axes_t matrix = XYZ);
-    void reflect(double x, double y, double z, axes_t matrix = XYZ);
+                double c, axes_t matrix = MachineEnum::XYZ);
+    void reflect(double x, double y, double z,
+                 axes_t matrix = MachineEnum::XYZ);
 
     // From MachineInterface
     void start();
@@ -54,10 +65,181 @@ namespace GCode {
     void setMatrix(const cb::Matrix4x4D &m, axes_t matrix);
 
   protected:
-    matrices_t &getMatrices(axes_t matrix);
-    const matrices_t &getMatrices(axes_t matrix) const;
     TransMatrix &getTransMatrix(axes_t matrix);
     const TransMatrix &getTransMatrix(axes_t matrix) const;
     void updateMatrix(axes_t matrix);
   };
+
+
+  template <typename Base>
+  MachineMatrixStage<Base>::MachineMatrixStage() {
+    for (unsigned i = 0; i < 3; i++) matrices[i].push_back(TransMatrix());
+  }
+
+
+  template <typename Base>
+  void MachineMatrixStage<Base>::pushMatrix(axes_t matrix) {
+    matrices_t &m = getMatrices(matrix);
+    m.push_back(m.back());
+  }
+
+
+  template <typename Base>
+  void MachineMatrixStage<Base>::popMatrix(axes_t matrix) {
+    matrices_t &matrices = getMatrices(matrix);
+    if (matrices.size() == 1) THROW("Matrix stack empty");
+    matrices.pop_back();
+
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base>
+  void MachineMatrixStage<Base>::loadIdentity(axes_t matrix) {
+    getTransMatrix(matrix).identity();
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::
+  scale(double x, double y, double z, axes_t matrix) {
+    getTransMatrix(matrix).scale(cb::Vector3D(x, y, z));
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::
+  translate(double x, double y, double z, axes_t matrix) {
+    // TODO Need to convert imperial units to metric
+    getTransMatrix(matrix).translate(cb::Vector3D(x, y, z));
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::
+  rotate(double angle, double x, double y, double z, double a, double b,
+         double c, axes_t matrix) {
+    if (!angle) return;
+    getTransMatrix(matrix)
+      .rotate(angle, cb::Vector3D(x, y, z), cb::Vector3D(a, b, c));
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::
+  reflect(double x, double y, double z, axes_t matrix) {
+    getTransMatrix(matrix).reflect(cb::Vector3D(x, y, z));
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::start() {
+    loadIdentity(MachineEnum::XYZ);
+    loadIdentity(MachineEnum::ABC);
+    loadIdentity(MachineEnum::UVW);
+
+    Base::start();
+  }
+
+
+  template <typename Base> Axes MachineMatrixStage<Base>::getPosition() const {
+    Axes axes = Base::getPosition();
+
+    const TransMatrix &xyz = getTransMatrix(MachineEnum::XYZ);
+    const TransMatrix &abc = getTransMatrix(MachineEnum::ABC);
+    const TransMatrix &uvw = getTransMatrix(MachineEnum::UVW);
+
+    if (!xyz.isIdentity()) axes.setXYZ(xyz.invert(axes.getXYZ()));
+    if (!abc.isIdentity()) axes.setABC(abc.invert(axes.getABC()));
+    if (!uvw.isIdentity()) axes.setUVW(uvw.invert(axes.getUVW()));
+
+    return axes;
+  }
+
+
+  template <typename Base>
+  cb::Vector3D MachineMatrixStage<Base>::getPosition(axes_t axes) const {
+    return getTransMatrix(axes).invert(Base::getPosition(axes));
+  }
+
+
+  template <typename Base>
+  void MachineMatrixStage<Base>::move(const Axes &axes, bool rapid) {
+    const TransMatrix &xyz = getTransMatrix(MachineEnum::XYZ);
+    const TransMatrix &abc = getTransMatrix(MachineEnum::ABC);
+    const TransMatrix &uvw = getTransMatrix(MachineEnum::UVW);
+
+    // Most programs never transform
+    if (xyz.isIdentity() && abc.isIdentity() && uvw.isIdentity())
+      return Base::move(axes, rapid);
+
+    Axes trans(axes);
+
+    if (!xyz.isIdentity()) trans.setXYZ(xyz.transform(axes.getXYZ()));
+    if (!abc.isIdentity()) trans.setABC(abc.transform(axes.getABC()));
+    if (!uvw.isIdentity()) trans.setUVW(uvw.transform(axes.getUVW()));
+
+    Base::move(trans, rapid);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::
+  arc(const cb::Vector3D &offset, double angle, plane_t plane) {
+    // Arc offsets are relative so translations do not change them
+    if (getTransMatrix(MachineEnum::XYZ).getType() == TransMatrix::GENERAL)
+      THROW("MachineMatrix cannot handle arc directly");
+
+    Base::arc(offset, angle, plane);
+  }
+
+
+  template <typename Base> void MachineMatrixStage<Base>::
+  setMatrix(const cb::Matrix4x4D &t, axes_t matrix) {
+    getTransMatrix(matrix).setMatrix(t);
+    updateMatrix(matrix);
+  }
+
+
+  template <typename Base> typename MachineMatrixStage<Base>::matrices_t &
+  MachineMatrixStage<Base>::getMatrices(axes_t matrix) {
+    if (MachineEnum::AXES_COUNT <= matrix)
+      THROWS("Invalid matrix " << matrix);
+    return matrices[matrix];
+  }
+
+
+  template <typename Base>
+  const typename MachineMatrixStage<Base>::matrices_t &
+  MachineMatrixStage<Base>::getMatrices(axes_t matrix) const {
+    if (MachineEnum::AXES_COUNT <= matrix)
+      THROWS("Invalid matrix " << matrix);
+    return matrices[matrix];
+  }
+
+
+  template <typename Base>
+  TransMatrix &MachineMatrixStage<Base>::getTransMatrix(axes_t matrix) {
+    matrices_t &matrices = getMatrices(matrix);
+    if (matrices.empty()) THROW("Matrix stack empty");
+    return matrices.back();
+  }
+
+
+  template <typename Base> const TransMatrix &
+  MachineMatrixStage<Base>::getTransMatrix(axes_t matrix) const {
+    const matrices_t &matrices = getMatrices(matrix);
+    if (matrices.empty()) THROW("Matrix stack empty");
+    return matrices.back();
+  }
+
+
+  template <typename Base>
+  void MachineMatrixStage<Base>::updateMatrix(axes_t matrix) {
+    const cb::Matrix4x4D &m = getTransMatrix(matrix).getMatrix();
+
+    if (Base::getMatrix(matrix) != m) Base::setMatrix(m, matrix);
+  }
+
+
+  typedef MachineMatrixStage<MachineAdapter> MachineMatrix;
 }
@@ -27,14 +27,28 @@
 
 
 namespace GCode {
-  class MachineUnitAdapter : virtual public MachineAdapter, public Units {
+  template <typename Base>
+  class MachineUnitAdapterStage : public Base, public Units {
   protected:
     Units units;
     Units targetUnits;
 
+    // Conversions to and from the target units, found once per change of
+    // units rather than on every call.  Programs already in the target
+    // units pass straight through.
+    double lengthIn;
+    double lengthOut;
+    double surfaceIn;
+    double surfaceOut;
+
   public:
-    MachineUnitAdapter(Units units = METRIC, Units targetUnits = METRIC) :
-      units(units), targetUnits(targetUnits) {}
+    typedef MachineEnum::feed_mode_t feed_mode_t;
+    typedef MachineEnum::spin_mode_t spin_mode_t;
+    typedef MachineEnum::plane_t plane_t;
+    typedef MachineEnum::axes_t axes_t;
+
+    MachineUnitAdapterStage(Units units = METRIC, Units targetUnits = METRIC) :
+      units(units), targetUnits(targetUnits) {updateScales();}
 
     bool isMetric() const {return units == METRIC;}
     void setMetric() {setUnits(METRIC);}
@@ -49,24 +63,87 @@ namespace GCode {
      * Set the active units, IMPERIAL or METRIC.
      * @throw cb::Exception if @param units is invalid.
      */
-    void setUnits(Units units) {this->units = units;}
+    void setUnits(Units units) {
+      this->units = units;
+      updateScales();
+    }
 
     // From MachineInterface
-    double getFeed(feed_mode_t *mode) const;
-    void setFeed(double feed, feed_mode_t mode);
+    double getFeed(feed_mode_t *_mode) const {
+      feed_mode_t mode;
+      double feed = Base::getFeed(&mode);
+
+      if (_mode) *_mode = mode;
+
+      return mode == MachineEnum::INVERSE_TIME ? feed : feed * lengthIn;
+    }
+
+
+    void setFeed(double feed, feed_mode_t mode) {
+      Base::setFeed
+        (mode == MachineEnum::INVERSE_TIME ? feed : feed * lengthOut, mode);
+    }
+
+
+    double getSpeed(spin_mode_t *_mode, double *max) const {
+      spin_mode_t mode;
+      double speed = Base::getSpeed(&mode, max);
+
+      if (_mode) *_mode = mode;
+
+      return mode != MachineEnum::CONSTANT_SURFACE_SPEED ? speed :
+        speed * surfaceIn;
+    }
+
 
-    double getSpeed(spin_mode_t *mode, double *max) const;
-    void setSpeed(double speed, spin_mode_t mode, double max);
+    void setSpeed(double speed, spin_mode_t mode, double max) {
+      Base::setSpeed
+        (mode != MachineEnum::CONSTANT_SURFACE_SPEED ? speed :
+         speed * surfaceOut, mode, max);
+    }
 
-    Axes getPosition() const;
-    cb::Vector3D getPosition(axes_t axes) const;
 
-    void move(const Axes &axes, bool rapid);
-    void arc(const cb::Vector3D &offset, double angle, plane_t plane);
+    Axes getPosition() const {
+      if (lengthIn == 1) return Base::getPosition();
+      return Base::getPosition() * lengthIn;
+    }
 
-    double mmInchIn() const;
-    double mmInchOut() const;
-    double meterFootIn() const;
-    double meterFootOut() const;
+
+    cb::Vector3D getPosition(axes_t axes) const {
+      if (lengthIn == 1) return Base::getPosition(axes);
+      return Base::getPosition(axes) * lengthIn;
+    }
+
+
+    void move(const Axes &axes, bool rapid) {
+      if (lengthOut == 1) Base::move(axes, rapid);
+      else Base::move(axes * lengthOut, rapid);
+    }
+
+
+    void arc(const cb::Vector3D &offset, double angle, plane_t plane) {
+      if (lengthOut == 1) Base::arc(offset, angle, plane);
+      else Base::arc(offset * lengthOut, angle, plane);
+    }
+
+
+    double mmInchIn() const {return lengthIn;}
+    double mmInchOut() const {return lengthOut;}
+    double meterFootIn() const {return surfaceIn;}
+    double meterFootOut() const {return surfaceOut;}
+
+  protected:
+    void updateScales() {
+      bool same = units == targetUnits;
+      bool toMetric = targetUnits == METRIC;
+
+      lengthIn = same ? 1 : (toMetric ? 1 / 25.4 : 25.4);
+      lengthOut = same ? 1 : (toMetric ? 25.4 : 1 / 25.4);
+      surfaceIn = same ? 1 : (toMetric ? 1 / 0.3048 : 0.3048);
+      surfaceOut = same ? 1 : (toMetric ? 0.3048 : 1 / 0.3048);
+    }
   };
+
+
+  typedef MachineUnitAdapterStage<MachineAdapter> MachineUnitAdapter;
 }
@@ -23,28 +23,120 @@
 
 #include "MachineAdapter.h"
 
+#include <gcode/Move.h>
 #include <gcode/MoveStream.h>
 
 #include <cbang/config/Options.h>
+#include <cbang/log/Logger.h>
+
+#include <cmath>
 
 
 namespace GCode {
-  class MoveSink : public MachineAdapter {
+  template <typename Base>
+  class MoveSinkStage : public Base {
     MoveStream &stream;
 
     bool probePending;
     double time;
 
   public:
-    MoveSink(MoveStream &stream);
+    typedef MachineEnum::input_mode_t input_mode_t;
+    typedef MachineEnum::plane_t plane_t;
+
+    MoveSinkStage(MoveStream &stream) : stream(stream) {}
+
+    bool getProbePending() const {return probePending;}
+    void setProbePending(bool probePending)
+    {this->probePending = probePending;}
+    double getTime() const {return time;}
+    void setTime(double time) {this->time = time;}
 
     // From MachineInterface
-    void reset();
-    double input(unsigned port, input_mode_t mode, double timeout, bool error);
+    void reset() {
+      Base::reset();
+      probePending = false;
+      time = 0;
+    }
+
+
+    double input(unsigned port, input_mode_t mode, double timeout,
+                 bool error) {
+      if (mode != MachineEnum::IMMEDIATE) probePending = true;
+      return Base::input(port, mode, timeout, error);
+    }
+
 
     void move(const Axes &axes, bool rapid);
-    void arc(const cb::Vector3D &offset, double degrees, plane_t plane);
+    void arc(const cb::Vector3D &offset, double angle, plane_t plane);
   };
-}
 
 
+  template <typename Base>
+  void MoveSinkStage<Base>::move(const Axes &axes, bool rapid) {
+    Axes position = Base::getPosition();
+
+    if (position != axes) {
+      MoveType type = rapid ? Move::MOVE_RAPID :
+        (probePending ? Move::MOVE_PROBE : Move::MOVE_CUTTING);
+
+      if (Base::getTool() < 0 && !rapid) {
+        LOG_WARNING("Cutting move but no tool selected, selecting tool 1");
+        Base::setTool(1);
+      }
+
+      Move move(type, position, axes, time, Base::getTool(),
+                Base::getFeed(), Base::getSpeed(),
+                Base::getLocation().getStart().getLine());
+
+      time += move.getTime();
+
+      stream.move(move);
+
+      probePending = false;
+    }
+
+    Base::move(axes, rapid);
+  }
+
+
+  template <typename Base> void MoveSinkStage<Base>::
+  arc(const cb::Vector3D &offset, double angle, plane_t plane) {
+    // Only XY arcs are passed through, see MachineLinearizer
+    if (plane != MachineEnum::XY) THROWS("Invalid arc plane: " << plane);
+
+    Axes position = Base::getPosition();
+    cb::Vector2D center(position.getX() + offset.x(),
+                        position.getY() + offset.y());
+
+    // End point, positive angles are clockwise
+    double radius = cb::Vector2D(offset.x(), offset.y()).length();
+    double endAngle = atan2(-offset.y(), -offset.x()) - angle;
+
+    Axes end(position);
+    end.setX(center.x() + radius * cos(endAngle));
+    end.setY(center.y() + radius * sin(endAngle));
+    end.setZ(position.getZ() + offset.z());
+
+    if (Base::getTool() < 0) {
+      LOG_WARNING("Cutting move but no tool selected, selecting tool 1");
+      Base::setTool(1);
+    }
+
+    Move move(probePending ? Move::MOVE_PROBE : Move::MOVE_CUTTING,
+              position, end, time, Base::getTool(), Base::getFeed(),
+              Base::getSpeed(), Base::getLocation().getStart().getLine());
+    move.setArc(center, angle);
+
+    time += move.getTime();
+
+    stream.move(move);
+
+    probePending = false;
+
+    Base::move(end, false);
+  }
+
+
+  typedef MoveSinkStage<MachineAdapter> MoveSink;
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "MachineAdapter.h"
+
+
+namespace GCode {
+  /***
+   * A MachineAdapter whose parent is known to be a @param Next.  Calls are
+   * forwarded to it directly, without virtual dispatch, so a pipeline of
+   * stages built on StaticAdapters inlines in to a single call chain.  The
+   * parent must be set to a @param Next.
+   */
+  template <typename Next>
+  class StaticAdapter : public MachineAdapter {
+  public:
+    Next &getNext() const {return *static_cast<Next *>(getParent().get());}
+
+    // From MachineInterface
+    void reset() {getNext().Next::reset();}
+    void start() {getNext().Next::start();}
+    void end() {getNext().Next::end();}
+
+    double getFeed(feed_mode_t *mode = 0) const
+    {return getNext().Next::getFeed(mode);}
+    void setFeed(double feed, feed_mode_t mode = MM_PER_MINUTE)
+    {getNext().Next::setFeed(feed, mode);}
+
+    double getSpeed(spin_mode_t *mode = 0, double *max = 0) const
+    {return getNext().Next::getSpeed(mode, max);}
+    void setSpeed(double speed, spin_mode_t mode = REVOLUTIONS_PER_MINUTE,
+                  double max = 0) {getNext().Next::setSpeed(speed, mode, max);}
+
+    int getTool() const {return getNext().Next::getTool();}
+    void setTool(unsigned tool) {getNext().Next::setTool(tool);}
+
+    int findPort(port_t type, unsigned index = 0)
+    {return getNext().Next::findPort(type, index);}
+    double input(unsigned port, input_mode_t mode = IMMEDIATE,
+                 double timeout = 0, bool error = false)
+    {return getNext().Next::input(port, mode, timeout, error);}
+    void output(unsigned port, double value, bool sync = true)
+    {getNext().Next::output(port, value, sync);}
+
+    Axes getPosition() const {return getNext().Next::getPosition();}
+    cb::Vector3D getPosition(axes_t axes) const
+    {return getNext().Next::getPosition(axes);}
+
+    void dwell(double seconds) {getNext().Next::dwell(seconds);}
+    void move(const Axes &axes, bool rapid = false)
+    {getNext().Next::move(axes, rapid);}
+    void arc(const cb::Vector3D &offset, double angle, plane_t plane = XY)
+    {getNext().Next::arc(offset, angle, plane);}
+
+    const cb::Matrix4x4D &getMatrix(axes_t matrix) const
+    {return getNext().Next::getMatrix(matrix);}
+    void setMatrix(const cb::Matrix4x4D &m, axes_t matrix)
+    {getNext().Next::setMatrix(m, matrix);}
+
+    void pause(bool optional = true) {getNext().Next::pause(optional);}
+    bool synchronize(double timeout = 0)
+    {return getNext().Next::synchronize(timeout);}
+    void abort() {getNext().Next::abort();}
+
+    async_error_t readAsyncError() {return getNext().Next::readAsyncError();}
+    void clearAsyncErrors() {getNext().Next::clearAsyncErrors();}
+
+    const cb::LocationRange &getLocation() const
+    {return getNext().Next::getLocation();}
+    void setLocation(const cb::LocationRange &location)
+    {getNext().Next::setLocation(location);}
+
+    void comment(const std::string &s) const {getNext().Next::comment(s);}
+  };
+}
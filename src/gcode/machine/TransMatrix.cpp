@@ -33,6 +33,7 @@ void TransMatrix::setMatrix(const Matrix4x4D &m) {
   this->m = m;
   i = m;
   i.inverse();
+  updateType();
 }
 
 
@@ -40,12 +41,14 @@ void TransMatrix::setInverse(const Matrix4x4D &i) {
   this->i = i;
   m = i;
   m.inverse();
+  updateType();
 }
 
 
 void TransMatrix::identity() {
   m.toIdentity();
   i.toIdentity();
+  type = IDENTITY;
 }
 
 
@@ -64,6 +67,7 @@ void TransMatrix::scale(const cb::Vector3D &o) {
     t[j][j] = 1.0 / o[j];
 
   i = i * t;
+  type = GENERAL;
 }
 
 
@@ -82,6 +86,7 @@ void TransMatrix::translate(const cb::Vector3D &o) {
     t[j][3] = -o[j];
 
   i = t * i;
+  if (type == IDENTITY && (o[0] || o[1] || o[2])) type = TRANSLATION;
 }
 
 
@@ -135,6 +140,7 @@ void TransMatrix::rotate(double angle, const cb::Vector3D &_v, const cb::Vector3
   m = t * m;
   makeRotationMatrix(t, -angle, v, u);
   i = i * t;
+  type = GENERAL;
 }
 
 
@@ -153,14 +159,24 @@ void TransMatrix::reflect(const cb::Vector3D &_o) {
 
   m = t * m;
   i = i * t;
+  type = GENERAL;
 }
 
 
-cb::Vector3D TransMatrix::transform(const cb::Vector3D &p) const {
-  return (m * Vector4D(p, 1)).slice<3>();
+TransMatrix::type_t TransMatrix::classify(const Matrix4x4D &m) {
+  type_t type = IDENTITY;
+
+  for (unsigned row = 0; row < 4; row++)
+    for (unsigned col = 0; col < 4; col++)
+      if (col == 3 && row < 3) {
+        if (m[row][col]) type = TRANSLATION;
+
+      } else if (m[row][col] != (row == col ? 1 : 0)) return GENERAL;
+
+  return type;
 }
 
 
-cb::Vector3D TransMatrix::invert(const cb::Vector3D &p) const {
-  return (i * Vector4D(p, 1)).slice<3>();
+void TransMatrix::updateType() {
+  type = classify(m);
 }
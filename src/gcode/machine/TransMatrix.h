@@ -26,12 +26,21 @@
 
 namespace GCode {
   class TransMatrix {
+  public:
+    typedef enum {IDENTITY, TRANSLATION, GENERAL} type_t;
+
+  private:
     cb::Matrix4x4D m;
     cb::Matrix4x4D i;
+    type_t type;
 
   public:
     TransMatrix();
 
+    /// @return IDENTITY or TRANSLATION if the matrix is known to be one.
+    type_t getType() const {return type;}
+    bool isIdentity() const {return type == IDENTITY;}
+
     const cb::Matrix4x4D &getMatrix() const {return m;}
     void setMatrix(const cb::Matrix4x4D &m);
 
@@ -44,8 +53,21 @@ namespace GCode {
     void rotate(double angle, const cb::Vector3D &o, const cb::Vector3D &u);
     void reflect(const cb::Vector3D &o);
 
-    cb::Vector3D transform(const cb::Vector3D &p) const;
-    cb::Vector3D invert(const cb::Vector3D &p) const;
+    cb::Vector3D transform(const cb::Vector3D &p) const
+    {return type == IDENTITY ? p : apply(m, p);}
+    cb::Vector3D invert(const cb::Vector3D &p) const
+    {return type == IDENTITY ? p : apply(i, p);}
+
+    static type_t classify(const cb::Matrix4x4D &m);
+
+  protected:
+    void updateType();
+
+    cb::Vector3D apply(const cb::Matrix4x4D &t, const cb::Vector3D &p) const {
+      if (type == TRANSLATION)
+        return cb::Vector3D(p[0] + t[0][3], p[1] + t[1][3], p[2] + t[2][3]);
+      return (t * cb::Vector4D(p, 1)).slice<3>();
+    }
   };
 }
 
@@ -0,0 +1,259 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "ChunkParser.h"
+
+#include "Parser.h"
+#include "Tokenizer.h"
+
+#include <cbang/Exception.h>
+#include <cbang/os/Thread.h>
+#include <cbang/log/Logger.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+namespace {
+  // How far to look for the end of a comment when splitting
+  const unsigned maxCommentLength = 4096;
+}
+
+
+class ChunkParser::Chunk : public Thread, public Processor {
+public:
+  struct Entry {
+    SmartPointer<Block> block; // Null for SimpleBlocks
+    bool deleted;
+    int line;
+    unsigned first;
+    unsigned count;
+    int64_t startLine;
+    int64_t startCol;
+    int64_t endLine;
+    int64_t endCol;
+  };
+
+  const char *begin;
+  const char *end;
+  const string &filename;
+  int64_t line;
+
+  const Interrupter &interrupter;
+  Parser parser;
+  bool failed;
+
+  vector<Entry> entries;
+  vector<SimpleBlock::Word> words;
+
+
+  Chunk(const char *begin, const char *end, const string &filename,
+        int64_t line, const Interrupter &interrupter) :
+    begin(begin), end(end), filename(filename), line(line),
+    interrupter(interrupter), failed(false) {}
+
+
+  // From Processor
+  void operator()(const SmartPointer<Block> &block) {
+    Entry entry;
+    entry.block = block;
+    entries.push_back(entry);
+  }
+
+
+  bool wantsSimpleBlocks() const {return true;}
+
+
+  void operator()(const SimpleBlock &block) {
+    const LocationRange &location = block.getLocation();
+    Entry entry = {
+      0, block.isDeleted(), block.getUserLine(), (unsigned)words.size(),
+      block.size(), location.getStart().getLine(),
+      location.getStart().getCol(), location.getEnd().getLine(),
+      location.getEnd().getCol()};
+
+    entries.push_back(entry);
+    for (unsigned i = 0; i < block.size(); i++) words.push_back(block[i]);
+  }
+
+
+  // From Thread
+  void run() {
+    // Errors are reported when the chunk is parsed again in order
+    try {
+      Tokenizer tokenizer(begin, end - begin, filename, line);
+      while (!interrupter.interrupt() && parser.parseOne(tokenizer, *this))
+        continue;
+
+    } catch (...) {
+      failed = true;
+    }
+  }
+};
+
+
+ChunkParser::ChunkParser(const char *data, uint64_t length,
+                         const string &filename, unsigned threads,
+                         unsigned maxErrors, uint64_t chunkSize) :
+  data(data), length(length), filename(filename),
+  threads(threads ? threads : 1), maxErrors(maxErrors),
+  chunkSize(chunkSize), next(0), line(0), offset(0), quit(false),
+  errors(0) {}
+
+
+ChunkParser::~ChunkParser() {
+  quit = true;
+  for (unsigned i = 0; i < parsing.size(); i++) parsing[i]->join();
+}
+
+
+void ChunkParser::start() {
+  if (!next) startRound();
+}
+
+
+void ChunkParser::process(Processor &processor,
+                          const SmartPointer<Interrupter> &interrupter) {
+  start();
+
+  while (!parsing.empty()) {
+    vector<SmartPointer<Chunk> > round;
+    round.swap(parsing);
+
+    for (unsigned i = 0; i < round.size(); i++) round[i]->join();
+
+    // Parse ahead while this round is processed
+    startRound();
+
+    for (unsigned i = 0; i < round.size() && !quit; i++) {
+      offset = round[i]->begin - data;
+
+      try {
+        process(*round[i], processor, interrupter);
+      } catch (...) {
+        quit = true; // The destructor joins the running chunks
+        throw;
+      }
+
+      round[i].release(); // Free the blocks
+    }
+
+    if (quit) break;
+  }
+
+  offset = length;
+}
+
+
+const char *ChunkParser::findSplit(const char *ptr) const {
+  const char *end = data + length;
+
+  while (ptr < end) {
+    const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+    if (!eol) break;
+    ptr = eol + 1;
+
+    // Do not split a comment that spans lines.  A ')' before any '(' is
+    // taken to mean one is open.
+    const char *limit = min(end, ptr + maxCommentLength);
+    const char *paren = ptr;
+    while (paren < limit && *paren != '(' && *paren != ')') paren++;
+
+    if (paren == limit || *paren == '(') return ptr;
+  }
+
+  return end;
+}
+
+
+void ChunkParser::startRound() {
+  for (unsigned i = 0; i < threads && next < length; i++) {
+    const char *begin = data + next;
+    const char *end = findSplit(begin + min(chunkSize, length - next));
+
+    SmartPointer<Chunk> chunk = new Chunk(begin, end, filename, line, *this);
+    chunk->start();
+    parsing.push_back(chunk);
+
+    line += count(begin, end, '\n');
+    next = end - data;
+  }
+}
+
+
+void ChunkParser::process(Chunk &chunk, Processor &processor,
+                          const SmartPointer<Interrupter> &interrupter) {
+  if (chunk.failed) {
+    // Parse again in order, reporting errors as they are found
+    Tokenizer tokenizer(chunk.begin, chunk.end - chunk.begin, filename,
+                        chunk.line);
+    Parser parser(interrupter);
+
+    parser.parse(tokenizer, processor,
+                 errors < maxErrors ? maxErrors - errors : 0);
+    errors += parser.getErrorCount();
+
+    return;
+  }
+
+  for (unsigned i = 0; i < chunk.entries.size(); i++) {
+    if (interrupter->interrupt()) {
+      quit = true;
+      return;
+    }
+
+    const Chunk::Entry &entry = chunk.entries[i];
+    SmartPointer<Block> block = entry.block;
+
+    try {
+      if (block.isNull()) {
+        simple.clear();
+        simple.setDeleted(entry.deleted);
+        simple.setUserLine(entry.line);
+
+        for (unsigned j = 0; j < entry.count; j++) {
+          const SimpleBlock::Word &word = chunk.words[entry.first + j];
+          simple.add(word.type, word.value, word.col);
+        }
+
+        LocationRange &location = simple.getLocation();
+        location.getStart() =
+          FileLocation(filename, entry.startLine, entry.startCol);
+        location.getEnd() = FileLocation(filename, entry.endLine, entry.endCol);
+
+        if (processor.wantsSimpleBlocks()) processor(simple);
+        else processor(simple.toBlock());
+
+      } else processor(block);
+
+    } catch (const Exception &e) {
+      const LocationRange &location =
+        block.isNull() ? simple.getLocation() : block->getLocation();
+
+      LOG_ERROR(location << ":" << e.getMessage());
+      LOG_DEBUG(3, e);
+
+      if (maxErrors < ++errors) THROW("Too many errors aborting");
+    }
+  }
+}
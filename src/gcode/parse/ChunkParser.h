@@ -0,0 +1,89 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include <gcode/Processor.h>
+#include <gcode/Interrupter.h>
+#include <gcode/ast/SimpleBlock.h>
+
+#include <cbang/SmartPointer.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+namespace GCode {
+  /***
+   * Splits GCode held in memory at line boundaries and parses the pieces
+   * in parallel.  Parsing does not depend on what came before, so only
+   * process() has to run in order.  Each round of chunks is parsed while
+   * the previous round is being processed.
+   */
+  class ChunkParser : public Interrupter {
+    class Chunk;
+
+    const char *data;
+    uint64_t length;
+    std::string filename;
+    unsigned threads;
+    unsigned maxErrors;
+    uint64_t chunkSize;
+
+    std::vector<cb::SmartPointer<Chunk> > parsing;
+    uint64_t next;   // Start of the next chunk to parse
+    int64_t line;    // Line at next
+    uint64_t offset; // Start of the chunk being processed
+    std::atomic<bool> quit;
+
+    unsigned errors;
+    SimpleBlock simple;
+
+  public:
+    /// @param data must stay valid while the ChunkParser is used.
+    ChunkParser(const char *data, uint64_t length,
+                const std::string &filename, unsigned threads,
+                unsigned maxErrors = 32, uint64_t chunkSize = 1 << 20);
+    ~ChunkParser();
+
+    /// @return the number of bytes processed so far.
+    uint64_t getOffset() const {return offset;}
+    uint64_t getLength() const {return length;}
+    unsigned getErrorCount() const {return errors;}
+
+    /// Start parsing the first round of chunks before process() is called.
+    void start();
+
+    /// Pass all blocks to @param processor, in order, in this thread.
+    /// @param interrupter is also only called from this thread.
+    void process(Processor &processor,
+                 const cb::SmartPointer<Interrupter> &interrupter);
+
+    // From Interrupter
+    bool interrupt() const {return quit;}
+
+  protected:
+    const char *findSplit(const char *ptr) const;
+    void startRound();
+    void process(Chunk &chunk, Processor &processor,
+                 const cb::SmartPointer<Interrupter> &interrupter);
+  };
+}
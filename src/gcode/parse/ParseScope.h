@@ -0,0 +1,43 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include "Tokenizer.h"
+
+
+namespace GCode {
+  /// Sets the location of a parsed entity to span from the token current
+  /// when the scope was created to the last one consumed.
+  class ParseScope {
+    Tokenizer &tokenizer;
+    cb::FileLocation start;
+
+  public:
+    ParseScope(Tokenizer &tokenizer) :
+      tokenizer(tokenizer), start(tokenizer.getLocation().getStart()) {}
+
+    void set(cb::LocationRange &location) const
+    {location = cb::LocationRange(start, tokenizer.getLastEnd());}
+
+    template <typename T>
+    T *set(T *entity) const {set(entity->getLocation()); return entity;}
+  };
+}
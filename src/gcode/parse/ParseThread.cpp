@@ -0,0 +1,164 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#include "ParseThread.h"
+
+#include <cbang/log/Logger.h>
+
+using namespace std;
+using namespace cb;
+using namespace GCode;
+
+
+ParseThread::ParseThread(Tokenizer &tokenizer,
+                         const SmartPointer<Interrupter> &interrupter,
+                         unsigned maxErrors, unsigned size) :
+  tokenizer(tokenizer), interrupter(interrupter),
+  parser(SmartPointer<Interrupter>::Phony(this)), maxErrors(maxErrors),
+  ring(size), head(0), tail(0), pending(0), done(false), quit(false),
+  parserWaiting(false), processWaiting(false), errors(0) {}
+
+
+ParseThread::~ParseThread() {
+  quit = true;
+  wake(parserWaiting);
+  join();
+}
+
+
+void ParseThread::process(Processor &processor) {
+  while (true) {
+    uint64_t i = head;
+
+    if (i == tail) {
+      if (done) {
+        if (i == tail) break;
+        continue;
+      }
+
+      // Wait for the parser
+      lock();
+      processWaiting = true;
+      if (i == tail && !done) timedWait(0.01);
+      processWaiting = false;
+      unlock();
+      continue;
+    }
+
+    Entry &entry = ring[i % ring.size()];
+
+    try {
+      if (!entry.block.isNull()) processor(entry.block);
+      else if (processor.wantsSimpleBlocks()) processor(entry.simple);
+      else processor(entry.simple.toBlock());
+
+    } catch (const Exception &e) {
+      const LocationRange &location = entry.block.isNull() ?
+        entry.simple.getLocation() : entry.block->getLocation();
+
+      LOG_ERROR(location << ":" << e.getMessage());
+      LOG_DEBUG(3, e);
+
+      if (maxErrors < ++errors) {
+        quit = true;
+        THROW("Too many errors aborting");
+      }
+
+    } catch (...) {
+      quit = true; // Stop parsing, the destructor joins the thread
+      throw;
+    }
+
+    entry.block.release();
+    head = i + 1;
+    wake(parserWaiting);
+  }
+
+  if (!error.isNull()) throw *error;
+}
+
+
+void ParseThread::operator()(const SmartPointer<Block> &block) {
+  Entry *entry = next();
+  if (entry) entry->block = block;
+}
+
+
+void ParseThread::operator()(const SimpleBlock &block) {
+  Entry *entry = next();
+  if (entry) entry->simple = block;
+}
+
+
+ParseThread::Entry *ParseThread::next() {
+  // The previous entry is only published now that the parser has dropped
+  // its reference to the Block, so the two threads never both change the
+  // reference count.
+  publish();
+
+  // Wait for space
+  while (tail - head == ring.size()) {
+    if (quit) return 0;
+
+    lock();
+    parserWaiting = true;
+    if (tail - head == ring.size() && !quit) timedWait(0.01);
+    parserWaiting = false;
+    unlock();
+  }
+
+  pending = 1;
+
+  return &ring[tail % ring.size()];
+}
+
+
+void ParseThread::publish() {
+  if (!pending) return;
+
+  pending = 0;
+  tail++;
+  wake(processWaiting);
+}
+
+
+void ParseThread::wake(const atomic<bool> &waiting) {
+  if (!waiting) return;
+
+  lock();
+  broadcast();
+  unlock();
+}
+
+
+void ParseThread::run() {
+  try {
+    parser.parse(tokenizer, *this, maxErrors);
+
+  } catch (const Exception &e) {
+    error = new Exception(e);
+
+  } catch (const std::exception &e) {
+    error = new Exception(e.what());
+  }
+
+  publish();
+  done = true;
+  wake(processWaiting);
+}
@@ -0,0 +1,98 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+
+#include <gcode/Processor.h>
+#include <gcode/Interrupter.h>
+
+#include "Parser.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/Exception.h>
+#include <cbang/os/Thread.h>
+#include <cbang/os/Condition.h>
+
+#include <atomic>
+#include <vector>
+
+
+namespace GCode {
+  class Tokenizer;
+
+  /***
+   * Parses in its own thread, passing blocks through a single producer,
+   * single consumer ring to the thread calling process(), so tokenizing
+   * and parsing overlap with interpreting.
+   */
+  class ParseThread :
+    public cb::Thread, public Processor, public Interrupter,
+    public cb::Condition {
+    struct Entry {
+      cb::SmartPointer<Block> block; // Null for SimpleBlocks
+      SimpleBlock simple;
+    };
+
+    Tokenizer &tokenizer;
+    cb::SmartPointer<Interrupter> interrupter;
+    Parser parser;
+    unsigned maxErrors;
+
+    std::vector<Entry> ring;
+    std::atomic<uint64_t> head; // Next to process
+    std::atomic<uint64_t> tail; // Next to fill
+    uint64_t pending;
+    std::atomic<bool> done;
+    std::atomic<bool> quit;
+    std::atomic<bool> parserWaiting;
+    std::atomic<bool> processWaiting;
+
+    unsigned errors;
+    cb::SmartPointer<cb::Exception> error;
+
+  public:
+    ParseThread(Tokenizer &tokenizer,
+                const cb::SmartPointer<Interrupter> &interrupter,
+                unsigned maxErrors = 32, unsigned size = 1024);
+    ~ParseThread();
+
+    /// Parse and interpret errors.  Only valid after process() returns.
+    unsigned getErrorCount() {return errors + parser.getErrorCount();}
+
+    /// Pass all parsed blocks to @param processor, in this thread.
+    void process(Processor &processor);
+
+    // From Processor
+    void operator()(const cb::SmartPointer<Block> &block);
+    bool wantsSimpleBlocks() const {return true;}
+    void operator()(const SimpleBlock &block);
+
+    // From Interrupter
+    bool interrupt() const {return quit || interrupter->interrupt();}
+
+  protected:
+    Entry *next();
+    void publish();
+    void wake(const std::atomic<bool> &waiting);
+
+    // From cb::Thread
+    void run();
+  };
+}
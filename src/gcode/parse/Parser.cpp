@@ -21,17 +21,18 @@
 #include "Parser.h"
 
 #include "Tokenizer.h"
+#include "ParseScope.h"
 
 #include <gcode/ast/UnaryOp.h>
 #include <gcode/ast/BinaryOp.h>
 #include <gcode/ast/QuotedExpr.h>
 #include <gcode/ast/Reference.h>
 #include <gcode/ast/NamedReference.h>
+#include <gcode/ast/FoldedExpr.h>
 
 #include <cbang/String.h>
 #include <cbang/Exception.h>
 #include <cbang/os/SystemUtilities.h>
-#include <cbang/parse/ParseScope.h>
 #include <cbang/util/DefaultCatch.h>
 
 #include <fstream>
@@ -42,6 +43,80 @@ using namespace cb;
 using namespace GCode;
 
 
+namespace {
+  // Leaves errors to be reported when the expression is evaluated
+  class FoldEvaluator : public Evaluator {
+  public:
+    // From Evaluator
+    double eval(BinaryOp &e) {
+      if ((e.getType() == Operator::DIV_OP ||
+           e.getType() == Operator::MOD_OP) && !e.getRight()->eval(*this))
+        THROW("Divide by zero");
+
+      return Evaluator::eval(e);
+    }
+  };
+
+
+  bool simpleWords(GCode::Tokenizer &tokenizer, SimpleBlock &block) {
+    block.clear();
+
+    // Deleted
+    if (tokenizer.consume(TokenType::DIV_TOKEN)) block.setDeleted(true);
+
+    // Line number
+    if (tokenizer.isID("N")) {
+      tokenizer.advance();
+      if (!tokenizer.isType(TokenType::NUMBER_TOKEN)) return false;
+      block.setUserLine(String::parseU32(tokenizer.getValue()));
+      tokenizer.advance();
+    }
+
+    while (tokenizer.hasMore()) {
+      switch (tokenizer.getType()) {
+      case TokenType::EOL_TOKEN: break; // End of block
+
+      case TokenType::COMMENT_TOKEN:
+      case TokenType::PAREN_COMMENT_TOKEN:
+        tokenizer.advance(); // Comments are not interpreted
+        break;
+
+      case TokenType::ID_TOKEN: {
+        // O-codes and invalid words need the full AST
+        const string &name = tokenizer.getValue();
+        if (name.length() != 1 || toupper(name[0]) == 'O') return false;
+
+        char type = toupper(name[0]);
+        int col = tokenizer.getLocation().getStart().getCol();
+        tokenizer.advance();
+
+        // Optional sign and a number
+        bool negative = tokenizer.isType(TokenType::SUB_TOKEN);
+        if (negative || tokenizer.isType(TokenType::ADD_TOKEN))
+          tokenizer.advance();
+
+        if (!tokenizer.isType(TokenType::NUMBER_TOKEN)) return false;
+        double value = String::parseDouble(tokenizer.getValue());
+        tokenizer.advance();
+
+        if (!block.add(type, negative ? -value : value, col)) return false;
+        break;
+      }
+
+      default: return false; // Assignments and expressions
+      }
+
+      if (tokenizer.getType() == TokenType::EOL_TOKEN) {
+        tokenizer.advance();
+        break;
+      }
+    }
+
+    return true;
+  }
+}
+
+
 void Parser::parse(GCode::Tokenizer &tokenizer, Processor &processor,
                    unsigned maxErrors) {
   while (!interrupter->interrupt()) {
@@ -59,8 +134,7 @@ void Parser::parse(GCode::Tokenizer &tokenizer, Processor &processor,
 
 void Parser::parse(const InputSource &source, Processor &processor,
                    unsigned maxErrors) {
-  Scanner scanner(source);
-  GCode::Tokenizer tokenizer(scanner);
+  GCode::Tokenizer tokenizer(source);
 
   parse(tokenizer, processor, maxErrors);
 }
@@ -68,13 +142,31 @@ void Parser::parse(const InputSource &source, Processor &processor,
 
 bool Parser::parseOne(GCode::Tokenizer &tokenizer, Processor &processor) {
   if (!tokenizer.hasMore()) return false;
-  processor(block(tokenizer));
+
+  if (processor.wantsSimpleBlocks() && simpleBlock(tokenizer, simple))
+    processor(simple);
+  else processor(block(tokenizer));
+
   return true;
 }
 
 
+bool Parser::simpleBlock(GCode::Tokenizer &tokenizer, SimpleBlock &block) {
+  GCode::Tokenizer::Mark mark = tokenizer.getMark();
+  FileLocation start = tokenizer.getLocation().getStart();
+
+  if (simpleWords(tokenizer, block)) {
+    block.getLocation() = LocationRange(start, tokenizer.getLastEnd());
+    return true;
+  }
+
+  tokenizer.rewind(mark);
+  return false;
+}
+
+
 SmartPointer<Block> Parser::block(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   // Deleted
   bool deleted = false;
@@ -126,7 +218,7 @@ SmartPointer<Block> Parser::block(GCode::Tokenizer &tokenizer) {
 
 
 SmartPointer<Comment> Parser::comment(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   Token token;
   bool paren = tokenizer.getType() == TokenType::PAREN_COMMENT_TOKEN;
@@ -139,7 +231,7 @@ SmartPointer<Comment> Parser::comment(GCode::Tokenizer &tokenizer) {
 
 
 SmartPointer<Word> Parser::word(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   string name = tokenizer.match(TokenType::ID_TOKEN).getValue();
   if (name.length() != 1) THROWS("Invalid word '" << name << "'");
@@ -149,7 +241,7 @@ SmartPointer<Word> Parser::word(GCode::Tokenizer &tokenizer) {
 
 
 SmartPointer<Assign> Parser::assign(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   SmartPointer<Entity> ref = reference(tokenizer);
   tokenizer.match(TokenType::ASSIGN_TOKEN);
@@ -159,7 +251,7 @@ SmartPointer<Assign> Parser::assign(GCode::Tokenizer &tokenizer) {
 
 
 SmartPointer<OCode> Parser::ocode(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   tokenizer.match(TokenType::ID_TOKEN); // The 'O'
 
@@ -220,7 +312,7 @@ SmartPointer<Entity> Parser::boolOp(GCode::Tokenizer &tokenizer) {
 
       if (op != Operator::NO_OP) {
         tokenizer.advance();
-        entity = new BinaryOp(op, entity, compareOp(tokenizer));
+        entity = fold(new BinaryOp(op, entity, compareOp(tokenizer)));
       }
     }
     break;
@@ -247,7 +339,7 @@ SmartPointer<Entity> Parser::compareOp(GCode::Tokenizer &tokenizer) {
 
       if (op != Operator::NO_OP) {
         tokenizer.advance();
-        entity = new BinaryOp(op, entity, addOp(tokenizer));
+        entity = fold(new BinaryOp(op, entity, addOp(tokenizer)));
         continue;
       }
     }
@@ -271,7 +363,7 @@ SmartPointer<Entity> Parser::addOp(GCode::Tokenizer &tokenizer) {
 
     if (op != Operator::NO_OP) {
       tokenizer.advance();
-      entity = new BinaryOp(op, entity, mulOp(tokenizer));
+      entity = fold(new BinaryOp(op, entity, mulOp(tokenizer)));
 
     } else break;
   }
@@ -297,7 +389,7 @@ SmartPointer<Entity> Parser::mulOp(GCode::Tokenizer &tokenizer) {
 
     if (op != Operator::NO_OP) {
       tokenizer.advance();
-      entity = new BinaryOp(op, entity, expOp(tokenizer));
+      entity = fold(new BinaryOp(op, entity, expOp(tokenizer)));
 
     } else break;
   }
@@ -311,7 +403,8 @@ SmartPointer<Entity> Parser::expOp(GCode::Tokenizer &tokenizer) {
 
   while (true) {
     if (tokenizer.consume(TokenType::EXP_TOKEN))
-      entity = new BinaryOp(Operator::EXP_OP, entity, primary(tokenizer));
+      entity =
+        fold(new BinaryOp(Operator::EXP_OP, entity, primary(tokenizer)));
     else break;
   }
 
@@ -330,32 +423,32 @@ SmartPointer<Entity> Parser::unaryOp(GCode::Tokenizer &tokenizer) {
 
   tokenizer.advance();
 
-  return new UnaryOp(op, numberRefOrExpr(tokenizer));
+  return fold(new UnaryOp(op, numberRefOrExpr(tokenizer)));
 }
 
 
 SmartPointer<Entity> Parser::primary(GCode::Tokenizer &tokenizer) {
   switch (tokenizer.getType()) {
-  case TokenType::ID_TOKEN: return functionCall(tokenizer);
+  case TokenType::ID_TOKEN: return fold(functionCall(tokenizer));
   default: return numberRefOrExpr(tokenizer);
   }
 }
 
 
 SmartPointer<Entity> Parser::quotedExpr(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   tokenizer.match(TokenType::OBRACKET_TOKEN);
   SmartPointer<Entity> expr = expression(tokenizer);
   tokenizer.match(TokenType::CBRACKET_TOKEN);
 
-  return scope.set(new QuotedExpr(expr));
+  return fold(scope.set(new QuotedExpr(expr)));
 }
 
 
 SmartPointer<FunctionCall>
 Parser::functionCall(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
   string name = tokenizer.match(TokenType::ID_TOKEN).getValue();
   SmartPointer<Entity> arg1 = quotedExpr(tokenizer);
   SmartPointer<Entity> arg2;
@@ -370,7 +463,7 @@ Parser::functionCall(GCode::Tokenizer &tokenizer) {
 
 
 SmartPointer<Number> Parser::number(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
   double value =
     String::parseDouble(tokenizer.match(TokenType::NUMBER_TOKEN).getValue());
 
@@ -379,7 +472,7 @@ SmartPointer<Number> Parser::number(GCode::Tokenizer &tokenizer) {
 
 
 SmartPointer<Entity> Parser::reference(GCode::Tokenizer &tokenizer) {
-  ParseScope scope(tokenizer.getScanner());
+  ParseScope scope(tokenizer);
 
   tokenizer.match(TokenType::POUND_TOKEN);
 
@@ -392,3 +485,25 @@ SmartPointer<Entity> Parser::reference(GCode::Tokenizer &tokenizer) {
   } else
     return scope.set(new Reference(numberRefOrExpr(tokenizer)));
 }
+
+
+SmartPointer<Entity> Parser::fold(const SmartPointer<Entity> &entity) {
+  if (entity->instance<Number>() || entity->instance<FoldedExpr>())
+    return entity;
+
+  // Function calls are not constant, in case the name is unknown
+  FunctionCall *call = entity->instance<FunctionCall>();
+  if (call) {
+    if (!call->getArg1()->isConstant() ||
+        (!call->getArg2().isNull() && !call->getArg2()->isConstant()))
+      return entity;
+
+  } else if (!entity->isConstant()) return entity;
+
+  try {
+    FoldEvaluator evaluator;
+    return new FoldedExpr(entity, entity->eval(evaluator));
+  } catch (const Exception &e) {}
+
+  return entity;
+}
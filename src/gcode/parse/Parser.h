@@ -24,6 +24,7 @@
 #include <gcode/NullInterrupter.h>
 
 #include <gcode/ast/Block.h>
+#include <gcode/ast/SimpleBlock.h>
 #include <gcode/ast/Comment.h>
 #include <gcode/ast/Word.h>
 #include <gcode/ast/Assign.h>
@@ -44,6 +45,7 @@ namespace GCode {
   class Parser {
     cb::SmartPointer<Interrupter> interrupter;
     unsigned errors;
+    SimpleBlock simple;
 
   public:
     Parser(const cb::SmartPointer<Interrupter> &interrupter =
@@ -60,6 +62,10 @@ namespace GCode {
 
     bool parseOne(Tokenizer &tokenizer, Processor &processor);
 
+    /// Parse a block of constant words only in to @param block.
+    /// @return false, with @param tokenizer back where it was, if the
+    /// block needs a full AST.
+    bool simpleBlock(Tokenizer &tokenizer, SimpleBlock &block);
     cb::SmartPointer<Block> block(Tokenizer &tokenizer);
 
     cb::SmartPointer<Comment> comment(Tokenizer &tokenizer);
@@ -83,5 +89,8 @@ namespace GCode {
     cb::SmartPointer<FunctionCall> functionCall(Tokenizer &tokenizer);
     cb::SmartPointer<Number> number(Tokenizer &tokenizer);
     cb::SmartPointer<Entity> reference(Tokenizer &tokenizer);
+
+    /// @return @param entity evaluated once, if it only has constants.
+    cb::SmartPointer<Entity> fold(const cb::SmartPointer<Entity> &entity);
   };
 }
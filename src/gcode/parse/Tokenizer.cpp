@@ -17,121 +17,238 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 \******************************************************************************/
-
 #include "Tokenizer.h"
 
 #include <cbang/Exception.h>
 #include <cbang/String.h>
 
+#include <algorithm>
 #include <cctype>
+#include <cstring>
 
 using namespace std;
 using namespace GCode;
 
 
 namespace {
-  int whiteSpace[] = {0x20, 0x09, 0x0d, 0xfeff, 0};
+  inline bool isWhiteSpace(char c) {return c == ' ' || c == '\t' || c == '\r';}
+  inline bool isDigit(char c) {return '0' <= c && c <= '9';}
+  inline bool isIDChar(char c) {return isalpha((unsigned char)c) || c == '_';}
+}
+
+
+Tokenizer::Tokenizer(const char *data, uint64_t length,
+                     const string &filename, int64_t line) :
+  begin(data), end(data + length), filename(filename) {
+  init(line);
+}
+
+
+Tokenizer::Tokenizer(const cb::InputSource &source) :
+  filename(source.getName()) {
+  istream &stream = source.getStream();
+
+  // Read in large blocks rather than character by character
+  const streamsize blockSize = 1 << 20;
+  if (0 < source.getLength()) data.reserve(source.getLength());
+
+  while (stream) {
+    size_t fill = data.size();
+    data.resize(fill + blockSize);
+    stream.read(&data[fill], blockSize);
+    data.resize(fill + stream.gcount());
+  }
+
+  begin = data.empty() ? 0 : &data[0];
+  end = begin + data.size();
+  init();
 }
 
 
 bool Tokenizer::isID(const string &id) const {
-  return isType(ID_TOKEN) &&
-    cb::String::toUpper(id) == cb::String::toUpper(getValue());
+  if (!isType(TokenType::ID_TOKEN)) return false;
+
+  const string &value = getValue();
+  if (value.length() != id.length()) return false;
+
+  for (unsigned i = 0; i < id.length(); i++)
+    if (toupper(value[i]) != toupper(id[i])) return false;
+
+  return true;
+}
+
+
+Token Tokenizer::advance() {
+  endLine = current.getLocation().getEnd().getLine();
+  endCol = current.getLocation().getEnd().getCol();
+
+  Token last = std::move(current);
+  next();
+  return last;
+}
+
+
+Token Tokenizer::match(TokenType::enum_t type) {
+  if (!isType(type))
+    THROWS("Expected " << TokenType(type) << ", found "
+           << TokenType(getType()));
+
+  return advance();
+}
+
+
+bool Tokenizer::consume(TokenType::enum_t type) {
+  if (!isType(type)) return false;
+  advance();
+  return true;
+}
+
+
+Tokenizer::Mark Tokenizer::getMark() const {
+  Mark mark = {tokenStart, tokenLine, tokenLineStart, endLine, endCol};
+  return mark;
+}
+
+
+void Tokenizer::rewind(const Mark &mark) {
+  ptr = mark.tokenStart;
+  line = mark.tokenLine;
+  lineStart = mark.tokenLineStart;
+  next();
+  endLine = mark.endLine;
+  endCol = mark.endCol;
+}
+
+
+void Tokenizer::init(int64_t line) {
+  ptr = lineStart = begin;
+  this->line = line;
+
+  // Skip UTF-8 byte order mark
+  if (3 <= end - begin && !memcmp(begin, "\xef\xbb\xbf", 3)) ptr += 3;
+
+  endLine = line;
+  endCol = ptr - lineStart;
+  next();
+}
+
+
+cb::FileLocation Tokenizer::getPosition() const {
+  return cb::FileLocation(filename, line, ptr - lineStart);
+}
+
+
+void Tokenizer::setLocation(int64_t startLine, int64_t startCol) {
+  // Assigned in place to avoid copying the file name more than needed
+  cb::LocationRange &location = current.getLocation();
+  location.getStart() = cb::FileLocation(filename, startLine, startCol);
+  location.getEnd() = getPosition();
+}
+
+
+void Tokenizer::skipWhiteSpace() {
+  while (ptr < end && isWhiteSpace(*ptr)) ptr++;
 }
 
 
 void Tokenizer::comment() {
-  scanner.match(';');
-  current.setType(COMMENT_TOKEN);
+  const char *start = ++ptr; // The ';'
 
-  string value;
-  while (scanner.hasMore() && scanner.peek() != '\n') {
-    if (scanner.peek() != '\r') value.append(1, scanner.peek());
-    scanner.advance();
-  }
+  const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+  ptr = eol ? eol : end;
+
+  string value(start, ptr);
+  if (value.find('\r') != string::npos)
+    value.erase(std::remove(value.begin(), value.end(), '\r'), value.end());
 
-  current.setValue(value);
+  current.set(TokenType::COMMENT_TOKEN, value);
 }
 
 
 void Tokenizer::parenComment() {
-  scanner.match('(');
-  current.setType(PAREN_COMMENT_TOKEN);
+  const char *start = ++ptr; // The '('
 
-  string value;
-  while (scanner.hasMore() && scanner.peek() != ')') {
-    value.append(1, scanner.peek());
-    scanner.advance();
+  const char *close = (const char *)memchr(ptr, ')', end - ptr);
+  const char *stop = close ? close : end;
+
+  // Comments rarely span lines, but locations must count them
+  const char *eol = ptr;
+  while ((eol = (const char *)memchr(eol, '\n', stop - eol))) {
+    line++;
+    lineStart = ++eol;
   }
 
-  scanner.match(')');
+  ptr = stop;
 
-  current.setValue(value);
+  current.set(TokenType::PAREN_COMMENT_TOKEN, string(start, ptr));
+
+  if (ptr == end) THROWS("Expected ')'");
+  ptr++;
 }
 
 
 void Tokenizer::number(bool positive) {
   string value;
   bool foundDot = false;
-  char c = scanner.peek();
 
+  // Spaces between digits are ignored
   do {
-    if (c == '.') {
-      if (foundDot) break; // Already found decimal point
-      foundDot = true;
-    }
+    const char *start = ptr;
 
-    value.append(string(1, c));
-
-    scanner.advance();
-    scanner.skipWhiteSpace(whiteSpace);
-    if (!scanner.hasMore()) break;
-    c = scanner.peek();
+    while (ptr < end && (isDigit(*ptr) || (!foundDot && *ptr == '.'))) {
+      if (*ptr == '.') foundDot = true;
+      ptr++;
+    }
 
-  } while (isdigit(c) || (!foundDot && c == '.'));
+    value.append(start, ptr);
+    skipWhiteSpace();
 
+  } while (ptr < end && (isDigit(*ptr) || (!foundDot && *ptr == '.')));
 
   if (foundDot && value.length() == 1)
     THROWS("Invalid decimal point, expected number");
 
-  if (!positive) value = string("-") + value;
+  if (!positive) value.insert(0, 1, '-');
 
-  current.set(NUMBER_TOKEN, value);
+  current.set(TokenType::NUMBER_TOKEN, value);
 }
 
 
 void Tokenizer::id() {
-  string value;
-
-  char c = scanner.peek();
-  while (isalpha(c) || c == '_') {
-    value.append(string(1, c));
-
-    scanner.advance();
-    if (!scanner.hasMore()) break;
-    c = scanner.peek();
-  }
-
-  current.set(ID_TOKEN, value);
+  const char *start = ptr;
+  while (ptr < end && isIDChar(*ptr)) ptr++;
+  current.set(TokenType::ID_TOKEN, string(start, ptr));
 }
 
 
 void Tokenizer::next() {
-  scanner.skipWhiteSpace(whiteSpace);
+  while (true) {
+    skipWhiteSpace();
+    if (ptr == end || *ptr != '%') break;
+    ptr++; // Ignore program delimiter
+  }
 
-  cb::FileLocation start = scanner.getLocation();
+  tokenStart = ptr;
+  tokenLine = line;
+  tokenLineStart = lineStart;
 
-  if (!scanner.hasMore()) {
-    current.set(EOF_TOKEN, "");
+  int64_t startLine = line;
+  int64_t startCol = ptr - lineStart;
+
+  if (ptr == end) {
+    current.set(TokenType::EOF_TOKEN, "");
+    setLocation(startLine, startCol);
     return;
   }
 
   bool needAdvance = true;
-  int c = scanner.peek();
+  char c = *ptr;
   switch (c) {
-  case 0: current.set(EOF_TOKEN, ""); return;
+  case 0:
+    current.set(TokenType::EOF_TOKEN, "");
+    needAdvance = false;
+    break;
 
-  case '%': break; // Ignore program delimiter
   case ';': comment(); needAdvance = false; break;
   case '(': parenComment(); needAdvance = false; break;
 
@@ -143,27 +260,30 @@ void Tokenizer::next() {
     break;
 
   case '*':
-    scanner.advance();
-    if (scanner.peek() == '*') current.set(EXP_TOKEN, "**");
-    else {
-      current.set(MUL_TOKEN, c);
-      needAdvance = false;
-    }
+    if (ptr + 1 < end && ptr[1] == '*') {
+      current.set(TokenType::EXP_TOKEN, "**");
+      ptr++;
+    } else current.set(TokenType::MUL_TOKEN, "*");
     break;
 
-  case '+': current.set(ADD_TOKEN, c); break;
-  case '-': current.set(SUB_TOKEN, c); break;
-  case '/': current.set(DIV_TOKEN, c); break;
-  case '[': current.set(OBRACKET_TOKEN, c); break;
-  case ']': current.set(CBRACKET_TOKEN, c); break;
-  case '<': current.set(OANGLE_TOKEN, c); break;
-  case '>': current.set(CANGLE_TOKEN, c); break;
-  case '=': current.set(ASSIGN_TOKEN, c); break;
-  case '#': current.set(POUND_TOKEN, c); break;
-  case '\n': current.set(EOL_TOKEN, c); break;
+  case '+': current.set(TokenType::ADD_TOKEN, "+"); break;
+  case '-': current.set(TokenType::SUB_TOKEN, "-"); break;
+  case '/': current.set(TokenType::DIV_TOKEN, "/"); break;
+  case '[': current.set(TokenType::OBRACKET_TOKEN, "["); break;
+  case ']': current.set(TokenType::CBRACKET_TOKEN, "]"); break;
+  case '<': current.set(TokenType::OANGLE_TOKEN, "<"); break;
+  case '>': current.set(TokenType::CANGLE_TOKEN, ">"); break;
+  case '=': current.set(TokenType::ASSIGN_TOKEN, "="); break;
+  case '#': current.set(TokenType::POUND_TOKEN, "#"); break;
+
+  case '\n':
+    current.set(TokenType::EOL_TOKEN, "\n");
+    line++;
+    lineStart = ptr + 1;
+    break;
 
   default:
-    if (isalpha(c) || c == '_') {
+    if (isIDChar(c)) {
       id();
       needAdvance = false;
 
@@ -171,7 +291,7 @@ void Tokenizer::next() {
       THROWS("Invalid character: '" << cb::String::escapeC(c) << "'");
   }
 
-  if (needAdvance) scanner.advance();
+  if (needAdvance) ptr++;
 
-  current.getLocation() = cb::LocationRange(start, scanner.getLocation());
+  setLocation(startLine, startCol);
 }
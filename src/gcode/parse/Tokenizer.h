@@ -17,32 +17,95 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 \******************************************************************************/
-
 #pragma once
 
 
 #include "Token.h"
 
-#include <cbang/parse/Tokenizer.h>
+#include <cbang/io/InputSource.h>
+
+#include <string>
+#include <vector>
 
 
 namespace GCode {
-  class Tokenizer : public cb::Tokenizer<TokenType> {
+  /***
+   * Splits GCode held in memory in to tokens.  Token values are copied
+   * straight out of the buffer and locations are only computed at token
+   * boundaries.
+   */
+  class Tokenizer {
+    std::vector<char> data; // Only used when reading from a stream
+    const char *begin;
+    const char *end;
+    const char *ptr;
+
+    std::string filename;
+    int64_t line;
+    const char *lineStart;
+
+    Token current;
+    const char *tokenStart;
+    int64_t tokenLine;
+    const char *tokenLineStart;
+    int64_t endLine;
+    int64_t endCol;
+
   public:
-    using cb::Tokenizer<TokenType>::Token_T;
+    typedef Token Token_T;
+
+    /// A position to return to with rewind()
+    struct Mark {
+      const char *tokenStart;
+      int64_t tokenLine;
+      const char *tokenLineStart;
+      int64_t endLine;
+      int64_t endCol;
+    };
 
-    Tokenizer(cb::Scanner &scanner) : cb::Tokenizer<TokenType>(scanner)
-    {advance();}
+    /// Tokenize @param length bytes at @param data.  They must stay
+    /// valid and unmodified while the Tokenizer is used.  @param line is
+    /// the line of the first byte, when tokenizing part of a file.
+    Tokenizer(const char *data, uint64_t length,
+              const std::string &filename = "<memory>", int64_t line = 0);
+    /// Read all of @param source before tokenizing it.
+    Tokenizer(const cb::InputSource &source);
 
+    /// @return the number of bytes tokenized so far.
+    uint64_t getOffset() const {return ptr - begin;}
+    uint64_t getLength() const {return end - begin;}
+
+    const Token &peek() const {return current;}
+    TokenType::enum_t getType() const {return current.getType();}
+    const std::string &getValue() const {return current.getValue();}
+    const cb::LocationRange &getLocation() const
+    {return current.getLocation();}
+    /// @return where the last token returned by advance() ended.
+    cb::FileLocation getLastEnd() const
+    {return cb::FileLocation(filename, endLine, endCol);}
+
+    bool hasMore() const {return !isType(TokenType::EOF_TOKEN);}
+    bool isType(TokenType::enum_t type) const {return getType() == type;}
     bool isID(const std::string &id) const;
 
+    Token advance();
+    Token match(TokenType::enum_t type);
+    bool consume(TokenType::enum_t type);
+
+    Mark getMark() const;
+    /// Return to @param mark, scanning its current token again.
+    void rewind(const Mark &mark);
+
   protected:
+    void init(int64_t line = 0);
+    cb::FileLocation getPosition() const;
+    void setLocation(int64_t startLine, int64_t startCol);
+    void skipWhiteSpace();
+
     void comment();
     void parenComment();
     void number(bool positive = true);
     void id();
-
-    // From cb::Tokenizer
     void next();
   };
 }
@@ -20,11 +20,6 @@
 
 #include "LinePlanner.h"
 
-#include "LineCommand.h"
-#include "SpeedCommand.h"
-#include "ToolCommand.h"
-#include "DwellCommand.h"
-#include "PauseCommand.h"
 
 #include <cbang/Exception.h>
 #include <cbang/Math.h>
@@ -33,7 +28,6 @@
 
 #include <limits>
 #include <algorithm>
-#include <complex>
 
 using namespace cb;
 using namespace std;
@@ -45,11 +39,6 @@ namespace {
   template<typename T> T cube(T x) {return x * x * x;}
 
 
-  complex<double> cbrt(complex<double> x) {
-    return x.real() < 0 ? -pow(-x, 1.0 / 3.0) : pow(x, 1.0 / 3.0);
-  }
-
-
   double computeDistance(double t, double v, double a, double j) {
     // v * t + 1/2 * a * t^2 + 1/6 * j * t^3
     return t * (v + t * (0.5 * a + 1.0 / 6.0 * j * t));
@@ -64,22 +53,31 @@ namespace {
 
 
 bool LinePlanner::hasMove() const {
-  return !cmds.empty() && isFinal(cmds.begin());
+  if (cmds.empty()) return false;
+
+  // Past the lookahead limit the oldest command is taken as it stands
+  if (config.maxLookahead && config.maxLookahead < cmds.size()) return true;
+
+  return isFinal(0);
 }
 
 
-void LinePlanner::next(JSON::Sink &sink) {
+const PlannerCommand &LinePlanner::next() {
   if (!hasMove()) THROW("Planner not ready");
 
-  SmartPointer<PlannerCommand> cmd = cmds.front();
-  cmd->write(sink);
-  output.push_back(cmd);
+  output.push_back(cmds.front());
   cmds.pop_front();
+
+  return output.back();
 }
 
 
+void LinePlanner::next(JSON::Sink &sink) {next().write(sink);}
+void LinePlanner::next(PlannerCommand::Record &record) {next().write(record);}
+
+
 void LinePlanner::release(uint64_t line) {
-  while (!output.empty() && output.front()->getLine() <= line)
+  while (!output.empty() && output.front().getLine() <= line)
     output.pop_front();
 }
 
@@ -87,28 +85,37 @@ void LinePlanner::release(uint64_t line) {
 void LinePlanner::restart(uint64_t line, double length) {
   // Find replan command in output
   while (true) {
-    if (output.empty() || line < output.front()->getLine())
+    if (output.empty() || line < output.front().getLine())
       THROWS("Planner line " << line << " at length " << length
              << " not found");
 
-    if (output.front()->getLine() == line) {
-      if (output.front()->getLength() <= length) break;
-      else length -= output.front()->getLength();
+    if (output.front().getLine() == line) {
+      if (!length || length < output.front().getLength()) break;
+      else length -= output.front().getLength();
     }
 
     output.pop_front(); // Release any moves before the restart
   }
 
   // Reload previously output moves
-  cmds.splice(cmds.begin(), output, output.begin(), output.end());
+  while (!output.empty()) {
+    cmds.push_front(output.back());
+    output.pop_back();
+  }
 
   // Reset output position
   outputPos = Vector4D(numeric_limits<double>::quiet_NaN());
 
-  // Replan from zero velocity
-  cmds.front()->restart(length);
-  for (auto it = cmds.begin(); it != cmds.end(); it++)
-    if (plan(it)) backplan(it);
+  // Replan from zero velocity.  Lowering the entry velocity can only lower
+  // the velocities that follow, so stop once they no longer change.
+  cmds.front().restart(length);
+  for (unsigned i = 0; i < cmds.size(); i++) {
+    double exitVel = cmds[i].getExitVelocity();
+    if (plan(i)) backplan(i);
+    if (cmds[i].getExitVelocity() == exitVel) break;
+  }
+
+  lastExitVel = cmds.back().getExitVelocity();
 }
 
 
@@ -127,8 +134,8 @@ void LinePlanner::end() {
   MachineAdapter::end();
 
   if (!cmds.empty()) {
-    cmds.back()->setExitVelocity(0);
-    plan(std::prev(cmds.end()));
+    cmds.back().setExitVelocity(0);
+    plan(cmds.size() - 1);
   }
 }
 
@@ -136,65 +143,71 @@ void LinePlanner::end() {
 void LinePlanner::setSpeed(double speed, spin_mode_t mode, double max) {
   MachineAdapter::setSpeed(speed, mode, max);
   // TODO handle spin mode
-  push(new SpeedCommand(getLine(), speed));
+  PlannerCommand cmd(PlannerCommand::SPEED, getLine());
+  cmd.speed = speed;
+  push(cmd);
 }
 
 
 void LinePlanner::setTool(unsigned tool) {
   MachineAdapter::setTool(tool);
-  push(new ToolCommand(getLine(), tool));
+  PlannerCommand cmd(PlannerCommand::TOOL, getLine());
+  cmd.tool = tool;
+  push(cmd);
 }
 
 
 void LinePlanner::dwell(double seconds) {
   MachineAdapter::dwell(seconds);
-  push(new DwellCommand(getLine(), seconds));
+  PlannerCommand cmd(PlannerCommand::DWELL, getLine());
+  cmd.seconds = seconds;
+  push(cmd);
 }
 
 
 void LinePlanner::move(const Axes &target, bool rapid) {
   MachineAdapter::move(target, rapid);
 
-  SmartPointer<LineCommand> lc = new LineCommand(getLine());
+  PlannerCommand lc(PlannerCommand::LINE, getLine());
 
   for (int i = 0; i < 4; i++)
-    lc->position[i] = target[i];
+    lc.target[i] = target[i];
 
   // Compute axis and lengths
-  Vector4D delta = lc->position - position;
-  position = lc->position;
-  lc->length = delta.length();
-  Vector4D unit = delta / lc->length;
+  Vector4D delta = lc.target - position;
+  position = lc.target;
+  lc.length = delta.length();
+  Vector4D unit = delta / lc.length;
 
   // TODO ignore too short moves
-  if (!lc->length) return; // Null move
+  if (!lc.length) return; // Null move
 
   // Apply user velocity limit
   // TODO Handle feed rate mode
   if (!rapid) {
-    lc->maxVel = getFeed();
-    if (!lc->maxVel) THROWS("Non-rapid move with zero feed rate");
+    lc.maxVel = getFeed();
+    if (!lc.maxVel) THROWS("Non-rapid move with zero feed rate");
   }
 
   // Apply axis velocity limits
   for (unsigned i = 0; i < 4; i++)
     if (unit[i]) {
       double v = fabs(config.maxVel[i] / unit[i]);
-      if (v < lc->maxVel) lc->maxVel = v;
+      if (v < lc.maxVel) lc.maxVel = v;
     }
 
   // Apply axis jerk limits
   for (unsigned i = 0; i < 4; i++)
     if (unit[i]) {
       double j = fabs(config.maxJerk[i] / unit[i]);
-      if (j < lc->maxJerk) lc->maxJerk = j;
+      if (j < lc.maxJerk) lc.maxJerk = j;
     }
 
   // Apply axis acceleration limits
   for (unsigned i = 0; i < 4; i++)
     if (unit[i]) {
       double a = fabs(config.maxAccel[i] / unit[i]);
-      if (a < lc->maxAccel) lc->maxAccel = a;
+      if (a < lc.maxAccel) lc.maxAccel = a;
     }
 
   // Apply junction velocity limit
@@ -202,12 +215,12 @@ void LinePlanner::move(const Axes &target, bool rapid) {
     double jv = computeJunctionVelocity(unit, lastUnit,
                                         config.junctionDeviation,
                                         config.junctionAccel);
-    if (jv < lc->exitVel) lc->exitVel = jv;
+    if (jv < lc.exitVel) lc.exitVel = jv;
   }
   lastUnit = unit;
 
   // Limit velocity
-  if (lc->maxVel < lc->exitVel) lc->exitVel = lc->maxVel;
+  if (lc.maxVel < lc.exitVel) lc.exitVel = lc.maxVel;
 
   // Add move
   push(lc);
@@ -216,30 +229,32 @@ void LinePlanner::move(const Axes &target, bool rapid) {
 
 void LinePlanner::pause(bool optional) {
   MachineAdapter::pause(optional);
-  push(new PauseCommand(getLine(), optional));
+  PlannerCommand cmd(PlannerCommand::PAUSE, getLine());
+  cmd.optional = optional;
+  push(cmd);
 }
 
 
-void LinePlanner::push(const cb::SmartPointer<PlannerCommand> &cmd) {
+void LinePlanner::push(const PlannerCommand &cmd) {
   cmds.push_back(cmd);
 
   // Plan move
-  cmd->setEntryVelocity(lastExitVel);
-  auto it = std::prev(cmds.end());
-  if (plan(it)) backplan(it);
+  unsigned i = cmds.size() - 1;
+  cmds[i].setEntryVelocity(lastExitVel);
+  if (plan(i)) backplan(i);
 
-  lastExitVel = cmd->getExitVelocity();
+  lastExitVel = cmds.back().getExitVelocity();
 }
 
 
-bool LinePlanner::isFinal(cmds_t::const_iterator it) const {
-  double velocity = (*it)->getExitVelocity();
+bool LinePlanner::isFinal(unsigned i) const {
+  double velocity = cmds[i].getExitVelocity();
   if (!velocity) return true;
 
   // Check if there is enough velocity change in the following blocks to
   // deccelerate to zero if necessary.
-  while (++it != cmds.end()) {
-    velocity -= (*it)->getDeltaVelocity();
+  while (++i < cmds.size()) {
+    velocity -= cmds[i].getDeltaVelocity();
     if (velocity <= 0) return true;
   }
 
@@ -247,20 +262,18 @@ bool LinePlanner::isFinal(cmds_t::const_iterator it) const {
 }
 
 
-bool LinePlanner::plan(cmds_t::iterator it) {
-  const SmartPointer<PlannerCommand> &pc = *it;
+bool LinePlanner::plan(unsigned i, unsigned first) {
+  PlannerCommand &lc = cmds[i];
 
-  if (!pc.isInstance<LineCommand>()) {
-    if (it != cmds.begin() &&
-        pc->getEntryVelocity() < (*std::prev(it))->getExitVelocity()) {
-      (*std::prev(it))->setExitVelocity(pc->getEntryVelocity());
+  if (!lc.isLine()) {
+    if (first < i && lc.getEntryVelocity() < cmds[i - 1].getExitVelocity()) {
+      cmds[i - 1].setExitVelocity(lc.getEntryVelocity());
       return true;
     }
 
     return false;
   }
 
-  LineCommand &lc = *it->cast<LineCommand>();
   bool backplan = false;
   double Vi = lc.entryVel;
   double Vt = lc.exitVel;
@@ -285,19 +298,28 @@ bool LinePlanner::plan(cmds_t::iterator it) {
       // Backplaning  necessary
       backplan = true;
 
-      if (it == cmds.begin())
-        THROWS("Cannot backplan, previous move unavailable");
+      if (i == first) {
+        // With limited lookahead the previous move may already be gone or
+        // be beyond the backplanning horizon.  Accept the velocity step
+        // rather than fail.
+        if (!config.maxLookahead)
+          THROWS("Cannot backplan, previous move unavailable");
 
-      LOG_DEBUG(3, "Backplan: entryVel=" << lc.entryVel
-                << " prev.exitVel=" << (*std::prev(it))->getExitVelocity()
-                << " Vt=" << Vt);
+        lc.entryVel = Vt;
+        backplan = false;
 
-      lc.entryVel = Vt;
-      (*std::prev(it))->setExitVelocity(Vt);
+      } else {
+        LOG_DEBUG(3, "Backplan: entryVel=" << lc.entryVel
+                  << " prev.exitVel=" << cmds[i - 1].getExitVelocity()
+                  << " Vt=" << Vt);
+
+        lc.entryVel = Vt;
+        cmds[i - 1].setExitVelocity(Vt);
+      }
 
     } else {
       lc.exitVel = Vt;
-      if (std::next(it) != cmds.end()) (*std::next(it))->setEntryVelocity(Vt);
+      if (i + 1 < cmds.size()) cmds[i + 1].setEntryVelocity(Vt);
     }
   }
 
@@ -373,12 +395,19 @@ bool LinePlanner::plan(cmds_t::iterator it) {
 }
 
 
-void LinePlanner::backplan(cmds_t::iterator it) {
+void LinePlanner::backplan(unsigned i) {
+  // Bound how far back one move can replan
+  unsigned first = 0;
+  if (config.maxLookahead && config.maxLookahead < i)
+    first = i - config.maxLookahead;
+
   while (true) {
-    if (it == cmds.begin())
+    if (i == first) {
+      if (config.maxLookahead) break;
       THROWS("Cannot backplan, previous move unavailable");
+    }
 
-    if (!plan(--it)) break;
+    if (!plan(--i, first)) break;
   }
 }
 
@@ -491,23 +520,42 @@ double LinePlanner::peakAccelFromLength(double Vi, double jerk,
   //   (1/2 * L * Jm^2)^2 + (2/3 * Vi * Jm)^3
   //
   // In fact, it is always negative when Jm < 0 and 0 < Vt.  Proof omitted.
-  // So we must handle complex numbers correctly.
+  // Then the cubic has three real roots and we take the largest.
+  //
+  //--------------------------------------------------------------------------
+  // Otherwise there is one real root.  Let u and v be the two cube roots
+  // above so that Ap = u + v, u * v = -r and u^3 + v^3 = 2 * q.  Then:
+  //
+  //   Ap = 2 * q / (u^2 - u * v + v^2) = 2 * q / (u^2 + r + (r / u)^2)
+  //
+  // Unlike u + v, every term is positive when 0 < Jm.  So there is no
+  // cancellation when r^3 dominates q^2, as it does for short moves at
+  // speed.
 
   if (jerk < 0 && jerk <= -cube(Vi) / square(length))
     return -square(Vi) / length; // Peak accel when Vt = 0
 
-  complex<double> q = 0.5 * length * square(jerk);
-  complex<double> r = 2.0 / 3.0 * Vi * jerk;
-  complex<double> sqrtq2r3 = sqrt(square(q) + cube(r));
+  double q = 0.5 * length * square(jerk);
+  double r = 2.0 / 3.0 * Vi * jerk;
+  double q2r3 = square(q) + cube(r);
+  double Ap;
 
-  complex<double> Ap = cbrt(q + sqrtq2r3) + cbrt(q - sqrtq2r3);
+  if (q2r3 < 0) {
+    double s = sqrt(-r);
+    Ap = 2 * s * cos(acos(q / cube(s)) / 3);
+
+  } else if (!q) Ap = 0;
+  else {
+    double u = cbrt(q + sqrt(q2r3));
+    Ap = 2 * q / (square(u) + r + square(r / u));
+  }
 
   LOG_DEBUG(3, "peakAccelFromLength(" << Vi << ", " << jerk << ", "
             << length << ") = " << Ap);
 
-  if (!isfinite(Ap.real()) || Ap.imag()) THROW("Invalid peak acceleration");
+  if (!isfinite(Ap)) THROW("Invalid peak acceleration");
 
-  return Ap.real();
+  return Ap;
 }
 
 
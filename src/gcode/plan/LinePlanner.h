@@ -22,14 +22,12 @@
 
 #include "PlannerConfig.h"
 #include "PlannerCommand.h"
+#include "RingBuffer.h"
 
 #include <gcode/machine/MachineAdapter.h>
 
-#include <cbang/SmartPointer.h>
 #include <cbang/geom/Vector.h>
 
-#include <list>
-
 
 namespace cb {namespace JSON {class Sink;}}
 
@@ -46,7 +44,7 @@ namespace GCode {
     // Output state
     cb::Vector4D outputPos;
 
-    typedef std::list<cb::SmartPointer<PlannerCommand> > cmds_t;
+    typedef RingBuffer<PlannerCommand> cmds_t;
     cmds_t cmds;
     cmds_t output;
 
@@ -56,7 +54,10 @@ namespace GCode {
     uint64_t getLine() const {return getLocation().getStart().getLine();}
 
     bool hasMove() const;
+    /// The command stays valid until the next call to next() or release()
+    const PlannerCommand &next();
     void next(cb::JSON::Sink &sink);
+    void next(PlannerCommand::Record &record);
     void release(uint64_t line);
     void restart(uint64_t line, double length);
 
@@ -76,10 +77,10 @@ namespace GCode {
     //void abort();
 
   protected:
-    void push(const cb::SmartPointer<PlannerCommand> &cmd);
-    bool isFinal(cmds_t::const_iterator it) const;
-    bool plan(cmds_t::iterator it);
-    void backplan(cmds_t::iterator it);
+    void push(const PlannerCommand &cmd);
+    bool isFinal(unsigned i) const;
+    bool plan(unsigned i, unsigned first = 0);
+    void backplan(unsigned i);
 
     bool isAccelLimited(double Vi, double Vt, double maxAccel,
                         double maxJerk) const;
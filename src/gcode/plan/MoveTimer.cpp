@@ -0,0 +1,136 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "MoveTimer.h"
+
+#include "LinePlanner.h"
+
+#include <gcode/ToolPath.h>
+#include <gcode/machine/MachinePipeline.h>
+#include <gcode/machine/MachineState.h>
+
+#include <cbang/Math.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cb;
+using namespace std;
+using namespace GCode;
+
+
+namespace {
+  class Retimer {
+    ToolPath &path;
+
+    unsigned next;
+    double time;
+    double moveTime;
+    bool planned;
+
+  public:
+    Retimer(ToolPath &path) :
+      path(path), next(0), time(0), moveTime(0), planned(false) {}
+
+
+    void add(const PlannerCommand &cmd) {
+      // Planner commands carry the index of their move as their line
+      finish(cmd.getLine());
+
+      if (!cmd.isLine()) return;
+
+      for (unsigned i = 0; i < 7; i++)
+        moveTime += cmd.times[i] * 60; // Minutes to seconds
+      planned = true;
+    }
+
+
+    /// Time the moves before @param end
+    void finish(unsigned end) {
+      for (; next < end && next < path.size(); next++) {
+        // Moves the planner ignores, such as rotations of B or C, keep
+        // their feed time
+        if (!planned) moveTime = path.at(next).getTime();
+
+        path.setMoveTime(next, time, moveTime);
+        time += moveTime;
+        moveTime = 0;
+        planned = false;
+      }
+    }
+  };
+}
+
+
+void MoveTimer::time(ToolPath &path) const {
+  if (path.empty()) return;
+
+  PlannerConfig config = this->config;
+  config.start = path.at(0).getStart();
+
+  // Bound the lookahead so long runs of short segments at constant velocity
+  // do not make the pass quadratic.  The planner never holds back more than
+  // this many commands.
+  if (!config.maxLookahead) config.maxLookahead = 256;
+
+  LinePlanner planner(config);
+  MachinePipeline pipeline;
+  pipeline.add(SmartPointer<LinePlanner>::Phony(&planner));
+  pipeline.add(new MachineState);
+  pipeline.start();
+
+  Retimer retimer(path);
+
+  for (unsigned i = 0; i < path.size(); i++) {
+    const Move &move = path.at(i);
+    bool rapid = move.getType() == MoveType::MOVE_RAPID;
+
+    pipeline.setLocation(LocationRange(FileLocation(string(), i)));
+    if (!rapid) pipeline.setFeed(move.getFeed());
+
+    if (move.isArc()) {
+      // The planner only takes lines
+      double radius = move.getRadius();
+      double error = min(config.maxArcError, radius);
+      double step = min(2 * M_PI / 3, 2 * acos(1 - error / radius));
+      unsigned segments = ceil(fabs(move.getAngle()) / step);
+      Axes axes = move.getEnd();
+
+      for (unsigned j = 1; j < segments; j++) {
+        axes.setXYZ(move.getPtAt((double)j / segments));
+        pipeline.move(axes, false);
+      }
+    }
+
+    pipeline.move(move.getEnd(), rapid);
+
+    // Only look as far ahead as the planner needs
+    while (planner.hasMove()) {
+      const PlannerCommand &cmd = planner.next();
+      retimer.add(cmd);
+      planner.release(cmd.getLine());
+    }
+  }
+
+  pipeline.end();
+
+  while (planner.hasMove()) retimer.add(planner.next());
+  retimer.finish(path.size());
+}
@@ -0,0 +1,42 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+#include "PlannerConfig.h"
+
+
+namespace GCode {
+  class ToolPath;
+
+  /// Times the moves of a tool path as the planner would run them, with
+  /// acceleration and jerk, rather than as distance over feed.  Moves stream
+  /// through the planner which only holds the moves it must look ahead.
+  class MoveTimer {
+    PlannerConfig config;
+
+  public:
+    MoveTimer(const PlannerConfig &config = PlannerConfig()) :
+      config(config) {}
+
+    /// Replace the start time and duration of every move in @param path.
+    void time(ToolPath &path) const;
+  };
+}
@@ -27,6 +27,9 @@
 
 #include <cbang/json/Writer.h>
 #include <cbang/io/StringInputSource.h>
+#include <cbang/time/Timer.h>
+
+#include <limits>
 
 
 using namespace cb;
@@ -64,17 +67,24 @@ void Planner::load(const cb::InputSource &source) {
 }
 
 
-bool Planner::hasMore() {
+bool Planner::hasMore() {return advance(numeric_limits<double>::infinity());}
+
+
+bool Planner::advance(double seconds) {
+  double deadline = Timer::now() + seconds;
+
   while (true) {
     if (planner.hasMove()) return true;
     if (runner.isNull() || runner->isDone()) return false;
     runner->next();
     if (runner->isDone()) pipeline.end();
+    if (deadline <= Timer::now()) return planner.hasMove();
   }
 }
 
 
 void Planner::next(JSON::Sink &sink) {planner.next(sink);}
+void Planner::next(PlannerCommand::Record &record) {planner.next(record);}
 void Planner::release(uint64_t line) {planner.release(line);}
 
 
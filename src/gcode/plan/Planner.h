@@ -53,7 +53,14 @@ namespace GCode {
     void load(const cb::InputSource &source);
 
     bool hasMore();
+
+    /// Interpret GCode until a move is ready, the program ends or about
+    /// @param seconds have passed.  Blocks are not split, so one long block
+    /// can still overrun.
+    /// @return true if next() has a move.
+    bool advance(double seconds);
     void next(cb::JSON::Sink &sink);
+    void next(PlannerCommand::Record &record);
     void release(uint64_t line);
     void restart(uint64_t line, double length);
   };
@@ -20,25 +20,105 @@
 
 #include "PlannerCommand.h"
 
+#include <gcode/Axes.h>
+
+#include <cbang/Exception.h>
 #include <cbang/json/Sink.h>
 
+#include <limits>
+
 using namespace GCode;
 using namespace cb;
+using namespace std;
+
+
+PlannerCommand::PlannerCommand(type_t type, uint64_t line) :
+  type(type), line(line), entryVel(0), exitVel(0), deltaV(0), length(0),
+  maxVel(numeric_limits<double>::max()),
+  maxAccel(numeric_limits<double>::max()),
+  maxJerk(numeric_limits<double>::max()), seconds(0) {
+
+  if (type == LINE) entryVel = exitVel = numeric_limits<double>::max();
+  for (unsigned i = 0; i < 7; i++) times[i] = 0;
+}
+
+
+const char *PlannerCommand::getType() const {
+  switch (type) {
+  case LINE: return "line";
+  case SPEED: return "speed";
+  case TOOL: return "tool";
+  case DWELL: return "dwell";
+  case PAUSE: return "pause";
+  }
+
+  THROWS("Invalid planner command type " << type);
+}
 
 
 void PlannerCommand::restart(double length) {
-  if (length) THROWS("Cannot restart from non-zero length " << length);
+  if (type != LINE) {
+    if (length) THROWS("Cannot restart from non-zero length " << length);
+
+  } else if (this->length < length)
+    THROWS("Cannot restart from length " << length);
+
   setEntryVelocity(0);
+  this->length -= length;
 }
 
 
-void PlannerCommand::write(cb::JSON::Sink &sink) {
+void PlannerCommand::write(JSON::Sink &sink) const {
   sink.beginDict();
 
   sink.insert("type", getType());
   sink.insert("line", getLine());
 
-  insert(sink);
+  switch (type) {
+  case LINE:
+    sink.insertDict("target", true);
+    for (unsigned i = 0; i < target.getSize(); i++)
+      sink.insert(Axes::toAxisName(i, true), target[i]);
+    sink.endDict();
+
+    sink.insert("exit-vel", exitVel);
+    sink.insert("max-vel", maxVel);
+    sink.insert("max-accel", maxAccel);
+    sink.insert("max-jerk", maxJerk);
+
+    sink.insertList("times", true);
+    for (unsigned i = 0; i < 7; i++)
+      sink.append(times[i] * 60000); // ms
+    sink.endList();
+    break;
+
+  case SPEED: sink.insert("speed", speed); break;
+  case TOOL: sink.insert("tool", tool); break;
+  case DWELL: sink.insert("seconds", seconds); break;
+  case PAUSE: sink.insertBoolean("optional", optional); break;
+  }
 
   sink.endDict();
 }
+
+
+void PlannerCommand::write(Record &record) const {
+  record.type = type;
+  record.reserved = 0;
+  record.line = line;
+
+  for (unsigned i = 0; i < 4; i++) record.target[i] = target[i];
+  record.exitVel = exitVel;
+  record.maxVel = maxVel;
+  record.maxAccel = maxAccel;
+  record.maxJerk = maxJerk;
+  for (unsigned i = 0; i < 7; i++) record.times[i] = times[i] * 60000; // ms
+
+  switch (type) {
+  case LINE: record.value = 0; break;
+  case SPEED: record.value = speed; break;
+  case TOOL: record.value = tool; break;
+  case DWELL: record.value = seconds; break;
+  case PAUSE: record.value = optional; break;
+  }
+}
@@ -21,32 +21,96 @@
 #pragma once
 
 #include <cbang/StdTypes.h>
+#include <cbang/geom/Vector.h>
 
 namespace cb {namespace JSON {class Sink;}}
 
 
 namespace GCode {
+  /// One planner command.  All command types share this plain record,
+  /// tagged by type, so the planner can hold them by value in contiguous
+  /// memory.
   class PlannerCommand {
+  public:
+    // The values are part of the binary Record format
+    typedef enum {
+      LINE,
+      SPEED,
+      TOOL,
+      DWELL,
+      PAUSE,
+    } type_t;
+
+    type_t type;
     uint64_t line;
-    double velocity;
 
-  public:
-    PlannerCommand(uint64_t line) : line(line), velocity(0) {}
-    virtual ~PlannerCommand() {}
+    double entryVel;
+    double exitVel;
+    double deltaV;
+    double length;
+
+    // Line
+    cb::Vector4D target;
+    double maxVel;
+    double maxAccel;
+    double maxJerk;
+    double times[7];
+
+    union {
+      double speed;    // SPEED
+      unsigned tool;   // TOOL
+      double seconds;  // DWELL
+      bool optional;   // PAUSE
+    };
+
+    PlannerCommand(type_t type = LINE, uint64_t line = 0);
 
-    virtual const char *getType() = 0;
+    const char *getType() const;
+    bool isLine() const {return type == LINE;}
+    bool isStop() const {return type == DWELL || type == PAUSE;}
 
     uint64_t getLine() const {return line;}
 
-    virtual double getEntryVelocity() const {return velocity;}
-    virtual void setEntryVelocity(double entryVel) {velocity = entryVel;}
-    virtual double getExitVelocity() const {return velocity;}
-    virtual void setExitVelocity(double exitVel) {velocity = exitVel;}
-    virtual double getDeltaVelocity() const {return 0;}
-    virtual double getLength() const {return 0;}
-    virtual void restart(double length);
+    // Dwells and pauses always stop.  Other non-line commands hold one
+    // velocity.
+    double getEntryVelocity() const {return entryVel;}
+
+    void setEntryVelocity(double entryVel) {
+      if (isStop()) return;
+      this->entryVel = entryVel;
+      if (!isLine()) exitVel = entryVel;
+    }
+
+    double getExitVelocity() const {return exitVel;}
+
+    void setExitVelocity(double exitVel) {
+      if (isStop()) return;
+      this->exitVel = exitVel;
+      if (!isLine()) entryVel = exitVel;
+    }
+
+    double getDeltaVelocity() const {return deltaV;}
+    double getLength() const {return length;}
+    void restart(double length);
+
+    void write(cb::JSON::Sink &sink) const;
+
+    /// Fixed layout binary form of a command.  Fields are naturally aligned
+    /// and in host byte order, so the Python struct format is "=IIQ16d".
+    /// As in the JSON form, times are in ms.
+    struct Record {
+      uint32_t type;
+      uint32_t reserved;
+      uint64_t line;
+      double target[4];
+      double exitVel;
+      double maxVel;
+      double maxAccel;
+      double maxJerk;
+      double times[7];
+      double value; ///< Speed, tool, dwell seconds or pause optional
+    };
 
-    void write(cb::JSON::Sink &sink);
-    virtual void insert(cb::JSON::Sink &sink) = 0;
+    void write(Record &record) const;
   };
 }
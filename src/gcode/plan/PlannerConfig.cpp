@@ -31,7 +31,8 @@ using namespace std;
 
 PlannerConfig::PlannerConfig() :
   start(0.0), maxVel(10000), maxAccel(200000), maxJerk(50000000),
-  junctionDeviation(0.05), junctionAccel(100000), maxArcError(0.01) {}
+  junctionDeviation(0.05), junctionAccel(100000), maxArcError(0.01),
+  maxLookahead(0) {}
 
 
 void PlannerConfig::read(const JSON::Value &value) {
@@ -46,6 +47,7 @@ void PlannerConfig::read(const JSON::Value &value) {
   junctionDeviation = value.getNumber("junction-deviation", junctionDeviation);
   junctionAccel = value.getNumber("junction-accel", junctionAccel);
   maxArcError = value.getNumber("maxArcError", maxArcError);
+  maxLookahead = value.getU32("max-lookahead", maxLookahead);
 }
 
 
@@ -70,6 +72,7 @@ void PlannerConfig::write(JSON::Sink &sink) const {
 
   sink.insert("junction-deviation", junctionDeviation);
   sink.insert("junction-accel", junctionAccel);
+  sink.insert("max-lookahead", maxLookahead);
 
   sink.endDict();
 }
@@ -39,6 +39,8 @@ namespace GCode {
     Units defaultUnits;
     Units outputUnits;
     double maxArcError;
+    /// Commands held and backplanned per move, zero for no limit
+    unsigned maxLookahead;
 
     PlannerConfig();
 
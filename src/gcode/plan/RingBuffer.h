@@ -0,0 +1,81 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+#pragma once
+
+#include <vector>
+
+
+namespace GCode {
+  /// A double ended queue in one contiguous array with a power of two size.
+  /// The storage only ever grows, so once it is large enough pushing and
+  /// popping never allocate and neighbouring entries stay close in memory.
+  template <typename T>
+  class RingBuffer {
+    std::vector<T> buffer;
+    unsigned head;
+    unsigned count;
+
+  public:
+    RingBuffer(unsigned capacity = 64) : head(0), count(0) {
+      unsigned size = 1;
+      while (size < capacity) size <<= 1;
+      buffer.resize(size);
+    }
+
+    bool empty() const {return !count;}
+    unsigned size() const {return count;}
+    unsigned capacity() const {return buffer.size();}
+
+    /// @param i is counted from the front
+    T &operator[](unsigned i) {return buffer[index(i)];}
+    const T &operator[](unsigned i) const {return buffer[index(i)];}
+
+    T &front() {return buffer[head];}
+    const T &front() const {return buffer[head];}
+    T &back() {return buffer[index(count - 1)];}
+    const T &back() const {return buffer[index(count - 1)];}
+
+    void push_back(const T &x) {
+      if (count == buffer.size()) grow();
+      buffer[index(count++)] = x;
+    }
+
+    void push_front(const T &x) {
+      if (count == buffer.size()) grow();
+      head = (head - 1) & (buffer.size() - 1);
+      buffer[head] = x;
+      count++;
+    }
+
+    void pop_front() {head = index(1); count--;}
+    void pop_back() {count--;}
+    void clear() {head = count = 0;}
+
+  protected:
+    unsigned index(unsigned i) const {return (head + i) & (buffer.size() - 1);}
+
+    void grow() {
+      std::vector<T> bigger(buffer.size() * 2);
+      for (unsigned i = 0; i < count; i++) bigger[i] = (*this)[i];
+      buffer.swap(bigger);
+      head = 0;
+    }
+  };
+}
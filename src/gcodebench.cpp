@@ -0,0 +1,393 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include <camotics/Application.h>
+
+#include <gcode/ToolTable.h>
+#include <gcode/ToolPath.h>
+#include <gcode/Controller.h>
+#include <gcode/parse/Tokenizer.h>
+#include <gcode/parse/Parser.h>
+#include <gcode/interp/Interpreter.h>
+#include <gcode/machine/Machine.h>
+
+#include <cbang/Exception.h>
+#include <cbang/ApplicationMain.h>
+#include <cbang/String.h>
+#include <cbang/json/Writer.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/time/Timer.h>
+
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+
+using namespace cb;
+using namespace std;
+using namespace GCode;
+
+
+namespace {
+  class Corpus {
+    string text;
+    uint64_t lines;
+
+  public:
+    Corpus() : lines(0) {}
+
+    const string &getText() const {return text;}
+    uint64_t getLines() const {return lines;}
+
+    void read(const string &filename) {
+      SmartPointer<istream> stream = SystemUtilities::iopen(filename);
+      text.assign(istreambuf_iterator<char>(*stream),
+                  istreambuf_iterator<char>());
+      lines = count(text.begin(), text.end(), '\n');
+    }
+
+
+    void line(const char *fmt, ...) {
+      char buffer[256];
+
+      va_list ap;
+      va_start(ap, fmt);
+      vsnprintf(buffer, sizeof(buffer), fmt, ap);
+      va_end(ap);
+
+      text += buffer;
+      text += '\n';
+      lines++;
+    }
+
+
+    /// A 3D finishing raster over a wavy surface, like CAM output
+    void finishing(uint64_t count) {
+      line("G21 G90 G17");
+      line("F1500 S12000 M3");
+      line("G0 Z5");
+
+      const unsigned width = 1000;
+      for (uint64_t i = 0; lines < count; i++) {
+        double y = (i / width) * 0.1;
+        unsigned j = i % width;
+        double x = ((i / width) & 1 ? width - j : j) * 0.1;
+        double z = sin(x * 0.05) * cos(y * 0.07) * 4 - 5;
+
+        line("G1 X%.4f Y%.4f Z%.4f", x, y, z);
+      }
+
+      line("M2");
+    }
+
+
+    /// Nested subroutine calls, loops and conditionals
+    void ocode(uint64_t count) {
+      line("G21 G90 G17");
+      line("F1000");
+      line("o100 sub");
+      line("  G1 X[#1] Y[#2]");
+      line("  G1 Z[-#2]");
+      line("o100 endsub");
+      line("o101 sub");
+      line("  #3 = 0");
+      line("  o102 while [#3 lt 3]");
+      line("    o103 if [[#3 mod 2] eq 0]");
+      line("      o100 call [#1 + #3] [#2]");
+      line("    o103 else");
+      line("      G1 X[#1] Y[#2 + #3]");
+      line("    o103 endif");
+      line("    #3 = [#3 + 1]");
+      line("  o102 endwhile");
+      line("o101 endsub");
+
+      for (uint64_t i = 0; lines < count; i++) {
+        line("#1 = 0");
+        line("o200 repeat [2]");
+        line("  o101 call [#1] [%u]", (unsigned)(i % 100));
+        line("  #1 = [#1 + 0.5]");
+        line("o200 endrepeat");
+      }
+
+      line("M2");
+    }
+
+
+    /// Expressions over global and local named parameters
+    void named(uint64_t count) {
+      line("G21 G90 G17");
+      line("F1000");
+      line("#<_x> = 0");
+      line("#<_step> = 0.01");
+
+      while (lines < count) {
+        line("#<_x> = [#<_x> + #<_step>]");
+        line("#<y> = [#<_x> * 2 + #<_step>]");
+        line("#<z> = [0 - [#<y> mod 5]]");
+        line("G1 X[#<_x>] Y[#<y>] Z[#<z>]");
+      }
+
+      line("M2");
+    }
+
+
+    /// Long runs of arcs in all three planes
+    void arcs(uint64_t count) {
+      line("G21 G90 G17");
+      line("F800");
+      line("G0 X0 Y0 Z0");
+
+      double x = 0;
+      for (uint64_t i = 0; lines < count; i++)
+        switch (i % 5) {
+        case 0: line("G17 G2 X%.3f Y0 I1 J0", x += 2); break;
+        case 1: line("G3 X%.3f Y0 I1 J0", x += 2); break;
+        case 2: line("G18 G2 X%.3f Z0 I1 K0", x += 2); break;
+        case 3: line("G17 G2 X%.3f Y0 I1 J0 P2", x); break;
+        case 4: if (400 < x) line("G0 X%.3f", x = 0); break;
+        }
+
+      line("M2");
+    }
+  };
+
+
+  class CountingProcessor : public Processor {
+  public:
+    uint64_t blocks;
+
+    CountingProcessor() : blocks(0) {}
+
+    // From Processor
+    void operator()(const SmartPointer<Block> &block) {blocks++;}
+    bool wantsSimpleBlocks() const {return true;}
+    void operator()(const SimpleBlock &block) {blocks++;}
+  };
+
+
+  class CountingStream : public MoveStream {
+  public:
+    uint64_t moves;
+
+    CountingStream() : moves(0) {}
+
+    // From MoveStream
+    void move(Move &move) {moves++;}
+  };
+}
+
+
+namespace CAMotics {
+  class BenchApp : public Application {
+    uint64_t lines;
+    unsigned runs;
+    string corpora;
+    string stages;
+
+    struct Input {
+      string name;
+      Corpus corpus;
+    };
+    vector<SmartPointer<Input> > inputs;
+
+  public:
+    BenchApp() :
+      Application("CAMotics GCode Benchmark"), lines(1000000), runs(3),
+      corpora("finishing ocode named arcs"),
+      stages("tokenizer parser interpreter toolpath") {
+
+      cmdLine.setUsageArgs("[OPTIONS] [input.gcode]...");
+      cmdLine.setAllowConfigAsFirstArg(false);
+      cmdLine.setAllowPositionalArgs(true);
+
+      cmdLine.addTarget("lines", lines, "Number of lines in each generated "
+                        "corpus.  Releases are compared with 10000000.");
+      cmdLine.addTarget("runs", runs, "Run each stage this many times and "
+                        "report the fastest.");
+      cmdLine.addTarget("corpora", corpora, "The generated corpora to run.  "
+                        "Any of 'finishing', 'ocode', 'named' or 'arcs'.  "
+                        "GCode files given as arguments are also run.");
+      cmdLine.addTarget("stages", stages, "The stages to time.  Any of "
+                        "'tokenizer', 'parser', 'interpreter' or 'toolpath'.");
+
+      Logger::instance().setLogTime(false);
+      Logger::instance().setLogNoInfoHeader(true);
+      Logger::instance().setVerbosity(1);
+    }
+
+
+    uint64_t tokenize(const Corpus &corpus) {
+      const string &text = corpus.getText();
+      Tokenizer tokenizer(text.data(), text.size());
+
+      uint64_t tokens = 0;
+      while (tokenizer.hasMore()) {
+        tokenizer.advance();
+        tokens++;
+      }
+
+      return tokens;
+    }
+
+
+    uint64_t parse(const Corpus &corpus) {
+      const string &text = corpus.getText();
+      Tokenizer tokenizer(text.data(), text.size());
+      CountingProcessor processor;
+
+      Parser parser;
+      parser.parse(tokenizer, processor);
+      if (parser.getErrorCount()) THROW("Parse errors");
+
+      return processor.blocks;
+    }
+
+
+    void interpret(const Corpus &corpus, MoveStream &stream) {
+      const string &text = corpus.getText();
+      Tokenizer tokenizer(text.data(), text.size());
+      ToolTable tools;
+      Machine machine(stream);
+      machine.reset();
+      Controller controller(machine, tools);
+
+      Interpreter interp(controller);
+      interp.read(tokenizer);
+      if (interp.getErrorCount()) THROW("Interpreter errors");
+    }
+
+
+    uint64_t interpret(const Corpus &corpus) {
+      CountingStream stream;
+      interpret(corpus, stream);
+      return stream.moves;
+    }
+
+
+    uint64_t toolPath(const Corpus &corpus) {
+      ToolTable tools;
+      ToolPath path(tools);
+      interpret(corpus, path);
+      return path.size();
+    }
+
+
+    uint64_t timeStage(const string &stage, const Corpus &corpus,
+                  double &seconds) {
+      uint64_t count = 0;
+      seconds = numeric_limits<double>::max();
+
+      for (unsigned i = 0; i < runs && !shouldQuit(); i++) {
+        double start = Timer::now();
+
+        if (stage == "tokenizer") count = tokenize(corpus);
+        else if (stage == "parser") count = parse(corpus);
+        else if (stage == "interpreter") count = interpret(corpus);
+        else if (stage == "toolpath") count = toolPath(corpus);
+        else THROW("Invalid stage '" << stage << "'");
+
+        seconds = min(seconds, Timer::now() - start);
+      }
+
+      return count;
+    }
+
+
+    // From Application
+    int init(int argc, char *argv[]) {
+      int ret = Application::init(argc, argv);
+      if (ret == -1) return ret;
+
+      vector<string> names;
+      String::tokenize(corpora, names);
+
+      for (unsigned i = 0; i < names.size(); i++) {
+        SmartPointer<Input> input = new Input;
+        input->name = names[i];
+
+        if (names[i] == "finishing") input->corpus.finishing(lines);
+        else if (names[i] == "ocode") input->corpus.ocode(lines);
+        else if (names[i] == "named") input->corpus.named(lines);
+        else if (names[i] == "arcs") input->corpus.arcs(lines);
+        else THROW("Invalid corpus '" << names[i] << "'");
+
+        inputs.push_back(input);
+      }
+
+      const vector<string> &args = cmdLine.getPositionalArgs();
+      for (unsigned i = 0; i < args.size(); i++) {
+        SmartPointer<Input> input = new Input;
+        input->name = args[i];
+        input->corpus.read(args[i]);
+        inputs.push_back(input);
+      }
+
+      return 0;
+    }
+
+
+    void run() {
+      vector<string> names;
+      String::tokenize(stages, names);
+
+      JSON::Writer writer(cout, 0, false);
+      writer.beginList();
+
+      for (unsigned i = 0; i < inputs.size() && !shouldQuit(); i++)
+        for (unsigned j = 0; j < names.size() && !shouldQuit(); j++) {
+          const Input &input = *inputs[i];
+          const string &stage = names[j];
+          double seconds;
+          uint64_t count = timeStage(stage, input.corpus, seconds);
+          uint64_t lineCount = input.corpus.getLines();
+
+          LOG_INFO(1, input.name << ' ' << stage << ": " << seconds << "s");
+
+          writer.appendDict();
+          writer.insert("corpus", input.name);
+          writer.insert("stage", stage);
+          writer.insert("lines", lineCount);
+          writer.insert("bytes", input.corpus.getText().size());
+          writer.insert("seconds", seconds);
+          writer.insert("lines_per_sec", lineCount / seconds);
+
+          if (stage == "tokenizer") writer.insert("tokens", count);
+          else if (stage == "parser") writer.insert("blocks", count);
+          else {
+            writer.insert("moves", count);
+            writer.insert("moves_per_sec", count / seconds);
+          }
+
+          writer.endDict();
+        }
+
+      writer.endList();
+      writer.close();
+      cout << endl;
+    }
+  };
+}
+
+
+int main(int argc, char *argv[]) {
+  return doApplication<CAMotics::BenchApp>(argc, argv);
+}
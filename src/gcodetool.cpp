@@ -21,38 +21,300 @@
 #include <camotics/CommandLineApp.h>
 
 #include <gcode/Printer.h>
+#include <gcode/NullInterrupter.h>
 #include <gcode/parse/Parser.h>
+#include <gcode/parse/Tokenizer.h>
+#include <gcode/parse/ChunkParser.h>
 #include <gcode/interp/Interpreter.h>
 #include <gcode/machine/MachinePipeline.h>
+#include <gcode/machine/MachineState.h>
+#include <gcode/machine/MachineMatrix.h>
+#include <gcode/machine/MachineLinearizer.h>
+#include <gcode/machine/MachineUnitAdapter.h>
 
 #include <cbang/Exception.h>
 #include <cbang/ApplicationMain.h>
+#include <cbang/json/Writer.h>
+#include <cbang/time/Timer.h>
 
 #include <iostream>
+#include <iterator>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 using namespace std;
 using namespace cb;
 using namespace GCode;
 
 
+namespace {
+  // Allocations are counted by the pipeline stage running when they are
+  // made, only for --stats.  Stage zero is the parser and interpreter.
+  const unsigned maxStages = 8;
+  atomic<uint64_t> allocations[maxStages];
+  thread_local unsigned currentStage = 0;
+  bool counting = false; // Set before any parser threads start
+
+
+  void *allocate(size_t size) {
+    if (counting)
+      allocations[currentStage].fetch_add(1, memory_order_relaxed);
+
+    return malloc(size ? size : 1);
+  }
+
+
+#ifdef __cpp_aligned_new
+  void *allocateAligned(size_t size, align_val_t align) {
+    if (counting)
+      allocations[currentStage].fetch_add(1, memory_order_relaxed);
+
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, (size_t)align);
+#else
+    void *ptr = 0;
+    if (posix_memalign(&ptr, (size_t)align, size ? size : 1)) return 0;
+    return ptr;
+#endif
+  }
+
+
+  void freeAligned(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+#endif // __cpp_aligned_new
+
+
+  class StageScope {
+    unsigned last;
+
+  public:
+    StageScope(unsigned stage) : last(currentStage) {currentStage = stage;}
+    ~StageScope() {currentStage = last;}
+  };
+
+
+  /// Counts the moves and arcs passed to the stage after it.
+  class StageCounter : public MachineAdapter {
+    unsigned index;
+
+  public:
+    string name;
+    uint64_t moves;
+    uint64_t arcs;
+
+    StageCounter(unsigned index, const string &name) :
+      index(index), name(name), moves(0), arcs(0) {}
+
+    // From MachineInterface
+    void move(const Axes &axes, bool rapid) {
+      moves++;
+      StageScope scope(index);
+      MachineAdapter::move(axes, rapid);
+    }
+
+
+    void arc(const Vector3D &offset, double angle, plane_t plane) {
+      arcs++;
+      StageScope scope(index);
+      MachineAdapter::arc(offset, angle, plane);
+    }
+  };
+
+
+  class CountingProcessor : public Processor {
+  public:
+    uint64_t blocks;
+
+    CountingProcessor() : blocks(0) {}
+
+    // From Processor
+    void operator()(const SmartPointer<Block> &block) {blocks++;}
+    bool wantsSimpleBlocks() const {return true;}
+    void operator()(const SimpleBlock &block) {blocks++;}
+  };
+
+
+  class CountingInterpreter : public Interpreter {
+  public:
+    uint64_t blocks;
+
+    CountingInterpreter(Controller &controller) :
+      Interpreter(controller), blocks(0) {}
+
+    // From Processor
+    void operator()(const SmartPointer<Block> &block)
+    {blocks++; Interpreter::operator()(block);}
+    void operator()(const SimpleBlock &block)
+    {blocks++; Interpreter::operator()(block);}
+  };
+}
+
+
+// Every form is replaced so none bypass the counts
+void *operator new(size_t size) {
+  void *ptr = allocate(size);
+  if (!ptr) throw bad_alloc();
+  return ptr;
+}
+
+
+void *operator new[](size_t size) {return operator new(size);}
+void *operator new(size_t size, const nothrow_t &) noexcept
+{return allocate(size);}
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{return allocate(size);}
+
+void operator delete(void *ptr) noexcept {free(ptr);}
+void operator delete[](void *ptr) noexcept {free(ptr);}
+void operator delete(void *ptr, const nothrow_t &) noexcept {free(ptr);}
+void operator delete[](void *ptr, const nothrow_t &) noexcept {free(ptr);}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, size_t) noexcept {free(ptr);}
+void operator delete[](void *ptr, size_t) noexcept {free(ptr);}
+#endif
+
+
+#ifdef __cpp_aligned_new
+void *operator new(size_t size, align_val_t align) {
+  void *ptr = allocateAligned(size, align);
+  if (!ptr) throw bad_alloc();
+  return ptr;
+}
+
+
+void *operator new[](size_t size, align_val_t align)
+{return operator new(size, align);}
+void *operator new(size_t size, align_val_t align, const nothrow_t &) noexcept
+{return allocateAligned(size, align);}
+void *operator new[](size_t size, align_val_t align,
+                     const nothrow_t &) noexcept
+{return allocateAligned(size, align);}
+
+void operator delete(void *ptr, align_val_t) noexcept {freeAligned(ptr);}
+void operator delete[](void *ptr, align_val_t) noexcept {freeAligned(ptr);}
+void operator delete(void *ptr, align_val_t, const nothrow_t &) noexcept
+{freeAligned(ptr);}
+void operator delete[](void *ptr, align_val_t, const nothrow_t &) noexcept
+{freeAligned(ptr);}
+void operator delete(void *ptr, size_t, align_val_t) noexcept
+{freeAligned(ptr);}
+void operator delete[](void *ptr, size_t, align_val_t) noexcept
+{freeAligned(ptr);}
+#endif // __cpp_aligned_new
+
+
 class GCodeTool : public CAMotics::CommandLineApp {
   MachinePipeline pipeline;
   SmartPointer<Controller> controller;
+  vector<StageCounter *> counters; // Owned by the pipeline
 
   bool parseOnly;
+  bool stats;
+  unsigned threads;
+  unsigned chunkSize;
+  bool parseThread;
+  bool memoize;
+  bool compile;
 
 public:
   GCodeTool() :
-    CAMotics::CommandLineApp("CAMotics GCode Tool"), parseOnly(false) {
+    CAMotics::CommandLineApp("CAMotics GCode Tool"), parseOnly(false),
+    stats(false), threads(1), chunkSize(1 << 20), parseThread(false),
+    memoize(true), compile(true) {
     cmdLine.addTarget("parse", parseOnly,
                       "Only parse the GCode, don't evaluate it.");
+    cmdLine.addTarget("stats", stats, "Write throughput statistics as JSON "
+                      "instead of the GCode.  Blocks and moves per second, "
+                      "arcs linearized and allocations are reported for "
+                      "each pipeline stage.");
+    cmdLine.addTarget("threads", threads, "Parse in parallel with this many "
+                      "threads.  The input is then read in to memory first.");
+    cmdLine.addTarget("chunk-size", chunkSize, "The size in bytes of the "
+                      "pieces parsed in parallel with --threads.");
+    cmdLine.addTarget("parse-thread", parseThread, "Parse in a separate "
+                      "thread ahead of the interpreter.  The input is then "
+                      "read in to memory first.");
+    cmdLine.addTarget("memoize", memoize, "Replay subroutine calls made "
+                      "again with the same inputs rather than running them.");
+    cmdLine.addTarget("compile", compile, "Compile the expressions in "
+                      "subroutines and loops to bytecode.");
+  }
+
+
+  void addStage(const string &name, const SmartPointer<MachineInterface> &m) {
+    if (maxStages <= counters.size() + 1) THROW("Too many stages");
+
+    StageCounter *counter = new StageCounter(counters.size() + 1, name);
+    counters.push_back(counter);
+    pipeline.add(counter);
+    pipeline.add(m);
+  }
+
+
+  void buildStats() {
+    // As CommandLineApp::build() but without printing
+    addStage("units", new MachineUnitAdapter(defaultUnits, outputUnits));
+    if (linearize) addStage("linearizer", new MachineLinearizer(maxArcError));
+    addStage("matrix", new MachineMatrix);
+    addStage("state", new MachineState);
+  }
+
+
+  void writeStats(uint64_t bytes, uint64_t blocks, double seconds) {
+    JSON::Writer writer(*stream, 0, false);
+
+    writer.beginDict();
+    writer.insert("bytes", bytes);
+    writer.insert("seconds", seconds);
+    writer.insert("threads", threads);
+    writer.insert("blocks", blocks);
+    writer.insert("blocks_per_sec", blocks / seconds);
+
+    writer.insertDict("parser");
+    writer.insert("allocations", allocations[0].load());
+    writer.endDict();
+
+    for (unsigned i = 0; i < counters.size(); i++) {
+      const StageCounter &counter = *counters[i];
+
+      writer.insertDict(counter.name);
+      writer.insert("moves", counter.moves);
+      writer.insert("moves_per_sec", counter.moves / seconds);
+      writer.insert("arcs", counter.arcs);
+      writer.insert("allocations", allocations[i + 1].load());
+      writer.endDict();
+    }
+
+    // Arcs passed to the linearizer are broken into the moves it adds
+    if (linearize) {
+      const StageCounter &in = *counters[1];
+      const StageCounter &out = *counters[2];
+      writer.insert("arc_expansions", in.arcs);
+      writer.insert("arc_segments", out.moves - in.moves);
+    }
+
+    writer.endDict();
+    writer.close();
+    *stream << endl;
   }
 
 
   // From Application
   void run() {
     if (!parseOnly) {
-      build(pipeline);
+      if (stats) buildStats();
+      else build(pipeline);
       controller = new Controller(pipeline);
     }
 
@@ -62,15 +324,57 @@ public:
 
   // From cb::Reader
   void read(const InputSource &source) {
+    for (unsigned i = 0; i < maxStages; i++) allocations[i] = 0;
+    counting = stats;
+
+    // Statistics and the parse threads work on the input in memory, so
+    // reading it is not timed
+    bool inMemory = stats || 1 < threads || parseThread;
+    string text;
+    if (inMemory) {
+      istream &in = source.getStream();
+      text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    SmartPointer<ChunkParser> chunks;
+    if (1 < threads)
+      chunks = new ChunkParser(text.data(), text.size(), source.getName(),
+                               threads, 32, chunkSize);
+    Tokenizer tokenizer(text.data(), text.size(), source.getName());
+
+    double start = Timer::now();
+    uint64_t blocks = 0;
+
     if (parseOnly) {
-      Printer printer(*stream);
-      Parser().parse(source, printer);
+      SmartPointer<Processor> processor;
+      if (stats) processor = new CountingProcessor;
+      else processor = new Printer(*stream);
+
+      if (!chunks.isNull()) chunks->process(*processor, new NullInterrupter);
+      else if (inMemory) Parser().parse(tokenizer, *processor);
+      else Parser().parse(source, *processor);
+
+      if (stats) blocks = processor.cast<CountingProcessor>()->blocks;
 
     } else {
+      CountingInterpreter interp(*controller);
+      interp.setMemoize(memoize);
+      interp.setCompileExpressions(compile);
+
       pipeline.start();
-      Interpreter(*controller).read(source);
+      if (!chunks.isNull()) interp.read(*chunks);
+      else if (parseThread)
+        interp.readPipelined(tokenizer, new NullInterrupter);
+      else if (inMemory) interp.read(tokenizer);
+      else interp.read(source);
       pipeline.end();
+
+      blocks = interp.blocks;
     }
+
+    double seconds = Timer::now() - start;
+
+    if (stats) writeStats(text.size(), blocks, seconds);
   }
 };
 
@@ -2,7 +2,15 @@
 
 #include <gcode/plan/Planner.h>
 
+#include <cbang/Exception.h>
 #include <cbang/json/NullSink.h>
+#include <cbang/json/Builder.h>
+#include <cbang/os/Thread.h>
+#include <cbang/os/Condition.h>
+#include <cbang/util/SmartLock.h>
+
+#include <deque>
+#include <cstring>
 
 
 class PyJSONSink : public cb::JSON::NullSink {
@@ -166,13 +174,130 @@ public:
 };
 
 
+// Plans on its own thread, queueing commands for Python to take.  Its lock
+// also serializes every use of the planner.
+class PlannerQueue : public cb::Thread, public cb::Condition {
+  GCode::Planner &planner;
+  unsigned capacity;
+  std::deque<cb::JSON::ValuePtr> queue;
+  std::string error;
+  bool started;
+
+public:
+  PlannerQueue(GCode::Planner &planner) :
+    planner(planner), capacity(0), started(false) {}
+  ~PlannerQueue() {stop();}
+
+  bool isStarted() const {return started;}
+  unsigned size() const {return queue.size();}
+  void clear() {queue.clear(); broadcast();}
+
+
+  void start(unsigned capacity) {
+    if (started) THROW("Planner thread already started");
+    this->capacity = capacity ? capacity : 1;
+    error.clear();
+    started = true;
+    cb::Thread::start();
+  }
+
+
+  void stop() {
+    if (!started) return;
+
+    cb::Thread::stop();
+    lock();
+    broadcast();
+    unlock();
+    join();
+
+    started = false;
+    queue.clear();
+  }
+
+
+  /// Call locked.  Waits up to @param timeout seconds for a command.
+  cb::JSON::ValuePtr take(double timeout) {
+    if (queue.empty() && 0 < timeout && error.empty()) timedWait(timeout);
+    if (queue.empty() && !error.empty()) THROW(error);
+    if (queue.empty()) return 0;
+
+    cb::JSON::ValuePtr value = queue.front();
+    queue.pop_front();
+    broadcast(); // Room for more
+
+    return value;
+  }
+
+
+  // From cb::Thread
+  void run() {
+    while (!shouldShutdown()) {
+      cb::SmartLock lock(this);
+
+      // Plan in short slices so callers are not locked out for long
+      bool ready = false;
+      if (queue.size() < capacity && error.empty())
+        try {
+          ready = planner.advance(0.05);
+
+          if (ready) {
+            cb::JSON::Builder builder;
+            planner.next(builder);
+            queue.push_back(builder.getRoot());
+            broadcast();
+          }
+
+        } catch (const std::exception &e) {error = e.what();}
+
+      // Full, failed or out of work, wait for a caller
+      if (!ready && (capacity <= queue.size() || !error.empty() ||
+                     !planner.isRunning()))
+        timedWait(0.1);
+    }
+  }
+};
+
+
 typedef struct {
   PyObject_HEAD;
   GCode::Planner *planner;
+  PlannerQueue *queue;
 } PyPlanner;
 
 
+// Run a planner call with the GIL released and the planner locked, raising
+// RuntimeError if it throws
+#define PLANNER_CALL(CALL)                                              \
+  do {                                                                  \
+    std::string _error;                                                 \
+    Py_BEGIN_ALLOW_THREADS;                                             \
+    try {                                                               \
+      cb::SmartLock _lock(self->queue);                                 \
+      CALL;                                                             \
+    } catch (const std::exception &e) {_error = e.what();}              \
+    Py_END_ALLOW_THREADS;                                               \
+    if (!_error.empty()) {                                              \
+      PyErr_SetString(PyExc_RuntimeError, _error.c_str());              \
+      return 0;                                                         \
+    }                                                                   \
+  } while (0)
+
+
+static bool checkNotThreaded(PyPlanner *self) {
+  if (!self->queue->isStarted()) return true;
+  PyErr_SetString(PyExc_RuntimeError,
+                  "Planner thread running, use get() instead");
+  return false;
+}
+
+
 static void _dealloc(PyPlanner *self) {
+  if (self->queue) {
+    Py_BEGIN_ALLOW_THREADS;
+    delete self->queue;
+    Py_END_ALLOW_THREADS;
+  }
   if (self->planner) delete self->planner;
   Py_TYPE(self)->tp_free((PyObject *)self);
 }
@@ -198,58 +323,126 @@ static int _init(PyPlanner *self, PyObject *args, PyObject *kwds) {
   // TODO Convert Python object to JSON config
 
   self->planner = new GCode::Planner(config);
+  self->queue = new PlannerQueue(*self->planner);
 
   return 0;
 }
 
 
 static PyObject *_is_running(PyPlanner *self) {
-  if (self->planner->isRunning()) Py_RETURN_TRUE;
+  bool running;
+  PLANNER_CALL(running = self->planner->isRunning());
+
+  if (running) Py_RETURN_TRUE;
   else Py_RETURN_FALSE;
 }
 
 
 static PyObject *_mdi(PyPlanner *self, PyObject *args) {
-  const char *gcode;
+  const char *_gcode;
 
-  if (!PyArg_ParseTuple(args, "s", &gcode)) return 0;
+  if (!PyArg_ParseTuple(args, "s", &_gcode)) return 0;
 
-  self->planner->mdi(gcode);
+  std::string gcode = _gcode;
+  PLANNER_CALL(self->planner->mdi(gcode); self->queue->broadcast());
 
   Py_RETURN_NONE;
 }
 
 
 static PyObject *_load(PyPlanner *self, PyObject *args) {
-  const char *filename;
+  const char *_filename;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) return 0;
+  if (!PyArg_ParseTuple(args, "s", &_filename)) return 0;
 
-  self->planner->load(std::string(filename));
+  std::string filename = _filename;
+  PLANNER_CALL(self->planner->load(filename); self->queue->broadcast());
 
   Py_RETURN_NONE;
 }
 
 
 static PyObject *_has_more(PyPlanner *self) {
-  if (self->planner->hasMore()) Py_RETURN_TRUE;
+  bool more;
+
+  // With the thread running only report what is queued, without planning
+  if (self->queue->isStarted()) PLANNER_CALL(more = self->queue->size());
+  else PLANNER_CALL(more = self->planner->hasMore());
+
+  if (more) Py_RETURN_TRUE;
+  else Py_RETURN_FALSE;
+}
+
+
+static PyObject *_advance(PyPlanner *self, PyObject *args) {
+  double seconds;
+
+  if (!PyArg_ParseTuple(args, "d", &seconds) || !checkNotThreaded(self))
+    return 0;
+
+  bool ready;
+  PLANNER_CALL(ready = self->planner->advance(seconds));
+
+  if (ready) Py_RETURN_TRUE;
   else Py_RETURN_FALSE;
 }
 
 
 static PyObject *_next(PyPlanner *self) {
+  if (!checkNotThreaded(self)) return 0;
+
+  // Built without the GIL, converted with it
+  cb::JSON::ValuePtr value;
+  PLANNER_CALL(cb::JSON::Builder builder; self->planner->next(builder);
+               value = builder.getRoot());
+
   PyJSONSink sink;
-  self->planner->next(sink);
+  value->write(sink);
   return sink.getRoot();
 }
 
 
+static PyObject *_next_records(PyPlanner *self, PyObject *args) {
+  Py_buffer buffer;
+
+  if (!checkNotThreaded(self) || !PyArg_ParseTuple(args, "w*", &buffer))
+    return 0;
+
+  // Fill as many whole records as fit.  The buffer may not be aligned.
+  const size_t size = sizeof(GCode::PlannerCommand::Record);
+  size_t count = buffer.len / size;
+  size_t n = 0;
+  std::string error;
+
+  Py_BEGIN_ALLOW_THREADS;
+  try {
+    cb::SmartLock lock(self->queue);
+
+    for (; n < count && self->planner->hasMore(); n++) {
+      GCode::PlannerCommand::Record record;
+      self->planner->next(record);
+      memcpy((char *)buffer.buf + n * size, &record, size);
+    }
+  } catch (const std::exception &e) {error = e.what();}
+  Py_END_ALLOW_THREADS;
+
+  PyBuffer_Release(&buffer);
+
+  if (!error.empty()) {
+    PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    return 0;
+  }
+
+  return PyLong_FromSize_t(n);
+}
+
+
 static PyObject *_release(PyPlanner *self, PyObject *args) {
   uint64_t line;
 
   if (!PyArg_ParseTuple(args, "K", &line)) return 0;
 
-  self->planner->release(line);
+  PLANNER_CALL(self->planner->release(line); self->queue->broadcast());
 
   Py_RETURN_NONE;
 }
@@ -261,12 +454,57 @@ static PyObject *_restart(PyPlanner *self, PyObject *args) {
 
   if (!PyArg_ParseTuple(args, "Kd", &line, &length)) return 0;
 
-  self->planner->restart(line, length);
+  // Commands queued before the restart are stale
+  PLANNER_CALL(self->planner->restart(line, length); self->queue->clear());
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_start(PyPlanner *self, PyObject *args) {
+  unsigned capacity = 1024;
+
+  if (!PyArg_ParseTuple(args, "|I", &capacity)) return 0;
+
+  PLANNER_CALL(self->queue->start(capacity));
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_stop(PyPlanner *self) {
+  // Not locked, the thread takes the lock to finish
+  Py_BEGIN_ALLOW_THREADS;
+  self->queue->stop();
+  Py_END_ALLOW_THREADS;
 
   Py_RETURN_NONE;
 }
 
 
+static PyObject *_get(PyPlanner *self, PyObject *args) {
+  double timeout = 0;
+
+  if (!PyArg_ParseTuple(args, "|d", &timeout)) return 0;
+
+  cb::JSON::ValuePtr value;
+  PLANNER_CALL(value = self->queue->take(timeout));
+
+  if (value.isNull()) Py_RETURN_NONE;
+
+  PyJSONSink sink;
+  value->write(sink);
+  return sink.getRoot();
+}
+
+
+static PyObject *_pending(PyPlanner *self) {
+  unsigned pending;
+  PLANNER_CALL(pending = self->queue->size());
+  return PyLong_FromUnsignedLong(pending);
+}
+
+
 static PyMethodDef _methods[] = {
   {"is_running", (PyCFunction)_is_running, METH_NOARGS,
    "True if the planner active"},
@@ -274,10 +512,22 @@ static PyMethodDef _methods[] = {
   {"load", (PyCFunction)_load, METH_VARARGS, "Load GCode by filename"},
   {"has_more", (PyCFunction)_has_more, METH_NOARGS,
    "True if the planner has more data"},
+  {"advance", (PyCFunction)_advance, METH_VARARGS,
+   "Interpret for at most the given seconds, True if data is ready"},
   {"next", (PyCFunction)_next, METH_NOARGS, "Get next planner data"},
+  {"next_records", (PyCFunction)_next_records, METH_VARARGS,
+   "Write binary planner records into a writable buffer, return the count"},
   {"release", (PyCFunction)_release, METH_VARARGS, "Release planner data"},
   {"restart", (PyCFunction)_restart, METH_VARARGS,
    "Restart planner from given line"},
+  {"start", (PyCFunction)_start, METH_VARARGS,
+   "Plan on a background thread, queueing up to the given number of "
+   "commands"},
+  {"stop", (PyCFunction)_stop, METH_NOARGS, "Stop the background thread"},
+  {"get", (PyCFunction)_get, METH_VARARGS,
+   "Take the next queued command, waiting up to the given seconds, or None"},
+  {"pending", (PyCFunction)_pending, METH_NOARGS,
+   "Number of queued commands"},
   {0}
 };
 
@@ -339,5 +589,10 @@ PyMODINIT_FUNC PyInit_gplan() {
   Py_INCREF(&PlannerType);
   PyModule_AddObject(m, "Planner", (PyObject *)&PlannerType);
 
+  // Layout of the records written by Planner.next_records()
+  PyModule_AddIntConstant(m, "RECORD_SIZE",
+                          sizeof(GCode::PlannerCommand::Record));
+  PyModule_AddStringConstant(m, "RECORD_FORMAT", "=IIQ16d");
+
   return m;
 }
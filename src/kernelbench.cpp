@@ -0,0 +1,518 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include <camotics/Application.h>
+#include <camotics/sim/CutSim.h>
+#include <camotics/sim/CutWorkpiece.h>
+#include <camotics/sim/Project.h>
+#include <camotics/sim/ToolSweep.h>
+#include <camotics/sim/ConicSweep.h>
+#include <camotics/sim/SpheroidSweep.h>
+#include <camotics/sim/CompositeSweep.h>
+#include <camotics/contour/GridTree.h>
+#include <camotics/contour/GridTreeRef.h>
+#include <camotics/contour/CubeSlice.h>
+#include <camotics/contour/MarchingCubes.h>
+#include <camotics/contour/CubicalMarchingSquares.h>
+#include <camotics/contour/QEF.h>
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+#include <cbang/ApplicationMain.h>
+#include <cbang/String.h>
+#include <cbang/config/Options.h>
+#include <cbang/json/Writer.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/time/Timer.h>
+
+#include <iostream>
+#include <limits>
+#include <random>
+#include <algorithm>
+
+using namespace cb;
+using namespace std;
+using namespace CAMotics;
+
+
+namespace {
+  // Keeps results alive so kernels are not optimized away
+  volatile double sinkValue;
+
+
+  struct SweepInput {
+    const GCode::Move *move;
+    cb::Vector3D p;
+
+    bool operator<(const SweepInput &o) const {return move < o.move;}
+  };
+
+
+  struct QEFInput {
+    double mat[12][3];
+    double vec[12];
+    unsigned rows;
+  };
+
+
+  // Corners of a marching cubes cell and the edges between them
+  const unsigned cellCorners[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+    {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},
+  };
+
+  const unsigned cellEdges[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0}, {4, 5}, {5, 6}, {6, 7}, {7, 4},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7},
+  };
+}
+
+
+namespace CAMotics {
+  class KernelBenchApp : public Application {
+    string resolution;
+    string lookup;
+    unsigned samples;
+    unsigned runs;
+    string kernels;
+    double radius;
+    double length;
+
+    Project project;
+    CutSim cutSim;
+
+    SmartPointer<ToolSweep> sweep;
+    SmartPointer<CutWorkpiece> cutWP;
+    SmartPointer<GridTree> tree;
+    vector<GridTreeRef> grids;
+
+    vector<cb::Vector3D> points;
+    vector<SweepInput> sweepInputs; // Sorted by move
+    vector<QEFInput> qefInputs;
+
+  public:
+    KernelBenchApp() :
+      Application("CAMotics Kernel Benchmark"), resolution("low"),
+      samples(100000), runs(5),
+      kernels("conic spheroid composite conic-batch spheroid-batch "
+              "composite-batch collisions cube-slice mcubes-cell cms-cell "
+              "qef"), radius(3.175), length(25), project(options) {
+
+      cmdLine.setUsageArgs("[OPTIONS] <project.xml | input.gcode>");
+      cmdLine.setAllowConfigAsFirstArg(false);
+      cmdLine.setAllowPositionalArgs(true);
+
+      cmdLine.addTarget("resolution", resolution, "Grid resolution of the "
+                        "contouring kernels.  Valid values are 'low', "
+                        "'medium', 'high' or a decimal value.");
+      cmdLine.addTarget("lookup", lookup, "Move lookup structure.  Valid "
+                        "values are 'aabb_tree', 'oct_tree', 'linear_bvh' or "
+                        "'auto'.");
+      cmdLine.addTarget("samples", samples, "Number of points sampled in the "
+                        "workpiece.  Their candidate moves are the inputs of "
+                        "the sweep kernels.");
+      cmdLine.addTarget("runs", runs, "Run each kernel this many times and "
+                        "report the fastest.");
+      cmdLine.addTarget("kernels", kernels, "The kernels to time.");
+      cmdLine.addTarget("radius", radius, "Tool radius of the sweep kernels.");
+      cmdLine.addTarget("length", length, "Tool length of the sweep kernels.");
+
+      Logger::instance().setLogTime(false);
+      Logger::instance().setLogNoInfoHeader(true);
+      Logger::instance().setVerbosity(1);
+    }
+
+
+    void record() {
+      // Points sampled uniformly in the workpiece, the same every run
+      cb::Rectangle3D bounds = project.getWorkpieceBounds();
+      mt19937 rng(1);
+      uniform_real_distribution<double> unit(0, 1);
+
+      for (unsigned i = 0; i < samples; i++) {
+        cb::Vector3D p;
+        for (unsigned j = 0; j < 3; j++)
+          p[j] = bounds.getMin()[j] + unit(rng) * bounds.getDimensions()[j];
+        points.push_back(p);
+      }
+
+      // Straight moves which may cut the points
+      vector<const GCode::Move *> moves;
+      for (unsigned i = 0; i < points.size(); i++) {
+        moves.clear();
+        sweep->collisions(points[i], moves);
+
+        for (unsigned j = 0; j < moves.size(); j++)
+          if (!moves[j]->isArc()) {
+            SweepInput input = {moves[j], points[i]};
+            sweepInputs.push_back(input);
+          }
+      }
+
+      // Grouped by move for the batched kernels
+      stable_sort(sweepInputs.begin(), sweepInputs.end());
+
+      // QEF systems of the cells the surface crosses
+      for (unsigned i = 0; i < grids.size(); i++) {
+        GridTreeRef &grid = grids[i];
+        CubeSlice slice(grid);
+
+        for (unsigned z = 0; z < grid.getSteps().z(); z++) {
+          if (z) slice.shift();
+          slice.compute(*cutWP);
+
+          for (unsigned x = 0; x < grid.getSteps().x(); x++)
+            for (unsigned y = 0; y < grid.getSteps().y(); y++) {
+              uint8_t index = slice.getIndex(x, y);
+              if (!index || index == 0xff) continue;
+              if (samples <= qefInputs.size()) return;
+
+              qefInputs.push_back(getQEFInput(grid, x, y, z));
+            }
+        }
+      }
+    }
+
+
+    QEFInput getQEFInput(const GridTreeRef &grid, unsigned x, unsigned y,
+                         unsigned z) {
+      double res = grid.getResolution();
+      double h = res / 16;
+
+      cb::Vector3D corners[8];
+      double depths[8];
+      for (unsigned i = 0; i < 8; i++) {
+        cb::Vector3D offset(x + cellCorners[i][0], y + cellCorners[i][1],
+                            z + cellCorners[i][2]);
+        corners[i] = grid.getOffset() + offset * res;
+        depths[i] = cutWP->depth(corners[i]);
+      }
+
+      // As in DualContouring, relative to the mean of the intersections
+      vector<Edge> edges;
+      for (unsigned i = 0; i < 12; i++) {
+        unsigned a = cellEdges[i][0];
+        unsigned b = cellEdges[i][1];
+        if ((depths[a] < 0) == (depths[b] < 0)) continue;
+
+        cb::Vector3D pa = corners[a];
+        cb::Vector3D pb = corners[b];
+        double da = depths[a];
+        double db = depths[b];
+
+        Edge e;
+        e.vertex = cutWP->linearIntersect(pa, da, pb, db);
+
+        for (unsigned j = 0; j < 3; j++) {
+          cb::Vector3D offset;
+          offset[j] = h;
+          e.normal[j] =
+            cutWP->depth(e.vertex - offset) - cutWP->depth(e.vertex + offset);
+        }
+
+        double len = e.normal.length();
+        if (len) e.normal /= len;
+
+        edges.push_back(e);
+      }
+
+      cb::Vector3D mass;
+      for (unsigned i = 0; i < edges.size(); i++) mass += edges[i].vertex;
+      if (!edges.empty()) mass /= edges.size();
+
+      QEFInput input;
+      input.rows = 0;
+
+      for (unsigned i = 0; i < edges.size(); i++) {
+        const cb::Vector3D &n = edges[i].normal;
+        if (!n.lengthSquared()) continue;
+
+        for (unsigned j = 0; j < 3; j++) input.mat[input.rows][j] = n[j];
+        input.vec[input.rows++] = n.dot(edges[i].vertex - mass);
+      }
+
+      for (; input.rows < 3; input.rows++) {
+        input.mat[input.rows][0] = input.mat[input.rows][1] =
+          input.mat[input.rows][2] = 0;
+        input.vec[input.rows] = 0;
+      }
+
+      return input;
+    }
+
+
+    SmartPointer<Sweep> getSweep(const string &name) {
+      if (name == "conic") return new ConicSweep(length, radius, radius);
+      if (name == "spheroid") return new SpheroidSweep(radius, 2 * radius);
+
+      // A ball nose, as ToolSweep builds it
+      SmartPointer<CompositeSweep> composite = new CompositeSweep;
+      composite->add(new SpheroidSweep(radius, 2 * radius), 0);
+      composite->add(new ConicSweep(length, radius, radius), radius);
+      return composite;
+    }
+
+
+    uint64_t sweepDepth(const Sweep &s) {
+      double sum = 0;
+
+      for (unsigned i = 0; i < sweepInputs.size(); i++) {
+        const SweepInput &input = sweepInputs[i];
+        sum += s.depth(input.move->getStartPt(), input.move->getEndPt(),
+                       input.p);
+      }
+
+      sinkValue = sum;
+      return sweepInputs.size();
+    }
+
+
+    uint64_t sweepDepthBatch(const Sweep &s) {
+      vector<double> xs, ys, zs, out;
+      double sum = 0;
+
+      for (unsigned i = 0; i < sweepInputs.size();) {
+        const GCode::Move *move = sweepInputs[i].move;
+
+        xs.clear(); ys.clear(); zs.clear();
+        for (; i < sweepInputs.size() && sweepInputs[i].move == move; i++) {
+          const cb::Vector3D &p = sweepInputs[i].p;
+          xs.push_back(p.x());
+          ys.push_back(p.y());
+          zs.push_back(p.z());
+        }
+
+        out.resize(xs.size());
+        s.depth(move->getStartPt(), move->getEndPt(), &xs[0], &ys[0], &zs[0],
+                xs.size(), &out[0]);
+        sum += out[0];
+      }
+
+      sinkValue = sum;
+      return sweepInputs.size();
+    }
+
+
+    uint64_t collisions() {
+      vector<const GCode::Move *> moves;
+      uint64_t count = 0;
+
+      for (unsigned i = 0; i < points.size(); i++) {
+        moves.clear();
+        sweep->collisions(points[i], moves);
+        count += moves.size();
+      }
+
+      sinkValue = count;
+      return points.size();
+    }
+
+
+    uint64_t cubeSlice() {
+      uint64_t cells = 0;
+
+      for (unsigned i = 0; i < grids.size(); i++) {
+        GridTreeRef &grid = grids[i];
+        CubeSlice slice(grid);
+
+        for (unsigned z = 0; z < grid.getSteps().z(); z++) {
+          if (z) slice.shift();
+          slice.compute(*cutWP);
+        }
+
+        cells += grid.getTotalCells();
+      }
+
+      return cells;
+    }
+
+
+    /// Only the cell kernel is timed, slices are computed beforehand
+    uint64_t doCells(SliceContourGenerator &generator, double &seconds) {
+      uint64_t cells = 0;
+      seconds = 0;
+
+      for (unsigned i = 0; i < grids.size(); i++) {
+        GridTreeRef &grid = grids[i];
+        CubeSlice slice(grid);
+        const cb::Vector3U &steps = grid.getSteps();
+
+        for (unsigned z = 0; z < steps.z(); z++) {
+          if (z) slice.shift();
+          slice.compute(*cutWP);
+          generator.doSlice(*cutWP, slice, z);
+
+          double start = Timer::now();
+
+          for (unsigned x = 0; x < steps.x(); x++)
+            for (unsigned y = 0; y < steps.y(); y++) {
+              uint8_t index = slice.getIndex(x, y);
+              if (!index || index == 0xff) continue;
+
+              generator.doCell(grid, slice, x, y);
+              cells++;
+            }
+
+          seconds += Timer::now() - start;
+        }
+
+        grid.clear();
+      }
+
+      return cells;
+    }
+
+
+    uint64_t qef() {
+      cb::Vector3D sum;
+
+      for (unsigned i = 0; i < qefInputs.size(); i++) {
+        // evaluate() works in place
+        QEFInput input = qefInputs[i];
+        sum += QEF::evaluate(input.mat, input.vec, input.rows);
+      }
+
+      sinkValue = sum.x();
+      return qefInputs.size();
+    }
+
+
+    uint64_t timeKernel(const string &kernel, double &seconds) {
+      uint64_t count = 0;
+      seconds = numeric_limits<double>::max();
+
+      for (unsigned i = 0; i < runs && !shouldQuit(); i++) {
+        double start = Timer::now();
+        double elapsed = -1;
+
+        if (kernel == "conic" || kernel == "spheroid" ||
+            kernel == "composite")
+          count = sweepDepth(*getSweep(kernel));
+
+        else if (String::endsWith(kernel, "-batch"))
+          count = sweepDepthBatch
+            (*getSweep(kernel.substr(0, kernel.length() - 6)));
+
+        else if (kernel == "collisions") count = collisions();
+        else if (kernel == "cube-slice") count = cubeSlice();
+
+        else if (kernel == "mcubes-cell") {
+          MarchingCubes generator;
+          count = doCells(generator, elapsed);
+
+        } else if (kernel == "cms-cell") {
+          CubicalMarchingSquares generator;
+          count = doCells(generator, elapsed);
+
+        } else if (kernel == "qef") count = qef();
+        else THROW("Invalid kernel '" << kernel << "'");
+
+        if (elapsed < 0) elapsed = Timer::now() - start;
+        seconds = min(seconds, elapsed);
+      }
+
+      return count;
+    }
+
+
+    // From Application
+    int init(int argc, char *argv[]) {
+      int ret = Application::init(argc, argv);
+      if (ret == -1) return ret;
+
+      const vector<string> &args = cmdLine.getPositionalArgs();
+      if (args.size() != 1)
+        THROW("Expected one project, GCode or TPL input argument.");
+
+      const string &input = args[0];
+      if (SystemUtilities::extension(input) == "xml") project.load(input);
+      else project.addFile(input);
+
+      ResolutionMode resMode = ResolutionMode::RESOLUTION_MANUAL;
+      double res = 0;
+
+      try {
+        res = String::parseDouble(resolution);
+      } catch (const Exception &e) {}
+
+      if (res) project.setResolution(res);
+      else resMode = ResolutionMode::parse(resolution, resMode);
+      project.setResolutionMode(resMode);
+
+      project.time = numeric_limits<double>::max();
+      project.threads = 1;
+      if (!lookup.empty()) project.lookup = LookupMode::parse(lookup);
+      project.workpiece = project.getWorkpieceBounds();
+      project.path = cutSim.computeToolPath(project);
+      project.updateAutomaticWorkpiece(*project.path);
+
+      sweep = new ToolSweep(project.path, 0, numeric_limits<double>::max(),
+                            project.lookup, 1);
+      cutWP = new CutWorkpiece(sweep, project.getWorkpieceBounds());
+
+      cb::Rectangle3D bbox =
+        project.getWorkpieceBounds().grow(project.getResolution() * 0.9);
+      tree = new GridTree(Grid(bbox, project.getResolution()));
+      tree->partition(grids, bbox, 1);
+
+      record();
+
+      LOG_INFO(1, "Recorded " << sweepInputs.size() << " sweep inputs and "
+               << qefInputs.size() << " QEF inputs");
+
+      return 0;
+    }
+
+
+    void run() {
+      vector<string> names;
+      String::tokenize(kernels, names);
+
+      JSON::Writer writer(cout, 0, false);
+      writer.beginList();
+
+      for (unsigned i = 0; i < names.size() && !shouldQuit(); i++) {
+        const string &kernel = names[i];
+        double seconds;
+        uint64_t count = timeKernel(kernel, seconds);
+
+        LOG_INFO(1, kernel << ": " << seconds << "s");
+
+        writer.appendDict();
+        writer.insert("kernel", kernel);
+        writer.insert("count", count);
+        writer.insert("seconds", seconds);
+        writer.insert("ns_per_op", count ? seconds * 1e9 / count : 0);
+        writer.insert("ops_per_sec", seconds ? count / seconds : 0);
+        writer.endDict();
+      }
+
+      writer.endList();
+      writer.close();
+      cout << endl;
+    }
+  };
+}
+
+
+int main(int argc, char *argv[]) {
+  return doApplication<CAMotics::KernelBenchApp>(argc, argv);
+}
@@ -0,0 +1,652 @@
+#include <Python.h>
+
+#include <camotics/sim/Project.h>
+#include <camotics/sim/CutSim.h>
+#include <camotics/contour/TriangleSurface.h>
+#include <camotics/contour/CompositeSurface.h>
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/config/Options.h>
+#include <cbang/os/SystemUtilities.h>
+
+#include <limits>
+#include <exception>
+
+using namespace std;
+using namespace cb;
+using namespace CAMotics;
+
+
+// Run a C++ call with the GIL released, raising RuntimeError if it throws
+#define PY_COMPUTE(CALL)                                          \
+  do {                                                            \
+    string _error;                                                \
+    Py_BEGIN_ALLOW_THREADS;                                       \
+    try {CALL;} catch (const std::exception &e) {_error = e.what();} \
+    Py_END_ALLOW_THREADS;                                         \
+    if (!_error.empty()) {                                        \
+      PyErr_SetString(PyExc_RuntimeError, _error.c_str());        \
+      return 0;                                                   \
+    }                                                             \
+  } while (0)
+
+#define PY_TRY try {
+#define PY_CATCH(RET)                                             \
+  } catch (const std::exception &e) {                             \
+    PyErr_SetString(PyExc_RuntimeError, e.what());                \
+    return RET;                                                   \
+  }
+
+
+static PyTypeObject ArrayViewType = {PyVarObject_HEAD_INIT(0, 0)};
+static PyTypeObject ProjectType = {PyVarObject_HEAD_INIT(0, 0)};
+static PyTypeObject ToolPathType = {PyVarObject_HEAD_INIT(0, 0)};
+static PyTypeObject SurfaceType = {PyVarObject_HEAD_INIT(0, 0)};
+static PyTypeObject CutSimType = {PyVarObject_HEAD_INIT(0, 0)};
+
+
+/******************************************************************************
+ * ArrayView, a read-only buffer over memory owned by another object.  NumPy
+ * wraps it without copying, e.g. numpy.asarray(surface.vertices()).
+ */
+typedef struct {
+  PyObject_HEAD;
+  PyObject *owner;
+  const char *data;
+  const char *format;
+  int ndim;
+  Py_ssize_t itemsize;
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+} PyArrayView;
+
+
+static void _view_dealloc(PyArrayView *self) {
+  Py_XDECREF(self->owner);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+static int _view_getbuffer(PyArrayView *self, Py_buffer *view, int flags) {
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "Array is read-only");
+    return -1;
+  }
+
+  bool strided = (flags & PyBUF_STRIDES) == PyBUF_STRIDES;
+  bool contiguous = self->strides[self->ndim - 1] == self->itemsize &&
+    (self->ndim == 1 || self->strides[0] == self->itemsize * self->shape[1]);
+
+  if (!strided && !contiguous) {
+    PyErr_SetString(PyExc_BufferError, "Array is not contiguous");
+    return -1;
+  }
+
+  view->obj = (PyObject *)self;
+  Py_INCREF(self);
+
+  view->buf = (void *)self->data;
+  view->len = self->itemsize * self->shape[0] *
+    (self->ndim == 2 ? self->shape[1] : 1);
+  view->readonly = 1;
+  view->itemsize = self->itemsize;
+  view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : 0;
+  view->ndim = self->ndim;
+  view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : 0;
+  view->strides = strided ? self->strides : 0;
+  view->suboffsets = 0;
+  view->internal = 0;
+
+  return 0;
+}
+
+
+static PyBufferProcs viewBuffer = {(getbufferproc)_view_getbuffer, 0};
+
+
+/// A view of @param rows of @param cols items, or one column if zero,
+/// each row @param stride bytes after the last.  @param owner is kept alive.
+static PyObject *newView(PyObject *owner, const void *data,
+                         const char *format, Py_ssize_t itemsize,
+                         Py_ssize_t rows, Py_ssize_t cols, Py_ssize_t stride) {
+  static const double empty = 0;
+
+  PyArrayView *self =
+    (PyArrayView *)ArrayViewType.tp_alloc(&ArrayViewType, 0);
+  if (!self) return 0;
+
+  Py_INCREF(owner);
+  self->owner = owner;
+  self->data = rows ? (const char *)data : (const char *)&empty;
+  self->format = format;
+  self->ndim = cols ? 2 : 1;
+  self->itemsize = itemsize;
+  self->shape[0] = rows;
+  self->shape[1] = cols;
+  self->strides[0] = stride;
+  self->strides[1] = itemsize;
+
+  return (PyObject *)self;
+}
+
+
+/******************************************************************************
+ * Project
+ */
+typedef struct {
+  PyObject_HEAD;
+  Options *options;
+  Project *project;
+} PyProject;
+
+
+static void _project_dealloc(PyProject *self) {
+  if (self->project) delete self->project;
+  if (self->options) delete self->options;
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+static int _project_init(PyProject *self, PyObject *args, PyObject *kwds) {
+  const char *filename = 0;
+
+  static const char *kwlist[] = {"filename", 0};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|s", (char **)kwlist,
+                                   &filename))
+    return -1;
+
+  PY_TRY;
+  if (!self->options) self->options = new Options;
+  if (self->project) delete self->project;
+  self->project = new Project(*self->options, filename ? filename : "");
+
+  // Simulate to the end unless told otherwise
+  self->project->time = numeric_limits<double>::max();
+  PY_CATCH(-1);
+
+  return 0;
+}
+
+
+static PyObject *_project_load(PyProject *self, PyObject *args) {
+  const char *filename;
+
+  if (!PyArg_ParseTuple(args, "s", &filename)) return 0;
+
+  PY_TRY;
+  self->project->load(filename);
+  PY_CATCH(0);
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_project_add_file(PyProject *self, PyObject *args) {
+  const char *filename;
+
+  if (!PyArg_ParseTuple(args, "s", &filename)) return 0;
+
+  PY_TRY;
+  self->project->addFile(filename);
+  PY_CATCH(0);
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_project_set_resolution(PyProject *self, PyObject *args) {
+  double resolution;
+
+  if (!PyArg_ParseTuple(args, "d", &resolution)) return 0;
+
+  PY_TRY;
+  self->project->setResolution(resolution);
+  self->project->setResolutionMode(ResolutionMode::RESOLUTION_MANUAL);
+  PY_CATCH(0);
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_project_get_resolution(PyProject *self) {
+  return PyFloat_FromDouble(self->project->getResolution());
+}
+
+
+static PyObject *_project_set_time(PyProject *self, PyObject *args) {
+  double time;
+
+  if (!PyArg_ParseTuple(args, "d", &time)) return 0;
+
+  self->project->time = time;
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_project_set_threads(PyProject *self, PyObject *args) {
+  unsigned threads;
+
+  if (!PyArg_ParseTuple(args, "I", &threads)) return 0;
+
+  self->project->threads = threads;
+
+  Py_RETURN_NONE;
+}
+
+
+static PyObject *_project_compute_hash(PyProject *self) {
+  string hash;
+
+  PY_TRY;
+  hash = self->project->computeHash();
+  PY_CATCH(0);
+
+  return PyUnicode_FromStringAndSize(hash.data(), hash.size());
+}
+
+
+static PyMethodDef _project_methods[] = {
+  {"load", (PyCFunction)_project_load, METH_VARARGS,
+   "Load a project file"},
+  {"add_file", (PyCFunction)_project_add_file, METH_VARARGS,
+   "Add a TPL or G-Code file"},
+  {"set_resolution", (PyCFunction)_project_set_resolution, METH_VARARGS,
+   "Set a manual simulation grid resolution"},
+  {"get_resolution", (PyCFunction)_project_get_resolution, METH_NOARGS,
+   "Get the simulation grid resolution"},
+  {"set_time", (PyCFunction)_project_set_time, METH_VARARGS,
+   "Set the simulation end time in seconds"},
+  {"set_threads", (PyCFunction)_project_set_threads, METH_VARARGS,
+   "Set the number of simulation threads, zero for all"},
+  {"compute_hash", (PyCFunction)_project_compute_hash, METH_NOARGS,
+   "Hash of the simulation settings"},
+  {0}
+};
+
+
+/******************************************************************************
+ * ToolPath.  Move end points are viewed in place.  The other columns are
+ * copied out of the moves once, on the first call to columns().
+ */
+struct ToolPathColumns {
+  vector<int32_t> type;
+  vector<int32_t> tool;
+  vector<uint32_t> line;
+  vector<double> feed;
+  vector<double> speed;
+  vector<double> startTime;
+  vector<double> time;
+};
+
+
+typedef struct {
+  PyObject_HEAD;
+  SmartPointer<const GCode::ToolPath> *path;
+  ToolPathColumns *columns;
+} PyToolPath;
+
+
+static PyObject *newToolPath(const SmartPointer<const GCode::ToolPath> &path) {
+  PyToolPath *self = (PyToolPath *)ToolPathType.tp_alloc(&ToolPathType, 0);
+  if (self) self->path = new SmartPointer<const GCode::ToolPath>(path);
+  return (PyObject *)self;
+}
+
+
+static void _path_dealloc(PyToolPath *self) {
+  if (self->path) delete self->path;
+  if (self->columns) delete self->columns;
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+static PyObject *_path_size(PyToolPath *self) {
+  return PyLong_FromSize_t((*self->path)->size());
+}
+
+
+static PyObject *_path_time(PyToolPath *self) {
+  return PyFloat_FromDouble((*self->path)->getTime());
+}
+
+
+static PyObject *pointView(PyToolPath *self, bool end) {
+  const GCode::ToolPath &path = **self->path;
+  if (path.empty())
+    return newView((PyObject *)self, 0, "d", sizeof(double), 0, 3, 0);
+
+  const GCode::Move &move = path.at(0);
+  const double *data = &(end ? move.getEndPt() : move.getStartPt())[0];
+
+  return newView((PyObject *)self, data, "d", sizeof(double), path.size(), 3,
+                 sizeof(GCode::Move));
+}
+
+
+static PyObject *_path_starts(PyToolPath *self) {return pointView(self, 0);}
+static PyObject *_path_ends(PyToolPath *self) {return pointView(self, 1);}
+
+
+static bool addColumn(PyObject *dict, PyToolPath *self, const char *name,
+                      const void *data, const char *format, size_t itemsize,
+                      size_t size) {
+  PyObject *view =
+    newView((PyObject *)self, data, format, itemsize, size, 0, itemsize);
+  if (!view) return false;
+
+  int ret = PyDict_SetItemString(dict, name, view);
+  Py_DECREF(view);
+
+  return !ret;
+}
+
+
+static PyObject *_path_columns(PyToolPath *self) {
+  const GCode::ToolPath &path = **self->path;
+
+  if (!self->columns) {
+    ToolPathColumns *c = self->columns = new ToolPathColumns;
+
+    for (unsigned i = 0; i < path.size(); i++) {
+      const GCode::Move &move = path.at(i);
+
+      c->type.push_back(move.getType());
+      c->tool.push_back(move.getTool());
+      c->line.push_back(move.getLine());
+      c->feed.push_back(move.getFeed());
+      c->speed.push_back(move.getSpeed());
+      c->startTime.push_back(move.getStartTime());
+      c->time.push_back(move.getTime());
+    }
+  }
+
+  const ToolPathColumns &c = *self->columns;
+  size_t n = path.size();
+
+  PyObject *dict = PyDict_New();
+  if (!dict) return 0;
+
+  if (addColumn(dict, self, "type", c.type.data(), "i", 4, n) &&
+      addColumn(dict, self, "tool", c.tool.data(), "i", 4, n) &&
+      addColumn(dict, self, "line", c.line.data(), "I", 4, n) &&
+      addColumn(dict, self, "feed", c.feed.data(), "d", 8, n) &&
+      addColumn(dict, self, "speed", c.speed.data(), "d", 8, n) &&
+      addColumn(dict, self, "start_time", c.startTime.data(), "d", 8, n) &&
+      addColumn(dict, self, "time", c.time.data(), "d", 8, n))
+    return dict;
+
+  Py_DECREF(dict);
+  return 0;
+}
+
+
+static PyMethodDef _path_methods[] = {
+  {"size", (PyCFunction)_path_size, METH_NOARGS, "Number of moves"},
+  {"time", (PyCFunction)_path_time, METH_NOARGS,
+   "Total run time in seconds"},
+  {"starts", (PyCFunction)_path_starts, METH_NOARGS,
+   "Move start points as an N x 3 array of doubles"},
+  {"ends", (PyCFunction)_path_ends, METH_NOARGS,
+   "Move end points as an N x 3 array of doubles"},
+  {"columns", (PyCFunction)_path_columns, METH_NOARGS,
+   "Dict of per move arrays: type, tool, line, feed, speed, start_time and "
+   "time"},
+  {0}
+};
+
+
+/******************************************************************************
+ * Surface
+ */
+typedef struct {
+  PyObject_HEAD;
+  SmartPointer<Surface> *surface;
+  const TriangleSurface *mesh;
+} PySurface;
+
+
+static PyObject *newSurface(SmartPointer<Surface> surface) {
+  if (surface.isNull()) Py_RETURN_NONE;
+
+  // Cluster results are made of parts, join them for viewing
+  CompositeSurface *composite =
+    dynamic_cast<CompositeSurface *>(surface.get());
+  if (composite) surface = composite->consolidate();
+
+  const TriangleSurface *mesh =
+    dynamic_cast<const TriangleSurface *>(surface.get());
+  if (!mesh) {
+    PyErr_SetString(PyExc_TypeError, "Unsupported surface type");
+    return 0;
+  }
+
+  PySurface *self = (PySurface *)SurfaceType.tp_alloc(&SurfaceType, 0);
+  if (!self) return 0;
+
+  self->surface = new SmartPointer<Surface>(surface);
+  self->mesh = mesh;
+
+  return (PyObject *)self;
+}
+
+
+static void _surface_dealloc(PySurface *self) {
+  if (self->surface) delete self->surface;
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+static PyObject *_surface_count(PySurface *self) {
+  return PyLong_FromUnsignedLongLong(self->mesh->getCount());
+}
+
+
+static PyObject *_surface_vertices(PySurface *self) {
+  const vector<float> &v = self->mesh->getVertices();
+  return newView((PyObject *)self, v.data(), "f", 4, v.size() / 3, 3, 12);
+}
+
+
+static PyObject *_surface_normals(PySurface *self) {
+  const vector<float> &n = self->mesh->getNormals();
+  return newView((PyObject *)self, n.data(), "f", 4, n.size() / 3, 3, 12);
+}
+
+
+static PyObject *_surface_indices(PySurface *self) {
+  const vector<uint32_t> &i = self->mesh->getIndices();
+  return newView((PyObject *)self, i.data(), "I", 4, i.size() / 3, 3, 12);
+}
+
+
+static PyObject *_surface_bounds(PySurface *self) {
+  Rectangle3D b = self->mesh->getBounds();
+  return Py_BuildValue("(ddd)(ddd)", b.getMin().x(), b.getMin().y(),
+                       b.getMin().z(), b.getMax().x(), b.getMax().y(),
+                       b.getMax().z());
+}
+
+
+static PyObject *_surface_write_stl(PySurface *self, PyObject *args) {
+  const char *filename;
+  int binary = 1;
+
+  if (!PyArg_ParseTuple(args, "s|p", &filename, &binary)) return 0;
+
+  const Surface &surface = **self->surface;
+  string path = filename;
+  PY_COMPUTE(surface.writeSTL(*SystemUtilities::oopen(path), binary,
+                              "CAMotics Surface", ""));
+
+  Py_RETURN_NONE;
+}
+
+
+static PyMethodDef _surface_methods[] = {
+  {"count", (PyCFunction)_surface_count, METH_NOARGS, "Number of triangles"},
+  {"vertices", (PyCFunction)_surface_vertices, METH_NOARGS,
+   "Vertex positions as an N x 3 array of floats"},
+  {"normals", (PyCFunction)_surface_normals, METH_NOARGS,
+   "Vertex normals as an N x 3 array of floats"},
+  {"indices", (PyCFunction)_surface_indices, METH_NOARGS,
+   "Triangle vertex indices as an M x 3 array of uint32"},
+  {"bounds", (PyCFunction)_surface_bounds, METH_NOARGS,
+   "Bounds as ((minX, minY, minZ), (maxX, maxY, maxZ))"},
+  {"write_stl", (PyCFunction)_surface_write_stl, METH_VARARGS,
+   "Write to an STL file, binary by default"},
+  {0}
+};
+
+
+/******************************************************************************
+ * CutSim
+ */
+typedef struct {
+  PyObject_HEAD;
+  CutSim *cutSim;
+} PyCutSim;
+
+
+static void _cutsim_dealloc(PyCutSim *self) {
+  if (self->cutSim) delete self->cutSim;
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+static int _cutsim_init(PyCutSim *self, PyObject *args, PyObject *kwds) {
+  if (!PyArg_ParseTuple(args, "")) return -1;
+
+  PY_TRY;
+  if (!self->cutSim) self->cutSim = new CutSim;
+  PY_CATCH(-1);
+
+  return 0;
+}
+
+
+static void computeToolPath(CutSim &cutSim, Project &project) {
+  project.workpiece = project.getWorkpieceBounds();
+  project.path = cutSim.computeToolPath(project);
+  if (!project.path.isNull()) project.updateAutomaticWorkpiece(*project.path);
+}
+
+
+static PyObject *_cutsim_compute_tool_path(PyCutSim *self, PyObject *args) {
+  PyProject *py;
+
+  if (!PyArg_ParseTuple(args, "O!", &ProjectType, &py)) return 0;
+
+  Project &project = *py->project;
+  PY_COMPUTE(computeToolPath(*self->cutSim, project));
+
+  if (project.path.isNull()) Py_RETURN_NONE; // Interrupted
+  return newToolPath(project.path);
+}
+
+
+static PyObject *_cutsim_compute_surface(PyCutSim *self, PyObject *args) {
+  PyProject *py;
+
+  if (!PyArg_ParseTuple(args, "O!", &ProjectType, &py)) return 0;
+
+  Project &project = *py->project;
+  CutSim &cutSim = *self->cutSim;
+  SmartPointer<Surface> surface;
+
+  if (project.path.isNull()) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Project has no tool path, call compute_tool_path()");
+    return 0;
+  }
+
+  PY_COMPUTE(surface = cutSim.computeSurface(project));
+
+  return newSurface(surface);
+}
+
+
+static PyObject *_cutsim_interrupt(PyCutSim *self) {
+  self->cutSim->interrupt();
+  Py_RETURN_NONE;
+}
+
+
+static PyMethodDef _cutsim_methods[] = {
+  {"compute_tool_path", (PyCFunction)_cutsim_compute_tool_path, METH_VARARGS,
+   "Run a Project's programs, set its tool path and return it"},
+  {"compute_surface", (PyCFunction)_cutsim_compute_surface, METH_VARARGS,
+   "Simulate a Project's tool path and return the Surface"},
+  {"interrupt", (PyCFunction)_cutsim_interrupt, METH_NOARGS,
+   "Stop the running computation, callable from other threads"},
+  {0}
+};
+
+
+/******************************************************************************
+ * Module
+ */
+static bool readyType(PyTypeObject &type, const char *name, size_t size,
+                      destructor dealloc, PyMethodDef *methods,
+                      const char *doc, initproc init = 0) {
+  type.tp_name = name;
+  type.tp_basicsize = size;
+  type.tp_dealloc = dealloc;
+  type.tp_flags = Py_TPFLAGS_DEFAULT;
+  type.tp_doc = doc;
+  type.tp_methods = methods;
+  type.tp_init = init;
+  if (init) type.tp_new = PyType_GenericNew;
+
+  return PyType_Ready(&type) == 0;
+}
+
+
+static bool addType(PyObject *m, PyTypeObject &type, const char *name) {
+  Py_INCREF(&type);
+  if (!PyModule_AddObject(m, name, (PyObject *)&type)) return true;
+  Py_DECREF(&type);
+  return false;
+}
+
+
+static struct PyModuleDef module = {
+  PyModuleDef_HEAD_INIT, "camotics", 0, -1, 0, 0, 0, 0, 0
+};
+
+
+PyMODINIT_FUNC PyInit_camotics() {
+  ArrayViewType.tp_as_buffer = &viewBuffer;
+
+  if (!readyType(ArrayViewType, "camotics.ArrayView", sizeof(PyArrayView),
+                 (destructor)_view_dealloc, 0,
+                 "Read-only array, use numpy.asarray() to view it") ||
+      !readyType(ProjectType, "camotics.Project", sizeof(PyProject),
+                 (destructor)_project_dealloc, _project_methods,
+                 "Simulation project", (initproc)_project_init) ||
+      !readyType(ToolPathType, "camotics.ToolPath", sizeof(PyToolPath),
+                 (destructor)_path_dealloc, _path_methods, "Tool path") ||
+      !readyType(SurfaceType, "camotics.Surface", sizeof(PySurface),
+                 (destructor)_surface_dealloc, _surface_methods,
+                 "Simulated surface") ||
+      !readyType(CutSimType, "camotics.CutSim", sizeof(PyCutSim),
+                 (destructor)_cutsim_dealloc, _cutsim_methods,
+                 "Computes tool paths and surfaces with the GIL released",
+                 (initproc)_cutsim_init))
+    return 0;
+
+  PyObject *m = PyModule_Create(&module);
+  if (!m) return 0;
+
+  if (!addType(m, ProjectType, "Project") ||
+      !addType(m, ToolPathType, "ToolPath") ||
+      !addType(m, SurfaceType, "Surface") ||
+      !addType(m, CutSimType, "CutSim")) {
+    Py_DECREF(m);
+    return 0;
+  }
+
+  return m;
+}
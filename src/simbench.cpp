@@ -0,0 +1,471 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include <camotics/Application.h>
+#include <camotics/MemoryUsage.h>
+#include <camotics/sim/CutSim.h>
+#include <camotics/sim/CostModel.h>
+#include <camotics/sim/Project.h>
+#include <camotics/contour/Surface.h>
+#include <camotics/contour/FieldStats.h>
+
+#include <gcode/ToolPath.h>
+
+#include <cbang/Exception.h>
+#include <cbang/ApplicationMain.h>
+#include <cbang/String.h>
+#include <cbang/config/Options.h>
+#include <cbang/json/JSON.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SystemInfo.h>
+#include <cbang/time/Timer.h>
+
+#include <iostream>
+#include <limits>
+#include <map>
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace cb;
+using namespace std;
+using namespace CAMotics;
+
+
+namespace {
+  struct Usage {
+    double wall;
+    double cpu;
+    uint64_t peakRSS;
+
+    Usage() : wall(Timer::now()), cpu(0), peakRSS(0) {
+#ifndef _WIN32
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+
+      cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+#ifdef __APPLE__
+      peakRSS = usage.ru_maxrss;
+#else
+      peakRSS = (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+  };
+
+
+  struct Phase {
+    double wall;
+    double cpu;
+
+    Phase() : wall(numeric_limits<double>::max()), cpu(0) {}
+
+    void add(const Usage &start, const Usage &end) {
+      if (end.wall - start.wall < wall) {
+        wall = end.wall - start.wall;
+        cpu = end.cpu - start.cpu;
+      }
+    }
+  };
+
+
+  class Synthetic {
+    string text;
+
+  public:
+    const string &getText() const {return text;}
+
+
+    void line(const char *fmt, ...) {
+      char buffer[256];
+
+      va_list ap;
+      va_start(ap, fmt);
+      vsnprintf(buffer, sizeof(buffer), fmt, ap);
+      va_end(ap);
+
+      text += buffer;
+      text += '\n';
+    }
+
+
+    void header() {
+      line("G21 G90 G17");
+      line("T1 M6");
+      line("F1500 S12000 M3");
+      line("G0 Z5");
+    }
+
+
+    /// A 3D finishing raster over a wavy surface with a ball end mill
+    void finishing(double size) {
+      header();
+
+      double step = 0.5;
+      unsigned rows = size / step;
+      unsigned cols = size / step;
+
+      for (unsigned i = 0; i <= rows; i++) {
+        double y = i * step;
+
+        for (unsigned j = 0; j <= cols; j++) {
+          double x = (i & 1 ? cols - j : j) * step;
+          double z = sin(x * 0.05) * cos(y * 0.07) * 4 - 5;
+          line("G1 X%.4f Y%.4f Z%.4f", x, y, z);
+        }
+      }
+
+      line("G0 Z5");
+      line("M2");
+    }
+
+
+    /// Stepped pocketing with many long straight passes
+    void pocket(double size) {
+      header();
+
+      double step = 2;
+      for (double z = -1; -10 <= z; z -= 1) {
+        line("G0 X0 Y0");
+        line("G1 Z%.4f", z);
+
+        for (double y = 0; y <= size; y += step) {
+          line("G1 X%.4f Y%.4f", size, y);
+          if (y + step <= size) line("G1 X0 Y%.4f", y + step);
+        }
+
+        line("G0 Z5");
+      }
+
+      line("M2");
+    }
+  };
+}
+
+
+namespace CAMotics {
+  class SimBenchApp : public Application {
+    string examples;
+    string synthetic;
+    double size;
+    string workDir;
+    string resolutions;
+    string threadCounts;
+    unsigned warmup;
+    unsigned runs;
+    string baseline;
+    double tolerance;
+    string calibrate;
+
+    vector<string> inputs;
+    vector<CostModel::Sample> samples;
+    unsigned regressions;
+
+    struct Result {
+      string input;
+      string resolution;
+      unsigned threads;
+      double cells;
+      uint64_t triangles;
+      uint64_t peakRSS;
+      map<string, Phase> phases;
+      FieldStats stats;
+      MemoryUsage memory; ///< Peak of each structure
+      double res;
+      CostModel::Features features;
+
+      Result() : threads(0), cells(0), triangles(0), peakRSS(0), res(0) {}
+    };
+
+  public:
+    SimBenchApp() :
+      Application("CAMotics Simulation Benchmark"),
+      examples("examples/camotics/camotics.xml examples/box/box.xml "
+               "examples/tiger/tiger.xml"),
+      synthetic("finishing pocket"), size(200), workDir("."),
+      resolutions("low medium high"), warmup(1), runs(3), tolerance(0.1),
+      regressions(0) {
+
+      threadCounts = String(1);
+      unsigned cpus = SystemInfo::instance().getCPUCount();
+      if (1 < cpus) threadCounts += " " + String(cpus);
+
+      cmdLine.setUsageArgs("[OPTIONS] [project.xml | input.gcode]...");
+      cmdLine.setAllowConfigAsFirstArg(false);
+      cmdLine.setAllowPositionalArgs(true);
+
+      cmdLine.addTarget("examples", examples, "Example projects to run.  "
+                        "Projects or GCode given as arguments are also run.");
+      cmdLine.addTarget("synthetic", synthetic, "The generated jobs to run.  "
+                        "Any of 'finishing' or 'pocket'.");
+      cmdLine.addTarget("size", size, "Width and depth in mm of the "
+                        "generated jobs.");
+      cmdLine.addTarget("work-dir", workDir, "Where the generated jobs are "
+                        "written.");
+      cmdLine.addTarget("resolutions", resolutions, "Resolutions to run.  "
+                        "Each is 'low', 'medium', 'high' or a decimal value.");
+      cmdLine.addTarget("threads", threadCounts, "Thread counts to run.");
+      cmdLine.addTarget("warmup", warmup, "Untimed runs before each case.");
+      cmdLine.addTarget("runs", runs, "Run each case this many times and "
+                        "report the fastest.");
+      cmdLine.addTarget("baseline", baseline, "Compare against results "
+                        "previously written by this program.");
+      cmdLine.addTarget("tolerance", tolerance, "Fraction by which a phase "
+                        "may be slower than the baseline before it is "
+                        "reported as a regression.");
+      cmdLine.addTarget("calibrate", calibrate, "Fit the rates of the cost "
+                        "model used by the 'budget' resolution mode to the "
+                        "runs and write them to this file.");
+
+      Logger::instance().setLogTime(false);
+      Logger::instance().setLogNoInfoHeader(true);
+      Logger::instance().setVerbosity(1);
+    }
+
+
+    void setResolution(Project &project, const string &resolution) {
+      ResolutionMode resMode = ResolutionMode::RESOLUTION_MANUAL;
+      double res = 0;
+
+      try {
+        res = String::parseDouble(resolution);
+      } catch (const Exception &e) {}
+
+      if (res) project.setResolution(res);
+      else resMode = ResolutionMode::parse(resolution, resMode);
+
+      project.setResolutionMode(resMode);
+    }
+
+
+    void simulate(Result &result, bool timed) {
+      Options options;
+      Project project(options);
+      CutSim cutSim;
+
+      if (SystemUtilities::extension(result.input) == "xml")
+        project.load(result.input);
+      else project.addFile(result.input);
+
+      setResolution(project, result.resolution);
+      project.time = numeric_limits<double>::max();
+      project.threads = result.threads;
+      project.workpiece = project.getWorkpieceBounds();
+
+      // No cache, every phase is computed
+      MemoryUsage::clearPeaks();
+      Usage start;
+      project.path = cutSim.computeToolPath(project);
+      project.updateAutomaticWorkpiece(*project.path);
+      Usage toolPath;
+      FieldStats::flush();
+      FieldStats before = FieldStats::getTotals();
+      SmartPointer<Surface> surface = cutSim.computeSurface(project);
+      FieldStats::flush();
+      Usage simulated;
+      surface = cutSim.reduceSurface(surface, result.threads);
+      Usage reduced;
+
+      if (!timed) return;
+
+      result.phases["toolpath"].add(start, toolPath);
+      result.phases["surface"].add(toolPath, simulated);
+      result.phases["reduce"].add(simulated, reduced);
+      result.phases["total"].add(start, reduced);
+
+      double res = project.getResolution();
+      result.cells =
+        project.getWorkpieceBounds().getVolume() / (res * res * res);
+      result.triangles = surface->getCount();
+      result.peakRSS = reduced.peakRSS;
+      result.stats = FieldStats::getTotals() - before;
+      result.memory = MemoryUsage::getPeaks();
+      result.res = res;
+
+      if (!calibrate.empty())
+        result.features = CostModel::measure
+          (project.path, project.getWorkpieceBounds(), result.threads);
+    }
+
+
+    void addSample(const Result &result) {
+      CostModel::Sample sample;
+      sample.features = result.features;
+      sample.resolution = result.res;
+      sample.cost.time = result.phases.find("surface")->second.wall;
+      sample.cost.memory = result.memory.getTotal();
+      samples.push_back(sample);
+    }
+
+
+    void compare(const Result &result, const JSON::Value &base) {
+      for (unsigned i = 0; i < base.size(); i++) {
+        const JSON::Value &entry = *base.get(i);
+
+        if (entry.getString("input") != result.input ||
+            entry.getString("resolution") != result.resolution ||
+            (unsigned)entry.getNumber("threads") != result.threads) continue;
+
+        const JSON::Value &phases = *entry.get("phases");
+        map<string, Phase>::const_iterator it;
+        for (it = result.phases.begin(); it != result.phases.end(); it++) {
+          if (!phases.has(it->first)) continue;
+
+          double was = phases.get(it->first)->getNumber("wall");
+          double ratio = it->second.wall / was;
+
+          if (1 + tolerance < ratio) {
+            LOG_WARNING(result.input << ' ' << result.resolution << ' '
+                        << result.threads << " threads " << it->first
+                        << ": " << was << "s -> " << it->second.wall << "s");
+            regressions++;
+          }
+        }
+
+        return;
+      }
+    }
+
+
+    void write(JSON::Sink &sink, const Result &result) {
+      const Phase &surface = result.phases.find("surface")->second;
+
+      sink.appendDict();
+      sink.insert("input", result.input);
+      sink.insert("resolution", result.resolution);
+      sink.insert("threads", result.threads);
+      sink.insert("cells", result.cells);
+      sink.insert("triangles", result.triangles);
+      sink.insert("peak_rss", result.peakRSS);
+      sink.insert("cells_per_sec", result.cells / surface.wall);
+      sink.insert("triangles_per_sec", result.triangles / surface.wall);
+
+      sink.insertDict("phases");
+      map<string, Phase>::const_iterator it;
+      for (it = result.phases.begin(); it != result.phases.end(); it++) {
+        sink.insertDict(it->first);
+        sink.insert("wall", it->second.wall);
+        sink.insert("cpu", it->second.cpu);
+        sink.endDict();
+      }
+      sink.endDict();
+
+      sink.beginInsert("field");
+      result.stats.write(sink);
+
+      sink.beginInsert("memory");
+      result.memory.write(sink);
+
+      sink.endDict();
+    }
+
+
+    // From Application
+    int init(int argc, char *argv[]) {
+      int ret = Application::init(argc, argv);
+      if (ret == -1) return ret;
+
+      String::tokenize(examples, inputs);
+
+      vector<string> names;
+      String::tokenize(synthetic, names);
+
+      for (unsigned i = 0; i < names.size(); i++) {
+        Synthetic job;
+
+        if (names[i] == "finishing") job.finishing(size);
+        else if (names[i] == "pocket") job.pocket(size);
+        else THROW("Invalid synthetic job '" << names[i] << "'");
+
+        string path = SystemUtilities::joinPath
+          (workDir, "simbench-" + names[i] + ".nc");
+        *SystemUtilities::oopen(path) << job.getText();
+        inputs.push_back(path);
+      }
+
+      const vector<string> &args = cmdLine.getPositionalArgs();
+      inputs.insert(inputs.end(), args.begin(), args.end());
+
+      return 0;
+    }
+
+
+    void run() {
+      vector<string> resList;
+      vector<string> threadList;
+      String::tokenize(resolutions, resList);
+      String::tokenize(threadCounts, threadList);
+
+      SmartPointer<JSON::Value> base;
+      if (!baseline.empty()) base = JSON::Reader::parse(InputSource(baseline));
+
+      JSON::Writer writer(cout, 0, false);
+      writer.beginList();
+
+      for (unsigned i = 0; i < inputs.size() && !shouldQuit(); i++)
+        for (unsigned j = 0; j < resList.size() && !shouldQuit(); j++)
+          for (unsigned k = 0; k < threadList.size() && !shouldQuit(); k++) {
+            Result result;
+            result.input = inputs[i];
+            result.resolution = resList[j];
+            result.threads = String::parseU32(threadList[k]);
+
+            for (unsigned r = 0; r < warmup && !shouldQuit(); r++)
+              simulate(result, false);
+
+            for (unsigned r = 0; r < runs && !shouldQuit(); r++)
+              simulate(result, true);
+
+            if (shouldQuit()) break;
+
+            LOG_INFO(1, result.input << ' ' << result.resolution << ' '
+                     << result.threads << " threads: "
+                     << result.phases["total"].wall << "s");
+
+            if (!base.isNull()) compare(result, *base);
+            if (!calibrate.empty()) addSample(result);
+            write(writer, result);
+          }
+
+      writer.endList();
+      writer.close();
+      cout << endl;
+
+      if (!calibrate.empty() && !samples.empty()) {
+        CostModel model;
+        model.calibrate(samples);
+        model.save(calibrate);
+        LOG_INFO(1, "Cost model written to " << calibrate);
+      }
+
+      if (regressions) THROWS(regressions << " phases slower than baseline");
+    }
+  };
+}
+
+
+int main(int argc, char *argv[]) {
+  return doApplication<CAMotics::SimBenchApp>(argc, argv);
+}
@@ -0,0 +1,268 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "ASCIIScanner.h"
+
+#include <cbang/Exception.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+using namespace cb;
+using namespace STL;
+
+
+namespace {
+  inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' ||
+      c == '\v';
+  }
+
+
+  inline char toLower(char c) {return 'A' <= c && c <= 'Z' ? c + 32 : c;}
+
+
+  // Powers of ten which are exactly representable as doubles
+  const double exactPowers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+
+  const int maxExactPower = 22;
+  const uint64_t maxExactMantissa = (uint64_t)1 << 53;
+}
+
+
+ASCIIScanner::ASCIIScanner(const char *begin, const char *end, bool last) :
+  ptr(begin), end(end), last(last), incomplete(false) {}
+
+
+bool ASCIIScanner::isEnd() {
+  while (ptr < end && isSpace(*ptr)) ptr++;
+  if (ptr == end && !last) incomplete = true;
+  return ptr == end && last;
+}
+
+
+bool ASCIIScanner::check(const char *keyword) {
+  const char *start = ptr;
+  const char *token;
+  unsigned length;
+
+  bool found = nextToken(token, length) && tokenIs(token, length, keyword);
+  ptr = start;
+
+  return found;
+}
+
+
+bool ASCIIScanner::match(const char *keyword) {
+  const char *start = ptr;
+  if (matchToken(keyword)) return true;
+  ptr = start;
+  return false;
+}
+
+
+bool ASCIIScanner::skipLine() {
+  const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+
+  if (eol) ptr = eol + 1;
+  else if (last) ptr = end;
+  else {
+    incomplete = true;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool ASCIIScanner::readFacet(float facet[12]) {
+  const char *start = ptr;
+
+  if (matchToken("facet") && matchToken("normal")) {
+    bool ok = parseFloat(facet[0]) && parseFloat(facet[1]) &&
+      parseFloat(facet[2]) && matchToken("outer") && matchToken("loop");
+
+    for (unsigned i = 1; ok && i < 4; i++)
+      ok = matchToken("vertex") && parseFloat(facet[i * 3]) &&
+        parseFloat(facet[i * 3 + 1]) && parseFloat(facet[i * 3 + 2]);
+
+    if (ok && matchToken("endloop") && matchToken("endfacet")) return true;
+  }
+
+  ptr = start;
+  return false;
+}
+
+
+const char *ASCIIScanner::findFacet(const char *begin, const char *end) {
+  const char *p = begin;
+
+  while (p + 5 <= end) {
+    const char *f = (const char *)memchr(p, 'f', end - p);
+    const char *F = (const char *)memchr(p, 'F', end - p);
+    if (!f || (F && F < f)) f = F;
+    if (!f || end < f + 5) break;
+
+    // Must be a whole word, which excludes "endfacet"
+    if ((f == begin || isSpace(f[-1])) && (f + 5 == end || isSpace(f[5]))) {
+      unsigned i;
+      for (i = 1; i < 5; i++)
+        if (toLower(f[i]) != "facet"[i]) break;
+      if (i == 5) return f;
+    }
+
+    p = f + 1;
+  }
+
+  return end;
+}
+
+
+bool ASCIIScanner::nextToken(const char *&token, unsigned &length) {
+  while (ptr < end && isSpace(*ptr)) ptr++;
+
+  token = ptr;
+  while (ptr < end && !isSpace(*ptr)) ptr++;
+  length = ptr - token;
+
+  // The token may continue in the next buffer
+  if (ptr == end && !last) {
+    incomplete = true;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool ASCIIScanner::tokenIs(const char *token, unsigned length,
+                           const char *keyword) const {
+  for (unsigned i = 0; i < length; i++)
+    if (!keyword[i] || toLower(token[i]) != keyword[i]) return false;
+
+  return !keyword[length];
+}
+
+
+bool ASCIIScanner::matchToken(const char *keyword) {
+  const char *token;
+  unsigned length;
+
+  if (!nextToken(token, length)) return false;
+
+  if (!length) THROWS("Expected '" << keyword << "' found end of STL");
+  if (!tokenIs(token, length, keyword))
+    THROWS("Expected '" << keyword << "' found '"
+           << string(token, length < 32 ? length : 32) << "' in STL");
+
+  return true;
+}
+
+
+bool ASCIIScanner::parseFloat(float &value) {
+  const char *token;
+  unsigned length;
+
+  if (!nextToken(token, length)) return false;
+  if (!length) THROW("Expected number found end of STL");
+
+  const char *s = token;
+  const char *e = token + length;
+
+  bool negative = *s == '-';
+  if (*s == '-' || *s == '+') s++;
+
+  // Mantissa, dropping digits that do not fit in 64-bits
+  uint64_t mantissa = 0;
+  unsigned digits = 0;
+  bool haveDigits = false;
+  int exponent = 0;
+
+  for (; s < e && '0' <= *s && *s <= '9'; s++) {
+    haveDigits = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*s - '0');
+      if (mantissa) digits++;
+    } else exponent++;
+  }
+
+  if (s < e && *s == '.')
+    for (s++; s < e && '0' <= *s && *s <= '9'; s++) {
+      haveDigits = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*s - '0');
+        if (mantissa) digits++;
+        exponent--;
+      }
+    }
+
+  // Exponent
+  bool valid = haveDigits;
+  if (valid && s < e && (*s == 'e' || *s == 'E')) {
+    s++;
+    bool negativeExp = s < e && *s == '-';
+    if (s < e && (*s == '-' || *s == '+')) s++;
+
+    int exp = 0;
+    valid = s < e;
+    for (; s < e && '0' <= *s && *s <= '9'; s++)
+      if (exp < 100000) exp = exp * 10 + (*s - '0');
+
+    exponent += negativeExp ? -exp : exp;
+  }
+
+  if (valid && s == e) {
+    if (!mantissa) {
+      value = negative ? -0.0f : 0.0f;
+      return true;
+    }
+
+    // Exact when both the mantissa and power of ten are exact doubles
+    if (mantissa <= maxExactMantissa && -maxExactPower <= exponent &&
+        exponent <= maxExactPower) {
+      double x = (double)mantissa;
+      if (exponent < 0) x /= exactPowers[-exponent];
+      else x *= exactPowers[exponent];
+
+      value = (float)(negative ? -x : x);
+      return true;
+    }
+  }
+
+  // Anything else, including "nan" and "inf", goes to the C library
+  char buffer[64];
+  if (sizeof(buffer) <= length)
+    THROWS("Invalid number '" << string(token, 32) << "...' in STL");
+
+  memcpy(buffer, token, length);
+  buffer[length] = 0;
+
+  char *parsed;
+  double x = strtod(buffer, &parsed);
+  if (parsed != buffer + length)
+    THROWS("Invalid number '" << buffer << "' in STL");
+
+  value = (float)x;
+  return true;
+}
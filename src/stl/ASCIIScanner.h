@@ -0,0 +1,78 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+
+
+namespace STL {
+  /***
+   * Scans ASCII STL directly from a character buffer.  Tokens are compared
+   * and numbers parsed in place so no strings are allocated per token.
+   *
+   * If the buffer is not the end of the input, scanning stops when a token
+   * may continue past the end of the buffer and needsMore() returns true.
+   * The scanner is then left where it was before the call so the caller can
+   * refill the buffer and try again.
+   */
+  class ASCIIScanner {
+    const char *ptr;
+    const char *end;
+    bool last;
+    bool incomplete;
+
+  public:
+    ASCIIScanner(const char *begin, const char *end, bool last = true);
+
+    const char *getPosition() const {return ptr;}
+    bool needsMore() const {return incomplete;}
+
+    /// @return true if only whitespace remains
+    bool isEnd();
+
+    /// @return true if the next token is @param keyword, ignoring case
+    bool check(const char *keyword);
+    /// Throws if the next token is not @param keyword
+    bool match(const char *keyword);
+    /// Skip to the start of the next line
+    bool skipLine();
+
+    /***
+     * Read one facet starting with the "facet" keyword.  Twelve floats are
+     * written to @param facet, the normal followed by the three vertices.
+     * @return false if more input is needed.
+     */
+    bool readFacet(float facet[12]);
+
+    /// @return the start of the first facet at or after @param begin
+    static const char *findFacet(const char *begin, const char *end);
+
+  protected:
+    bool nextToken(const char *&token, unsigned &length);
+    bool tokenIs(const char *token, unsigned length,
+                 const char *keyword) const;
+    bool matchToken(const char *keyword);
+    bool parseFloat(float &value);
+  };
+}
@@ -0,0 +1,288 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#include "MappedReader.h"
+#include "BinaryTriangle.h"
+#include "ASCIIScanner.h"
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/SmartPointer.h>
+#include <cbang/os/SysError.h>
+#include <cbang/os/Thread.h>
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace cb;
+using namespace STL;
+
+
+namespace {
+  const unsigned headerSize = 84;
+
+  // Bytes of ASCII per part when parsing in parallel
+  const unsigned minParseBytes = 1 << 20;
+
+
+  class ParseJob : public Thread {
+    const char *begin;
+    const char *end;
+
+  public:
+    vector<float> facets;
+    SmartPointer<Exception> error;
+
+    ParseJob(const char *begin, const char *end) : begin(begin), end(end) {}
+
+
+    void parse() {
+      ASCIIScanner scanner(begin, end);
+      float facet[12];
+
+      while (!scanner.isEnd()) {
+        // Files may hold more than one solid
+        if (scanner.check("endsolid") || scanner.check("solid")) {
+          scanner.skipLine();
+          continue;
+        }
+
+        scanner.readFacet(facet);
+        facets.insert(facets.end(), facet, facet + 12);
+      }
+    }
+
+
+    // From Thread
+    void run() {
+      try {
+        parse();
+      } catch (const Exception &e) {
+        error = new Exception(e);
+      }
+    }
+  };
+}
+
+
+MappedReader::MappedReader(const string &path, unsigned threads) :
+  data(0), size(0), count(0), next(0) {
+#ifdef _WIN32
+  mapping = 0;
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+  if (file == INVALID_HANDLE_VALUE)
+    THROWS("Failed to open '" << path << "': " << SysError());
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    close();
+    THROWS("Failed to get size of '" << path << "': " << SysError());
+  }
+  size = fileSize.QuadPart;
+
+  if (size) {
+    mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if (mapping) data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ,
+                                                    0, 0, 0);
+  }
+
+#else
+  fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) THROWS("Failed to open '" << path << "': " << SysError());
+
+  struct stat info;
+  if (fstat(fd, &info)) {
+    close();
+    THROWS("Failed to stat '" << path << "': " << SysError());
+  }
+  size = info.st_size;
+
+  if (size) {
+    void *addr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      data = (const char *)addr;
+      madvise(addr, size, MADV_WILLNEED);
+    }
+  }
+#endif
+
+  if (!data) {
+    close();
+    THROWS("Failed to map '" << path << "'");
+  }
+
+  // The facet count must match the file size or this is not a binary STL
+  if (headerSize <= size) memcpy(&count, data + 80, 4);
+
+  if (headerSize <= size &&
+      size == headerSize + (uint64_t)count * sizeof(BinaryTriangle))
+    hash = string(data, strnlen(data, 80));
+
+  else if (6 <= size && String::toLower(string(data, 6)) == "solid ") {
+    try {
+      parseASCII(threads);
+    } catch (...) {
+      close();
+      throw;
+    }
+
+    close(); // The parsed facets are all that is needed
+
+  } else {
+    close();
+    THROWS("'" << path << "' is not an STL file");
+  }
+}
+
+
+MappedReader::~MappedReader() {close();}
+
+
+void MappedReader::getFacet(uint32_t i, Vector3F &v1, Vector3F &v2,
+                            Vector3F &v3, Vector3F &normal) const {
+  if (!data) {
+    const float *facet = &facets[(uint64_t)i * 12];
+
+    for (unsigned j = 0; j < 3; j++) {
+      normal[j] = facet[j];
+      v1[j] = facet[3 + j];
+      v2[j] = facet[6 + j];
+      v3[j] = facet[9 + j];
+    }
+
+    return;
+  }
+
+  // Facets are not aligned
+  BinaryTriangle tri;
+  memcpy(&tri, data + headerSize + (uint64_t)i * sizeof(tri), sizeof(tri));
+
+  v1 = tri.v1;
+  v2 = tri.v2;
+  v3 = tri.v3;
+  normal = tri.normal;
+}
+
+
+uint32_t MappedReader::readHeader(string &name, string &hash) {
+  name = this->name;
+  hash = this->hash;
+  next = 0;
+
+  return count;
+}
+
+
+void MappedReader::readFacet(Vector3F &v1, Vector3F &v2, Vector3F &v3,
+                             Vector3F &normal) {
+  if (count <= next) THROW("No more facets");
+  getFacet(next++, v1, v2, v3, normal);
+}
+
+
+void MappedReader::parseASCII(unsigned threads) {
+  const char *end = data + size;
+
+  // Name and hash on the "solid" line
+  ASCIIScanner header(data + 6, end);
+  header.skipLine();
+  const char *begin = header.getPosition();
+
+  name = String::trim(string(data + 6, begin));
+  string::size_type pos = name.find_last_of(' ');
+  if (pos != string::npos) {
+    hash = name.substr(pos + 1);
+    name = String::trim(name.substr(0, pos));
+  }
+
+  // Split in to parts at facet boundaries
+  unsigned parts = (end - begin) / minParseBytes;
+  if (threads < parts) parts = threads;
+  if (!parts) parts = 1;
+
+  vector<SmartPointer<ParseJob> > jobs;
+  const char *partBegin = begin;
+
+  for (unsigned i = 0; i < parts; i++) {
+    const char *partEnd = end;
+
+    if (i < parts - 1) {
+      partEnd = begin + (end - begin) * (i + 1) / parts;
+      if (partEnd < partBegin) partEnd = partBegin;
+      partEnd = ASCIIScanner::findFacet(partEnd, end);
+    }
+
+    jobs.push_back(new ParseJob(partBegin, partEnd));
+    partBegin = partEnd;
+  }
+
+  // Parse
+  for (unsigned i = 1; i < parts; i++) jobs[i]->start();
+  jobs[0]->run();
+  for (unsigned i = 1; i < parts; i++) jobs[i]->join();
+
+  uint64_t floats = 0;
+  for (unsigned i = 0; i < parts; i++) {
+    if (jobs[i]->error.isSet()) throw *jobs[i]->error;
+    floats += jobs[i]->facets.size();
+  }
+
+  if ((uint64_t)~(uint32_t)0 < floats / 12) THROW("Too many facets in STL");
+
+  // Combine
+  facets.reserve(floats);
+  for (unsigned i = 0; i < parts; i++) {
+    facets.insert(facets.end(), jobs[i]->facets.begin(),
+                  jobs[i]->facets.end());
+    jobs[i]->facets = vector<float>();
+  }
+
+  count = floats / 12;
+}
+
+
+void MappedReader::close() {
+#ifdef _WIN32
+  if (data) UnmapViewOfFile(data);
+  if (mapping) CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+  mapping = 0;
+  file = INVALID_HANDLE_VALUE;
+
+#else
+  if (data) munmap((void *)data, size);
+  if (fd != -1) ::close(fd);
+  fd = -1;
+#endif
+
+  data = 0;
+}
@@ -0,0 +1,75 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+#pragma once
+
+
+#include "Source.h"
+
+#include <string>
+#include <vector>
+
+
+namespace STL {
+  /***
+   * Reads an STL file by mapping it in to memory.  Facets can be read
+   * in order as a Source or by index, from any number of threads at once.
+   *
+   * ASCII files are parsed up front, split at facet boundaries so the parts
+   * can be scanned in parallel, and the mapping is released afterwards.
+   */
+  class MappedReader : public Source {
+    std::string name;
+    std::string hash;
+    std::vector<float> facets; // ASCII facets, normal first
+    const char *data;
+    uint64_t size;
+    uint32_t count;
+    uint32_t next;
+
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#else
+    int fd;
+#endif
+
+  public:
+    /// Throws if @param path cannot be mapped or is not an STL file.
+    MappedReader(const std::string &path, unsigned threads = 1);
+    ~MappedReader();
+
+    const std::string &getHash() const {return hash;}
+    void getFacet(uint32_t i, cb::Vector3F &v1, cb::Vector3F &v2,
+                  cb::Vector3F &v3, cb::Vector3F &normal) const;
+
+    // From Source
+    uint32_t readHeader(std::string &name, std::string &hash);
+    uint32_t getFacetCount() const {return count;}
+    bool hasMore() {return next < count;}
+    void readFacet(cb::Vector3F &v1, cb::Vector3F &v2, cb::Vector3F &v3,
+                   cb::Vector3F &normal);
+    void readFooter() {}
+
+  protected:
+    void parseASCII(unsigned threads);
+    void close();
+  };
+}
@@ -20,19 +20,25 @@
 
 #include "Reader.h"
 #include "BinaryTriangle.h"
+#include "ASCIIScanner.h"
 
 #include <cbang/String.h>
 
+#include <string.h>
+
 using namespace std;
 using namespace cb;
 using namespace STL;
 
 
+namespace {
+  const unsigned blockSize = 1 << 20;
+}
+
+
 Reader::Reader(const InputSource &source) :
   source(source), stream(source.getStream()), binary(true), count(0),
-  parser(source.getStream()) {
-  parser.setCaseSensitive(false);
-}
+  start(0), fill(0) {}
 
 
 uint32_t Reader::readHeader(string &name, string &hash) {
@@ -73,8 +79,16 @@ uint32_t Reader::readHeader(string &name, string &hash) {
 
 
 bool Reader::hasMore() {
-  return !stream.fail() &&
-    ((binary && count) || (!binary && parser.check("facet")));
+  if (binary) return !stream.fail() && count;
+
+  while (true) {
+    ASCIIScanner scanner(buffer.data() + start, buffer.data() + fill,
+                         !stream.good());
+
+    if (scanner.check("facet")) return true;
+    if (!scanner.needsMore()) return false;
+    readBlock();
+  }
 }
 
 
@@ -92,34 +106,59 @@ void Reader::readFacet(Vector3F &v1, Vector3F &v2, Vector3F &v3,
     count--;
 
   } else {
-    parser.advance();
-    parser.match("normal");
-
-    for (unsigned i = 0; i < 3; i++)
-      normal[i] = String::parseDouble(parser.advance());
+    float facet[12];
 
-    parser.match("outer");
-    parser.match("loop");
+    while (true) {
+      ASCIIScanner scanner(buffer.data() + start, buffer.data() + fill,
+                           !stream.good());
 
-    Vector3F *vertices[3] = {&v1, &v2, &v3};
+      if (scanner.readFacet(facet)) {
+        start = scanner.getPosition() - buffer.data();
+        break;
+      }
 
-    for (unsigned i = 0; i < 3; i++) {
-      parser.match("vertex");
+      readBlock();
+    }
 
+    Vector3F *vectors[4] = {&normal, &v1, &v2, &v3};
+    for (unsigned i = 0; i < 4; i++)
       for (unsigned j = 0; j < 3; j++)
-        (*vertices[i])[j] = String::parseDouble(parser.advance());
+        (*vectors[i])[j] = facet[i * 3 + j];
+  }
+}
+
+
+void Reader::readFooter() {
+  if (binary) return;
+
+  while (true) {
+    ASCIIScanner scanner(buffer.data() + start, buffer.data() + fill,
+                         !stream.good());
+
+    if (scanner.match("endsolid") && scanner.skipLine()) {
+      start = scanner.getPosition() - buffer.data();
+      break;
     }
 
-    parser.match("endloop");
-    parser.match("endfacet");
+    readBlock();
   }
 }
 
 
-void Reader::readFooter() {
-  if (!binary) {
-    parser.match("endsolid");
-    char buffer[1024];
-    stream.getline(buffer, 1023); // Name
+bool Reader::readBlock() {
+  if (!stream.good()) return false;
+
+  // Keep unread input, growing the buffer if a token spans a whole block
+  if (start) {
+    memmove(buffer.data(), buffer.data() + start, fill - start);
+    fill -= start;
+    start = 0;
   }
+
+  if (buffer.size() < fill + blockSize) buffer.resize(fill + blockSize);
+
+  stream.read(buffer.data() + fill, buffer.size() - fill);
+  fill += stream.gcount();
+
+  return true;
 }
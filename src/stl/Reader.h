@@ -24,7 +24,8 @@
 #include "Source.h"
 
 #include <cbang/io/InputSource.h>
-#include <cbang/io/Parser.h>
+
+#include <vector>
 
 
 namespace STL {
@@ -33,7 +34,11 @@ namespace STL {
     std::istream &stream;
     bool binary;
     uint32_t count;
-    cb::Parser parser;
+
+    // ASCII input is scanned from large blocks
+    std::vector<char> buffer;
+    unsigned start;
+    unsigned fill;
 
   public:
     Reader(const cb::InputSource &source);
@@ -44,5 +49,8 @@ namespace STL {
     void readFacet(cb::Vector3F &v1, cb::Vector3F &v2, cb::Vector3F &v3,
                    cb::Vector3F &normal);
     void readFooter();
+
+  protected:
+    bool readBlock();
   };
 }
@@ -20,10 +20,24 @@
 
 #include "Sink.h"
 #include "Facet.h"
+#include "BinaryTriangle.h"
 
+using namespace cb;
 using namespace STL;
 
 
 void Sink::writeFacet(const Facet &facet) {
   writeFacet(facet[0], facet[1], facet[2], facet.getNormal());
 }
+
+
+void Sink::writeFacets(const BinaryTriangle *facets, unsigned count) {
+  for (unsigned i = 0; i < count; i++) {
+    const BinaryTriangle &t = facets[i];
+
+    writeFacet(Vector3F(t.v1[0], t.v1[1], t.v1[2]),
+               Vector3F(t.v2[0], t.v2[1], t.v2[2]),
+               Vector3F(t.v3[0], t.v3[1], t.v3[2]),
+               Vector3F(t.normal[0], t.normal[1], t.normal[2]));
+  }
+}
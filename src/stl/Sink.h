@@ -29,6 +29,7 @@
 
 namespace STL {
   class Facet;
+  struct BinaryTriangle;
 
   class Sink {
   public:
@@ -43,5 +44,9 @@ namespace STL {
                              const std::string &hash = std::string()) = 0;
 
     void writeFacet(const Facet &facet);
+
+    /// Write @param count packed facets at once.  Sinks which can copy the
+    /// records directly should override this.
+    virtual void writeFacets(const BinaryTriangle *facets, unsigned count);
   };
 }
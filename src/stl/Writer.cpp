@@ -21,6 +21,8 @@
 #include "Writer.h"
 #include "BinaryTriangle.h"
 
+#include <cbang/Exception.h>
+
 #include <string.h>
 
 using namespace std;
@@ -38,6 +40,7 @@ void Writer::writeHeader(const string &name, uint32_t count,
     stream.write(header, 80);
 
     // Count
+    countPos = stream.tellp();
     stream.write((char *)&count, 4);
 
   } else {
@@ -91,6 +94,13 @@ void Writer::writeFacet(const Triangle3F &t, const Vector3F &normal) {
 }
 
 
+void Writer::writeFacets(const BinaryTriangle *facets, unsigned count) {
+  // Binary records are copied in one write
+  if (binary) stream.write((const char *)facets, count * sizeof(*facets));
+  else Sink::writeFacets(facets, count);
+}
+
+
 void Writer::writeFooter(const string &name, const string &hash) {
   if (!binary) {
     stream << "endsolid " << name;
@@ -98,3 +108,16 @@ void Writer::writeFooter(const string &name, const string &hash) {
     stream << '\n';
   }
 }
+
+
+void Writer::updateCount(uint32_t count) {
+  if (!binary) return; // ASCII STL has no count
+
+  streampos end = stream.tellp();
+  if (countPos == streampos(-1) || end == streampos(-1))
+    THROW("Cannot update STL facet count, output is not seekable");
+
+  stream.seekp(countPos);
+  stream.write((char *)&count, 4);
+  stream.seekp(end);
+}
@@ -32,17 +32,23 @@ namespace STL {
     cb::OutputSink sink;
     std::ostream &stream;
     bool binary;
+    std::streampos countPos;
 
   public:
     Writer(const cb::OutputSink &sink, bool binary) :
-      sink(sink), stream(sink.getStream()), binary(binary) {}
+      sink(sink), stream(sink.getStream()), binary(binary), countPos(-1) {}
 
     void writeHeader(const std::string &name, uint32_t count,
                      const std::string &hash = std::string());
     void writeFacet(const cb::Vector3F &v1, const cb::Vector3F &v2,
                     const cb::Vector3F &v3, const cb::Vector3F &normal);
     void writeFacet(const cb::Triangle3F &t, const cb::Vector3F &normal);
+    void writeFacets(const BinaryTriangle *facets, unsigned count);
     void writeFooter(const std::string &name,
                      const std::string &hash = std::string());
+
+    /// Rewrite the facet count of a binary header already written, for
+    /// when it was not known in advance.  The stream must be seekable.
+    void updateCount(uint32_t count);
   };
 }
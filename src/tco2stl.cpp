@@ -25,28 +25,62 @@
 
 #include <cbang/Exception.h>
 #include <cbang/ApplicationMain.h>
-#include <cbang/io/StringInputSource.h>
-#include <cbang/json/Reader.h>
 #include <cbang/util/DefaultCatch.h>
 #include <cbang/geom/Vector.h>
+#include <cbang/log/Logger.h>
 
 #include <vector>
 #include <iostream>
+#include <sstream>
+
+#include <stdlib.h>
+#include <string.h>
 
 using namespace std;
 using namespace cb;
 
 
+namespace {
+  const char *skipSpace(const char *s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+    return s;
+  }
+
+
+  /// Parses up to @param max comma separated numbers from @param s.
+  /// @return the number of values found, more than @param max if too many.
+  unsigned parseNumbers(const char *s, double *values, unsigned max) {
+    unsigned count = 0;
+
+    while (true) {
+      s = skipSpace(s);
+      if (!*s) break;
+
+      char *end;
+      double value = strtod(s, &end);
+      if (end == s) break;
+      if (count == max) return max + 1;
+      values[count++] = value;
+
+      s = skipSpace(end);
+      if (*s != ',') break;
+      s++;
+    }
+
+    return count;
+  }
+}
+
+
 class TC02STLApp : public CAMotics::Application {
-  SmartPointer<STL::Writer> writer;
-  vector<Triangle3F> triangles;
+  uint32_t facets;
 
 public:
-  TC02STLApp() : CAMotics::Application("TCO to STL converter") {}
+  TC02STLApp() :
+    CAMotics::Application("TCO to STL converter"), facets(0) {}
 
 
-  void parseBlock(const cb::InputSource &source) {
-    vector<Vector2U> lines;
+  void parseBlock(istream &stream, STL::Writer &writer) {
     vector<Vector3U> triangles;
     vector<Vector3F> vertices;
 
@@ -54,49 +88,41 @@ public:
     int numLines = -1;
     int numVertices = -1;
 
-    while (source.getStream().good()) {
-      string line = String::trim(source.getLine());
-      if (line.empty()) break;
+    string line;
+    double values[3];
+
+    while (getline(stream, line)) {
+      const char *s = skipSpace(line.c_str());
+      if (!*s) break;
 
-      switch (line[0]) {
+      switch (*s) {
       case 't':
       case 'l':
       case 'v': {
-        size_t equal = line.find('=');
-        if (equal == string::npos) continue;
-
-        int start = 1;
-        while (line[start] == '0') start++;
-        unsigned n = String::parseU32(line.substr(start));
+        const char *equal = strchr(s, '=');
+        if (!equal) continue;
 
-        vector<string> nums;
-        String::tokenize(line.substr(equal + 1), nums, ",");
+        unsigned n = strtoul(s + 1, 0, 10);
+        unsigned count = parseNumbers(equal + 1, values, 3);
 
-        if (line[0] == 't' && nums.size() == 3)
-          triangles.push_back(Vector3U(String::parseU32(nums[0]),
-                                       String::parseU32(nums[1]),
-                                       String::parseU32(nums[2])));
+        // Lines are not part of the surface
+        if (*s == 't' && count == 3)
+          triangles.push_back(Vector3U(values[0], values[1], values[2]));
 
-        else if (line[0] == 'l' && nums.size() == 2)
-          lines.push_back(Vector2U(String::parseU32(nums[0]),
-                                   String::parseU32(nums[1])));
-
-        else if (line[0] == 'v' && nums.size() == 3) {
+        else if (*s == 'v' && count == 3) {
           if (vertices.size() < n + 1) vertices.resize((n + 1) * 1.5);
-          vertices[n] = Vector3D(String::parseFloat(nums[0]),
-                                 String::parseFloat(nums[1]),
-                                 String::parseFloat(nums[2]));
+          vertices[n] = Vector3F(values[0], values[1], values[2]);
         }
 
         break;
       }
 
       case 'n':
-        if (1 < line.size())
-          switch (line[1]) {
-          case 't': numTriangles = String::parseU32(line.substr(3)); break;
-          case 'l': numLines = String::parseU32(line.substr(3)); break;
-          case 'v': numVertices = String::parseU32(line.substr(3)); break;
+        if (3 < strlen(s))
+          switch (s[1]) {
+          case 't': numTriangles = strtoul(s + 3, 0, 10); break;
+          case 'l': numLines = strtoul(s + 3, 0, 10); break;
+          case 'v': numVertices = strtoul(s + 3, 0, 10); break;
           }
         break;
 
@@ -104,37 +130,46 @@ public:
       }
     }
 
-    //if (0 <= numLines) lines.resize(numLines);
-    //if (0 <= numTriangles) triangles.resize(numTriangles);
-    //if (0 <= numVertices) vertices.resize(numVertices);
-
     LOG_INFO(1, "lines=" << numLines << " triangles=" << numTriangles
              << " vertices=" << numVertices);
 
-    // Assemble triangles
+    // Write this block's triangles
     for (unsigned i = 0; i < triangles.size(); i++) {
       const Vector3U &indices = triangles[i];
-      this->triangles.push_back(Triangle3F(vertices[indices[0]],
-                                           vertices[indices[1]],
-                                           vertices[indices[2]]));
+
+      for (unsigned j = 0; j < 3; j++)
+        if (vertices.size() <= indices[j])
+          THROWS("Triangle vertex " << indices[j] << " not found");
+
+      Triangle3F t(vertices[indices[0]], vertices[indices[1]],
+                   vertices[indices[2]]);
+      writer.writeFacet(t, CAMotics::Triangle::computeNormal(t));
+      facets++;
     }
   }
 
 
   // From cb::Reader
   void read(const cb::InputSource &source) {
-    while (source.getStream().good()) {
-      string line = String::trim(source.getLine());
-      if (!line.empty() && line[0] == '[') parseBlock(source);
-    }
+    // Facets are written as each block is read.  If the output cannot be
+    // seeked to fill in the facet count afterwards they are spooled instead.
+    bool seekable = cout.tellp() != streampos(-1);
+    ostringstream spool;
 
-    STL::Writer writer(cout, true);
+    STL::Writer writer(seekable ? (ostream &)cout : (ostream &)spool, true);
+    if (seekable) writer.writeHeader("tco2stl", 0);
 
-    writer.writeHeader("tco2stl", triangles.size());
+    facets = 0;
+    istream &stream = source.getStream();
+    string line;
 
-    for (unsigned i = 0; i < triangles.size(); i++) {
-      const Triangle3F &t = triangles[i];
-      writer.writeFacet(t, CAMotics::Triangle::computeNormal(t));
+    while (getline(stream, line))
+      if (*skipSpace(line.c_str()) == '[') parseBlock(stream, writer);
+
+    if (seekable) writer.updateCount(facets);
+    else {
+      STL::Writer(cout, true).writeHeader("tco2stl", facets);
+      if (facets) cout << spool.rdbuf();
     }
 
     writer.writeFooter("tco2stl");
@@ -20,18 +20,232 @@
 
 #include "ClipperModule.h"
 
+#include <cbang/Exception.h>
 #include <cbang/json/JSON.h>
+#include <cbang/os/SystemInfo.h>
+#include <cbang/os/Thread.h>
 
-#include <clipper/clipper.hpp>
+#include <algorithm>
+#include <cmath>
 
+using namespace std;
 using namespace cb;
 using namespace ClipperLib;
 using namespace tplang;
 
 
+namespace {
+  struct OffsetOptions {
+    JoinType join;
+    double limit;
+    bool autoFix;
+
+    OffsetOptions(const js::Value &args, int scale) :
+      join(args.has("join") ? (JoinType)args.getInteger("join") : jtRound),
+      limit(args.getNumber("limit") * scale),
+      autoFix(args.getBoolean("autoFix")) {}
+  };
+
+
+  // Below this many points splitting an offset is not worth the threads
+  const unsigned splitPoints = 4096;
+
+
+  struct Bounds {
+    long64 minX;
+    long64 minY;
+    long64 maxX;
+    long64 maxY;
+    unsigned poly;
+
+    bool operator<(const Bounds &o) const {return minX < o.minX;}
+  };
+
+
+  unsigned findGroup(vector<unsigned> &parent, unsigned i) {
+    while (parent[i] != i) i = parent[i] = parent[parent[i]];
+    return i;
+  }
+
+
+  /// Split polygons in to groups which can not meet after offsetting by
+  /// up to @param margin.  Holes stay with their outer polygons.
+  void partition(const Polygons &polys, double margin,
+                 vector<Polygons> &groups) {
+    vector<Bounds> bounds;
+
+    for (unsigned i = 0; i < polys.size(); i++) {
+      const Polygon &poly = polys[i];
+      if (poly.empty()) continue;
+
+      Bounds b = {poly[0].X, poly[0].Y, poly[0].X, poly[0].Y, i};
+      for (unsigned j = 1; j < poly.size(); j++) {
+        b.minX = std::min(b.minX, poly[j].X);
+        b.minY = std::min(b.minY, poly[j].Y);
+        b.maxX = std::max(b.maxX, poly[j].X);
+        b.maxY = std::max(b.maxY, poly[j].Y);
+      }
+
+      b.minX -= margin;
+      b.minY -= margin;
+      b.maxX += margin;
+      b.maxY += margin;
+      bounds.push_back(b);
+    }
+
+    // Sweep in X joining overlapping bounds
+    sort(bounds.begin(), bounds.end());
+
+    vector<unsigned> parent(bounds.size());
+    for (unsigned i = 0; i < parent.size(); i++) parent[i] = i;
+
+    vector<unsigned> active;
+    for (unsigned i = 0; i < bounds.size(); i++) {
+      const Bounds &b = bounds[i];
+      unsigned keep = 0;
+
+      for (unsigned j = 0; j < active.size(); j++) {
+        const Bounds &a = bounds[active[j]];
+        if (a.maxX < b.minX) continue; // Passed
+
+        if (b.minY <= a.maxY && a.minY <= b.maxY)
+          parent[findGroup(parent, active[j])] = findGroup(parent, i);
+
+        active[keep++] = active[j];
+      }
+
+      active.resize(keep);
+      active.push_back(i);
+    }
+
+    // Collect groups, keeping the input order within each
+    vector<int> groupIndex(bounds.size(), -1);
+    vector<unsigned> byPoly(polys.size(), ~0U);
+    for (unsigned i = 0; i < bounds.size(); i++) byPoly[bounds[i].poly] = i;
+
+    for (unsigned i = 0; i < polys.size(); i++) {
+      if (byPoly[i] == ~0U) continue;
+
+      unsigned root = findGroup(parent, byPoly[i]);
+      if (groupIndex[root] < 0) {
+        groupIndex[root] = groups.size();
+        groups.push_back(Polygons());
+      }
+
+      groups[groupIndex[root]].push_back(polys[i]);
+    }
+  }
+
+
+  // Offsets every stride-th polygon group, starting at first
+  class GroupOffsetJob : public Thread {
+    const vector<Polygons> &groups;
+    double delta;
+    const OffsetOptions &opts;
+    unsigned first;
+    unsigned stride;
+    vector<Polygons> &results;
+
+  public:
+    GroupOffsetJob(const vector<Polygons> &groups, double delta,
+                   const OffsetOptions &opts, unsigned first, unsigned stride,
+                   vector<Polygons> &results) :
+      groups(groups), delta(delta), opts(opts), first(first), stride(stride),
+      results(results) {}
+
+
+    // From Thread
+    void run() {
+      for (unsigned i = first; i < groups.size(); i += stride)
+        OffsetPolygons(groups[i], results[i], delta, opts.join, opts.limit,
+                       opts.autoFix);
+    }
+  };
+
+
+  SmartPointer<ClipperModule::Polygons>
+  offset(const ClipperModule::Polygons &in, double delta,
+         const OffsetOptions &opts, bool split) {
+    SmartPointer<ClipperModule::Polygons> out =
+      new ClipperModule::Polygons(in.scale, in.dict);
+    delta *= in.scale;
+
+    unsigned points = 0;
+    for (unsigned i = 0; i < in.polys.size(); i++)
+      points += in.polys[i].size();
+
+    // Miter joins can reach arbitrarily far so are never split
+    vector<Polygons> groups;
+    if (split && splitPoints <= points && opts.join != jtMiter)
+      partition(in.polys, 2 * fabs(delta), groups);
+
+    if (groups.size() < 2) {
+      OffsetPolygons(in.polys, out->polys, delta, opts.join, opts.limit,
+                     opts.autoFix);
+      return out;
+    }
+
+    // Separate groups can not interact, offset them on all cores and merge
+    vector<Polygons> results(groups.size());
+    unsigned jobCount =
+      std::min((unsigned)groups.size(), SystemInfo::instance().getCPUCount());
+    vector<SmartPointer<GroupOffsetJob> > jobs;
+
+    for (unsigned i = 0; i < jobCount; i++)
+      jobs.push_back
+        (new GroupOffsetJob(groups, delta, opts, i, jobCount, results));
+
+    for (unsigned i = 1; i < jobCount; i++) jobs[i]->start();
+    jobs[0]->run();
+    for (unsigned i = 1; i < jobCount; i++) jobs[i]->join();
+
+    for (unsigned i = 0; i < results.size(); i++)
+      out->polys.insert(out->polys.end(), results[i].begin(),
+                        results[i].end());
+
+    return out;
+  }
+
+
+  // Offsets every stride-th delta, starting at first
+  class OffsetJob : public Thread {
+    const ClipperModule::Polygons &in;
+    const vector<double> &deltas;
+    const OffsetOptions &opts;
+    unsigned first;
+    unsigned stride;
+    bool split;
+    vector<SmartPointer<ClipperModule::Polygons> > &results;
+
+  public:
+    OffsetJob(const ClipperModule::Polygons &in, const vector<double> &deltas,
+              const OffsetOptions &opts, unsigned first, unsigned stride,
+              bool split,
+              vector<SmartPointer<ClipperModule::Polygons> > &results) :
+      in(in), deltas(deltas), opts(opts), first(first), stride(stride),
+      split(split), results(results) {}
+
+
+    // From Thread
+    void run() {
+      for (unsigned i = first; i < deltas.size(); i += stride)
+        results[i] = offset(in, deltas[i], opts, split);
+    }
+  };
+}
+
+
 void ClipperModule::define(js::Sink &exports) {
+  exports.insert("polygons(polys, scale=1000000)", this,
+                 &ClipperModule::polygonsCB);
+  exports.insert("points(polys, scale=1000000)", this,
+                 &ClipperModule::pointsCB);
   exports.insert("offset(polys, delta, join, limit=1000, autoFix=true, "
-                 "scale=1000000)", this, &ClipperModule::offsetCB);
+                 "scale=1000000, native=false)", this,
+                 &ClipperModule::offsetCB);
+  exports.insert("offsetSeries(polys, deltas, join, limit=1000, autoFix=true, "
+                 "scale=1000000, native=false, parallel=true)", this,
+                 &ClipperModule::offsetSeriesCB);
 
   exports.insert("JOIN_SQUARE", jtSquare);
   exports.insert("JOIN_ROUND", jtRound);
@@ -39,18 +253,81 @@ void ClipperModule::define(js::Sink &exports) {
 }
 
 
-void ClipperModule::offsetCB(const js::Value &args, js::Sink &sink) {
+void ClipperModule::polygonsCB(const js::Value &args, js::Sink &sink) {
   int scale = args.getInteger("scale");
+  write(sink, getPolygons(*args.get("polys"), scale), true);
+}
+
+
+void ClipperModule::pointsCB(const js::Value &args, js::Sink &sink) {
+  int scale = args.getInteger("scale");
+  write(sink, getPolygons(*args.get("polys"), scale), false);
+}
+
+
+void ClipperModule::offsetCB(const js::Value &args, js::Sink &sink) {
+  SmartPointer<Polygons> polys =
+    getPolygons(*args.get("polys"), args.getInteger("scale"));
+  OffsetOptions opts(args, polys->scale);
+
+  write(sink, offset(*polys, args.getNumber("delta"), opts, true),
+        args.getBoolean("native"));
+}
+
+
+void ClipperModule::offsetSeriesCB(const js::Value &args, js::Sink &sink) {
+  SmartPointer<Polygons> polys =
+    getPolygons(*args.get("polys"), args.getInteger("scale"));
+  OffsetOptions opts(args, polys->scale);
+
+  SmartPointer<js::Value> jsDeltas = args.get("deltas");
+  vector<double> deltas;
+  for (unsigned i = 0; i < jsDeltas->length(); i++)
+    deltas.push_back(jsDeltas->getNumber(i));
+
+  // Offset on all cores, the input polygons are shared read only
+  vector<SmartPointer<Polygons> > results(deltas.size());
+  bool parallel = args.getBoolean("parallel");
+  unsigned jobCount = parallel ?
+    std::min((unsigned)deltas.size(), SystemInfo::instance().getCPUCount()) : 1;
+  bool split = parallel && jobCount == 1; // Split the polygons instead
+  vector<SmartPointer<OffsetJob> > jobs;
+
+  for (unsigned i = 0; i < jobCount; i++)
+    jobs.push_back
+      (new OffsetJob(*polys, deltas, opts, i, jobCount, split, results));
+
+  for (unsigned i = 1; i < jobCount; i++) jobs[i]->start();
+  if (jobCount) jobs[0]->run();
+  for (unsigned i = 1; i < jobCount; i++) jobs[i]->join();
+
+  bool native = args.getBoolean("native");
+  sink.beginList();
+  for (unsigned i = 0; i < results.size(); i++) {
+    sink.beginAppend();
+    write(sink, results[i], native);
+  }
+  sink.endList();
+}
+
+
+SmartPointer<ClipperModule::Polygons>
+ClipperModule::getPolygons(const js::Value &jsPolys, int scale) {
+  if (jsPolys.has("polygons")) {
+    int index = jsPolys.getInteger("polygons");
+    if (index < 0 || (int)handles.size() <= index)
+      THROWS("Invalid polygons " << index);
+
+    return handles[index];
+  }
 
   // Convert JavaScript polys to Clipper polys
-  Polygons polys;
-  SmartPointer<js::Value> jsPolys = args.get("polys");
-  bool dict = false;
+  SmartPointer<Polygons> polys = new Polygons(scale);
 
-  for (unsigned i = 0; i < jsPolys->length(); i++) {
-    polys.push_back(Polygon());
-    Polygon &poly = polys.back();
-    SmartPointer<js::Value> jsPoly = jsPolys->get(i);
+  for (unsigned i = 0; i < jsPolys.length(); i++) {
+    polys->polys.push_back(Polygon());
+    Polygon &poly = polys->polys.back();
+    SmartPointer<js::Value> jsPoly = jsPolys.get(i);
 
     for (unsigned j = 0; j < jsPoly->length(); j++) {
       SmartPointer<js::Value> jsPoint = jsPoly->get(j);
@@ -58,7 +335,7 @@ void ClipperModule::offsetCB(const js::Value &args, js::Sink &sink) {
       if (jsPoint->has("x") && jsPoint->has("y")) {
         poly.push_back(IntPoint(jsPoint->getNumber("x") * scale,
                                 jsPoint->getNumber("y") * scale));
-        dict = true;
+        polys->dict = true;
 
       } else if (jsPoint->length() == 2)
         poly.push_back(IntPoint(jsPoint->getNumber(0) * scale,
@@ -68,24 +345,33 @@ void ClipperModule::offsetCB(const js::Value &args, js::Sink &sink) {
     }
   }
 
-  double delta = args.getNumber("delta") * scale;
-  JoinType join =
-    args.has("join") ? (JoinType)args.getInteger("join") : jtRound;
-  double limit = args.getNumber("limit") * scale;
-  bool autoFix = args.getBoolean("autoFix");
+  return polys;
+}
+
 
-  OffsetPolygons(polys, polys, delta, join, limit, autoFix);
+void ClipperModule::write(js::Sink &sink, const SmartPointer<Polygons> &polys,
+                          bool native) {
+  if (native) {
+    handles.push_back(polys);
+
+    sink.beginDict();
+    sink.insert("polygons", (uint32_t)handles.size() - 1);
+    sink.endDict();
+    return;
+  }
 
   // Convert Clipper result back to JavaScript
+  int scale = polys->scale;
+
   sink.beginList();
-  for (unsigned i = 0; i < polys.size(); i++) {
-    Polygon &poly = polys[i];
+  for (unsigned i = 0; i < polys->polys.size(); i++) {
+    const Polygon &poly = polys->polys[i];
     sink.appendList();
 
     for (unsigned j = 0; j < poly.size(); j++) {
-      IntPoint &point = poly[j];
+      const IntPoint &point = poly[j];
 
-      if (dict) {
+      if (polys->dict) {
         sink.appendDict();
         sink.insert("x", (double)point.X / scale);
         sink.insert("y", (double)point.Y / scale);
@@ -22,10 +22,28 @@
 
 
 #include <cbang/js/NativeModule.h>
+#include <cbang/SmartPointer.h>
+
+#include <clipper/clipper.hpp>
+
+#include <vector>
 
 
 namespace tplang {
   class ClipperModule : public cb::js::NativeModule {
+  public:
+    struct Polygons {
+      ClipperLib::Polygons polys;
+      int scale;
+      bool dict;
+
+      Polygons(int scale = 1, bool dict = false) : scale(scale), dict(dict) {}
+    };
+
+  private:
+    // Native polygons stay here, scripts only get their index
+    std::vector<cb::SmartPointer<Polygons> > handles;
+
   public:
     ClipperModule() : cb::js::NativeModule("clipper") {}
 
@@ -33,6 +51,16 @@ namespace tplang {
     void define(cb::js::Sink &exports);
 
     // Javascript call backs
+    void polygonsCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void pointsCB(const cb::js::Value &args, cb::js::Sink &sink);
     void offsetCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void offsetSeriesCB(const cb::js::Value &args, cb::js::Sink &sink);
+
+  protected:
+    /// @return the native polygons of a handle or converted Javascript polys.
+    cb::SmartPointer<Polygons> getPolygons(const cb::js::Value &polys,
+                                           int scale);
+    void write(cb::js::Sink &sink, const cb::SmartPointer<Polygons> &polys,
+               bool native);
   };
 }
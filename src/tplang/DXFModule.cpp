@@ -21,13 +21,9 @@
 #include "DXFModule.h"
 #include "TPLContext.h"
 
-#include <dxf/Reader.h>
-#include <dxf/Point.h>
-#include <dxf/Line.h>
-#include <dxf/Arc.h>
-#include <dxf/PolyLine.h>
-#include <dxf/Spline.h>
+#include <dxf/SplineFlattener.h>
 
+#include <cbang/Exception.h>
 #include <cbang/os/SystemUtilities.h>
 
 using namespace tplang;
@@ -35,11 +31,96 @@ using namespace cb;
 using namespace std;
 
 
+namespace {
+  void insertPoint(js::Sink &sink, const string &key, const double *v) {
+    sink.insertDict(key);
+    sink.insert("x", v[0]);
+    sink.insert("y", v[1]);
+    sink.insert("z", v[2]);
+    sink.endDict();
+  }
+
+
+  void insertPoints(js::Sink &sink, const string &key, const double *v,
+                    unsigned count) {
+    sink.insertList(key);
+
+    for (unsigned i = 0; i < count; i++, v += 3) {
+      sink.appendDict();
+      sink.insert("x", v[0]);
+      sink.insert("y", v[1]);
+      sink.insert("z", v[2]);
+      sink.insert("type", DXF::Entity::DXF_POINT);
+      sink.endDict();
+    }
+
+    sink.endList();
+  }
+
+
+  void appendEntity(js::Sink &sink, const DXF::Layer &layer, unsigned i) {
+    const double *v = layer.getValues(i);
+    DXF::Entity::type_t type = layer.getType(i);
+
+    sink.appendDict();
+
+    switch (type) {
+    case DXF::Entity::DXF_POINT:
+      sink.insert("x", v[0]);
+      sink.insert("y", v[1]);
+      sink.insert("z", v[2]);
+      break;
+
+    case DXF::Entity::DXF_LINE:
+      insertPoint(sink, "start", v);
+      insertPoint(sink, "end", v + 3);
+      break;
+
+    case DXF::Entity::DXF_ARC:
+      insertPoint(sink, "center", v);
+      sink.insert("radius", v[3]);
+      sink.insert("startAngle", v[4]);
+      sink.insert("endAngle", v[5]);
+      sink.insertBoolean("clockwise", v[6]);
+      break;
+
+    case DXF::Entity::DXF_POLYLINE:
+      insertPoints(sink, "vertices", v + 1, v[0]);
+      break;
+
+    case DXF::Entity::DXF_SPLINE: {
+      unsigned ctrlPts = v[1];
+      unsigned knots = v[2];
+
+      sink.insert("degree", (unsigned)v[0]);
+      insertPoints(sink, "ctrlPts", v + 3, ctrlPts);
+
+      sink.insertList("knots");
+      v += 3 + 3 * ctrlPts;
+      for (unsigned k = 0; k < knots; k++) sink.append(v[k]);
+      sink.endList();
+      break;
+    }
+
+    default: THROWS("Invalid DXF entity type " << type);
+    }
+
+    sink.insert("type", type);
+    sink.endDict();
+  }
+}
+
+
 DXFModule::DXFModule(TPLContext &ctx) : js::NativeModule("_dxf"), ctx(ctx) {}
 
 
 void DXFModule::define(js::Sink &exports) {
-  exports.insert("open(path)", this, &DXFModule::openCB);
+  exports.insert("open(path, layers)", this, &DXFModule::openCB);
+  exports.insert("load(path, layers)", this, &DXFModule::loadCB);
+  exports.insert("entities(drawing, layer, region)", this,
+                 &DXFModule::entitiesCB);
+  exports.insert("flatten(spline, tolerance=0.001)", this,
+                 &DXFModule::flattenCB);
 
   exports.insert("POINT",    DXF::Entity::DXF_POINT);
   exports.insert("LINE",     DXF::Entity::DXF_LINE);
@@ -50,122 +131,141 @@ void DXFModule::define(js::Sink &exports) {
 
 
 void DXFModule::openCB(const js::Value &args, js::Sink &sink) {
-  DXF::Reader reader;
-  reader.read(ctx.relativePath(args.getString("path")));
+  SmartPointer<DXF::LayerReader> reader = read(args);
+  const DXF::LayerReader::layers_t &layers = reader->getLayers();
 
-  const DXF::Reader::layers_t &layers = reader.getLayers();
   sink.beginDict();
 
-  DXF::Reader::layers_t::const_iterator it;
+  DXF::LayerReader::layers_t::const_iterator it;
   for (it = layers.begin(); it != layers.end(); it++) {
-    const DXF::Reader::layer_t &layer = it->second;
+    const DXF::Layer &layer = *it->second;
     sink.insertList(it->first);
 
-    for (unsigned j = 0; j < layer.size(); j++) {
-      const DXF::Entity &entity = *layer[j];
-      sink.appendDict();
-
-      switch (entity.getType()) {
-      case DXF::Entity::DXF_POINT: {
-        const DXF::Point &point = dynamic_cast<const DXF::Point &>(entity);
-        sink.insert("x", point.x());
-        sink.insert("y", point.y());
-        sink.insert("z", point.z());
-        break;
-      }
-
-      case DXF::Entity::DXF_LINE: {
-        const DXF::Line &line = dynamic_cast<const DXF::Line &>(entity);
-
-        sink.insertDict("start");
-        sink.insert("x", line.getStart().x());
-        sink.insert("y", line.getStart().y());
-        sink.insert("z", line.getStart().z());
-        sink.endDict();
-
-        sink.insertDict("end");
-        sink.insert("x", line.getEnd().x());
-        sink.insert("y", line.getEnd().y());
-        sink.insert("z", line.getEnd().z());
-        sink.endDict();
-        break;
-      }
-
-      case DXF::Entity::DXF_ARC: {
-        const DXF::Arc &arc = dynamic_cast<const DXF::Arc &>(entity);
-
-        sink.insertDict("center");
-        sink.insert("x", arc.getCenter().x());
-        sink.insert("y", arc.getCenter().y());
-        sink.insert("z", arc.getCenter().z());
-        sink.endDict();
-
-        sink.insert("radius", arc.getRadius());
-        sink.insert("startAngle", arc.getStartAngle());
-        sink.insert("endAngle", arc.getEndAngle());
-        sink.insert("clockwise", arc.getClockwise());
-        break;
-      }
-
-      case DXF::Entity::DXF_POLYLINE: {
-        const DXF::PolyLine &polyLine =
-          dynamic_cast<const DXF::PolyLine &>(entity);
-        const vector<cb::Vector3D> &vertices = polyLine.getVertices();
-        sink.insertList("vertices");
-
-        for (unsigned k = 0; k < vertices.size(); k++) {
-          sink.appendDict();
-          sink.insert("x", vertices[k].x());
-          sink.insert("y", vertices[k].y());
-          sink.insert("z", vertices[k].z());
-          sink.insert("type", DXF::Entity::DXF_POINT);
-          sink.endDict();
-        }
-
-        sink.endList();
-        break;
-      }
-
-      case DXF::Entity::DXF_SPLINE: {
-        const DXF::Spline &spline = dynamic_cast<const DXF::Spline &>(entity);
-
-        sink.insert("degree", spline.getDegree());
-
-        // Control points
-        const vector<cb::Vector3D> &ctrlPts = spline.getControlPoints();
-        sink.insertList("ctrlPts");
-
-        for (unsigned k = 0; k < ctrlPts.size(); k++) {
-          sink.appendDict();
-          sink.insert("x", ctrlPts[k].x());
-          sink.insert("y", ctrlPts[k].y());
-          sink.insert("z", ctrlPts[k].z());
-          sink.insert("type", DXF::Entity::DXF_POINT);
-          sink.endDict();
-        }
-
-        sink.endList();
-
-        // Knots
-        const vector<double> &knots = spline.getKnots();
-        sink.insertList("knots");
-
-        for (unsigned k = 0; k < knots.size(); k++)
-          sink.append(knots[k]);
-
-        sink.endList();
-        break;
-      }
-
-      default: THROWS("Invalid DXF entity type " << entity.getType());
-      }
-
-      sink.insert("type", entity.getType());
-      sink.endDict();
-    }
+    for (unsigned i = 0; i < layer.size(); i++)
+      appendEntity(sink, layer, i);
 
     sink.endList();
   }
 
   sink.endDict();
 }
+
+
+void DXFModule::loadCB(const js::Value &args, js::Sink &sink) {
+  drawings.push_back(read(args));
+  const DXF::LayerReader::layers_t &layers = drawings.back()->getLayers();
+
+  sink.beginDict();
+  sink.insert("drawing", (uint32_t)drawings.size() - 1);
+  sink.insertDict("layers");
+
+  DXF::LayerReader::layers_t::const_iterator it;
+  for (it = layers.begin(); it != layers.end(); it++)
+    sink.insert(it->first, it->second->size());
+
+  sink.endDict();
+  sink.endDict();
+}
+
+
+void DXFModule::entitiesCB(const js::Value &args, js::Sink &sink) {
+  int index = args.getInteger("drawing");
+  if (index < 0 || (int)drawings.size() <= index)
+    THROWS("Invalid DXF drawing " << index);
+
+  const DXF::LayerReader::layers_t &layers = drawings[index]->getLayers();
+  string name = args.getString("layer");
+  DXF::LayerReader::layers_t::const_iterator it = layers.find(name);
+  if (it == layers.end()) THROWS("DXF layer '" << name << "' not loaded");
+
+  const DXF::Layer &layer = *it->second;
+  sink.beginList();
+
+  if (args.has("region")) {
+    SmartPointer<js::Value> region = args.get("region");
+    SmartPointer<js::Value> min = region->get("min");
+    SmartPointer<js::Value> max = region->get("max");
+
+    vector<unsigned> results;
+    layer.find(Rectangle2D(Vector2D(min->getNumber("x"), min->getNumber("y")),
+                           Vector2D(max->getNumber("x"), max->getNumber("y"))),
+               results);
+
+    for (unsigned i = 0; i < results.size(); i++)
+      appendEntity(sink, layer, results[i]);
+
+  } else
+    for (unsigned i = 0; i < layer.size(); i++) appendEntity(sink, layer, i);
+
+  sink.endList();
+}
+
+
+void DXFModule::flattenCB(const js::Value &args, js::Sink &sink) {
+  SmartPointer<js::Value> spline = args.get("spline");
+  double tolerance = args.getNumber("tolerance");
+  unsigned degree = spline->getInteger("degree");
+
+  // The spline's values are the cache key
+  vector<double> key;
+  key.push_back(tolerance);
+  key.push_back(degree);
+
+  vector<Vector3D> ctrlPts;
+  SmartPointer<js::Value> jsCtrlPts = spline->get("ctrlPts");
+  for (unsigned i = 0; i < jsCtrlPts->length(); i++) {
+    SmartPointer<js::Value> p = jsCtrlPts->get(i);
+    ctrlPts.push_back(Vector3D(p->getNumber("x"), p->getNumber("y"),
+                               p->has("z") ? p->getNumber("z") : 0));
+    for (int j = 0; j < 3; j++) key.push_back(ctrlPts.back()[j]);
+  }
+
+  vector<double> knots;
+  if (spline->has("knots")) {
+    SmartPointer<js::Value> jsKnots = spline->get("knots");
+    for (unsigned i = 0; i < jsKnots->length(); i++)
+      knots.push_back(jsKnots->getNumber(i));
+  }
+  key.insert(key.end(), knots.begin(), knots.end());
+
+  spline_cache_t::iterator it = splineCache.find(key);
+
+  if (it == splineCache.end()) {
+    if (maxCachedSplines <= splineCache.size()) splineCache.clear();
+
+    SmartPointer<vector<Vector3D> > points = new vector<Vector3D>;
+    DXF::SplineFlattener(degree, ctrlPts, knots, tolerance).flatten(*points);
+    it = splineCache.insert(make_pair(key, points)).first;
+  }
+
+  const vector<Vector3D> &points = *it->second;
+  sink.beginList();
+
+  for (unsigned i = 0; i < points.size(); i++) {
+    const Vector3D &p = points[i];
+
+    sink.appendDict();
+    sink.insert("x", p.x());
+    sink.insert("y", p.y());
+    sink.insert("z", p.z());
+    sink.insert("type", DXF::Entity::DXF_POINT);
+    sink.endDict();
+  }
+
+  sink.endList();
+}
+
+
+SmartPointer<DXF::LayerReader> DXFModule::read(const js::Value &args) {
+  SmartPointer<DXF::LayerReader> reader = new DXF::LayerReader;
+
+  if (args.has("layers")) {
+    SmartPointer<js::Value> layers = args.get("layers");
+    for (unsigned i = 0; i < layers->length(); i++)
+      reader->want(layers->getString(i));
+  }
+
+  reader->read(ctx.relativePath(args.getString("path")));
+
+  return reader;
+}
@@ -21,7 +21,13 @@
 #pragma once
 
 
+#include <dxf/LayerReader.h>
+
 #include <cbang/js/NativeModule.h>
+#include <cbang/SmartPointer.h>
+
+#include <vector>
+#include <map>
 
 
 namespace tplang {
@@ -30,6 +36,16 @@ namespace tplang {
   class DXFModule : public cb::js::NativeModule {
     TPLContext &ctx;
 
+    // Loaded drawings stay here, scripts only get their index
+    std::vector<cb::SmartPointer<DXF::LayerReader> > drawings;
+
+    // Flattened splines by tolerance, degree, control points and knots
+    typedef std::map<std::vector<double>,
+                     cb::SmartPointer<std::vector<cb::Vector3D> > >
+    spline_cache_t;
+    spline_cache_t splineCache;
+    static const unsigned maxCachedSplines = 65536;
+
   public:
     DXFModule(TPLContext &ctx);
 
@@ -38,5 +54,11 @@ namespace tplang {
 
     // Javascript call backs
     void openCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void loadCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void entitiesCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void flattenCB(const cb::js::Value &args, cb::js::Sink &sink);
+
+  protected:
+    cb::SmartPointer<DXF::LayerReader> read(const cb::js::Value &args);
   };
 }
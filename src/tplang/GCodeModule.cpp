@@ -55,6 +55,9 @@ void GCodeModule::define(js::Sink &exports) {
                  &GCodeModule::rapidCB);
   exports.insert("cut(" AXES ", incremental=false)", this, &GCodeModule::cutCB);
   exports.insert("icut(" AXES ", incremental=true)", this, &GCodeModule::cutCB);
+  exports.insert("cutPolyline(points, feed)", this,
+                 &GCodeModule::cutPolylineCB);
+  exports.insert("cutPath(coords, feed)", this, &GCodeModule::cutPathCB);
   exports.insert("arc(x=0, y=0, z=0, angle, plane, incremental=true)", this,
                  &GCodeModule::arcCB);
   exports.insert("probe(" AXES ", toward=true, error=true, index=0, port=-1, "
@@ -88,6 +91,7 @@ void GCodeModule::define(js::Sink &exports) {
   exports.insert("BALLNOSE", ToolShape::TS_BALLNOSE);
   exports.insert("SPHEROID", ToolShape::TS_SPHEROID);
   exports.insert("SNUBNOSE", ToolShape::TS_SNUBNOSE);
+  exports.insert("PROFILE", ToolShape::TS_PROFILE);
 
 #undef XYZ
 #undef ABC
@@ -104,6 +108,8 @@ MachineUnitAdapter &GCodeModule::getUnitAdapter() {
 
 
 void GCodeModule::gcodeCB(const js::Value &args, js::Sink &sink) {
+  checkNotRecording("gcode()");
+
   string path =
     SystemUtilities::absolute(ctx.getCurrentPath(), args.getString("path"));
 
@@ -117,21 +123,72 @@ void GCodeModule::gcodeCB(const js::Value &args, js::Sink &sink) {
 
 
 void GCodeModule::rapidCB(const js::Value &args, js::Sink &sink) {
-  Axes axes = ctx.machine.getPosition();
+  Axes axes = getPosition();
   parseAxes(args, axes, args.getBoolean("incremental"));
-  ctx.machine.move(axes, true);
+  move(axes, true);
 }
 
 
 void GCodeModule::cutCB(const js::Value &args, js::Sink &sink) {
-  Axes axes = ctx.machine.getPosition();
+  Axes axes = getPosition();
   parseAxes(args, axes, args.getBoolean("incremental"));
-  ctx.machine.move(axes);
+  move(axes);
+}
+
+
+void GCodeModule::cutPolylineCB(const js::Value &args, js::Sink &sink) {
+  // Points are objects of axes, as for cut(), or x, y, z lists
+  setPathFeed(args);
+
+  SmartPointer<js::Value> points = args.get("points");
+  Axes axes = getPosition();
+
+  for (unsigned i = 0; i < points->length(); i++) {
+    SmartPointer<js::Value> point = points->get(i);
+
+    if (point->has("x") || point->has("y") || point->has("z"))
+      parseAxes(*point, axes);
+
+    else {
+      if (3 < point->length()) THROW("Polyline point has more than 3 axes");
+
+      for (unsigned j = 0; j < point->length(); j++) {
+        double value = point->getNumber(j);
+        if (!Math::isfinite(value)) THROWS("xyz"[j] << " position is invalid");
+        axes.set("xyz"[j], value);
+      }
+    }
+
+    move(axes);
+  }
+}
+
+
+void GCodeModule::cutPathCB(const js::Value &args, js::Sink &sink) {
+  // A flat list, or typed array, of x, y, z triples
+  setPathFeed(args);
+
+  SmartPointer<js::Value> coords = args.get("coords");
+  unsigned length = coords->length();
+  if (length % 3) THROW("Path coordinates must be x, y, z triples");
+
+  Axes axes = getPosition();
+
+  for (unsigned i = 0; i < length; i += 3) {
+    for (unsigned j = 0; j < 3; j++) {
+      double value = coords->getNumber(i + j);
+      if (!Math::isfinite(value)) THROWS("xyz"[j] << " position is invalid");
+      axes.set("xyz"[j], value);
+    }
+
+    move(axes);
+  }
 }
 
 
 void GCodeModule::arcCB(const js::Value &args, js::Sink &sink) {
   // TODO Handle 'incremental=false'
+  checkNotRecording("arc()");
 
   cb::Vector3D
     offset(args.getNumber("x"), args.getNumber("y"), args.getNumber("z"));
@@ -143,6 +200,8 @@ void GCodeModule::arcCB(const js::Value &args, js::Sink &sink) {
 
 
 void GCodeModule::probeCB(const js::Value &args, js::Sink &sink) {
+  checkNotRecording("probe()");
+
   bool toward = args.getBoolean("toward");
   bool error = args.getBoolean("error");
   uint32_t index = args.getInteger("index");
@@ -161,6 +220,7 @@ void GCodeModule::probeCB(const js::Value &args, js::Sink &sink) {
 
 
 void GCodeModule::dwellCB(const js::Value &args, js::Sink &sink) {
+  checkNotRecording("dwell()");
   ctx.machine.dwell(args.getNumber("seconds"));
 }
 
@@ -211,6 +271,7 @@ void GCodeModule::speedCB(const js::Value &args, js::Sink &sink) {
   }
 
   // Otherwise set spindle
+  checkNotRecording("speed()");
   spin_mode_t mode = REVOLUTIONS_PER_MINUTE;
   double max = 0;
 
@@ -229,6 +290,7 @@ void GCodeModule::toolCB(const js::Value &args, js::Sink &sink) {
   int number;
 
   if (args.has("number")) {
+    checkNotRecording("tool()");
     number = args.getInteger("number");
     ctx.machine.setTool(number);
 
@@ -256,6 +318,21 @@ void GCodeModule::toolCB(const js::Value &args, js::Sink &sink) {
   sink.insert("diameter", tool.getDiameter() / scale);
   if (tool.getShape() == ToolShape::TS_SNUBNOSE)
     sink.insert("snub_diameter", tool.getSnubDiameter() / scale);
+
+  if (tool.getShape() == ToolShape::TS_PROFILE) {
+    const vector<Vector2D> &profile = tool.getProfile();
+    sink.insertList("profile");
+
+    for (unsigned i = 0; i < profile.size(); i++) {
+      sink.appendList();
+      sink.append(profile[i].x() / scale);
+      sink.append(profile[i].y() / scale);
+      sink.endList();
+    }
+
+    sink.endList();
+  }
+
   sink.endDict();
 }
 
@@ -279,12 +356,13 @@ void GCodeModule::unitsCB(const js::Value &args, js::Sink &sink) {
 
 
 void GCodeModule::pauseCB(const js::Value &args, js::Sink &sink) {
+  checkNotRecording("pause()");
   ctx.machine.pause(args.getBoolean("optional"));
 }
 
 
 void GCodeModule::positionCB(const js::Value &args, js::Sink &sink) {
-  Axes axes = ctx.machine.getPosition();
+  Axes axes = getPosition();
 
   sink.beginDict();
 
@@ -296,6 +374,8 @@ void GCodeModule::positionCB(const js::Value &args, js::Sink &sink) {
 
 
 void GCodeModule::commentCB(const js::Value &args, js::Sink &sink) {
+  checkNotRecording("comment()");
+
   for (unsigned i = 0; i < args.length(); i++)
     ctx.machine.comment(args.getString(i)); // TODO Call JSON.stringify()
 }
@@ -329,6 +409,34 @@ void GCodeModule::workpieceCB(const js::Value &args, js::Sink &sink) {
 }
 
 
+Axes GCodeModule::getPosition() const {
+  // While recording, moves are captured rather than sent to the machine
+  if (ctx.matrixMod.isRecording()) return ctx.matrixMod.getRecordPosition();
+  return ctx.machine.getPosition();
+}
+
+
+void GCodeModule::move(const Axes &axes, bool rapid) {
+  if (ctx.matrixMod.isRecording()) ctx.matrixMod.record(axes, rapid);
+  else ctx.machine.move(axes, rapid);
+}
+
+
+void GCodeModule::checkNotRecording(const char *name) const {
+  if (ctx.matrixMod.isRecording()) THROWS(name << " cannot be recorded");
+}
+
+
+void GCodeModule::setPathFeed(const js::Value &args) {
+  if (!args.has("feed")) return;
+
+  // Keep the feed mode
+  feed_mode_t mode;
+  ctx.machine.getFeed(&mode);
+  ctx.machine.setFeed(args.getNumber("feed"), mode);
+}
+
+
 void GCodeModule::parseAxes(const js::Value &args, Axes &axes,
                             bool incremental) {
   for (const char *axis = "xyzabcuvw"; *axis; axis++) {
@@ -47,6 +47,8 @@ namespace tplang {
     void gcodeCB(const cb::js::Value &args, cb::js::Sink &sink);
     void rapidCB(const cb::js::Value &args, cb::js::Sink &sink);
     void cutCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void cutPolylineCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void cutPathCB(const cb::js::Value &args, cb::js::Sink &sink);
     void arcCB(const cb::js::Value &args, cb::js::Sink &sink);
     void probeCB(const cb::js::Value &args, cb::js::Sink &sink);
     void dwellCB(const cb::js::Value &args, cb::js::Sink &sink);
@@ -60,7 +62,11 @@ namespace tplang {
     void workpieceCB(const cb::js::Value &args, cb::js::Sink &sink);
 
   protected:
+    GCode::Axes getPosition() const;
+    void move(const GCode::Axes &axes, bool rapid = false);
+    void checkNotRecording(const char *name) const;
     void parseAxes(const cb::js::Value &args, GCode::Axes &axes,
                    bool incremental = false);
+    void setPathFeed(const cb::js::Value &args);
   };
 }
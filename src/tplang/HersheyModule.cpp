@@ -0,0 +1,204 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#include "HersheyModule.h"
+#include "TPLContext.h"
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/json/Reader.h>
+#include <cbang/json/Value.h>
+#include <cbang/io/InputSource.h>
+#include <cbang/os/SystemUtilities.h>
+
+#include <mutex>
+#include <cctype>
+#include <cstdlib>
+#include <stdint.h>
+
+using namespace tplang;
+using namespace cb;
+using namespace std;
+
+
+namespace {
+  struct CacheEntry {
+    uint64_t modified;
+    SmartPointer<HersheyModule::fonts_t> fonts;
+  };
+
+
+  mutex cacheLock;
+  map<string, CacheEntry> cache;
+
+
+  // Parses SVG style "M x,y L x,y x,y ..." strokes
+  void parseStrokes(const string &d, HersheyModule::Glyph &glyph) {
+    const char *s = d.c_str();
+
+    while (*s) {
+      if (isspace(*s)) {s++; continue;}
+
+      if (*s == 'M') {
+        glyph.paths.push_back(vector<Vector2D>());
+        s++;
+        continue;
+      }
+
+      if (*s == 'L') {s++; continue;}
+
+      if (glyph.paths.empty()) THROWS("Invalid Hershey path '" << d << "'");
+
+      char *end;
+      double x = strtod(s, &end);
+      if (end == s || *end != ',') THROWS("Invalid Hershey path '" << d << "'");
+      s = end + 1;
+
+      double y = strtod(s, &end);
+      if (end == s) THROWS("Invalid Hershey path '" << d << "'");
+      s = end;
+
+      glyph.paths.back().push_back(Vector2D(x, y));
+    }
+  }
+
+
+  SmartPointer<HersheyModule::fonts_t> parseFonts(const string &path) {
+    SmartPointer<JSON::Value> data = JSON::Reader::parse(InputSource(path));
+    SmartPointer<HersheyModule::fonts_t> fonts = new HersheyModule::fonts_t;
+
+    for (unsigned i = 0; i < data->size(); i++) {
+      const JSON::Value &f = data->getDict(i);
+      HersheyModule::Font &font = (*fonts)[data->keyAt(i)];
+
+      font.name = f.getString("name");
+
+      const JSON::Value &chars = f.getList("chars");
+      font.glyphs.resize(chars.size());
+
+      for (unsigned j = 0; j < chars.size(); j++) {
+        const JSON::Value &c = chars.getDict(j);
+        HersheyModule::Glyph &glyph = font.glyphs[j];
+
+        glyph.offset = c.getNumber("o");
+        parseStrokes(c.getString("d"), glyph);
+      }
+    }
+
+    return fonts;
+  }
+}
+
+
+HersheyModule::HersheyModule(TPLContext &ctx) :
+  js::NativeModule("hershey"), ctx(ctx) {}
+
+
+void HersheyModule::define(js::Sink &exports) {
+  exports.insert("fonts(path)", this, &HersheyModule::fontsCB);
+  exports.insert("glyphs(font, text, path)", this, &HersheyModule::glyphsCB);
+}
+
+
+void HersheyModule::fontsCB(const js::Value &args, js::Sink &sink) {
+  SmartPointer<fonts_t> fonts = getFonts(args);
+
+  sink.beginDict();
+
+  for (fonts_t::const_iterator it = fonts->begin(); it != fonts->end(); it++)
+    sink.insert(it->first, it->second.name);
+
+  sink.endDict();
+}
+
+
+void HersheyModule::glyphsCB(const js::Value &args, js::Sink &sink) {
+  SmartPointer<fonts_t> fonts = getFonts(args);
+
+  string name = args.getString("font");
+  fonts_t::const_iterator it = fonts->find(name);
+  if (it == fonts->end()) THROWS("Hershey font '" << name << "' not found");
+  const Font &font = it->second;
+
+  // One entry per character, empty for those without a glyph
+  string text = args.getString("text");
+
+  sink.beginList();
+
+  for (unsigned i = 0; i < text.length(); i++) {
+    int index = (int)(unsigned char)text[i] - '!';
+
+    sink.appendDict();
+
+    if (0 <= index && index < (int)font.glyphs.size()) {
+      const Glyph &glyph = font.glyphs[index];
+
+      sink.insert("offset", glyph.offset);
+      sink.insertList("paths");
+
+      for (unsigned j = 0; j < glyph.paths.size(); j++) {
+        const vector<Vector2D> &path = glyph.paths[j];
+
+        sink.appendList();
+
+        for (unsigned k = 0; k < path.size(); k++) {
+          sink.appendList();
+          sink.append(path[k].x());
+          sink.append(path[k].y());
+          sink.endList();
+        }
+
+        sink.endList();
+      }
+
+      sink.endList();
+    }
+
+    sink.endDict();
+  }
+
+  sink.endList();
+}
+
+
+SmartPointer<HersheyModule::fonts_t> HersheyModule::load(const string &path) {
+  uint64_t modified = SystemUtilities::getModificationTime(path);
+
+  lock_guard<mutex> lock(cacheLock);
+
+  CacheEntry &entry = cache[path];
+  if (entry.fonts.isNull() || entry.modified != modified) {
+    entry.fonts = parseFonts(path);
+    entry.modified = modified;
+  }
+
+  return entry.fonts;
+}
+
+
+SmartPointer<HersheyModule::fonts_t>
+HersheyModule::getFonts(const js::Value &args) {
+  string path = args.has("path") ?
+    SystemUtilities::absolute(ctx.getCurrentPath(), args.getString("path")) :
+    ctx.findLibFile("hersheytext.json");
+
+  return load(path);
+}
@@ -0,0 +1,69 @@
+/******************************************************************************\
+
+    CAMotics is an Open-Source simulation and CAM software.
+    Copyright (C) 2011-2017 Joseph Coffland <joseph@cauldrondevelopment.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+\******************************************************************************/
+
+
+#pragma once
+
+
+#include <cbang/js/NativeModule.h>
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Vector.h>
+
+#include <vector>
+#include <string>
+#include <map>
+
+
+namespace tplang {
+  class TPLContext;
+
+  class HersheyModule : public cb::js::NativeModule {
+    TPLContext &ctx;
+
+  public:
+    struct Glyph {
+      double offset;
+      std::vector<std::vector<cb::Vector2D> > paths;
+    };
+
+    struct Font {
+      std::string name;
+      std::vector<Glyph> glyphs; ///< From '!'
+    };
+
+    typedef std::map<std::string, Font> fonts_t;
+
+    HersheyModule(TPLContext &ctx);
+
+    // From cb::js::NativeModule
+    void define(cb::js::Sink &exports);
+
+    // Javascript call backs
+    void fontsCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void glyphsCB(const cb::js::Value &args, cb::js::Sink &sink);
+
+    /// Parsed fonts are shared by all contexts and reloaded if the file
+    /// changes, so repeated runs only pay for parsing once.
+    static cb::SmartPointer<fonts_t> load(const std::string &path);
+
+  protected:
+    cb::SmartPointer<fonts_t> getFonts(const cb::js::Value &args);
+  };
+}
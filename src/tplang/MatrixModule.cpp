@@ -21,12 +21,14 @@
 #include "MatrixModule.h"
 #include "TPLContext.h"
 
+#include <cbang/Math.h>
+
 using namespace cb;
 using namespace tplang;
 
 
 MatrixModule::MatrixModule(TPLContext &ctx) :
-  js::NativeModule("matrix"), ctx(ctx), matrix(0) {}
+  js::NativeModule("matrix"), ctx(ctx), matrix(0), recording(false) {}
 
 
 void MatrixModule::define(js::Sink &exports) {
@@ -40,6 +42,12 @@ void MatrixModule::define(js::Sink &exports) {
               &MatrixModule::rotateCB);
   exports.insert("setMatrix(m, matrix)", this, &MatrixModule::setMatrixCB);
   exports.insert("getMatrix(m)", this, &MatrixModule::getMatrixCB);
+  exports.insert("transformPoints(coords, matrix)", this,
+                 &MatrixModule::transformPointsCB);
+  exports.insert("beginRecording()", this, &MatrixModule::beginRecordingCB);
+  exports.insert("endRecording()", this, &MatrixModule::endRecordingCB);
+  exports.insert("replay(recording, transforms)", this,
+                 &MatrixModule::replayCB);
 
   // TODO Consider replacing these with get(X), get(Y), etc.
   exports.insert("getXYZ()", this, &MatrixModule::getXYZ);
@@ -55,6 +63,15 @@ GCode::MachineMatrix &MatrixModule::getMatrix() {
 }
 
 
+void MatrixModule::record(const GCode::Axes &axes, bool rapid) {
+  if (!recording) THROW("Not recording");
+
+  Move move = {axes, rapid, ctx.machine.getFeed()};
+  recordings.back().push_back(move);
+  position = axes;
+}
+
+
 void MatrixModule::pushMatrixCB(const js::Value &args, js::Sink &sink) {
   getMatrix().pushMatrix(parseMatrix(args));
 }
@@ -100,6 +117,73 @@ void MatrixModule::getMatrixCB(const js::Value &args, js::Sink &sink) {
 }
 
 
+void MatrixModule::transformPointsCB(const js::Value &args, js::Sink &sink) {
+  // A flat list, or typed array, of x, y, z triples
+  SmartPointer<js::Value> coords = args.get("coords");
+  unsigned length = coords->length();
+  if (length % 3) THROW("Point coordinates must be x, y, z triples");
+
+  const GCode::TransMatrix &m =
+    getMatrix().getMatrices(parseMatrix(args)).back();
+
+  sink.beginList();
+
+  for (unsigned i = 0; i < length; i += 3) {
+    Vector3D p(coords->getNumber(i), coords->getNumber(i + 1),
+               coords->getNumber(i + 2));
+    p = m.transform(p);
+
+    for (unsigned j = 0; j < 3; j++) sink.append(p[j]);
+  }
+
+  sink.endList();
+}
+
+
+void MatrixModule::beginRecordingCB(const js::Value &args, js::Sink &sink) {
+  if (recording) THROW("Already recording");
+
+  // Moves are captured in the coordinates they were given, untransformed
+  recordings.push_back(moves_t());
+  position = ctx.machine.getPosition();
+  recording = true;
+}
+
+
+void MatrixModule::endRecordingCB(const js::Value &args, js::Sink &sink) {
+  if (!recording) THROW("Not recording");
+  recording = false;
+  sink.write(recordings.size() - 1);
+}
+
+
+void MatrixModule::replayCB(const js::Value &args, js::Sink &sink) {
+  if (recording) THROW("Cannot replay while recording");
+
+  int id = args.getInteger("recording");
+  if (id < 0 || (int)recordings.size() <= id)
+    THROWS("Invalid recording " << id);
+  const moves_t &moves = recordings[id];
+
+  if (!args.has("transforms")) return replay(moves);
+
+  // Emit the recording once per transform, applied on top of the current
+  // matrix, without calling back into Javascript
+  GCode::MachineMatrix &matrix = getMatrix();
+  Matrix4x4D current = matrix.getMatrices(XYZ).back().getMatrix();
+  SmartPointer<js::Value> transforms = args.get("transforms");
+
+  for (unsigned i = 0; i < transforms->length(); i++) {
+    Matrix4x4D t = current * parseTransform(*transforms->get(i));
+
+    matrix.pushMatrix(XYZ);
+    matrix.setMatrix(t, XYZ);
+    replay(moves);
+    matrix.popMatrix(XYZ);
+  }
+}
+
+
 MatrixModule::axes_t MatrixModule::parseMatrix(const js::Value &args) {
   if (!args.has("matrix")) return XYZ;
 
@@ -110,6 +194,47 @@ MatrixModule::axes_t MatrixModule::parseMatrix(const js::Value &args) {
 }
 
 
+Matrix4x4D MatrixModule::parseTransform(const js::Value &transform) {
+  // Either an x, y, z offset or a row major 4x4 matrix
+  unsigned length = transform.length();
+  if (length != 3 && length != 16)
+    THROW("Transform must be an x, y, z offset or 16 matrix values");
+
+  Matrix4x4D m;
+
+  if (length == 3)
+    for (unsigned i = 0; i < 4; i++) {
+      m[i][i] = 1;
+      if (i < 3) m[i][3] = transform.getNumber(i);
+    }
+
+  else
+    for (unsigned i = 0; i < 16; i++)
+      m[i / 4][i % 4] = transform.getNumber(i);
+
+  for (unsigned i = 0; i < 4; i++)
+    for (unsigned j = 0; j < 4; j++)
+      if (!Math::isfinite(m[i][j])) THROW("Transform value is invalid");
+
+  return m;
+}
+
+
+void MatrixModule::replay(const moves_t &moves) {
+  feed_mode_t mode;
+  double feed = ctx.machine.getFeed(&mode);
+
+  for (unsigned i = 0; i < moves.size(); i++) {
+    const Move &move = moves[i];
+
+    if (!move.rapid && move.feed != feed)
+      ctx.machine.setFeed(feed = move.feed, mode);
+
+    ctx.machine.move(move.axes, move.rapid);
+  }
+}
+
+
 void MatrixModule::getXYZ(const js::Value &args, js::Sink &sink) {
   cb::Vector3D v = ctx.machine.getPosition(XYZ);
 
@@ -26,6 +26,8 @@
 
 #include <cbang/js/NativeModule.h>
 
+#include <vector>
+
 
 namespace tplang {
   class TPLContext;
@@ -35,6 +37,18 @@ namespace tplang {
     TPLContext &ctx;
     GCode::MachineMatrix *matrix;
 
+    struct Move {
+      GCode::Axes axes;
+      bool rapid;
+      double feed;
+    };
+
+    typedef std::vector<Move> moves_t;
+    std::vector<moves_t> recordings;
+
+    bool recording;
+    GCode::Axes position;
+
   public:
     MatrixModule(TPLContext &ctx);
 
@@ -43,6 +57,10 @@ namespace tplang {
 
     GCode::MachineMatrix &getMatrix();
 
+    bool isRecording() const {return recording;}
+    const GCode::Axes &getRecordPosition() const {return position;}
+    void record(const GCode::Axes &axes, bool rapid);
+
     // Javascript call backs
     void pushMatrixCB(const cb::js::Value &args, cb::js::Sink &sink);
     void popMatrixCB(const cb::js::Value &args, cb::js::Sink &sink);
@@ -52,6 +70,10 @@ namespace tplang {
     void rotateCB(const cb::js::Value &args, cb::js::Sink &sink);
     void setMatrixCB(const cb::js::Value &args, cb::js::Sink &sink);
     void getMatrixCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void transformPointsCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void beginRecordingCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void endRecordingCB(const cb::js::Value &args, cb::js::Sink &sink);
+    void replayCB(const cb::js::Value &args, cb::js::Sink &sink);
 
     void getXYZ(const cb::js::Value &args, cb::js::Sink &sink);
     void getX(const cb::js::Value &args, cb::js::Sink &sink);
@@ -60,5 +82,7 @@ namespace tplang {
 
   protected:
     axes_t parseMatrix(const cb::js::Value &args);
+    cb::Matrix4x4D parseTransform(const cb::js::Value &transform);
+    void replay(const moves_t &moves);
   };
 }
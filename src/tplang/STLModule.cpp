@@ -22,17 +22,22 @@
 #include "TPLContext.h"
 
 #include <stl/Reader.h>
+#include <stl/MappedReader.h>
 #include <stl/Facet.h>
 
+#include <cbang/Exception.h>
 #include <cbang/io/InputSource.h>
 #include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SystemInfo.h>
 #include <cbang/geom/Segment.h>
 #include <cbang/geom/Rectangle.h>
 #include <cbang/log/Logger.h>
+#include <cbang/os/Thread.h>
 
 #include <limits>
-#include <list>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <cmath>
 
 using namespace tplang;
@@ -170,99 +175,256 @@ namespace {
   }
 
 
-  void contourLevel(js::Sink &sink, const vector<STL::Facet> &facets,
-                    float level) {
-    // Find segments
-    typedef list<Segment2F> segments_t;
-    segments_t segments;
+  // Segment ends closer than this are joined
+  const float joinTolerance = 0.001;
 
-    for (unsigned i = 0; i < facets.size(); i++) {
-      const STL::Facet &f = facets[i];
-      Vector2F p1, p2;
 
-      if ((level < f[0].z() && level < f[1].z() && level < f[2].z()) ||
-          (f[0].z() < level && f[1].z() < level && f[2].z() < level))
-        continue;
+  typedef vector<vector<Vector2F> > contours_t;
 
-      if (findSegment(level, f, p1, p2)) {
-        if (isEqual(p1.x(), p2.x())) {
-          if (p1.y() < p2.y()) {
-            if (f.getNormal().x() < 0) swap(p1, p2);
-          } else if (0 < f.getNormal().x()) swap(p1, p2);
 
-        } else if (isEqual(p1.y(), p2.y())) {
-          if (p1.x() < p2.x()) {
-            if (0 < f.getNormal().y()) swap(p1, p2);
-          } else if (f.getNormal().y() < 0) swap(p1, p2);
+  void orient(const STL::Facet &f, Vector2F &p1, Vector2F &p2) {
+    if (isEqual(p1.x(), p2.x())) {
+      if (p1.y() < p2.y()) {
+        if (f.getNormal().x() < 0) swap(p1, p2);
+      } else if (0 < f.getNormal().x()) swap(p1, p2);
+
+    } else if (isEqual(p1.y(), p2.y())) {
+      if (p1.x() < p2.x()) {
+        if (0 < f.getNormal().y()) swap(p1, p2);
+      } else if (f.getNormal().y() < 0) swap(p1, p2);
+
+    } else if (p1.x() < p2.x() && p1.y() < p2.y()) {
+      if (f.getNormal().x() < 0) swap(p1, p2);
+
+    } else if (p2.x() < p1.x() && p2.y() < p1.y()) {
+      if (0 < f.getNormal().x()) swap(p1, p2);
+
+    } else if (p1.x() < p2.x() && p2.y() < p1.y()) {
+      if (0 < f.getNormal().x()) swap(p1, p2);
+
+    } else if (f.getNormal().x() < 0) swap(p1, p2);
+  }
+
+
+  // Segment starts by grid cell, the cells are the join tolerance wide
+  class StartIndex {
+    typedef unordered_multimap<uint64_t, unsigned> starts_t;
+    starts_t starts;
+
+    static int64_t cell(float x) {return (int64_t)floor(x / joinTolerance);}
+
+    static uint64_t key(int64_t x, int64_t y)
+    {return (uint64_t)x * 73856093 ^ (uint64_t)y * 19349663;}
+
+    static uint64_t key(const Vector2F &p)
+    {return key(cell(p.x()), cell(p.y()));}
+
+  public:
+    void add(const Vector2F &p, unsigned i)
+    {starts.insert(make_pair(key(p), i));}
+
+
+    void remove(const Vector2F &p, unsigned i) {
+      pair<starts_t::iterator, starts_t::iterator> range =
+        starts.equal_range(key(p));
+
+      for (starts_t::iterator it = range.first; it != range.second; it++)
+        if (it->second == i) {
+          starts.erase(it);
+          break;
+        }
+    }
+
+
+    /// @return the first segment starting at @param p or -1.
+    int find(const Vector2F &p, const vector<Segment2F> &segments) const {
+      int64_t x = cell(p.x());
+      int64_t y = cell(p.y());
+      int best = -1;
+
+      for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++) {
+          pair<starts_t::const_iterator, starts_t::const_iterator> range =
+            starts.equal_range(key(x + dx, y + dy));
+
+          for (starts_t::const_iterator it = range.first; it != range.second;
+               it++)
+            if (!distanceBetweenPoints(p, segments[it->second].getStart()) &&
+                (best < 0 || (int)it->second < best))
+              best = it->second;
+        }
+
+      return best;
+    }
+  };
 
-        } else if (p1.x() < p2.x() && p1.y() < p2.y()) {
-          if (f.getNormal().x() < 0) swap(p1, p2);
 
-        } else if (p2.x() < p1.x() && p2.y() < p1.y()) {
-          if (0 < f.getNormal().x()) swap(p1, p2);
+  void findSegments(const STLModule::Model &model, float level,
+                    vector<Segment2F> &segments) {
+    const vector<unsigned> &candidates = model.find(level);
 
-        } else if (p1.x() < p2.x() && p2.y() < p1.y()) {
-          if (0 < f.getNormal().x()) swap(p1, p2);
+    for (unsigned i = 0; i < candidates.size(); i++) {
+      const STL::Facet &f = model.facets[candidates[i]];
+      Vector2F p1, p2;
 
-        } else if (f.getNormal().x() < 0) swap(p1, p2);
+      if ((level < f[0].z() && level < f[1].z() && level < f[2].z()) ||
+          (f[0].z() < level && f[1].z() < level && f[2].z() < level))
+        continue;
 
-        Segment2F seg(p1, p2);
-        segments.push_back(seg);
+      if (findSegment(level, f, p1, p2)) {
+        orient(f, p1, p2);
+        segments.push_back(Segment2F(p1, p2));
       }
     }
+  }
+
+
+  void linkSegments(const vector<Segment2F> &segments, contours_t &contours) {
+    StartIndex starts;
+    for (unsigned i = 0; i < segments.size(); i++)
+      starts.add(segments[i].getStart(), i);
 
-    // Link segments
+    vector<bool> used(segments.size(), false);
+    unsigned remaining = segments.size();
+    unsigned nextFirst = 0;
     bool inLoop = false;
     Vector2F first;
     Vector2F last;
 
-    sink.beginList();
-
-    while (!segments.empty()) {
+    while (remaining) {
       // Start new loop
       if (!inLoop) {
-        inLoop = true;
-        first = segments.begin()->getStart();
-        last = segments.begin()->getEnd();
+        while (used[nextFirst]) nextFirst++;
 
-        sink.appendList();
+        const Segment2F &seg = segments[nextFirst];
+        used[nextFirst] = true;
+        starts.remove(seg.getStart(), nextFirst);
+        remaining--;
 
-        append(sink, first);
-        append(sink, last);
+        inLoop = true;
+        first = seg.getStart();
+        last = seg.getEnd();
 
-        segments.erase(segments.begin());
+        contours.push_back(vector<Vector2F>());
+        contours.back().push_back(first);
+        contours.back().push_back(last);
       }
 
-      // Find next closest segment
-      float best = numeric_limits<float>::max();
-      segments_t::iterator closestIt = segments.end();
+      // Find the next segment, the closest if none joins
+      int next = remaining ? starts.find(last, segments) : -1;
 
-      segments_t::iterator it;
-      for (it = segments.begin(); it != segments.end(); it++) {
-        float dist = distanceBetweenPoints(last, it->getStart());
+      if (next < 0 && remaining) {
+        float best = numeric_limits<float>::max();
 
-        if (dist < best) {
-          closestIt = it;
-          best = dist;
-        }
+        for (unsigned i = nextFirst; i < segments.size(); i++)
+          if (!used[i]) {
+            float dist = distanceBetweenPoints(last, segments[i].getStart());
+
+            if (dist < best) {
+              next = i;
+              best = dist;
+            }
+          }
       }
 
       // Add it
-      if (closestIt != segments.end()) {
-        last = closestIt->getEnd();
-        append(sink, last);
-        segments.erase(closestIt);
+      if (0 <= next) {
+        used[next] = true;
+        starts.remove(segments[next].getStart(), next);
+        remaining--;
+
+        last = segments[next].getEnd();
+        contours.back().push_back(last);
       }
 
       // Detect end of loop
-      if (segments.empty() || !distanceBetweenPoints(last, first)) {
-        sink.endList();
-        inLoop = false;
-      }
+      if (!remaining || !distanceBetweenPoints(last, first)) inLoop = false;
+    }
+  }
+
+
+  void contourLevel(const STLModule::Model &model, float level,
+                    contours_t &contours) {
+    vector<Segment2F> segments;
+    findSegments(model, level, segments);
+    linkSegments(segments, contours);
+  }
+
+
+  void append(js::Sink &sink, const contours_t &contours) {
+    sink.beginList();
+
+    for (unsigned i = 0; i < contours.size(); i++) {
+      sink.appendList();
+      for (unsigned j = 0; j < contours[i].size(); j++)
+        append(sink, contours[i][j]);
+      sink.endList();
     }
 
     sink.endList();
   }
+
+
+  // Slices every jobs-th level, starting at offset
+  class SliceJob : public Thread {
+    const STLModule::Model &model;
+    float start;
+    float delta;
+    unsigned offset;
+    unsigned stride;
+    vector<contours_t> &levels;
+
+  public:
+    SliceJob(const STLModule::Model &model, float start, float delta,
+             unsigned offset, unsigned stride, vector<contours_t> &levels) :
+      model(model), start(start), delta(delta), offset(offset),
+      stride(stride), levels(levels) {}
+
+
+    // From Thread
+    void run() {
+      for (unsigned i = offset; i < levels.size(); i += stride)
+        contourLevel(model, start + delta * i, levels[i]);
+    }
+  };
+}
+
+
+void STLModule::Model::index() {
+  zBuckets.clear();
+  if (facets.empty()) return;
+
+  // About 16 facets per bucket when they are spread evenly
+  unsigned buckets = std::min(std::max(facets.size() / 16, (size_t)1),
+                              (size_t)4096);
+  zMin = bounds.getMin().z();
+  zStep = (bounds.getMax().z() - zMin) / buckets;
+  if (!zStep) zStep = 1;
+
+  zBuckets.resize(buckets);
+
+  for (unsigned i = 0; i < facets.size(); i++) {
+    const STL::Facet &f = facets[i];
+    float low = std::min(f[0].z(), std::min(f[1].z(), f[2].z()));
+    float high = std::max(f[0].z(), std::max(f[1].z(), f[2].z()));
+
+    for (unsigned j = getBucket(low); j <= getBucket(high); j++)
+      zBuckets[j].push_back(i);
+  }
+}
+
+
+unsigned STLModule::Model::getBucket(float z) const {
+  float bucket = floor((z - zMin) / zStep);
+  if (bucket < 0) return 0;
+  if (zBuckets.size() <= bucket) return zBuckets.size() - 1;
+  return bucket;
+}
+
+
+const vector<unsigned> &STLModule::Model::find(float z) const {
+  static const vector<unsigned> none;
+  return zBuckets.empty() ? none : zBuckets[getBucket(z)];
 }
 
 
@@ -274,56 +436,57 @@ void STLModule::define(js::Sink &exports) {
   exports.insert("bounds(stl)", this, &STLModule::bounds);
   exports.insert("contour(stl, level, start, end, steps)", this,
                  &STLModule::contour);
+  exports.insert("facets(stl)", this, &STLModule::facets);
 }
 
 
 void STLModule::open(const js::Value &args, js::Sink &sink) {
-  // Read STL
-  STL::Reader reader(ctx.relativePath(args.getString("path")));
+  // Read STL, mapping files in to memory
+  string path = ctx.relativePath(args.getString("path"));
+  SmartPointer<STL::Source> source;
+
+  try {
+    source = new STL::MappedReader(path,
+                                   SystemInfo::instance().getCPUCount());
+  } catch (const Exception &e) {
+    source = new STL::Reader(path);
+  }
+
+  STL::Source &reader = *source;
 
   // Header
   string name;
   string hash;
   reader.readHeader(name, hash);
 
-  sink.beginDict();
-  sink.insert("name", name);
-  sink.insert("hash", hash);
-
-  // Facets
-  sink.insertList("facets");
+  // Facets are kept in C++, converting them to Javascript is very slow
+  SmartPointer<Model> model = new Model;
 
   while (reader.hasMore()) {
     Vector3F v[3];
     Vector3F normal;
     reader.readFacet(v[0], v[1], v[2], normal);
 
-    sink.appendList();
-    for (int i = 0; i < 3; i++) append(sink, v[i]);
-    append(sink, normal);
-    sink.endList();
+    model->facets.push_back(STL::Facet(v[0], v[1], v[2], normal));
+    for (int i = 0; i < 3; i++) model->bounds.add(v[i]);
   }
 
-  sink.endList();
+  models.push_back(model);
+
+  sink.beginDict();
+  sink.insert("name", name);
+  sink.insert("hash", hash);
+  sink.insert("model", (uint32_t)models.size() - 1);
   sink.endDict();
 }
 
 
 void STLModule::bounds(const js::Value &args, js::Sink &sink) {
-  SmartPointer<js::Value> facets = args.get("stl")->get("facets");
-  Rectangle3F bounds;
-
-  unsigned length = facets->length();
-  for (unsigned i = 0; i < length; i++) {
-    SmartPointer<js::Value> facet = facets->get(i);
-
-    for (unsigned j = 0; j < 3; j++)
-      bounds.add(toVector3F(*facet->get(j)));
-  }
+  SmartPointer<Model> model = getModel(*args.get("stl"));
 
   sink.beginList();
-  append(sink, bounds.getMin());
-  append(sink, bounds.getMax());
+  append(sink, model->bounds.getMin());
+  append(sink, model->bounds.getMax());
   sink.endList();
 }
 
@@ -359,13 +522,15 @@ void STLModule::bounds(const js::Value &args, js::Sink &sink) {
  *  ]
  */
 void STLModule::contour(const js::Value &args, js::Sink &sink) {
-  // Read facets
-  vector<STL::Facet> facets;
-  readFacets(facets, *args.get("stl")->get("facets"));
+  SmartPointer<Model> model = getModel(*args.get("stl"));
+  if (model->zBuckets.empty()) model->index();
 
   // Process one level
-  if (args.get("level")->isNumber())
-    contourLevel(sink, facets, args.getNumber("level"));
+  if (args.get("level")->isNumber()) {
+    contours_t contours;
+    contourLevel(*model, args.getNumber("level"), contours);
+    append(sink, contours);
+  }
 
   // Process multiple levels
   if (args.get("start")->isNumber() && args.get("end")->isNumber() &&
@@ -378,16 +543,65 @@ void STLModule::contour(const js::Value &args, js::Sink &sink) {
 
     float delta = (end - start) / (steps - 1);
 
+    // Slice on all cores
+    vector<contours_t> levels(steps);
+    unsigned jobCount =
+      std::min((unsigned)steps, SystemInfo::instance().getCPUCount());
+    vector<SmartPointer<SliceJob> > jobs;
+
+    for (unsigned i = 0; i < jobCount; i++)
+      jobs.push_back(new SliceJob(*model, start, delta, i, jobCount, levels));
+
+    for (unsigned i = 1; i < jobCount; i++) jobs[i]->start();
+    jobs[0]->run();
+    for (unsigned i = 1; i < jobCount; i++) jobs[i]->join();
+
     sink.beginList();
     for (int i = 0; i < steps; i++) {
-      float level = start + delta * i;
-
       sink.appendDict();
-      sink.insert("Z", level);
+      sink.insert("Z", start + delta * i);
       sink.beginInsert("contours");
-      contourLevel(sink, facets, level);
+      append(sink, levels[i]);
       sink.endDict();
     }
     sink.endList();
   }
 }
+
+
+void STLModule::facets(const js::Value &args, js::Sink &sink) {
+  SmartPointer<Model> model = getModel(*args.get("stl"));
+
+  sink.beginList();
+
+  for (unsigned i = 0; i < model->facets.size(); i++) {
+    const STL::Facet &f = model->facets[i];
+
+    sink.appendList();
+    for (int j = 0; j < 3; j++) append(sink, f[j]);
+    append(sink, f.getNormal());
+    sink.endList();
+  }
+
+  sink.endList();
+}
+
+
+SmartPointer<STLModule::Model> STLModule::getModel(const js::Value &stl) {
+  if (stl.has("model")) {
+    int index = stl.getInteger("model");
+    if (index < 0 || (int)models.size() <= index)
+      THROWS("Invalid STL model " << index);
+
+    return models[index];
+  }
+
+  // Facets built by the script
+  SmartPointer<Model> model = new Model;
+  readFacets(model->facets, *stl.get("facets"));
+
+  for (unsigned i = 0; i < model->facets.size(); i++)
+    for (int j = 0; j < 3; j++) model->bounds.add(model->facets[i][j]);
+
+  return model;
+}
@@ -21,7 +21,13 @@
 #pragma once
 
 
+#include <stl/Facet.h>
+
 #include <cbang/js/NativeModule.h>
+#include <cbang/SmartPointer.h>
+#include <cbang/geom/Rectangle.h>
+
+#include <vector>
 
 
 namespace tplang {
@@ -30,6 +36,26 @@ namespace tplang {
   class STLModule : public cb::js::NativeModule {
     TPLContext &ctx;
 
+  public:
+    struct Model {
+      std::vector<STL::Facet> facets;
+      cb::Rectangle3F bounds;
+
+      // Facets by the Z slices they cross, so a level only tests a few
+      std::vector<std::vector<unsigned> > zBuckets;
+      float zMin;
+      float zStep;
+
+      void index();
+      unsigned getBucket(float z) const;
+      /// @return the facets which may cross @param z.
+      const std::vector<unsigned> &find(float z) const;
+    };
+
+  private:
+    // Opened models stay here, scripts only get their index
+    std::vector<cb::SmartPointer<Model> > models;
+
   public:
     STLModule(TPLContext &ctx);
 
@@ -40,5 +66,10 @@ namespace tplang {
     void open(const cb::js::Value &args, cb::js::Sink &sink);
     void bounds(const cb::js::Value &args, cb::js::Sink &sink);
     void contour(const cb::js::Value &args, cb::js::Sink &sink);
+    void facets(const cb::js::Value &args, cb::js::Sink &sink);
+
+  protected:
+    /// @return the model opened by open() or built from raw facets.
+    cb::SmartPointer<Model> getModel(const cb::js::Value &stl);
   };
 }
@@ -21,6 +21,7 @@
 #include "TPLContext.h"
 
 #include <cbang/Exception.h>
+#include <cbang/String.h>
 #include <cbang/os/SystemUtilities.h>
 
 using namespace std;
@@ -31,7 +32,7 @@ using namespace tplang;
 TPLContext::TPLContext(ostream &out, GCode::MachineInterface &machine,
                        const string &jsImpl) :
   js::Javascript(jsImpl), gcodeMod(*this), matrixMod(*this), dxfMod(*this),
-  stlMod(*this), machine(machine) {
+  stlMod(*this), hersheyMod(*this), machine(machine) {
 
   // Add modules
   define(gcodeMod);
@@ -39,6 +40,7 @@ TPLContext::TPLContext(ostream &out, GCode::MachineInterface &machine,
   define(clipperMod);
   define(dxfMod);
   define(stlMod);
+  define(hersheyMod);
 
   import("gcode", ".");
   import("matrix", ".");
@@ -46,27 +48,43 @@ TPLContext::TPLContext(ostream &out, GCode::MachineInterface &machine,
 
   // Add TPL_PATH search paths
   const char *paths = SystemUtilities::getenv("TPL_PATH");
-  if (paths) addSearchPaths(paths);
+#ifdef _WIN32
+  if (paths) String::tokenize(paths, libPaths, ";");
+#else
+  if (paths) String::tokenize(paths, libPaths, ":");
+#endif
 
   // Add HOME search path
   const char *home = SystemUtilities::getenv("HOME");
-  if (home) addSearchPaths(string(home) + "/.tpl_lib");
+  if (home) libPaths.push_back(string(home) + "/.tpl_lib");
 
   // Add system search paths
   string exeDir =
     SystemUtilities::dirname(SystemUtilities::getExecutablePath());
-  addSearchPaths(exeDir + "/tpl_lib");
-  addSearchPaths("/usr/share/camotics/tpl_lib");
+  libPaths.push_back(exeDir + "/tpl_lib");
+  libPaths.push_back("/usr/share/camotics/tpl_lib");
 #ifdef __APPLE__
-  addSearchPaths(exeDir + "/../Resources/tpl_lib");
+  libPaths.push_back(exeDir + "/../Resources/tpl_lib");
 #endif
 
+  for (unsigned i = 0; i < libPaths.size(); i++) addSearchPaths(libPaths[i]);
+
   // Add .tpl to search extensions
   clearSearchExtensions();
   addSearchExtensions("/package.json .tpl .js .json");
 }
 
 
+string TPLContext::findLibFile(const string &name) const {
+  for (unsigned i = 0; i < libPaths.size(); i++) {
+    string path = libPaths[i] + "/" + name;
+    if (SystemUtilities::exists(path)) return path;
+  }
+
+  THROWS("'" << name << "' not found in TPL library paths");
+}
+
+
 void TPLContext::pushPath(const std::string &path) {
   Javascript::pushPath(path);
   machine.setLocation(FileLocation(path));
@@ -26,6 +26,7 @@
 #include "DXFModule.h"
 #include "ClipperModule.h"
 #include "STLModule.h"
+#include "HersheyModule.h"
 
 #include <gcode/machine/MachineAdapter.h>
 
@@ -33,6 +34,9 @@
 #include <cbang/config/Options.h>
 #include <cbang/json/Value.h>
 
+#include <vector>
+#include <string>
+
 
 namespace tplang {
   class TPLContext : public cb::js::Javascript {
@@ -41,6 +45,9 @@ namespace tplang {
     ClipperModule clipperMod;
     DXFModule dxfMod;
     STLModule stlMod;
+    HersheyModule hersheyMod;
+
+    std::vector<std::string> libPaths;
 
   public:
     GCode::MachineInterface &machine;
@@ -57,6 +64,10 @@ namespace tplang {
       return adapter->find<T>();
     }
 
+    /// @return the path of @param name in the first TPL library directory
+    /// which has it.
+    std::string findLibFile(const std::string &name) const;
+
     // From cb::js::Javascript
     void pushPath(const std::string &path);
     void popPath();
@@ -0,0 +1,32 @@
+import os
+import re
+
+
+# Compare only the machine words, not the file and line numbers
+def machine_words(line):
+    line = re.sub(r'^N\d+ ', '', line)
+    if re.match(r'[FGM]\d', line): return line
+
+
+class Suite:
+    def __init__(self, th):
+        cmd = os.path.abspath(th.path + '/../../gcodetool')
+        checks = [CheckFile('stdout', machine_words), CheckFile('return')]
+
+        # Running every call must write the same GCode, as must parsing in
+        # other threads.  Small chunks split programs inside subroutines.
+        modes = [('NoMemo', ' --memoize=false'),
+                 ('ParseThread', ' --parse-thread'),
+                 ('Chunked', ' --threads=3 --chunk-size=16')]
+
+        # Expected output must be recorded from a real run of the default
+        # mode, with "testHarness init callTests/<name>", not written by hand.
+        for name in ['Offsets', 'Globals', 'WritesGlobals', 'Nested',
+                     'Redefined', 'NamedLocals']:
+            th.Test(name, command = cmd, checks = checks)
+
+            path = th.path + '/' + name
+            for mode, args in modes:
+                th.Test(name + mode, command = cmd + args, checks = checks,
+                        data_dir = path + '/data',
+                        expect_dir = path + '/expect')
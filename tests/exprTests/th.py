@@ -0,0 +1,68 @@
+import os
+import re
+
+
+# Compare only the machine words, not the file and line numbers
+def machine_words(line):
+    line = re.sub(r'^N\d+ ', '', line)
+    if re.match(r'[FGM]\d', line): return line
+
+
+# Compare only the expression errors, without their locations, and the
+# locations of parse errors
+def errors(line):
+    if 'Divide by zero' in line: return 'Divide by zero\n'
+
+    match = re.search(r"Unsupported function '\w+'", line)
+    if match: return match.group(0) + '\n'
+
+    match = re.search(r'(\d+):(\d+)\S*:\s*Expected', line)
+    if match: return 'Line %s column %s\n' % match.groups()
+
+
+# Blank blocks print as empty lines
+def nonblank(line):
+    if line.strip(): return line
+
+
+class Suite:
+    def __init__(self, th):
+        cmd = os.path.abspath(th.path + '/../../gcodetool')
+        checks = [CheckFile('stdout', machine_words),
+                  CheckFile('stderr', errors), CheckFile('return')]
+
+        # The exit code of a failed program is not part of the test
+        error_checks = {
+            'UnknownFunction': [CheckFile('stderr', errors)],
+            'CommentLines': [CheckFile('stdout', machine_words),
+                             CheckFile('stderr', errors)],
+        }
+
+        # The Evaluator must agree with the compiled expressions and the
+        # parse threads with parsing in line.  Small chunks split programs
+        # between their subroutines and loops.
+        modes = [('Evaluator', ' --compile=false'),
+                 ('ParseThread', ' --parse-thread'),
+                 ('Chunked', ' --threads=3 --chunk-size=16')]
+
+        # Expected output must be recorded from a real run of the default
+        # mode, with "testHarness init exprTests/<name>", not written by hand.
+        for name in ['Functions', 'ComputedRefs', 'DivideByZero', 'Named',
+                     'ConstDivideByZero', 'LocalCache', 'UnknownFunction',
+                     'Tokens', 'SimpleBlocks', 'ComputedCodes',
+                     'Numbers', 'CommentLines']:
+            test_checks = error_checks.get(name, checks)
+
+            th.Test(name, command = cmd, checks = test_checks)
+
+            path = th.path + '/' + name
+            for mode, args in modes:
+                th.Test(name + mode, command = cmd + args,
+                        checks = test_checks, data_dir = path + '/data',
+                        expect_dir = path + '/expect')
+
+        # Folded constants must print as they were written, so the expected
+        # output is a copy of the input
+        th.Test('Folded', command = cmd + ' --parse',
+                checks = [CheckFile('stdout', nonblank), CheckFile('stderr'),
+                          CheckFile('return')])
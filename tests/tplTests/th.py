@@ -6,5 +6,8 @@ class Suite:
     def __init__(self, th):
         cmd = os.path.abspath(th.path + '/../../tplang')
 
+        # Expected output must be recorded from a real run, with
+        # "testHarness init tplTests/<name>", not written by hand.  A test
+        # without it fails until it is recorded.
         for test in glob.glob('*Test'):
             th.Test(test, command = cmd)
@@ -140,54 +140,6 @@ function bounds_dims(bounds) {
 }
 
 
-function quad_bezier(p, t) {
-  var c = [sqr(1 - t), 2 * (1 - t) * t, sqr(t)];
-
-  return {
-    x: c[0] * p[0].x + c[1] * p[1].x + c[2] * p[2].x,
-    y: c[0] * p[0].y + c[1] * p[1].y + c[2] * p[2].y
-  }
-}
-
-
-function quad_bezier_length(p) {
-  var l = 0;
-  var v = p[0];
-
-  for (var i = 1; i <= 100; i++) {
-    var u = quad_bezier(p, 0.01 * i);
-    l += distance2D(v, u);
-    v = u;
-  }
-
-  return l;
-}
-
-
-function cubic_bezier(p, t) {
-  var c = [cube(1 - t), 3 * sqr(1 - t) * t, 3 * (1 - t) * sqr(t), cube(t)];
-
-  return {
-    x: c[0] * p[0].x + c[1] * p[1].x + c[2] * p[2].x + c[3] * p[3].x,
-    y: c[0] * p[0].y + c[1] * p[1].y + c[2] * p[2].y + c[3] * p[3].y
-  }
-}
-
-
-function cubic_bezier_length(p) {
-  var l = 0;
-  var v = p[0];
-
-  for (var i = 1; i <= 100; i++) {
-    var u = cubic_bezier(p, 0.01 * i);
-    l += distance2D(v, u);
-    v = u;
-  }
-
-  return l;
-}
-
-
 function extend(target, source) {
   for (var i in source)
     if (source.hasOwnProperty(i))
@@ -199,6 +151,7 @@ function extend(target, source) {
 
 module.exports = extend({
   arc_error: 0.0001, // In length units
+  spline_error: 0.01, // In mm
 
 
   // Vertices ******************************************************************
@@ -383,30 +336,12 @@ module.exports = extend({
 
 
   spline_cut: function(s, res) {
-    if (typeof res == 'undefined') res = units() == METRIC ? 1 : 1 / 25.4;
-
-    if (s.degree == 2) {
-      var steps = Math.ceil(quad_bezier_length(s.ctrlPts) / res);
-      var delta = 1 / steps;
-
-      for (var i = 0; i < steps; i++) {
-        v = quad_bezier(s.ctrlPts, delta * (i + 1));
-        cut(v.x, v.y);
-      }
-
-
-    } else if (s.degree == 3) {
-      var steps = Math.ceil(cubic_bezier_length(s.ctrlPts) / res);
-      var delta = 1 / steps;
-
-      for (var i = 0; i < steps; i++) {
-        var v = cubic_bezier(s.ctrlPts, delta * (i + 1));
-        cut(v.x, v.y);
-      }
+    // Flattened natively, res is the allowed deviation from the curve
+    if (typeof res == 'undefined')
+      res = this.spline_error / (units() == METRIC ? 1 : 25.4);
 
-    } else
-      for (var i = 1; i < s.ctrlPts.length; i++)
-        cut(s.ctrlPts[i].x, s.ctrlPts[i].y);
+    var v = this.flatten(s, res);
+    for (var i = 1; i < v.length; i++) cut(v[i].x, v[i].y);
   },
 
 